@@ -0,0 +1,271 @@
+
+#include "AppendBufferBenchmark.hpp"
+#include "BeamInstanceList.hpp"
+#include "ParallelFor.hpp"
+#include "RayTracingSampling.hpp"
+#include "../Shaders/util/BeamInstance.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // random walks of beams from the origin, every beam ending on a surface
+        BeamEmissionLaunches CreateEmissions(const AppendBufferBenchmarkSettings& settings)
+        {
+            std::mt19937 generator(4321);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+            BeamEmissionLaunches launches(settings.numLaunches);
+            for (auto& emissions : launches)
+            {
+                const uint32_t numBeams = 1 + generator() % std::max(settings.maxBeamsPerLaunch, 1u);
+                float3 position = float3(0.0f);
+
+                for (uint32_t i = 0; i < numBeams; i++)
+                {
+                    BeamEmission emission = {};
+                    emission.direction = uniformSamplingSphereFromUV(float2(unit(generator), unit(generator)));
+                    emission.hitNormal = uniformSamplingSphereFromUV(float2(unit(generator), unit(generator)));
+                    emission.airSubBeams = true;
+                    emission.surfacePhoton = true;
+
+                    emission.beam.startPos = position.ToXMFLOAT3();
+                    position = position + emission.direction * (10.0f * unit(generator));
+                    emission.beam.endPos = position.ToXMFLOAT3();
+                    emission.beam.lightColor = XMFLOAT3(1.0f, 1.0f, 1.0f);
+
+                    emissions.push_back(emission);
+                }
+            }
+
+            return launches;
+        }
+
+        void AppendGlobalAtomic(
+            const BeamEmissionLaunches& launches,
+            const PushConstantBeam& pc,
+            uint32_t numThreads,
+            BeamInstanceList& list
+        )
+        {
+            list.beams.resize(pc.maxNumBeams);
+            list.instances.resize(pc.maxNumSubBeams);
+
+            std::atomic<uint64_t> beamCounter(0);
+            std::atomic<uint64_t> subBeamCounter(0);
+
+            ParallelFor(numThreads, launches.size(), [&](uint32_t, uint64_t begin, uint64_t end)
+            {
+                for (uint64_t launch = begin; launch < end; launch++)
+                {
+                    for (const auto& emission : launches[launch])
+                    {
+                        const uint32_t numInstances = CountBeamInstances(emission, pc, SubBeamSplitMode::Uniform);
+                        if (numInstances < 1)
+                            break;
+
+                        const uint64_t beamIndex = beamCounter.fetch_add(1, std::memory_order_relaxed);
+                        if (beamIndex >= pc.maxNumBeams)
+                            break;
+
+                        list.beams[beamIndex] = EmittedBeam(emission, pc);
+
+                        const uint64_t subBeamIndex = subBeamCounter.fetch_add(numInstances, std::memory_order_relaxed);
+                        if (subBeamIndex + numInstances > pc.maxNumSubBeams)
+                            break;
+
+                        WriteBeamInstances(emission, uint32_t(beamIndex), pc, SubBeamSplitMode::Uniform, list.instances.data() + subBeamIndex);
+                    }
+                }
+            });
+
+            list.requestedBeams = beamCounter;
+            list.requestedInstances = subBeamCounter;
+            list.beams.resize(std::min<uint64_t>(list.requestedBeams, pc.maxNumBeams));
+            list.instances.resize(std::min<uint64_t>(list.requestedInstances, pc.maxNumSubBeams));
+        }
+
+        void AppendPerThreadMerge(
+            const BeamEmissionLaunches& launches,
+            const PushConstantBeam& pc,
+            uint32_t numThreads,
+            BeamInstanceList& list
+        )
+        {
+            std::vector<BeamInstanceList> threadLists(numThreads);
+
+            // instance ids are indices in the beam list of the thread until the merge
+            ParallelFor(numThreads, launches.size(), [&](uint32_t threadIndex, uint64_t begin, uint64_t end)
+            {
+                BeamInstanceList& threadList = threadLists[threadIndex];
+
+                for (uint64_t launch = begin; launch < end; launch++)
+                {
+                    for (const auto& emission : launches[launch])
+                    {
+                        const uint32_t numInstances = CountBeamInstances(emission, pc, SubBeamSplitMode::Uniform);
+                        if (numInstances < 1)
+                            break;
+
+                        const size_t instanceIndex = threadList.instances.size();
+                        threadList.instances.resize(instanceIndex + numInstances);
+                        WriteBeamInstances(emission, uint32_t(threadList.beams.size()), pc, SubBeamSplitMode::Uniform, threadList.instances.data() + instanceIndex);
+
+                        threadList.beams.push_back(EmittedBeam(emission, pc));
+                    }
+                }
+            });
+
+            std::vector<uint64_t> beamBase(numThreads);
+            std::vector<uint64_t> instanceBase(numThreads);
+            uint64_t numBeams = 0;
+            uint64_t numInstances = 0;
+            for (uint32_t threadIndex = 0; threadIndex < numThreads; threadIndex++)
+            {
+                beamBase[threadIndex] = numBeams;
+                instanceBase[threadIndex] = numInstances;
+                numBeams += threadLists[threadIndex].beams.size();
+                numInstances += threadLists[threadIndex].instances.size();
+            }
+
+            list.beams.resize(numBeams);
+            list.instances.resize(numInstances);
+
+            ParallelFor(numThreads, numThreads, [&](uint32_t, uint64_t begin, uint64_t end)
+            {
+                for (uint64_t threadIndex = begin; threadIndex < end; threadIndex++)
+                {
+                    const BeamInstanceList& threadList = threadLists[threadIndex];
+                    std::copy(threadList.beams.begin(), threadList.beams.end(), list.beams.begin() + beamBase[threadIndex]);
+
+                    for (size_t i = 0; i < threadList.instances.size(); i++)
+                    {
+                        ShaderRayTracingTopASInstanceDesc desc = threadList.instances[i];
+                        uint32_t beamIndex = unpackInstanceCustomIndex(desc.instanceCustomIndexAndmask) + uint32_t(beamBase[threadIndex]);
+                        desc.instanceCustomIndexAndmask = packInstanceCustomIndexAndMask(beamIndex, unpackInstanceMask(desc.instanceCustomIndexAndmask));
+                        list.instances[instanceBase[threadIndex] + i] = desc;
+                    }
+                }
+            });
+
+            list.requestedBeams = numBeams;
+            list.requestedInstances = numInstances;
+        }
+    }
+
+    const char* AppendStrategyName(AppendStrategy strategy)
+    {
+        switch (strategy)
+        {
+        case AppendStrategy::GlobalAtomic:
+            return "global atomic";
+        case AppendStrategy::Chunked:
+            return "chunked";
+        case AppendStrategy::PerThreadMerge:
+            return "per thread merge";
+        }
+        return "";
+    }
+
+    std::vector<AppendBufferBenchmarkResult> RunAppendBufferBenchmark(const AppendBufferBenchmarkSettings& settings)
+    {
+        const BeamEmissionLaunches launches = CreateEmissions(settings);
+
+        PushConstantBeam pc = {};
+        pc.beamRadius = 0.6f;
+        pc.photonRadius = 0.5f;
+        pc.beamBlasAddress = 1;
+        pc.photonBlasAddress = 2;
+
+        // capacities holding every beam, with the slack of a partially filled chunk per thread,
+        // so all strategies store the same records
+        for (const auto& emissions : launches)
+        {
+            for (const auto& emission : emissions)
+            {
+                pc.maxNumBeams++;
+                pc.maxNumSubBeams += CountBeamInstances(emission, pc, SubBeamSplitMode::Uniform);
+            }
+        }
+
+        const uint32_t maxThreads = settings.threadCounts.empty() ? 1 : *std::max_element(settings.threadCounts.begin(), settings.threadCounts.end());
+        pc.maxNumBeams += uint64_t(maxThreads) * settings.chunkSize;
+        pc.maxNumSubBeams += uint64_t(maxThreads) * settings.chunkSize;
+
+        std::vector<AppendBufferBenchmarkResult> results;
+        const uint32_t hardwareThreads = ResolveThreadCount(0);
+
+        for (uint32_t numThreads : settings.threadCounts)
+        {
+            for (AppendStrategy strategy : { AppendStrategy::GlobalAtomic, AppendStrategy::Chunked, AppendStrategy::PerThreadMerge })
+            {
+                AppendBufferBenchmarkResult result;
+                result.strategy = strategy;
+                result.numThreads = numThreads;
+                result.hardwareThreads = hardwareThreads;
+
+                for (uint32_t pass = 0; pass < settings.numPasses; pass++)
+                {
+                    BeamInstanceList list;
+                    auto start = std::chrono::steady_clock::now();
+
+                    switch (strategy)
+                    {
+                    case AppendStrategy::GlobalAtomic:
+                        AppendGlobalAtomic(launches, pc, numThreads, list);
+                        break;
+                    case AppendStrategy::Chunked:
+                        BuildBeamInstanceListChunked(launches, pc, SubBeamSplitMode::Uniform, list, numThreads, settings.chunkSize);
+                        break;
+                    case AppendStrategy::PerThreadMerge:
+                        AppendPerThreadMerge(launches, pc, numThreads, list);
+                        break;
+                    }
+
+                    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    if (pass == 0 || seconds < result.seconds)
+                        result.seconds = seconds;
+
+                    result.numBeams = list.beams.size();
+                    result.numInstances = list.instances.size();
+                }
+
+                result.recordsPerSecond = result.seconds > 0.0 ? double(result.numBeams + result.numInstances) / result.seconds : 0.0;
+                results.push_back(result);
+            }
+        }
+
+        return results;
+    }
+
+    std::string FormatAppendBufferBenchmarkResults(const std::vector<AppendBufferBenchmarkResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-17s threads %3u  beams %9llu  instances %10llu  %9.3f ms  %8.2f Mrecords/s%s\n",
+                AppendStrategyName(result.strategy),
+                result.numThreads,
+                static_cast<unsigned long long>(result.numBeams),
+                static_cast<unsigned long long>(result.numInstances),
+                result.seconds * 1e3,
+                result.recordsPerSecond * 1e-6,
+                result.numThreads > result.hardwareThreads ? "  oversubscribed, no contention measured" : ""
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
@@ -0,0 +1,61 @@
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Contention benchmark of the strategies appending the beams and sub-beam instances of BeamGen.hlsl from many threads.
+//  GlobalAtomic    one atomic add per beam and one per sub-beam group on two global counters, as BeamGen.hlsl does
+//  Chunked         ChunkedAppendBuffer writers, one atomic add per chunk, then a compaction
+//  PerThreadMerge  a vector per thread, then a prefix sum over the threads and a parallel copy
+// Every strategy starts from the same emissions, built once with random beams, and ends with dense lists.
+// The threads only contend when they run at the same time, the rows with more threads than the machine has cores
+// measure the cost of the strategies time sliced, not their contention, and are marked in the output.
+namespace CpuReference
+{
+    enum class AppendStrategy
+    {
+        GlobalAtomic,
+        Chunked,
+        PerThreadMerge,
+    };
+
+    const char* AppendStrategyName(AppendStrategy strategy);
+
+    struct AppendBufferBenchmarkSettings
+    {
+        std::vector<uint32_t> threadCounts = { 1, 2, 4, 8, 16, 32, 64 };
+
+        uint32_t numLaunches = 1u << 16;
+
+        // beams per launch are uniform in [1, maxBeamsPerLaunch]
+        uint32_t maxBeamsPerLaunch = 8;
+
+        uint32_t chunkSize = 256;
+
+        // the best of the passes is reported
+        uint32_t numPasses = 3;
+    };
+
+    struct AppendBufferBenchmarkResult
+    {
+        AppendStrategy strategy;
+        uint32_t numThreads = 0;
+
+        // std::thread::hardware_concurrency() of the machine the result was measured on
+        uint32_t hardwareThreads = 0;
+
+        uint64_t numBeams = 0;
+        uint64_t numInstances = 0;
+
+        // appending, compaction or merge included
+        double seconds = 0.0;
+        double recordsPerSecond = 0.0;
+    };
+
+    std::vector<AppendBufferBenchmarkResult> RunAppendBufferBenchmark(const AppendBufferBenchmarkSettings& settings = {});
+
+    // one line per result
+    std::string FormatAppendBufferBenchmarkResults(const std::vector<AppendBufferBenchmarkResult>& results);
+}
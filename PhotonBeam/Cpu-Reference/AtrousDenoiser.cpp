@@ -0,0 +1,980 @@
+#include "AtrousDenoiser.hpp"
+#include "BeamGather.hpp"
+#include "BeamOcclusion.hpp"
+#include "CornellScene.hpp"
+#include "ParallelFor.hpp"
+#include "PhotonPlanes.hpp"
+#include "RayTracingSampling.hpp"
+#include "../Shaders/util/FastMath.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace CpuReference
+{
+    namespace
+    {
+        // the frames of the reference start this far from the noisy frame, the photons this far from the beams
+        constexpr uint32_t c_referenceSeedOffset = 1u << 24;
+        constexpr uint32_t c_photonSeedOffset = 1u << 20;
+
+        // B3 spline
+        constexpr float c_atrousKernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+
+        // Lane types of the filter, the interface of the lane types of BeamSoA.cpp with the exp of util/FastMath.h.
+        // The AVX2 exp takes the steps of fastExp(), so both lanes give the same image.
+        struct ScalarLanes
+        {
+            using F = float;
+            static constexpr uint32_t Width = 1;
+            static constexpr const char* Name = "Scalar";
+
+            static F LoadF(const float* p) { return *p; }
+            static void StoreF(float* p, F a) { *p = a; }
+            static F SetF(float a) { return a; }
+
+            static F Add(F a, F b) { return a + b; }
+            static F Sub(F a, F b) { return a - b; }
+            static F Mul(F a, F b) { return a * b; }
+            static F Div(F a, F b) { return a / b; }
+            static F Exp(F a) { return fastExp(a); }
+        };
+
+#if defined(__AVX2__)
+        struct Avx2Lanes
+        {
+            using F = __m256;
+            static constexpr uint32_t Width = 8;
+            static constexpr const char* Name = "AVX2";
+
+            // the taps are not aligned to the blocks
+            static F LoadF(const float* p) { return _mm256_loadu_ps(p); }
+            static void StoreF(float* p, F a) { _mm256_storeu_ps(p, a); }
+            static F SetF(float a) { return _mm256_set1_ps(a); }
+
+            static F Add(F a, F b) { return _mm256_add_ps(a, b); }
+            static F Sub(F a, F b) { return _mm256_sub_ps(a, b); }
+            static F Mul(F a, F b) { return _mm256_mul_ps(a, b); }
+            static F Div(F a, F b) { return _mm256_div_ps(a, b); }
+
+            static F Exp(F a)
+            {
+                F x = _mm256_mul_ps(a, _mm256_set1_ps(FAST_MATH_LOG2E));
+                x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-127.0f)), _mm256_set1_ps(128.0f));
+
+                const __m256i xi = _mm256_sub_epi32(_mm256_cvttps_epi32(_mm256_add_ps(x, _mm256_set1_ps(128.0f))), _mm256_set1_epi32(128));
+                const F f = _mm256_sub_ps(x, _mm256_cvtepi32_ps(xi));
+
+                F p = _mm256_set1_ps(0.00187757277f);
+                p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.00898934470f));
+                p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.0558263192f));
+                p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.240153614f));
+                p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.693153074f));
+                p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.999999925f));
+
+                return _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(xi, _mm256_set1_epi32(127)), 23)));
+            }
+        };
+
+        using SimdLanes = Avx2Lanes;
+#else
+        using SimdLanes = ScalarLanes;
+#endif
+
+        // the planes of an iteration, in the layout of the denoiser
+        struct AtrousPlanes
+        {
+            uint32_t width;
+            uint32_t height;
+            uint32_t pad;
+            uint32_t stride;
+
+            const float* normalX;
+            const float* normalY;
+            const float* normalZ;
+            const float* depth;
+            const float* invDepthSquare;
+            const float* valid;
+        };
+
+        struct AtrousPass
+        {
+            const float* srcR;
+            const float* srcG;
+            const float* srcB;
+            float* dstR;
+            float* dstG;
+            float* dstB;
+
+            // 1 / (variance + floor^2) of the mean channel around every pixel, see EstimateColorScale()
+            const float* colorScale;
+
+            // 1 / sigma^2 of the edge-stopping functions, 0 turns one off
+            float colorCoff;
+            float normalCoff;
+            float depthCoff;
+        };
+
+        // one row of an iteration, the blocks past the width run into the pad
+        template <class L, bool UseNormals>
+        void FilterAtrousRow(const AtrousPlanes& planes, const AtrousPass& pass, uint32_t y, uint32_t step)
+        {
+            using F = typename L::F;
+            const size_t rowStart = size_t(y) * planes.stride + planes.pad;
+            const F centerWeight = L::SetF(c_atrousKernel[2] * c_atrousKernel[2]);
+            const F colorCoff = L::SetF(pass.colorCoff);
+            const F normalCoff = L::SetF(pass.normalCoff);
+            const F zero = L::SetF(0.0f);
+
+            for (uint32_t x = 0; x < planes.width; x += L::Width)
+            {
+                const size_t p = rowStart + x;
+                const F r = L::LoadF(pass.srcR + p);
+                const F g = L::LoadF(pass.srcG + p);
+                const F b = L::LoadF(pass.srcB + p);
+                const F z = L::LoadF(planes.depth + p);
+                const F depthCoff = L::Mul(L::LoadF(planes.invDepthSquare + p), L::SetF(pass.depthCoff));
+                const F colorScale = L::Mul(L::LoadF(pass.colorScale + p), colorCoff);
+
+                F nx = zero;
+                F ny = zero;
+                F nz = zero;
+                if constexpr (UseNormals)
+                {
+                    nx = L::LoadF(planes.normalX + p);
+                    ny = L::LoadF(planes.normalY + p);
+                    nz = L::LoadF(planes.normalZ + p);
+                }
+
+                F sumR = L::Mul(r, centerWeight);
+                F sumG = L::Mul(g, centerWeight);
+                F sumB = L::Mul(b, centerWeight);
+                F sumWeight = centerWeight;
+
+                for (int32_t ty = -2; ty <= 2; ty++)
+                {
+                    const int64_t yq = int64_t(y) + int64_t(ty) * step;
+                    if (yq < 0 || yq >= int64_t(planes.height))
+                        continue;
+
+                    for (int32_t tx = -2; tx <= 2; tx++)
+                    {
+                        if (tx == 0 && ty == 0)
+                            continue;
+
+                        const size_t q = size_t(yq) * planes.stride + planes.pad + x + int64_t(tx) * step;
+                        const F dr = L::Sub(L::LoadF(pass.srcR + q), r);
+                        const F dg = L::Sub(L::LoadF(pass.srcG + q), g);
+                        const F db = L::Sub(L::LoadF(pass.srcB + q), b);
+                        const F dz = L::Sub(L::LoadF(planes.depth + q), z);
+
+                        F exponent = L::Mul(L::Add(L::Add(L::Mul(dr, dr), L::Mul(dg, dg)), L::Mul(db, db)), colorScale);
+                        exponent = L::Add(exponent, L::Mul(L::Mul(dz, dz), depthCoff));
+                        if constexpr (UseNormals)
+                        {
+                            const F dnx = L::Sub(L::LoadF(planes.normalX + q), nx);
+                            const F dny = L::Sub(L::LoadF(planes.normalY + q), ny);
+                            const F dnz = L::Sub(L::LoadF(planes.normalZ + q), nz);
+                            exponent = L::Add(exponent, L::Mul(L::Add(L::Add(L::Mul(dnx, dnx), L::Mul(dny, dny)), L::Mul(dnz, dnz)), normalCoff));
+                        }
+
+                        const F kernel = L::Mul(L::SetF(c_atrousKernel[ty + 2] * c_atrousKernel[tx + 2]), L::LoadF(planes.valid + q));
+                        const F weight = L::Mul(kernel, L::Exp(L::Sub(zero, exponent)));
+
+                        sumR = L::Add(sumR, L::Mul(L::LoadF(pass.srcR + q), weight));
+                        sumG = L::Add(sumG, L::Mul(L::LoadF(pass.srcG + q), weight));
+                        sumB = L::Add(sumB, L::Mul(L::LoadF(pass.srcB + q), weight));
+                        sumWeight = L::Add(sumWeight, weight);
+                    }
+                }
+
+                L::StoreF(pass.dstR + p, L::Div(sumR, sumWeight));
+                L::StoreF(pass.dstG + p, L::Div(sumG, sumWeight));
+                L::StoreF(pass.dstB + p, L::Div(sumB, sumWeight));
+            }
+        }
+
+        template <class L>
+        void FilterAtrousRows(const AtrousPlanes& planes, const AtrousPass& pass, bool useNormals, uint64_t begin, uint64_t end, uint32_t step)
+        {
+            for (uint64_t y = begin; y < end; y++)
+            {
+                if (useNormals)
+                    FilterAtrousRow<L, true>(planes, pass, uint32_t(y), step);
+                else
+                    FilterAtrousRow<L, false>(planes, pass, uint32_t(y), step);
+            }
+        }
+
+        // Sums of the mean channel m and m^2 and the number of valid pixels over the 5 pixels of the row around every
+        // pixel, to the three sum planes.
+        void SumColorWindowRows(const AtrousPlanes& planes, const float* r, const float* g, const float* b, float* sums[3], uint64_t begin, uint64_t end)
+        {
+            for (uint64_t y = begin; y < end; y++)
+            {
+                const size_t rowStart = size_t(y) * planes.stride + planes.pad;
+                for (uint32_t x = 0; x < planes.width; x++)
+                {
+                    float sum = 0.0f;
+                    float sumSquare = 0.0f;
+                    float count = 0.0f;
+                    for (int32_t dx = -2; dx <= 2; dx++)
+                    {
+                        const size_t q = rowStart + x + dx;
+                        const float mean = (r[q] + g[q] + b[q]) * (1.0f / 3.0f) * planes.valid[q];
+                        sum += mean;
+                        sumSquare += mean * mean;
+                        count += planes.valid[q];
+                    }
+
+                    sums[0][rowStart + x] = sum;
+                    sums[1][rowStart + x] = sumSquare;
+                    sums[2][rowStart + x] = count;
+                }
+            }
+        }
+
+        // 1 / (variance + floor^2) of the mean channel over the 5x5 window of every pixel from the row sums. The
+        // edge-stopping of the color takes the differences relative to the noise around the pixel, not to its value,
+        // which would keep the dark pixels from taking the bright samples around them.
+        void EstimateColorScale(const AtrousPlanes& planes, float* const sums[3], float floorSquare, float* colorScale, uint64_t begin, uint64_t end)
+        {
+            for (uint64_t y = begin; y < end; y++)
+            {
+                const size_t rowStart = size_t(y) * planes.stride + planes.pad;
+                for (uint32_t x = 0; x < planes.width; x++)
+                {
+                    float sum = 0.0f;
+                    float sumSquare = 0.0f;
+                    float count = 0.0f;
+                    for (int32_t dy = -2; dy <= 2; dy++)
+                    {
+                        const int64_t yq = int64_t(y) + dy;
+                        if (yq < 0 || yq >= int64_t(planes.height))
+                            continue;
+
+                        const size_t q = size_t(yq) * planes.stride + planes.pad + x;
+                        sum += sums[0][q];
+                        sumSquare += sums[1][q];
+                        count += sums[2][q];
+                    }
+
+                    const float mean = sum / count;
+                    const float variance = std::max(0.0f, sumSquare / count - mean * mean);
+                    colorScale[rowStart + x] = 1.0f / (variance + floorSquare);
+                }
+            }
+        }
+
+        float ToFinite(float value)
+        {
+            return std::isfinite(value) ? value : 0.0f;
+        }
+
+        float InverseSquare(float sigma)
+        {
+            return sigma > 0.0f ? 1.0f / (sigma * sigma) : 0.0f;
+        }
+
+        // the Cornell scene seen from the camera of the progressive renderer, the primary rays with the tMax of their hit
+        struct DenoiseScene
+        {
+            std::vector<SceneBox> scene;
+            PushConstantRay pc;
+            OcclusionCamera camera;
+
+            std::vector<GatherRay> pixelRays;
+            std::vector<SceneHit> pixelHits;
+        };
+
+        DenoiseScene MakeDenoiseScene(const AtrousDenoiserBenchmarkSettings& settings, uint32_t width, uint32_t height)
+        {
+            DenoiseScene scene;
+            scene.scene = CreateCornellScene();
+            scene.pc = MakeSceneRayConstants(float3(0.0f, 0.0f, -14.0f), float3(0.0f), 0.8f, float(width) / float(height), settings.numBeamLaunches);
+            scene.pc.numPhotonSources = settings.numPhotonLaunches;
+            scene.pc.beamRadius = settings.beamRadius;
+            scene.pc.photonRadius = settings.photonRadius;
+            scene.camera = MakeOcclusionCamera(scene.pc, width, height);
+
+            const size_t numPixels = size_t(width) * height;
+            scene.pixelRays.resize(numPixels);
+            scene.pixelHits.resize(numPixels);
+            for (uint32_t y = 0; y < height; y++)
+            {
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    const size_t pixel = size_t(y) * width + x;
+                    GatherRay& ray = scene.pixelRays[pixel];
+                    SceneHit& hit = scene.pixelHits[pixel];
+
+                    ray = MakePrimaryRay(scene.camera, x, y);
+                    ray.tMax = c_rayTMaxDefault;
+                    hit = {};
+                    hit.boxIndex = -1;
+                    if (TraceScene(scene.scene, ray.origin, ray.direction, c_rayTMin, c_rayTMaxDefault, hit))
+                        ray.tMax = hit.t;
+                }
+            }
+            return scene;
+        }
+
+        DenoiseGuide MakeDenoiseGuide(const DenoiseScene& scene)
+        {
+            DenoiseGuide guide;
+            guide.width = scene.camera.width;
+            guide.height = scene.camera.height;
+            guide.normalDepth.resize(scene.pixelRays.size());
+            guide.albedo.resize(scene.pixelRays.size());
+
+            for (size_t pixel = 0; pixel < scene.pixelRays.size(); pixel++)
+            {
+                const SceneHit& hit = scene.pixelHits[pixel];
+                const bool isHit = hit.boxIndex >= 0;
+                const float3 normal = isHit ? hit.normal : float3(0.0f);
+                const float albedo = isHit ? c_cornellAlbedo : 0.0f;
+
+                guide.normalDepth[pixel] = XMFLOAT4(normal.x, normal.y, normal.z, scene.pixelRays[pixel].tMax);
+                guide.albedo[pixel] = XMFLOAT4(albedo, albedo, albedo, 0.0f);
+            }
+            return guide;
+        }
+
+        // The air beams of numBeamLaunches and the surface photons of numPhotonLaunches gathered apart, the beams as
+        // BeamAnyHit does and the photons with the kernel of GatherSurfacePhotonBoxRadiance().
+        void RenderNoisyFrame(const DenoiseScene& scene, const AtrousDenoiserBenchmarkSettings& settings, uint32_t seed, DenoiseImage& volume, DenoiseImage& surface)
+        {
+            const BeamGatherConstants gatherConstants = MakeBeamGatherConstants(scene.pc);
+
+            struct BoundedBeam
+            {
+                GatherBeam beam;
+                float3 boundsMin;
+                float3 boundsMax;
+            };
+            std::vector<BoundedBeam> airBeams;
+            for (const auto& emissions : CreateSceneEmissions(scene.scene, settings.numBeamLaunches, 4, seed))
+            {
+                for (const auto& emission : emissions)
+                {
+                    if (!emission.airSubBeams)
+                        continue;
+
+                    BoundedBeam airBeam;
+                    airBeam.beam = LoadGatherBeam(emission.beam);
+                    airBeam.boundsMin = min(float3(emission.beam.startPos), float3(emission.beam.endPos)) - settings.beamRadius;
+                    airBeam.boundsMax = max(float3(emission.beam.startPos), float3(emission.beam.endPos)) + settings.beamRadius;
+                    airBeams.push_back(airBeam);
+                }
+            }
+
+            std::vector<std::vector<PhotonBeam>> boxPhotons(scene.scene.size());
+            for (const auto& emissions : CreateSceneEmissions(scene.scene, settings.numPhotonLaunches, 4, seed + c_photonSeedOffset))
+            {
+                for (const auto& emission : emissions)
+                {
+                    if (emission.surfacePhoton && emission.beam.hitInstanceID >= 0)
+                        boxPhotons[emission.beam.hitInstanceID].push_back(emission.beam);
+                }
+            }
+
+            const uint32_t width = scene.camera.width;
+            const uint32_t height = scene.camera.height;
+            volume.width = surface.width = width;
+            volume.height = surface.height = height;
+            volume.pixels.assign(scene.pixelRays.size(), XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+            surface.pixels.assign(scene.pixelRays.size(), XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+
+            ParallelFor(ResolveThreadCount(settings.denoiser.numThreads), height, [&](uint32_t, uint64_t begin, uint64_t end)
+            {
+                for (uint64_t y = begin; y < end; y++)
+                {
+                    for (uint32_t x = 0; x < width; x++)
+                    {
+                        const size_t pixel = size_t(y) * width + x;
+                        const GatherRay& ray = scene.pixelRays[pixel];
+                        const SceneHit& hit = scene.pixelHits[pixel];
+
+                        float3 beamRadiance(0.0f);
+                        for (const auto& airBeam : airBeams)
+                        {
+                            float3 radiance;
+                            if (RayEntersBox(ray, airBeam.boundsMin, airBeam.boundsMax) && GatherBeamRadiance(gatherConstants, ray, airBeam.beam, radiance))
+                                beamRadiance += radiance;
+                        }
+
+                        float3 photonRadiance(0.0f);
+                        if (hit.boxIndex >= 0)
+                        {
+                            for (const auto& photon : boxPhotons[hit.boxIndex])
+                                photonRadiance += GatherSurfacePhotonBoxRadiance(scene.pc, ray, hit, photon);
+                        }
+
+                        volume.pixels[pixel] = XMFLOAT4(beamRadiance.x, beamRadiance.y, beamRadiance.z, 1.0f);
+                        surface.pixels[pixel] = XMFLOAT4(photonRadiance.x, photonRadiance.y, photonRadiance.z, 1.0f);
+                    }
+                }
+            });
+        }
+
+        // nearest neighbor
+        DenoiseImage ScaleDenoiseImage(const DenoiseImage& image, uint32_t width, uint32_t height)
+        {
+            DenoiseImage scaled;
+            scaled.width = width;
+            scaled.height = height;
+            scaled.pixels.resize(size_t(width) * height);
+            for (uint32_t y = 0; y < height; y++)
+            {
+                const uint32_t sourceY = uint32_t(uint64_t(y) * image.height / height);
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    const uint32_t sourceX = uint32_t(uint64_t(x) * image.width / width);
+                    scaled.pixels[size_t(y) * width + x] = image.pixels[size_t(sourceY) * image.width + sourceX];
+                }
+            }
+            return scaled;
+        }
+
+        DenoiseImage AddDenoiseImages(const DenoiseImage& a, const DenoiseImage& b)
+        {
+            DenoiseImage sum = a;
+            for (size_t i = 0; i < sum.pixels.size(); i++)
+            {
+                sum.pixels[i].x += b.pixels[i].x;
+                sum.pixels[i].y += b.pixels[i].y;
+                sum.pixels[i].z += b.pixels[i].z;
+            }
+            return sum;
+        }
+
+        // mean of (x - r)^2 / (r^2 + e^2) over the channels, e a tenth of the mean channel of the reference
+        double RelativeMse(const DenoiseImage& image, const DenoiseImage& reference, double referenceMean)
+        {
+            const double floorSquare = 0.01 * referenceMean * referenceMean;
+            double sum = 0.0;
+            for (size_t i = 0; i < image.pixels.size(); i++)
+            {
+                const float* x = &image.pixels[i].x;
+                const float* r = &reference.pixels[i].x;
+                for (int channel = 0; channel < 3; channel++)
+                {
+                    const double difference = double(x[channel]) - r[channel];
+                    sum += difference * difference / (double(r[channel]) * r[channel] + floorSquare);
+                }
+            }
+            return image.pixels.empty() ? 0.0 : sum / double(image.pixels.size() * 3);
+        }
+
+        double MeanChannel(const DenoiseImage& image)
+        {
+            double sum = 0.0;
+            for (const XMFLOAT4& pixel : image.pixels)
+                sum += double(pixel.x) + pixel.y + pixel.z;
+            return image.pixels.empty() ? 0.0 : sum / double(image.pixels.size() * 3);
+        }
+
+        DenoiseGuide MakeFlatGuide(uint32_t width, uint32_t height, float depth)
+        {
+            DenoiseGuide guide;
+            guide.width = width;
+            guide.height = height;
+            guide.normalDepth.assign(size_t(width) * height, XMFLOAT4(0.0f, 0.0f, -1.0f, depth));
+            guide.albedo.assign(size_t(width) * height, XMFLOAT4(1.0f, 1.0f, 1.0f, 0.0f));
+            return guide;
+        }
+
+        DenoiseImage MakeConstantImage(uint32_t width, uint32_t height, const XMFLOAT4& value)
+        {
+            DenoiseImage image;
+            image.width = width;
+            image.height = height;
+            image.pixels.assign(size_t(width) * height, value);
+            return image;
+        }
+    }
+
+    const char* AtrousInstructionSet()
+    {
+        return SimdLanes::Name;
+    }
+
+    AtrousDenoiser::AtrousDenoiser(const AtrousDenoiserSettings& settings) :
+        m_settings(settings)
+    {
+    }
+
+    void AtrousDenoiser::Resize(uint32_t width, uint32_t height)
+    {
+        if (width == m_width && height == m_height)
+            return;
+
+        // the taps of the last iteration reach 2^numIterations pixels, the last block up to 7 pixels past the width
+        const uint32_t maxOffset = m_settings.numIterations > 0 ? 1u << m_settings.numIterations : 0;
+        m_width = width;
+        m_height = height;
+        m_pad = (std::max(maxOffset, 8u) + 7) & ~7u;
+        m_stride = 2 * m_pad + ((width + 7) & ~7u);
+
+        const size_t size = size_t(m_stride) * height;
+        m_normalX.assign(size, 0.0f);
+        m_normalY.assign(size, 0.0f);
+        m_normalZ.assign(size, 0.0f);
+        m_depth.assign(size, c_rayTMaxDefault);
+        m_invDepthSquare.assign(size, 1.0f / (c_rayTMaxDefault * c_rayTMaxDefault));
+        m_valid.assign(size, 0.0f);
+        m_volumeColorScale.assign(size, 0.0f);
+        m_surfaceColorScale.assign(size, 0.0f);
+        for (ColorPlanes* planes : { &m_volumePlanes[0], &m_volumePlanes[1], &m_surfacePlanes[0], &m_surfacePlanes[1] })
+        {
+            planes->r.assign(size, 0.0f);
+            planes->g.assign(size, 0.0f);
+            planes->b.assign(size, 0.0f);
+        }
+
+        m_volume.width = m_surface.width = width;
+        m_volume.height = m_surface.height = height;
+        m_volume.pixels.resize(size_t(width) * height);
+        m_surface.pixels.resize(size_t(width) * height);
+    }
+
+    void AtrousDenoiser::Denoise(const DenoiseGuide& guide, const DenoiseImage& volume, const DenoiseImage& surface, DenoiseImage& output)
+    {
+        const uint32_t width = guide.width;
+        const uint32_t height = guide.height;
+        const uint32_t numThreads = ResolveThreadCount(m_settings.numThreads);
+        Resize(width, height);
+
+        // the planes, the surface divided by the albedo, and the channel sums of the images for the color sigma
+        std::vector<double> channelSums(size_t(numThreads) * 2, 0.0);
+        ParallelFor(numThreads, height, [&](uint32_t threadIndex, uint64_t begin, uint64_t end)
+        {
+            double volumeSum = 0.0;
+            double surfaceSum = 0.0;
+            for (uint64_t y = begin; y < end; y++)
+            {
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    const size_t pixel = size_t(y) * width + x;
+                    const size_t p = size_t(y) * m_stride + m_pad + x;
+                    const XMFLOAT4& normalDepth = guide.normalDepth[pixel];
+                    const XMFLOAT4& albedo = guide.albedo[pixel];
+                    const float depth = std::max(normalDepth.w, c_rayTMin);
+
+                    m_normalX[p] = normalDepth.x;
+                    m_normalY[p] = normalDepth.y;
+                    m_normalZ[p] = normalDepth.z;
+                    m_depth[p] = depth;
+                    m_invDepthSquare[p] = 1.0f / (depth * depth);
+                    m_valid[p] = 1.0f;
+
+                    const XMFLOAT4& v = volume.pixels[pixel];
+                    m_volumePlanes[0].r[p] = ToFinite(v.x);
+                    m_volumePlanes[0].g[p] = ToFinite(v.y);
+                    m_volumePlanes[0].b[p] = ToFinite(v.z);
+                    volumeSum += double(m_volumePlanes[0].r[p]) + m_volumePlanes[0].g[p] + m_volumePlanes[0].b[p];
+
+                    const XMFLOAT4& s = surface.pixels[pixel];
+                    m_surfacePlanes[0].r[p] = ToFinite(s.x / std::max(albedo.x, 1e-3f));
+                    m_surfacePlanes[0].g[p] = ToFinite(s.y / std::max(albedo.y, 1e-3f));
+                    m_surfacePlanes[0].b[p] = ToFinite(s.z / std::max(albedo.z, 1e-3f));
+                    surfaceSum += double(m_surfacePlanes[0].r[p]) + m_surfacePlanes[0].g[p] + m_surfacePlanes[0].b[p];
+                }
+            }
+            channelSums[threadIndex * 2] = volumeSum;
+            channelSums[threadIndex * 2 + 1] = surfaceSum;
+        });
+
+        double volumeMean = 0.0;
+        double surfaceMean = 0.0;
+        for (uint32_t threadIndex = 0; threadIndex < numThreads; threadIndex++)
+        {
+            volumeMean += channelSums[threadIndex * 2];
+            surfaceMean += channelSums[threadIndex * 2 + 1];
+        }
+        const double numChannels = std::max(1.0, double(width) * height * 3);
+        volumeMean = volumeMean > 0.0 ? volumeMean / numChannels : 1.0;
+        surfaceMean = surfaceMean > 0.0 ? surfaceMean / numChannels : 1.0;
+
+        AtrousPlanes planes;
+        planes.width = width;
+        planes.height = height;
+        planes.pad = m_pad;
+        planes.stride = m_stride;
+        planes.normalX = m_normalX.data();
+        planes.normalY = m_normalY.data();
+        planes.normalZ = m_normalZ.data();
+        planes.depth = m_depth.data();
+        planes.invDepthSquare = m_invDepthSquare.data();
+        planes.valid = m_valid.data();
+
+        // the noise around every pixel, the second planes hold the row sums until the first iteration writes them
+        {
+            float* volumeSums[3] = { m_volumePlanes[1].r.data(), m_volumePlanes[1].g.data(), m_volumePlanes[1].b.data() };
+            float* surfaceSums[3] = { m_surfacePlanes[1].r.data(), m_surfacePlanes[1].g.data(), m_surfacePlanes[1].b.data() };
+            ParallelFor(numThreads, height, [&](uint32_t, uint64_t begin, uint64_t end)
+            {
+                SumColorWindowRows(planes, m_volumePlanes[0].r.data(), m_volumePlanes[0].g.data(), m_volumePlanes[0].b.data(), volumeSums, begin, end);
+                SumColorWindowRows(planes, m_surfacePlanes[0].r.data(), m_surfacePlanes[0].g.data(), m_surfacePlanes[0].b.data(), surfaceSums, begin, end);
+            });
+
+            const float volumeFloor = float(volumeMean) * m_settings.volume.colorFloor;
+            const float surfaceFloor = float(surfaceMean) * m_settings.surface.colorFloor;
+            ParallelFor(numThreads, height, [&](uint32_t, uint64_t begin, uint64_t end)
+            {
+                EstimateColorScale(planes, volumeSums, std::max(volumeFloor * volumeFloor, 1e-30f), m_volumeColorScale.data(), begin, end);
+                EstimateColorScale(planes, surfaceSums, std::max(surfaceFloor * surfaceFloor, 1e-30f), m_surfaceColorScale.data(), begin, end);
+            });
+        }
+
+        const auto makePass = [](const ColorPlanes& src, ColorPlanes& dst, const std::vector<float>& colorScale, const AtrousEdgeStopping& edgeStopping, uint32_t iteration)
+        {
+            AtrousPass pass;
+            pass.srcR = src.r.data();
+            pass.srcG = src.g.data();
+            pass.srcB = src.b.data();
+            pass.dstR = dst.r.data();
+            pass.dstG = dst.g.data();
+            pass.dstB = dst.b.data();
+            pass.colorScale = colorScale.data();
+            pass.colorCoff = InverseSquare(edgeStopping.colorSigma / float(1u << iteration));
+            pass.normalCoff = InverseSquare(edgeStopping.normalSigma);
+            pass.depthCoff = InverseSquare(edgeStopping.depthSigma);
+            return pass;
+        };
+
+        for (uint32_t iteration = 0; iteration < m_settings.numIterations; iteration++)
+        {
+            const uint32_t step = 1u << iteration;
+            const uint32_t src = iteration & 1;
+            const AtrousPass volumePass = makePass(m_volumePlanes[src], m_volumePlanes[src ^ 1], m_volumeColorScale, m_settings.volume, iteration);
+            const AtrousPass surfacePass = makePass(m_surfacePlanes[src], m_surfacePlanes[src ^ 1], m_surfaceColorScale, m_settings.surface, iteration);
+
+            ParallelFor(numThreads, height, [&](uint32_t, uint64_t begin, uint64_t end)
+            {
+                if (m_settings.useSimd)
+                {
+                    FilterAtrousRows<SimdLanes>(planes, volumePass, volumePass.normalCoff > 0.0f, begin, end, step);
+                    FilterAtrousRows<SimdLanes>(planes, surfacePass, surfacePass.normalCoff > 0.0f, begin, end, step);
+                }
+                else
+                {
+                    FilterAtrousRows<ScalarLanes>(planes, volumePass, volumePass.normalCoff > 0.0f, begin, end, step);
+                    FilterAtrousRows<ScalarLanes>(planes, surfacePass, surfacePass.normalCoff > 0.0f, begin, end, step);
+                }
+            });
+        }
+
+        // back to the images, the surface multiplied by the albedo
+        const uint32_t result = m_settings.numIterations & 1;
+        const ColorPlanes& volumePlanes = m_volumePlanes[result];
+        const ColorPlanes& surfacePlanes = m_surfacePlanes[result];
+        output.width = width;
+        output.height = height;
+        output.pixels.resize(size_t(width) * height);
+        ParallelFor(numThreads, height, [&](uint32_t, uint64_t begin, uint64_t end)
+        {
+            for (uint64_t y = begin; y < end; y++)
+            {
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    const size_t pixel = size_t(y) * width + x;
+                    const size_t p = size_t(y) * m_stride + m_pad + x;
+                    const XMFLOAT4& albedo = guide.albedo[pixel];
+
+                    const XMFLOAT4 v(volumePlanes.r[p], volumePlanes.g[p], volumePlanes.b[p], 1.0f);
+                    const XMFLOAT4 s(surfacePlanes.r[p] * albedo.x, surfacePlanes.g[p] * albedo.y, surfacePlanes.b[p] * albedo.z, 1.0f);
+                    m_volume.pixels[pixel] = v;
+                    m_surface.pixels[pixel] = s;
+                    output.pixels[pixel] = XMFLOAT4(v.x + s.x, v.y + s.y, v.z + s.z, 1.0f);
+                }
+            }
+        });
+    }
+
+    double DenoiseImageRmse(const DenoiseImage& image, const DenoiseImage& reference)
+    {
+        const size_t size = std::min(image.pixels.size(), reference.pixels.size());
+        if (size == 0)
+            return 0.0;
+
+        double sum = 0.0;
+        for (size_t i = 0; i < size; i++)
+        {
+            const double dx = double(image.pixels[i].x) - reference.pixels[i].x;
+            const double dy = double(image.pixels[i].y) - reference.pixels[i].y;
+            const double dz = double(image.pixels[i].z) - reference.pixels[i].z;
+            sum += dx * dx + dy * dy + dz * dz;
+        }
+        return std::sqrt(sum / double(size * 3));
+    }
+
+    std::string ValidateAtrousDenoiser()
+    {
+        std::string failures;
+        const uint32_t width = 83;
+        const uint32_t height = 47;
+        const DenoiseImage black = MakeConstantImage(width, height, XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+
+        // noise of mean 1 on a flat guide, the volume and the surface of different noise
+        const auto makeNoise = [&](uint32_t seed)
+        {
+            DenoiseImage image = MakeConstantImage(width, height, XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+            for (size_t i = 0; i < image.pixels.size(); i++)
+            {
+                uint32_t pixelSeed = rngInitSeed(uint32_t(i), seed);
+                image.pixels[i] = XMFLOAT4(0.5f + rnd(pixelSeed), 0.5f + rnd(pixelSeed), 0.5f + rnd(pixelSeed), 1.0f);
+            }
+            return image;
+        };
+        const DenoiseImage volumeNoise = makeNoise(1);
+        const DenoiseImage surfaceNoise = makeNoise(2);
+
+        // the SIMD lanes and the scalar lanes, on a guide of varying normals and depths
+        {
+            DenoiseGuide guide = MakeFlatGuide(width, height, 6.0f);
+            for (uint32_t y = 0; y < height; y++)
+            {
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    const float3 normal = normalize(float3(float(x % 7) - 3.0f, float(y % 5) - 2.0f, -4.0f));
+                    guide.normalDepth[size_t(y) * width + x] = XMFLOAT4(normal.x, normal.y, normal.z, 4.0f + float(x / 20) + float(y / 15));
+                }
+            }
+
+            AtrousDenoiserSettings settings;
+            settings.numThreads = 3;
+            AtrousDenoiser simd(settings);
+            settings.useSimd = false;
+            AtrousDenoiser scalar(settings);
+
+            DenoiseImage simdImage;
+            DenoiseImage scalarImage;
+            simd.Denoise(guide, volumeNoise, surfaceNoise, simdImage);
+            scalar.Denoise(guide, volumeNoise, surfaceNoise, scalarImage);
+            Check(DenoiseImageRmse(simdImage, scalarImage) < 1e-6, "the SIMD lanes do not give the image of the scalar lanes", failures);
+        }
+
+        // a constant image stays constant, a constant irradiance stays constant on a textured surface
+        {
+            DenoiseGuide guide = MakeFlatGuide(width, height, 6.0f);
+            DenoiseImage surface = black;
+            for (size_t i = 0; i < guide.albedo.size(); i++)
+            {
+                const float albedo = (i / 3) % 2 == 0 ? 0.8f : 0.1f;
+                guide.albedo[i] = XMFLOAT4(albedo, albedo * 0.5f, albedo, 0.0f);
+                surface.pixels[i] = XMFLOAT4(2.0f * albedo, albedo, 2.0f * albedo, 1.0f);
+            }
+            const DenoiseImage volume = MakeConstantImage(width, height, XMFLOAT4(0.25f, 0.5f, 0.75f, 1.0f));
+
+            AtrousDenoiser denoiser;
+            DenoiseImage output;
+            denoiser.Denoise(guide, volume, surface, output);
+            Check(DenoiseImageRmse(denoiser.Volume(), volume) < 1e-6, "a constant volume image does not stay constant", failures);
+            Check(DenoiseImageRmse(denoiser.Surface(), surface) < 1e-6, "a constant irradiance on a textured surface does not stay constant", failures);
+            Check(DenoiseImageRmse(output, AddDenoiseImages(volume, surface)) < 1e-6, "the output is not the sum of the images", failures);
+        }
+
+        // the left half near, the right half far, and the top half facing another way, each of its own color
+        {
+            DenoiseGuide guide = MakeFlatGuide(width, height, 3.0f);
+            DenoiseImage surface = black;
+            for (uint32_t y = 0; y < height; y++)
+            {
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    const size_t pixel = size_t(y) * width + x;
+                    const bool isFar = x >= width / 2;
+                    const bool isTop = y < height / 2;
+                    guide.normalDepth[pixel] = isTop ? XMFLOAT4(1.0f, 0.0f, 0.0f, isFar ? 9.0f : 3.0f) : XMFLOAT4(0.0f, 0.0f, -1.0f, isFar ? 9.0f : 3.0f);
+                    const float value = (isFar ? 1.0f : 0.2f) * (isTop ? 2.0f : 1.0f);
+                    surface.pixels[pixel] = XMFLOAT4(value, value, value, 1.0f);
+                }
+            }
+
+            // color alone would not stop the filter at these edges
+            AtrousDenoiserSettings settings;
+            settings.surface.colorSigma = 1000.0f;
+            AtrousDenoiser denoiser(settings);
+            DenoiseImage output;
+            denoiser.Denoise(guide, black, surface, output);
+
+            double maxError = 0.0;
+            for (size_t i = 0; i < surface.pixels.size(); i++)
+                maxError = std::max(maxError, std::abs(double(denoiser.Surface().pixels[i].x) - surface.pixels[i].x) / surface.pixels[i].x);
+            Check(maxError < 0.01, "the depth and the normals do not stop the filter at an edge", failures);
+
+            // without the guide the edges blur
+            settings.surface.normalSigma = 0.0f;
+            settings.surface.depthSigma = 0.0f;
+            AtrousDenoiser unguided(settings);
+            unguided.Denoise(guide, black, surface, output);
+            Check(DenoiseImageRmse(unguided.Surface(), surface) > 0.05, "the filter does not blur the edges without the guide", failures);
+        }
+
+        // the noise of a flat image shrinks, the mean stays
+        {
+            const DenoiseGuide guide = MakeFlatGuide(width, height, 6.0f);
+            const DenoiseImage flat = MakeConstantImage(width, height, XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
+
+            AtrousDenoiser denoiser;
+            DenoiseImage output;
+            denoiser.Denoise(guide, volumeNoise, surfaceNoise, output);
+            Check(DenoiseImageRmse(denoiser.Volume(), flat) < DenoiseImageRmse(volumeNoise, flat) * 0.2, "the noise of the volume image does not shrink", failures);
+            Check(DenoiseImageRmse(denoiser.Surface(), flat) < DenoiseImageRmse(surfaceNoise, flat) * 0.2, "the noise of the surface image does not shrink", failures);
+            Check(std::abs(MeanChannel(output) / MeanChannel(AddDenoiseImages(volumeNoise, surfaceNoise)) - 1.0) < 0.01, "the filter changes the mean of the image", failures);
+        }
+
+        return failures;
+    }
+
+    AtrousDenoiserBenchmarkResult RunAtrousDenoiserBenchmark(const AtrousDenoiserBenchmarkSettings& settings)
+    {
+        AtrousDenoiserBenchmarkResult result;
+
+        // the noisy frame, the reference and their filtered images
+        const DenoiseScene qualityScene = MakeDenoiseScene(settings, settings.qualityWidth, settings.qualityHeight);
+        const DenoiseGuide qualityGuide = MakeDenoiseGuide(qualityScene);
+
+        DenoiseImage noisyVolume;
+        DenoiseImage noisySurface;
+        RenderNoisyFrame(qualityScene, settings, settings.seed, noisyVolume, noisySurface);
+
+        DenoiseImage referenceVolume = MakeConstantImage(settings.qualityWidth, settings.qualityHeight, XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+        DenoiseImage referenceSurface = referenceVolume;
+        for (uint32_t frame = 0; frame < settings.numReferenceFrames; frame++)
+        {
+            DenoiseImage volume;
+            DenoiseImage surface;
+            RenderNoisyFrame(qualityScene, settings, settings.seed + c_referenceSeedOffset + frame, volume, surface);
+
+            const float weight = 1.0f / float(settings.numReferenceFrames);
+            for (size_t i = 0; i < volume.pixels.size(); i++)
+            {
+                referenceVolume.pixels[i].x += volume.pixels[i].x * weight;
+                referenceVolume.pixels[i].y += volume.pixels[i].y * weight;
+                referenceVolume.pixels[i].z += volume.pixels[i].z * weight;
+                referenceSurface.pixels[i].x += surface.pixels[i].x * weight;
+                referenceSurface.pixels[i].y += surface.pixels[i].y * weight;
+                referenceSurface.pixels[i].z += surface.pixels[i].z * weight;
+            }
+        }
+
+        // the taps cover the part of the quality frame they cover of the timed frame, the ones of 5 iterations would
+        // reach half way across 224 pixels and spread the light past the border of the image
+        AtrousDenoiserSettings qualitySettings = settings.denoiser;
+        uint32_t scale = 1;
+        while (settings.qualityWidth * scale * 2 <= settings.width && qualitySettings.numIterations > 1)
+        {
+            scale *= 2;
+            qualitySettings.numIterations--;
+        }
+
+        AtrousDenoiser qualityDenoiser(qualitySettings);
+        DenoiseImage denoised;
+        qualityDenoiser.Denoise(qualityGuide, noisyVolume, noisySurface, denoised);
+
+        const auto addQuality = [&](const char* image, const DenoiseImage& noisy, const DenoiseImage& filtered, const DenoiseImage& reference)
+        {
+            AtrousDenoiserQuality quality;
+            quality.image = image;
+            quality.noisyRmse = DenoiseImageRmse(noisy, reference);
+            quality.denoisedRmse = DenoiseImageRmse(filtered, reference);
+            quality.noisyRelativeMse = RelativeMse(noisy, reference, MeanChannel(reference));
+            quality.denoisedRelativeMse = RelativeMse(filtered, reference, MeanChannel(reference));
+            quality.meanDifference = MeanChannel(noisy) > 0.0 ? MeanChannel(filtered) / MeanChannel(noisy) - 1.0 : 0.0;
+            result.quality.push_back(quality);
+        };
+        addQuality("volume", noisyVolume, qualityDenoiser.Volume(), referenceVolume);
+        addQuality("surface", noisySurface, qualityDenoiser.Surface(), referenceSurface);
+        addQuality("sum", AddDenoiseImages(noisyVolume, noisySurface), denoised, AddDenoiseImages(referenceVolume, referenceSurface));
+
+        // the timed frame, the guide of its size and the noisy images scaled up to it
+        const DenoiseScene timedScene = MakeDenoiseScene(settings, settings.width, settings.height);
+        const DenoiseGuide timedGuide = MakeDenoiseGuide(timedScene);
+        const DenoiseImage timedVolume = ScaleDenoiseImage(noisyVolume, settings.width, settings.height);
+        const DenoiseImage timedSurface = ScaleDenoiseImage(noisySurface, settings.width, settings.height);
+
+        struct TimedConfig
+        {
+            bool useSimd;
+            uint32_t numThreads;
+        };
+        std::vector<TimedConfig> configs = { { false, 1 }, { true, 1 } };
+        const uint32_t numThreads = ResolveThreadCount(settings.denoiser.numThreads);
+        if (numThreads > 1)
+            configs.push_back({ true, numThreads });
+
+        for (const TimedConfig& config : configs)
+        {
+            AtrousDenoiserSettings denoiserSettings = settings.denoiser;
+            denoiserSettings.useSimd = config.useSimd;
+            denoiserSettings.numThreads = config.numThreads;
+            AtrousDenoiser denoiser(denoiserSettings);
+
+            // the first frame allocates the planes
+            DenoiseImage output;
+            denoiser.Denoise(timedGuide, timedVolume, timedSurface, output);
+
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t frame = 0; frame < settings.numTimedFrames; frame++)
+                denoiser.Denoise(timedGuide, timedVolume, timedSurface, output);
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            AtrousDenoiserTiming timing;
+            timing.instructionSet = config.useSimd ? AtrousInstructionSet() : ScalarLanes::Name;
+            timing.numThreads = config.numThreads;
+            timing.millisecondsPerFrame = seconds * 1000.0 / double(std::max(settings.numTimedFrames, 1u));
+            result.timings.push_back(timing);
+        }
+
+        return result;
+    }
+
+    std::string FormatAtrousDenoiserResults(const AtrousDenoiserBenchmarkResult& result)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& timing : result.timings)
+        {
+            std::snprintf(line, sizeof(line), "%-7s %3u threads  %9.2f ms/frame\n", timing.instructionSet.c_str(), timing.numThreads, timing.millisecondsPerFrame);
+            text += line;
+        }
+
+        for (const auto& quality : result.quality)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-8s rmse noisy %.3e  denoised %.3e (%.2fx lower)  relMSE noisy %.4f  denoised %.4f (%.2fx lower)  mean %+.2f%%\n",
+                quality.image.c_str(),
+                quality.noisyRmse,
+                quality.denoisedRmse,
+                quality.denoisedRmse > 0.0 ? quality.noisyRmse / quality.denoisedRmse : 0.0,
+                quality.noisyRelativeMse,
+                quality.denoisedRelativeMse,
+                quality.denoisedRelativeMse > 0.0 ? quality.noisyRelativeMse / quality.denoisedRelativeMse : 0.0,
+                quality.meanDifference * 100.0
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
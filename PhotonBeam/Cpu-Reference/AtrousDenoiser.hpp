@@ -0,0 +1,210 @@
+#pragma once
+
+#include "CpuVector.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) of the beam and photon images of a frame.
+//
+// Each iteration i filters the image with the 5x5 B3 spline kernel, whose taps are 2^i pixels apart. The weight of a
+// tap is the kernel times the edge-stopping functions of the center pixel p and the tap q:
+//   color    exp(-|c_p - c_q|^2 / (sigma_c^2 v_p)) sigma_c halved every iteration, the image gets smoother
+//   normal   exp(-|n_p - n_q|^2 / sigma_n^2)      hitNormal of the primary ray
+//   depth    exp(-((z_p - z_q) / (sigma_z z_p))^2) tMax of the primary ray, relative to the depth of p
+// v_p is the variance of the noisy image in the 5x5 pixels around p (Schied et al. 2017 estimate it over time), so
+// the settings do not depend on the exposure and a dark pixel takes the bright samples of its noisy neighborhood.
+//
+// The volume and the surface photon images are filtered apart, they do not share edges:
+//   volume    the beams in front of the surface, which do not depend on its normal, the depth only bounds the
+//             length of the ray through the medium
+//   surface   the photons are divided by hitAlbedo before the filter and multiplied after it, so the texture of the
+//             surface is not blurred with the noise
+//
+// The filter works on planes of floats padded left and right by the largest tap offset, a row is done in SIMD
+// registers of adjacent pixels and the rows are split between threads. Every iteration reads the planes of the
+// last one, so the rows of an iteration are independent.
+namespace CpuReference
+{
+    // row major from the top row, the layout of RenderTarget in RayGen.hlsl
+    struct DenoiseImage
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<XMFLOAT4> pixels;
+    };
+
+    // what the primary ray of RayGen.hlsl leaves in RayHitPayload
+    struct DenoiseGuide
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+
+        // xyz hitNormal, w tMax, a miss has the normal 0 and c_rayTMaxDefault
+        std::vector<XMFLOAT4> normalDepth;
+
+        // xyz hitAlbedo, w unused
+        std::vector<XMFLOAT4> albedo;
+    };
+
+    struct AtrousEdgeStopping
+    {
+        // of the color difference, relative to the deviation of the mean channel in the 5x5 pixels around the center
+        float colorSigma = 1.0f;
+
+        // the deviation is at least this times the mean channel of the image
+        float colorFloor = 0.1f;
+
+        // of the difference of the unit normals, 0 ignores the normals
+        float normalSigma = 0.0f;
+
+        // of the depth difference relative to the depth of the center pixel, 0 ignores the depth
+        float depthSigma = 0.0f;
+    };
+
+    struct AtrousDenoiserSettings
+    {
+        // the taps of iteration i are 2^i pixels apart
+        uint32_t numIterations = 5;
+
+        AtrousEdgeStopping volume = { 32.0f, 0.5f, 0.0f, 0.2f };
+        AtrousEdgeStopping surface = { 16.0f, 0.5f, 0.3f, 0.05f };
+
+        // false runs the scalar lanes, for the comparison of the benchmark
+        bool useSimd = true;
+
+        // numThreads 0 uses std::thread::hardware_concurrency()
+        uint32_t numThreads = 0;
+    };
+
+    // name of the instruction set the filter uses when useSimd is set
+    const char* AtrousInstructionSet();
+
+    class AtrousDenoiser
+    {
+    public:
+        explicit AtrousDenoiser(const AtrousDenoiserSettings& settings = {});
+
+        // Filters both images and writes their sum to output. The images and the guide have the same size, the
+        // planes are kept for the next frame of that size.
+        void Denoise(const DenoiseGuide& guide, const DenoiseImage& volume, const DenoiseImage& surface, DenoiseImage& output);
+
+        // the filtered images of the last Denoise(), the surface multiplied by the albedo again
+        const DenoiseImage& Volume() const { return m_volume; }
+        const DenoiseImage& Surface() const { return m_surface; }
+
+    private:
+        struct ColorPlanes
+        {
+            std::vector<float> r;
+            std::vector<float> g;
+            std::vector<float> b;
+        };
+
+        void Resize(uint32_t width, uint32_t height);
+
+        AtrousDenoiserSettings m_settings;
+
+        uint32_t m_width = 0;
+        uint32_t m_height = 0;
+        uint32_t m_pad = 0;
+        uint32_t m_stride = 0;
+
+        // guide planes, the pad has valid 0
+        std::vector<float> m_normalX;
+        std::vector<float> m_normalY;
+        std::vector<float> m_normalZ;
+        std::vector<float> m_depth;
+        std::vector<float> m_invDepthSquare;
+        std::vector<float> m_valid;
+
+        // 1 / (variance + floor^2) of the noisy images around every pixel
+        std::vector<float> m_volumeColorScale;
+        std::vector<float> m_surfaceColorScale;
+
+        // the volume and the demodulated surface, read from one and written to the other every iteration
+        ColorPlanes m_volumePlanes[2];
+        ColorPlanes m_surfacePlanes[2];
+
+        DenoiseImage m_volume;
+        DenoiseImage m_surface;
+    };
+
+    // root mean square of the differences of the channels, xyz
+    double DenoiseImageRmse(const DenoiseImage& image, const DenoiseImage& reference);
+
+    // Checks
+    //  that the SIMD lanes give the image of the scalar lanes
+    //  that a constant image, and a constant irradiance on a textured surface, stay as they are
+    //  that the depth and the normals stop the filter at an edge
+    //  that the noise of a flat image shrinks
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidateAtrousDenoiser();
+
+    struct AtrousDenoiserBenchmarkSettings
+    {
+        // the timed frame, the output of the app
+        uint32_t width = 1400;
+        uint32_t height = 800;
+        uint32_t numTimedFrames = 5;
+
+        // The quality is measured on frames of the Cornell scene rendered on the CPU, the timed frame is the noisy
+        // frame of this size scaled up, the filter does not branch on the pixels. The quality frame drops an
+        // iteration per halving of the width, its taps cover the part of the frame they cover in the timed one.
+        uint32_t qualityWidth = 224;
+        uint32_t qualityHeight = 128;
+
+        // the app traces 1024 beams and 32k photons, the photons are fewer here to keep the CPU gather short
+        uint32_t numBeamLaunches = 1024;
+        uint32_t numPhotonLaunches = 4096;
+        float beamRadius = 0.1f;
+        float photonRadius = 0.2f;
+
+        // the reference is the mean of this many frames of other seeds
+        uint32_t numReferenceFrames = 32;
+
+        AtrousDenoiserSettings denoiser = {};
+
+        uint32_t seed = 1;
+    };
+
+    struct AtrousDenoiserTiming
+    {
+        // "Scalar" or AtrousInstructionSet()
+        std::string instructionSet;
+        uint32_t numThreads = 0;
+        double millisecondsPerFrame = 0.0;
+    };
+
+    struct AtrousDenoiserQuality
+    {
+        // "volume", "surface" or "sum"
+        std::string image;
+
+        // against the reference
+        double noisyRmse = 0.0;
+        double denoisedRmse = 0.0;
+
+        // mean of (x - r)^2 / (r^2 + e^2), e a tenth of the mean channel of the reference r, the error of the dark
+        // parts weighs as much as the one around the light
+        double noisyRelativeMse = 0.0;
+        double denoisedRelativeMse = 0.0;
+
+        // of the mean channel of the denoised image, relative to the one of the noisy image
+        double meanDifference = 0.0;
+    };
+
+    struct AtrousDenoiserBenchmarkResult
+    {
+        std::vector<AtrousDenoiserTiming> timings;
+        std::vector<AtrousDenoiserQuality> quality;
+    };
+
+    // The scalar lanes on one thread, the SIMD lanes on one thread and on every thread, then the quality.
+    AtrousDenoiserBenchmarkResult RunAtrousDenoiserBenchmark(const AtrousDenoiserBenchmarkSettings& settings = {});
+
+    // one line per timing and per image
+    std::string FormatAtrousDenoiserResults(const AtrousDenoiserBenchmarkResult& result);
+}
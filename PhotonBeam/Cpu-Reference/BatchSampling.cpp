@@ -0,0 +1,604 @@
+
+#include "BatchSampling.hpp"
+#include "RayTracingSampling.hpp"
+
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace CpuReference
+{
+    namespace
+    {
+        // Lane types share one interface, so every kernel is written once
+        // and the scalar lanes give the exact result of a single SIMD lane for the tail of a batch.
+        struct ScalarLanes
+        {
+            using F = float;
+            using I = uint32_t;
+            using M = bool;
+            static constexpr size_t Width = 1;
+            static constexpr const char* Name = "Scalar";
+
+            static F LoadF(const float* p) { return *p; }
+            static void StoreF(float* p, F a) { *p = a; }
+            static I LoadI(const uint32_t* p) { return *p; }
+            static void StoreI(uint32_t* p, I a) { *p = a; }
+            static F SetF(float a) { return a; }
+            static I SetI(uint32_t a) { return a; }
+            static I Sequence(uint32_t start) { return start; }
+
+            static F Add(F a, F b) { return a + b; }
+            static F Sub(F a, F b) { return a - b; }
+            static F Mul(F a, F b) { return a * b; }
+            static F Div(F a, F b) { return a / b; }
+            static F Sqrt(F a) { return std::sqrt(a); }
+            static F Abs(F a) { return std::abs(a); }
+            static F Max(F a, F b) { return a > b ? a : b; }
+            static F Round(F a) { return std::nearbyint(a); }
+            static M Greater(F a, F b) { return a > b; }
+            static M Equal(F a, F b) { return a == b; }
+            static F Select(M m, F a, F b) { return m ? a : b; }
+
+            static F ToFloat(I a) { return float(int32_t(a)); }
+            static I ToInt(F a) { return I(int32_t(a)); }
+            static M NonZero(I a) { return a != 0; }
+
+            static I AddI(I a, I b) { return a + b; }
+            static I MulLo(I a, I b) { return a * b; }
+            static I Xor(I a, I b) { return a ^ b; }
+            static I And(I a, I b) { return a & b; }
+            static I SrlV(I a, I b) { return a >> b; }
+            template <int N> static I Srl(I a) { return a >> N; }
+            template <int N> static I Sll(I a) { return a << N; }
+
+            static void MulHiLo(I a, uint32_t b, I& hi, I& lo)
+            {
+                uint64_t product = uint64_t(a) * b;
+                hi = uint32_t(product >> 32);
+                lo = uint32_t(product);
+            }
+        };
+
+#if defined(__AVX2__)
+        struct Avx2Lanes
+        {
+            using F = __m256;
+            using I = __m256i;
+            using M = __m256;
+            static constexpr size_t Width = 8;
+            static constexpr const char* Name = "AVX2";
+
+            static F LoadF(const float* p) { return _mm256_loadu_ps(p); }
+            static void StoreF(float* p, F a) { _mm256_storeu_ps(p, a); }
+            static I LoadI(const uint32_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+            static void StoreI(uint32_t* p, I a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), a); }
+            static F SetF(float a) { return _mm256_set1_ps(a); }
+            static I SetI(uint32_t a) { return _mm256_set1_epi32(int(a)); }
+            static I Sequence(uint32_t start) { return _mm256_add_epi32(SetI(start), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)); }
+
+            static F Add(F a, F b) { return _mm256_add_ps(a, b); }
+            static F Sub(F a, F b) { return _mm256_sub_ps(a, b); }
+            static F Mul(F a, F b) { return _mm256_mul_ps(a, b); }
+            static F Div(F a, F b) { return _mm256_div_ps(a, b); }
+            static F Sqrt(F a) { return _mm256_sqrt_ps(a); }
+            static F Abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+            static F Max(F a, F b) { return _mm256_max_ps(a, b); }
+            static F Round(F a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+            static M Greater(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+            static M Equal(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+            static F Select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+
+            static F ToFloat(I a) { return _mm256_cvtepi32_ps(a); }
+            static I ToInt(F a) { return _mm256_cvttps_epi32(a); }
+            static M NonZero(I a)
+            {
+                I isZero = _mm256_cmpeq_epi32(a, _mm256_setzero_si256());
+                return _mm256_castsi256_ps(_mm256_xor_si256(isZero, _mm256_set1_epi32(-1)));
+            }
+
+            static I AddI(I a, I b) { return _mm256_add_epi32(a, b); }
+            static I MulLo(I a, I b) { return _mm256_mullo_epi32(a, b); }
+            static I Xor(I a, I b) { return _mm256_xor_si256(a, b); }
+            static I And(I a, I b) { return _mm256_and_si256(a, b); }
+            static I SrlV(I a, I b) { return _mm256_srlv_epi32(a, b); }
+            template <int N> static I Srl(I a) { return _mm256_srli_epi32(a, N); }
+            template <int N> static I Sll(I a) { return _mm256_slli_epi32(a, N); }
+
+            // 32 x 32 -> 64 bit products. _mm256_mul_epu32 only multiplies the even lanes, so the odd lanes are shifted down first.
+            static void MulHiLo(I a, uint32_t b, I& hi, I& lo)
+            {
+                const I multiplier = SetI(b);
+                const I even = _mm256_mul_epu32(a, multiplier);
+                const I odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), multiplier);
+                lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+                hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+            }
+        };
+#endif
+
+#if defined(__AVX512F__)
+        struct Avx512Lanes
+        {
+            using F = __m512;
+            using I = __m512i;
+            using M = __mmask16;
+            static constexpr size_t Width = 16;
+            static constexpr const char* Name = "AVX-512";
+
+            static F LoadF(const float* p) { return _mm512_loadu_ps(p); }
+            static void StoreF(float* p, F a) { _mm512_storeu_ps(p, a); }
+            static I LoadI(const uint32_t* p) { return _mm512_loadu_si512(p); }
+            static void StoreI(uint32_t* p, I a) { _mm512_storeu_si512(p, a); }
+            static F SetF(float a) { return _mm512_set1_ps(a); }
+            static I SetI(uint32_t a) { return _mm512_set1_epi32(int(a)); }
+            static I Sequence(uint32_t start)
+            {
+                return _mm512_add_epi32(SetI(start), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+            }
+
+            static F Add(F a, F b) { return _mm512_add_ps(a, b); }
+            static F Sub(F a, F b) { return _mm512_sub_ps(a, b); }
+            static F Mul(F a, F b) { return _mm512_mul_ps(a, b); }
+            static F Div(F a, F b) { return _mm512_div_ps(a, b); }
+            static F Sqrt(F a) { return _mm512_sqrt_ps(a); }
+            static F Abs(F a) { return _mm512_abs_ps(a); }
+            static F Max(F a, F b) { return _mm512_max_ps(a, b); }
+            static F Round(F a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+            static M Greater(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+            static M Equal(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+            static F Select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+
+            static F ToFloat(I a) { return _mm512_cvtepi32_ps(a); }
+            static I ToInt(F a) { return _mm512_cvttps_epi32(a); }
+            static M NonZero(I a) { return _mm512_test_epi32_mask(a, a); }
+
+            static I AddI(I a, I b) { return _mm512_add_epi32(a, b); }
+            static I MulLo(I a, I b) { return _mm512_mullo_epi32(a, b); }
+            static I Xor(I a, I b) { return _mm512_xor_si512(a, b); }
+            static I And(I a, I b) { return _mm512_and_si512(a, b); }
+            static I SrlV(I a, I b) { return _mm512_srlv_epi32(a, b); }
+            template <int N> static I Srl(I a) { return _mm512_srli_epi32(a, N); }
+            template <int N> static I Sll(I a) { return _mm512_slli_epi32(a, N); }
+
+            static void MulHiLo(I a, uint32_t b, I& hi, I& lo)
+            {
+                const I multiplier = SetI(b);
+                const I even = _mm512_mul_epu32(a, multiplier);
+                const I odd = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), multiplier);
+                lo = _mm512_mask_blend_epi32(0xAAAA, even, _mm512_slli_epi64(odd, 32));
+                hi = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(even, 32), odd);
+            }
+        };
+#endif
+
+#if defined(__AVX512F__)
+        using SimdLanes = Avx512Lanes;
+#elif defined(__AVX2__)
+        using SimdLanes = Avx2Lanes;
+#else
+        using SimdLanes = ScalarLanes;
+#endif
+
+        template <class L>
+        struct Lanes3
+        {
+            typename L::F x;
+            typename L::F y;
+            typename L::F z;
+        };
+
+        //-------------------------------------------------------------------------------------------------
+        // Random numbers, mirrors Shaders/util/RandomNumberGenerator.h
+        //-------------------------------------------------------------------------------------------------
+
+        template <class L>
+        typename L::I Tea(typename L::I v0, typename L::I v1)
+        {
+            typename L::I s0 = L::SetI(0);
+            for (uint32_t n = 0; n < 16; n++)
+            {
+                s0 = L::AddI(s0, L::SetI(0x9e3779b9));
+                v0 = L::AddI(v0, L::Xor(L::Xor(
+                    L::AddI(L::template Sll<4>(v1), L::SetI(0xa341316c)),
+                    L::AddI(v1, s0)),
+                    L::AddI(L::template Srl<5>(v1), L::SetI(0xc8013ea4))
+                ));
+                v1 = L::AddI(v1, L::Xor(L::Xor(
+                    L::AddI(L::template Sll<4>(v0), L::SetI(0xad90777d)),
+                    L::AddI(v0, s0)),
+                    L::AddI(L::template Srl<5>(v0), L::SetI(0x7e95761e))
+                ));
+            }
+            return v0;
+        }
+
+        template <class L>
+        typename L::I PcgPermute(typename L::I state)
+        {
+            auto shift = L::AddI(L::template Srl<28>(state), L::SetI(4));
+            auto word = L::MulLo(L::Xor(L::SrlV(state, shift), state), L::SetI(277803737u));
+            return L::Xor(L::template Srl<22>(word), word);
+        }
+
+        template <class L>
+        typename L::I PcgStep(typename L::I state)
+        {
+            return L::AddI(L::MulLo(state, L::SetI(747796405u)), L::SetI(2891336453u));
+        }
+
+        template <class L>
+        typename L::I Philox4x32X(
+            typename L::I c0, typename L::I c1, typename L::I c2, typename L::I c3,
+            uint32_t key0, uint32_t key1
+        )
+        {
+            for (uint32_t n = 0; n < PHOTONBEAM_PHILOX_ROUNDS; n++)
+            {
+                typename L::I hi0, lo0, hi1, lo1;
+                L::MulHiLo(c0, 0xD2511F53u, hi0, lo0);
+                L::MulHiLo(c2, 0xCD9E8D57u, hi1, lo1);
+
+                c0 = L::Xor(L::Xor(hi1, c1), L::SetI(key0));
+                c1 = lo1;
+                c2 = L::Xor(L::Xor(hi0, c3), L::SetI(key1));
+                c3 = lo0;
+
+                key0 += 0x9E3779B9u;
+                key1 += 0xBB67AE85u;
+            }
+            return c0;
+        }
+
+        template <class L>
+        typename L::I InitSeed(typename L::I launchIndex, uint32_t frameSeed)
+        {
+#if PHOTONBEAM_RNG == PHOTONBEAM_RNG_LCG
+            return Tea<L>(launchIndex, L::SetI(frameSeed));
+#elif PHOTONBEAM_RNG == PHOTONBEAM_RNG_PCG
+            return PcgPermute<L>(PcgStep<L>(L::AddI(launchIndex, L::SetI(pcgHash(frameSeed)))));
+#else
+            return Philox4x32X<L>(launchIndex, L::SetI(frameSeed), L::SetI(0), L::SetI(0), 0x2F6B6DB1u, 0x8E5FC4D7u);
+#endif
+        }
+
+        template <class L>
+        typename L::I Next24(typename L::I& state)
+        {
+#if PHOTONBEAM_RNG == PHOTONBEAM_RNG_LCG
+            state = L::AddI(L::MulLo(state, L::SetI(1664525u)), L::SetI(1013904223u));
+            return L::And(state, L::SetI(0x00FFFFFF));
+#elif PHOTONBEAM_RNG == PHOTONBEAM_RNG_PCG
+            state = PcgStep<L>(state);
+            return L::template Srl<8>(PcgPermute<L>(state));
+#else
+            auto value = Philox4x32X<L>(state, L::SetI(0x5851F42Du), L::SetI(0), L::SetI(0), 0xA511E9B3u, 0x63D83595u);
+            state = L::AddI(state, L::SetI(1));
+            return L::template Srl<8>(value);
+#endif
+        }
+
+        template <class L>
+        typename L::F Rnd(typename L::I& state)
+        {
+            // division by 2^24 is exact, same as float(lcg(prev)) / float(0x01000000)
+            return L::Mul(L::ToFloat(Next24<L>(state)), L::SetF(1.0f / float(0x01000000)));
+        }
+
+        //-------------------------------------------------------------------------------------------------
+        // Geometry helpers
+        //-------------------------------------------------------------------------------------------------
+
+        // sin and cos of an angle in [0, 2 pi), Cody-Waite reduction to [-pi/4, pi/4] and Cephes polynomials
+        template <class L>
+        void SinCos(typename L::F angle, typename L::F& sinVal, typename L::F& cosVal)
+        {
+            auto quadrant = L::Round(L::Mul(angle, L::SetF(0.636619772f)));
+            auto r = L::Sub(angle, L::Mul(quadrant, L::SetF(1.5703125f)));
+            r = L::Sub(r, L::Mul(quadrant, L::SetF(4.837512969970703125e-4f)));
+            r = L::Sub(r, L::Mul(quadrant, L::SetF(7.54978995489188216e-8f)));
+
+            auto r2 = L::Mul(r, r);
+
+            auto s = L::Add(L::Mul(r2, L::SetF(-1.9515295891e-4f)), L::SetF(8.3321608736e-3f));
+            s = L::Add(L::Mul(r2, s), L::SetF(-1.6666654611e-1f));
+            s = L::Add(L::Mul(L::Mul(r2, r), s), r);
+
+            auto c = L::Add(L::Mul(r2, L::SetF(2.443315711809948e-5f)), L::SetF(-1.388731625493765e-3f));
+            c = L::Add(L::Mul(r2, c), L::SetF(4.166664568298827e-2f));
+            c = L::Add(L::Mul(L::Mul(r2, r2), c), L::Sub(L::SetF(1.0f), L::Mul(r2, L::SetF(0.5f))));
+
+            auto quadrantBits = L::ToInt(quadrant);
+            auto swap = L::NonZero(L::And(quadrantBits, L::SetI(1)));
+            auto sinNegative = L::NonZero(L::And(quadrantBits, L::SetI(2)));
+            auto cosNegative = L::NonZero(L::And(L::AddI(quadrantBits, L::SetI(1)), L::SetI(2)));
+
+            auto sinRaw = L::Select(swap, c, s);
+            auto cosRaw = L::Select(swap, s, c);
+            sinVal = L::Select(sinNegative, L::Sub(L::SetF(0.0f), sinRaw), sinRaw);
+            cosVal = L::Select(cosNegative, L::Sub(L::SetF(0.0f), cosRaw), cosRaw);
+        }
+
+        template <class L>
+        typename L::F Dot(const Lanes3<L>& a, const Lanes3<L>& b)
+        {
+            return L::Add(L::Add(L::Mul(a.x, b.x), L::Mul(a.y, b.y)), L::Mul(a.z, b.z));
+        }
+
+        template <class L>
+        Lanes3<L> Cross(const Lanes3<L>& a, const Lanes3<L>& b)
+        {
+            return Lanes3<L>{
+                L::Sub(L::Mul(a.y, b.z), L::Mul(a.z, b.y)),
+                L::Sub(L::Mul(a.z, b.x), L::Mul(a.x, b.z)),
+                L::Sub(L::Mul(a.x, b.y), L::Mul(a.y, b.x))
+            };
+        }
+
+        template <class L>
+        Lanes3<L> Normalize(const Lanes3<L>& a)
+        {
+            auto len = L::Sqrt(Dot<L>(a, a));
+            return Lanes3<L>{ L::Div(a.x, len), L::Div(a.y, len), L::Div(a.z, len) };
+        }
+
+        template <class L>
+        Lanes3<L> Load3(const Float3SoA& values, size_t index)
+        {
+            return Lanes3<L>{ L::LoadF(&values.x[index]), L::LoadF(&values.y[index]), L::LoadF(&values.z[index]) };
+        }
+
+        template <class L>
+        void Store3(Float3SoA& values, size_t index, const Lanes3<L>& a)
+        {
+            L::StoreF(&values.x[index], a.x);
+            L::StoreF(&values.y[index], a.y);
+            L::StoreF(&values.z[index], a.z);
+        }
+
+        template <class L>
+        void CreateCoordinateSystem(const Lanes3<L>& N, Lanes3<L>& Nt, Lanes3<L>& Nb)
+        {
+            const auto zero = L::SetF(0.0f);
+            const auto useXZ = L::Greater(L::Abs(N.x), L::Abs(N.y));
+
+            const auto lengthXZ = L::Sqrt(L::Add(L::Mul(N.x, N.x), L::Mul(N.z, N.z)));
+            const auto lengthYZ = L::Sqrt(L::Add(L::Mul(N.y, N.y), L::Mul(N.z, N.z)));
+
+            Nt.x = L::Select(useXZ, L::Div(N.z, lengthXZ), L::Div(zero, lengthYZ));
+            Nt.y = L::Select(useXZ, L::Div(zero, lengthXZ), L::Div(L::Sub(zero, N.z), lengthYZ));
+            Nt.z = L::Select(useXZ, L::Div(L::Sub(zero, N.x), lengthXZ), L::Div(N.y, lengthYZ));
+
+            Nb = Cross<L>(N, Nt);
+        }
+
+        // local.x * bitangent + local.y * normal + local.z * tangent
+        template <class L>
+        Lanes3<L> ToWorld(
+            const Lanes3<L>& local,
+            const Lanes3<L>& normal,
+            const Lanes3<L>& tangent,
+            const Lanes3<L>& bitangent
+        )
+        {
+            return Lanes3<L>{
+                L::Add(L::Add(L::Mul(local.x, bitangent.x), L::Mul(local.y, normal.x)), L::Mul(local.z, tangent.x)),
+                L::Add(L::Add(L::Mul(local.x, bitangent.y), L::Mul(local.y, normal.y)), L::Mul(local.z, tangent.y)),
+                L::Add(L::Add(L::Mul(local.x, bitangent.z), L::Mul(local.y, normal.z)), L::Mul(local.z, tangent.z))
+            };
+        }
+
+        //-------------------------------------------------------------------------------------------------
+        // Kernels. Each processes lanes from `start` while a full block fits and returns where it stopped.
+        //-------------------------------------------------------------------------------------------------
+
+        template <class L>
+        size_t InitSeedsKernel(uint32_t firstLaunchIndex, uint32_t frameSeed, size_t start, size_t count, uint32_t* seeds)
+        {
+            size_t i = start;
+            for (; i + L::Width <= count; i += L::Width)
+            {
+                auto launchIndex = L::Sequence(firstLaunchIndex + uint32_t(i));
+                L::StoreI(&seeds[i], InitSeed<L>(launchIndex, frameSeed));
+            }
+            return i;
+        }
+
+        template <class L>
+        size_t RndKernel(uint32_t* seeds, size_t start, size_t count, float* out)
+        {
+            size_t i = start;
+            for (; i + L::Width <= count; i += L::Width)
+            {
+                auto state = L::LoadI(&seeds[i]);
+                L::StoreF(&out[i], Rnd<L>(state));
+                L::StoreI(&seeds[i], state);
+            }
+            return i;
+        }
+
+        template <class L>
+        size_t CoordinateSystemKernel(const Float3SoA& normals, size_t start, Float3SoA& tangents, Float3SoA& bitangents)
+        {
+            size_t i = start;
+            for (; i + L::Width <= normals.size(); i += L::Width)
+            {
+                Lanes3<L> tangent, bitangent;
+                CreateCoordinateSystem<L>(Load3<L>(normals, i), tangent, bitangent);
+                Store3<L>(tangents, i, tangent);
+                Store3<L>(bitangents, i, bitangent);
+            }
+            return i;
+        }
+
+        template <class L>
+        size_t UniformSphereKernel(uint32_t* seeds, size_t start, size_t count, Float3SoA& out)
+        {
+            size_t i = start;
+            for (; i + L::Width <= count; i += L::Width)
+            {
+                auto state = L::LoadI(&seeds[i]);
+                auto r1 = Rnd<L>(state);
+                auto r2 = L::Sub(L::Mul(Rnd<L>(state), L::SetF(2.0f)), L::SetF(1.0f));
+                auto sq = L::Sqrt(L::Sub(L::SetF(1.0f), L::Mul(r2, r2)));
+
+                typename L::F sinPhi, cosPhi;
+                SinCos<L>(L::Mul(L::SetF(2 * c_pi), r1), sinPhi, cosPhi);
+
+                Store3<L>(out, i, Lanes3<L>{ L::Mul(cosPhi, sq), L::Mul(sinPhi, sq), r2 });
+                L::StoreI(&seeds[i], state);
+            }
+            return i;
+        }
+
+        template <class L>
+        size_t HeneyGreenKernel(uint32_t* seeds, const Float3SoA& normals, float g, size_t start, Float3SoA& out)
+        {
+            const float g2 = g * g;
+            const float g3 = g2 * g;
+
+            size_t i = start;
+            for (; i + L::Width <= normals.size(); i += L::Width)
+            {
+                auto state = L::LoadI(&seeds[i]);
+                auto r1 = Rnd<L>(state);
+                auto r2 = Rnd<L>(state);
+
+                auto s1 = L::Sub(L::Mul(L::SetF(2.0f), r1), L::SetF(1.0f));
+                auto s2 = L::Mul(s1, s1);
+
+                auto denom = L::Add(L::SetF(1.0f), L::Mul(L::SetF(g), s1));
+                denom = L::Mul(L::Mul(denom, denom), L::SetF(2.0f));
+                denom = L::Select(L::Equal(denom, L::SetF(0.0f)), L::Add(denom, L::SetF(0.000001f)), denom);
+
+                auto numerator = L::Add(L::Add(L::Add(
+                    L::Mul(L::SetF(2.0f), s1),
+                    L::Mul(L::SetF(g), L::Add(s2, L::SetF(3.0f)))),
+                    L::Mul(L::SetF(g2), L::Mul(L::SetF(2.0f), s1))),
+                    L::Mul(L::SetF(g3), L::Sub(s2, L::SetF(1.0f)))
+                );
+
+                auto cosTheta = L::Div(numerator, denom);
+                auto sinTheta = L::Sqrt(L::Max(L::Sub(L::SetF(1.0f), L::Mul(cosTheta, cosTheta)), L::SetF(0.0f)));
+
+                typename L::F sinPhi, cosPhi;
+                SinCos<L>(L::Mul(L::SetF(2.0f * c_pi), r2), sinPhi, cosPhi);
+
+                auto normal = Load3<L>(normals, i);
+                Lanes3<L> tangent, bitangent;
+                CreateCoordinateSystem<L>(normal, tangent, bitangent);
+
+                Lanes3<L> local{ L::Mul(sinTheta, cosPhi), cosTheta, L::Mul(sinTheta, sinPhi) };
+                Store3<L>(out, i, Normalize<L>(ToWorld<L>(local, normal, tangent, bitangent)));
+                L::StoreI(&seeds[i], state);
+            }
+            return i;
+        }
+
+        template <class L>
+        size_t MicrofacetKernel(
+            uint32_t* seeds,
+            const Float3SoA& incomingLightDirs,
+            const Float3SoA& normals,
+            float roughness,
+            size_t start,
+            Float3SoA& out
+        )
+        {
+            const float a = roughness * roughness;
+
+            size_t i = start;
+            for (; i + L::Width <= normals.size(); i += L::Width)
+            {
+                auto state = L::LoadI(&seeds[i]);
+                auto r1 = Rnd<L>(state);
+                auto r2 = Rnd<L>(state);
+
+                // theta = atan(t), so cos theta = 1 / sqrt(1 + t^2) and sin theta = t cos theta
+                auto t = L::Mul(L::SetF(a), L::Sqrt(L::Div(r1, L::Sub(L::SetF(1.0f), r1))));
+                auto cosTheta = L::Div(L::SetF(1.0f), L::Sqrt(L::Add(L::SetF(1.0f), L::Mul(t, t))));
+                auto sinTheta = L::Mul(t, cosTheta);
+
+                typename L::F sinPhi, cosPhi;
+                SinCos<L>(L::Mul(L::SetF(2 * c_pi), r2), sinPhi, cosPhi);
+
+                auto normal = Load3<L>(normals, i);
+                Lanes3<L> tangent, bitangent;
+                CreateCoordinateSystem<L>(normal, tangent, bitangent);
+
+                Lanes3<L> local{ L::Mul(sinTheta, cosPhi), cosTheta, L::Mul(sinTheta, sinPhi) };
+                auto halfVec = ToWorld<L>(local, normal, tangent, bitangent);
+
+                auto incoming = Load3<L>(incomingLightDirs, i);
+                auto scale = L::Mul(L::SetF(2.0f), Dot<L>(halfVec, incoming));
+                Lanes3<L> reflected{
+                    L::Sub(incoming.x, L::Mul(scale, halfVec.x)),
+                    L::Sub(incoming.y, L::Mul(scale, halfVec.y)),
+                    L::Sub(incoming.z, L::Mul(scale, halfVec.z))
+                };
+
+                Store3<L>(out, i, Normalize<L>(reflected));
+                L::StoreI(&seeds[i], state);
+            }
+            return i;
+        }
+    }
+
+    const char* BatchSamplingInstructionSet()
+    {
+        return SimdLanes::Name;
+    }
+
+    void BatchInitSeeds(uint32_t firstLaunchIndex, uint32_t frameSeed, size_t count, uint32_t* seeds)
+    {
+        size_t i = InitSeedsKernel<SimdLanes>(firstLaunchIndex, frameSeed, 0, count, seeds);
+        InitSeedsKernel<ScalarLanes>(firstLaunchIndex, frameSeed, i, count, seeds);
+    }
+
+    void BatchRnd(uint32_t* seeds, size_t count, float* out)
+    {
+        size_t i = RndKernel<SimdLanes>(seeds, 0, count, out);
+        RndKernel<ScalarLanes>(seeds, i, count, out);
+    }
+
+    void BatchCreateCoordinateSystem(const Float3SoA& normals, Float3SoA& tangents, Float3SoA& bitangents)
+    {
+        tangents.resize(normals.size());
+        bitangents.resize(normals.size());
+
+        size_t i = CoordinateSystemKernel<SimdLanes>(normals, 0, tangents, bitangents);
+        CoordinateSystemKernel<ScalarLanes>(normals, i, tangents, bitangents);
+    }
+
+    void BatchUniformSamplingSphere(uint32_t* seeds, size_t count, Float3SoA& out)
+    {
+        out.resize(count);
+
+        size_t i = UniformSphereKernel<SimdLanes>(seeds, 0, count, out);
+        UniformSphereKernel<ScalarLanes>(seeds, i, count, out);
+    }
+
+    void BatchHeneyGreenPhaseFuncSampling(uint32_t* seeds, const Float3SoA& normals, float g, Float3SoA& out)
+    {
+        out.resize(normals.size());
+
+        size_t i = HeneyGreenKernel<SimdLanes>(seeds, normals, g, 0, out);
+        HeneyGreenKernel<ScalarLanes>(seeds, normals, g, i, out);
+    }
+
+    void BatchMicrofacetReflectedLightSampling(
+        uint32_t* seeds,
+        const Float3SoA& incomingLightDirs,
+        const Float3SoA& normals,
+        float roughness,
+        Float3SoA& out
+    )
+    {
+        out.resize(normals.size());
+
+        size_t i = MicrofacetKernel<SimdLanes>(seeds, incomingLightDirs, normals, roughness, 0, out);
+        MicrofacetKernel<ScalarLanes>(seeds, incomingLightDirs, normals, roughness, i, out);
+    }
+}
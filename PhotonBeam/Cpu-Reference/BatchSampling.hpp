@@ -0,0 +1,58 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Batch versions of the functions in Shaders/util/RayTracingSampling.hlsli.
+// Every lane i behaves like one shader invocation holding seeds[i]:
+// the random number streams are bit exact with the scalar rnd() for the generator selected by PHOTONBEAM_RNG,
+// and directions match the scalar versions within float rounding(sin/cos use a polynomial, atan is solved algebraically).
+// The lanes are processed with AVX-512 or AVX2 when the translation unit is compiled for them, with a scalar fallback.
+namespace CpuReference
+{
+    // structure of arrays storage for float3 values
+    struct Float3SoA
+    {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+
+        void resize(size_t count)
+        {
+            x.resize(count);
+            y.resize(count);
+            z.resize(count);
+        }
+
+        size_t size() const { return x.size(); }
+    };
+
+    // name of the instruction set used by the batch functions
+    const char* BatchSamplingInstructionSet();
+
+    // seeds[i] = rngInitSeed(firstLaunchIndex + i, frameSeed)
+    void BatchInitSeeds(uint32_t firstLaunchIndex, uint32_t frameSeed, size_t count, uint32_t* seeds);
+
+    // out[i] = rnd(seeds[i])
+    void BatchRnd(uint32_t* seeds, size_t count, float* out);
+
+    // tangents and bitangents of createCoordinateSystem for every normal
+    void BatchCreateCoordinateSystem(const Float3SoA& normals, Float3SoA& tangents, Float3SoA& bitangents);
+
+    // out[i] = uniformSamplingSphere(seeds[i])
+    void BatchUniformSamplingSphere(uint32_t* seeds, size_t count, Float3SoA& out);
+
+    // out[i] = heneyGreenPhaseFuncSampling(seeds[i], normals[i], g)
+    void BatchHeneyGreenPhaseFuncSampling(uint32_t* seeds, const Float3SoA& normals, float g, Float3SoA& out);
+
+    // out[i] = microfacetReflectedLightSampling(seeds[i], incomingLightDirs[i], normals[i], roughness)
+    void BatchMicrofacetReflectedLightSampling(
+        uint32_t* seeds,
+        const Float3SoA& incomingLightDirs,
+        const Float3SoA& normals,
+        float roughness,
+        Float3SoA& out
+    );
+}
@@ -0,0 +1,260 @@
+
+#include "BeamCapacityPlanner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace CpuReference
+{
+    BeamOverflowCounters MakeBeamOverflowCounters(
+        const PhotonBeamCounter& counter,
+        uint64_t beamCapacity,
+        uint64_t subBeamCapacity
+    )
+    {
+        BeamOverflowCounters counters;
+        counters.requestedBeams = counter.beamCount;
+        counters.requestedSubBeams = counter.subBeamCount;
+        counters.storedBeams = std::min(counter.beamCount, beamCapacity);
+        counters.storedSubBeams = std::min(counter.subBeamCount, subBeamCapacity);
+        return counters;
+    }
+
+    BeamCapacityPlanner::BeamCapacityPlanner(uint64_t beamCapacity, uint64_t subBeamCapacity, const BeamCapacityPlannerSettings& settings)
+        : m_settings(settings),
+        m_beamCapacity(beamCapacity),
+        m_subBeamCapacity(subBeamCapacity),
+        m_beamWindow(std::max(settings.windowSize, 1u)),
+        m_subBeamWindow(std::max(settings.windowSize, 1u))
+    {
+        m_settings.granularity = std::max<uint64_t>(m_settings.granularity, 1);
+        m_scratch.reserve(m_beamWindow.size());
+    }
+
+    uint64_t BeamCapacityPlanner::BeamDemand(const BeamOverflowCounters& counters)
+    {
+        return counters.requestedBeams;
+    }
+
+    uint64_t BeamCapacityPlanner::SubBeamDemand(const BeamOverflowCounters& counters)
+    {
+        // the launches stopped at a dropped beam never requested its sub-beams
+        if (counters.storedBeams < counters.requestedBeams && counters.storedBeams > 0)
+        {
+            double scale = double(counters.requestedBeams) / double(counters.storedBeams);
+            return uint64_t(std::ceil(double(counters.requestedSubBeams) * scale));
+        }
+
+        return counters.requestedSubBeams;
+    }
+
+    uint64_t BeamCapacityPlanner::Round(double capacity, uint64_t minCapacity, uint64_t maxCapacity) const
+    {
+        const uint64_t granularity = m_settings.granularity;
+        uint64_t rounded = (uint64_t(std::ceil(capacity)) + granularity - 1) / granularity * granularity;
+        return std::clamp(rounded, minCapacity, maxCapacity);
+    }
+
+    uint64_t BeamCapacityPlanner::Plan(const std::vector<uint64_t>& window, uint64_t minCapacity, uint64_t maxCapacity)
+    {
+        if (m_windowFill == 0)
+            return minCapacity;
+
+        // the filled part of the ring buffer, its order does not matter
+        m_scratch.assign(window.begin(), window.begin() + m_windowFill);
+
+        double rank = std::ceil(double(m_settings.percentile) * double(m_windowFill)) - 1.0;
+        size_t index = size_t(std::clamp(rank, 0.0, double(m_windowFill - 1)));
+        std::nth_element(m_scratch.begin(), m_scratch.begin() + index, m_scratch.end());
+
+        return Round(double(m_scratch[index]) * m_settings.headroom, minCapacity, maxCapacity);
+    }
+
+    bool BeamCapacityPlanner::AddFrame(const BeamOverflowCounters& counters)
+    {
+        m_lastFrame = counters;
+        m_numFrames++;
+
+        if (counters.Overflowed())
+        {
+            m_numOverflowFrames++;
+            m_numDroppedBeams += counters.requestedBeams - counters.storedBeams;
+            m_numDroppedSubBeams += counters.requestedSubBeams - counters.storedSubBeams;
+        }
+
+        const uint64_t beamDemand = BeamDemand(counters);
+        const uint64_t subBeamDemand = SubBeamDemand(counters);
+
+        const uint32_t windowSize = uint32_t(m_beamWindow.size());
+        m_beamWindow[m_windowNext] = beamDemand;
+        m_subBeamWindow[m_windowNext] = subBeamDemand;
+        m_windowNext = (m_windowNext + 1) % windowSize;
+        m_windowFill = std::min(m_windowFill + 1, windowSize);
+
+        uint64_t beamCapacity = m_beamCapacity;
+        uint64_t subBeamCapacity = m_subBeamCapacity;
+
+        if (counters.Overflowed())
+        {
+            // grow at once, at least to the demand of this frame
+            beamCapacity = std::max({
+                beamCapacity,
+                Plan(m_beamWindow, m_settings.minBeams, m_settings.maxBeams),
+                Round(double(beamDemand) * m_settings.headroom, m_settings.minBeams, m_settings.maxBeams)
+            });
+            subBeamCapacity = std::max({
+                subBeamCapacity,
+                Plan(m_subBeamWindow, m_settings.minSubBeams, m_settings.maxSubBeams),
+                Round(double(subBeamDemand) * m_settings.headroom, m_settings.minSubBeams, m_settings.maxSubBeams)
+            });
+        }
+        else if (m_numFrames - m_lastResizeFrame >= m_settings.minFramesBetweenResizes)
+        {
+            const bool windowFull = m_windowFill == windowSize;
+
+            uint64_t plannedBeams = Plan(m_beamWindow, m_settings.minBeams, m_settings.maxBeams);
+            if (plannedBeams > beamCapacity || (windowFull && double(plannedBeams) < double(beamCapacity) * m_settings.shrinkRatio))
+                beamCapacity = plannedBeams;
+
+            uint64_t plannedSubBeams = Plan(m_subBeamWindow, m_settings.minSubBeams, m_settings.maxSubBeams);
+            if (plannedSubBeams > subBeamCapacity || (windowFull && double(plannedSubBeams) < double(subBeamCapacity) * m_settings.shrinkRatio))
+                subBeamCapacity = plannedSubBeams;
+        }
+
+        if (beamCapacity == m_beamCapacity && subBeamCapacity == m_subBeamCapacity)
+            return false;
+
+        m_beamCapacity = beamCapacity;
+        m_subBeamCapacity = subBeamCapacity;
+        m_lastResizeFrame = m_numFrames;
+        m_numResizes++;
+        return true;
+    }
+
+    namespace
+    {
+        // one frame of the given demand run with the capacities of the planner
+        bool AddDemand(BeamCapacityPlanner& planner, uint64_t beams, uint64_t subBeams)
+        {
+            PhotonBeamCounter counter = {};
+            counter.beamCount = beams;
+            counter.subBeamCount = subBeams;
+            return planner.AddFrame(MakeBeamOverflowCounters(counter, planner.BeamCapacity(), planner.SubBeamCapacity()));
+        }
+
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+    }
+
+    std::string ValidateBeamCapacityPlanner()
+    {
+        std::string failures;
+        BeamCapacityPlannerSettings settings;
+
+        // counters
+        {
+            PhotonBeamCounter counter = {};
+            counter.beamCount = 1000;
+            counter.subBeamCount = 5000;
+
+            BeamOverflowCounters counters = MakeBeamOverflowCounters(counter, 800, 8000);
+            Check(counters.storedBeams == 800 && counters.storedSubBeams == 5000 && counters.Overflowed(), "counters: beam overflow", failures);
+            Check(BeamCapacityPlanner::SubBeamDemand(counters) == 6250, "counters: sub-beam demand of dropped beams", failures);
+
+            counters = MakeBeamOverflowCounters(counter, 1000, 5000);
+            Check(!counters.Overflowed() && BeamCapacityPlanner::SubBeamDemand(counters) == 5000, "counters: exact fit", failures);
+        }
+
+        // steady demand shrinks the over-allocated buffers once the window is full, then stays
+        {
+            BeamCapacityPlanner planner(settings.maxBeams, settings.maxSubBeams, settings);
+
+            uint32_t firstResize = 0;
+            for (uint32_t frame = 1; frame <= 4 * settings.windowSize; frame++)
+            {
+                if (AddDemand(planner, 40000, 300000) && firstResize == 0)
+                    firstResize = frame;
+            }
+
+            Check(firstResize == settings.windowSize, "steady: shrinks when the window is full", failures);
+            Check(planner.NumResizes() == 1, "steady: a single resize", failures);
+            Check(planner.BeamCapacity() == 50176 && planner.SubBeamCapacity() == 375040, "steady: headroom over the demand", failures);
+            Check(planner.NumOverflowFrames() == 0, "steady: no overflow", failures);
+        }
+
+        // an overflow grows at once, whatever the cooldown
+        {
+            BeamCapacityPlanner planner(8192, 65536, settings);
+
+            Check(AddDemand(planner, 10000, 60000), "overflow: grows on the first overflow", failures);
+            Check(planner.BeamCapacity() >= 12500 && planner.SubBeamCapacity() >= 65536, "overflow: covers the frame with headroom", failures);
+            Check(planner.NumDroppedBeams() == 10000 - 8192, "overflow: dropped beams", failures);
+
+            Check(AddDemand(planner, 30000, 60000), "overflow: grows again inside the cooldown", failures);
+            Check(planner.BeamCapacity() >= 37500, "overflow: covers the second frame", failures);
+            Check(planner.BeamCapacity() % settings.granularity == 0 && planner.SubBeamCapacity() % settings.granularity == 0, "overflow: granularity", failures);
+        }
+
+        // rare spikes above the percentile do not keep the buffers large, frequent ones do
+        {
+            BeamCapacityPlanner planner(settings.maxBeams, settings.maxSubBeams, settings);
+
+            for (uint32_t frame = 0; frame < settings.windowSize; frame++)
+            {
+                uint64_t beams = frame == 10 ? 900000 : 20000;
+                AddDemand(planner, beams, beams * 8);
+            }
+            Check(planner.BeamCapacity() == 25088, "spikes: a single spike is outside the percentile", failures);
+
+            BeamCapacityPlanner frequent(settings.maxBeams, settings.maxSubBeams, settings);
+            for (uint32_t frame = 0; frame < settings.windowSize; frame++)
+            {
+                uint64_t beams = frame % 10 == 0 ? 900000 : 20000;
+                AddDemand(frequent, beams, beams * 8);
+            }
+            Check(frequent.BeamCapacity() == settings.maxBeams, "spikes: frequent spikes keep the capacity", failures);
+        }
+
+        // bounds
+        {
+            BeamCapacityPlanner planner(settings.maxBeams, settings.maxSubBeams, settings);
+            for (uint32_t frame = 0; frame < settings.windowSize; frame++)
+                AddDemand(planner, 10, 10);
+            Check(planner.BeamCapacity() == settings.minBeams && planner.SubBeamCapacity() == settings.minSubBeams, "bounds: minimum", failures);
+
+            AddDemand(planner, 1ull << 30, 1ull << 30);
+            Check(planner.BeamCapacity() == settings.maxBeams && planner.SubBeamCapacity() == settings.maxSubBeams, "bounds: maximum", failures);
+            Check(!AddDemand(planner, 1ull << 30, 1ull << 30), "bounds: no resize at the maximum", failures);
+        }
+
+        // a slowly decreasing demand does not resize before the cooldown
+        {
+            BeamCapacityPlanner planner(settings.maxBeams, settings.maxSubBeams, settings);
+            uint64_t lastResizeFrame = 0;
+            bool resizedTooSoon = false;
+
+            for (uint32_t frame = 1; frame <= 8 * settings.windowSize; frame++)
+            {
+                uint64_t beams = 400000 - frame * 300;
+                if (AddDemand(planner, beams, beams * 8))
+                {
+                    if (lastResizeFrame != 0 && frame - lastResizeFrame < settings.minFramesBetweenResizes)
+                        resizedTooSoon = true;
+                    lastResizeFrame = frame;
+                }
+            }
+
+            Check(!resizedTooSoon, "cooldown: resizes are spaced", failures);
+            Check(planner.NumOverflowFrames() == 0, "cooldown: a decreasing demand never overflows", failures);
+        }
+
+        return failures;
+    }
+}
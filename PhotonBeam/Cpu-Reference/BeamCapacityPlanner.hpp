@@ -0,0 +1,117 @@
+
+#pragma once
+
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Sizing of the beam buffer and the sub-beam instance buffer of BeamGen.hlsl from the demand of the previous frames.
+//
+// BeamGen.hlsl increments its counters before testing the capacities, so the counters read back after a frame
+// hold the requested beams and sub-beams, the overflowing ones included.
+// A launch returns at its first overflow, so the beams it would have traced after it and the sub-beams of a
+// dropped beam are never requested, the requested counts are a lower bound of the demand of an overflowing frame.
+//
+// The planner keeps a moving window of the demand and plans headroom * percentile of the window:
+//  - any overflow grows the capacities at once, lost light is visible
+//  - the capacities shrink only once the window is full, when the plan falls under shrinkRatio of the capacity,
+//    and at least minFramesBetweenResizes frames after the previous resize, so the buffers are not recreated every frame
+// It does not touch the GPU, PhotonBeamApp recreates the buffers when AddFrame() returns true.
+namespace CpuReference
+{
+    struct BeamOverflowCounters
+    {
+        uint64_t requestedBeams = 0;
+        uint64_t requestedSubBeams = 0;
+
+        uint64_t storedBeams = 0;
+        uint64_t storedSubBeams = 0;
+
+        bool Overflowed() const { return storedBeams < requestedBeams || storedSubBeams < requestedSubBeams; }
+    };
+
+    // Counters of a frame run with the given capacities.
+    // BeamGen.hlsl drops a whole sub-beam group that does not fit, so the stored sub-beams are an upper bound.
+    BeamOverflowCounters MakeBeamOverflowCounters(
+        const PhotonBeamCounter& counter,
+        uint64_t beamCapacity,
+        uint64_t subBeamCapacity
+    );
+
+    struct BeamCapacityPlannerSettings
+    {
+        // frames of the moving window
+        uint32_t windowSize = 120;
+
+        // percentile of the window demand covered, and the factor applied over it
+        float percentile = 0.99f;
+        float headroom = 1.25f;
+
+        // the capacities shrink when the plan falls under shrinkRatio * capacity
+        float shrinkRatio = 0.5f;
+
+        // growing on overflow ignores it
+        uint32_t minFramesBetweenResizes = 60;
+
+        // capacities are multiples of granularity, the sub-beam buffer is reset by groups of that size
+        uint64_t granularity = SUB_BEAM_INFO_BUFFER_RESET_COMPUTE_SHADER_GROUP_SIZE;
+
+        uint64_t minBeams = 4096;
+        uint64_t maxBeams = 1ull << 21;
+        uint64_t minSubBeams = 4096;
+        uint64_t maxSubBeams = 1ull << 22;
+    };
+
+    class BeamCapacityPlanner
+    {
+    public:
+        BeamCapacityPlanner(uint64_t beamCapacity, uint64_t subBeamCapacity, const BeamCapacityPlannerSettings& settings = {});
+
+        // Counters of one frame, in frame order. Returns true when the capacities changed.
+        bool AddFrame(const BeamOverflowCounters& counters);
+
+        uint64_t BeamCapacity() const { return m_beamCapacity; }
+        uint64_t SubBeamCapacity() const { return m_subBeamCapacity; }
+
+        // demand of one frame, the sub-beams scaled by requested / stored beams when beams were dropped
+        static uint64_t BeamDemand(const BeamOverflowCounters& counters);
+        static uint64_t SubBeamDemand(const BeamOverflowCounters& counters);
+
+        const BeamOverflowCounters& LastFrame() const { return m_lastFrame; }
+        uint64_t NumFrames() const { return m_numFrames; }
+        uint64_t NumOverflowFrames() const { return m_numOverflowFrames; }
+        uint64_t NumDroppedBeams() const { return m_numDroppedBeams; }
+        uint64_t NumDroppedSubBeams() const { return m_numDroppedSubBeams; }
+        uint64_t NumResizes() const { return m_numResizes; }
+
+    private:
+        // headroom * percentile of the window, rounded and clamped
+        uint64_t Plan(const std::vector<uint64_t>& window, uint64_t minCapacity, uint64_t maxCapacity);
+        uint64_t Round(double capacity, uint64_t minCapacity, uint64_t maxCapacity) const;
+
+        BeamCapacityPlannerSettings m_settings;
+
+        uint64_t m_beamCapacity;
+        uint64_t m_subBeamCapacity;
+
+        // ring buffers of the demand, m_windowFill entries ending before m_windowNext
+        std::vector<uint64_t> m_beamWindow;
+        std::vector<uint64_t> m_subBeamWindow;
+        std::vector<uint64_t> m_scratch;
+        uint32_t m_windowNext = 0;
+        uint32_t m_windowFill = 0;
+
+        BeamOverflowCounters m_lastFrame;
+        uint64_t m_numFrames = 0;
+        uint64_t m_lastResizeFrame = 0;
+        uint64_t m_numOverflowFrames = 0;
+        uint64_t m_numDroppedBeams = 0;
+        uint64_t m_numDroppedSubBeams = 0;
+        uint64_t m_numResizes = 0;
+    };
+
+    // Checks the planner on synthetic demand sequences. Returns one line per failure, an empty string when everything passed.
+    std::string ValidateBeamCapacityPlanner();
+}
@@ -0,0 +1,675 @@
+#include "BeamClusterTree.hpp"
+#include "BeamInstanceList.hpp"
+#include "BeamOcclusion.hpp"
+#include "CornellScene.hpp"
+#include "ProgressiveBeams.hpp"
+#include "RayTracingSampling.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // the shortest representative, for the nodes of parallel segments side by side
+        constexpr float c_minRepresentativeLength = 1e-4f;
+
+        struct CutEntry
+        {
+            float bound;
+            uint32_t node;
+            float3 estimate;
+        };
+
+        bool operator<(const CutEntry& a, const CutEntry& b)
+        {
+            return a.bound < b.bound;
+        }
+
+        // mean of exp(-extinction * d) over d in [0, length]
+        float3 MeanTransmittance(const float3& airExtinctCoff, float length)
+        {
+            const auto mean = [length](float extinction)
+            {
+                const float opticalLength = extinction * length;
+                return opticalLength > 1e-6f ? (1.0f - std::exp(-opticalLength)) / opticalLength : 1.0f;
+            };
+            return float3(mean(airExtinctCoff.x), mean(airExtinctCoff.y), mean(airExtinctCoff.z));
+        }
+
+        float MinComponent(const float3& a)
+        {
+            return std::min(a.x, std::min(a.y, a.z));
+        }
+
+        // entry of the ray segment [0, tMax] into the bounds
+        bool RayHitsBounds(const GatherRay& ray, const float3& boundsMin, const float3& boundsMax, float& tNear)
+        {
+            float tMin = 0.0f;
+            float tMax = ray.tMax;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const float origin = (&ray.origin.x)[axis];
+                const float direction = (&ray.direction.x)[axis];
+                const float low = (&boundsMin.x)[axis];
+                const float high = (&boundsMax.x)[axis];
+
+                if (direction == 0.0f)
+                {
+                    if (origin < low || origin > high)
+                        return false;
+                    continue;
+                }
+
+                float t0 = (low - origin) / direction;
+                float t1 = (high - origin) / direction;
+                if (t0 > t1)
+                    std::swap(t0, t1);
+
+                tMin = std::max(tMin, t0);
+                tMax = std::min(tMax, t1);
+                if (tMin > tMax)
+                    return false;
+            }
+
+            tNear = tMin;
+            return true;
+        }
+
+        // the segments each hit at the brightest phase and the smallest sine of the cone, from the entry of the bounds
+        float ClusterErrorBound(const BeamGatherConstants& constants, const GatherRay& ray, const BeamClusterNode& node, float tNear)
+        {
+            const float cosToAxis = std::clamp(dot(-ray.direction, node.coneAxis), -1.0f, 1.0f);
+            const float angle = std::acos(cosToAxis);
+            const float halfAngle = std::acos(std::clamp(node.coneCosHalfAngle, -1.0f, 1.0f));
+            const float nearestAngle = angle - halfAngle;
+            const float farthestAngle = angle + halfAngle;
+
+            // the phase function is monotonic in the cosine
+            const float phaseMax = std::max(
+                heneyGreenPhaseFunc(std::cos(std::max(0.0f, nearestAngle)), constants.airHGAssymFactor),
+                heneyGreenPhaseFunc(std::cos(std::min(c_pi, farthestAngle)), constants.airHGAssymFactor)
+            );
+
+            // a cone holding the ray direction has no bound, the 1 / sin of the radiance
+            const float sinMin = nearestAngle <= 0.0f || farthestAngle >= c_pi
+                ? 0.0f
+                : std::min(std::sin(nearestAngle), std::sin(farthestAngle));
+
+            const float rayTransmittance = std::exp(-MinComponent(constants.airExtinctCoff) * tNear);
+            return maxComponent(constants.airScatterCoff) * phaseMax * rayTransmittance * node.flux * node.maxTransmittance
+                / (constants.numBeamSources * (node.minRadius * sinMin + 0.1e-10f)) * std::sqrt(1.1f);
+        }
+
+        struct ClusterView
+        {
+            std::vector<SceneBox> scene;
+            PushConstantRay pcRay;
+            std::vector<GatherRay> pixelRays;
+            std::vector<PhotonBeam> beams;
+        };
+
+        // the air beams of the Cornell scene seen from outside the open front
+        ClusterView CreateClusterView(uint32_t width, uint32_t height, uint32_t numLaunches, uint32_t maxBeamsPerLaunch, float beamRadius, uint32_t seed)
+        {
+            ClusterView view;
+            view.scene = CreateCornellScene();
+            view.pcRay = MakeSceneRayConstants(float3(0.0f, 0.0f, -14.0f), float3(0.0f), 0.8f, float(width) / float(height), numLaunches);
+            view.pcRay.beamRadius = beamRadius;
+
+            const OcclusionCamera camera = MakeOcclusionCamera(view.pcRay, width, height);
+            view.pixelRays.resize(size_t(width) * height);
+            for (uint32_t y = 0; y < height; y++)
+            {
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    GatherRay ray = MakePrimaryRay(camera, x, y);
+                    SceneHit hit;
+                    if (TraceScene(view.scene, ray.origin, ray.direction, c_rayTMin, c_rayTMaxDefault, hit))
+                        ray.tMax = hit.t;
+                    view.pixelRays[size_t(y) * width + x] = ray;
+                }
+            }
+
+            PushConstantBeam pcBeam = MakeSceneBeamConstants();
+            pcBeam.beamRadius = beamRadius;
+            for (const auto& emissions : CreateSceneEmissions(view.scene, numLaunches, maxBeamsPerLaunch, seed))
+            {
+                for (const auto& emission : emissions)
+                {
+                    if (emission.airSubBeams)
+                        view.beams.push_back(EmittedBeam(emission, pcBeam));
+                }
+            }
+            return view;
+        }
+
+        void CollectSegments(const BeamClusterTree& tree, uint32_t nodeIndex, std::vector<uint32_t>& segments)
+        {
+            const BeamClusterNode& node = tree.Nodes()[nodeIndex];
+            if (node.segment != BeamClusterTree::c_invalidIndex)
+            {
+                segments.push_back(node.segment);
+                return;
+            }
+            CollectSegments(tree, node.children[0], segments);
+            CollectSegments(tree, node.children[1], segments);
+        }
+
+        bool IsNear(const float3& a, const float3& b, float relativeError)
+        {
+            const float scale = std::max(maxComponent(max(a, b)), 1e-12f);
+            return maxComponent(max(a - b, b - a)) <= scale * relativeError;
+        }
+
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+    }
+
+    void BeamClusterTree::Build(const std::vector<PhotonBeam>& beams, const BeamGatherConstants& constants, float segmentLength)
+    {
+        m_beams.clear();
+        m_segments.clear();
+        m_nodes.clear();
+
+        for (const auto& photonBeam : beams)
+        {
+            GatherBeam beam = LoadGatherBeam(photonBeam);
+            if (!(beam.length > 0.0f))
+                continue;
+
+            beam.radius = getGatherBeamRadius(beam.radius, constants.beamRadius);
+            const uint32_t beamIndex = uint32_t(m_beams.size());
+            m_beams.push_back(beam);
+
+            const uint32_t numSegments = std::max(1u, uint32_t(std::ceil(beam.length / segmentLength)));
+            const float length = beam.length / float(numSegments);
+            for (uint32_t i = 0; i < numSegments; i++)
+            {
+                const float offset = length * float(i);
+                const float3 transmittance = exp(-constants.airExtinctCoff * offset);
+
+                BeamClusterSegment segment;
+                segment.beam = beamIndex;
+                segment.offset = offset;
+                segment.length = length;
+                segment.lightColor = beam.lightColor * transmittance;
+                segment.transmittance = maxComponent(transmittance);
+                m_segments.push_back(segment);
+            }
+        }
+
+        m_order.resize(m_segments.size());
+        std::iota(m_order.begin(), m_order.end(), 0u);
+        m_nodes.reserve(m_segments.size() * 2);
+        if (!m_segments.empty())
+            BuildNode(0, uint32_t(m_segments.size()), constants.airExtinctCoff);
+    }
+
+    uint32_t BeamClusterTree::BuildNode(uint32_t begin, uint32_t end, const float3& airExtinctCoff)
+    {
+        const uint32_t nodeIndex = uint32_t(m_nodes.size());
+        m_nodes.emplace_back();
+
+        BeamClusterNode node = {};
+        node.boundsMin = float3(FLT_MAX);
+        node.boundsMax = float3(-FLT_MAX);
+        node.minTransmittance = FLT_MAX;
+        node.maxTransmittance = 0.0f;
+
+        float3 axisSum(0.0f);
+        float3 centroidSum(0.0f);
+        float3 centerMin(FLT_MAX);
+        float3 centerMax(-FLT_MAX);
+        float weightSum = 0.0f;
+        float minRadius = FLT_MAX;
+        for (uint32_t i = begin; i < end; i++)
+        {
+            const BeamClusterSegment& segment = m_segments[m_order[i]];
+            const GatherBeam& beam = m_beams[segment.beam];
+            const float3 start = beam.startPos + beam.direction * segment.offset;
+            const float3 stop = start + beam.direction * segment.length;
+            const float3 center = (start + stop) * 0.5f;
+
+            node.boundsMin = min(node.boundsMin, min(start, stop) - beam.radius);
+            node.boundsMax = max(node.boundsMax, max(start, stop) + beam.radius);
+            node.flux += maxComponent(beam.lightColor);
+            node.minTransmittance = std::min(node.minTransmittance, segment.transmittance);
+            node.maxTransmittance = std::max(node.maxTransmittance, segment.transmittance);
+            minRadius = std::min(minRadius, beam.radius);
+
+            const float weight = std::max(maxComponent(segment.lightColor), 1e-12f) * segment.length;
+            axisSum += beam.direction * weight;
+            centroidSum += center * weight;
+            weightSum += weight;
+            centerMin = min(centerMin, center);
+            centerMax = max(centerMax, center);
+        }
+
+        const GatherBeam& firstBeam = m_beams[m_segments[m_order[begin]].beam];
+        node.coneAxis = length(axisSum) > weightSum * 1e-6f ? normalize(axisSum) : firstBeam.direction;
+        const float3 centroid = centroidSum / weightSum;
+
+        // the representative spans the segments along the axis and is as wide as their distance to it
+        float alongMin = FLT_MAX;
+        float alongMax = -FLT_MAX;
+        float radius = minRadius;
+        node.minRadius = minRadius;
+        float3 colorLength(0.0f);
+        node.coneCosHalfAngle = 1.0f;
+        for (uint32_t i = begin; i < end; i++)
+        {
+            const BeamClusterSegment& segment = m_segments[m_order[i]];
+            const GatherBeam& beam = m_beams[segment.beam];
+            const float3 start = beam.startPos + beam.direction * segment.offset;
+            const float3 stop = start + beam.direction * segment.length;
+
+            for (const float3& point : { start, stop })
+            {
+                const float along = dot(point - centroid, node.coneAxis);
+                alongMin = std::min(alongMin, along);
+                alongMax = std::max(alongMax, along);
+                radius = std::max(radius, length(cross(point - centroid, node.coneAxis)) + beam.radius);
+            }
+
+            node.coneCosHalfAngle = std::min(node.coneCosHalfAngle, dot(beam.direction, node.coneAxis));
+            colorLength += segment.lightColor * segment.length * MeanTransmittance(airExtinctCoff, segment.length);
+        }
+
+        GatherBeam& representative = node.representative;
+        representative.direction = node.coneAxis;
+        representative.startPos = centroid + node.coneAxis * alongMin;
+        representative.length = std::max(alongMax - alongMin, c_minRepresentativeLength);
+        representative.radius = radius;
+        representative.lightColor = colorLength / (MeanTransmittance(airExtinctCoff, representative.length) * representative.length);
+
+        node.children[0] = c_invalidIndex;
+        node.children[1] = c_invalidIndex;
+        node.segment = c_invalidIndex;
+
+        if (end - begin == 1)
+        {
+            node.segment = m_order[begin];
+            m_nodes[nodeIndex] = node;
+            return nodeIndex;
+        }
+
+        // median split of the segment centers along the longest side of their bounds
+        const float3 extent = centerMax - centerMin;
+        const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        const uint32_t middle = begin + (end - begin) / 2;
+        std::nth_element(
+            m_order.begin() + begin,
+            m_order.begin() + middle,
+            m_order.begin() + end,
+            [&](uint32_t a, uint32_t b)
+            {
+                const auto center = [&](uint32_t index)
+                {
+                    const BeamClusterSegment& segment = m_segments[index];
+                    const GatherBeam& beam = m_beams[segment.beam];
+                    return (&beam.startPos.x)[axis] + (&beam.direction.x)[axis] * (segment.offset + segment.length * 0.5f);
+                };
+                return center(a) < center(b);
+            }
+        );
+
+        node.children[0] = BuildNode(begin, middle, airExtinctCoff);
+        node.children[1] = BuildNode(middle, end, airExtinctCoff);
+        m_nodes[nodeIndex] = node;
+        return nodeIndex;
+    }
+
+    bool BeamClusterTree::GatherSegment(const BeamGatherConstants& constants, const GatherRay& ray, uint32_t segmentIndex, float3& radiance) const
+    {
+        const BeamClusterSegment& segment = m_segments[segmentIndex];
+        const GatherBeam& beam = m_beams[segment.beam];
+
+        // the ray enters the box of the segment, as it enters the AABB of a sub-beam instance
+        const float3 start = beam.startPos + beam.direction * segment.offset;
+        const float3 stop = start + beam.direction * segment.length;
+        float tNear;
+        if (!RayHitsBounds(ray, min(start, stop) - beam.radius, max(start, stop) + beam.radius, tNear))
+            return false;
+
+        float tCurr;
+        float3 beamPoint;
+        if (!IntersectGatherBeam(constants, ray, beam, tCurr, beamPoint))
+            return false;
+
+        // the first and the last segment take the beam points before and after the beam
+        const float along = dot(beamPoint - beam.startPos, beam.direction);
+        const bool isFirst = segment.offset == 0.0f;
+        const bool isLast = segment.offset + segment.length * 1.5f > beam.length;
+        if ((!isFirst && along < segment.offset) || (!isLast && along >= segment.offset + segment.length))
+            return false;
+
+        radiance = GatherBeamHitRadiance(constants, ray, beam, tCurr, beamPoint);
+        return true;
+    }
+
+    float3 BeamClusterTree::Gather(const BeamGatherConstants& constants, const GatherRay& ray, const BeamClusterCutSettings& settings, BeamClusterGatherStats& stats) const
+    {
+        if (m_nodes.empty())
+            return float3(0.0f);
+
+        // the leaves add to radiance as they are reached, the nodes left in the cut at the end, without the
+        // cancellation of the running total
+        float3 radiance(0.0f);
+        float3 total(0.0f);
+
+        const uint32_t maxCutSize = settings.errorThreshold > 0.0f ? settings.maxCutSize : UINT32_MAX;
+        std::vector<CutEntry> cut;
+        uint32_t cutSize = 0;
+
+        // sum of the bounds of the nodes in the cut
+        double boundSum = 0.0;
+
+        const auto addNode = [&](uint32_t nodeIndex)
+        {
+            const BeamClusterNode& node = m_nodes[nodeIndex];
+            stats.numBoxTests++;
+
+            float tNear;
+            if (!RayHitsBounds(ray, node.boundsMin, node.boundsMax, tNear))
+                return;
+
+            cutSize++;
+            if (node.segment != c_invalidIndex)
+            {
+                stats.numSegmentIntersections++;
+                float3 segmentRadiance;
+                if (GatherSegment(constants, ray, node.segment, segmentRadiance))
+                {
+                    radiance += segmentRadiance;
+                    total += segmentRadiance;
+                }
+                return;
+            }
+
+            CutEntry entry;
+            entry.node = nodeIndex;
+            entry.estimate = float3(0.0f);
+            entry.bound = ClusterErrorBound(constants, ray, node, tNear);
+
+            stats.numRepresentativeIntersections++;
+            GatherBeamRadiance(constants, ray, node.representative, entry.estimate);
+            total += entry.estimate;
+            boundSum += entry.bound;
+
+            cut.push_back(entry);
+            std::push_heap(cut.begin(), cut.end());
+        };
+
+        addNode(0);
+        while (!cut.empty())
+        {
+            if (boundSum <= settings.errorThreshold * maxComponent(total))
+                break;
+
+            if (cutSize >= maxCutSize)
+            {
+                stats.numTruncatedCuts++;
+                break;
+            }
+
+            std::pop_heap(cut.begin(), cut.end());
+            const CutEntry entry = cut.back();
+            cut.pop_back();
+            cutSize--;
+            total -= entry.estimate;
+            boundSum -= entry.bound;
+
+            // the largest bound held most of the sum, the rest is summed again rather than left to the cancellation
+            if (entry.bound > boundSum)
+            {
+                boundSum = 0.0;
+                for (const CutEntry& remaining : cut)
+                    boundSum += remaining.bound;
+            }
+
+            const BeamClusterNode& node = m_nodes[entry.node];
+            addNode(node.children[0]);
+            addNode(node.children[1]);
+        }
+
+        for (const CutEntry& entry : cut)
+            radiance += entry.estimate;
+        return radiance;
+    }
+
+    float3 BeamClusterTree::GatherSegments(const BeamGatherConstants& constants, const GatherRay& ray) const
+    {
+        float3 total(0.0f);
+        for (uint32_t i = 0; i < uint32_t(m_segments.size()); i++)
+        {
+            float3 radiance;
+            if (GatherSegment(constants, ray, i, radiance))
+                total += radiance;
+        }
+        return total;
+    }
+
+    std::string ValidateBeamClusterTree()
+    {
+        std::string failures;
+
+        const uint32_t width = 24;
+        const uint32_t height = 14;
+        const ClusterView view = CreateClusterView(width, height, 64, 4, 0.2f, 3);
+        const BeamGatherConstants constants = MakeBeamGatherConstants(view.pcRay);
+
+        BeamClusterTree tree;
+        tree.Build(view.beams, constants, 0.4f);
+        const auto& nodes = tree.Nodes();
+        const auto& segments = tree.Segments();
+
+        // the nodes bound their children, the cones hold their segments, the representatives carry their segments
+        {
+            bool isBounding = true;
+            bool isConeHolding = true;
+            bool isCarrying = true;
+            std::vector<uint32_t> nodeSegments;
+            for (uint32_t i = 0; i < uint32_t(nodes.size()); i++)
+            {
+                const BeamClusterNode& node = nodes[i];
+                for (uint32_t child : node.children)
+                {
+                    if (child == BeamClusterTree::c_invalidIndex)
+                        continue;
+                    isBounding = isBounding && maxComponent(node.boundsMin - nodes[child].boundsMin) <= 0.0f
+                        && maxComponent(nodes[child].boundsMax - node.boundsMax) <= 0.0f;
+                }
+
+                // every 16th node, the segments of the large nodes take long to collect
+                if (i % 16 != 0)
+                    continue;
+
+                nodeSegments.clear();
+                CollectSegments(tree, i, nodeSegments);
+                float3 colorLength(0.0f);
+                for (uint32_t segmentIndex : nodeSegments)
+                {
+                    const BeamClusterSegment& segment = segments[segmentIndex];
+                    const GatherBeam& beam = tree.Beams()[segment.beam];
+                    isConeHolding = isConeHolding && dot(beam.direction, node.coneAxis) >= node.coneCosHalfAngle - 1e-5f;
+                    colorLength += segment.lightColor * segment.length * MeanTransmittance(constants.airExtinctCoff, segment.length);
+                }
+
+                const GatherBeam& representative = node.representative;
+                const float3 representativeColorLength = representative.lightColor * representative.length
+                    * MeanTransmittance(constants.airExtinctCoff, representative.length);
+                isCarrying = isCarrying && IsNear(representativeColorLength, colorLength, 1e-3f);
+            }
+
+            Check(nodes.size() == segments.size() * 2 - 1, "tree: a leaf per segment", failures);
+            Check(isBounding, "tree: nodes bound their children", failures);
+            Check(isConeHolding, "tree: cones hold their segments", failures);
+            Check(isCarrying, "tree: representatives carry the color times length of their segments", failures);
+        }
+
+        // the segments sum to their beams, the threshold 0 to the segments
+        {
+            uint32_t numSegmentSumMismatches = 0;
+            bool isExact = true;
+            bool hasRadiance = false;
+            BeamClusterGatherStats stats;
+            for (const GatherRay& ray : view.pixelRays)
+            {
+                float3 beamSum(0.0f);
+                for (const GatherBeam& beam : tree.Beams())
+                {
+                    float3 radiance;
+                    if (GatherBeamRadiance(constants, ray, beam, radiance))
+                        beamSum += radiance;
+                }
+
+                const float3 segmentSum = tree.GatherSegments(constants, ray);
+                const float3 exact = tree.Gather(constants, ray, { 0.0f, 0 }, stats);
+                numSegmentSumMismatches += IsNear(segmentSum, beamSum, 1e-4f) ? 0 : 1;
+                isExact = isExact && IsNear(exact, segmentSum, 1e-4f);
+                hasRadiance = hasRadiance || maxComponent(segmentSum) > 0.0f;
+            }
+
+            Check(hasRadiance, "gather: the beams are seen", failures);
+            // the hits of a ray point past the boxes of the segments are lost, as with the sub-beam instances
+            Check(numSegmentSumMismatches * 100 <= uint32_t(view.pixelRays.size()), "gather: segments sum to their beams", failures);
+            Check(isExact, "gather: threshold 0 is exact", failures);
+        }
+
+        // coarser cuts intersect less for more error
+        {
+            std::vector<float3> reference;
+            for (const GatherRay& ray : view.pixelRays)
+                reference.push_back(tree.GatherSegments(constants, ray));
+
+            double rmse[2];
+            uint64_t numIntersections[2];
+            const float thresholds[2] = { 0.01f, 0.2f };
+            for (int i = 0; i < 2; i++)
+            {
+                BeamClusterGatherStats stats;
+                std::vector<float3> image;
+                for (const GatherRay& ray : view.pixelRays)
+                    image.push_back(tree.Gather(constants, ray, { thresholds[i], 1024 }, stats));
+                rmse[i] = ImageRmse(image, reference);
+                numIntersections[i] = stats.numSegmentIntersections + stats.numRepresentativeIntersections;
+            }
+
+            Check(numIntersections[1] < numIntersections[0], "cut: a larger threshold intersects fewer beams", failures);
+            Check(rmse[1] > rmse[0], "cut: a larger threshold has a larger error", failures);
+        }
+
+        // a cut reaching maxCutSize is reported, the threshold 0 is never truncated
+        {
+            BeamClusterGatherStats smallCutStats;
+            BeamClusterGatherStats exactStats;
+            uint32_t numRaysWithRadiance = 0;
+            for (const GatherRay& ray : view.pixelRays)
+            {
+                tree.Gather(constants, ray, { 0.01f, 2 }, smallCutStats);
+                numRaysWithRadiance += maxComponent(tree.Gather(constants, ray, { 0.0f, 2 }, exactStats)) > 0.0f ? 1 : 0;
+            }
+
+            Check(smallCutStats.numTruncatedCuts > 0 && smallCutStats.numTruncatedCuts <= view.pixelRays.size(), "cut: truncated cuts are counted", failures);
+            Check(numRaysWithRadiance > 0 && exactStats.numTruncatedCuts == 0, "cut: threshold 0 is not truncated", failures);
+        }
+
+        return failures;
+    }
+
+    std::vector<BeamClusterBenchmarkResult> RunBeamClusterBenchmark(const BeamClusterBenchmarkSettings& settings)
+    {
+        const ClusterView view = CreateClusterView(settings.width, settings.height, settings.numLaunches, settings.maxBeamsPerLaunch, settings.beamRadius, settings.seed);
+        const BeamGatherConstants constants = MakeBeamGatherConstants(view.pcRay);
+        const double numRays = double(view.pixelRays.size());
+
+        BeamClusterTree tree;
+        tree.Build(view.beams, constants, settings.segmentLength);
+
+        std::vector<BeamClusterBenchmarkResult> results;
+
+        std::vector<float3> reference(view.pixelRays.size());
+        {
+            BeamClusterBenchmarkResult result;
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < view.pixelRays.size(); i++)
+                reference[i] = tree.GatherSegments(constants, view.pixelRays[i]);
+            result.secondsPerFrame = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            result.segmentIntersections = double(tree.Segments().size());
+            results.push_back(result);
+        }
+
+        double referenceMean = 0.0;
+        for (const auto& radiance : reference)
+            referenceMean += (radiance.x + radiance.y + radiance.z) / 3.0;
+        referenceMean /= numRays;
+
+        std::vector<float3> image(view.pixelRays.size());
+        for (float threshold : settings.errorThresholds)
+        {
+            BeamClusterBenchmarkResult result;
+            result.errorThreshold = threshold;
+
+            BeamClusterGatherStats stats;
+            const BeamClusterCutSettings cutSettings = { threshold, settings.maxCutSize };
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < view.pixelRays.size(); i++)
+                image[i] = tree.Gather(constants, view.pixelRays[i], cutSettings, stats);
+            result.secondsPerFrame = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            result.boxTests = double(stats.numBoxTests) / numRays;
+            result.segmentIntersections = double(stats.numSegmentIntersections) / numRays;
+            result.representativeIntersections = double(stats.numRepresentativeIntersections) / numRays;
+            result.truncatedCuts = double(stats.numTruncatedCuts) / numRays;
+            result.rmse = ImageRmse(image, reference);
+            result.relativeRmse = referenceMean > 0.0 ? result.rmse / referenceMean : 0.0;
+            results.push_back(result);
+        }
+
+        return results;
+    }
+
+    std::string FormatBeamClusterBenchmarkResults(const std::vector<BeamClusterBenchmarkResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            char name[32];
+            if (result.errorThreshold < 0.0f)
+                std::snprintf(name, sizeof(name), "segments");
+            else
+                std::snprintf(name, sizeof(name), "cut %.3f", result.errorThreshold);
+
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-12s %9.3f ms/frame  per ray: boxes %8.1f  segments %8.1f  representatives %7.1f  truncated %5.1f%%  rmse %.4g (%.2f%%)\n",
+                name,
+                result.secondsPerFrame * 1e3,
+                result.boxTests,
+                result.segmentIntersections,
+                result.representativeIntersections,
+                result.truncatedCuts * 100.0,
+                result.rmse,
+                result.relativeRmse * 100.0
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
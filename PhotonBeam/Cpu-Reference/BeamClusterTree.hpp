@@ -0,0 +1,171 @@
+#pragma once
+
+#include "CpuVector.hpp"
+#include "BeamGather.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Lightcuts style clustering of the beams for the far field of the gather.
+//
+// The beams are cut into segments of at most segmentLength. A segment gathers the hits of its beam for the rays
+// entering its box whose beam point falls in it, as a sub-beam instance and the test of BeamAnyHit do, so the
+// segments of a beam sum to the beam but for the rays passing the ends of the boxes. A binary tree over
+// the segments stores in every node
+//   the bounds of the segments grown by their radii
+//   a representative beam, along the weighted mean direction through the segments and as wide as their spread,
+//     carrying their color times length, so it gathers as the segments blurred over the width of the node
+//   the direction cone of the segments, and the bounds of the transmittance from the starts of their beams
+//
+// The gather of a ray starts with the root in the cut and replaces the node of the largest error bound by its
+// children until the sum of the bounds of the cut is below errorThreshold times the brightest channel of the
+// estimate of the cut, or the cut holds maxCutSize nodes and leaves, which BeamClusterGatherStats counts.
+// A leaf gathers its segment exactly, a node the ray misses adds nothing. The bound of a node is every segment
+// hit at its thinnest radius, the brightest phase and the smallest sine of its cone and from the entry of the ray
+// into its bounds, so it bounds the radiance of the segments of the node, not the error of its representative.
+// An untruncated cut therefore leaves at most errorThreshold times its estimate to the representatives.
+// A cone holding the ray direction has no bound, as the 1 / sin of the radiance, and is always refined.
+namespace CpuReference
+{
+    struct BeamClusterSegment
+    {
+        uint32_t beam;
+        float offset;
+        float length;
+
+        // the beam color attenuated from the start of the beam to the segment
+        float3 lightColor;
+        float transmittance;
+    };
+
+    struct BeamClusterNode
+    {
+        float3 boundsMin;
+        float3 boundsMax;
+
+        GatherBeam representative;
+
+        float3 coneAxis;
+        float coneCosHalfAngle;
+
+        // sum of the brightest channel of the beam colors of the segments, before the attenuation
+        float flux;
+
+        // transmittance from the starts of the beams to the segments, the brightest channel
+        float minTransmittance;
+        float maxTransmittance;
+
+        // thinnest beam of the segments
+        float minRadius;
+
+        // a leaf holds one segment, an inner node two children
+        uint32_t children[2];
+        uint32_t segment;
+    };
+
+    struct BeamClusterCutSettings
+    {
+        // relative error bound of the cut, 0 refines to the leaves the ray reaches
+        float errorThreshold = 0.02f;
+
+        // nodes and leaves in the cut of a ray, a cut reaching it stops above the threshold
+        uint32_t maxCutSize = 1024;
+    };
+
+    struct BeamClusterGatherStats
+    {
+        uint64_t numBoxTests = 0;
+
+        // exact segments and representative beams the gather intersects
+        uint64_t numSegmentIntersections = 0;
+        uint64_t numRepresentativeIntersections = 0;
+
+        // cuts stopped by maxCutSize with the sum of their bounds above the threshold
+        uint64_t numTruncatedCuts = 0;
+    };
+
+    class BeamClusterTree
+    {
+    public:
+        static constexpr uint32_t c_invalidIndex = UINT32_MAX;
+
+        // segments of the beams for the extinction of constants
+        void Build(const std::vector<PhotonBeam>& beams, const BeamGatherConstants& constants, float segmentLength);
+
+        // the radiance of the cut of ray
+        float3 Gather(const BeamGatherConstants& constants, const GatherRay& ray, const BeamClusterCutSettings& settings, BeamClusterGatherStats& stats) const;
+
+        // the radiance of every segment, without the tree
+        float3 GatherSegments(const BeamGatherConstants& constants, const GatherRay& ray) const;
+
+        const std::vector<BeamClusterNode>& Nodes() const { return m_nodes; }
+        const std::vector<BeamClusterSegment>& Segments() const { return m_segments; }
+        const std::vector<GatherBeam>& Beams() const { return m_beams; }
+
+    private:
+        uint32_t BuildNode(uint32_t begin, uint32_t end, const float3& airExtinctCoff);
+
+        // the radiance of the hit of the beam of segment when its beam point falls in the segment
+        bool GatherSegment(const BeamGatherConstants& constants, const GatherRay& ray, uint32_t segment, float3& radiance) const;
+
+        std::vector<GatherBeam> m_beams;
+        std::vector<BeamClusterSegment> m_segments;
+        std::vector<uint32_t> m_order;
+        std::vector<BeamClusterNode> m_nodes;
+    };
+
+    // Checks
+    //  that the nodes bound their children, and that the cones hold the directions of their segments
+    //  that a representative carries the color times length of its segments
+    //  that the segments gather as their beams, and that a threshold of 0 gathers the segments exactly
+    //  that a larger threshold intersects fewer beams per ray for a larger error
+    //  that cuts stopped by maxCutSize are counted, and that a threshold of 0 is never stopped
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidateBeamClusterTree();
+
+    struct BeamClusterBenchmarkSettings
+    {
+        uint32_t width = 48;
+        uint32_t height = 27;
+
+        uint32_t numLaunches = 1u << 9;
+        uint32_t maxBeamsPerLaunch = 4;
+        float beamRadius = 0.2f;
+
+        // segments of 2 beam radii, the length of the sub-beams
+        float segmentLength = 0.4f;
+
+        std::vector<float> errorThresholds = { 0.0f, 0.005f, 0.01f, 0.02f, 0.05f, 0.1f, 0.2f };
+        uint32_t maxCutSize = 1024;
+
+        uint32_t seed = 1;
+    };
+
+    struct BeamClusterBenchmarkResult
+    {
+        // negative for the gather of every segment
+        float errorThreshold = -1.0f;
+
+        double secondsPerFrame = 0.0;
+
+        // per ray
+        double boxTests = 0.0;
+        double segmentIntersections = 0.0;
+        double representativeIntersections = 0.0;
+
+        // fraction of the rays whose cut was stopped by maxCutSize
+        double truncatedCuts = 0.0;
+
+        // against the gather of every segment, and relative to its mean channel
+        double rmse = 0.0;
+        double relativeRmse = 0.0;
+    };
+
+    // The gather of every segment, then one gather of the tree per threshold, on the air beams of the Cornell scene.
+    std::vector<BeamClusterBenchmarkResult> RunBeamClusterBenchmark(const BeamClusterBenchmarkSettings& settings = {});
+
+    // one line per result
+    std::string FormatBeamClusterBenchmarkResults(const std::vector<BeamClusterBenchmarkResult>& results);
+}
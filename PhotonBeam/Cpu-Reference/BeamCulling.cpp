@@ -0,0 +1,714 @@
+
+#include "BeamCulling.hpp"
+#include "BeamInstanceList.hpp"
+#include "RayTracingSampling.hpp"
+#include "../Shaders/util/BeamCulling.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // half extent of the benchmark room, centered on the origin
+        constexpr float c_roomSize = 5.0f;
+
+        // the proxy builds are written to a volatile so they are not optimized away
+        volatile uint64_t s_buildSink = 0;
+
+        // xyz of mul(float4(x, y, z, w), M) of HLSL, M stored transposed as PushConstantRay holds it
+        float3 MulStored(float x, float y, float z, float w, const XMFLOAT4X4& stored)
+        {
+            float3 result;
+            for (int j = 0; j < 3; j++)
+                result[j] = x * stored.m[j][0] + y * stored.m[j][1] + z * stored.m[j][2] + w * stored.m[j][3];
+            return result;
+        }
+
+        float3 CameraOrigin(const PushConstantRay& pc)
+        {
+            return MulStored(0.0f, 0.0f, 0.0f, 1.0f, pc.viewInverse);
+        }
+
+        // direction of the primary ray through inUV, as RayGen.hlsl computes it
+        float3 CameraDirection(const PushConstantRay& pc, float u, float v)
+        {
+            const float3 target = normalize(MulStored(u, v, 1.0f, 1.0f, pc.projInverse));
+            return MulStored(target.x, target.y, target.z, 0.0f, pc.viewInverse);
+        }
+
+        float PlaneDistance(const XMFLOAT4& plane, const float3& p)
+        {
+            return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w;
+        }
+
+        bool IsBoxBehindPlane(const XMFLOAT4& plane, const float3& boundsMin, const float3& boundsMax)
+        {
+            // corner the farthest along the plane normal
+            const float3 corner(
+                plane.x >= 0.0f ? boundsMax.x : boundsMin.x,
+                plane.y >= 0.0f ? boundsMax.y : boundsMin.y,
+                plane.z >= 0.0f ? boundsMax.z : boundsMin.z
+            );
+            return PlaneDistance(plane, corner) < 0.0f;
+        }
+
+        struct CullCamera
+        {
+            float3 eye;
+            float3 right;
+            float3 up;
+            float3 forward;
+            float tanHalfFovX;
+            float tanHalfFovY;
+        };
+
+        // left handed look at camera, the matrices are written as UpdateRayTracingPushConstants() stores them
+        CullCamera MakeCullCamera(const float3& eye, const float3& target, float fovY, float aspect, PushConstantRay& pc)
+        {
+            CullCamera camera;
+            camera.eye = eye;
+            camera.forward = normalize(target - eye);
+            camera.right = normalize(cross(float3(0.0f, 1.0f, 0.0f), camera.forward));
+            camera.up = cross(camera.forward, camera.right);
+            camera.tanHalfFovY = std::tan(fovY * 0.5f);
+            camera.tanHalfFovX = camera.tanHalfFovY * aspect;
+
+            pc = {};
+            for (int j = 0; j < 3; j++)
+            {
+                pc.viewInverse.m[j][0] = camera.right[j];
+                pc.viewInverse.m[j][1] = camera.up[j];
+                pc.viewInverse.m[j][2] = camera.forward[j];
+                pc.viewInverse.m[j][3] = eye[j];
+            }
+            pc.viewInverse.m[3][3] = 1.0f;
+
+            // (u, v, 1, 1) to the view space point (u tanX, v tanY, 1)
+            pc.projInverse.m[0][0] = camera.tanHalfFovX;
+            pc.projInverse.m[1][1] = camera.tanHalfFovY;
+            pc.projInverse.m[2][3] = 1.0f;
+            pc.projInverse.m[3][2] = 1.0f;
+
+            return camera;
+        }
+
+        // a primary ray of the camera reaches the point
+        bool IsInCameraView(const CullCamera& camera, const float3& p)
+        {
+            const float3 offset = p - camera.eye;
+            const float z = dot(offset, camera.forward);
+            return z > 0.0f
+                && std::abs(dot(offset, camera.right)) <= camera.tanHalfFovX * z
+                && std::abs(dot(offset, camera.up)) <= camera.tanHalfFovY * z;
+        }
+
+        float3 InstancePoint(const ShaderRayTracingTopASInstanceDesc& instance, const float3& p)
+        {
+            float3 world;
+            for (int row = 0; row < 3; row++)
+            {
+                const XMFLOAT4& t = instance.transform[row];
+                world[row] = t.x * p.x + t.y * p.y + t.z * p.z + t.w;
+            }
+            return world;
+        }
+
+        // BLAS box of the hit group of the instance
+        void InstanceBox(const ShaderRayTracingTopASInstanceDesc& instance, float3& boxMin, float3& boxMax)
+        {
+            const float beamBox[6] = BEAM_BLAS_AABB;
+            const float photonBox[6] = PHOTON_BLAS_AABB;
+            const bool isPhoton = unpackInstanceHitGroup(instance.instanceShaderBindingTableRecordOffsetAndflags) == BEAM_HIT_TYPE_SOLID;
+            const float* box = isPhoton ? photonBox : beamBox;
+
+            boxMin = float3(box[0], box[1], box[2]);
+            boxMax = float3(box[3], box[4], box[5]);
+        }
+
+        // A light in the ceiling and beams bouncing off the walls, every beam ends on a wall with a photon.
+        BeamEmissionLaunches CreateRoomEmissions(uint32_t numLaunches, uint32_t maxBeamsPerLaunch, uint32_t seed)
+        {
+            std::mt19937 generator(seed);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+            BeamEmissionLaunches launches(numLaunches);
+            for (auto& emissions : launches)
+            {
+                const uint32_t numBeams = 1 + generator() % std::max(maxBeamsPerLaunch, 1u);
+                float3 position = float3(0.0f, c_roomSize * 0.9f, 0.0f);
+                float3 direction = uniformSamplingSphereFromUV(float2(unit(generator), unit(generator)));
+                if (direction.y > 0.0f)
+                    direction.y = -direction.y;
+
+                for (uint32_t i = 0; i < numBeams; i++)
+                {
+                    // distance to the wall the beam leaves the room through
+                    float tExit = FLT_MAX;
+                    int exitAxis = 0;
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        if (direction[axis] == 0.0f)
+                            continue;
+                        const float wall = direction[axis] > 0.0f ? c_roomSize : -c_roomSize;
+                        const float t = (wall - position[axis]) / direction[axis];
+                        if (t < tExit)
+                        {
+                            tExit = t;
+                            exitAxis = axis;
+                        }
+                    }
+
+                    float3 normal = float3(0.0f);
+                    normal[exitAxis] = direction[exitAxis] > 0.0f ? -1.0f : 1.0f;
+
+                    BeamEmission emission = {};
+                    emission.direction = direction;
+                    emission.hitNormal = normal;
+                    emission.airSubBeams = true;
+                    emission.surfacePhoton = true;
+                    emission.beam.startPos = position.ToXMFLOAT3();
+                    position = position + direction * tExit;
+                    emission.beam.endPos = position.ToXMFLOAT3();
+                    emission.beam.lightColor = XMFLOAT3(1.0f, 1.0f, 1.0f);
+                    emissions.push_back(emission);
+
+                    // diffuse bounce off the wall
+                    direction = uniformSamplingSphereFromUV(float2(unit(generator), unit(generator)));
+                    if (dot(direction, normal) < 0.0f)
+                        direction = -direction;
+                }
+            }
+
+            return launches;
+        }
+
+        PushConstantBeam MakeRoomBeamConstants()
+        {
+            PushConstantBeam pc = {};
+            pc.beamRadius = 0.2f;
+            pc.photonRadius = 0.2f;
+            pc.beamBlasAddress = 1;
+            pc.photonBlasAddress = 2;
+            pc.maxNumBeams = UINT32_MAX;
+            pc.maxNumSubBeams = UINT32_MAX;
+            return pc;
+        }
+
+        // a mirror panel standing in the middle of the room, facing +x
+        MirrorSurface MakeRoomMirror(float centerY, float centerZ, float halfSize)
+        {
+            const XMFLOAT3 positions[4] = {
+                XMFLOAT3(0.0f, -halfSize, -halfSize),
+                XMFLOAT3(0.0f, -halfSize, halfSize),
+                XMFLOAT3(0.0f, halfSize, halfSize),
+                XMFLOAT3(0.0f, halfSize, -halfSize),
+            };
+            const XMFLOAT3 normals[4] = {
+                XMFLOAT3(1.0f, 0.0f, 0.0f),
+                XMFLOAT3(1.0f, 0.0f, 0.0f),
+                XMFLOAT3(1.0f, 0.0f, 0.0f),
+                XMFLOAT3(1.0f, 0.0f, 0.0f),
+            };
+
+            XMFLOAT4X4 world = {};
+            world.m[0][0] = 1.0f;
+            world.m[1][1] = 1.0f;
+            world.m[2][2] = 1.0f;
+            world.m[3][1] = centerY;
+            world.m[3][2] = centerZ;
+            world.m[3][3] = 1.0f;
+
+            return MakeMirrorSurface(positions, normals, 4, world);
+        }
+
+        // a sphere of mirror normals, for the curved fallback
+        MirrorSurface MakeCurvedMirror(const float3& center)
+        {
+            std::vector<XMFLOAT3> positions;
+            std::vector<XMFLOAT3> normals;
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                const float3 normal = uniformSamplingSphereFromUV(float2((i + 0.5f) / 16.0f, (i % 4 + 0.5f) / 4.0f));
+                normals.push_back(normal.ToXMFLOAT3());
+                positions.push_back((center + normal * 0.5f).ToXMFLOAT3());
+            }
+
+            XMFLOAT4X4 world = {};
+            world.m[0][0] = 1.0f;
+            world.m[1][1] = 1.0f;
+            world.m[2][2] = 1.0f;
+            world.m[3][3] = 1.0f;
+            return MakeMirrorSurface(positions.data(), normals.data(), uint32_t(positions.size()), world);
+        }
+
+        uint32_t ExpandMortonBits(uint32_t v)
+        {
+            v = (v * 0x00010001u) & 0xFF0000FFu;
+            v = (v * 0x00000101u) & 0x0F00F00Fu;
+            v = (v * 0x00000011u) & 0xC30C30C3u;
+            v = (v * 0x00000005u) & 0x49249249u;
+            return v;
+        }
+
+        // world AABBs of the capsules, Morton codes of their centers and the sort of the codes, returns a checksum
+        uint64_t BuildTlasProxy(const std::vector<ShaderRayTracingTopASInstanceDesc>& instances)
+        {
+            std::vector<float3> centers(instances.size());
+            float3 boundsMin = float3(FLT_MAX);
+            float3 boundsMax = float3(-FLT_MAX);
+
+            for (size_t i = 0; i < instances.size(); i++)
+            {
+                XMFLOAT3 start, end;
+                float radius;
+                getSubBeamInstanceCapsule(instances[i], start, end, radius);
+
+                const float3 boxMin = min(float3(start), float3(end)) - radius;
+                const float3 boxMax = max(float3(start), float3(end)) + radius;
+                centers[i] = (boxMin + boxMax) * 0.5f;
+                boundsMin = min(boundsMin, boxMin);
+                boundsMax = max(boundsMax, boxMax);
+            }
+
+            const float3 extent = max(boundsMax - boundsMin, float3(1e-6f));
+            const float3 invExtent = float3(1.0f) / extent;
+            auto quantize = [](float x) { return uint32_t(std::clamp(x * 1023.0f, 0.0f, 1023.0f)); };
+
+            std::vector<uint64_t> keys(instances.size());
+            for (size_t i = 0; i < instances.size(); i++)
+            {
+                const float3 normalized = (centers[i] - boundsMin) * invExtent;
+                const uint32_t code = ExpandMortonBits(quantize(normalized.x))
+                    | (ExpandMortonBits(quantize(normalized.y)) << 1)
+                    | (ExpandMortonBits(quantize(normalized.z)) << 2);
+                keys[i] = (uint64_t(code) << 32) | uint64_t(i);
+            }
+            std::sort(keys.begin(), keys.end());
+
+            return keys.empty() ? 0 : keys.front() ^ keys.back();
+        }
+
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+    }
+
+    MirrorSurface MakeMirrorSurface(
+        const XMFLOAT3* positions,
+        const XMFLOAT3* normals,
+        uint32_t numVertices,
+        const XMFLOAT4X4& worldMatrix
+    )
+    {
+        MirrorSurface mirror;
+        if (numVertices < 1)
+            return mirror;
+
+        const float3 rows[3] = {
+            float3(worldMatrix.m[0][0], worldMatrix.m[0][1], worldMatrix.m[0][2]),
+            float3(worldMatrix.m[1][0], worldMatrix.m[1][1], worldMatrix.m[1][2]),
+            float3(worldMatrix.m[2][0], worldMatrix.m[2][1], worldMatrix.m[2][2]),
+        };
+        const float3 translation(worldMatrix.m[3][0], worldMatrix.m[3][1], worldMatrix.m[3][2]);
+
+        // normals transform with the inverse transpose, the cofactor matrix up to the sign of the determinant
+        const float3 cofactors[3] = {
+            cross(rows[1], rows[2]),
+            cross(rows[2], rows[0]),
+            cross(rows[0], rows[1]),
+        };
+        const float determinantSign = dot(rows[0], cofactors[0]) < 0.0f ? -1.0f : 1.0f;
+
+        std::vector<float3> worldPositions(numVertices);
+        mirror.boundsMin = float3(FLT_MAX);
+        mirror.boundsMax = float3(-FLT_MAX);
+        mirror.planar = true;
+
+        for (uint32_t i = 0; i < numVertices; i++)
+        {
+            const float3 p = positions[i];
+            worldPositions[i] = p.x * rows[0] + p.y * rows[1] + p.z * rows[2] + translation;
+            mirror.boundsMin = min(mirror.boundsMin, worldPositions[i]);
+            mirror.boundsMax = max(mirror.boundsMax, worldPositions[i]);
+
+            const float3 n = normals[i];
+            const float3 worldNormal = normalize((n.x * cofactors[0] + n.y * cofactors[1] + n.z * cofactors[2]) * determinantSign);
+            if (i == 0)
+                mirror.normal = worldNormal;
+            else if (dot(worldNormal, mirror.normal) < 0.9999f)
+                mirror.planar = false;
+        }
+
+        mirror.minDistance = FLT_MAX;
+        mirror.maxDistance = -FLT_MAX;
+        for (const auto& p : worldPositions)
+        {
+            mirror.minDistance = std::min(mirror.minDistance, dot(mirror.normal, p));
+            mirror.maxDistance = std::max(mirror.maxDistance, dot(mirror.normal, p));
+        }
+
+        return mirror;
+    }
+
+    void MakeFrustumPlanes(const PushConstantRay& pc, XMFLOAT4 planes[4])
+    {
+        const float3 origin = CameraOrigin(pc);
+        const float3 center = CameraDirection(pc, 0.0f, 0.0f);
+        const float3 corners[4] = {
+            CameraDirection(pc, -1.0f, -1.0f),
+            CameraDirection(pc, 1.0f, -1.0f),
+            CameraDirection(pc, 1.0f, 1.0f),
+            CameraDirection(pc, -1.0f, 1.0f),
+        };
+
+        for (int i = 0; i < 4; i++)
+        {
+            float3 normal = normalize(cross(corners[i], corners[(i + 1) % 4]));
+            if (dot(normal, center) < 0.0f)
+                normal = -normal;
+
+            planes[i] = XMFLOAT4(normal.x, normal.y, normal.z, -dot(normal, origin));
+        }
+    }
+
+    BeamCullConstants MakeBeamCullConstants(
+        const PushConstantRay& pc,
+        const std::vector<MirrorSurface>& mirrors,
+        uint32_t cullMode,
+        uint32_t maxNumSubBeams
+    )
+    {
+        BeamCullConstants constants = {};
+        constants.cullMode = cullMode;
+        constants.maxNumSubBeams = maxNumSubBeams;
+
+        MakeFrustumPlanes(pc, constants.frustumPlanes);
+
+        if (cullMode != BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS)
+            return constants;
+
+        const float3 origin = CameraOrigin(pc);
+        for (const auto& mirror : mirrors)
+        {
+            bool isVisible = true;
+            for (int i = 0; i < 4; i++)
+            {
+                if (IsBoxBehindPlane(constants.frustumPlanes[i], mirror.boundsMin, mirror.boundsMax))
+                    isVisible = false;
+            }
+
+            if (!isVisible)
+                continue;
+
+            if (!mirror.planar || constants.numMirrorPlanes >= BEAM_CULL_MAX_MIRROR_PLANES)
+            {
+                constants.cullMode = BEAM_CULL_MODE_KEEP_ALL;
+                constants.numMirrorPlanes = 0;
+                return constants;
+            }
+
+            // the reflected rays leave on the side of the camera
+            const float cameraDistance = dot(mirror.normal, origin);
+            const bool isFrontSide = cameraDistance >= (mirror.minDistance + mirror.maxDistance) * 0.5f;
+            const float3 normal = isFrontSide ? mirror.normal : -mirror.normal;
+            const float offset = isFrontSide ? -mirror.minDistance : mirror.maxDistance;
+
+            constants.mirrorPlanes[constants.numMirrorPlanes++] = XMFLOAT4(normal.x, normal.y, normal.z, offset);
+        }
+
+        return constants;
+    }
+
+    SubBeamCullCounter CullSubBeamInstances(
+        const BeamCullConstants& constants,
+        const ShaderRayTracingTopASInstanceDesc* instances,
+        uint32_t numInstances,
+        std::vector<ShaderRayTracingTopASInstanceDesc>& kept
+    )
+    {
+        SubBeamCullCounter counter = {};
+        kept.clear();
+
+        for (uint32_t i = 0; i < std::min(numInstances, constants.maxNumSubBeams); i++)
+        {
+            const ShaderRayTracingTopASInstanceDesc& instance = instances[i];
+            if (instance.accelerationStructureReference == 0)
+                continue;
+
+            counter.numInstances++;
+
+            const uint32_t result = cullSubBeamInstance(constants, instance);
+            if (result == BEAM_CULL_RESULT_CULLED)
+                continue;
+
+            kept.push_back(instance);
+            counter.numKept++;
+            if (result == BEAM_CULL_RESULT_MIRRORS)
+                counter.numKeptByMirrors++;
+        }
+
+        return counter;
+    }
+
+    std::string ValidateBeamCulling()
+    {
+        std::string failures;
+        std::mt19937 generator(2024);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        // the frustum planes hold the rays of RayGen.hlsl
+        {
+            PushConstantRay pc;
+            MakeCullCamera(float3(3.0f, 1.0f, -4.0f), float3(-1.0f, -2.0f, 2.0f), 0.9f, 1.6f, pc);
+
+            XMFLOAT4 planes[4];
+            MakeFrustumPlanes(pc, planes);
+
+            const float3 origin = CameraOrigin(pc);
+            bool inside = true;
+            for (uint32_t i = 0; i < 4096; i++)
+            {
+                const float3 direction = CameraDirection(pc, unit(generator) * 2.0f - 1.0f, unit(generator) * 2.0f - 1.0f);
+                const float t = 0.001f + 100.0f * unit(generator);
+                const float3 p = origin + direction * t;
+                for (const auto& plane : planes)
+                    inside = inside && PlaneDistance(plane, p) >= -1e-4f * t;
+            }
+            Check(inside, "frustum: primary rays inside the planes", failures);
+        }
+
+        // no instance a primary or a mirror ray reaches is culled
+        {
+            const PushConstantBeam pcBeam = MakeRoomBeamConstants();
+            BeamInstanceList list;
+            BuildBeamInstanceListCounted(CreateRoomEmissions(2048, 4, 7), pcBeam, SubBeamSplitMode::Uniform, list);
+
+            const std::vector<MirrorSurface> mirrors = { MakeRoomMirror(-3.5f, 0.0f, 1.0f) };
+            const float3 views[3][2] = {
+                { float3(4.5f, -2.0f, 0.0f), float3(0.0f, -3.5f, 0.0f) },
+                { float3(-4.5f, 4.5f, -4.5f), float3(-5.0f, -5.0f, 5.0f) },
+                { float3(0.0f, 0.0f, -4.9f), float3(0.0f, 0.0f, 5.0f) },
+            };
+
+            bool conservative = true;
+            bool culledSome = false;
+            bool mirrorsUsed = false;
+
+            for (const auto& view : views)
+            {
+                PushConstantRay pc;
+                const CullCamera camera = MakeCullCamera(view[0], view[1], 0.6f, 1.5f, pc);
+
+                for (uint32_t mode : { BEAM_CULL_MODE_FRUSTUM, BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS })
+                {
+                    const BeamCullConstants constants = MakeBeamCullConstants(pc, mirrors, mode, UINT32_MAX);
+                    const bool mirrorVisible = constants.numMirrorPlanes > 0;
+                    mirrorsUsed = mirrorsUsed || mirrorVisible;
+
+                    for (const auto& instance : list.instances)
+                    {
+                        float3 boxMin, boxMax;
+                        InstanceBox(instance, boxMin, boxMax);
+
+                        bool isReached = false;
+                        for (uint32_t s = 0; s < 16 && !isReached; s++)
+                        {
+                            // the eight corners, then random points
+                            const float3 local = s < 8
+                                ? float3((s & 1) ? boxMax.x : boxMin.x, (s & 2) ? boxMax.y : boxMin.y, (s & 4) ? boxMax.z : boxMin.z)
+                                : boxMin + (boxMax - boxMin) * float3(unit(generator), unit(generator), unit(generator));
+                            const float3 p = InstancePoint(instance, local);
+
+                            isReached = IsInCameraView(camera, p) || (mirrorVisible && p.x > 0.0f);
+                        }
+
+                        const uint32_t result = cullSubBeamInstance(constants, instance);
+                        if (isReached && result == BEAM_CULL_RESULT_CULLED)
+                            conservative = false;
+                        if (result == BEAM_CULL_RESULT_CULLED)
+                            culledSome = true;
+                    }
+                }
+            }
+
+            Check(conservative, "conservative: reached instances kept", failures);
+            Check(culledSome, "conservative: some instances culled", failures);
+            Check(mirrorsUsed, "conservative: the mirror is visible from a view", failures);
+        }
+
+        // mirror planes and the fallback to keeping every instance
+        {
+            PushConstantRay pc;
+            MakeCullCamera(float3(4.5f, -2.0f, 0.0f), float3(0.0f, -3.5f, 0.0f), 0.6f, 1.5f, pc);
+
+            const MirrorSurface planar = MakeRoomMirror(-3.5f, 0.0f, 1.0f);
+            Check(planar.planar, "mirrors: panel is planar", failures);
+
+            BeamCullConstants constants = MakeBeamCullConstants(pc, { planar }, BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS, 16);
+            Check(constants.cullMode == BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS && constants.numMirrorPlanes == 1,
+                "mirrors: visible planar mirror adds a plane", failures);
+            Check(PlaneDistance(constants.mirrorPlanes[0], CameraOrigin(pc)) > 0.0f, "mirrors: plane faces the camera", failures);
+
+            const MirrorSurface hidden = MakeRoomMirror(-3.5f, 4.9f, 0.05f);
+            constants = MakeBeamCullConstants(pc, { hidden, MakeCurvedMirror(float3(-4.0f, 4.0f, -4.5f)) }, BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS, 16);
+            Check(constants.cullMode == BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS && constants.numMirrorPlanes == 0,
+                "mirrors: hidden mirrors ignored", failures);
+
+            const MirrorSurface curved = MakeCurvedMirror(float3(0.0f, -3.5f, 0.0f));
+            Check(!curved.planar, "mirrors: sphere is curved", failures);
+            constants = MakeBeamCullConstants(pc, { planar, curved }, BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS, 16);
+            Check(constants.cullMode == BEAM_CULL_MODE_KEEP_ALL, "mirrors: visible curved mirror keeps all", failures);
+
+            std::vector<MirrorSurface> many(BEAM_CULL_MAX_MIRROR_PLANES + 1, planar);
+            constants = MakeBeamCullConstants(pc, many, BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS, 16);
+            Check(constants.cullMode == BEAM_CULL_MODE_KEEP_ALL, "mirrors: too many planes keeps all", failures);
+
+            constants = MakeBeamCullConstants(pc, { curved }, BEAM_CULL_MODE_FRUSTUM, 16);
+            Check(constants.cullMode == BEAM_CULL_MODE_FRUSTUM, "mirrors: frustum mode ignores mirrors", failures);
+        }
+
+        // compaction skips the empty slots and stops at the capacity
+        {
+            const PushConstantBeam pcBeam = MakeRoomBeamConstants();
+            BeamInstanceList list;
+            BuildBeamInstanceListCounted(CreateRoomEmissions(64, 4, 11), pcBeam, SubBeamSplitMode::Uniform, list);
+
+            std::vector<ShaderRayTracingTopASInstanceDesc> instances = list.instances;
+            instances.insert(instances.begin() + instances.size() / 2, ShaderRayTracingTopASInstanceDesc{});
+
+            PushConstantRay pc;
+            MakeCullCamera(float3(0.0f, 0.0f, -4.9f), float3(0.0f, 0.0f, 5.0f), 0.6f, 1.5f, pc);
+
+            BeamCullConstants constants = MakeBeamCullConstants(pc, {}, BEAM_CULL_MODE_KEEP_ALL, UINT32_MAX);
+            std::vector<ShaderRayTracingTopASInstanceDesc> kept;
+            SubBeamCullCounter counter = CullSubBeamInstances(constants, instances.data(), uint32_t(instances.size()), kept);
+            Check(counter.numInstances == list.instances.size() && counter.numKept == list.instances.size() && kept.size() == counter.numKept,
+                "compaction: keep all skips the empty slot", failures);
+
+            constants.maxNumSubBeams = 10;
+            counter = CullSubBeamInstances(constants, instances.data(), uint32_t(instances.size()), kept);
+            Check(counter.numInstances == 10, "compaction: capacity", failures);
+
+            constants = MakeBeamCullConstants(pc, {}, BEAM_CULL_MODE_FRUSTUM, UINT32_MAX);
+            counter = CullSubBeamInstances(constants, instances.data(), uint32_t(instances.size()), kept);
+            Check(counter.numKept == kept.size() && counter.numKept <= counter.numInstances && counter.numKeptByMirrors == 0,
+                "compaction: frustum counters", failures);
+        }
+
+        return failures;
+    }
+
+    std::vector<BeamCullBenchmarkResult> RunBeamCullBenchmark(const BeamCullBenchmarkSettings& settings)
+    {
+        const PushConstantBeam pcBeam = MakeRoomBeamConstants();
+        BeamInstanceList list;
+        BuildBeamInstanceListCounted(
+            CreateRoomEmissions(settings.numLaunches, settings.maxBeamsPerLaunch, 1234),
+            pcBeam,
+            SubBeamSplitMode::Uniform,
+            list
+        );
+
+        const std::vector<MirrorSurface> mirrors = { MakeRoomMirror(-3.5f, 0.0f, 1.0f) };
+
+        struct View
+        {
+            const char* name;
+            float3 eye;
+            float3 target;
+            float fovY;
+        };
+        const View views[] = {
+            { "room", float3(4.9f, 4.9f, -4.9f), float3(0.0f, 0.0f, 0.0f), 1.2f },
+            { "mirror", float3(4.5f, -2.0f, 0.0f), float3(0.0f, -3.5f, 0.0f), 0.6f },
+            { "corner", float3(-4.5f, 4.5f, -4.5f), float3(-5.0f, -5.0f, 5.0f), 0.6f },
+            { "wall", float3(0.0f, 0.0f, -4.9f), float3(0.0f, 0.0f, 5.0f), 0.6f },
+        };
+
+        std::vector<BeamCullBenchmarkResult> results;
+        std::vector<ShaderRayTracingTopASInstanceDesc> kept;
+
+        for (const auto& view : views)
+        {
+            PushConstantRay pc;
+            MakeCullCamera(view.eye, view.target, view.fovY, 1.5f, pc);
+
+            for (uint32_t mode : { BEAM_CULL_MODE_KEEP_ALL, BEAM_CULL_MODE_FRUSTUM, BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS })
+            {
+                BeamCullBenchmarkResult result;
+                result.view = view.name;
+
+                const BeamCullConstants constants = MakeBeamCullConstants(pc, mirrors, mode, UINT32_MAX);
+                result.cullMode = constants.cullMode;
+
+                for (uint32_t pass = 0; pass < settings.numPasses; pass++)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    result.counter = CullSubBeamInstances(constants, list.instances.data(), uint32_t(list.instances.size()), kept);
+                    auto culled = std::chrono::steady_clock::now();
+                    s_buildSink = s_buildSink + BuildTlasProxy(list.instances);
+                    auto builtAll = std::chrono::steady_clock::now();
+                    s_buildSink = s_buildSink + BuildTlasProxy(kept);
+                    auto builtKept = std::chrono::steady_clock::now();
+
+                    const double cullSeconds = std::chrono::duration<double>(culled - start).count();
+                    const double buildAllSeconds = std::chrono::duration<double>(builtAll - culled).count();
+                    const double buildKeptSeconds = std::chrono::duration<double>(builtKept - builtAll).count();
+                    if (pass == 0 || cullSeconds < result.cullSeconds)
+                        result.cullSeconds = cullSeconds;
+                    if (pass == 0 || buildAllSeconds < result.buildAllSeconds)
+                        result.buildAllSeconds = buildAllSeconds;
+                    if (pass == 0 || buildKeptSeconds < result.buildKeptSeconds)
+                        result.buildKeptSeconds = buildKeptSeconds;
+                }
+
+                result.culledFraction = result.counter.numInstances > 0
+                    ? 1.0 - double(result.counter.numKept) / double(result.counter.numInstances)
+                    : 0.0;
+                results.push_back(result);
+            }
+        }
+
+        return results;
+    }
+
+    std::string FormatBeamCullBenchmarkResults(const std::vector<BeamCullBenchmarkResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            const char* modeName = result.cullMode == BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS ? "frustum+mirrors"
+                : (result.cullMode == BEAM_CULL_MODE_FRUSTUM ? "frustum" : "keep all");
+
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-7s %-16s instances %8u  kept %8u  by mirrors %8u  culled %5.1f%%  cull %7.3f ms  build %7.3f -> %7.3f ms\n",
+                result.view,
+                modeName,
+                result.counter.numInstances,
+                result.counter.numKept,
+                result.counter.numKeptByMirrors,
+                result.culledFraction * 100.0,
+                result.cullSeconds * 1e3,
+                result.buildAllSeconds * 1e3,
+                result.buildKeptSeconds * 1e3
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
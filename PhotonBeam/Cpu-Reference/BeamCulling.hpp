@@ -0,0 +1,102 @@
+
+#pragma once
+
+#include "CpuVector.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU side of the sub-beam culling of CullSubBeamInstances.hlsl: the planes of the cull constants,
+// a reference of the culling and compaction, its validation and a benchmark.
+// The test of one instance is cullSubBeamInstance() of Shaders/util/BeamCulling.h, shared with the shader.
+namespace CpuReference
+{
+    // a surface the mirror bounce of RayGen.hlsl reflects off, in world space
+    struct MirrorSurface
+    {
+        float3 boundsMin = float3(0.0f);
+        float3 boundsMax = float3(0.0f);
+
+        // all the normals of the surface are the same,
+        // the vertices lie in minDistance <= dot(normal, p) <= maxDistance
+        bool planar = false;
+        float3 normal = float3(0.0f);
+        float minDistance = 0.0f;
+        float maxDistance = 0.0f;
+    };
+
+    // World space bounds and plane of the vertices of a mesh placed by worldMatrix,
+    // the row vector matrix of GltfNode, p' = (p, 1) * worldMatrix.
+    MirrorSurface MakeMirrorSurface(
+        const DirectX::XMFLOAT3* positions,
+        const DirectX::XMFLOAT3* normals,
+        uint32_t numVertices,
+        const DirectX::XMFLOAT4X4& worldMatrix
+    );
+
+    // Inward planes through the camera and the four edges of the screen, from the matrices RayGen.hlsl builds its rays with.
+    // A plane is (normal, offset) as in BeamCullConstants.
+    void MakeFrustumPlanes(const PushConstantRay& pc, DirectX::XMFLOAT4 planes[4]);
+
+    // Cull constants of a frame.
+    // BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS adds the planes of the mirrors reaching the frustum, oriented to the camera side
+    // the reflected rays leave into, and falls back to BEAM_CULL_MODE_KEEP_ALL when one of them is curved
+    // or there are more than BEAM_CULL_MAX_MIRROR_PLANES.
+    BeamCullConstants MakeBeamCullConstants(
+        const PushConstantRay& pc,
+        const std::vector<MirrorSurface>& mirrors,
+        uint32_t cullMode,
+        uint32_t maxNumSubBeams
+    );
+
+    // Port of CullSubBeamInstances.hlsl, the kept instances are appended in their order.
+    // Empty instances, those without a BLAS, are skipped and not counted.
+    SubBeamCullCounter CullSubBeamInstances(
+        const BeamCullConstants& constants,
+        const ShaderRayTracingTopASInstanceDesc* instances,
+        uint32_t numInstances,
+        std::vector<ShaderRayTracingTopASInstanceDesc>& kept
+    );
+
+    // Checks
+    //  the frustum planes against the rays of RayGen.hlsl
+    //  that no instance reaching the frustum or the front of a visible planar mirror is culled
+    //  the fallback to BEAM_CULL_MODE_KEEP_ALL
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidateBeamCulling();
+
+    struct BeamCullBenchmarkSettings
+    {
+        uint32_t numLaunches = 1u << 14;
+
+        // beams per launch are uniform in [1, maxBeamsPerLaunch]
+        uint32_t maxBeamsPerLaunch = 4;
+
+        // the best of the passes is reported
+        uint32_t numPasses = 3;
+    };
+
+    struct BeamCullBenchmarkResult
+    {
+        const char* view = "";
+        uint32_t cullMode = BEAM_CULL_MODE_KEEP_ALL;
+
+        SubBeamCullCounter counter = {};
+        double culledFraction = 0.0;
+
+        double cullSeconds = 0.0;
+
+        // CPU proxy of the TLAS build over all and over the kept instances:
+        // the world AABBs, their Morton codes and the sort of the codes, the first pass of an LBVH build
+        double buildAllSeconds = 0.0;
+        double buildKeptSeconds = 0.0;
+    };
+
+    // Beams bouncing in a room with a mirror on the floor, seen from several views, culled with every mode.
+    std::vector<BeamCullBenchmarkResult> RunBeamCullBenchmark(const BeamCullBenchmarkSettings& settings = {});
+
+    // one line per result
+    std::string FormatBeamCullBenchmarkResults(const std::vector<BeamCullBenchmarkResult>& results);
+}
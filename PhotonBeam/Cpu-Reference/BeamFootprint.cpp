@@ -0,0 +1,397 @@
+
+#include "BeamFootprint.hpp"
+#include "BeamInstanceList.hpp"
+#include "BeamOcclusion.hpp"
+#include "CornellScene.hpp"
+#include "ProgressiveBeams.hpp"
+#include "../Shaders/util/BeamCulling.h"
+#include "../Shaders/util/BeamFootprint.h"
+#include "../Shaders/util/PackedBeam.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // the seeds of the reference start this far from the seeds of the frames
+        constexpr uint32_t c_referenceSeedOffset = 1u << 24;
+
+        struct FootprintView
+        {
+            const char* name;
+            float3 eye;
+            float3 target;
+            float fovY;
+        };
+
+        // outside the open front, and from a corner under the ceiling close to the light
+        const FootprintView c_footprintViews[] = {
+            { "front", float3(0.0f, 0.0f, -14.0f), float3(0.0f, 0.0f, 0.0f), 0.8f },
+            { "corner", float3(4.5f, 4.5f, -4.5f), float3(-1.0f, -3.0f, 1.5f), 1.0f },
+        };
+
+        // the camera, the primary rays with the tMax of their surface hit and the reference of a view
+        struct FootprintScene
+        {
+            std::vector<SceneBox> scene;
+            PushConstantRay pcRay;
+            OcclusionCamera camera;
+            std::vector<GatherRay> pixelRays;
+            std::vector<float3> reference;
+        };
+
+        struct FootprintFrame
+        {
+            std::vector<float3> image;
+            uint64_t numInstances = 0;
+            uint64_t numBeams = 0;
+            double radiusSum = 0.0;
+            double seconds = 0.0;
+        };
+
+        FootprintScene CreateFootprintScene(const FootprintView& view, uint32_t width, uint32_t height)
+        {
+            FootprintScene scene;
+            scene.scene = CreateCornellScene();
+            scene.pcRay = MakeSceneRayConstants(view.eye, view.target, view.fovY, float(width) / float(height), 1);
+            scene.camera = MakeOcclusionCamera(scene.pcRay, width, height);
+
+            scene.pixelRays.resize(size_t(width) * height);
+            for (uint32_t y = 0; y < height; y++)
+            {
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    GatherRay ray = MakePrimaryRay(scene.camera, x, y);
+                    SceneHit hit;
+                    if (TraceScene(scene.scene, ray.origin, ray.direction, c_rayTMin, c_rayTMaxDefault, hit))
+                        ray.tMax = hit.t;
+                    scene.pixelRays[size_t(y) * width + x] = ray;
+                }
+            }
+            return scene;
+        }
+
+        // air beams alone, converged by a progressive run
+        void RenderFootprintReference(const FootprintView& view, const BeamFootprintBenchmarkSettings& settings, FootprintScene& scene)
+        {
+            ProgressiveBeamSettings referenceSettings;
+            referenceSettings.width = settings.width;
+            referenceSettings.height = settings.height;
+            referenceSettings.eye = view.eye;
+            referenceSettings.target = view.target;
+            referenceSettings.fovY = view.fovY;
+            referenceSettings.numLaunches = settings.numLaunches;
+            referenceSettings.maxBeamsPerLaunch = settings.maxBeamsPerLaunch;
+            referenceSettings.initialRadii = { settings.beamRadius, settings.beamRadius };
+            referenceSettings.alpha = 0.7f;
+            referenceSettings.gatherSurfacePhotons = false;
+            referenceSettings.seed = c_referenceSeedOffset;
+
+            ProgressiveBeamRenderer renderer(referenceSettings);
+            for (uint32_t i = 0; i < settings.numReferenceIterations; i++)
+                renderer.Iterate();
+            scene.reference = renderer.Image();
+        }
+
+        // One frame of the air beams: the emissions, the instance list of pcBeam and the splatted gather.
+        FootprintFrame RenderFootprintFrame(
+            const FootprintScene& scene,
+            const PushConstantBeam& pcBeam,
+            uint32_t numLaunches,
+            uint32_t maxBeamsPerLaunch,
+            uint32_t seed
+        )
+        {
+            FootprintFrame frame;
+            const auto start = std::chrono::steady_clock::now();
+
+            BeamEmissionLaunches launches = CreateSceneEmissions(scene.scene, numLaunches, maxBeamsPerLaunch, seed);
+            for (auto& emissions : launches)
+            {
+                for (auto& emission : emissions)
+                    emission.surfacePhoton = false;
+            }
+
+            BeamInstanceList list;
+            BuildBeamInstanceListCounted(launches, pcBeam, SubBeamSplitMode::Uniform, list, 1);
+
+            PushConstantRay pcRay = scene.pcRay;
+            pcRay.beamRadius = pcBeam.beamRadius;
+            pcRay.numBeamSources = numLaunches;
+            const BeamGatherConstants gatherConstants = MakeBeamGatherConstants(pcRay);
+
+            const OcclusionCamera& camera = scene.camera;
+            frame.image.assign(scene.pixelRays.size(), float3(0.0f));
+            for (const auto& instance : list.instances)
+            {
+                uint32_t x0, y0, x1, y1;
+                if (!ProjectInstanceBounds(camera, instance, x0, y0, x1, y1))
+                    continue;
+
+                const GatherBeam gatherBeam = LoadGatherBeam(list.beams[unpackInstanceCustomIndex(instance.instanceCustomIndexAndmask)]);
+                const float3 instanceOrigin(instance.transform[0].w, instance.transform[1].w, instance.transform[2].w);
+                for (uint32_t y = y0; y <= y1; y++)
+                {
+                    for (uint32_t x = x0; x <= x1; x++)
+                    {
+                        const size_t pixel = size_t(y) * camera.width + x;
+                        const GatherRay& ray = scene.pixelRays[pixel];
+                        if (!RayEntersInstance(instance, ray.origin, ray.direction, c_rayTMin, ray.tMax))
+                            continue;
+
+                        float tCurr;
+                        float3 beamPoint;
+                        if (!IntersectGatherBeam(gatherConstants, ray, gatherBeam, tCurr, beamPoint))
+                            continue;
+
+                        // the hit is on the sub-beam of the instance
+                        const float boxLocalBeamPointPos = dot(beamPoint - instanceOrigin, gatherBeam.direction);
+                        if (boxLocalBeamPointPos < 0.0f || gatherBeam.radius * 2.0f <= boxLocalBeamPointPos)
+                            continue;
+
+                        frame.image[pixel] += GatherBeamHitRadiance(gatherConstants, ray, gatherBeam, tCurr, beamPoint);
+                    }
+                }
+            }
+
+            frame.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            frame.numInstances = list.instances.size();
+            frame.numBeams = list.beams.size();
+            for (const auto& beam : list.beams)
+                frame.radiusSum += beam.radius;
+            return frame;
+        }
+
+        BeamFootprintBenchmarkResult MeasureFootprintFrames(
+            const FootprintScene& scene,
+            const PushConstantBeam& pcBeam,
+            uint32_t numLaunches,
+            const BeamFootprintBenchmarkSettings& settings
+        )
+        {
+            BeamFootprintBenchmarkResult result;
+            result.numLaunches = numLaunches;
+
+            uint64_t numBeams = 0;
+            double radiusSum = 0.0;
+            for (uint32_t frameIndex = 0; frameIndex < settings.numFrames; frameIndex++)
+            {
+                const FootprintFrame frame = RenderFootprintFrame(scene, pcBeam, numLaunches, settings.maxBeamsPerLaunch, frameIndex + 1);
+                result.secondsPerFrame += frame.seconds;
+                result.instancesPerFrame += double(frame.numInstances);
+                result.rmse += ImageRmse(frame.image, scene.reference);
+                numBeams += frame.numBeams;
+                radiusSum += frame.radiusSum;
+            }
+
+            const double numFrames = double(std::max(settings.numFrames, 1u));
+            result.secondsPerFrame /= numFrames;
+            result.instancesPerFrame /= numFrames;
+            result.rmse /= numFrames;
+            result.meanBeamRadius = numBeams > 0 ? radiusSum / double(numBeams) : 0.0;
+            return result;
+        }
+
+        // global radius, footprint radius with as many launches and with the launches of an equal time
+        void CompareFootprintRadius(const FootprintView& view, const BeamFootprintBenchmarkSettings& settings, std::vector<BeamFootprintBenchmarkResult>& results)
+        {
+            FootprintScene scene = CreateFootprintScene(view, settings.width, settings.height);
+            RenderFootprintReference(view, settings, scene);
+
+            PushConstantBeam globalPc = MakeSceneBeamConstants();
+            globalPc.beamRadius = settings.beamRadius;
+
+            PushConstantBeam footprintPc = globalPc;
+            SetFootprintBeamRadius(footprintPc, view.eye, view.fovY, settings.height, length(view.eye), settings.radiusRange);
+
+            BeamFootprintBenchmarkResult global = MeasureFootprintFrames(scene, globalPc, settings.numLaunches, settings);
+            global.view = view.name;
+            global.mode = "global";
+            results.push_back(global);
+
+            BeamFootprintBenchmarkResult footprint = MeasureFootprintFrames(scene, footprintPc, settings.numLaunches, settings);
+            footprint.view = view.name;
+            footprint.mode = "footprint";
+            results.push_back(footprint);
+
+            // the frame time grows linearly with the launches
+            const double scale = footprint.secondsPerFrame > 0.0 ? global.secondsPerFrame / footprint.secondsPerFrame : 1.0;
+            const uint32_t equalTimeLaunches = std::max(1u, uint32_t(std::lround(double(settings.numLaunches) * scale)));
+
+            BeamFootprintBenchmarkResult equalTime = MeasureFootprintFrames(scene, footprintPc, equalTimeLaunches, settings);
+            equalTime.view = view.name;
+            equalTime.mode = "footprint equal time";
+            results.push_back(equalTime);
+        }
+
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+    }
+
+    float PixelSpreadAngle(float fovY, uint32_t height)
+    {
+        return 2.0f * std::tan(fovY * 0.5f) / float(std::max(height, 1u));
+    }
+
+    void SetFootprintBeamRadius(PushConstantBeam& pc, const float3& cameraPosition, float fovY, uint32_t height, float referenceDistance, float radiusRange)
+    {
+        pc.cameraPosition = cameraPosition.ToXMFLOAT3();
+        pc.pixelSpreadAngle = PixelSpreadAngle(fovY, height);
+        pc.footprintPixels = pc.beamRadius / (pc.pixelSpreadAngle * std::max(referenceDistance, 1e-6f));
+        pc.minBeamRadius = pc.beamRadius / radiusRange;
+        pc.maxBeamRadius = pc.beamRadius * radiusRange;
+    }
+
+    std::string ValidateBeamFootprint()
+    {
+        std::string failures;
+
+        // camera distance of the nearest point of the beam
+        {
+            const XMFLOAT3 start(0.0f, 0.0f, 0.0f);
+            const XMFLOAT3 end(10.0f, 0.0f, 0.0f);
+            Check(getBeamCameraDistance(start, end, XMFLOAT3(4.0f, 3.0f, 0.0f)) == 3.0f, "distance: side of the beam", failures);
+            Check(getBeamCameraDistance(start, end, XMFLOAT3(-3.0f, 4.0f, 0.0f)) == 5.0f, "distance: behind the start", failures);
+            Check(getBeamCameraDistance(start, end, XMFLOAT3(13.0f, 0.0f, 4.0f)) == 5.0f, "distance: past the end", failures);
+            Check(getBeamCameraDistance(start, start, XMFLOAT3(0.0f, 2.0f, 0.0f)) == 2.0f, "distance: empty beam", failures);
+        }
+
+        // the radius grows with the distance between the clamps
+        {
+            PushConstantBeam pc = MakeSceneBeamConstants();
+            pc.beamRadius = 0.2f;
+            Check(getFootprintBeamRadius(pc, XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f)) == 0.2f, "radius: no spread keeps the radius", failures);
+
+            SetFootprintBeamRadius(pc, float3(0.0f, 0.0f, 0.0f), 1.0f, 100, 10.0f, 4.0f);
+            const auto radiusAt = [&](float distance)
+            {
+                return getFootprintBeamRadius(pc, XMFLOAT3(-1.0f, distance, 0.0f), XMFLOAT3(1.0f, distance, 0.0f));
+            };
+            Check(std::abs(radiusAt(10.0f) - 0.2f) < 1e-6f, "radius: beamRadius at the reference distance", failures);
+            Check(std::abs(radiusAt(20.0f) - 0.4f) < 1e-6f, "radius: linear in the distance", failures);
+            Check(radiusAt(1.0f) == 0.05f && radiusAt(1000.0f) == 0.8f, "radius: clamped", failures);
+        }
+
+        // the sub-beams and the gather use the radius of the beam
+        {
+            const std::vector<SceneBox> scene = CreateCornellScene();
+            BeamEmissionLaunches launches = CreateSceneEmissions(scene, 64, 4, 3);
+
+            PushConstantBeam pc = MakeSceneBeamConstants();
+            SetFootprintBeamRadius(pc, float3(0.0f, 0.0f, -14.0f), 0.8f, 27, 14.0f, 4.0f);
+
+            BeamInstanceList list;
+            BuildBeamInstanceListCounted(launches, pc, SubBeamSplitMode::Uniform, list);
+
+            bool isSubBeamRadius = true;
+            bool hasRadiusRange = false;
+            std::vector<uint32_t> numSubBeams(list.beams.size(), 0);
+            for (const auto& instance : list.instances)
+            {
+                if (unpackInstanceHitGroup(instance.instanceShaderBindingTableRecordOffsetAndflags) != BEAM_HIT_TYPE_AIR)
+                    continue;
+
+                const uint32_t beamIndex = unpackInstanceCustomIndex(instance.instanceCustomIndexAndmask);
+                const float beamRadius = list.beams[beamIndex].radius;
+                const float3 xColumn(instance.transform[0].x, instance.transform[1].x, instance.transform[2].x);
+                isSubBeamRadius = isSubBeamRadius && std::abs(length(xColumn) - beamRadius) < beamRadius * 1e-5f;
+                hasRadiusRange = hasRadiusRange || std::abs(beamRadius - pc.beamRadius) > pc.beamRadius * 0.1f;
+                numSubBeams[beamIndex]++;
+            }
+
+            bool isSubBeamCount = true;
+            for (size_t i = 0; i < list.beams.size(); i++)
+            {
+                const PhotonBeam& beam = list.beams[i];
+                const float beamLength = length(float3(beam.endPos) - float3(beam.startPos));
+                isSubBeamCount = isSubBeamCount && numSubBeams[i] == UniformSubBeamCount(beamLength, beam.radius);
+            }
+
+            Check(isSubBeamRadius, "sub-beams: boxes of the beam radius", failures);
+            Check(isSubBeamCount, "sub-beams: a sub-beam every 2 beam radii", failures);
+            Check(hasRadiusRange, "sub-beams: radii differ from the global radius", failures);
+        }
+
+        {
+            PhotonBeam beam = {};
+            beam.startPos = XMFLOAT3(-1.0f, 0.0f, 0.0f);
+            beam.endPos = XMFLOAT3(1.0f, 0.0f, 0.0f);
+            beam.lightColor = XMFLOAT3(1.0f, 1.0f, 1.0f);
+
+            // a ray passing 0.3 from the beam
+            GatherRay ray;
+            ray.origin = float3(0.0f, 0.3f, -5.0f);
+            ray.direction = float3(0.0f, 0.0f, 1.0f);
+            ray.tMax = 10.0f;
+
+            BeamGatherConstants constants = {};
+            constants.airScatterCoff = float3(0.1f);
+            constants.airExtinctCoff = float3(0.1f);
+            constants.numBeamSources = 1.0f;
+
+            float3 radiance;
+            constants.beamRadius = 0.2f;
+            beam.radius = 0.5f;
+            const bool isWideHit = GatherBeamRadiance(constants, ray, LoadGatherBeam(beam), radiance);
+
+            constants.beamRadius = 0.5f;
+            beam.radius = 0.2f;
+            const bool isThinHit = GatherBeamRadiance(constants, ray, LoadGatherBeam(beam), radiance);
+
+            beam.radius = 0.0f;
+            const bool isFallbackHit = GatherBeamRadiance(constants, ray, LoadGatherBeam(beam), radiance);
+
+            Check(isWideHit && !isThinHit, "gather: radius of the beam", failures);
+            Check(isFallbackHit, "gather: radius of the constants for a radius of 0", failures);
+
+            beam.radius = 0.3125f;
+            Check(unpackPhotonBeam(packPhotonBeam(beam)).radius == beam.radius, "packed: radius kept", failures);
+        }
+
+        return failures;
+    }
+
+    std::vector<BeamFootprintBenchmarkResult> RunBeamFootprintBenchmark(const BeamFootprintBenchmarkSettings& settings)
+    {
+        std::vector<BeamFootprintBenchmarkResult> results;
+        for (const auto& view : c_footprintViews)
+            CompareFootprintRadius(view, settings, results);
+
+        return results;
+    }
+
+    std::string FormatBeamFootprintBenchmarkResults(const std::vector<BeamFootprintBenchmarkResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-7s %-21s launches %6u  %8.3f ms/frame  instances %9.1f  mean radius %.4f  rmse %.6g\n",
+                result.view,
+                result.mode,
+                result.numLaunches,
+                result.secondsPerFrame * 1e3,
+                result.instancesPerFrame,
+                result.meanBeamRadius,
+                result.rmse
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "CpuVector.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Equal time comparison of the pixel footprint beam radius of util/BeamFootprint.h against the global beam radius.
+//
+// A frame traces the beams of the Cornell scene, builds their sub-beam instances and gathers the air instances by
+// splatting every instance over the pixels of its screen bounds, so the cost of a frame follows the launches,
+// the instances and the any hit calls as on the GPU. The error of a frame is its RMSE against a long progressive
+// run of ProgressiveBeams.hpp, which converges to the image of an infinitely thin beam radius.
+//
+// The footprint radius keeps the blur of a beam about as wide on the screen wherever the beam is. It is not an
+// error reduction against that reference: the thin beams near the camera cost more instances and more noise than
+// the wide far beams save, so compare the error at an equal time before lowering the launches.
+namespace CpuReference
+{
+    // pixelSpreadAngle of util/BeamFootprint.h for a vertical field of view of fovY radians over height pixels
+    float PixelSpreadAngle(float fovY, uint32_t height);
+
+    // Footprint constants of a camera at cameraPosition whose beam radius is pc.beamRadius at referenceDistance,
+    // clamped to [pc.beamRadius / radiusRange, pc.beamRadius * radiusRange].
+    void SetFootprintBeamRadius(PushConstantBeam& pc, const float3& cameraPosition, float fovY, uint32_t height, float referenceDistance, float radiusRange);
+
+    // Checks
+    //  the camera distance and the clamped radius of util/BeamFootprint.h
+    //  that the sub-beams and the gather use the radius of the beam, and the radius of the constants for a radius of 0
+    //  that the packed beam keeps the radius
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidateBeamFootprint();
+
+    struct BeamFootprintBenchmarkSettings
+    {
+        uint32_t width = 48;
+        uint32_t height = 27;
+
+        uint32_t numLaunches = 1u << 8;
+        uint32_t maxBeamsPerLaunch = 4;
+
+        // the global radius, and the footprint radius at the distance of the center of the box
+        float beamRadius = 0.2f;
+        float radiusRange = 4.0f;
+
+        // frames averaged per measurement, each on its own seed
+        uint32_t numFrames = 8;
+        uint32_t numReferenceIterations = 512;
+    };
+
+    struct BeamFootprintBenchmarkResult
+    {
+        const char* view = "";
+        const char* mode = "";
+
+        uint32_t numLaunches = 0;
+        double secondsPerFrame = 0.0;
+        double instancesPerFrame = 0.0;
+        double meanBeamRadius = 0.0;
+
+        // mean over the frames of the RMSE of one frame
+        double rmse = 0.0;
+    };
+
+    // For every view: the global radius, the footprint radius with as many launches,
+    // and the footprint radius with the launches of the time of the global radius.
+    std::vector<BeamFootprintBenchmarkResult> RunBeamFootprintBenchmark(const BeamFootprintBenchmarkSettings& settings = {});
+
+    // one line per result
+    std::string FormatBeamFootprintBenchmarkResults(const std::vector<BeamFootprintBenchmarkResult>& results);
+}
@@ -0,0 +1,186 @@
+
+#pragma once
+
+#include "CpuVector.hpp"
+#include "RayTracingSampling.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+#include "../Shaders/util/PackedBeam.h"
+#include "../Shaders/util/BeamFootprint.h"
+
+#include <algorithm>
+#include <cmath>
+
+// CPU port of the beam gather of RayBeamAnyHit.hlsl, the intersection of a camera ray with a beam and the radiance it adds.
+// The any hit shader also rejects the hits outside the sub-beam box the ray entered, the port tests the whole beam.
+namespace CpuReference
+{
+    struct BeamGatherConstants
+    {
+        float3 airScatterCoff;
+        float3 airExtinctCoff;
+        float airHGAssymFactor;
+        float beamRadius;
+        float numBeamSources;
+    };
+
+    inline BeamGatherConstants MakeBeamGatherConstants(const PushConstantRay& pc)
+    {
+        BeamGatherConstants constants;
+        constants.airScatterCoff = pc.airScatterCoff;
+        constants.airExtinctCoff = pc.airExtinctCoff;
+        constants.airHGAssymFactor = pc.airHGAssymFactor;
+        constants.beamRadius = pc.beamRadius;
+        constants.numBeamSources = float(pc.numBeamSources);
+        return constants;
+    }
+
+    struct GatherRay
+    {
+        float3 origin;
+        float3 direction;
+        float tMax;
+    };
+
+    // the beam as the gather reads it
+    struct GatherBeam
+    {
+        float3 startPos;
+        float3 direction;
+        float length;
+        float3 lightColor;
+
+        // PhotonBeam::radius, 0 for the radius of the constants
+        float radius;
+    };
+
+    inline GatherBeam LoadGatherBeam(const PhotonBeam& beam)
+    {
+        float3 beamVec = float3(beam.endPos) - float3(beam.startPos);
+
+        GatherBeam gatherBeam;
+        gatherBeam.startPos = beam.startPos;
+        gatherBeam.length = length(beamVec);
+        gatherBeam.direction = normalize(beamVec);
+        gatherBeam.lightColor = beam.lightColor;
+        gatherBeam.radius = beam.radius;
+        return gatherBeam;
+    }
+
+    inline GatherBeam LoadGatherBeam(const PackedPhotonBeam& beam)
+    {
+        GatherBeam gatherBeam;
+        gatherBeam.startPos = beam.startPos;
+        gatherBeam.direction = unpackOctahedralDirection(beam.octDirection);
+        gatherBeam.length = beam.length;
+        gatherBeam.lightColor = unpackRGB9E5(beam.lightColorRGB9E5);
+        gatherBeam.radius = beam.radius;
+        return gatherBeam;
+    }
+
+    // getIntersection() of RayBeamAnyHit.hlsl
+    inline bool IntersectGatherBeam(const BeamGatherConstants& pc, const GatherRay& ray, const GatherBeam& beam, float& tCurr, float3& beamPoint)
+    {
+        const float3 rayEnd = ray.origin + ray.direction * ray.tMax;
+        const float rayLength = ray.tMax - 0.0001f;
+        const float3 beamEnd = beam.startPos + beam.direction * beam.length;
+        const float3 rayBeamCross = cross(ray.direction, beam.direction);
+        const float beamRadius = getGatherBeamRadius(beam.radius, pc.beamRadius);
+        const float radiusSquare = beamRadius * beamRadius;
+
+        // check if the ray hits beam cylinder when the beam cylinder has infinite radius
+        float rayStartOnBeamAt = dot(beam.direction, ray.origin - beam.startPos);
+        float rayEndOnBeamAt = dot(beam.direction, rayEnd - beam.startPos);
+
+        if ((rayStartOnBeamAt < 0 && rayEndOnBeamAt < 0) || (beam.length < rayStartOnBeamAt && beam.length < rayEndOnBeamAt))
+            return false;
+
+        // ray and beam almost parallel, the beam point giving the shortest ray length is used
+        if (dot(rayBeamCross, rayBeamCross) < 0.1e-4f * 0.1e-4f)
+        {
+            float beamEndOnRayAt = std::min(rayLength, std::max(0.0f, dot(beamEnd - ray.origin, ray.direction)));
+            float beamStartOnRayAt = std::min(rayLength, std::max(0.0f, dot(beam.startPos - ray.origin, ray.direction)));
+
+            float3 rayPoint = ray.origin + ray.direction * std::min(beamEndOnRayAt, beamStartOnRayAt);
+            beamPoint = beam.startPos + beam.direction * dot(rayPoint - beam.startPos, beam.direction);
+
+            float3 rayToBeam = beamPoint - rayPoint;
+            if (dot(rayToBeam, rayToBeam) > radiusSquare)
+                return false;
+
+            tCurr = length(rayPoint - ray.origin);
+            return true;
+        }
+
+        float3 norm1 = cross(ray.direction, rayBeamCross);
+        float3 norm2 = cross(beam.direction, rayBeamCross);
+
+        // nearest points between the camera ray and the beam
+        float3 rayPoint = ray.origin + dot(beam.startPos - ray.origin, norm2) / dot(ray.direction, norm2) * ray.direction;
+        beamPoint = beam.startPos + dot(ray.origin - beam.startPos, norm1) / dot(beam.direction, norm1) * beam.direction;
+
+        float rayPointAt = dot(rayPoint - ray.origin, ray.direction);
+        float beamPointAt = dot(beamPoint - beam.startPos, beam.direction);
+
+        // the last two cases add the clamped distance instead of scaling the direction, as the shader does
+        if (beamPointAt < 0)
+        {
+            beamPoint = beam.startPos;
+            rayPoint = ray.origin + ray.direction * std::min(std::max(0.0f, dot(ray.direction, beamPoint - ray.origin)), rayLength);
+        }
+        else if (beamPointAt > beam.length)
+        {
+            beamPoint = beamEnd;
+            rayPoint = ray.origin + ray.direction * std::min(std::max(0.0f, dot(ray.direction, beamPoint - ray.origin)), rayLength);
+        }
+        else if (rayPointAt < 0)
+        {
+            rayPoint = ray.origin;
+            beamPoint = beam.startPos + beam.direction + std::min(std::max(0.0f, dot(beam.direction, rayPoint - beam.startPos)), beam.length);
+        }
+        else if (rayPointAt > rayLength)
+        {
+            rayPoint = rayEnd;
+            beamPoint = beam.startPos + beam.direction + std::min(std::max(0.0f, dot(beam.direction, rayPoint - beam.startPos)), beam.length);
+        }
+
+        // check if the ray point is within the beam radius
+        float3 beamToRayPoint = cross(rayPoint - beam.startPos, beam.direction);
+        if (dot(beamToRayPoint, beamToRayPoint) > radiusSquare)
+            return false;
+
+        tCurr = length(rayPoint - ray.origin);
+        return true;
+    }
+
+    // radiance BeamAnyHit adds to the payload with a weight of 1, for the intersection found by IntersectGatherBeam()
+    inline float3 GatherBeamHitRadiance(const BeamGatherConstants& pc, const GatherRay& ray, const GatherBeam& beam, float tCurr, const float3& beamHit)
+    {
+        const float beamRadius = getGatherBeamRadius(beam.radius, pc.beamRadius);
+        float3 worldPos = ray.origin + ray.direction * tCurr;
+        float beamDist = length(beamHit - beam.startPos);
+
+        float beamRayCosVal = dot(-ray.direction, beam.direction);
+        float beamRayAbsSinVal = std::sqrt(std::max(0.0f, 1 - beamRayCosVal * beamRayCosVal));
+
+        float phaseVal = heneyGreenPhaseFunc(beamRayCosVal, pc.airHGAssymFactor);
+
+        float3 radiance = pc.airScatterCoff * exp(-pc.airExtinctCoff * (tCurr + beamDist)) * phaseVal
+            * beam.lightColor / pc.numBeamSources / (beamRadius * beamRayAbsSinVal + 0.1e-10f);
+
+        float rayBeamCylinderCenterDist = length(cross(worldPos - beam.startPos, beam.direction));
+
+        return radiance * std::sqrt(std::max(0.0f, 1.1f - rayBeamCylinderCenterDist / beamRadius));
+    }
+
+    // returns false when the ray misses the beam
+    inline bool GatherBeamRadiance(const BeamGatherConstants& pc, const GatherRay& ray, const GatherBeam& beam, float3& radiance)
+    {
+        float tCurr;
+        float3 beamHit;
+        if (!IntersectGatherBeam(pc, ray, beam, tCurr, beamHit))
+            return false;
+
+        radiance = GatherBeamHitRadiance(pc, ray, beam, tCurr, beamHit);
+        return true;
+    }
+}
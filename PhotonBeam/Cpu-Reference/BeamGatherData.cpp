@@ -0,0 +1,310 @@
+
+#include "BeamGatherData.hpp"
+#include "BeamInstanceList.hpp"
+#include "BeamOcclusion.hpp"
+#include "CornellScene.hpp"
+#include "PhotonPlanes.hpp"
+#include "RayTracingSampling.hpp"
+#include "../Shaders/util/BeamGatherData.h"
+
+#include <chrono>
+#include <cstdio>
+
+namespace CpuReference
+{
+    namespace
+    {
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+
+        // the counted air beams of the Cornell scene and the pixel rays of a camera outside the open front
+        struct GatherDataView
+        {
+            std::vector<GatherRay> pixelRays;
+            BeamInstanceList list;
+            BeamGatherConstants constants;
+        };
+
+        // a ray and a beam whose box the ray enters
+        struct GatherCandidate
+        {
+            uint32_t ray;
+            uint32_t beam;
+        };
+
+        GatherDataView CreateGatherDataView(uint32_t width, uint32_t height, uint32_t numLaunches, uint32_t maxBeamsPerLaunch, float beamRadius, uint32_t seed)
+        {
+            const std::vector<SceneBox> scene = CreateCornellScene();
+
+            GatherDataView view;
+            PushConstantRay pcRay = MakeSceneRayConstants(float3(0.0f, 0.0f, -14.0f), float3(0.0f), 0.8f, float(width) / float(height), numLaunches);
+            pcRay.beamRadius = beamRadius;
+            view.constants = MakeBeamGatherConstants(pcRay);
+
+            const OcclusionCamera camera = MakeOcclusionCamera(pcRay, width, height);
+            view.pixelRays.resize(size_t(width) * height);
+            for (uint32_t y = 0; y < height; y++)
+            {
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    GatherRay ray = MakePrimaryRay(camera, x, y);
+                    SceneHit hit;
+                    if (TraceScene(scene, ray.origin, ray.direction, c_rayTMin, c_rayTMaxDefault, hit))
+                        ray.tMax = hit.t;
+                    view.pixelRays[size_t(y) * width + x] = ray;
+                }
+            }
+
+            BeamEmissionLaunches launches = CreateSceneEmissions(scene, numLaunches, maxBeamsPerLaunch, seed);
+            for (auto& emissions : launches)
+            {
+                for (auto& emission : emissions)
+                    emission.surfacePhoton = false;
+            }
+
+            // the medium of the gather, as UpdateRayTracingPushConstants() copies it
+            PushConstantBeam pcBeam = MakeSceneBeamConstants();
+            pcBeam.beamRadius = beamRadius;
+            pcBeam.airScatterCoff = pcRay.airScatterCoff;
+            pcBeam.airExtinctCoff = pcRay.airExtinctCoff;
+            pcBeam.airHGAssymFactor = pcRay.airHGAssymFactor;
+            pcBeam.numBeamSources = pcRay.numBeamSources;
+            BuildBeamInstanceListCounted(launches, pcBeam, SubBeamSplitMode::Uniform, view.list, 1);
+            return view;
+        }
+
+        // the rays and the beams whose box grown by the radius the ray enters, ray by ray
+        std::vector<GatherCandidate> CollectGatherCandidates(const GatherDataView& view)
+        {
+            std::vector<float3> boundsMin(view.list.beams.size());
+            std::vector<float3> boundsMax(view.list.beams.size());
+            for (size_t i = 0; i < view.list.beams.size(); i++)
+            {
+                const PhotonBeam& beam = view.list.beams[i];
+                const float3 radius(getGatherBeamRadius(beam.radius, view.constants.beamRadius));
+                boundsMin[i] = min(float3(beam.startPos), float3(beam.endPos)) - radius;
+                boundsMax[i] = max(float3(beam.startPos), float3(beam.endPos)) + radius;
+            }
+
+            std::vector<GatherCandidate> candidates;
+            for (uint32_t ray = 0; ray < uint32_t(view.pixelRays.size()); ray++)
+            {
+                for (uint32_t beam = 0; beam < uint32_t(view.list.beams.size()); beam++)
+                {
+                    if (RayEntersBox(view.pixelRays[ray], boundsMin[beam], boundsMax[beam]))
+                        candidates.push_back({ ray, beam });
+                }
+            }
+            return candidates;
+        }
+
+        float RelativeDifference(const float3& value, const float3& reference)
+        {
+            const float scale = std::max(maxComponent(reference), 1e-20f);
+            return maxComponent(max(value - reference, reference - value)) / scale;
+        }
+    }
+
+    BeamTransmittanceLut BuildBeamTransmittanceLut(const float3& airExtinctCoff, float maxDistance, uint32_t resolution)
+    {
+        BeamTransmittanceLut lut;
+        lut.extinction = airExtinctCoff;
+        lut.maxDistance = maxDistance;
+        lut.entriesPerUnit = float(resolution - 1) / maxDistance;
+
+        lut.values.resize(resolution);
+        for (uint32_t i = 0; i < resolution; i++)
+            lut.values[i] = exp(-airExtinctCoff * (float(i) / lut.entriesPerUnit));
+        return lut;
+    }
+
+    BeamPhaseLut BuildBeamPhaseLut(float hgAssymFactor, uint32_t resolution)
+    {
+        BeamPhaseLut lut;
+        lut.hgAssymFactor = hgAssymFactor;
+
+        lut.values.resize(resolution);
+        for (uint32_t i = 0; i < resolution; i++)
+            lut.values[i] = heneyGreenPhaseFunc(-1.0f + 2.0f * float(i) / float(resolution - 1), hgAssymFactor);
+        return lut;
+    }
+
+    BeamGatherTables BuildBeamGatherTables(const BeamGatherConstants& constants)
+    {
+        BeamGatherTables tables;
+        tables.transmittance = BuildBeamTransmittanceLut(constants.airExtinctCoff);
+        tables.phase = BuildBeamPhaseLut(constants.airHGAssymFactor);
+        return tables;
+    }
+
+    std::string ValidateBeamGatherData()
+    {
+        std::string failures;
+
+        const GatherDataView view = CreateGatherDataView(48, 27, 128, 4, 0.2f, 3);
+        const BeamGatherTables tables = BuildBeamGatherTables(view.constants);
+
+        // the data of the emission is the beam LoadGatherBeam() reads
+        {
+            bool isMatching = view.list.gatherData.size() == view.list.beams.size() && !view.list.beams.empty();
+            for (size_t i = 0; isMatching && i < view.list.beams.size(); i++)
+            {
+                const GatherBeam beam = LoadGatherBeam(view.list.beams[i]);
+                const PhotonBeamGatherData& data = view.list.gatherData[i];
+                const float3 expectedRadiance = beam.lightColor * view.constants.airScatterCoff / view.constants.numBeamSources;
+
+                isMatching = length(float3(data.direction) - beam.direction) < 1e-6f
+                    && std::abs(data.length - beam.length) <= 1e-6f * beam.length
+                    && std::abs(data.invLength * beam.length - 1.0f) < 1e-6f
+                    && RelativeDifference(data.startRadiance, expectedRadiance) < 1e-6f;
+            }
+            Check(isMatching, "the gather data of the emission differs from the beams", failures);
+        }
+
+        // the tables against the functions they sample, past the end of the transmittance table too
+        {
+            float transmittanceError = 0.0f;
+            for (uint32_t i = 0; i <= 10000; i++)
+            {
+                const float distance = 80.0f * float(i) / 10000.0f;
+                const float3 expected = exp(-view.constants.airExtinctCoff * distance);
+                transmittanceError = std::max(transmittanceError, RelativeDifference(SampleBeamTransmittance(tables.transmittance, distance), expected));
+            }
+            Check(transmittanceError < 1e-4f, "the transmittance table is off by more than 1e-4", failures);
+
+            float phaseError = 0.0f;
+            for (uint32_t i = 0; i <= 10000; i++)
+            {
+                const float cosTheta = -1.0f + 2.0f * float(i) / 10000.0f;
+                const float expected = heneyGreenPhaseFunc(cosTheta, view.constants.airHGAssymFactor);
+                phaseError = std::max(phaseError, std::abs(SampleBeamPhase(tables.phase, cosTheta) - expected) / expected);
+            }
+            Check(phaseError < 1e-4f, "the phase function table is off by more than 1e-4", failures);
+        }
+
+        // same hits and radiance as GatherBeamRadiance()
+        {
+            const std::vector<GatherCandidate> candidates = CollectGatherCandidates(view);
+            uint64_t numHits = 0;
+            uint64_t numMismatchedHits = 0;
+            float radianceError = 0.0f;
+            for (const auto& candidate : candidates)
+            {
+                const GatherRay& ray = view.pixelRays[candidate.ray];
+
+                float3 expected;
+                float3 radiance;
+                const bool isHit = GatherBeamRadiance(view.constants, ray, LoadGatherBeam(view.list.beams[candidate.beam]), expected);
+                const bool isDataHit = GatherBeamDataRadiance(view.constants, tables, ray, view.list.beams[candidate.beam], view.list.gatherData[candidate.beam], radiance);
+
+                numHits += isHit ? 1 : 0;
+                if (isHit != isDataHit)
+                    numMismatchedHits++;
+                else if (isHit)
+                    radianceError = std::max(radianceError, RelativeDifference(radiance, expected));
+            }
+
+            Check(numHits > 0, "no pixel ray hits a beam", failures);
+            Check(numMismatchedHits * 1000 <= numHits, "the kernels disagree on more than 0.1% of the hits", failures);
+            Check(radianceError < 1e-3f, "the radiance of the kernels differs by more than 1e-3", failures);
+        }
+
+        return failures;
+    }
+
+    std::vector<BeamGatherDataBenchmarkResult> RunBeamGatherDataBenchmark(const BeamGatherDataBenchmarkSettings& settings)
+    {
+        const GatherDataView view = CreateGatherDataView(settings.width, settings.height, settings.numLaunches, settings.maxBeamsPerLaunch, settings.beamRadius, settings.seed);
+        const BeamGatherTables tables = BuildBeamGatherTables(view.constants);
+        const std::vector<GatherCandidate> candidates = CollectGatherCandidates(view);
+
+        std::vector<BeamGatherDataBenchmarkResult> results(2);
+        results[0].kernel = "beam";
+        results[1].kernel = "gather data";
+
+        std::vector<std::vector<float3>> images(2, std::vector<float3>(view.pixelRays.size()));
+        for (uint32_t kernel = 0; kernel < 2; kernel++)
+        {
+            BeamGatherDataBenchmarkResult& result = results[kernel];
+            std::vector<float3>& image = images[kernel];
+
+            double bestSeconds = 0.0;
+            uint64_t numHits = 0;
+            for (uint32_t pass = 0; pass < settings.numPasses; pass++)
+            {
+                std::fill(image.begin(), image.end(), float3(0.0f));
+                numHits = 0;
+
+                const auto start = std::chrono::steady_clock::now();
+                for (const auto& candidate : candidates)
+                {
+                    const GatherRay& ray = view.pixelRays[candidate.ray];
+
+                    float3 radiance;
+                    const bool isHit = kernel == 0
+                        ? GatherBeamRadiance(view.constants, ray, LoadGatherBeam(view.list.beams[candidate.beam]), radiance)
+                        : GatherBeamDataRadiance(view.constants, tables, ray, view.list.beams[candidate.beam], view.list.gatherData[candidate.beam], radiance);
+                    if (isHit)
+                    {
+                        image[candidate.ray] += radiance;
+                        numHits++;
+                    }
+                }
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                bestSeconds = pass == 0 ? seconds : std::min(bestSeconds, seconds);
+            }
+
+            result.numCandidates = candidates.size();
+            result.nanosecondsPerCandidate = candidates.empty() ? 0.0 : bestSeconds * 1e9 / double(candidates.size());
+            result.hitFraction = candidates.empty() ? 0.0 : double(numHits) / double(candidates.size());
+        }
+
+        double referenceMean = 0.0;
+        for (const auto& radiance : images[0])
+            referenceMean += (radiance.x + radiance.y + radiance.z) / 3.0;
+        referenceMean /= double(images[0].size());
+
+        for (uint32_t kernel = 0; kernel < 2; kernel++)
+        {
+            BeamGatherDataBenchmarkResult& result = results[kernel];
+            for (size_t i = 0; i < images[kernel].size(); i++)
+            {
+                const double difference = maxComponent(max(images[kernel][i] - images[0][i], images[0][i] - images[kernel][i]));
+                result.maxRelativeDifference = std::max(result.maxRelativeDifference, referenceMean > 0.0 ? difference / referenceMean : 0.0);
+            }
+            result.speedup = result.nanosecondsPerCandidate > 0.0 ? results[0].nanosecondsPerCandidate / result.nanosecondsPerCandidate : 0.0;
+        }
+
+        return results;
+    }
+
+    std::string FormatBeamGatherDataResults(const std::vector<BeamGatherDataBenchmarkResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-12s %8.2f ns/candidate  %.2fx  candidates %9llu  hits %5.1f%%  max difference %.3g of the mean\n",
+                result.kernel.c_str(),
+                result.nanosecondsPerCandidate,
+                result.speedup,
+                static_cast<unsigned long long>(result.numCandidates),
+                result.hitFraction * 100.0,
+                result.maxRelativeDifference
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
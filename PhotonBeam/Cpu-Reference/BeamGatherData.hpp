@@ -0,0 +1,214 @@
+#pragma once
+
+#include "CpuVector.hpp"
+#include "BeamGather.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+#include "../Shaders/util/BeamFootprint.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The beam gather on the per-beam terms of util/BeamGatherData.h and per-frame tables of the medium.
+//
+// GatherBeamRadiance() of a PhotonBeam normalizes the beam, then evaluates one exponential per channel and the
+// Henyey-Greenstein phase function for every hit. The emission stores the direction, the length and the radiance
+// factor of every beam in PhotonBeamGatherData, and the homogeneous medium of a frame is tabulated once:
+//   transmittance   exp(-airExtinctCoff * d) over the path length d = ray distance + beam distance
+//   phase           heneyGreenPhaseFunc(cos, airHGAssymFactor) over cos in [-1, 1], the row of the frame's g
+// Both are linearly interpolated, a path longer than the transmittance table falls back to the exponential.
+//
+// GatherBeamDataRadiance() takes the branches of IntersectGatherBeam(), its quirks included, and takes the distances
+// along the ray and the beam from the parameters of the nearest points instead of the lengths of their vectors.
+// The sine of the beam and the ray is the length of their cross product and the distance to the beam axis the
+// radius test already computed.
+namespace CpuReference
+{
+    struct BeamTransmittanceLut
+    {
+        float3 extinction;
+        float maxDistance = 0.0f;
+        float entriesPerUnit = 0.0f;
+
+        // exp(-extinction * i / entriesPerUnit)
+        std::vector<float3> values;
+    };
+
+    struct BeamPhaseLut
+    {
+        float hgAssymFactor = 0.0f;
+
+        // heneyGreenPhaseFunc(-1 + 2 i / (size - 1), hgAssymFactor)
+        std::vector<float> values;
+    };
+
+    struct BeamGatherTables
+    {
+        BeamTransmittanceLut transmittance;
+        BeamPhaseLut phase;
+    };
+
+    // resolution entries over [0, maxDistance]
+    BeamTransmittanceLut BuildBeamTransmittanceLut(const float3& airExtinctCoff, float maxDistance = 64.0f, uint32_t resolution = 1024);
+
+    BeamPhaseLut BuildBeamPhaseLut(float hgAssymFactor, uint32_t resolution = 1024);
+
+    BeamGatherTables BuildBeamGatherTables(const BeamGatherConstants& constants);
+
+    inline float3 SampleBeamTransmittance(const BeamTransmittanceLut& lut, float distance)
+    {
+        const float x = std::max(0.0f, distance * lut.entriesPerUnit);
+        const uint32_t index = uint32_t(x);
+        if (index + 1 >= lut.values.size())
+            return exp(-lut.extinction * distance);
+
+        const float t = x - float(index);
+        return lut.values[index] + (lut.values[index + 1] - lut.values[index]) * t;
+    }
+
+    inline float SampleBeamPhase(const BeamPhaseLut& lut, float cosTheta)
+    {
+        const float maxIndex = float(lut.values.size() - 1);
+        const float x = std::min(std::max(0.0f, (cosTheta * 0.5f + 0.5f) * maxIndex), maxIndex);
+        const uint32_t index = std::min(uint32_t(x), uint32_t(lut.values.size() - 2));
+
+        const float t = x - float(index);
+        return lut.values[index] + (lut.values[index + 1] - lut.values[index]) * t;
+    }
+
+    // GatherBeamRadiance() of the beam with its gather data, returns false when the ray misses the beam
+    inline bool GatherBeamDataRadiance(
+        const BeamGatherConstants& pc,
+        const BeamGatherTables& tables,
+        const GatherRay& ray,
+        const PhotonBeam& beam,
+        const PhotonBeamGatherData& data,
+        float3& radiance
+    )
+    {
+        const float3 startPos = beam.startPos;
+        const float3 direction = data.direction;
+        const float rayLength = ray.tMax - 0.0001f;
+        const float beamRadius = getGatherBeamRadius(beam.radius, pc.beamRadius);
+        const float radiusSquare = beamRadius * beamRadius;
+
+        const float3 startToOrigin = ray.origin - startPos;
+        const float rayBeamCos = dot(ray.direction, direction);
+
+        // check if the ray hits beam cylinder when the beam cylinder has infinite radius
+        const float rayStartOnBeamAt = dot(direction, startToOrigin);
+        const float rayEndOnBeamAt = rayStartOnBeamAt + ray.tMax * rayBeamCos;
+        if ((rayStartOnBeamAt < 0 && rayEndOnBeamAt < 0) || (data.length < rayStartOnBeamAt && data.length < rayEndOnBeamAt))
+            return false;
+
+        const float3 rayBeamCross = cross(ray.direction, direction);
+        const float sinSquare = dot(rayBeamCross, rayBeamCross);
+
+        // distances of the hit along the ray and from the start of the beam
+        float rayDist;
+        float beamDist;
+
+        if (sinSquare < 0.1e-4f * 0.1e-4f)
+        {
+            // ray and beam almost parallel, the beam point giving the shortest ray length is used
+            const float startOnRayAt = -dot(startToOrigin, ray.direction);
+            const float endOnRayAt = startOnRayAt + data.length * rayBeamCos;
+            rayDist = std::min(std::min(rayLength, std::max(0.0f, endOnRayAt)), std::min(rayLength, std::max(0.0f, startOnRayAt)));
+            beamDist = std::abs(rayStartOnBeamAt + rayDist * rayBeamCos);
+        }
+        else
+        {
+            const float3 norm1 = cross(ray.direction, rayBeamCross);
+            const float3 norm2 = cross(direction, rayBeamCross);
+
+            // parameters of the nearest points between the camera ray and the beam
+            const float rayPointAt = -dot(startToOrigin, norm2) / dot(ray.direction, norm2);
+            const float beamPointAt = dot(startToOrigin, norm1) / dot(direction, norm1);
+
+            // the last two cases add the clamped distance instead of scaling the direction, as the shader does
+            if (beamPointAt < 0)
+            {
+                rayDist = std::min(std::max(0.0f, -dot(ray.direction, startToOrigin)), rayLength);
+                beamDist = 0.0f;
+            }
+            else if (beamPointAt > data.length)
+            {
+                rayDist = std::min(std::max(0.0f, data.length * rayBeamCos - dot(ray.direction, startToOrigin)), rayLength);
+                beamDist = data.length;
+            }
+            else if (rayPointAt < 0)
+            {
+                rayDist = 0.0f;
+                beamDist = length(direction + std::min(std::max(0.0f, rayStartOnBeamAt), data.length));
+            }
+            else if (rayPointAt > rayLength)
+            {
+                rayDist = ray.tMax;
+                beamDist = length(direction + std::min(std::max(0.0f, rayEndOnBeamAt), data.length));
+            }
+            else
+            {
+                rayDist = rayPointAt;
+                beamDist = beamPointAt;
+            }
+        }
+
+        // check if the ray point is within the beam radius
+        const float3 beamToRayPoint = cross(startToOrigin + ray.direction * rayDist, direction);
+        const float centerDistSquare = dot(beamToRayPoint, beamToRayPoint);
+        if (centerDistSquare > radiusSquare)
+            return false;
+
+        const float beamRayAbsSinVal = std::sqrt(sinSquare);
+        const float phaseVal = SampleBeamPhase(tables.phase, -rayBeamCos);
+
+        radiance = float3(data.startRadiance) * SampleBeamTransmittance(tables.transmittance, rayDist + beamDist)
+            * (phaseVal / (beamRadius * beamRayAbsSinVal + 0.1e-10f) * std::sqrt(std::max(0.0f, 1.1f - std::sqrt(centerDistSquare) / beamRadius)));
+        return true;
+    }
+
+    // Checks
+    //  that the gather data of the emission is the direction and length LoadGatherBeam() computes
+    //  that the tables follow the exponential and the phase function
+    //  that the kernel on the gather data hits the beams GatherBeamRadiance() hits, for the same radiance
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidateBeamGatherData();
+
+    struct BeamGatherDataBenchmarkSettings
+    {
+        uint32_t width = 160;
+        uint32_t height = 90;
+
+        uint32_t numLaunches = 1u << 9;
+        uint32_t maxBeamsPerLaunch = 4;
+        float beamRadius = 0.2f;
+
+        // both kernels gather the candidates this many times, the fastest pass counts
+        uint32_t numPasses = 5;
+
+        uint32_t seed = 1;
+    };
+
+    struct BeamGatherDataBenchmarkResult
+    {
+        // "beam" for GatherBeamRadiance() of LoadGatherBeam(), "gather data" for GatherBeamDataRadiance()
+        std::string kernel;
+
+        // the rays and the beams whose box the ray enters
+        uint64_t numCandidates = 0;
+        double nanosecondsPerCandidate = 0.0;
+        double hitFraction = 0.0;
+
+        // of the image against the one of "beam", and relative to its mean channel
+        double maxRelativeDifference = 0.0;
+        double speedup = 1.0;
+    };
+
+    // The air beams of the Cornell scene gathered by the pixel rays, with both kernels.
+    std::vector<BeamGatherDataBenchmarkResult> RunBeamGatherDataBenchmark(const BeamGatherDataBenchmarkSettings& settings = {});
+
+    // one line per result
+    std::string FormatBeamGatherDataResults(const std::vector<BeamGatherDataBenchmarkResult>& results);
+}
@@ -0,0 +1,524 @@
+
+#include "BeamInstanceList.hpp"
+#include "ChunkedAppendBuffer.hpp"
+#include "ParallelFor.hpp"
+#include "RayTracingSampling.hpp"
+#include "../Shaders/util/BeamInstance.h"
+#include "../Shaders/util/BeamFootprint.h"
+#include "../Shaders/util/BeamGatherData.h"
+
+#include <d3d12.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+namespace CpuReference
+{
+    namespace
+    {
+        static_assert(sizeof(ShaderRayTracingTopASInstanceDesc) == sizeof(D3D12_RAYTRACING_INSTANCE_DESC));
+        static_assert(offsetof(ShaderRayTracingTopASInstanceDesc, transform) == offsetof(D3D12_RAYTRACING_INSTANCE_DESC, Transform));
+        static_assert(offsetof(ShaderRayTracingTopASInstanceDesc, accelerationStructureReference) == offsetof(D3D12_RAYTRACING_INSTANCE_DESC, AccelerationStructure));
+
+        // transpose(float4x3(xAxis, yAxis, zAxis, origin)) of BeamGen.hlsl
+        void SetInstanceTransform(
+            ShaderRayTracingTopASInstanceDesc& desc,
+            const float3& xAxis,
+            const float3& yAxis,
+            const float3& zAxis,
+            const float3& origin
+        )
+        {
+            for (size_t row = 0; row < 3; row++)
+            {
+                desc.transform[row] = XMFLOAT4(xAxis[row], yAxis[row], zAxis[row], origin[row]);
+            }
+        }
+
+        // number of air sub-beams of an emission
+        uint32_t AirSubBeamCount(const BeamEmission& emission, float beamLength, float beamRadius, SubBeamSplitMode mode)
+        {
+            if (!emission.airSubBeams)
+                return 0;
+
+            if (mode == SubBeamSplitMode::Uniform)
+                return UniformSubBeamCount(beamLength, beamRadius);
+
+            return AdaptiveSubBeamCount(emission.direction, beamLength, beamRadius);
+        }
+
+        float BeamLength(const PhotonBeam& beam)
+        {
+            return length(float3(beam.endPos) - float3(beam.startPos));
+        }
+
+        std::string InstanceFailure(uint64_t instanceIndex, const char* what)
+        {
+            char line[128];
+            std::snprintf(line, sizeof(line), "instance %llu: %s\n", static_cast<unsigned long long>(instanceIndex), what);
+            return line;
+        }
+    }
+
+    PhotonBeam EmittedBeam(const BeamEmission& emission, const PushConstantBeam& pc)
+    {
+        PhotonBeam beam = emission.beam;
+        beam.radius = getFootprintBeamRadius(pc, beam.startPos, beam.endPos);
+        return beam;
+    }
+
+    uint32_t CountBeamInstances(const BeamEmission& emission, const PushConstantBeam& pc, SubBeamSplitMode mode)
+    {
+        const float beamRadius = getFootprintBeamRadius(pc, emission.beam.startPos, emission.beam.endPos);
+        return AirSubBeamCount(emission, BeamLength(emission.beam), beamRadius, mode) + (emission.surfacePhoton ? 1 : 0);
+    }
+
+    void WriteBeamInstances(
+        const BeamEmission& emission,
+        uint32_t beamIndex,
+        const PushConstantBeam& pc,
+        SubBeamSplitMode mode,
+        ShaderRayTracingTopASInstanceDesc* instances
+    )
+    {
+        const float3 startPos = emission.beam.startPos;
+        const float beamLength = BeamLength(emission.beam);
+        const float beamRadius = getFootprintBeamRadius(pc, emission.beam.startPos, emission.beam.endPos);
+        const uint32_t numSplit = AirSubBeamCount(emission, beamLength, beamRadius, mode);
+
+        // uniform sub-beams are 2r long and the last one sticks out of the beam end
+        const float segmentLength = mode == SubBeamSplitMode::Uniform ? beamRadius * 2.0f : beamLength / float(std::max(numSplit, 1u));
+
+        float3 tangent, bitangent;
+        createCoordinateSystem(emission.direction, tangent, bitangent);
+
+        for (uint32_t i = 0; i < numSplit; i++)
+        {
+            ShaderRayTracingTopASInstanceDesc& desc = instances[i];
+            desc.instanceCustomIndexAndmask = packInstanceCustomIndexAndMask(beamIndex, BEAM_INSTANCE_MASK);
+            desc.instanceShaderBindingTableRecordOffsetAndflags = packInstanceHitGroupAndFlags(BEAM_HIT_TYPE_AIR, BEAM_INSTANCE_FLAGS);
+            desc.accelerationStructureReference = pc.beamBlasAddress;
+
+            // the beam BLAS box is [0, 2] along z
+            SetInstanceTransform(
+                desc,
+                bitangent * beamRadius,
+                tangent * beamRadius,
+                emission.direction * (segmentLength * 0.5f),
+                startPos + segmentLength * float(i) * emission.direction
+            );
+        }
+
+        if (emission.surfacePhoton)
+        {
+            ShaderRayTracingTopASInstanceDesc& desc = instances[numSplit];
+            desc.instanceCustomIndexAndmask = packInstanceCustomIndexAndMask(beamIndex, BEAM_INSTANCE_MASK);
+            desc.instanceShaderBindingTableRecordOffsetAndflags = packInstanceHitGroupAndFlags(BEAM_HIT_TYPE_SOLID, BEAM_INSTANCE_FLAGS);
+            desc.accelerationStructureReference = pc.photonBlasAddress;
+
+            createCoordinateSystem(emission.hitNormal, tangent, bitangent);
+            SetInstanceTransform(
+                desc,
+                bitangent * pc.photonRadius,
+                emission.hitNormal * pc.photonRadius,
+                tangent,
+                emission.beam.endPos
+            );
+        }
+    }
+
+    uint64_t ExclusiveScan(const std::vector<uint32_t>& counts, std::vector<uint64_t>& offsets, uint32_t numThreads)
+    {
+        numThreads = ResolveThreadCount(numThreads);
+        offsets.resize(counts.size());
+
+        // sum of every block, scan of the block sums, then scan of every block from its base
+        std::vector<uint64_t> blockSums(numThreads, 0);
+        ParallelFor(numThreads, counts.size(), [&](uint32_t threadIndex, uint64_t begin, uint64_t end)
+        {
+            uint64_t sum = 0;
+            for (uint64_t i = begin; i < end; i++)
+                sum += counts[i];
+            blockSums[threadIndex] = sum;
+        });
+
+        uint64_t total = 0;
+        for (auto& blockSum : blockSums)
+        {
+            uint64_t sum = blockSum;
+            blockSum = total;
+            total += sum;
+        }
+
+        ParallelFor(numThreads, counts.size(), [&](uint32_t threadIndex, uint64_t begin, uint64_t end)
+        {
+            uint64_t offset = blockSums[threadIndex];
+            for (uint64_t i = begin; i < end; i++)
+            {
+                offsets[i] = offset;
+                offset += counts[i];
+            }
+        });
+
+        return total;
+    }
+
+    void BuildBeamInstanceListAtomic(
+        const BeamEmissionLaunches& launches,
+        const PushConstantBeam& pc,
+        SubBeamSplitMode mode,
+        BeamInstanceList& list
+    )
+    {
+        // ResetSubBeamInfoBuffer.hlsl zeroes the instances, the TLAS is built over all of them
+        list.beams.assign(pc.maxNumBeams, PhotonBeam{});
+        list.instances.assign(pc.maxNumSubBeams, ShaderRayTracingTopASInstanceDesc{});
+        list.gatherData.assign(pc.maxNumBeams, PhotonBeamGatherData{});
+
+        uint64_t beamCount = 0;
+        uint64_t subBeamCount = 0;
+
+        for (const auto& emissions : launches)
+        {
+            for (const auto& emission : emissions)
+            {
+                const uint32_t numInstances = CountBeamInstances(emission, pc, mode);
+                if (numInstances < 1)
+                    break;
+
+                const uint64_t beamIndex = beamCount++;
+                if (beamIndex >= pc.maxNumBeams)
+                    break;
+
+                list.beams[beamIndex] = EmittedBeam(emission, pc);
+                list.gatherData[beamIndex] = makePhotonBeamGatherData(list.beams[beamIndex], pc.airScatterCoff, pc.numBeamSources);
+
+                const uint64_t subBeamIndex = subBeamCount;
+                subBeamCount += numInstances;
+                if (numInstances + subBeamIndex >= pc.maxNumSubBeams)
+                    break;
+
+                WriteBeamInstances(emission, uint32_t(beamIndex), pc, mode, list.instances.data() + subBeamIndex);
+            }
+        }
+
+        // the values the GPU counters end with
+        list.requestedBeams = beamCount;
+        list.requestedInstances = subBeamCount;
+    }
+
+    void BuildBeamInstanceListCounted(
+        const BeamEmissionLaunches& launches,
+        const PushConstantBeam& pc,
+        SubBeamSplitMode mode,
+        BeamInstanceList& list,
+        uint32_t numThreads
+    )
+    {
+        numThreads = ResolveThreadCount(numThreads);
+
+        // 1. count, a launch stops at its first emission without instances as BeamGen.hlsl does
+        std::vector<uint32_t> beamCounts(launches.size(), 0);
+        std::vector<uint32_t> instanceCounts(launches.size(), 0);
+
+        ParallelFor(numThreads, launches.size(), [&](uint32_t, uint64_t begin, uint64_t end)
+        {
+            for (uint64_t launch = begin; launch < end; launch++)
+            {
+                for (const auto& emission : launches[launch])
+                {
+                    const uint32_t numInstances = CountBeamInstances(emission, pc, mode);
+                    if (numInstances < 1)
+                        break;
+
+                    beamCounts[launch]++;
+                    instanceCounts[launch] += numInstances;
+                }
+            }
+        });
+
+        // 2. scan
+        std::vector<uint64_t> beamOffsets;
+        std::vector<uint64_t> instanceOffsets;
+        list.requestedBeams = ExclusiveScan(beamCounts, beamOffsets, numThreads);
+        list.requestedInstances = ExclusiveScan(instanceCounts, instanceOffsets, numThreads);
+
+        list.beams.resize(list.requestedBeams);
+        list.instances.resize(list.requestedInstances);
+        list.gatherData.resize(list.requestedBeams);
+
+        // 3. write
+        ParallelFor(numThreads, launches.size(), [&](uint32_t, uint64_t begin, uint64_t end)
+        {
+            for (uint64_t launch = begin; launch < end; launch++)
+            {
+                uint64_t beamIndex = beamOffsets[launch];
+                uint64_t instanceIndex = instanceOffsets[launch];
+
+                for (uint32_t i = 0; i < beamCounts[launch]; i++)
+                {
+                    const BeamEmission& emission = launches[launch][i];
+                    list.beams[beamIndex] = EmittedBeam(emission, pc);
+                    list.gatherData[beamIndex] = makePhotonBeamGatherData(list.beams[beamIndex], pc.airScatterCoff, pc.numBeamSources);
+                    WriteBeamInstances(emission, uint32_t(beamIndex), pc, mode, list.instances.data() + instanceIndex);
+
+                    beamIndex++;
+                    instanceIndex += CountBeamInstances(emission, pc, mode);
+                }
+            }
+        });
+    }
+
+    void BuildBeamInstanceListChunked(
+        const BeamEmissionLaunches& launches,
+        const PushConstantBeam& pc,
+        SubBeamSplitMode mode,
+        BeamInstanceList& list,
+        uint32_t numThreads,
+        uint32_t chunkSize
+    )
+    {
+        numThreads = ResolveThreadCount(numThreads);
+
+        ChunkedAppendBuffer<PhotonBeam> beams(pc.maxNumBeams, chunkSize);
+        ChunkedAppendBuffer<ShaderRayTracingTopASInstanceDesc> instances(pc.maxNumSubBeams, chunkSize);
+
+        ParallelFor(numThreads, launches.size(), [&](uint32_t, uint64_t begin, uint64_t end)
+        {
+            ChunkedAppendBuffer<PhotonBeam>::Writer beamWriter(beams);
+            ChunkedAppendBuffer<ShaderRayTracingTopASInstanceDesc>::Writer instanceWriter(instances);
+            std::vector<ShaderRayTracingTopASInstanceDesc> emissionInstances;
+
+            for (uint64_t launch = begin; launch < end; launch++)
+            {
+                for (const auto& emission : launches[launch])
+                {
+                    const uint32_t numInstances = CountBeamInstances(emission, pc, mode);
+                    if (numInstances < 1)
+                        break;
+
+                    const uint64_t beamIndex = beamWriter.Append(EmittedBeam(emission, pc));
+                    if (beamIndex == ChunkedAppendBuffer<PhotonBeam>::c_invalidIndex)
+                        break;
+
+                    // the instance ids are the indices before the compaction until the remapping below
+                    emissionInstances.resize(numInstances);
+                    WriteBeamInstances(emission, uint32_t(beamIndex), pc, mode, emissionInstances.data());
+
+                    // the beam and its whole group or neither, BeamGen.hlsl leaves no instance of a dropped group
+                    if (!instanceWriter.Append(emissionInstances.data(), numInstances))
+                    {
+                        beamWriter.DropLast();
+                        break;
+                    }
+                }
+            }
+        });
+
+        beams.Compact();
+        instances.Compact();
+
+        list.requestedBeams = beams.Size() + beams.DroppedRecords();
+        list.requestedInstances = instances.Size() + instances.DroppedRecords();
+
+        list.instances = instances.TakeRecords();
+
+        for (auto& desc : list.instances)
+        {
+            uint64_t beamIndex = beams.CompactedIndex(unpackInstanceCustomIndex(desc.instanceCustomIndexAndmask));
+            desc.instanceCustomIndexAndmask = packInstanceCustomIndexAndMask(uint32_t(beamIndex), unpackInstanceMask(desc.instanceCustomIndexAndmask));
+        }
+
+        list.beams = beams.TakeRecords();
+
+        // the gather data follows the compacted beams, the index BeamGen.hlsl would have written it at
+        list.gatherData.resize(list.beams.size());
+        ParallelFor(numThreads, list.beams.size(), [&](uint32_t, uint64_t begin, uint64_t end)
+        {
+            for (uint64_t i = begin; i < end; i++)
+                list.gatherData[i] = makePhotonBeamGatherData(list.beams[i], pc.airScatterCoff, pc.numBeamSources);
+        });
+    }
+
+    namespace
+    {
+        // the gather data of the first numBeams beams of list
+        std::string GatherDataFailures(const char* path, const BeamInstanceList& list, uint64_t numBeams)
+        {
+            char line[128];
+            if (list.gatherData.size() != list.beams.size())
+            {
+                std::snprintf(line, sizeof(line), "the %s list has no gather data for every beam\n", path);
+                return line;
+            }
+
+            std::string failures;
+            for (uint64_t i = 0; i < numBeams; i++)
+            {
+                const PhotonBeam& beam = list.beams[i];
+                const PhotonBeamGatherData& data = list.gatherData[i];
+                const float3 beamVec = float3(beam.endPos) - float3(beam.startPos);
+                const float3 spanError = float3(data.direction) * data.length - beamVec;
+
+                if (dot(spanError, spanError) > 1e-8f * std::max(1.0f, dot(beamVec, beamVec))
+                    || (data.length > 0.0f && std::abs(data.length * data.invLength - 1.0f) > 1e-5f))
+                {
+                    std::snprintf(line, sizeof(line), "%s beam %llu: gather data does not span the beam\n", path, static_cast<unsigned long long>(i));
+                    failures += line;
+                }
+            }
+            return failures;
+        }
+    }
+
+    std::string ValidateBeamInstanceList(const BeamEmissionLaunches& launches, const PushConstantBeam& pc, SubBeamSplitMode mode)
+    {
+        std::string failures;
+
+        // bit packing against the D3D12 bit fields, both ways
+        const uint32_t customIndices[] = { 0, 1, 0x1234, 0x7FFFFF, BEAM_INSTANCE_MAX_CUSTOM_INDEX };
+        const uint32_t hitGroups[] = { BEAM_HIT_TYPE_AIR, BEAM_HIT_TYPE_SOLID };
+
+        for (uint32_t customIndex : customIndices)
+        {
+            for (uint32_t hitGroup : hitGroups)
+            {
+                ShaderRayTracingTopASInstanceDesc desc = {};
+                desc.instanceCustomIndexAndmask = packInstanceCustomIndexAndMask(customIndex, BEAM_INSTANCE_MASK);
+                desc.instanceShaderBindingTableRecordOffsetAndflags = packInstanceHitGroupAndFlags(hitGroup, BEAM_INSTANCE_FLAGS);
+                desc.accelerationStructureReference = pc.beamBlasAddress;
+
+                D3D12_RAYTRACING_INSTANCE_DESC d3dDesc;
+                std::memcpy(&d3dDesc, &desc, sizeof(desc));
+
+                if (d3dDesc.InstanceID != customIndex
+                    || d3dDesc.InstanceMask != BEAM_INSTANCE_MASK
+                    || d3dDesc.InstanceContributionToHitGroupIndex != hitGroup
+                    || d3dDesc.Flags != D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_CULL_DISABLE
+                    || d3dDesc.AccelerationStructure != pc.beamBlasAddress)
+                {
+                    failures += "packed instance does not match the D3D12_RAYTRACING_INSTANCE_DESC bit fields\n";
+                }
+
+                D3D12_RAYTRACING_INSTANCE_DESC d3dSource = {};
+                d3dSource.InstanceID = customIndex;
+                d3dSource.InstanceMask = BEAM_INSTANCE_MASK;
+                d3dSource.InstanceContributionToHitGroupIndex = hitGroup;
+                d3dSource.Flags = D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_CULL_DISABLE;
+                std::memcpy(&desc, &d3dSource, sizeof(desc));
+
+                if (unpackInstanceCustomIndex(desc.instanceCustomIndexAndmask) != customIndex
+                    || unpackInstanceMask(desc.instanceCustomIndexAndmask) != BEAM_INSTANCE_MASK
+                    || unpackInstanceHitGroup(desc.instanceShaderBindingTableRecordOffsetAndflags) != hitGroup
+                    || unpackInstanceFlags(desc.instanceShaderBindingTableRecordOffsetAndflags) != BEAM_INSTANCE_FLAGS)
+                {
+                    failures += "D3D12_RAYTRACING_INSTANCE_DESC bit fields do not unpack to the packed values\n";
+                }
+            }
+        }
+
+        BeamInstanceList counted;
+        BuildBeamInstanceListCounted(launches, pc, mode, counted);
+
+        // without overflow both paths give the same lists, the atomic one padded with zeroed entries
+        BeamInstanceList atomic;
+        BuildBeamInstanceListAtomic(launches, pc, mode, atomic);
+
+        if (counted.requestedBeams < pc.maxNumBeams && counted.requestedInstances < pc.maxNumSubBeams)
+        {
+            if (atomic.requestedBeams != counted.requestedBeams || atomic.requestedInstances != counted.requestedInstances)
+                failures += "the atomic and counted paths requested different numbers of beams or instances\n";
+
+            if (std::memcmp(atomic.beams.data(), counted.beams.data(), counted.beams.size() * sizeof(PhotonBeam)) != 0)
+                failures += "the atomic and counted beam lists differ\n";
+
+            if (std::memcmp(atomic.instances.data(), counted.instances.data(), counted.instances.size() * sizeof(ShaderRayTracingTopASInstanceDesc)) != 0)
+                failures += "the atomic and counted instance lists differ\n";
+
+            if (std::memcmp(atomic.gatherData.data(), counted.gatherData.data(), counted.gatherData.size() * sizeof(PhotonBeamGatherData)) != 0)
+                failures += "the atomic and counted gather data differ\n";
+        }
+
+        for (uint64_t i = 0; i < counted.instances.size(); i++)
+        {
+            const ShaderRayTracingTopASInstanceDesc& desc = counted.instances[i];
+            const uint32_t hitGroup = unpackInstanceHitGroup(desc.instanceShaderBindingTableRecordOffsetAndflags);
+
+            if (unpackInstanceCustomIndex(desc.instanceCustomIndexAndmask) >= counted.beams.size())
+                failures += InstanceFailure(i, "instance id is not a beam index");
+
+            if (unpackInstanceMask(desc.instanceCustomIndexAndmask) != BEAM_INSTANCE_MASK)
+                failures += InstanceFailure(i, "wrong instance mask");
+
+            if (unpackInstanceFlags(desc.instanceShaderBindingTableRecordOffsetAndflags) != BEAM_INSTANCE_FLAGS)
+                failures += InstanceFailure(i, "wrong instance flags");
+
+            if ((hitGroup == BEAM_HIT_TYPE_AIR && desc.accelerationStructureReference != pc.beamBlasAddress)
+                || (hitGroup == BEAM_HIT_TYPE_SOLID && desc.accelerationStructureReference != pc.photonBlasAddress)
+                || hitGroup > BEAM_HIT_TYPE_SOLID)
+            {
+                failures += InstanceFailure(i, "hit group does not match the BLAS");
+            }
+        }
+
+        // the gather data spans the beam it was made from, on every path
+        BeamInstanceList chunked;
+        BuildBeamInstanceListChunked(launches, pc, mode, chunked);
+
+        failures += GatherDataFailures("counted", counted, counted.beams.size());
+        failures += GatherDataFailures("atomic", atomic, std::min<uint64_t>(atomic.requestedBeams, atomic.beams.size()));
+        failures += GatherDataFailures("chunked", chunked, chunked.beams.size());
+
+        // half of the instances with small chunks on several threads, so the groups span chunks and some do not fit
+        if (counted.requestedInstances > 1)
+        {
+            PushConstantBeam overflowPc = pc;
+            overflowPc.maxNumSubBeams = uint32_t(counted.requestedInstances / 2);
+
+            BeamInstanceList overflowed;
+            BuildBeamInstanceListChunked(launches, overflowPc, mode, overflowed, 4, 7);
+
+            if (overflowed.instances.size() >= counted.requestedInstances)
+                failures += "the chunked path did not overflow half of the instances\n";
+
+            // the group size of a beam of the counted list, found by its bytes since the chunked order differs
+            std::unordered_map<std::string, uint32_t> groupSizes;
+            std::vector<uint32_t> countedGroupSizes(counted.beams.size(), 0);
+            for (const auto& desc : counted.instances)
+                countedGroupSizes[unpackInstanceCustomIndex(desc.instanceCustomIndexAndmask)]++;
+            for (uint64_t i = 0; i < counted.beams.size(); i++)
+                groupSizes[std::string(reinterpret_cast<const char*>(&counted.beams[i]), sizeof(PhotonBeam))] = countedGroupSizes[i];
+
+            std::vector<uint32_t> overflowedGroupSizes(overflowed.beams.size(), 0);
+            for (const auto& desc : overflowed.instances)
+            {
+                const uint32_t beamIndex = unpackInstanceCustomIndex(desc.instanceCustomIndexAndmask);
+                if (beamIndex < overflowed.beams.size())
+                    overflowedGroupSizes[beamIndex]++;
+                else
+                    failures += "an instance of the overflowed chunked list has no beam\n";
+            }
+
+            uint64_t numPartialGroups = 0;
+            for (uint64_t i = 0; i < overflowed.beams.size(); i++)
+            {
+                const auto group = groupSizes.find(std::string(reinterpret_cast<const char*>(&overflowed.beams[i]), sizeof(PhotonBeam)));
+                if (group == groupSizes.end() || group->second != overflowedGroupSizes[i])
+                    numPartialGroups++;
+            }
+
+            if (numPartialGroups > 0)
+            {
+                char line[128];
+                std::snprintf(line, sizeof(line), "%llu beams of the overflowed chunked list do not have their whole instance group\n", static_cast<unsigned long long>(numPartialGroups));
+                failures += line;
+            }
+        }
+
+        return failures;
+    }
+}
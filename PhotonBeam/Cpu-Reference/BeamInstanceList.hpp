@@ -0,0 +1,113 @@
+
+#pragma once
+
+#include "CpuVector.hpp"
+#include "SubBeamSplitter.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU reference of the beam emission of BeamGen.hlsl, from the traced beams to the beam buffer and the TLAS instance list.
+//
+// BeamGen.hlsl appends with two global atomic counters into buffers of fixed capacity,
+// which ResetSubBeamInfoBuffer.hlsl zeroes every frame, and the TLAS is built over the whole capacity.
+// The counted path runs in two passes instead:
+//  1. every launch counts its beams and instances
+//  2. the counts are exclusive scanned, and every launch writes at its offsets
+// The list is dense, its length is known before it is written, no reset is needed and
+// the order only depends on the launch index, not on the scheduling.
+namespace CpuReference
+{
+    // one TraceRay of BeamGen.hlsl
+    struct BeamEmission
+    {
+        PhotonBeam beam;
+
+        // direction of the traced ray, the sub-beam boxes are built around it
+        float3 direction;
+        float3 hitNormal;
+
+        // launchIndex < numBeamSources
+        bool airSubBeams;
+
+        // the ray hit a surface and launchIndex < numPhotonSources
+        bool surfacePhoton;
+    };
+
+    // emissions of every launch, in launch index order
+    using BeamEmissionLaunches = std::vector<std::vector<BeamEmission>>;
+
+    struct BeamInstanceList
+    {
+        std::vector<PhotonBeam> beams;
+        std::vector<ShaderRayTracingTopASInstanceDesc> instances;
+
+        // the terms of util/BeamGatherData.h at the index of every beam
+        std::vector<PhotonBeamGatherData> gatherData;
+
+        // beams and instances requested by the emissions, larger than the lists when the capacity overflowed
+        uint64_t requestedBeams = 0;
+        uint64_t requestedInstances = 0;
+    };
+
+    // the beam BeamGen.hlsl stores for the emission, with the radius of util/BeamFootprint.h
+    PhotonBeam EmittedBeam(const BeamEmission& emission, const PushConstantBeam& pc);
+
+    // air sub-beams plus the surface photon of one emission
+    uint32_t CountBeamInstances(const BeamEmission& emission, const PushConstantBeam& pc, SubBeamSplitMode mode);
+
+    // writes the CountBeamInstances() instances of the emission as BeamGen.hlsl does
+    void WriteBeamInstances(
+        const BeamEmission& emission,
+        uint32_t beamIndex,
+        const PushConstantBeam& pc,
+        SubBeamSplitMode mode,
+        ShaderRayTracingTopASInstanceDesc* instances
+    );
+
+    // offsets[i] = sum of counts[0, i), returns the sum of all counts
+    uint64_t ExclusiveScan(const std::vector<uint32_t>& counts, std::vector<uint64_t>& offsets, uint32_t numThreads = 0);
+
+    // Port of BeamGen.hlsl: global counters, lists of pc.maxNumBeams and pc.maxNumSubBeams entries with zeroed empty slots,
+    // and a launch stops at the first beam that overflows either of them.
+    void BuildBeamInstanceListAtomic(
+        const BeamEmissionLaunches& launches,
+        const PushConstantBeam& pc,
+        SubBeamSplitMode mode,
+        BeamInstanceList& list
+    );
+
+    // Count, scan and write. The lists hold exactly the requested beams and instances, and the gather data of the beams.
+    // numThreads 0 uses std::thread::hardware_concurrency()
+    void BuildBeamInstanceListCounted(
+        const BeamEmissionLaunches& launches,
+        const PushConstantBeam& pc,
+        SubBeamSplitMode mode,
+        BeamInstanceList& list,
+        uint32_t numThreads = 0
+    );
+
+    // Every thread appends its launches through ChunkedAppendBuffer writers, then the buffers are compacted,
+    // the instance ids remapped to the compacted beam indices and the gather data made from the compacted beams.
+    // The order depends on the scheduling, beams over pc.maxNumBeams or instances over pc.maxNumSubBeams are dropped,
+    // a beam together with its whole group of instances, and the partially filled chunks count against the capacities.
+    void BuildBeamInstanceListChunked(
+        const BeamEmissionLaunches& launches,
+        const PushConstantBeam& pc,
+        SubBeamSplitMode mode,
+        BeamInstanceList& list,
+        uint32_t numThreads = 0,
+        uint32_t chunkSize = 256
+    );
+
+    // Checks
+    //  ShaderRayTracingTopASInstanceDesc against the layout and bit fields of D3D12_RAYTRACING_INSTANCE_DESC
+    //  the counted list against the atomic one, when the atomic one did not overflow
+    //  the instance id, mask, hit group, flags and BLAS of every instance of the counted list
+    //  the gather data of every beam of the counted, atomic and chunked lists
+    //  that every beam the chunked path keeps when the instances overflow has its whole group of instances
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidateBeamInstanceList(const BeamEmissionLaunches& launches, const PushConstantBeam& pc, SubBeamSplitMode mode);
+}
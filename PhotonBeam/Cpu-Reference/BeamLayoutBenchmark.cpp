@@ -0,0 +1,469 @@
+
+#include "BeamLayoutBenchmark.hpp"
+#include "BeamGather.hpp"
+#include "BeamSoA.hpp"
+#include "ParallelFor.hpp"
+#include "../Shaders/util/PackedBeam.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace CpuReference
+{
+    static_assert(sizeof(PhotonBeam) == 48, "PhotonBeam is expected to be 48 bytes");
+    static_assert(sizeof(PackedPhotonBeam) == 32, "PackedPhotonBeam must stay 32 bytes, two per cache line");
+
+    namespace
+    {
+        struct GatherScene
+        {
+            std::vector<PhotonBeam> beams;
+            std::vector<GatherRay> rays;
+
+            // candidatesPerRay beam indices per ray
+            std::vector<uint32_t> candidates;
+        };
+
+        // beams of random directions and lengths in a 20 unit box, colors over 4 decades,
+        // and rays aimed at the middle of their first candidate so a part of the candidates are hit
+        GatherScene CreateGatherScene(const BeamLayoutBenchmarkSettings& settings)
+        {
+            std::mt19937 generator(1234);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+            GatherScene scene;
+            scene.beams.resize(settings.numBeams);
+            for (auto& beam : scene.beams)
+            {
+                float3 start = float3(unit(generator), unit(generator), unit(generator)) * 20.0f - 10.0f;
+                float3 direction = uniformSamplingSphereFromUV(float2(unit(generator), unit(generator)));
+                float beamLength = 0.5f + 9.5f * unit(generator);
+
+                beam.startPos = start.ToXMFLOAT3();
+                beam.endPos = (start + direction * beamLength).ToXMFLOAT3();
+                beam.mediaIndex = generator() % 256;
+                beam.radius = 0.0f;
+                beam.lightColor = (float3(unit(generator), unit(generator), unit(generator)) * std::pow(10.0f, 4.0f * unit(generator) - 2.0f)).ToXMFLOAT3();
+                beam.hitInstanceID = int(generator() % 1024) - 1;
+            }
+
+            scene.candidates.resize(uint64_t(settings.numRays) * settings.candidatesPerRay);
+            for (auto& candidate : scene.candidates)
+            {
+                candidate = generator() % std::max(settings.numBeams, 1u);
+            }
+
+            scene.rays.resize(settings.numRays);
+            for (uint32_t rayIndex = 0; rayIndex < settings.numRays; rayIndex++)
+            {
+                const PhotonBeam& target = scene.beams[scene.candidates[uint64_t(rayIndex) * settings.candidatesPerRay]];
+                float3 middle = (float3(target.startPos) + float3(target.endPos)) * 0.5f;
+
+                GatherRay& ray = scene.rays[rayIndex];
+                ray.origin = float3(unit(generator), unit(generator), unit(generator)) * 20.0f - 10.0f;
+                ray.direction = normalize(middle - ray.origin);
+                ray.tMax = 100.0f;
+            }
+
+            return scene;
+        }
+
+        template <class Beam>
+        void Gather(
+            const std::vector<Beam>& beams,
+            const GatherScene& scene,
+            const BeamGatherConstants& pc,
+            uint32_t candidatesPerRay,
+            uint32_t numThreads,
+            std::vector<float3>& rayRadiance,
+            std::vector<uint8_t>& candidateHits
+        )
+        {
+            ParallelFor(numThreads, scene.rays.size(), [&](uint32_t, uint64_t begin, uint64_t end)
+            {
+                for (uint64_t rayIndex = begin; rayIndex < end; rayIndex++)
+                {
+                    const GatherRay& ray = scene.rays[rayIndex];
+                    float3 sum = float3(0.0f);
+
+                    for (uint64_t i = rayIndex * candidatesPerRay; i < (rayIndex + 1) * candidatesPerRay; i++)
+                    {
+                        float3 radiance;
+                        bool hit = GatherBeamRadiance(pc, ray, LoadGatherBeam(beams[scene.candidates[i]]), radiance);
+                        if (hit)
+                            sum += radiance;
+                        candidateHits[i] = hit ? 1 : 0;
+                    }
+
+                    rayRadiance[rayIndex] = sum;
+                }
+            });
+        }
+
+        // the blocks of the SoA beams every ray gathers, around the block of its first random candidate
+        std::vector<uint32_t> CreateBlockCandidates(const GatherScene& scene, const BeamSoA& soa, uint32_t candidatesPerRay)
+        {
+            std::vector<uint32_t> slotOfSource(soa.numBeams);
+            for (uint32_t slot = 0; slot < soa.numBeams; slot++)
+            {
+                slotOfSource[soa.sourceIndex[slot]] = slot;
+            }
+
+            const uint32_t numBlocks = soa.NumBlocks();
+            const uint32_t blocksPerRay = std::min(std::max(candidatesPerRay / c_beamBlockWidth, 1u), numBlocks);
+
+            std::vector<uint32_t> blockCandidates(scene.rays.size() * blocksPerRay);
+            for (size_t rayIndex = 0; rayIndex < scene.rays.size(); rayIndex++)
+            {
+                const uint32_t targetBlock = slotOfSource[scene.candidates[rayIndex * candidatesPerRay]] / c_beamBlockWidth;
+                const uint32_t firstBlock = std::min(targetBlock - std::min(targetBlock, blocksPerRay / 2), numBlocks - blocksPerRay);
+
+                for (uint32_t i = 0; i < blocksPerRay; i++)
+                {
+                    blockCandidates[rayIndex * blocksPerRay + i] = firstBlock + i;
+                }
+            }
+
+            return blockCandidates;
+        }
+
+        // full layout on the blocked candidates, one beam at a time from the beams in the slot order of the SoA
+        void GatherBlocked(
+            const std::vector<PhotonBeam>& sortedBeams,
+            const GatherScene& scene,
+            const std::vector<uint32_t>& blockCandidates,
+            const BeamGatherConstants& pc,
+            uint32_t numThreads,
+            std::vector<float3>& rayRadiance,
+            std::vector<uint8_t>& candidateHits
+        )
+        {
+            const size_t blocksPerRay = blockCandidates.size() / std::max<size_t>(scene.rays.size(), 1);
+
+            ParallelFor(numThreads, scene.rays.size(), [&](uint32_t, uint64_t begin, uint64_t end)
+            {
+                for (uint64_t rayIndex = begin; rayIndex < end; rayIndex++)
+                {
+                    const GatherRay& ray = scene.rays[rayIndex];
+                    float3 sum = float3(0.0f);
+
+                    for (uint64_t i = rayIndex * blocksPerRay; i < (rayIndex + 1) * blocksPerRay; i++)
+                    {
+                        const uint64_t firstSlot = uint64_t(blockCandidates[i]) * c_beamBlockWidth;
+                        for (uint32_t lane = 0; lane < c_beamBlockWidth; lane++)
+                        {
+                            float3 radiance;
+                            bool hit = firstSlot + lane < sortedBeams.size()
+                                && GatherBeamRadiance(pc, ray, LoadGatherBeam(sortedBeams[firstSlot + lane]), radiance);
+                            if (hit)
+                                sum += radiance;
+                            candidateHits[i * c_beamBlockWidth + lane] = hit ? 1 : 0;
+                        }
+                    }
+
+                    rayRadiance[rayIndex] = sum;
+                }
+            });
+        }
+
+        void GatherBlocked(
+            const BeamSoA& soa,
+            const GatherScene& scene,
+            const std::vector<uint32_t>& blockCandidates,
+            const BeamGatherConstants& pc,
+            uint32_t numThreads,
+            std::vector<float3>& rayRadiance,
+            std::vector<uint8_t>& candidateHits
+        )
+        {
+            const size_t blocksPerRay = blockCandidates.size() / std::max<size_t>(scene.rays.size(), 1);
+
+            ParallelFor(numThreads, scene.rays.size(), [&](uint32_t, uint64_t begin, uint64_t end)
+            {
+                for (uint64_t rayIndex = begin; rayIndex < end; rayIndex++)
+                {
+                    const GatherRay& ray = scene.rays[rayIndex];
+                    float3 sum = float3(0.0f);
+
+                    for (uint64_t i = rayIndex * blocksPerRay; i < (rayIndex + 1) * blocksPerRay; i++)
+                    {
+                        const uint32_t hits = GatherBeamBlock(pc, ray, soa, blockCandidates[i], sum);
+                        for (uint32_t lane = 0; lane < c_beamBlockWidth; lane++)
+                        {
+                            candidateHits[i * c_beamBlockWidth + lane] = uint8_t((hits >> lane) & 1);
+                        }
+                    }
+
+                    rayRadiance[rayIndex] = sum;
+                }
+            });
+        }
+
+        // best of the passes of gather(), which fills rayRadiance and candidateHits
+        template <class GatherFunction>
+        BeamLayoutBenchmarkResult MeasureLayout(
+            BeamLayout layout,
+            BeamAccess access,
+            uint32_t bytesPerBeam,
+            uint64_t bufferBytes,
+            const BeamLayoutBenchmarkSettings& settings,
+            GatherFunction gather,
+            const std::vector<float3>& rayRadiance,
+            const std::vector<uint8_t>& candidateHits
+        )
+        {
+            BeamLayoutBenchmarkResult result;
+            result.layout = layout;
+            result.access = access;
+            result.bytesPerBeam = bytesPerBeam;
+            result.bufferBytes = bufferBytes;
+
+            for (uint32_t pass = 0; pass < std::max(settings.numPasses, 1u); pass++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                gather();
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                if (pass == 0 || seconds < result.seconds)
+                    result.seconds = seconds;
+            }
+
+            const double numCandidates = double(candidateHits.size());
+            result.candidatesPerSecond = result.seconds > 0.0 ? numCandidates / result.seconds : 0.0;
+            result.beamBytesPerSecond = result.candidatesPerSecond * bytesPerBeam;
+
+            for (uint8_t hit : candidateHits)
+                result.numHits += hit;
+            for (const float3& radiance : rayRadiance)
+                result.radianceSum += double(radiance.x) + double(radiance.y) + double(radiance.z);
+
+            return result;
+        }
+
+        void CompareGathers(
+            const BeamLayoutBenchmarkResult& reference,
+            const BeamLayoutBenchmarkResult& result,
+            const std::vector<uint8_t>& referenceHits,
+            const std::vector<uint8_t>& hits,
+            double& radianceSumRelativeError,
+            double& hitMismatchRatio
+        )
+        {
+            radianceSumRelativeError = reference.radianceSum != 0.0
+                ? std::abs(result.radianceSum - reference.radianceSum) / std::abs(reference.radianceSum)
+                : 0.0;
+
+            uint64_t hitMismatches = 0;
+            for (size_t i = 0; i < referenceHits.size(); i++)
+            {
+                hitMismatches += referenceHits[i] != hits[i] ? 1 : 0;
+            }
+            hitMismatchRatio = referenceHits.empty() ? 0.0 : double(hitMismatches) / double(referenceHits.size());
+        }
+
+        void MeasureRoundTrip(const std::vector<PhotonBeam>& beams, const std::vector<PackedPhotonBeam>& packedBeams, PackedBeamErrors& errors)
+        {
+            for (size_t i = 0; i < beams.size(); i++)
+            {
+                const PhotonBeam& beam = beams[i];
+                const PhotonBeam unpacked = unpackPhotonBeam(packedBeams[i]);
+
+                float3 beamVec = float3(beam.endPos) - float3(beam.startPos);
+                float beamLength = length(beamVec);
+
+                // atan2 of the cross and dot products in double, acos of a float dot product is off by 1e-4 near 1
+                float3 unpackedDirection = unpackOctahedralDirection(packedBeams[i].octDirection);
+                double a[3] = { beamVec.x, beamVec.y, beamVec.z };
+                double b[3] = { unpackedDirection.x, unpackedDirection.y, unpackedDirection.z };
+                double crossX = a[1] * b[2] - a[2] * b[1];
+                double crossY = a[2] * b[0] - a[0] * b[2];
+                double crossZ = a[0] * b[1] - a[1] * b[0];
+                double angle = std::atan2(std::sqrt(crossX * crossX + crossY * crossY + crossZ * crossZ), a[0] * b[0] + a[1] * b[1] + a[2] * b[2]);
+                errors.maxDirectionError = std::max(errors.maxDirectionError, angle);
+
+                double endPosError = length(float3(unpacked.endPos) - float3(beam.endPos));
+                errors.maxEndPosError = std::max(errors.maxEndPosError, endPosError / beamLength);
+
+                float3 color = beam.lightColor;
+                float3 colorDiff = float3(unpacked.lightColor) - color;
+                double maxChannel = maxComponent(color);
+                double colorError = std::max({ std::abs(colorDiff.x), std::abs(colorDiff.y), std::abs(colorDiff.z) });
+                if (maxChannel > 0.0)
+                    errors.maxColorError = std::max(errors.maxColorError, colorError / maxChannel);
+
+                if (unpacked.hitInstanceID != beam.hitInstanceID || unpacked.mediaIndex != beam.mediaIndex)
+                    errors.idMismatches++;
+            }
+        }
+    }
+
+    const char* BeamLayoutName(BeamLayout layout)
+    {
+        switch (layout)
+        {
+        case BeamLayout::Full:
+            return "full";
+        case BeamLayout::Packed:
+            return "packed";
+        case BeamLayout::SoA:
+            return "soa";
+        }
+        return "";
+    }
+
+    const char* BeamAccessName(BeamAccess access)
+    {
+        switch (access)
+        {
+        case BeamAccess::Random:
+            return "random";
+        case BeamAccess::Blocked:
+            return "blocked";
+        }
+        return "";
+    }
+
+    BeamLayoutBenchmarkResults RunBeamLayoutBenchmark(const BeamLayoutBenchmarkSettings& settings)
+    {
+        const GatherScene scene = CreateGatherScene(settings);
+
+        PushConstantRay pcRay = {};
+        pcRay.airScatterCoff = XMFLOAT3(0.02f, 0.03f, 0.04f);
+        pcRay.airExtinctCoff = XMFLOAT3(0.03f, 0.04f, 0.05f);
+        pcRay.airHGAssymFactor = 0.3f;
+        pcRay.beamRadius = 0.5f;
+        pcRay.numBeamSources = 1024;
+        const BeamGatherConstants pc = MakeBeamGatherConstants(pcRay);
+
+        std::vector<PackedPhotonBeam> packedBeams(scene.beams.size());
+        for (size_t i = 0; i < scene.beams.size(); i++)
+        {
+            packedBeams[i] = packPhotonBeam(scene.beams[i]);
+        }
+
+        const uint32_t numThreads = ResolveThreadCount(settings.numThreads);
+        const uint32_t candidatesPerRay = settings.candidatesPerRay;
+
+        BeamLayoutBenchmarkResults results;
+        results.soaInstructionSet = BeamSoAInstructionSet();
+
+        // random access
+        std::vector<float3> fullRadiance(scene.rays.size());
+        std::vector<uint8_t> fullHits(scene.candidates.size());
+        const BeamLayoutBenchmarkResult full = MeasureLayout(
+            BeamLayout::Full, BeamAccess::Random, sizeof(PhotonBeam), sizeof(PhotonBeam) * scene.beams.size(), settings,
+            [&]() { Gather(scene.beams, scene, pc, candidatesPerRay, numThreads, fullRadiance, fullHits); },
+            fullRadiance, fullHits
+        );
+        results.layouts.push_back(full);
+
+        std::vector<float3> packedRadiance(scene.rays.size());
+        std::vector<uint8_t> packedHits(scene.candidates.size());
+        const BeamLayoutBenchmarkResult packed = MeasureLayout(
+            BeamLayout::Packed, BeamAccess::Random, sizeof(PackedPhotonBeam), sizeof(PackedPhotonBeam) * packedBeams.size(), settings,
+            [&]() { Gather(packedBeams, scene, pc, candidatesPerRay, numThreads, packedRadiance, packedHits); },
+            packedRadiance, packedHits
+        );
+        results.layouts.push_back(packed);
+
+        PackedBeamErrors& errors = results.packedErrors;
+        MeasureRoundTrip(scene.beams, packedBeams, errors);
+        CompareGathers(full, packed, fullHits, packedHits, errors.radianceSumRelativeError, errors.hitMismatchRatio);
+
+        // blocked access
+        const BeamSoA soa = BuildBeamSoA(scene.beams.data(), uint32_t(scene.beams.size()));
+        const std::vector<uint32_t> blockCandidates = CreateBlockCandidates(scene, soa, candidatesPerRay);
+
+        std::vector<PhotonBeam> sortedBeams(scene.beams.size());
+        for (size_t slot = 0; slot < sortedBeams.size(); slot++)
+        {
+            sortedBeams[slot] = scene.beams[soa.sourceIndex[slot]];
+        }
+
+        std::vector<float3> blockedFullRadiance(scene.rays.size());
+        std::vector<uint8_t> blockedFullHits(blockCandidates.size() * c_beamBlockWidth);
+        const BeamLayoutBenchmarkResult blockedFull = MeasureLayout(
+            BeamLayout::Full, BeamAccess::Blocked, sizeof(PhotonBeam), sizeof(PhotonBeam) * sortedBeams.size(), settings,
+            [&]() { GatherBlocked(sortedBeams, scene, blockCandidates, pc, numThreads, blockedFullRadiance, blockedFullHits); },
+            blockedFullRadiance, blockedFullHits
+        );
+        results.layouts.push_back(blockedFull);
+
+        std::vector<float3> soaRadiance(scene.rays.size());
+        std::vector<uint8_t> soaHits(blockCandidates.size() * c_beamBlockWidth);
+        const BeamLayoutBenchmarkResult blockedSoA = MeasureLayout(
+            BeamLayout::SoA, BeamAccess::Blocked, c_beamSoABytesPerBeam, uint64_t(c_beamSoABytesPerBeam) * soa.length.size(), settings,
+            [&]() { GatherBlocked(soa, scene, blockCandidates, pc, numThreads, soaRadiance, soaHits); },
+            soaRadiance, soaHits
+        );
+        results.layouts.push_back(blockedSoA);
+
+        CompareGathers(
+            blockedFull, blockedSoA, blockedFullHits, soaHits,
+            results.soaErrors.radianceSumRelativeError, results.soaErrors.hitMismatchRatio
+        );
+
+        return results;
+    }
+
+    std::string FormatBeamLayoutBenchmarkResults(const BeamLayoutBenchmarkResults& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results.layouts)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-8s %-8s %3u B/beam  buffer %8.1f MB  %9.3f ms  %8.2f Mcandidates/s  %7.2f GB/s  hits %10llu  radiance %.6g\n",
+                BeamLayoutName(result.layout),
+                BeamAccessName(result.access),
+                result.bytesPerBeam,
+                double(result.bufferBytes) / (1024.0 * 1024.0),
+                result.seconds * 1e3,
+                result.candidatesPerSecond * 1e-6,
+                result.beamBytesPerSecond * 1e-9,
+                static_cast<unsigned long long>(result.numHits),
+                result.radianceSum
+            );
+            text += line;
+        }
+
+        const PackedBeamErrors& errors = results.packedErrors;
+        std::snprintf(
+            line,
+            sizeof(line),
+            "packed errors: direction %.3g rad  endPos %.3g of length  color %.3g of max channel  id mismatches %llu\n",
+            errors.maxDirectionError,
+            errors.maxEndPosError,
+            errors.maxColorError,
+            static_cast<unsigned long long>(errors.idMismatches)
+        );
+        text += line;
+
+        std::snprintf(
+            line,
+            sizeof(line),
+            "packed gather: radiance sum relative error %.3g  hit mismatches %.3g of the candidates\n",
+            errors.radianceSumRelativeError,
+            errors.hitMismatchRatio
+        );
+        text += line;
+
+        std::snprintf(
+            line,
+            sizeof(line),
+            "soa gather (%s): radiance sum relative error %.3g  hit mismatches %.3g of the candidates\n",
+            results.soaInstructionSet,
+            results.soaErrors.radianceSumRelativeError,
+            results.soaErrors.hitMismatchRatio
+        );
+        text += line;
+
+        return text;
+    }
+}
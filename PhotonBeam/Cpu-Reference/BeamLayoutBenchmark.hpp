@@ -0,0 +1,101 @@
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Gather throughput of the beam buffer layouts.
+// Random access: every camera ray gathers a fixed list of candidate beams picked at random over the whole buffer,
+// as the any hit shader reads g_photonBeams[InstanceID()] for the sub-beams a ray crosses,
+// so the loads miss the caches and the bytes per beam bound the throughput of large buffers.
+// Blocked access: every ray gathers candidatesPerRay / c_beamBlockWidth consecutive blocks of the Morton sorted beams
+// around the beam it is aimed at, the same beams for both layouts, as a traversal reaching a leaf of close beams would.
+//  Full    PhotonBeam, 48 bytes, one beam at a time
+//  Packed  PackedPhotonBeam of Shaders/util/PackedBeam.h, 32 bytes, decoded on load
+//  SoA     BeamSoA of BeamSoA.hpp, 44 bytes, a block of beams per GatherBeamBlock()
+namespace CpuReference
+{
+    enum class BeamLayout
+    {
+        Full,
+        Packed,
+        SoA,
+    };
+
+    enum class BeamAccess
+    {
+        Random,
+        Blocked,
+    };
+
+    const char* BeamLayoutName(BeamLayout layout);
+    const char* BeamAccessName(BeamAccess access);
+
+    struct BeamLayoutBenchmarkSettings
+    {
+        // 2M beams is the capacity of m_maxNumBeamData
+        uint32_t numBeams = 1u << 21;
+        uint32_t numRays = 1u << 16;
+        uint32_t candidatesPerRay = 64;
+
+        // 0 uses std::thread::hardware_concurrency()
+        uint32_t numThreads = 0;
+
+        // the best of the passes is reported
+        uint32_t numPasses = 3;
+    };
+
+    struct BeamLayoutBenchmarkResult
+    {
+        BeamLayout layout;
+        BeamAccess access;
+
+        uint32_t bytesPerBeam = 0;
+        uint64_t bufferBytes = 0;
+
+        double seconds = 0.0;
+        double candidatesPerSecond = 0.0;
+
+        // bytes of the beam records read per second, the candidates times the record size
+        double beamBytesPerSecond = 0.0;
+
+        // candidates intersected by their ray, and the radiance summed over every ray
+        uint64_t numHits = 0;
+        double radianceSum = 0.0;
+    };
+
+    // round trip error of the packed layout and its effect on the gather, against the full layout
+    struct PackedBeamErrors
+    {
+        double maxDirectionError = 0.0;         // radians
+        double maxEndPosError = 0.0;            // over the beam length
+        double maxColorError = 0.0;             // over the largest channel
+        uint64_t idMismatches = 0;              // hitInstanceID or mediaIndex not restored
+
+        double radianceSumRelativeError = 0.0;  // of the radiance summed over every ray
+        double hitMismatchRatio = 0.0;          // candidates hit by one layout only, over all candidates
+    };
+
+    // the SoA block gather against the full layout on the same blocked candidates
+    struct SoAGatherErrors
+    {
+        double radianceSumRelativeError = 0.0;
+        double hitMismatchRatio = 0.0;
+    };
+
+    struct BeamLayoutBenchmarkResults
+    {
+        std::vector<BeamLayoutBenchmarkResult> layouts;
+        PackedBeamErrors packedErrors;
+        SoAGatherErrors soaErrors;
+
+        // instruction set of the SoA block gather
+        const char* soaInstructionSet = "";
+    };
+
+    BeamLayoutBenchmarkResults RunBeamLayoutBenchmark(const BeamLayoutBenchmarkSettings& settings = {});
+
+    // one line per layout and access, then the errors of the packed and SoA layouts
+    std::string FormatBeamLayoutBenchmarkResults(const BeamLayoutBenchmarkResults& results);
+}
@@ -0,0 +1,692 @@
+
+#include "BeamOcclusion.hpp"
+#include "BeamCulling.hpp"
+#include "BeamInstanceList.hpp"
+#include "CornellScene.hpp"
+#include "ParallelFor.hpp"
+#include "RayTracingSampling.hpp"
+#include "../Shaders/util/BeamCulling.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // an instance is occluded only when its nearest depth is behind the farthest surface depth by this ratio,
+        // the margin for the rounding of the box entries and of the depths
+        constexpr float c_depthEpsilon = 1e-4f;
+
+        // nearest view depth of a box corner projected on the screen, the instance covers the screen below it
+        constexpr float c_minProjectedDepth = 1e-3f;
+
+        struct GatherStats
+        {
+            uint64_t numTests = 0;
+            uint64_t numEntries = 0;
+        };
+
+        // The primary ray pass of RayGen.hlsl over the instances, in their order.
+        // An air instance adds the radiance of BeamAnyHit, with its sub-beam test, a photon instance the one of SurfaceAnyHit.
+        std::vector<float3> RenderPrimaryImage(
+            const std::vector<SceneBox>& scene,
+            const PushConstantRay& pc,
+            const OcclusionCamera& camera,
+            const std::vector<PhotonBeam>& beams,
+            const std::vector<ShaderRayTracingTopASInstanceDesc>& instances,
+            GatherStats& stats
+        )
+        {
+            const BeamGatherConstants gatherConstants = MakeBeamGatherConstants(pc);
+            std::vector<float3> image(size_t(camera.width) * camera.height, float3(0.0f));
+
+            const uint32_t numThreads = ResolveThreadCount(0);
+            std::vector<GatherStats> threadStats(numThreads);
+
+            ParallelFor(numThreads, camera.height, [&](uint32_t threadIndex, uint64_t begin, uint64_t end)
+            {
+                GatherStats& localStats = threadStats[threadIndex];
+                for (uint64_t y = begin; y < end; y++)
+                {
+                    for (uint32_t x = 0; x < camera.width; x++)
+                    {
+                        GatherRay ray = MakePrimaryRay(camera, x, uint32_t(y));
+                        SceneHit hit = {};
+                        const bool isHit = TraceScene(scene, ray.origin, ray.direction, c_rayTMin, c_rayTMaxDefault, hit);
+                        ray.tMax = isHit ? hit.t : c_rayTMaxDefault;
+
+                        float3 radiance = float3(0.0f);
+                        for (const auto& instance : instances)
+                        {
+                            localStats.numTests++;
+                            if (!RayEntersInstance(instance, ray.origin, ray.direction, c_rayTMin, ray.tMax))
+                                continue;
+                            localStats.numEntries++;
+
+                            const PhotonBeam& beam = beams[unpackInstanceCustomIndex(instance.instanceCustomIndexAndmask)];
+                            if (unpackInstanceHitGroup(instance.instanceShaderBindingTableRecordOffsetAndflags) == BEAM_HIT_TYPE_SOLID)
+                            {
+                                if (isHit)
+                                    radiance += GatherSurfacePhotonRadiance(pc, ray, hit, beam);
+                                continue;
+                            }
+
+                            const GatherBeam gatherBeam = LoadGatherBeam(beam);
+                            float tCurr;
+                            float3 beamPoint;
+                            if (!IntersectGatherBeam(gatherConstants, ray, gatherBeam, tCurr, beamPoint))
+                                continue;
+
+                            // the hit is on the sub-beam of the instance
+                            const float3 instanceOrigin(instance.transform[0].w, instance.transform[1].w, instance.transform[2].w);
+                            const float boxLocalBeamPointPos = dot(beamPoint - instanceOrigin, gatherBeam.direction);
+                            if (boxLocalBeamPointPos < 0.0f || getGatherBeamRadius(gatherBeam.radius, pc.beamRadius) * 2.0f <= boxLocalBeamPointPos)
+                                continue;
+
+                            radiance += GatherBeamHitRadiance(gatherConstants, ray, gatherBeam, tCurr, beamPoint);
+                        }
+
+                        image[size_t(y) * camera.width + x] = radiance;
+                    }
+                }
+            });
+
+            for (const auto& localStats : threadStats)
+            {
+                stats.numTests += localStats.numTests;
+                stats.numEntries += localStats.numEntries;
+            }
+            return image;
+        }
+
+        // view depth of the surface hit of the primary ray of every pixel
+        std::vector<float> TracePixelDepths(const std::vector<SceneBox>& scene, const OcclusionCamera& camera)
+        {
+            std::vector<float> depths(size_t(camera.width) * camera.height);
+            for (uint32_t y = 0; y < camera.height; y++)
+            {
+                for (uint32_t x = 0; x < camera.width; x++)
+                {
+                    const GatherRay ray = MakePrimaryRay(camera, x, y);
+                    SceneHit hit;
+                    const float tMax = TraceScene(scene, ray.origin, ray.direction, c_rayTMin, c_rayTMaxDefault, hit) ? hit.t : c_rayTMaxDefault;
+                    depths[size_t(y) * camera.width + x] = tMax * dot(ray.direction, camera.forward);
+                }
+            }
+            return depths;
+        }
+
+        bool IsSameImage(const std::vector<float3>& a, const std::vector<float3>& b)
+        {
+            return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(float3)) == 0;
+        }
+
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+
+        struct SceneView
+        {
+            const char* name;
+            float3 eye;
+            float3 target;
+            float fovY;
+        };
+
+        // outside the open front, close to the tall block, down behind the short block and from a corner under the ceiling
+        const SceneView c_sceneViews[] = {
+            { "front", float3(0.0f, 0.0f, -14.0f), float3(0.0f, 0.0f, 0.0f), 0.8f },
+            { "block", float3(-2.0f, -1.0f, -3.0f), float3(-2.0f, -1.5f, 2.0f), 1.0f },
+            { "low", float3(2.0f, -3.5f, -4.5f), float3(2.0f, -3.0f, 5.0f), 1.0f },
+            { "corner", float3(4.5f, 4.5f, -4.5f), float3(-1.0f, -3.0f, 1.5f), 1.0f },
+        };
+    }
+
+    OcclusionCamera MakeOcclusionCamera(const PushConstantRay& pc, uint32_t width, uint32_t height)
+    {
+        // the matrices are stored transposed, a column of the inverse view is a row of the stored matrix
+        const XMFLOAT4X4& view = pc.viewInverse;
+
+        OcclusionCamera camera;
+        camera.right = normalize(float3(view.m[0][0], view.m[1][0], view.m[2][0]));
+        camera.up = normalize(float3(view.m[0][1], view.m[1][1], view.m[2][1]));
+        camera.forward = normalize(float3(view.m[0][2], view.m[1][2], view.m[2][2]));
+        camera.eye = float3(view.m[0][3], view.m[1][3], view.m[2][3]);
+
+        // (u, v, 1, 1) to the view space point (u tanX, v tanY, 1)
+        camera.tanHalfFovX = pc.projInverse.m[0][0];
+        camera.tanHalfFovY = pc.projInverse.m[1][1];
+
+        camera.width = width;
+        camera.height = height;
+        return camera;
+    }
+
+    GatherRay MakePrimaryRay(const OcclusionCamera& camera, uint32_t x, uint32_t y)
+    {
+        const float u = (float(x) + 0.5f) / float(camera.width) * 2.0f - 1.0f;
+        const float v = -((float(y) + 0.5f) / float(camera.height) * 2.0f - 1.0f);
+        const float3 target = normalize(float3(u * camera.tanHalfFovX, v * camera.tanHalfFovY, 1.0f));
+
+        GatherRay ray;
+        ray.origin = camera.eye;
+        ray.direction = camera.right * target.x + camera.up * target.y + camera.forward * target.z;
+        ray.tMax = c_rayTMaxDefault;
+        return ray;
+    }
+
+    bool RayEntersInstance(const ShaderRayTracingTopASInstanceDesc& instance, const float3& origin, const float3& direction, float tMin, float tMax)
+    {
+        const float beamBox[6] = BEAM_BLAS_AABB;
+        const float photonBox[6] = PHOTON_BLAS_AABB;
+        const bool isPhoton = unpackInstanceHitGroup(instance.instanceShaderBindingTableRecordOffsetAndflags) == BEAM_HIT_TYPE_SOLID;
+        const float* box = isPhoton ? photonBox : beamBox;
+
+        const float3 instanceOrigin(instance.transform[0].w, instance.transform[1].w, instance.transform[2].w);
+        const float3 offset = origin - instanceOrigin;
+
+        // the columns of the instance transforms of BeamGen.hlsl are orthogonal
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float3 column(
+                (&instance.transform[0].x)[axis],
+                (&instance.transform[1].x)[axis],
+                (&instance.transform[2].x)[axis]
+            );
+            const float invLengthSquare = 1.0f / dot(column, column);
+            const float localOrigin = dot(column, offset) * invLengthSquare;
+            const float localDirection = dot(column, direction) * invLengthSquare;
+
+            if (localDirection == 0.0f)
+            {
+                if (localOrigin < box[axis] || localOrigin > box[axis + 3])
+                    return false;
+                continue;
+            }
+
+            float t0 = (box[axis] - localOrigin) / localDirection;
+            float t1 = (box[axis + 3] - localOrigin) / localDirection;
+            if (t0 > t1)
+                std::swap(t0, t1);
+
+            tMin = std::max(tMin, t0);
+            tMax = std::min(tMax, t1);
+            if (tMin > tMax)
+                return false;
+        }
+
+        return true;
+    }
+
+    bool ProjectInstanceBounds(const OcclusionCamera& camera, const ShaderRayTracingTopASInstanceDesc& instance, uint32_t& x0, uint32_t& y0, uint32_t& x1, uint32_t& y1)
+    {
+        XMFLOAT3 start, end;
+        float radius;
+        getSubBeamInstanceCapsule(instance, start, end, radius);
+        const float3 boundsMin = min(float3(start), float3(end)) - radius;
+        const float3 boundsMax = max(float3(start), float3(end)) + radius;
+
+        float minX = FLT_MAX, minY = FLT_MAX;
+        float maxX = -FLT_MAX, maxY = -FLT_MAX;
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            const float3 corner(
+                (i & 1) ? boundsMax.x : boundsMin.x,
+                (i & 2) ? boundsMax.y : boundsMin.y,
+                (i & 4) ? boundsMax.z : boundsMin.z
+            );
+            const float3 offset = corner - camera.eye;
+            const float depth = dot(offset, camera.forward);
+            if (depth <= c_minProjectedDepth)
+            {
+                x0 = 0;
+                y0 = 0;
+                x1 = camera.width - 1;
+                y1 = camera.height - 1;
+                return true;
+            }
+
+            const float u = dot(offset, camera.right) / (depth * camera.tanHalfFovX);
+            const float v = dot(offset, camera.up) / (depth * camera.tanHalfFovY);
+            const float x = (u + 1.0f) * 0.5f * float(camera.width);
+            const float y = (1.0f - v) * 0.5f * float(camera.height);
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+        }
+
+        // a pixel of margin for the rounding
+        minX = std::floor(minX) - 1.0f;
+        minY = std::floor(minY) - 1.0f;
+        maxX = std::ceil(maxX) + 1.0f;
+        maxY = std::ceil(maxY) + 1.0f;
+        if (maxX < 0.0f || maxY < 0.0f || minX >= float(camera.width) || minY >= float(camera.height))
+            return false;
+
+        x0 = uint32_t(std::max(minX, 0.0f));
+        y0 = uint32_t(std::max(minY, 0.0f));
+        x1 = uint32_t(std::min(maxX, float(camera.width - 1)));
+        y1 = uint32_t(std::min(maxY, float(camera.height - 1)));
+        return true;
+    }
+
+    void BuildDepthPyramid(const OcclusionCamera& camera, const std::vector<float>& pixelDepths, uint32_t texelSize, DepthPyramid& pyramid)
+    {
+        pyramid.texelSize = std::max(texelSize, 1u);
+        pyramid.widths.clear();
+        pyramid.heights.clear();
+        pyramid.levels.clear();
+
+        uint32_t width = (camera.width + pyramid.texelSize - 1) / pyramid.texelSize;
+        uint32_t height = (camera.height + pyramid.texelSize - 1) / pyramid.texelSize;
+
+        std::vector<float> level(size_t(width) * height, 0.0f);
+        for (uint32_t y = 0; y < camera.height; y++)
+        {
+            float* row = level.data() + size_t(y / pyramid.texelSize) * width;
+            const float* depths = pixelDepths.data() + size_t(y) * camera.width;
+            for (uint32_t x = 0; x < camera.width; x++)
+                row[x / pyramid.texelSize] = std::max(row[x / pyramid.texelSize], depths[x]);
+        }
+
+        pyramid.widths.push_back(width);
+        pyramid.heights.push_back(height);
+        pyramid.levels.push_back(std::move(level));
+
+        while (width > 1 || height > 1)
+        {
+            const std::vector<float>& finer = pyramid.levels.back();
+            const uint32_t nextWidth = (width + 1) / 2;
+            const uint32_t nextHeight = (height + 1) / 2;
+
+            std::vector<float> coarser(size_t(nextWidth) * nextHeight, 0.0f);
+            for (uint32_t y = 0; y < height; y++)
+            {
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    float& texel = coarser[size_t(y / 2) * nextWidth + x / 2];
+                    texel = std::max(texel, finer[size_t(y) * width + x]);
+                }
+            }
+
+            width = nextWidth;
+            height = nextHeight;
+            pyramid.widths.push_back(width);
+            pyramid.heights.push_back(height);
+            pyramid.levels.push_back(std::move(coarser));
+        }
+    }
+
+    bool IsSubBeamInstanceOccluded(const OcclusionCamera& camera, const DepthPyramid& pyramid, const ShaderRayTracingTopASInstanceDesc& instance)
+    {
+        if (pyramid.levels.empty())
+            return false;
+
+        XMFLOAT3 start, end;
+        float radius;
+        getSubBeamInstanceCapsule(instance, start, end, radius);
+        const float3 boundsMin = min(float3(start), float3(end)) - radius;
+        const float3 boundsMax = max(float3(start), float3(end)) + radius;
+
+        // the screen bounds of the AABB corners hold the projection of the whole box when it is in front of the camera
+        float minDepth = FLT_MAX;
+        float minX = FLT_MAX, maxX = -FLT_MAX;
+        float minY = FLT_MAX, maxY = -FLT_MAX;
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            const float3 corner(
+                (i & 1) ? boundsMax.x : boundsMin.x,
+                (i & 2) ? boundsMax.y : boundsMin.y,
+                (i & 4) ? boundsMax.z : boundsMin.z
+            );
+            const float3 offset = corner - camera.eye;
+            const float depth = dot(offset, camera.forward);
+            if (depth <= c_rayTMin)
+                return false;
+
+            const float u = dot(offset, camera.right) / (depth * camera.tanHalfFovX);
+            const float v = dot(offset, camera.up) / (depth * camera.tanHalfFovY);
+
+            // pixel coordinates of the centers of MakePrimaryRay()
+            const float x = (u + 1.0f) * 0.5f * float(camera.width) - 0.5f;
+            const float y = (1.0f - v) * 0.5f * float(camera.height) - 0.5f;
+
+            minDepth = std::min(minDepth, depth);
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+        }
+
+        // a pixel of margin for the rounding of the projection
+        const float x0 = std::floor(minX);
+        const float x1 = std::ceil(maxX);
+        const float y0 = std::floor(minY);
+        const float y1 = std::ceil(maxY);
+
+        // no primary ray passes through the box
+        if (x1 < 0.0f || y1 < 0.0f || x0 > float(camera.width - 1) || y0 > float(camera.height - 1))
+            return true;
+
+        uint32_t texelX0 = uint32_t(std::max(x0, 0.0f)) / pyramid.texelSize;
+        uint32_t texelX1 = uint32_t(std::min(x1, float(camera.width - 1))) / pyramid.texelSize;
+        uint32_t texelY0 = uint32_t(std::max(y0, 0.0f)) / pyramid.texelSize;
+        uint32_t texelY1 = uint32_t(std::min(y1, float(camera.height - 1))) / pyramid.texelSize;
+
+        // the finest level where the bounds cover at most 2 x 2 texels
+        size_t level = 0;
+        while (level + 1 < pyramid.levels.size() && (texelX1 - texelX0 > 1 || texelY1 - texelY0 > 1))
+        {
+            texelX0 /= 2;
+            texelX1 /= 2;
+            texelY0 /= 2;
+            texelY1 /= 2;
+            level++;
+        }
+
+        const std::vector<float>& depths = pyramid.levels[level];
+        const uint32_t width = pyramid.widths[level];
+        float maxDepth = 0.0f;
+        for (uint32_t y = texelY0; y <= texelY1; y++)
+        {
+            for (uint32_t x = texelX0; x <= texelX1; x++)
+                maxDepth = std::max(maxDepth, depths[size_t(y) * width + x]);
+        }
+
+        return minDepth > maxDepth * (1.0f + c_depthEpsilon);
+    }
+
+    BeamOcclusionCounter OcclusionCullSubBeamInstances(
+        const BeamCullConstants& constants,
+        const OcclusionCamera& camera,
+        const DepthPyramid& pyramid,
+        const ShaderRayTracingTopASInstanceDesc* instances,
+        uint32_t numInstances,
+        std::vector<ShaderRayTracingTopASInstanceDesc>& kept
+    )
+    {
+        BeamOcclusionCounter counter;
+        kept.clear();
+
+        for (uint32_t i = 0; i < std::min(numInstances, constants.maxNumSubBeams); i++)
+        {
+            const ShaderRayTracingTopASInstanceDesc& instance = instances[i];
+            if (instance.accelerationStructureReference == 0)
+                continue;
+
+            counter.numInstances++;
+
+            const uint32_t result = cullSubBeamInstance(constants, instance);
+            if (result == BEAM_CULL_RESULT_CULLED)
+            {
+                counter.numFrustumCulled++;
+                continue;
+            }
+
+            // only the primary rays are bounded by the pyramid
+            bool isReachedByMirrors = result == BEAM_CULL_RESULT_MIRRORS;
+            if (constants.cullMode == BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS && !isReachedByMirrors)
+            {
+                XMFLOAT3 start, end;
+                float radius;
+                getSubBeamInstanceCapsule(instance, start, end, radius);
+                for (uint32_t plane = 0; plane < constants.numMirrorPlanes && !isReachedByMirrors; plane++)
+                    isReachedByMirrors = !isCapsuleBehindPlane(constants.mirrorPlanes[plane], start, end, radius);
+            }
+
+            if (constants.cullMode != BEAM_CULL_MODE_KEEP_ALL && !isReachedByMirrors && IsSubBeamInstanceOccluded(camera, pyramid, instance))
+            {
+                counter.numOccluded++;
+                continue;
+            }
+
+            kept.push_back(instance);
+            counter.numKept++;
+        }
+
+        return counter;
+    }
+
+    std::string ValidateBeamOcclusion()
+    {
+        std::string failures;
+
+        const std::vector<SceneBox> scene = CreateCornellScene();
+        const uint32_t numLaunches = 384;
+        const uint32_t width = 96;
+        const uint32_t height = 54;
+
+        BeamInstanceList list;
+        BuildBeamInstanceListCounted(CreateSceneEmissions(scene, numLaunches, 4, 5), MakeSceneBeamConstants(), SubBeamSplitMode::Uniform, list);
+
+        // the images of every instance, of the frustum culled and of the occlusion culled instances are the same
+        {
+            bool isIdentical = true;
+            bool isLit = false;
+            bool occludedSome = false;
+
+            for (const auto& view : c_sceneViews)
+            {
+                const PushConstantRay pc = MakeSceneRayConstants(view.eye, view.target, view.fovY, float(width) / float(height), numLaunches);
+                const OcclusionCamera camera = MakeOcclusionCamera(pc, width, height);
+
+                DepthPyramid pyramid;
+                BuildDepthPyramid(camera, TracePixelDepths(scene, camera), 8, pyramid);
+
+                const BeamCullConstants constants = MakeBeamCullConstants(pc, {}, BEAM_CULL_MODE_FRUSTUM, UINT32_MAX);
+                std::vector<ShaderRayTracingTopASInstanceDesc> frustumKept;
+                std::vector<ShaderRayTracingTopASInstanceDesc> occlusionKept;
+                CullSubBeamInstances(constants, list.instances.data(), uint32_t(list.instances.size()), frustumKept);
+                const BeamOcclusionCounter counter = OcclusionCullSubBeamInstances(
+                    constants, camera, pyramid, list.instances.data(), uint32_t(list.instances.size()), occlusionKept);
+                occludedSome = occludedSome || counter.numOccluded > 0;
+
+                GatherStats stats;
+                const std::vector<float3> all = RenderPrimaryImage(scene, pc, camera, list.beams, list.instances, stats);
+                const std::vector<float3> frustum = RenderPrimaryImage(scene, pc, camera, list.beams, frustumKept, stats);
+                const std::vector<float3> occlusion = RenderPrimaryImage(scene, pc, camera, list.beams, occlusionKept, stats);
+
+                isIdentical = isIdentical && IsSameImage(all, frustum) && IsSameImage(all, occlusion);
+                for (const auto& pixel : all)
+                    isLit = isLit || maxComponent(pixel) > 0.0f;
+            }
+
+            Check(isIdentical, "image: culled images identical", failures);
+            Check(isLit, "image: beams reach the image", failures);
+            Check(occludedSome, "image: some instances occluded", failures);
+        }
+
+        // every texel holds the farthest depth under it
+        {
+            const PushConstantRay pc = MakeSceneRayConstants(c_sceneViews[2].eye, c_sceneViews[2].target, c_sceneViews[2].fovY, 1.5f, numLaunches);
+            const OcclusionCamera camera = MakeOcclusionCamera(pc, 100, 67);
+            const std::vector<float> depths = TracePixelDepths(scene, camera);
+
+            DepthPyramid pyramid;
+            BuildDepthPyramid(camera, depths, 8, pyramid);
+
+            bool isConservative = pyramid.widths.front() == 13 && pyramid.heights.front() == 9;
+            for (uint32_t y = 0; y < camera.height; y++)
+            {
+                for (uint32_t x = 0; x < camera.width; x++)
+                {
+                    uint32_t texelX = x / 8;
+                    uint32_t texelY = y / 8;
+                    for (size_t level = 0; level < pyramid.levels.size(); level++)
+                    {
+                        isConservative = isConservative && pyramid.levels[level][size_t(texelY) * pyramid.widths[level] + texelX] >= depths[size_t(y) * camera.width + x];
+                        texelX /= 2;
+                        texelY /= 2;
+                    }
+                }
+            }
+            Check(isConservative && pyramid.levels.back().size() == 1, "pyramid: texels hold the farthest depth", failures);
+        }
+
+        // a visible mirror plane and the keep all mode disable the occlusion of what they keep
+        {
+            const SceneView& view = c_sceneViews[1];
+            const PushConstantRay pc = MakeSceneRayConstants(view.eye, view.target, view.fovY, float(width) / float(height), numLaunches);
+            const OcclusionCamera camera = MakeOcclusionCamera(pc, width, height);
+
+            DepthPyramid pyramid;
+            BuildDepthPyramid(camera, TracePixelDepths(scene, camera), 8, pyramid);
+
+            // a mirror on the front face of the tall block, only the instances behind its plane may be occluded
+            const XMFLOAT3 positions[4] = {
+                XMFLOAT3(-3.5f, -c_cornellRoomSize, 0.0f), XMFLOAT3(-0.5f, -c_cornellRoomSize, 0.0f), XMFLOAT3(-0.5f, 1.5f, 0.0f), XMFLOAT3(-3.5f, 1.5f, 0.0f),
+            };
+            const XMFLOAT3 normals[4] = {
+                XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT3(0.0f, 0.0f, -1.0f),
+            };
+            XMFLOAT4X4 world = {};
+            world.m[0][0] = 1.0f;
+            world.m[1][1] = 1.0f;
+            world.m[2][2] = 1.0f;
+            world.m[3][2] = 0.5f - 0.01f;
+            world.m[3][3] = 1.0f;
+            const MirrorSurface mirror = MakeMirrorSurface(positions, normals, 4, world);
+
+            std::vector<ShaderRayTracingTopASInstanceDesc> kept;
+            BeamCullConstants constants = MakeBeamCullConstants(pc, { mirror }, BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS, UINT32_MAX);
+            BeamOcclusionCounter counter = OcclusionCullSubBeamInstances(
+                constants, camera, pyramid, list.instances.data(), uint32_t(list.instances.size()), kept);
+
+            // kept is a subsequence of the instances, every dropped one is out of the frustum or behind the mirror plane
+            bool isKeptInFront = constants.numMirrorPlanes == 1;
+            size_t keptIndex = 0;
+            for (const auto& instance : list.instances)
+            {
+                if (keptIndex < kept.size() && std::memcmp(&instance, &kept[keptIndex], sizeof(instance)) == 0)
+                {
+                    keptIndex++;
+                    continue;
+                }
+
+                XMFLOAT3 start, end;
+                float radius;
+                getSubBeamInstanceCapsule(instance, start, end, radius);
+                isKeptInFront = isKeptInFront && isCapsuleBehindPlane(constants.mirrorPlanes[0], start, end, radius);
+            }
+            Check(isKeptInFront && keptIndex == kept.size() && counter.numOccluded > 0,
+                "mirrors: instances in front of the block mirror kept", failures);
+
+            constants = MakeBeamCullConstants(pc, {}, BEAM_CULL_MODE_FRUSTUM, UINT32_MAX);
+            counter = OcclusionCullSubBeamInstances(constants, camera, pyramid, list.instances.data(), uint32_t(list.instances.size()), kept);
+            Check(counter.numOccluded > 0, "mirrors: the view occludes instances without the mirror", failures);
+
+            constants = MakeBeamCullConstants(pc, {}, BEAM_CULL_MODE_KEEP_ALL, UINT32_MAX);
+            counter = OcclusionCullSubBeamInstances(constants, camera, pyramid, list.instances.data(), uint32_t(list.instances.size()), kept);
+            Check(counter.numKept == list.instances.size() && kept.size() == list.instances.size(), "mirrors: keep all", failures);
+        }
+
+        return failures;
+    }
+
+    std::vector<BeamOcclusionBenchmarkResult> RunBeamOcclusionBenchmark(const BeamOcclusionBenchmarkSettings& settings)
+    {
+        const std::vector<SceneBox> scene = CreateCornellScene();
+
+        BeamInstanceList list;
+        BuildBeamInstanceListCounted(
+            CreateSceneEmissions(scene, settings.numLaunches, settings.maxBeamsPerLaunch, 1234),
+            MakeSceneBeamConstants(),
+            SubBeamSplitMode::Uniform,
+            list
+        );
+
+        std::vector<BeamOcclusionBenchmarkResult> results;
+        for (const auto& view : c_sceneViews)
+        {
+            const PushConstantRay pc = MakeSceneRayConstants(
+                view.eye, view.target, view.fovY, float(settings.width) / float(settings.height), settings.numLaunches);
+            const OcclusionCamera camera = MakeOcclusionCamera(pc, settings.width, settings.height);
+            const std::vector<float> depths = TracePixelDepths(scene, camera);
+            const BeamCullConstants constants = MakeBeamCullConstants(pc, {}, BEAM_CULL_MODE_FRUSTUM, UINT32_MAX);
+
+            BeamOcclusionBenchmarkResult result;
+            result.view = view.name;
+
+            auto start = std::chrono::steady_clock::now();
+            DepthPyramid pyramid;
+            BuildDepthPyramid(camera, depths, settings.texelSize, pyramid);
+            auto built = std::chrono::steady_clock::now();
+
+            std::vector<ShaderRayTracingTopASInstanceDesc> occlusionKept;
+            result.counter = OcclusionCullSubBeamInstances(
+                constants, camera, pyramid, list.instances.data(), uint32_t(list.instances.size()), occlusionKept);
+            auto culled = std::chrono::steady_clock::now();
+
+            result.pyramidSeconds = std::chrono::duration<double>(built - start).count();
+            result.cullSeconds = std::chrono::duration<double>(culled - built).count();
+
+            const uint32_t numFrustumKept = result.counter.numInstances - result.counter.numFrustumCulled;
+            result.occludedFraction = numFrustumKept > 0 ? double(result.counter.numOccluded) / double(numFrustumKept) : 0.0;
+
+            std::vector<ShaderRayTracingTopASInstanceDesc> frustumKept;
+            CullSubBeamInstances(constants, list.instances.data(), uint32_t(list.instances.size()), frustumKept);
+
+            const double numRays = double(settings.width) * double(settings.height);
+            GatherStats frustumStats;
+            GatherStats occlusionStats;
+
+            start = std::chrono::steady_clock::now();
+            RenderPrimaryImage(scene, pc, camera, list.beams, frustumKept, frustumStats);
+            auto frustumGathered = std::chrono::steady_clock::now();
+            RenderPrimaryImage(scene, pc, camera, list.beams, occlusionKept, occlusionStats);
+            auto occlusionGathered = std::chrono::steady_clock::now();
+
+            result.entriesPerRay = double(occlusionStats.numEntries) / numRays;
+            result.testsPerRayFrustum = double(frustumStats.numTests) / numRays;
+            result.testsPerRayOcclusion = double(occlusionStats.numTests) / numRays;
+            result.gatherSecondsFrustum = std::chrono::duration<double>(frustumGathered - start).count();
+            result.gatherSecondsOcclusion = std::chrono::duration<double>(occlusionGathered - frustumGathered).count();
+
+            results.push_back(result);
+        }
+
+        return results;
+    }
+
+    std::string FormatBeamOcclusionBenchmarkResults(const std::vector<BeamOcclusionBenchmarkResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-7s instances %8u  frustum culled %8u  occluded %8u (%5.1f%%)  pyramid %6.3f ms  cull %7.3f ms  "
+                "tests/ray %9.1f -> %9.1f  entries/ray %6.2f  gather %8.1f -> %8.1f ms\n",
+                result.view,
+                result.counter.numInstances,
+                result.counter.numFrustumCulled,
+                result.counter.numOccluded,
+                result.occludedFraction * 100.0,
+                result.pyramidSeconds * 1e3,
+                result.cullSeconds * 1e3,
+                result.testsPerRayFrustum,
+                result.testsPerRayOcclusion,
+                result.entriesPerRay,
+                result.gatherSecondsFrustum * 1e3,
+                result.gatherSecondsOcclusion * 1e3
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
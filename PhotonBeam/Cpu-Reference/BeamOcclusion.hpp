@@ -0,0 +1,130 @@
+#pragma once
+
+#include "CpuVector.hpp"
+#include "BeamGather.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Occlusion culling of the sub-beam instances against a low resolution depth pyramid of the camera.
+//
+// RayGen.hlsl traces the beam TLAS with the tMax of the surface hit, so an instance whose box every primary ray
+// reaches only behind the surface it hit never runs an any hit shader. The pyramid stores the farthest view depth
+// of the surface hits of the pixels under every texel, an instance is occluded when the nearest view depth of
+// its capsule is behind the farthest depth of every texel its screen bounds cover.
+//
+// The pyramid only bounds the primary rays. The mirror bounce rays start on the mirrors, so an instance in front
+// of one of the mirror planes of BeamCullConstants is never occluded, and BEAM_CULL_MODE_KEEP_ALL disables the test.
+namespace CpuReference
+{
+    // the perspective camera of PushConstantRay, with the resolution of the ray dispatch
+    struct OcclusionCamera
+    {
+        float3 eye;
+        float3 right;
+        float3 up;
+        float3 forward;
+        float tanHalfFovX;
+        float tanHalfFovY;
+
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // Reads the camera of the matrices UpdateRayTracingPushConstants() writes, a look to +z view space and
+    // the inverse of a perspective projection.
+    OcclusionCamera MakeOcclusionCamera(const PushConstantRay& pc, uint32_t width, uint32_t height);
+
+    // the primary ray RayGen.hlsl traces through the center of the pixel, tMax is left to the caller
+    GatherRay MakePrimaryRay(const OcclusionCamera& camera, uint32_t x, uint32_t y);
+
+    // the ray enters the instance box within [tMin, tMax], the test of the traversal before the any hit shader
+    bool RayEntersInstance(const ShaderRayTracingTopASInstanceDesc& instance, const float3& origin, const float3& direction, float tMin, float tMax);
+
+    // Pixel rectangle [x0, x1] x [y0, y1] covering the box of the capsule of the instance, with a pixel of margin.
+    // The whole screen when a corner of the box is not in front of the camera, false when the box is off the screen.
+    bool ProjectInstanceBounds(const OcclusionCamera& camera, const ShaderRayTracingTopASInstanceDesc& instance, uint32_t& x0, uint32_t& y0, uint32_t& x1, uint32_t& y1);
+
+    struct DepthPyramid
+    {
+        // pixels per side of a level 0 texel
+        uint32_t texelSize = 8;
+
+        // level 0 covers the pixels, every next level halves the texels down to 1 x 1,
+        // a texel holds the farthest view depth of the surfaces under it
+        std::vector<uint32_t> widths;
+        std::vector<uint32_t> heights;
+        std::vector<std::vector<float>> levels;
+    };
+
+    // pixelDepths holds the view depth, tMax * dot(direction, forward), of the primary ray of every pixel,
+    // row major from the top row
+    void BuildDepthPyramid(const OcclusionCamera& camera, const std::vector<float>& pixelDepths, uint32_t texelSize, DepthPyramid& pyramid);
+
+    // no primary ray of the camera enters the instance box before its surface hit
+    bool IsSubBeamInstanceOccluded(const OcclusionCamera& camera, const DepthPyramid& pyramid, const ShaderRayTracingTopASInstanceDesc& instance);
+
+    struct BeamOcclusionCounter
+    {
+        uint32_t numInstances = 0;
+        uint32_t numFrustumCulled = 0;
+        uint32_t numOccluded = 0;
+        uint32_t numKept = 0;
+    };
+
+    // CullSubBeamInstances() of BeamCulling.hpp followed by the occlusion test on the instances it keeps
+    // for the frustum alone, the kept instances are appended in their order.
+    BeamOcclusionCounter OcclusionCullSubBeamInstances(
+        const BeamCullConstants& constants,
+        const OcclusionCamera& camera,
+        const DepthPyramid& pyramid,
+        const ShaderRayTracingTopASInstanceDesc* instances,
+        uint32_t numInstances,
+        std::vector<ShaderRayTracingTopASInstanceDesc>& kept
+    );
+
+    // Checks
+    //  the image of the primary rays gathering the frustum culled and the occlusion culled instances is bit identical
+    //  that the occlusion test culls instances behind the blocks of the test scene
+    //  the instances in front of a visible mirror plane and the keep all mode
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidateBeamOcclusion();
+
+    struct BeamOcclusionBenchmarkSettings
+    {
+        uint32_t numLaunches = 1u << 10;
+        uint32_t maxBeamsPerLaunch = 4;
+
+        uint32_t width = 128;
+        uint32_t height = 72;
+        uint32_t texelSize = 8;
+    };
+
+    struct BeamOcclusionBenchmarkResult
+    {
+        const char* view = "";
+        BeamOcclusionCounter counter = {};
+        double occludedFraction = 0.0;
+
+        double pyramidSeconds = 0.0;
+        double cullSeconds = 0.0;
+
+        // instance boxes entered before the surface hit and instance boxes tested per primary ray,
+        // with the frustum culled and with the occlusion culled instances
+        double entriesPerRay = 0.0;
+        double testsPerRayFrustum = 0.0;
+        double testsPerRayOcclusion = 0.0;
+
+        // the CPU gather of the image
+        double gatherSecondsFrustum = 0.0;
+        double gatherSecondsOcclusion = 0.0;
+    };
+
+    // Beams in a Cornell box with two blocks and an open front, seen from several views.
+    std::vector<BeamOcclusionBenchmarkResult> RunBeamOcclusionBenchmark(const BeamOcclusionBenchmarkSettings& settings = {});
+
+    // one line per result
+    std::string FormatBeamOcclusionBenchmarkResults(const std::vector<BeamOcclusionBenchmarkResult>& results);
+}
@@ -0,0 +1,512 @@
+
+#include "BeamReservoirGather.hpp"
+#include "BeamGather.hpp"
+#include "BeamInstanceList.hpp"
+#include "BeamOcclusion.hpp"
+#include "CornellScene.hpp"
+#include "ProgressiveBeams.hpp"
+#include "../Shaders/util/BeamInstance.h"
+#include "../Shaders/util/BeamReservoir.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // the beams, their instances and the primary rays of one frame
+        struct ReservoirFrame
+        {
+            BeamInstanceList list;
+            std::vector<GatherBeam> gatherBeams;
+            BeamGatherConstants constants;
+        };
+
+        struct ReservoirView
+        {
+            OcclusionCamera camera;
+            std::vector<GatherRay> pixelRays;
+            PushConstantRay pcRay;
+        };
+
+        // the gather of one frame, one reservoir per pixel
+        struct ReservoirImage
+        {
+            std::vector<float3> image;
+            std::vector<uint32_t> numHits;
+            std::vector<uint32_t> numEvaluations;
+            double seconds = 0.0;
+        };
+
+        ReservoirView CreateReservoirView(const std::vector<SceneBox>& scene, const BeamReservoirGatherSettings& settings)
+        {
+            ReservoirView view;
+            view.pcRay = MakeSceneRayConstants(settings.eye, settings.target, settings.fovY, float(settings.width) / float(settings.height), settings.numLaunches);
+            view.pcRay.beamRadius = settings.beamRadius;
+            view.camera = MakeOcclusionCamera(view.pcRay, settings.width, settings.height);
+
+            view.pixelRays.resize(size_t(settings.width) * settings.height);
+            for (uint32_t y = 0; y < settings.height; y++)
+            {
+                for (uint32_t x = 0; x < settings.width; x++)
+                {
+                    GatherRay ray = MakePrimaryRay(view.camera, x, y);
+                    SceneHit hit;
+                    if (TraceScene(scene, ray.origin, ray.direction, c_rayTMin, c_rayTMaxDefault, hit))
+                        ray.tMax = hit.t;
+                    view.pixelRays[size_t(y) * settings.width + x] = ray;
+                }
+            }
+            return view;
+        }
+
+        // the air beams of seed
+        void TraceReservoirFrame(const std::vector<SceneBox>& scene, const ReservoirView& view, const BeamReservoirGatherSettings& settings, uint32_t seed, ReservoirFrame& frame)
+        {
+            BeamEmissionLaunches launches = CreateSceneEmissions(scene, settings.numLaunches, settings.maxBeamsPerLaunch, seed);
+            for (auto& emissions : launches)
+            {
+                for (auto& emission : emissions)
+                    emission.surfacePhoton = false;
+            }
+
+            PushConstantBeam pcBeam = MakeSceneBeamConstants();
+            pcBeam.beamRadius = settings.beamRadius;
+            BuildBeamInstanceListCounted(launches, pcBeam, SubBeamSplitMode::Uniform, frame.list, 1);
+
+            frame.gatherBeams.resize(frame.list.beams.size());
+            for (size_t i = 0; i < frame.list.beams.size(); i++)
+                frame.gatherBeams[i] = LoadGatherBeam(frame.list.beams[i]);
+
+            frame.constants = MakeBeamGatherConstants(view.pcRay);
+        }
+
+        // the test of the traversal, getIntersection() and the sub-beam test of the any hit shader
+        bool HitSubBeam(const BeamGatherConstants& constants, const GatherRay& ray, const ShaderRayTracingTopASInstanceDesc& instance, const GatherBeam& beam, float& tCurr, float3& beamPoint)
+        {
+            if (!RayEntersInstance(instance, ray.origin, ray.direction, c_rayTMin, ray.tMax))
+                return false;
+
+            if (!IntersectGatherBeam(constants, ray, beam, tCurr, beamPoint))
+                return false;
+
+            const float3 instanceOrigin(instance.transform[0].w, instance.transform[1].w, instance.transform[2].w);
+            const float boxLocalBeamPointPos = dot(beamPoint - instanceOrigin, beam.direction);
+            return 0.0f <= boxLocalBeamPointPos && boxLocalBeamPointPos < getGatherBeamRadius(beam.radius, constants.beamRadius) * 2.0f;
+        }
+
+        // numSlots 0 evaluates every hit, the reservoirs are kept between the calls for their slots
+        void GatherReservoirImage(
+            const ReservoirView& view,
+            const ReservoirFrame& frame,
+            uint32_t numSlots,
+            uint32_t seed,
+            std::vector<BeamReservoir>& reservoirs,
+            std::vector<uint32_t>& seeds,
+            ReservoirImage& result
+        )
+        {
+            const OcclusionCamera& camera = view.camera;
+            const size_t numPixels = view.pixelRays.size();
+            result.image.assign(numPixels, float3(0.0f));
+            result.numHits.assign(numPixels, 0);
+            result.numEvaluations.assign(numPixels, 0);
+
+            if (numSlots > 0 && (reservoirs.size() != numPixels || reservoirs[0].NumSlots() != numSlots))
+                reservoirs.assign(numPixels, BeamReservoir(numSlots));
+            seeds.resize(numPixels);
+
+            const auto start = std::chrono::steady_clock::now();
+
+            for (size_t pixel = 0; pixel < numPixels && numSlots > 0; pixel++)
+            {
+                reservoirs[pixel].Reset();
+                seeds[pixel] = rngInitSeed(uint32_t(pixel), seed);
+            }
+
+            const auto& instances = frame.list.instances;
+            for (uint32_t instanceIndex = 0; instanceIndex < uint32_t(instances.size()); instanceIndex++)
+            {
+                const ShaderRayTracingTopASInstanceDesc& instance = instances[instanceIndex];
+                if (unpackInstanceHitGroup(instance.instanceShaderBindingTableRecordOffsetAndflags) != BEAM_HIT_TYPE_AIR)
+                    continue;
+
+                uint32_t x0, y0, x1, y1;
+                if (!ProjectInstanceBounds(camera, instance, x0, y0, x1, y1))
+                    continue;
+
+                const GatherBeam& beam = frame.gatherBeams[unpackInstanceCustomIndex(instance.instanceCustomIndexAndmask)];
+                const float beamRadius = getGatherBeamRadius(beam.radius, frame.constants.beamRadius);
+                for (uint32_t y = y0; y <= y1; y++)
+                {
+                    for (uint32_t x = x0; x <= x1; x++)
+                    {
+                        const size_t pixel = size_t(y) * camera.width + x;
+                        const GatherRay& ray = view.pixelRays[pixel];
+
+                        float tCurr;
+                        float3 beamPoint;
+                        if (!HitSubBeam(frame.constants, ray, instance, beam, tCurr, beamPoint))
+                            continue;
+
+                        result.numHits[pixel]++;
+                        if (numSlots == 0)
+                        {
+                            result.image[pixel] += GatherBeamHitRadiance(frame.constants, ray, beam, tCurr, beamPoint);
+                            result.numEvaluations[pixel]++;
+                        }
+                        else
+                        {
+                            const float weight = getBeamReservoirWeight(beam.lightColor.ToXMFLOAT3(), beamRadius, dot(-ray.direction, beam.direction));
+                            reservoirs[pixel].Add(instanceIndex, weight, seeds[pixel]);
+                        }
+                    }
+                }
+            }
+
+            // the slots are evaluated after the traversal, as RayGen does after TraceRay
+            for (size_t pixel = 0; pixel < numPixels && numSlots > 0; pixel++)
+            {
+                const BeamReservoir& reservoir = reservoirs[pixel];
+                const GatherRay& ray = view.pixelRays[pixel];
+                for (uint32_t slot = 0; slot < reservoir.NumFilled(); slot++)
+                {
+                    const ShaderRayTracingTopASInstanceDesc& instance = instances[reservoir.Candidate(slot)];
+                    const GatherBeam& beam = frame.gatherBeams[unpackInstanceCustomIndex(instance.instanceCustomIndexAndmask)];
+
+                    float tCurr;
+                    float3 beamPoint;
+                    HitSubBeam(frame.constants, ray, instance, beam, tCurr, beamPoint);
+                    result.image[pixel] += GatherBeamHitRadiance(frame.constants, ray, beam, tCurr, beamPoint) * reservoir.Scale(slot);
+                }
+                result.numEvaluations[pixel] = reservoir.NumFilled();
+            }
+
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        uint32_t EvaluationBucket(uint32_t numEvaluations)
+        {
+            uint32_t bucket = 0;
+            while (numEvaluations > 0)
+            {
+                numEvaluations >>= 1;
+                bucket++;
+            }
+            return bucket;
+        }
+
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+    }
+
+    BeamReservoir::BeamReservoir(uint32_t numSlots)
+        : m_candidates(std::max(numSlots, 1u), 0)
+        , m_weights(std::max(numSlots, 1u), 0.0f)
+    {
+    }
+
+    void BeamReservoir::Reset()
+    {
+        m_numHits = 0;
+        m_weightSum = 0.0f;
+    }
+
+    void BeamReservoir::Add(uint32_t candidate, float weight, uint32_t& seed)
+    {
+        if (weight <= 0.0f)
+            return;
+
+        const uint32_t numSlots = NumSlots();
+        const uint32_t numHits = m_numHits;
+        m_numHits = numHits + 1;
+        m_weightSum += weight;
+
+        if (numHits < numSlots)
+        {
+            m_candidates[numHits] = candidate;
+            m_weights[numHits] = weight;
+            return;
+        }
+
+        const float u = rnd(seed);
+
+        // the slots hold the first numSlots candidates, resample them with the new one
+        if (numHits == numSlots)
+        {
+            const std::vector<uint32_t> candidates = m_candidates;
+            const std::vector<float> weights = m_weights;
+
+            for (uint32_t slot = 0; slot < numSlots; slot++)
+            {
+                float target = getBeamReservoirSlotU(u, slot, numSlots) * m_weightSum;
+                uint32_t picked = numSlots;
+                for (uint32_t j = 0; j < numSlots; j++)
+                {
+                    target -= weights[j];
+                    if (target < 0.0f)
+                    {
+                        picked = j;
+                        break;
+                    }
+                }
+
+                m_candidates[slot] = picked < numSlots ? candidates[picked] : candidate;
+                m_weights[slot] = picked < numSlots ? weights[picked] : weight;
+            }
+            return;
+        }
+
+        for (uint32_t slot = 0; slot < numSlots; slot++)
+        {
+            if (getBeamReservoirSlotU(u, slot, numSlots) * m_weightSum < weight)
+            {
+                m_candidates[slot] = candidate;
+                m_weights[slot] = weight;
+            }
+        }
+    }
+
+    float BeamReservoir::Scale(uint32_t slot) const
+    {
+        return getBeamReservoirSlotScale(m_numHits, NumSlots(), m_weightSum, m_weights[slot]);
+    }
+
+    std::string ValidateBeamReservoirGather()
+    {
+        std::string failures;
+
+        // weights and values of a stream, the values do not follow the weights
+        const float weights[] = { 1.0f, 4.0f, 0.5f, 2.0f, 0.0f, 3.0f, 1.5f, 0.25f, 6.0f, 2.5f, 1.0f, 0.75f };
+        const float values[] = { 2.0f, 1.0f, 3.0f, 0.5f, 9.0f, 4.0f, 1.0f, 2.0f, 5.0f, 0.25f, 3.0f, 1.5f };
+        const uint32_t numCandidates = uint32_t(std::size(weights));
+
+        float exactSum = 0.0f;
+        float weightSum = 0.0f;
+        for (uint32_t i = 0; i < numCandidates; i++)
+        {
+            exactSum += weights[i] > 0.0f ? values[i] : 0.0f;
+            weightSum += weights[i];
+        }
+
+        // exact while the candidates fit the slots
+        {
+            BeamReservoir reservoir(8);
+            uint32_t seed = 7;
+            bool isExact = true;
+            for (uint32_t i = 0; i < 8; i++)
+                reservoir.Add(i, weights[i], seed);
+            for (uint32_t slot = 0; slot < reservoir.NumFilled(); slot++)
+            {
+                const uint32_t expected = slot < 4 ? slot : slot + 1;
+                isExact = isExact && reservoir.Candidate(slot) == expected && reservoir.Scale(slot) == 1.0f;
+            }
+            Check(isExact && reservoir.NumHits() == 7 && seed == 7, "reservoir: candidates kept while they fit, weight 0 skipped", failures);
+        }
+
+        // the mean of the estimates over seeds is the sum, every slot follows the weights
+        for (uint32_t numSlots : { 1u, 3u, 5u })
+        {
+            const uint32_t numRuns = 1u << 16;
+            BeamReservoir reservoir(numSlots);
+            std::vector<uint32_t> counts(numCandidates, 0);
+            double estimateSum = 0.0;
+            for (uint32_t run = 0; run < numRuns; run++)
+            {
+                uint32_t seed = rngInitSeed(run, 11);
+                reservoir.Reset();
+                for (uint32_t i = 0; i < numCandidates; i++)
+                    reservoir.Add(i, weights[i], seed);
+
+                for (uint32_t slot = 0; slot < numSlots; slot++)
+                {
+                    estimateSum += values[reservoir.Candidate(slot)] * reservoir.Scale(slot);
+                    counts[reservoir.Candidate(slot)]++;
+                }
+            }
+
+            const double mean = estimateSum / numRuns;
+            bool isFollowingWeights = true;
+            for (uint32_t i = 0; i < numCandidates; i++)
+            {
+                const double expected = double(weights[i]) / weightSum * numRuns * numSlots;
+                isFollowingWeights = isFollowingWeights && std::abs(counts[i] - expected) <= 5.0 * std::sqrt(expected) + 1.0;
+            }
+
+            Check(std::abs(mean - exactSum) < exactSum * 0.01, "reservoir: unbiased estimate", failures);
+            Check(isFollowingWeights, "reservoir: slots follow the weights", failures);
+        }
+
+        // the image of the Cornell scene
+        {
+            BeamReservoirGatherSettings settings;
+            settings.width = 32;
+            settings.height = 18;
+            settings.numLaunches = 128;
+
+            const std::vector<SceneBox> scene = CreateCornellScene();
+            const ReservoirView view = CreateReservoirView(scene, settings);
+            ReservoirFrame frame;
+            TraceReservoirFrame(scene, view, settings, 5, frame);
+
+            std::vector<BeamReservoir> reservoirs;
+            std::vector<uint32_t> seeds;
+            ReservoirImage exhaustive;
+            GatherReservoirImage(view, frame, 0, 1, reservoirs, seeds, exhaustive);
+            const uint32_t maxHits = *std::max_element(exhaustive.numHits.begin(), exhaustive.numHits.end());
+
+            ReservoirImage full;
+            GatherReservoirImage(view, frame, maxHits, 1, reservoirs, seeds, full);
+            Check(maxHits > 4 && ImageRmse(full.image, exhaustive.image) == 0.0, "image: slots for every hit give the exhaustive image", failures);
+
+            const uint32_t numSlots = 2;
+            const uint32_t numSeeds = 16;
+            ReservoirImage reservoir;
+            std::vector<float3> average(exhaustive.image.size(), float3(0.0f));
+            double singleRmse = 0.0;
+            bool isBounded = true;
+            for (uint32_t i = 0; i < numSeeds; i++)
+            {
+                GatherReservoirImage(view, frame, numSlots, i + 1, reservoirs, seeds, reservoir);
+                singleRmse += ImageRmse(reservoir.image, exhaustive.image) / numSeeds;
+                for (size_t pixel = 0; pixel < average.size(); pixel++)
+                {
+                    average[pixel] += reservoir.image[pixel] / float(numSeeds);
+                    isBounded = isBounded && reservoir.numEvaluations[pixel] == std::min(reservoir.numHits[pixel], numSlots);
+                }
+            }
+
+            Check(isBounded, "image: evaluations within the slots", failures);
+            Check(singleRmse > 0.0 && ImageRmse(average, exhaustive.image) < singleRmse * 0.5, "image: error of the mean of seeds shrinks", failures);
+        }
+
+        return failures;
+    }
+
+    std::vector<BeamReservoirGatherResult> RunBeamReservoirGatherBenchmark(const BeamReservoirGatherSettings& settings)
+    {
+        const std::vector<SceneBox> scene = CreateCornellScene();
+        const ReservoirView view = CreateReservoirView(scene, settings);
+        const size_t numPixels = view.pixelRays.size();
+
+        std::vector<uint32_t> slotCounts = { 0 };
+        slotCounts.insert(slotCounts.end(), settings.slotCounts.begin(), settings.slotCounts.end());
+
+        std::vector<BeamReservoirGatherResult> results(slotCounts.size());
+        std::vector<std::vector<float3>> averages(slotCounts.size(), std::vector<float3>(numPixels, float3(0.0f)));
+        for (size_t mode = 0; mode < slotCounts.size(); mode++)
+            results[mode].numSlots = slotCounts[mode];
+
+        ReservoirFrame frame;
+        std::vector<BeamReservoir> reservoirs;
+        std::vector<uint32_t> seeds;
+        ReservoirImage exhaustive;
+        ReservoirImage reservoir;
+        for (uint32_t frameIndex = 0; frameIndex < settings.numFrames; frameIndex++)
+        {
+            TraceReservoirFrame(scene, view, settings, settings.seed + frameIndex, frame);
+
+            for (size_t mode = 0; mode < slotCounts.size(); mode++)
+            {
+                ReservoirImage& image = mode == 0 ? exhaustive : reservoir;
+                GatherReservoirImage(view, frame, slotCounts[mode], settings.seed + frameIndex, reservoirs, seeds, image);
+
+                BeamReservoirGatherResult& result = results[mode];
+                result.gatherSecondsPerFrame += image.seconds;
+                result.rmse += ImageRmse(image.image, exhaustive.image);
+                for (size_t pixel = 0; pixel < numPixels; pixel++)
+                {
+                    const uint32_t bucket = EvaluationBucket(image.numEvaluations[pixel]);
+                    if (result.evaluationHistogram.size() <= bucket)
+                        result.evaluationHistogram.resize(bucket + 1, 0);
+                    result.evaluationHistogram[bucket]++;
+
+                    result.meanHits += image.numHits[pixel];
+                    result.meanEvaluations += image.numEvaluations[pixel];
+                    result.maxEvaluations = std::max(result.maxEvaluations, image.numEvaluations[pixel]);
+                    averages[mode][pixel] += image.image[pixel];
+                }
+            }
+        }
+
+        const double numFrames = double(std::max(settings.numFrames, 1u));
+        for (size_t mode = 0; mode < slotCounts.size(); mode++)
+        {
+            BeamReservoirGatherResult& result = results[mode];
+            result.gatherSecondsPerFrame /= numFrames;
+            result.rmse /= numFrames;
+            result.meanHits /= numFrames * double(numPixels);
+            result.meanEvaluations /= numFrames * double(numPixels);
+            result.averageRmse = ImageRmse(averages[mode], averages[0]) / numFrames;
+        }
+
+        return results;
+    }
+
+    std::string FormatBeamReservoirGatherResults(const std::vector<BeamReservoirGatherResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            char name[32];
+            if (result.numSlots == 0)
+                std::snprintf(name, sizeof(name), "exhaustive");
+            else
+                std::snprintf(name, sizeof(name), "reservoir K=%u", result.numSlots);
+
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-14s %8.3f ms/frame  hits %7.2f  evaluations mean %7.2f max %5u  rmse %.6g  average rmse %.6g\n",
+                name,
+                result.gatherSecondsPerFrame * 1e3,
+                result.meanHits,
+                result.meanEvaluations,
+                result.maxEvaluations,
+                result.rmse,
+                result.averageRmse
+            );
+            text += line;
+        }
+
+        // one column per bucket, the pixels of every frame
+        text += "evaluations    ";
+        size_t numBuckets = 0;
+        for (const auto& result : results)
+            numBuckets = std::max(numBuckets, result.evaluationHistogram.size());
+        for (size_t bucket = 0; bucket < numBuckets; bucket++)
+        {
+            if (bucket == 0)
+                std::snprintf(line, sizeof(line), " %9s", "0");
+            else
+                std::snprintf(line, sizeof(line), " %9s", (std::to_string(1u << (bucket - 1)) + "-" + std::to_string((1u << bucket) - 1)).c_str());
+            text += line;
+        }
+        text += '\n';
+
+        for (const auto& result : results)
+        {
+            std::snprintf(line, sizeof(line), "%-14s ", result.numSlots == 0 ? "exhaustive" : ("K=" + std::to_string(result.numSlots)).c_str());
+            text += line;
+            for (size_t bucket = 0; bucket < numBuckets; bucket++)
+            {
+                std::snprintf(line, sizeof(line), " %9llu", (unsigned long long)(bucket < result.evaluationHistogram.size() ? result.evaluationHistogram[bucket] : 0));
+                text += line;
+            }
+            text += '\n';
+        }
+
+        return text;
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "CpuVector.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Weighted reservoir gather of util/BeamReservoir.h on the CPU, with the cost of every pixel and the error
+// against the exhaustive gather of BeamAnyHit.
+//
+// A frame traces the air beams of the Cornell scene, builds their sub-beam instances and splats every instance
+// over the pixels of its screen bounds, as BeamFootprint.hpp does. Every sub-beam a pixel hits is a hit of the
+// any hit shader: the exhaustive gather evaluates its radiance at once, the reservoir gather streams it through
+// the slots of the pixel and evaluates the slots after the splat, as RayGen does after TraceRay.
+namespace CpuReference
+{
+    // The slots of one ray over the candidate indices of the caller, the stream of addBeamReservoirHit().
+    class BeamReservoir
+    {
+    public:
+        explicit BeamReservoir(uint32_t numSlots = 1);
+
+        // empties the slots
+        void Reset();
+
+        // Streams the candidate, rnd(seed) is drawn once the slots are full as the shader does.
+        // Candidates of weight 0 are skipped.
+        void Add(uint32_t candidate, float weight, uint32_t& seed);
+
+        uint32_t NumSlots() const { return uint32_t(m_candidates.size()); }
+        uint32_t NumHits() const { return m_numHits; }
+        uint32_t NumFilled() const { return m_numHits < NumSlots() ? m_numHits : NumSlots(); }
+        float WeightSum() const { return m_weightSum; }
+
+        uint32_t Candidate(uint32_t slot) const { return m_candidates[slot]; }
+
+        // the factor of the radiance of the candidate of slot
+        float Scale(uint32_t slot) const;
+
+    private:
+        std::vector<uint32_t> m_candidates;
+        std::vector<float> m_weights;
+        uint32_t m_numHits = 0;
+        float m_weightSum = 0.0f;
+    };
+
+    // Checks
+    //  that the reservoir keeps every candidate with a scale of 1 while they fit the slots
+    //  that the estimate of a stream is unbiased and that the slots follow the weights
+    //  that the image with as many slots as the worst pixel has hits is the exhaustive image
+    //  that the evaluations of a pixel stay within the slots, and that the error of the mean of seeds shrinks
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidateBeamReservoirGather();
+
+    struct BeamReservoirGatherSettings
+    {
+        uint32_t width = 64;
+        uint32_t height = 36;
+
+        // outside the open front of the box, the pixels around the light look down the beams
+        float3 eye = float3(0.0f, 0.0f, -14.0f);
+        float3 target = float3(0.0f, 0.0f, 0.0f);
+        float fovY = 0.8f;
+
+        uint32_t numLaunches = 1u << 9;
+        uint32_t maxBeamsPerLaunch = 4;
+        float beamRadius = 0.2f;
+
+        // slots of the reservoir gathers, compared with the exhaustive gather
+        std::vector<uint32_t> slotCounts = { 1, 2, 4, 8 };
+
+        // frame i traces the beams of seed + i
+        uint32_t numFrames = 4;
+        uint32_t seed = 1;
+    };
+
+    struct BeamReservoirGatherResult
+    {
+        // 0 for the exhaustive gather
+        uint32_t numSlots = 0;
+
+        // the splat and the radiances, without the beam tracing and the instance list
+        double gatherSecondsPerFrame = 0.0;
+
+        // per pixel, hits are the any hit calls that pass the intersection
+        double meanHits = 0.0;
+        double meanEvaluations = 0.0;
+        uint32_t maxEvaluations = 0;
+
+        // pixels of every frame by radiance evaluations, bucket b holds [2^(b-1), 2^b) and bucket 0 holds 0
+        std::vector<uint64_t> evaluationHistogram;
+
+        // mean over the frames of the RMSE against the exhaustive image of the same beams
+        double rmse = 0.0;
+
+        // RMSE of the average of the frames against the average of the exhaustive images, the bias shows here
+        double averageRmse = 0.0;
+    };
+
+    // The exhaustive gather, then one reservoir gather per slot count, on the same beams.
+    std::vector<BeamReservoirGatherResult> RunBeamReservoirGatherBenchmark(const BeamReservoirGatherSettings& settings = {});
+
+    // one line per result, then the histograms
+    std::string FormatBeamReservoirGatherResults(const std::vector<BeamReservoirGatherResult>& results);
+}
@@ -0,0 +1,526 @@
+
+#include "BeamSoA.hpp"
+#include "RayTracingSampling.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace CpuReference
+{
+    namespace
+    {
+        // Lane types of the block gather, the interface of the lane types of BatchSampling.cpp restricted to floats and masks.
+        // Min and Max follow std::min and std::max, so the lanes give the result of the scalar gather.
+        struct ScalarLanes
+        {
+            using F = float;
+            using M = bool;
+            static constexpr size_t Width = 1;
+            static constexpr const char* Name = "Scalar";
+
+            static F LoadF(const float* p) { return *p; }
+            static void StoreF(float* p, F a) { *p = a; }
+            static F SetF(float a) { return a; }
+
+            static F Add(F a, F b) { return a + b; }
+            static F Sub(F a, F b) { return a - b; }
+            static F Mul(F a, F b) { return a * b; }
+            static F Div(F a, F b) { return a / b; }
+            static F Sqrt(F a) { return std::sqrt(a); }
+            static F Min(F a, F b) { return std::min(a, b); }
+            static F Max(F a, F b) { return std::max(a, b); }
+            static M Less(F a, F b) { return a < b; }
+            static M Greater(F a, F b) { return a > b; }
+            static M And(M a, M b) { return a && b; }
+            static M Or(M a, M b) { return a || b; }
+            static F Select(M m, F a, F b) { return m ? a : b; }
+            static uint32_t MoveMask(M m) { return m ? 1u : 0u; }
+        };
+
+#if defined(__AVX2__)
+        struct Avx2Lanes
+        {
+            using F = __m256;
+            using M = __m256;
+            static constexpr size_t Width = 8;
+            static constexpr const char* Name = "AVX2";
+
+            // the arrays of BeamSoA are 64 byte aligned and the blocks are 8 floats
+            static F LoadF(const float* p) { return _mm256_load_ps(p); }
+            static void StoreF(float* p, F a) { _mm256_store_ps(p, a); }
+            static F SetF(float a) { return _mm256_set1_ps(a); }
+
+            static F Add(F a, F b) { return _mm256_add_ps(a, b); }
+            static F Sub(F a, F b) { return _mm256_sub_ps(a, b); }
+            static F Mul(F a, F b) { return _mm256_mul_ps(a, b); }
+            static F Div(F a, F b) { return _mm256_div_ps(a, b); }
+            static F Sqrt(F a) { return _mm256_sqrt_ps(a); }
+
+            // _mm256_min_ps(a, b) is a < b ? a : b, std::min(a, b) is b < a ? b : a
+            static F Min(F a, F b) { return _mm256_min_ps(b, a); }
+            static F Max(F a, F b) { return _mm256_max_ps(b, a); }
+            static M Less(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+            static M Greater(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+            static M And(M a, M b) { return _mm256_and_ps(a, b); }
+            static M Or(M a, M b) { return _mm256_or_ps(a, b); }
+            static F Select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+            static uint32_t MoveMask(M m) { return uint32_t(_mm256_movemask_ps(m)); }
+        };
+
+        using SimdLanes = Avx2Lanes;
+#else
+        using SimdLanes = ScalarLanes;
+#endif
+
+        static_assert(c_beamBlockWidth % SimdLanes::Width == 0, "a block must be whole SIMD registers");
+        static_assert(c_beamBlockWidth * sizeof(float) <= c_beamSoAAlignment, "blocks must not straddle the array alignment");
+
+        template <class L>
+        struct Lanes3
+        {
+            typename L::F x;
+            typename L::F y;
+            typename L::F z;
+        };
+
+        template <class L>
+        Lanes3<L> Set3(const float3& a)
+        {
+            return { L::SetF(a.x), L::SetF(a.y), L::SetF(a.z) };
+        }
+
+        template <class L>
+        Lanes3<L> Load3(const BeamSoAArray& x, const BeamSoAArray& y, const BeamSoAArray& z, size_t slot)
+        {
+            return { L::LoadF(x.data() + slot), L::LoadF(y.data() + slot), L::LoadF(z.data() + slot) };
+        }
+
+        template <class L>
+        Lanes3<L> Add3(const Lanes3<L>& a, const Lanes3<L>& b)
+        {
+            return { L::Add(a.x, b.x), L::Add(a.y, b.y), L::Add(a.z, b.z) };
+        }
+
+        template <class L>
+        Lanes3<L> Add3(const Lanes3<L>& a, typename L::F b)
+        {
+            return { L::Add(a.x, b), L::Add(a.y, b), L::Add(a.z, b) };
+        }
+
+        template <class L>
+        Lanes3<L> Sub3(const Lanes3<L>& a, const Lanes3<L>& b)
+        {
+            return { L::Sub(a.x, b.x), L::Sub(a.y, b.y), L::Sub(a.z, b.z) };
+        }
+
+        template <class L>
+        Lanes3<L> Scale3(const Lanes3<L>& a, typename L::F b)
+        {
+            return { L::Mul(a.x, b), L::Mul(a.y, b), L::Mul(a.z, b) };
+        }
+
+        template <class L>
+        typename L::F Dot3(const Lanes3<L>& a, const Lanes3<L>& b)
+        {
+            return L::Add(L::Add(L::Mul(a.x, b.x), L::Mul(a.y, b.y)), L::Mul(a.z, b.z));
+        }
+
+        template <class L>
+        Lanes3<L> Cross3(const Lanes3<L>& a, const Lanes3<L>& b)
+        {
+            return {
+                L::Sub(L::Mul(a.y, b.z), L::Mul(a.z, b.y)),
+                L::Sub(L::Mul(a.z, b.x), L::Mul(a.x, b.z)),
+                L::Sub(L::Mul(a.x, b.y), L::Mul(a.y, b.x))
+            };
+        }
+
+        template <class L>
+        Lanes3<L> Select3(typename L::M m, const Lanes3<L>& a, const Lanes3<L>& b)
+        {
+            return { L::Select(m, a.x, b.x), L::Select(m, a.y, b.y), L::Select(m, a.z, b.z) };
+        }
+
+        // IntersectGatherBeam() of BeamGather.hpp on L::Width slots, every branch is evaluated and selected.
+        // Returns the hit mask, bit i for slot + i.
+        template <class L>
+        uint32_t IntersectLanes(
+            const BeamGatherConstants& pc,
+            const GatherRay& ray,
+            const BeamSoA& beams,
+            size_t slot,
+            float* tCurrOut,
+            float* beamPointX,
+            float* beamPointY,
+            float* beamPointZ
+        )
+        {
+            using F = typename L::F;
+            using M = typename L::M;
+
+            const Lanes3<L> start = Load3<L>(beams.startX, beams.startY, beams.startZ, slot);
+            const Lanes3<L> direction = Load3<L>(beams.directionX, beams.directionY, beams.directionZ, slot);
+            const F beamLength = L::LoadF(beams.length.data() + slot);
+
+            const Lanes3<L> origin = Set3<L>(ray.origin);
+            const Lanes3<L> rayDirection = Set3<L>(ray.direction);
+            const Lanes3<L> rayEnd = Set3<L>(ray.origin + ray.direction * ray.tMax);
+            const F rayLength = L::SetF(ray.tMax - 0.0001f);
+            const F zero = L::SetF(0.0f);
+
+            // getGatherBeamRadius() of every slot
+            const F slotRadius = L::LoadF(beams.radius.data() + slot);
+            const F beamRadius = L::Select(L::Greater(slotRadius, zero), slotRadius, L::SetF(pc.beamRadius));
+            const F radiusSquare = L::Mul(beamRadius, beamRadius);
+
+            const Lanes3<L> beamEnd = Add3<L>(start, Scale3<L>(direction, beamLength));
+            const Lanes3<L> rayBeamCross = Cross3<L>(rayDirection, direction);
+
+            // the ray is outside the infinite radius beam cylinder
+            const F rayStartOnBeamAt = Dot3<L>(direction, Sub3<L>(origin, start));
+            const F rayEndOnBeamAt = Dot3<L>(direction, Sub3<L>(rayEnd, start));
+            const M outside = L::Or(
+                L::And(L::Less(rayStartOnBeamAt, zero), L::Less(rayEndOnBeamAt, zero)),
+                L::And(L::Less(beamLength, rayStartOnBeamAt), L::Less(beamLength, rayEndOnBeamAt))
+            );
+
+            const M parallel = L::Less(Dot3<L>(rayBeamCross, rayBeamCross), L::SetF(0.1e-4f * 0.1e-4f));
+
+            // ray and beam almost parallel
+            const F beamEndOnRayAt = L::Min(rayLength, L::Max(zero, Dot3<L>(Sub3<L>(beamEnd, origin), rayDirection)));
+            const F beamStartOnRayAt = L::Min(rayLength, L::Max(zero, Dot3<L>(Sub3<L>(start, origin), rayDirection)));
+            const Lanes3<L> parallelRayPoint = Add3<L>(origin, Scale3<L>(rayDirection, L::Min(beamEndOnRayAt, beamStartOnRayAt)));
+            const Lanes3<L> parallelBeamPoint = Add3<L>(start, Scale3<L>(direction, Dot3<L>(Sub3<L>(parallelRayPoint, start), direction)));
+            const Lanes3<L> rayToBeam = Sub3<L>(parallelBeamPoint, parallelRayPoint);
+            const M parallelMiss = L::Greater(Dot3<L>(rayToBeam, rayToBeam), radiusSquare);
+
+            // nearest points between the camera ray and the beam
+            const Lanes3<L> norm1 = Cross3<L>(rayDirection, rayBeamCross);
+            const Lanes3<L> norm2 = Cross3<L>(direction, rayBeamCross);
+
+            Lanes3<L> rayPoint = Add3<L>(origin, Scale3<L>(rayDirection, L::Div(Dot3<L>(Sub3<L>(start, origin), norm2), Dot3<L>(rayDirection, norm2))));
+            Lanes3<L> beamPoint = Add3<L>(start, Scale3<L>(direction, L::Div(Dot3<L>(Sub3<L>(origin, start), norm1), Dot3<L>(direction, norm1))));
+
+            const F rayPointAt = Dot3<L>(Sub3<L>(rayPoint, origin), rayDirection);
+            const F beamPointAt = Dot3<L>(Sub3<L>(beamPoint, start), direction);
+
+            // the clamped cases in reverse order of the else if chain, so the first true case is selected last
+            const Lanes3<L> startPlusDirection = Add3<L>(start, direction);
+
+            const M afterRayEnd = L::Greater(rayPointAt, rayLength);
+            rayPoint = Select3<L>(afterRayEnd, rayEnd, rayPoint);
+            beamPoint = Select3<L>(afterRayEnd, Add3<L>(startPlusDirection, L::Min(L::Max(zero, rayEndOnBeamAt), beamLength)), beamPoint);
+
+            const M beforeRayStart = L::Less(rayPointAt, zero);
+            rayPoint = Select3<L>(beforeRayStart, origin, rayPoint);
+            beamPoint = Select3<L>(beforeRayStart, Add3<L>(startPlusDirection, L::Min(L::Max(zero, rayStartOnBeamAt), beamLength)), beamPoint);
+
+            const M afterBeamEnd = L::Greater(beamPointAt, beamLength);
+            const F beamEndAt = L::Min(L::Max(zero, Dot3<L>(rayDirection, Sub3<L>(beamEnd, origin))), rayLength);
+            beamPoint = Select3<L>(afterBeamEnd, beamEnd, beamPoint);
+            rayPoint = Select3<L>(afterBeamEnd, Add3<L>(origin, Scale3<L>(rayDirection, beamEndAt)), rayPoint);
+
+            const M beforeBeamStart = L::Less(beamPointAt, zero);
+            const F beamStartAt = L::Min(L::Max(zero, Dot3<L>(rayDirection, Sub3<L>(start, origin))), rayLength);
+            beamPoint = Select3<L>(beforeBeamStart, start, beamPoint);
+            rayPoint = Select3<L>(beforeBeamStart, Add3<L>(origin, Scale3<L>(rayDirection, beamStartAt)), rayPoint);
+
+            // the ray point is within the beam radius
+            const Lanes3<L> beamToRayPoint = Cross3<L>(Sub3<L>(rayPoint, start), direction);
+            const M miss = L::Select(parallel, parallelMiss, L::Greater(Dot3<L>(beamToRayPoint, beamToRayPoint), radiusSquare));
+
+            rayPoint = Select3<L>(parallel, parallelRayPoint, rayPoint);
+            beamPoint = Select3<L>(parallel, parallelBeamPoint, beamPoint);
+
+            const Lanes3<L> rayOffset = Sub3<L>(rayPoint, origin);
+            L::StoreF(tCurrOut, L::Sqrt(Dot3<L>(rayOffset, rayOffset)));
+            L::StoreF(beamPointX, beamPoint.x);
+            L::StoreF(beamPointY, beamPoint.y);
+            L::StoreF(beamPointZ, beamPoint.z);
+
+            return ~L::MoveMask(L::Or(outside, miss)) & ((1u << L::Width) - 1);
+        }
+
+        // 3 x 10 bits interleaved, x in the lowest bit
+        uint32_t ExpandMortonBits(uint32_t v)
+        {
+            v = (v * 0x00010001u) & 0xFF0000FFu;
+            v = (v * 0x00000101u) & 0x0F00F00Fu;
+            v = (v * 0x00000011u) & 0xC30C30C3u;
+            v = (v * 0x00000005u) & 0x49249249u;
+            return v;
+        }
+
+        uint32_t MortonCode(const float3& p, const float3& boundsMin, const float3& invExtent)
+        {
+            auto quantize = [](float x) { return uint32_t(std::clamp(x * 1023.0f, 0.0f, 1023.0f)); };
+
+            const float3 normalized = (p - boundsMin) * invExtent;
+            return ExpandMortonBits(quantize(normalized.x))
+                | (ExpandMortonBits(quantize(normalized.y)) << 1)
+                | (ExpandMortonBits(quantize(normalized.z)) << 2);
+        }
+    }
+
+    GatherBeam BeamSoA::LoadBeam(uint32_t slot) const
+    {
+        GatherBeam beam;
+        beam.startPos = float3(startX[slot], startY[slot], startZ[slot]);
+        beam.direction = float3(directionX[slot], directionY[slot], directionZ[slot]);
+        beam.length = length[slot];
+        beam.lightColor = float3(colorR[slot], colorG[slot], colorB[slot]);
+        beam.radius = radius[slot];
+        return beam;
+    }
+
+    BeamSoA BuildBeamSoA(const PhotonBeam* beams, uint32_t count)
+    {
+        // bounds of the beam midpoints
+        float3 boundsMin = float3(FLT_MAX);
+        float3 boundsMax = float3(-FLT_MAX);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const float3 middle = (float3(beams[i].startPos) + float3(beams[i].endPos)) * 0.5f;
+            boundsMin = float3(std::min(boundsMin.x, middle.x), std::min(boundsMin.y, middle.y), std::min(boundsMin.z, middle.z));
+            boundsMax = float3(std::max(boundsMax.x, middle.x), std::max(boundsMax.y, middle.y), std::max(boundsMax.z, middle.z));
+        }
+
+        const float3 extent = boundsMax - boundsMin;
+        const float3 invExtent = float3(
+            extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+            extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+            extent.z > 0.0f ? 1.0f / extent.z : 0.0f
+        );
+
+        // Morton code in the high half, the source index in the low half keeps the order of equal codes
+        std::vector<uint64_t> keys(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const float3 middle = (float3(beams[i].startPos) + float3(beams[i].endPos)) * 0.5f;
+            keys[i] = (uint64_t(MortonCode(middle, boundsMin, invExtent)) << 32) | i;
+        }
+        std::sort(keys.begin(), keys.end());
+
+        BeamSoA soa;
+        soa.numBeams = count;
+
+        const size_t numSlots = (size_t(count) + c_beamBlockWidth - 1) / c_beamBlockWidth * c_beamBlockWidth;
+        for (BeamSoAArray* array : {
+            &soa.startX, &soa.startY, &soa.startZ,
+            &soa.directionX, &soa.directionY, &soa.directionZ, &soa.length, &soa.radius,
+            &soa.colorR, &soa.colorG, &soa.colorB })
+        {
+            // the padding is a beam of length 0 at the origin, GatherBeamBlock() masks it out
+            array->assign(numSlots, 0.0f);
+        }
+        soa.sourceIndex.assign(numSlots, UINT32_MAX);
+
+        for (uint32_t slot = 0; slot < count; slot++)
+        {
+            const uint32_t source = uint32_t(keys[slot]);
+            const GatherBeam beam = LoadGatherBeam(beams[source]);
+
+            soa.startX[slot] = beam.startPos.x;
+            soa.startY[slot] = beam.startPos.y;
+            soa.startZ[slot] = beam.startPos.z;
+            soa.directionX[slot] = beam.direction.x;
+            soa.directionY[slot] = beam.direction.y;
+            soa.directionZ[slot] = beam.direction.z;
+            soa.length[slot] = beam.length;
+            soa.radius[slot] = beam.radius;
+            soa.colorR[slot] = beam.lightColor.x;
+            soa.colorG[slot] = beam.lightColor.y;
+            soa.colorB[slot] = beam.lightColor.z;
+            soa.sourceIndex[slot] = source;
+        }
+
+        return soa;
+    }
+
+    const char* BeamSoAInstructionSet()
+    {
+        return SimdLanes::Name;
+    }
+
+    uint32_t GatherBeamBlock(const BeamGatherConstants& pc, const GatherRay& ray, const BeamSoA& beams, uint32_t block, float3& radiance)
+    {
+        alignas(c_beamSoAAlignment) float tCurr[c_beamBlockWidth];
+        alignas(c_beamSoAAlignment) float beamPointX[c_beamBlockWidth];
+        alignas(c_beamSoAAlignment) float beamPointY[c_beamBlockWidth];
+        alignas(c_beamSoAAlignment) float beamPointZ[c_beamBlockWidth];
+
+        const size_t firstSlot = size_t(block) * c_beamBlockWidth;
+
+        uint32_t hits = 0;
+        for (size_t lane = 0; lane < c_beamBlockWidth; lane += SimdLanes::Width)
+        {
+            hits |= IntersectLanes<SimdLanes>(
+                pc, ray, beams, firstSlot + lane, tCurr + lane, beamPointX + lane, beamPointY + lane, beamPointZ + lane
+            ) << lane;
+        }
+
+        // padding of the last block
+        if (firstSlot + c_beamBlockWidth > beams.numBeams)
+        {
+            const size_t numValid = beams.numBeams > firstSlot ? beams.numBeams - firstSlot : 0;
+            hits &= (1u << numValid) - 1;
+        }
+
+        // the radiance of the few hits is evaluated one lane at a time
+        for (uint32_t remaining = hits; remaining != 0; remaining &= remaining - 1)
+        {
+            const uint32_t lane = uint32_t(std::countr_zero(remaining));
+            const GatherBeam beam = beams.LoadBeam(uint32_t(firstSlot + lane));
+            radiance += GatherBeamHitRadiance(pc, ray, beam, tCurr[lane], float3(beamPointX[lane], beamPointY[lane], beamPointZ[lane]));
+        }
+
+        return hits;
+    }
+
+    namespace
+    {
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+    }
+
+    std::string ValidateBeamSoA()
+    {
+        std::string failures;
+
+        // a count that leaves a partly filled last block
+        const uint32_t numBeams = 4001;
+        const uint32_t numRays = 256;
+
+        std::mt19937 generator(4321);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        std::vector<PhotonBeam> beams(numBeams);
+        for (auto& beam : beams)
+        {
+            float3 start = float3(unit(generator), unit(generator), unit(generator)) * 8.0f - 4.0f;
+            float3 direction = uniformSamplingSphereFromUV(float2(unit(generator), unit(generator)));
+
+            beam.startPos = start.ToXMFLOAT3();
+            beam.endPos = (start + direction * (0.5f + 3.0f * unit(generator))).ToXMFLOAT3();
+            beam.mediaIndex = 0;
+            beam.lightColor = (float3(unit(generator), unit(generator), unit(generator)) * 10.0f).ToXMFLOAT3();
+            beam.hitInstanceID = -1;
+
+            // half of the beams have a footprint radius, the others the radius of the constants
+            beam.radius = generator() % 2 == 0 ? 0.1f + 0.8f * unit(generator) : 0.0f;
+        }
+
+        const BeamSoA soa = BuildBeamSoA(beams.data(), numBeams);
+
+        // conversion
+        {
+            Check(soa.NumBlocks() == (numBeams + c_beamBlockWidth - 1) / c_beamBlockWidth, "conversion: block count", failures);
+            Check(reinterpret_cast<uintptr_t>(soa.startX.data()) % c_beamSoAAlignment == 0
+                && reinterpret_cast<uintptr_t>(soa.colorB.data()) % c_beamSoAAlignment == 0, "conversion: alignment", failures);
+
+            std::vector<uint32_t> sources(soa.sourceIndex.begin(), soa.sourceIndex.begin() + numBeams);
+            std::sort(sources.begin(), sources.end());
+            bool permutation = true;
+            for (uint32_t i = 0; i < numBeams; i++)
+                permutation = permutation && sources[i] == i;
+            Check(permutation, "conversion: every beam once", failures);
+
+            bool exact = true;
+            for (uint32_t slot = 0; slot < numBeams && permutation; slot++)
+            {
+                const GatherBeam a = soa.LoadBeam(slot);
+                const GatherBeam b = LoadGatherBeam(beams[soa.sourceIndex[slot]]);
+                exact = exact && a.startPos.x == b.startPos.x && a.startPos.y == b.startPos.y && a.startPos.z == b.startPos.z
+                    && a.direction.x == b.direction.x && a.direction.y == b.direction.y && a.direction.z == b.direction.z
+                    && a.length == b.length && a.radius == b.radius && a.lightColor.x == b.lightColor.x && a.lightColor.y == b.lightColor.y && a.lightColor.z == b.lightColor.z;
+            }
+            Check(exact, "conversion: slots match LoadGatherBeam", failures);
+
+            // sorted blocks are tighter than blocks of random beams
+            double sortedSpread = 0.0;
+            double sourceSpread = 0.0;
+            for (uint32_t slot = 1; slot < numBeams; slot++)
+            {
+                sortedSpread += length(soa.LoadBeam(slot).startPos - soa.LoadBeam(slot - 1).startPos);
+                sourceSpread += length(float3(beams[slot].startPos) - float3(beams[slot - 1].startPos));
+            }
+            Check(sortedSpread < 0.5 * sourceSpread, "conversion: spatial locality", failures);
+        }
+
+        // block gather against the scalar gather of the source beams
+        {
+            PushConstantRay pcRay = {};
+            pcRay.airScatterCoff = XMFLOAT3(0.02f, 0.03f, 0.04f);
+            pcRay.airExtinctCoff = XMFLOAT3(0.03f, 0.04f, 0.05f);
+            pcRay.airHGAssymFactor = 0.3f;
+            pcRay.beamRadius = 0.5f;
+            pcRay.numBeamSources = 1024;
+            const BeamGatherConstants pc = MakeBeamGatherConstants(pcRay);
+
+            uint64_t numHits = 0;
+            uint64_t hitMismatches = 0;
+            double maxRadianceError = 0.0;
+
+            for (uint32_t rayIndex = 0; rayIndex < numRays; rayIndex++)
+            {
+                const PhotonBeam& target = beams[generator() % numBeams];
+                const float3 middle = (float3(target.startPos) + float3(target.endPos)) * 0.5f;
+
+                GatherRay ray;
+                ray.origin = float3(unit(generator), unit(generator), unit(generator)) * 12.0f - 6.0f;
+                ray.direction = normalize(middle - ray.origin);
+                ray.tMax = rayIndex % 2 == 0 ? 100.0f : length(middle - ray.origin) * unit(generator);
+
+                for (uint32_t block = 0; block < soa.NumBlocks(); block++)
+                {
+                    float3 blockRadiance = float3(0.0f);
+                    const uint32_t hits = GatherBeamBlock(pc, ray, soa, block, blockRadiance);
+
+                    float3 scalarRadiance = float3(0.0f);
+                    uint32_t scalarHits = 0;
+                    for (uint32_t lane = 0; lane < c_beamBlockWidth; lane++)
+                    {
+                        const uint32_t source = soa.sourceIndex[block * c_beamBlockWidth + lane];
+                        float3 radiance;
+                        if (source != UINT32_MAX && GatherBeamRadiance(pc, ray, LoadGatherBeam(beams[source]), radiance))
+                        {
+                            scalarHits |= 1u << lane;
+                            scalarRadiance += radiance;
+                        }
+                    }
+
+                    numHits += uint32_t(std::popcount(scalarHits));
+                    hitMismatches += uint32_t(std::popcount(hits ^ scalarHits));
+
+                    if (hits == scalarHits)
+                    {
+                        const float3 diff = blockRadiance - scalarRadiance;
+                        const double scale = std::max(double(maxComponent(scalarRadiance)), 1e-20);
+                        maxRadianceError = std::max(maxRadianceError, double(maxComponent(float3(std::abs(diff.x), std::abs(diff.y), std::abs(diff.z)))) / scale);
+                    }
+                }
+            }
+
+            // fused multiply adds of the compiler may move a hit on the radius by one rounding
+            Check(numHits > 0, "gather: rays hit beams", failures);
+            Check(hitMismatches * 10000 <= numHits, "gather: hit masks", failures);
+            Check(maxRadianceError < 1e-4, "gather: radiance", failures);
+        }
+
+        return failures;
+    }
+}
@@ -0,0 +1,96 @@
+
+#pragma once
+
+#include "BeamGather.hpp"
+#include "CpuVector.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+
+// Structure of arrays copy of the beam buffer for the CPU gather.
+// The beams are sorted by the Morton code of their midpoint, so the c_beamBlockWidth beams of a block lie close together
+// and a ray reaching one beam of a block is likely to reach the others.
+// Every array starts on a 64 byte boundary and is padded to whole blocks,
+// so the gather reads a field of a block with a single aligned load.
+// The block gather runs on AVX2 when the translation unit is compiled for it, with a scalar fallback.
+namespace CpuReference
+{
+    constexpr uint32_t c_beamBlockWidth = 8;
+    constexpr size_t c_beamSoAAlignment = 64;
+
+    template <class T>
+    struct BeamSoAAllocator
+    {
+        using value_type = T;
+
+        BeamSoAAllocator() = default;
+        template <class U> BeamSoAAllocator(const BeamSoAAllocator<U>&) {}
+
+        T* allocate(size_t count)
+        {
+            return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(c_beamSoAAlignment)));
+        }
+
+        void deallocate(T* p, size_t)
+        {
+            ::operator delete(p, std::align_val_t(c_beamSoAAlignment));
+        }
+
+        template <class U> bool operator==(const BeamSoAAllocator<U>&) const { return true; }
+        template <class U> bool operator!=(const BeamSoAAllocator<U>&) const { return false; }
+    };
+
+    using BeamSoAArray = std::vector<float, BeamSoAAllocator<float>>;
+
+    struct BeamSoA
+    {
+        BeamSoAArray startX;
+        BeamSoAArray startY;
+        BeamSoAArray startZ;
+
+        // unit direction, endPos = start + direction * length
+        BeamSoAArray directionX;
+        BeamSoAArray directionY;
+        BeamSoAArray directionZ;
+        BeamSoAArray length;
+
+        // PhotonBeam::radius, 0 for the radius of the constants as in getGatherBeamRadius()
+        BeamSoAArray radius;
+
+        BeamSoAArray colorR;
+        BeamSoAArray colorG;
+        BeamSoAArray colorB;
+
+        // index in the source PhotonBeam array of every slot, UINT32_MAX for the padding of the last block
+        std::vector<uint32_t> sourceIndex;
+
+        uint32_t numBeams = 0;
+
+        uint32_t NumBlocks() const { return uint32_t(length.size() / c_beamBlockWidth); }
+
+        // the beam of a slot as LoadGatherBeam() reads it
+        GatherBeam LoadBeam(uint32_t slot) const;
+    };
+
+    // bytes of one beam, the eleven arrays
+    constexpr uint32_t c_beamSoABytesPerBeam = 11 * sizeof(float);
+
+    // Sorts and converts a PhotonBeam array.
+    // The direction and length are computed as LoadGatherBeam(const PhotonBeam&) does, mediaIndex and hitInstanceID are not kept.
+    BeamSoA BuildBeamSoA(const PhotonBeam* beams, uint32_t count);
+
+    // name of the instruction set used by GatherBeamBlock()
+    const char* BeamSoAInstructionSet();
+
+    // Intersects a ray with every beam of a block and adds the radiance of the hits to radiance.
+    // Returns the hit mask, bit i for the slot block * c_beamBlockWidth + i.
+    // Matches GatherBeamRadiance() of BeamGather.hpp on every slot within float rounding.
+    uint32_t GatherBeamBlock(const BeamGatherConstants& pc, const GatherRay& ray, const BeamSoA& beams, uint32_t block, float3& radiance);
+
+    // compares the conversion and GatherBeamBlock() with the scalar gather of the source beams, returns the failures
+    std::string ValidateBeamSoA();
+}
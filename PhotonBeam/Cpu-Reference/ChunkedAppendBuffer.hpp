@@ -0,0 +1,224 @@
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace CpuReference
+{
+    // Lock-free append buffer of fixed capacity.
+    // Every Writer, one per thread, reserves whole chunks of chunkSize records with one atomic add
+    // and fills them without synchronization, so threads share the counter cache line once per chunk instead of once per record.
+    // Partially filled chunks leave holes, Compact() closes them once every writer is flushed.
+    template <class T>
+    class ChunkedAppendBuffer
+    {
+    public:
+        static constexpr uint64_t c_invalidIndex = std::numeric_limits<uint64_t>::max();
+
+        class Writer
+        {
+        public:
+            // the writer starts full, its first append reserves a chunk
+            explicit Writer(ChunkedAppendBuffer& buffer) : m_buffer(&buffer) {}
+            ~Writer() { Flush(); }
+
+            Writer(const Writer&) = delete;
+            Writer& operator=(const Writer&) = delete;
+
+            // index of the record before Compact(), c_invalidIndex when the buffer is full
+            uint64_t Append(const T& value)
+            {
+                if (m_fill == m_chunkCapacity && !NextChunk())
+                {
+                    m_buffer->m_droppedRecords.fetch_add(1, std::memory_order_relaxed);
+                    return c_invalidIndex;
+                }
+
+                uint64_t index = m_chunk * m_buffer->m_chunkSize + m_fill;
+                m_buffer->m_storage[index] = value;
+                m_fill++;
+                return index;
+            }
+
+            // All or nothing, the records may span several chunks. The ones past the current chunk go to consecutive
+            // chunks reserved with one atomic add. Returns false and drops every record when the buffer cannot hold them,
+            // the current chunk stays open for smaller appends.
+            bool Append(const T* values, uint32_t count)
+            {
+                const uint64_t chunkSize = m_buffer->m_chunkSize;
+                const uint32_t numInChunk = std::min(count, m_chunkCapacity - m_fill);
+                const uint32_t numAfter = count - numInChunk;
+
+                uint64_t firstChunk = c_invalidIndex;
+                if (numAfter > 0)
+                {
+                    if (!m_bufferFull)
+                        firstChunk = m_buffer->m_nextChunk.fetch_add((numAfter + chunkSize - 1) / chunkSize, std::memory_order_relaxed);
+
+                    // the chunks reserved past the capacity stay empty
+                    if (firstChunk == c_invalidIndex || firstChunk * chunkSize + numAfter > m_buffer->m_capacity)
+                    {
+                        m_bufferFull = true;
+                        m_buffer->m_droppedRecords.fetch_add(count, std::memory_order_relaxed);
+                        return false;
+                    }
+                }
+
+                if (numInChunk > 0)
+                {
+                    std::copy(values, values + numInChunk, m_buffer->m_storage.begin() + (m_chunk * chunkSize + m_fill));
+                    m_fill += numInChunk;
+                }
+
+                if (numAfter > 0)
+                {
+                    Flush();
+
+                    // consecutive chunks are consecutive in the storage, all of them but the last one are full
+                    std::copy(values + numInChunk, values + count, m_buffer->m_storage.begin() + firstChunk * chunkSize);
+
+                    const uint64_t lastChunk = firstChunk + (numAfter - 1) / chunkSize;
+                    for (uint64_t chunk = firstChunk; chunk < lastChunk; chunk++)
+                        m_buffer->m_chunkFill[chunk] = uint32_t(chunkSize);
+
+                    m_chunk = lastChunk;
+                    m_chunkCapacity = uint32_t(std::min<uint64_t>(chunkSize, m_buffer->m_capacity - lastChunk * chunkSize));
+                    m_fill = uint32_t(numAfter - (lastChunk - firstChunk) * chunkSize);
+                }
+
+                return true;
+            }
+
+            // Drops the record of the last Append(const T&), which must have succeeded, for a group appended to
+            // another buffer that did not fit
+            void DropLast()
+            {
+                m_fill--;
+                m_buffer->m_droppedRecords.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // publishes the fill of the current chunk, the writer can keep appending afterwards
+            void Flush()
+            {
+                if (m_chunk != c_invalidIndex)
+                    m_buffer->m_chunkFill[m_chunk] = m_fill;
+            }
+
+        private:
+            bool NextChunk()
+            {
+                // once the buffer is full, later appends fail without touching the counter again
+                if (m_bufferFull)
+                    return false;
+
+                Flush();
+
+                uint64_t chunk = m_buffer->m_nextChunk.fetch_add(1, std::memory_order_relaxed);
+                if (chunk >= m_buffer->m_numChunks)
+                {
+                    m_chunk = c_invalidIndex;
+                    m_bufferFull = true;
+                    return false;
+                }
+
+                // the last chunk ends at the capacity
+                m_chunk = chunk;
+                m_chunkCapacity = uint32_t(std::min<uint64_t>(m_buffer->m_chunkSize, m_buffer->m_capacity - chunk * m_buffer->m_chunkSize));
+                m_fill = 0;
+                return true;
+            }
+
+            ChunkedAppendBuffer* m_buffer;
+            uint64_t m_chunk = c_invalidIndex;
+            uint32_t m_chunkCapacity = 0;
+            uint32_t m_fill = 0;
+            bool m_bufferFull = false;
+        };
+
+        // The records left in the partially filled chunk of every writer count against the capacity,
+        // so it needs numThreads * chunkSize records of slack over the demand.
+        ChunkedAppendBuffer(uint64_t capacity, uint32_t chunkSize)
+            : m_chunkSize(std::max(chunkSize, 1u)),
+            m_capacity(capacity),
+            m_numChunks((capacity + m_chunkSize - 1) / m_chunkSize),
+            m_storage(capacity),
+            m_chunkFill(m_numChunks, 0),
+            m_chunkBase(m_numChunks, 0),
+            m_nextChunk(0),
+            m_droppedRecords(0)
+        {
+        }
+
+        // every writer must be flushed or destroyed
+        void Reset()
+        {
+            std::fill(m_chunkFill.begin(), m_chunkFill.end(), 0);
+            m_nextChunk = 0;
+            m_droppedRecords = 0;
+            m_size = 0;
+        }
+
+        // Moves the records of every chunk next to the ones of the previous chunk.
+        // Single threaded, every writer must be flushed or destroyed. Returns the number of records.
+        uint64_t Compact()
+        {
+            const uint64_t numUsedChunks = std::min(m_nextChunk.load(), m_numChunks);
+
+            uint64_t size = 0;
+            for (uint64_t chunk = 0; chunk < numUsedChunks; chunk++)
+            {
+                m_chunkBase[chunk] = size;
+
+                // the destination never passes the source, so a forward copy is safe
+                auto source = m_storage.begin() + chunk * m_chunkSize;
+                if (size != chunk * m_chunkSize)
+                    std::move(source, source + m_chunkFill[chunk], m_storage.begin() + size);
+
+                size += m_chunkFill[chunk];
+            }
+
+            m_size = size;
+            return size;
+        }
+
+        // index after Compact() of the record appended at index
+        uint64_t CompactedIndex(uint64_t index) const
+        {
+            return m_chunkBase[index / m_chunkSize] + index % m_chunkSize;
+        }
+
+        // valid after Compact()
+        const T* Data() const { return m_storage.data(); }
+        uint64_t Size() const { return m_size; }
+
+        // Moves the compacted records out, the buffer must be recreated to be used again
+        std::vector<T> TakeRecords()
+        {
+            m_storage.resize(m_size);
+            return std::move(m_storage);
+        }
+
+        uint64_t Capacity() const { return m_capacity; }
+        uint32_t ChunkSize() const { return m_chunkSize; }
+        uint64_t DroppedRecords() const { return m_droppedRecords.load(); }
+
+    private:
+        const uint32_t m_chunkSize;
+        const uint64_t m_capacity;
+        const uint64_t m_numChunks;
+
+        std::vector<T> m_storage;
+
+        // written by the writer owning the chunk, read after the writers are joined
+        std::vector<uint32_t> m_chunkFill;
+        std::vector<uint64_t> m_chunkBase;
+
+        std::atomic<uint64_t> m_nextChunk;
+        std::atomic<uint64_t> m_droppedRecords;
+        uint64_t m_size = 0;
+    };
+}
@@ -0,0 +1,220 @@
+
+#include "CornellScene.hpp"
+#include "RayTracingSampling.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace CpuReference
+{
+    namespace
+    {
+        constexpr float c_wallThickness = 0.5f;
+
+        // length of a beam leaving through the open front
+        constexpr float c_missBeamLength = 20.0f;
+
+        // the material of every surface of the scene, of albedo c_cornellAlbedo
+        constexpr float c_roughness = 1.0f;
+        constexpr float c_metallic = 0.0f;
+    }
+
+    std::vector<SceneBox> CreateCornellScene()
+    {
+        const float outer = c_cornellRoomSize + c_wallThickness;
+        return {
+            { float3(-outer, -outer, -outer), float3(outer, -c_cornellRoomSize, outer) }, // floor
+            { float3(-outer, c_cornellRoomSize, -outer), float3(outer, outer, outer) },   // ceiling
+            { float3(-outer, -outer, -outer), float3(-c_cornellRoomSize, outer, outer) }, // left wall
+            { float3(c_cornellRoomSize, -outer, -outer), float3(outer, outer, outer) },   // right wall
+            { float3(-outer, -outer, c_cornellRoomSize), float3(outer, outer, outer) },   // back wall
+            { float3(-3.5f, -c_cornellRoomSize, 0.5f), float3(-0.5f, 1.5f, 3.0f) },       // tall block
+            { float3(0.5f, -c_cornellRoomSize, -3.0f), float3(3.5f, -2.0f, -0.5f) },      // short block
+        };
+    }
+
+    bool IntersectSceneBox(const SceneBox& box, const float3& origin, const float3& direction, float tMin, float tMax, float& t, float3& normal)
+    {
+        float tNear = tMin;
+        float tFar = tMax;
+        int nearAxis = -1;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (direction[axis] == 0.0f)
+            {
+                if (origin[axis] < box.boundsMin[axis] || origin[axis] > box.boundsMax[axis])
+                    return false;
+                continue;
+            }
+
+            const float invDirection = 1.0f / direction[axis];
+            float t0 = (box.boundsMin[axis] - origin[axis]) * invDirection;
+            float t1 = (box.boundsMax[axis] - origin[axis]) * invDirection;
+            if (t0 > t1)
+                std::swap(t0, t1);
+
+            if (t0 > tNear)
+            {
+                tNear = t0;
+                nearAxis = axis;
+            }
+            tFar = std::min(tFar, t1);
+            if (tNear > tFar)
+                return false;
+        }
+
+        if (nearAxis < 0)
+            return false;
+
+        t = tNear;
+        normal = float3(0.0f);
+        normal[nearAxis] = direction[nearAxis] > 0.0f ? -1.0f : 1.0f;
+        return true;
+    }
+
+    bool TraceScene(const std::vector<SceneBox>& scene, const float3& origin, const float3& direction, float tMin, float tMax, SceneHit& hit)
+    {
+        bool isHit = false;
+        for (size_t i = 0; i < scene.size(); i++)
+        {
+            float t;
+            float3 normal;
+            if (IntersectSceneBox(scene[i], origin, direction, tMin, tMax, t, normal))
+            {
+                tMax = t;
+                hit.t = t;
+                hit.normal = normal;
+                hit.boxIndex = int(i);
+                isHit = true;
+            }
+        }
+        return isHit;
+    }
+
+    BeamEmissionLaunches CreateSceneEmissions(const std::vector<SceneBox>& scene, uint32_t numLaunches, uint32_t maxBeamsPerLaunch, uint32_t seed)
+    {
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        BeamEmissionLaunches launches(numLaunches);
+        for (auto& emissions : launches)
+        {
+            const uint32_t numBeams = 1 + generator() % std::max(maxBeamsPerLaunch, 1u);
+            float3 position = float3(0.0f, c_cornellRoomSize * 0.9f, 0.0f);
+            float3 direction = uniformSamplingSphereFromUV(float2(unit(generator), unit(generator)));
+            if (direction.y > 0.0f)
+                direction.y = -direction.y;
+
+            for (uint32_t i = 0; i < numBeams; i++)
+            {
+                BeamEmission emission = {};
+                emission.direction = direction;
+                emission.airSubBeams = true;
+                emission.beam.startPos = position.ToXMFLOAT3();
+                emission.beam.lightColor = XMFLOAT3(1.0f, 1.0f, 1.0f);
+                emission.beam.hitInstanceID = -1;
+
+                SceneHit hit;
+                if (!TraceScene(scene, position, direction, c_rayTMin, c_missBeamLength, hit))
+                {
+                    emission.beam.endPos = (position + direction * c_missBeamLength).ToXMFLOAT3();
+                    emissions.push_back(emission);
+                    break;
+                }
+
+                emission.hitNormal = hit.normal;
+                emission.surfacePhoton = true;
+                emission.beam.hitInstanceID = hit.boxIndex;
+                position = position + direction * hit.t;
+                emission.beam.endPos = position.ToXMFLOAT3();
+                emissions.push_back(emission);
+
+                // diffuse bounce off the surface
+                direction = uniformSamplingSphereFromUV(float2(unit(generator), unit(generator)));
+                if (dot(direction, hit.normal) < 0.0f)
+                    direction = -direction;
+                position = position + hit.normal * c_rayTMin;
+            }
+        }
+
+        return launches;
+    }
+
+    PushConstantBeam MakeSceneBeamConstants()
+    {
+        PushConstantBeam pc = {};
+        pc.beamRadius = 0.2f;
+        pc.photonRadius = 0.2f;
+        pc.beamBlasAddress = 1;
+        pc.photonBlasAddress = 2;
+        pc.maxNumBeams = UINT32_MAX;
+        pc.maxNumSubBeams = UINT32_MAX;
+        return pc;
+    }
+
+    PushConstantRay MakeSceneRayConstants(const float3& eye, const float3& target, float fovY, float aspect, uint32_t numLaunches)
+    {
+        const float3 forward = normalize(target - eye);
+        const float3 right = normalize(cross(float3(0.0f, 1.0f, 0.0f), forward));
+        const float3 up = cross(forward, right);
+        const float tanHalfFovY = std::tan(fovY * 0.5f);
+
+        PushConstantRay pc = {};
+        for (int j = 0; j < 3; j++)
+        {
+            pc.viewInverse.m[j][0] = right[j];
+            pc.viewInverse.m[j][1] = up[j];
+            pc.viewInverse.m[j][2] = forward[j];
+            pc.viewInverse.m[j][3] = eye[j];
+        }
+        pc.viewInverse.m[3][3] = 1.0f;
+
+        pc.projInverse.m[0][0] = tanHalfFovY * aspect;
+        pc.projInverse.m[1][1] = tanHalfFovY;
+        pc.projInverse.m[2][3] = 1.0f;
+        pc.projInverse.m[3][2] = 1.0f;
+
+        pc.airScatterCoff = XMFLOAT3(0.1f, 0.1f, 0.1f);
+        pc.airExtinctCoff = XMFLOAT3(0.12f, 0.12f, 0.12f);
+        pc.airHGAssymFactor = 0.3f;
+        pc.beamRadius = 0.2f;
+        pc.photonRadius = 0.2f;
+        pc.numBeamSources = numLaunches;
+        pc.numPhotonSources = numLaunches;
+        return pc;
+    }
+
+    float3 GatherSurfacePhotonBoxRadiance(const PushConstantRay& pc, const GatherRay& ray, const SceneHit& hit, const PhotonBeam& beam)
+    {
+        if (beam.hitInstanceID != hit.boxIndex)
+            return float3(0.0f);
+
+        const float3 worldPos = ray.origin + ray.direction * ray.tMax;
+        const float pointDist = length(worldPos - float3(beam.endPos));
+        if (pointDist > pc.photonRadius)
+            return float3(0.0f);
+
+        const float3 towardLightDirection = normalize(float3(beam.startPos) - float3(beam.endPos));
+        const float beamDist = length(float3(beam.startPos) - float3(beam.endPos));
+        const float3 viewingDirection = normalize(-ray.direction);
+        if (dot(towardLightDirection, hit.normal) <= 0.0f || dot(viewingDirection, hit.normal) <= 0.0f)
+            return float3(0.0f);
+
+        return exp(-float3(pc.airExtinctCoff) * (ray.tMax + beamDist))
+            * gltfBrdf(towardLightDirection, viewingDirection, hit.normal, float3(c_cornellAlbedo), c_roughness, c_metallic)
+            * float3(beam.lightColor) / float(pc.numPhotonSources) * dot(towardLightDirection, hit.normal)
+            / (pc.photonRadius * pc.photonRadius * c_pi);
+    }
+
+    float3 GatherSurfacePhotonRadiance(const PushConstantRay& pc, const GatherRay& ray, const SceneHit& hit, const PhotonBeam& beam)
+    {
+        const float3 radiance = GatherSurfacePhotonBoxRadiance(pc, ray, hit, beam);
+        if (radiance.x == 0.0f && radiance.y == 0.0f && radiance.z == 0.0f)
+            return radiance;
+
+        const float pointDist = length(ray.origin + ray.direction * ray.tMax - float3(beam.endPos));
+        return radiance * std::pow(1.0f - (pointDist - 0.1f) / pc.photonRadius, 0.5f);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "CpuVector.hpp"
+#include "BeamGather.hpp"
+#include "BeamInstanceList.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <cstdint>
+#include <vector>
+
+// Test scene of the CPU references, a Cornell box of solid slabs centered on the origin with the front at -z open,
+// a tall and a short block, a light under the ceiling and one diffuse material on every surface.
+namespace CpuReference
+{
+    // tMin and the tMax of a miss of RayGen.hlsl
+    constexpr float c_rayTMin = 0.001f;
+    constexpr float c_rayTMaxDefault = 10000.0f;
+
+    // half extent of the box
+    constexpr float c_cornellRoomSize = 5.0f;
+
+    // albedo of the diffuse material of every surface
+    constexpr float c_cornellAlbedo = 0.7f;
+
+    struct SceneBox
+    {
+        float3 boundsMin;
+        float3 boundsMax;
+    };
+
+    struct SceneHit
+    {
+        float t;
+        float3 normal;
+        int boxIndex;
+    };
+
+    // walls, floor and ceiling, then the tall and the short block
+    std::vector<SceneBox> CreateCornellScene();
+
+    // entering hit of a ray starting outside the box
+    bool IntersectSceneBox(const SceneBox& box, const float3& origin, const float3& direction, float tMin, float tMax, float& t, float3& normal);
+
+    // nearest hit of the boxes within [tMin, tMax]
+    bool TraceScene(const std::vector<SceneBox>& scene, const float3& origin, const float3& direction, float tMin, float tMax, SceneHit& hit);
+
+    // Beams from the light bouncing diffusely off the scene, 1 to maxBeamsPerLaunch per launch.
+    // A beam leaving through the open front ends the launch.
+    BeamEmissionLaunches CreateSceneEmissions(const std::vector<SceneBox>& scene, uint32_t numLaunches, uint32_t maxBeamsPerLaunch, uint32_t seed);
+
+    PushConstantBeam MakeSceneBeamConstants();
+
+    // left handed look at camera and the medium, the matrices are written as UpdateRayTracingPushConstants() stores them
+    PushConstantRay MakeSceneRayConstants(const float3& eye, const float3& target, float fovY, float aspect, uint32_t numLaunches);
+
+    // SurfaceAnyHit of RaySurfaceAnyHit.hlsl without its kernel, the constant 1 / (pi r^2) on the photon disk,
+    // for a ray whose tMax is the surface hit
+    float3 GatherSurfacePhotonBoxRadiance(const PushConstantRay& pc, const GatherRay& ray, const SceneHit& hit, const PhotonBeam& beam);
+
+    // SurfaceAnyHit of RaySurfaceAnyHit.hlsl for a ray whose tMax is the surface hit
+    float3 GatherSurfacePhotonRadiance(const PushConstantRay& pc, const GatherRay& ray, const SceneHit& hit, const PhotonBeam& beam);
+}
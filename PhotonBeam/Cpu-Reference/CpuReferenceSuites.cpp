@@ -0,0 +1,190 @@
+#include "CpuReferenceSuites.hpp"
+#include "AppendBufferBenchmark.hpp"
+#include "AtrousDenoiser.hpp"
+#include "BeamCapacityPlanner.hpp"
+#include "BeamClusterTree.hpp"
+#include "BeamCulling.hpp"
+#include "BeamFootprint.hpp"
+#include "BeamGatherData.hpp"
+#include "BeamInstanceList.hpp"
+#include "BeamLayoutBenchmark.hpp"
+#include "BeamOcclusion.hpp"
+#include "BeamReservoirGather.hpp"
+#include "BeamSoA.hpp"
+#include "CornellScene.hpp"
+#include "FastMathValidation.hpp"
+#include "GridMedium.hpp"
+#include "HgTableBenchmark.hpp"
+#include "IncrementalBeamList.hpp"
+#include "MediaTable.hpp"
+#include "PhotonPlanes.hpp"
+#include "ProgressiveBeams.hpp"
+#include "RngBenchmark.hpp"
+#include "SamplerValidation.hpp"
+#include "SobolBenchmark.hpp"
+#include "SubBeamSplitter.hpp"
+
+#include <chrono>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // emissions of the Cornell scene with capacities holding all of them
+        void MakeSceneLaunches(BeamEmissionLaunches& launches, PushConstantBeam& pc)
+        {
+            launches = CreateSceneEmissions(CreateCornellScene(), 4096, 4, 1);
+            pc = MakeSceneBeamConstants();
+            pc.maxNumBeams = 1u << 20;
+            pc.maxNumSubBeams = 1u << 22;
+        }
+
+        std::string ValidateSceneBeamInstanceList(SubBeamSplitMode mode)
+        {
+            BeamEmissionLaunches launches;
+            PushConstantBeam pc;
+            MakeSceneLaunches(launches, pc);
+            return ValidateBeamInstanceList(launches, pc, mode);
+        }
+
+        std::string ValidateSamplers()
+        {
+            std::string failures;
+            for (const auto& result : RunSamplerValidation())
+            {
+                if (!result.passed)
+                    failures += FormatSamplerValidationResults({ result });
+            }
+            return failures;
+        }
+
+        // the bounds of the error table of Shaders/util/FastMath.h with a small margin, on every 61st float of the domains
+        std::string ValidateFastMathErrors()
+        {
+            struct Bound
+            {
+                const char* name;
+                double maxUlpError;
+                double maxRelativeError;
+            };
+
+            const Bound bounds[] = {
+                { "fastExp2", 3.0, 1.0 },
+                { "fastLog2", 3.0, 1.0 },
+                { "fastRsqrt", 1e30, 6.6e-4 },
+                { "fastSqrt", 1e30, 6.6e-4 },
+                { "fastExp", 65.0, 1.0 },
+                { "fastLog", 3.5, 1.0 },
+            };
+
+            std::string failures;
+            for (const auto& result : MeasureFastMathErrors(61))
+            {
+                for (const auto& bound : bounds)
+                {
+                    if (result.name == bound.name && (result.maxUlpError > bound.maxUlpError || result.maxRelativeError > bound.maxRelativeError))
+                        failures += FormatFastMathErrorResults({ result });
+                }
+            }
+            return failures;
+        }
+
+        std::string BenchmarkSubBeamSplitter()
+        {
+            BeamEmissionLaunches launches;
+            PushConstantBeam pc;
+            MakeSceneLaunches(launches, pc);
+
+            std::vector<PhotonBeam> beams;
+            for (const auto& emissions : launches)
+            {
+                for (const auto& emission : emissions)
+                    beams.push_back(emission.beam);
+            }
+
+            return FormatSubBeamCostReport(BuildSubBeamCostReport(beams, pc.beamRadius));
+        }
+    }
+
+    std::vector<CpuReferenceSuite> CpuReferenceTestSuites()
+    {
+        return {
+            { "SamplerValidation", ValidateSamplers },
+            { "MicrofacetRejection", ValidateMicrofacetRejection },
+            { "FastMathErrors", ValidateFastMathErrors },
+            { "BeamInstanceList uniform", [] { return ValidateSceneBeamInstanceList(SubBeamSplitMode::Uniform); } },
+            { "BeamInstanceList adaptive", [] { return ValidateSceneBeamInstanceList(SubBeamSplitMode::Adaptive); } },
+            { "BeamCapacityPlanner", ValidateBeamCapacityPlanner },
+            { "BeamSoA", ValidateBeamSoA },
+            { "BeamCulling", ValidateBeamCulling },
+            { "BeamOcclusion", ValidateBeamOcclusion },
+            { "IncrementalBeamList", ValidateIncrementalBeamList },
+            { "ProgressiveBeams", ValidateProgressiveBeams },
+            { "BeamFootprint", ValidateBeamFootprint },
+            { "BeamReservoirGather", ValidateBeamReservoirGather },
+            { "BeamClusterTree", ValidateBeamClusterTree },
+            { "PhotonPlanes", ValidatePhotonPlanes },
+            { "BeamGatherData", ValidateBeamGatherData },
+            { "GridMedium", ValidateGridMedium },
+            { "MediaTable", ValidateMediaTable },
+            { "AtrousDenoiser", ValidateAtrousDenoiser },
+        };
+    }
+
+    std::vector<CpuReferenceSuite> CpuReferenceBenchmarkSuites()
+    {
+        return {
+            { "Rng", [] { return FormatRngBenchmarkResults(RunRngBenchmark()); } },
+            { "Sobol", [] { return FormatSobolBenchmarkResults(RunSobolBenchmark()); } },
+            { "HgTable", [] { return FormatHgTableBenchmarkResults(RunHgTableBenchmark()); } },
+            { "MicrofacetRejection", [] { return FormatMicrofacetRejectionResults(MeasureMicrofacetRejection()); } },
+            { "SamplerValidation", [] { return FormatSamplerValidationResults(RunSamplerValidation()); } },
+            { "FastMath", [] { return FormatFastMathErrorResults(MeasureFastMathErrors(61)) + FormatFastMathBenchmarkResults(RunFastMathBenchmark()); } },
+            { "SubBeamSplitter", BenchmarkSubBeamSplitter },
+            { "AppendBuffer", [] { return FormatAppendBufferBenchmarkResults(RunAppendBufferBenchmark()); } },
+            { "BeamLayout", [] { return FormatBeamLayoutBenchmarkResults(RunBeamLayoutBenchmark()); } },
+            { "BeamCulling", [] { return FormatBeamCullBenchmarkResults(RunBeamCullBenchmark()); } },
+            { "BeamOcclusion", [] { return FormatBeamOcclusionBenchmarkResults(RunBeamOcclusionBenchmark()); } },
+            { "IncrementalBeamList", [] { return FormatIncrementalBeamBenchmarkResults(RunIncrementalBeamBenchmark()); } },
+            { "ProgressiveBeams", [] { return FormatProgressiveConvergenceCurves(RunProgressiveBeamConvergence()); } },
+            { "BeamFootprint", [] { return FormatBeamFootprintBenchmarkResults(RunBeamFootprintBenchmark()); } },
+            { "BeamReservoirGather", [] { return FormatBeamReservoirGatherResults(RunBeamReservoirGatherBenchmark()); } },
+            { "BeamClusterTree", [] { return FormatBeamClusterBenchmarkResults(RunBeamClusterBenchmark()); } },
+            { "PhotonPlanes", [] { return FormatPhotonPlaneBenchmarkResults(RunPhotonPlaneBenchmark()); } },
+            { "BeamGatherData", [] { return FormatBeamGatherDataResults(RunBeamGatherDataBenchmark()); } },
+            { "GridMedium", [] { return FormatGridMediumResults(RunGridMediumBenchmark()); } },
+            { "AtrousDenoiser", [] { return FormatAtrousDenoiserResults(RunAtrousDenoiserBenchmark()); } },
+        };
+    }
+
+    uint32_t RunCpuReferenceSuites(const std::vector<CpuReferenceSuite>& suites, const std::string& filter, bool failOnOutput, std::FILE* out)
+    {
+        uint32_t numRun = 0;
+        uint32_t numFailed = 0;
+
+        for (const auto& suite : suites)
+        {
+            if (!filter.empty() && suite.name.find(filter) == std::string::npos)
+                continue;
+
+            std::fprintf(out, "[ RUN  ] %s\n", suite.name.c_str());
+            std::fflush(out);
+
+            auto start = std::chrono::steady_clock::now();
+            const std::string output = suite.run();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            const bool failed = failOnOutput && !output.empty();
+            std::fputs(output.c_str(), out);
+            std::fprintf(out, "[ %s ] %s (%.1f s)\n", failed ? "FAIL" : " OK ", suite.name.c_str(), seconds);
+            std::fflush(out);
+
+            numRun++;
+            if (failed)
+                numFailed++;
+        }
+
+        std::fprintf(out, "%u suites run, %u failed\n", numRun, numFailed);
+        return numFailed;
+    }
+}
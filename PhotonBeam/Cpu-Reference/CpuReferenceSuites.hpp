@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Runner of the checks and benchmarks of the CPU references, started by PhotonBeam.exe with
+//   --cpu-reference-tests [filter]        every Validate* check, the exit code is the number of failed suites
+//   --cpu-reference-benchmarks [filter]   every Run*Benchmark, printed as the Format* functions give them
+// The filter runs only the suites whose name contains it.
+namespace CpuReference
+{
+    struct CpuReferenceSuite
+    {
+        std::string name;
+
+        // a check returns one line per failure, an empty string when it passed, a benchmark returns its results
+        std::function<std::string()> run;
+    };
+
+    std::vector<CpuReferenceSuite> CpuReferenceTestSuites();
+    std::vector<CpuReferenceSuite> CpuReferenceBenchmarkSuites();
+
+    // Runs the suites whose name contains filter and writes their name, time and output to out.
+    // With failOnOutput every suite returning a non-empty string counts as failed.
+    // Returns the number of failed suites.
+    uint32_t RunCpuReferenceSuites(const std::vector<CpuReferenceSuite>& suites, const std::string& filter, bool failOnOutput, std::FILE* out);
+}
@@ -0,0 +1,104 @@
+
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <algorithm>
+#include <cmath>
+
+// Small HLSL like vector types, so CPU ports of the shaders read like the shader code.
+namespace CpuReference
+{
+    struct float2
+    {
+        float x;
+        float y;
+
+        float2() = default;
+        constexpr float2(float xVal, float yVal) : x(xVal), y(yVal) {}
+    };
+
+    struct float3
+    {
+        float x;
+        float y;
+        float z;
+
+        float3() = default;
+        constexpr float3(float xVal, float yVal, float zVal) : x(xVal), y(yVal), z(zVal) {}
+        constexpr explicit float3(float val) : x(val), y(val), z(val) {}
+        constexpr float3(const DirectX::XMFLOAT3& val) : x(val.x), y(val.y), z(val.z) {}
+
+        DirectX::XMFLOAT3 ToXMFLOAT3() const { return DirectX::XMFLOAT3(x, y, z); }
+
+        float& operator[](size_t index) { return (&x)[index]; }
+        float operator[](size_t index) const { return (&x)[index]; }
+
+        float3& operator+=(const float3& rhs) { x += rhs.x; y += rhs.y; z += rhs.z; return *this; }
+        float3& operator-=(const float3& rhs) { x -= rhs.x; y -= rhs.y; z -= rhs.z; return *this; }
+        float3& operator*=(const float3& rhs) { x *= rhs.x; y *= rhs.y; z *= rhs.z; return *this; }
+        float3& operator*=(float rhs) { x *= rhs; y *= rhs; z *= rhs; return *this; }
+        float3& operator/=(float rhs) { x /= rhs; y /= rhs; z /= rhs; return *this; }
+    };
+
+    inline float3 operator-(const float3& a) { return float3(-a.x, -a.y, -a.z); }
+    inline float3 operator+(const float3& a, const float3& b) { return float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+    inline float3 operator-(const float3& a, const float3& b) { return float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+    inline float3 operator*(const float3& a, const float3& b) { return float3(a.x * b.x, a.y * b.y, a.z * b.z); }
+    inline float3 operator/(const float3& a, const float3& b) { return float3(a.x / b.x, a.y / b.y, a.z / b.z); }
+    inline float3 operator+(const float3& a, float b) { return float3(a.x + b, a.y + b, a.z + b); }
+    inline float3 operator-(const float3& a, float b) { return float3(a.x - b, a.y - b, a.z - b); }
+    inline float3 operator-(float a, const float3& b) { return float3(a - b.x, a - b.y, a - b.z); }
+    inline float3 operator*(const float3& a, float b) { return float3(a.x * b, a.y * b, a.z * b); }
+    inline float3 operator*(float a, const float3& b) { return float3(a * b.x, a * b.y, a * b.z); }
+    inline float3 operator/(const float3& a, float b) { return float3(a.x / b, a.y / b, a.z / b); }
+
+    inline float dot(const float3& a, const float3& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    inline float3 cross(const float3& a, const float3& b)
+    {
+        return float3(
+            a.y * b.z - a.z * b.y,
+            a.z * b.x - a.x * b.z,
+            a.x * b.y - a.y * b.x
+        );
+    }
+
+    inline float length(const float3& a)
+    {
+        return std::sqrt(dot(a, a));
+    }
+
+    inline float3 normalize(const float3& a)
+    {
+        return a / length(a);
+    }
+
+    inline float3 exp(const float3& a)
+    {
+        return float3(std::exp(a.x), std::exp(a.y), std::exp(a.z));
+    }
+
+    inline float3 min(const float3& a, const float3& b)
+    {
+        return float3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+    }
+
+    inline float3 max(const float3& a, const float3& b)
+    {
+        return float3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+    }
+
+    inline float maxComponent(const float3& a)
+    {
+        return std::max(std::max(a.x, a.y), a.z);
+    }
+
+    inline float3 lerp(const float3& a, const float3& b, float t)
+    {
+        return a + (b - a) * t;
+    }
+}
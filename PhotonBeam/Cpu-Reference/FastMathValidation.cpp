@@ -0,0 +1,438 @@
+
+#include "FastMathValidation.hpp"
+#include "ParallelFor.hpp"
+#include "RayTracingSampling.hpp"
+#include "../Shaders/util/FastMath.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // floats mapped to integers in the same order, -0 and +0 both map to 0
+        int64_t OrderedIndex(float x)
+        {
+            uint32_t bits = std::bit_cast<uint32_t>(x);
+            return (bits & 0x80000000u) ? -int64_t(bits & 0x7fffffffu) : int64_t(bits);
+        }
+
+        float FromOrderedIndex(int64_t index)
+        {
+            return index < 0 ? -std::bit_cast<float>(uint32_t(-index)) : std::bit_cast<float>(uint32_t(index));
+        }
+
+        // size of one float ulp at the magnitude of x, denormals included
+        double FloatUlp(double x)
+        {
+            int exponent = std::max(std::ilogb(std::max(std::abs(x), double(FLT_MIN))), -126);
+            return std::ldexp(1.0, exponent - 23);
+        }
+
+        template <class Fast, class Exact>
+        FastMathErrorResult MeasureKernel(
+            const char* name,
+            float domainMin,
+            float domainMax,
+            uint32_t stride,
+            uint32_t numThreads,
+            const Fast& fast,
+            const Exact& exact
+        )
+        {
+            const int64_t first = OrderedIndex(domainMin);
+            const uint64_t count = uint64_t(OrderedIndex(domainMax) - first) / stride + 1;
+
+            std::vector<FastMathErrorResult> threadResults(numThreads);
+
+            ParallelFor(numThreads, count, [&](uint32_t threadIndex, uint64_t begin, uint64_t end)
+            {
+                FastMathErrorResult& result = threadResults[threadIndex];
+
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    float x = FromOrderedIndex(first + int64_t(i * stride));
+                    double reference = exact(double(x));
+                    double error = std::abs(double(fast(x)) - reference);
+
+                    double ulpError = error / FloatUlp(reference);
+                    if (ulpError > result.maxUlpError)
+                    {
+                        result.maxUlpError = ulpError;
+                        result.worstArgument = x;
+                    }
+
+                    if (reference != 0.0)
+                        result.maxRelativeError = std::max(result.maxRelativeError, error / std::abs(reference));
+
+                    result.maxAbsError = std::max(result.maxAbsError, error);
+                }
+            });
+
+            FastMathErrorResult result;
+            result.name = name;
+            result.domainMin = domainMin;
+            result.domainMax = domainMax;
+
+            for (const auto& threadResult : threadResults)
+            {
+                if (threadResult.maxUlpError > result.maxUlpError)
+                {
+                    result.maxUlpError = threadResult.maxUlpError;
+                    result.worstArgument = threadResult.worstArgument;
+                }
+
+                result.maxRelativeError = std::max(result.maxRelativeError, threadResult.maxRelativeError);
+                result.maxAbsError = std::max(result.maxAbsError, threadResult.maxAbsError);
+            }
+
+            return result;
+        }
+
+
+        // float3 versions of the policy functions, as in the HLSL part of FastMath.h
+        template <uint32_t Policy>
+        float3 PolicyExp(const float3& x)
+        {
+            return float3(policyExp(Policy, x.x), policyExp(Policy, x.y), policyExp(Policy, x.z));
+        }
+
+        template <uint32_t Policy>
+        float PolicyLength(const float3& x)
+        {
+            return policySqrt(Policy, dot(x, x));
+        }
+
+        struct GatherConstants
+        {
+            float3 airScatterCoff;
+            float3 airExtinctCoff;
+            float airHGAssymFactor;
+            float beamRadius;
+            float numBeamSources;
+        };
+
+        // inputs of the shading part of BeamAnyHit, once getIntersection() succeeded
+        struct GatherCandidate
+        {
+            float3 rayDirection;
+            float rayDist;
+            float3 beamStart;
+            float3 beamDirection;
+            float3 beamHit;
+            float3 lightColor;
+        };
+
+        // CPU port of the radiance estimate of BeamAnyHit in RayBeamAnyHit.hlsl
+        template <uint32_t Policy>
+        float3 GatherRadiance(const GatherConstants& pc, const GatherCandidate& candidate)
+        {
+            float3 worldPos = candidate.rayDirection * candidate.rayDist;
+            float beamDist = PolicyLength<Policy>(candidate.beamHit - candidate.beamStart);
+
+            float beamRayCosVal = dot(-candidate.rayDirection, candidate.beamDirection);
+            float beamRayAbsSinVal = policySqrt(Policy, std::max(0.0f, 1 - beamRayCosVal * beamRayCosVal));
+
+            float phaseVal = heneyGreenPhaseFunc(beamRayCosVal, pc.airHGAssymFactor);
+
+            float3 radiance = pc.airScatterCoff * PolicyExp<Policy>(-pc.airExtinctCoff * (candidate.rayDist + beamDist)) * phaseVal
+                * candidate.lightColor / pc.numBeamSources / (pc.beamRadius * beamRayAbsSinVal + 0.1e-10f);
+
+            float rayBeamCylinderCenterDist = PolicyLength<Policy>(cross(worldPos - candidate.beamStart, candidate.beamDirection));
+
+            return radiance * policySqrt(Policy, 1.1f - rayBeamCylinderCenterDist / pc.beamRadius);
+        }
+
+        // inputs of the free path sampling of randomScatterOccured
+        struct ScatterCandidate
+        {
+            float rnd;
+            float nextRnd;
+            float nextSeedRatio;
+        };
+
+        struct ScatterResult
+        {
+            float airScatterAt;
+            float3 weight;
+        };
+
+        // CPU port of the free path sampling and transmittance weight of randomScatterOccured in BeamClosestHit.hlsl
+        template <uint32_t Policy>
+        ScatterResult ScatterFreePath(const GatherConstants& pc, uint32_t colorIndex, const ScatterCandidate& candidate)
+        {
+            const float colorExtinctCoff = pc.airExtinctCoff[colorIndex];
+            const float curSeedRatio = 1.0f - candidate.nextSeedRatio;
+
+            ScatterResult result;
+            result.airScatterAt = curSeedRatio * (-policyLog(Policy, 1.0f - candidate.rnd))
+                - candidate.nextSeedRatio * policyLog(Policy, 1.0f - candidate.nextRnd);
+            result.airScatterAt /= colorExtinctCoff;
+
+            result.weight = PolicyExp<Policy>((colorExtinctCoff - pc.airExtinctCoff) * result.airScatterAt);
+            return result;
+        }
+
+        double RelativeDifference(float precise, float fast)
+        {
+            double scale = std::max(std::abs(double(precise)), 1e-30);
+            return std::abs(double(fast) - double(precise)) / scale;
+        }
+
+        double RelativeDifference(const float3& precise, const float3& fast)
+        {
+            return std::max({ RelativeDifference(precise.x, fast.x), RelativeDifference(precise.y, fast.y), RelativeDifference(precise.z, fast.z) });
+        }
+
+        volatile float s_benchmarkSink = 0.0f;
+
+        // best calls per second of settings.numPasses runs of func(i) over [0, count)
+        // the sum of the results is written to a volatile so the calls are not optimized away
+        template <class Func>
+        double MeasureThroughput(const FastMathBenchmarkSettings& settings, uint32_t count, const Func& func)
+        {
+            double bestSeconds = 0.0;
+
+            for (uint32_t pass = 0; pass < settings.numPasses; pass++)
+            {
+                auto start = std::chrono::steady_clock::now();
+
+                float sum = 0.0f;
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    sum += func(i);
+                }
+                s_benchmarkSink = sum;
+
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (pass == 0 || seconds < bestSeconds)
+                    bestSeconds = seconds;
+            }
+
+            return bestSeconds > 0.0 ? double(count) / bestSeconds : 0.0;
+        }
+
+        template <class Precise, class Fast>
+        FastMathBenchmarkResult BenchmarkKernel(
+            const char* name,
+            const FastMathBenchmarkSettings& settings,
+            const std::vector<float>& args,
+            const Precise& precise,
+            const Fast& fast
+        )
+        {
+            FastMathBenchmarkResult result;
+            result.name = name;
+
+            const uint32_t count = uint32_t(args.size());
+            result.preciseCallsPerSecond = MeasureThroughput(settings, count, [&](uint32_t i) { return precise(args[i]); });
+            result.fastCallsPerSecond = MeasureThroughput(settings, count, [&](uint32_t i) { return fast(args[i]); });
+
+            for (float x : args)
+            {
+                result.maxRelativeDifference = std::max(result.maxRelativeDifference, RelativeDifference(precise(x), fast(x)));
+            }
+
+            return result;
+        }
+    }
+
+    std::vector<FastMathErrorResult> MeasureFastMathErrors(uint32_t stride, uint32_t numThreads)
+    {
+        numThreads = ResolveThreadCount(numThreads);
+        stride = std::max(stride, 1u);
+
+        std::vector<FastMathErrorResult> results;
+
+        results.push_back(MeasureKernel("fastExp2", -126.0f, 127.99f, stride, numThreads,
+            [](float x) { return fastExp2(x); }, [](double x) { return std::exp2(x); }));
+
+        results.push_back(MeasureKernel("fastLog2", FLT_MIN, FLT_MAX, stride, numThreads,
+            [](float x) { return fastLog2(x); }, [](double x) { return std::log2(x); }));
+
+        results.push_back(MeasureKernel("fastRsqrt", FLT_MIN, FLT_MAX, stride, numThreads,
+            [](float x) { return fastRsqrt(x); }, [](double x) { return 1.0 / std::sqrt(x); }));
+
+        results.push_back(MeasureKernel("fastSqrt", FLT_MIN, FLT_MAX, stride, numThreads,
+            [](float x) { return fastSqrt(x); }, [](double x) { return std::sqrt(x); }));
+
+        results.push_back(MeasureKernel("fastExp", -87.0f, 88.0f, stride, numThreads,
+            [](float x) { return fastExp(x); }, [](double x) { return std::exp(x); }));
+
+        results.push_back(MeasureKernel("fastLog", FLT_MIN, FLT_MAX, stride, numThreads,
+            [](float x) { return fastLog(x); }, [](double x) { return std::log(x); }));
+
+        return results;
+    }
+
+    std::vector<FastMathBenchmarkResult> RunFastMathBenchmark(const FastMathBenchmarkSettings& settings)
+    {
+        std::mt19937 generator(1234);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        auto randomDirection = [&]()
+        {
+            return uniformSamplingSphereFromUV(float2(unit(generator), unit(generator)));
+        };
+
+        std::vector<FastMathBenchmarkResult> results;
+
+        // kernels alone, over the ranges the shaders use them in
+        {
+            std::vector<float> expArgs(settings.numArguments);
+            std::vector<float> logArgs(settings.numArguments);
+            std::vector<float> sqrtArgs(settings.numArguments);
+
+            for (uint32_t i = 0; i < settings.numArguments; i++)
+            {
+                expArgs[i] = -20.0f * unit(generator);
+                logArgs[i] = 1.0f - unit(generator);
+                sqrtArgs[i] = 100.0f * unit(generator);
+            }
+
+            results.push_back(BenchmarkKernel("exp", settings, expArgs,
+                [](float x) { return policyExp(PHOTONBEAM_MATH_PRECISE, x); }, [](float x) { return policyExp(PHOTONBEAM_MATH_FAST, x); }));
+
+            results.push_back(BenchmarkKernel("log", settings, logArgs,
+                [](float x) { return policyLog(PHOTONBEAM_MATH_PRECISE, x); }, [](float x) { return policyLog(PHOTONBEAM_MATH_FAST, x); }));
+
+            results.push_back(BenchmarkKernel("pow(x, 2.2)", settings, logArgs,
+                [](float x) { return policyPow(PHOTONBEAM_MATH_PRECISE, x, 2.2f); }, [](float x) { return policyPow(PHOTONBEAM_MATH_FAST, x, 2.2f); }));
+
+            results.push_back(BenchmarkKernel("sqrt", settings, sqrtArgs,
+                [](float x) { return policySqrt(PHOTONBEAM_MATH_PRECISE, x); }, [](float x) { return policySqrt(PHOTONBEAM_MATH_FAST, x); }));
+
+            results.push_back(BenchmarkKernel("rsqrt", settings, logArgs,
+                [](float x) { return policyRsqrt(PHOTONBEAM_MATH_PRECISE, x); }, [](float x) { return policyRsqrt(PHOTONBEAM_MATH_FAST, x); }));
+        }
+
+        GatherConstants pc;
+        pc.airScatterCoff = float3(0.03f, 0.04f, 0.05f);
+        pc.airExtinctCoff = float3(0.05f, 0.06f, 0.08f);
+        pc.airHGAssymFactor = 0.3f;
+        pc.beamRadius = 0.1f;
+        pc.numBeamSources = 1024.0f;
+
+        // beam gather, candidates inside the beam cylinder as getIntersection() accepts them
+        {
+            std::vector<GatherCandidate> candidates(settings.numArguments);
+            for (auto& candidate : candidates)
+            {
+                candidate.rayDirection = randomDirection();
+                candidate.rayDist = 20.0f * unit(generator);
+                candidate.beamDirection = randomDirection();
+
+                float3 worldPos = candidate.rayDirection * candidate.rayDist;
+                float3 offset = normalize(cross(candidate.beamDirection, randomDirection())) * (pc.beamRadius * unit(generator));
+                candidate.beamHit = worldPos + offset;
+                candidate.beamStart = candidate.beamHit - candidate.beamDirection * (10.0f * unit(generator));
+                candidate.lightColor = float3(unit(generator), unit(generator), unit(generator));
+            }
+
+            FastMathBenchmarkResult result;
+            result.name = "RayBeamAnyHit gather";
+            result.preciseCallsPerSecond = MeasureThroughput(settings, settings.numArguments,
+                [&](uint32_t i) { return GatherRadiance<PHOTONBEAM_MATH_PRECISE>(pc, candidates[i]).x; });
+            result.fastCallsPerSecond = MeasureThroughput(settings, settings.numArguments,
+                [&](uint32_t i) { return GatherRadiance<PHOTONBEAM_MATH_FAST>(pc, candidates[i]).x; });
+
+            for (const auto& candidate : candidates)
+            {
+                result.maxRelativeDifference = std::max(result.maxRelativeDifference, RelativeDifference(
+                    GatherRadiance<PHOTONBEAM_MATH_PRECISE>(pc, candidate),
+                    GatherRadiance<PHOTONBEAM_MATH_FAST>(pc, candidate)
+                ));
+            }
+
+            results.push_back(result);
+        }
+
+        // free path sampling, with the rnd() values of the 24 bit generators
+        {
+            std::vector<ScatterCandidate> candidates(settings.numArguments);
+            for (auto& candidate : candidates)
+            {
+                candidate.rnd = float(generator() >> 8) / float(1u << 24);
+                candidate.nextRnd = float(generator() >> 8) / float(1u << 24);
+                candidate.nextSeedRatio = unit(generator);
+            }
+
+            const uint32_t colorIndex = 0;
+
+            FastMathBenchmarkResult result;
+            result.name = "BeamClosestHit free path";
+            result.preciseCallsPerSecond = MeasureThroughput(settings, settings.numArguments,
+                [&](uint32_t i) { return ScatterFreePath<PHOTONBEAM_MATH_PRECISE>(pc, colorIndex, candidates[i]).weight.y; });
+            result.fastCallsPerSecond = MeasureThroughput(settings, settings.numArguments,
+                [&](uint32_t i) { return ScatterFreePath<PHOTONBEAM_MATH_FAST>(pc, colorIndex, candidates[i]).weight.y; });
+
+            for (const auto& candidate : candidates)
+            {
+                ScatterResult precise = ScatterFreePath<PHOTONBEAM_MATH_PRECISE>(pc, colorIndex, candidate);
+                ScatterResult fast = ScatterFreePath<PHOTONBEAM_MATH_FAST>(pc, colorIndex, candidate);
+
+                result.maxRelativeDifference = std::max({
+                    result.maxRelativeDifference,
+                    RelativeDifference(precise.airScatterAt, fast.airScatterAt),
+                    RelativeDifference(precise.weight, fast.weight)
+                });
+            }
+
+            results.push_back(result);
+        }
+
+        return results;
+    }
+
+    std::string FormatFastMathErrorResults(const std::vector<FastMathErrorResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-10s [%12.5g, %12.5g]  max %10.2f ulp (at %.9g)  rel %.3g  abs %.3g\n",
+                result.name.c_str(),
+                result.domainMin,
+                result.domainMax,
+                result.maxUlpError,
+                result.worstArgument,
+                result.maxRelativeError,
+                result.maxAbsError
+            );
+            text += line;
+        }
+
+        return text;
+    }
+
+    std::string FormatFastMathBenchmarkResults(const std::vector<FastMathBenchmarkResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-26s precise %9.2f Mcalls/s  fast %9.2f Mcalls/s  x%5.2f  max rel diff %.3g\n",
+                result.name.c_str(),
+                result.preciseCallsPerSecond * 1e-6,
+                result.fastCallsPerSecond * 1e-6,
+                result.preciseCallsPerSecond > 0.0 ? result.fastCallsPerSecond / result.preciseCallsPerSecond : 0.0,
+                result.maxRelativeDifference
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
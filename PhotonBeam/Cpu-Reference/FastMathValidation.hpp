@@ -0,0 +1,63 @@
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Error measurement and benchmark of the kernels in Shaders/util/FastMath.h.
+// The errors are measured against the double precision std functions over every float of the domain of each kernel,
+// the benchmark compares the two math policies on the CPU ports of the shader code that uses them.
+namespace CpuReference
+{
+    struct FastMathErrorResult
+    {
+        std::string name;
+
+        float domainMin = 0.0f;
+        float domainMax = 0.0f;
+
+        // error against the exact result rounded to float
+        double maxUlpError = 0.0;
+        double maxRelativeError = 0.0;
+        double maxAbsError = 0.0;
+
+        // argument giving maxUlpError
+        float worstArgument = 0.0f;
+    };
+
+    struct FastMathBenchmarkSettings
+    {
+        // arguments per pass, generated once before the timing
+        uint32_t numArguments = 1u << 20;
+
+        // the best of the passes is reported
+        uint32_t numPasses = 8;
+    };
+
+    struct FastMathBenchmarkResult
+    {
+        std::string name;
+
+        // calls per second on one thread
+        double preciseCallsPerSecond = 0.0;
+        double fastCallsPerSecond = 0.0;
+
+        // largest relative difference between the outputs of the two policies
+        double maxRelativeDifference = 0.0;
+    };
+
+    // Every float of the domain is tested when stride is 1, every stride-th float otherwise.
+    // numThreads 0 uses std::thread::hardware_concurrency()
+    std::vector<FastMathErrorResult> MeasureFastMathErrors(uint32_t stride = 1, uint32_t numThreads = 0);
+
+    // Single thread throughput of PHOTONBEAM_MATH_PRECISE against PHOTONBEAM_MATH_FAST for
+    //  the kernels alone                   exp, log, pow, sqrt, rsqrt
+    //  the beam gather of RayBeamAnyHit    radiance of one beam candidate once the intersection is found
+    //  the free path of BeamClosestHit     scatter distance and transmittance weight of randomScatterOccured
+    std::vector<FastMathBenchmarkResult> RunFastMathBenchmark(const FastMathBenchmarkSettings& settings = {});
+
+    // one line per result
+    std::string FormatFastMathErrorResults(const std::vector<FastMathErrorResult>& results);
+    std::string FormatFastMathBenchmarkResults(const std::vector<FastMathBenchmarkResult>& results);
+}
@@ -0,0 +1,715 @@
+
+#include "GridMedium.hpp"
+#include "ParallelFor.hpp"
+#include "RayTracingSampling.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // light position and miss length of CreateSceneEmissions()
+        constexpr float c_lightHeight = c_cornellRoomSize * 0.9f;
+        constexpr float c_missBeamLength = 20.0f;
+
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+
+        // a grid over the room of resolution^3 voxels of density(voxel center)
+        template <typename Density>
+        GridMedium CreateRoomGridMedium(uint32_t resolution, float extinctionCoff, const float3& scatterCoff, const Density& density)
+        {
+            const float3 boundsMin(-c_cornellRoomSize);
+            const float3 boundsMax(c_cornellRoomSize);
+            const float voxelSize = 2.0f * c_cornellRoomSize / float(resolution);
+
+            std::vector<float> voxels(size_t(resolution) * resolution * resolution);
+            for (uint32_t z = 0; z < resolution; z++)
+            {
+                for (uint32_t y = 0; y < resolution; y++)
+                {
+                    for (uint32_t x = 0; x < resolution; x++)
+                    {
+                        const float3 center = boundsMin + float3(float(x) + 0.5f, float(y) + 0.5f, float(z) + 0.5f) * voxelSize;
+                        voxels[(size_t(z) * resolution + y) * resolution + x] = density(center);
+                    }
+                }
+            }
+
+            const uint32_t resolutions[3] = { resolution, resolution, resolution };
+            GridMedium medium;
+            medium.Build(boundsMin, boundsMax, resolutions, std::move(voxels), extinctionCoff, scatterCoff);
+            return medium;
+        }
+
+        // a ray from the light of the Cornell scene to its surfaces, downwards as the first beams of the emission
+        GatherRay MakeLightRay(const std::vector<SceneBox>& scene, uint32_t& seed)
+        {
+            GatherRay ray;
+            ray.origin = float3(0.0f, c_lightHeight, 0.0f);
+            ray.direction = uniformSamplingSphere(seed);
+            if (ray.direction.y > 0.0f)
+                ray.direction.y = -ray.direction.y;
+
+            SceneHit hit;
+            ray.tMax = TraceScene(scene, ray.origin, ray.direction, c_rayTMin, c_missBeamLength, hit) ? hit.t : c_missBeamLength;
+            return ray;
+        }
+
+        struct EstimateMean
+        {
+            double mean = 0.0;
+            double standardError = 0.0;
+        };
+
+        template <typename Estimate>
+        EstimateMean MeanOf(uint32_t numSamples, const Estimate& estimate)
+        {
+            double sum = 0.0;
+            double sumSquares = 0.0;
+            for (uint32_t i = 0; i < numSamples; i++)
+            {
+                const double value = estimate(i);
+                sum += value;
+                sumSquares += value * value;
+            }
+
+            EstimateMean result;
+            result.mean = sum / double(numSamples);
+            result.standardError = std::sqrt(std::max(0.0, sumSquares / double(numSamples) - result.mean * result.mean) / double(numSamples));
+            return result;
+        }
+
+        const char* MajorantModeName(MajorantMode mode)
+        {
+            return mode == MajorantMode::Grid ? "grid" : "global";
+        }
+    }
+
+    void GridMedium::Build(
+        const float3& boundsMin,
+        const float3& boundsMax,
+        const uint32_t resolution[3],
+        std::vector<float> density,
+        float extinctionCoff,
+        const float3& scatterCoff,
+        uint32_t majorantCellSize
+    )
+    {
+        m_boundsMin = boundsMin;
+        m_boundsMax = boundsMax;
+        m_density = std::move(density);
+        m_extinctionCoff = extinctionCoff;
+        m_scatterCoff = scatterCoff;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            m_resolution[axis] = std::max(resolution[axis], 1u);
+            m_numCells[axis] = (m_resolution[axis] + majorantCellSize - 1) / majorantCellSize;
+            m_voxelSize[axis] = (boundsMax[axis] - boundsMin[axis]) / float(m_resolution[axis]);
+            m_cellSize[axis] = m_voxelSize[axis] * float(majorantCellSize);
+        }
+
+        // the interpolation in a cell reads the voxels of the cell and the ones next to it
+        m_majorants.assign(size_t(m_numCells[0]) * m_numCells[1] * m_numCells[2], 0.0f);
+        m_maxDensity = 0.0f;
+        uint32_t cell[3];
+        for (cell[2] = 0; cell[2] < m_numCells[2]; cell[2]++)
+        {
+            for (cell[1] = 0; cell[1] < m_numCells[1]; cell[1]++)
+            {
+                for (cell[0] = 0; cell[0] < m_numCells[0]; cell[0]++)
+                {
+                    uint32_t first[3];
+                    uint32_t last[3];
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        first[axis] = std::max(cell[axis] * majorantCellSize, 1u) - 1;
+                        last[axis] = std::min((cell[axis] + 1) * majorantCellSize, m_resolution[axis] - 1);
+                    }
+
+                    float majorant = 0.0f;
+                    for (uint32_t z = first[2]; z <= last[2]; z++)
+                    {
+                        for (uint32_t y = first[1]; y <= last[1]; y++)
+                        {
+                            for (uint32_t x = first[0]; x <= last[0]; x++)
+                                majorant = std::max(majorant, m_density[(size_t(z) * m_resolution[1] + y) * m_resolution[0] + x]);
+                        }
+                    }
+
+                    m_majorants[CellIndex(cell)] = majorant;
+                    m_maxDensity = std::max(m_maxDensity, majorant);
+                }
+            }
+        }
+    }
+
+    float GridMedium::Density(const float3& position) const
+    {
+        uint32_t index0[3];
+        uint32_t index1[3];
+        float fraction[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (position[axis] < m_boundsMin[axis] || position[axis] > m_boundsMax[axis])
+                return 0.0f;
+
+            const float coord = std::min(std::max((position[axis] - m_boundsMin[axis]) / m_voxelSize[axis] - 0.5f, 0.0f), float(m_resolution[axis] - 1));
+            index0[axis] = uint32_t(coord);
+            index1[axis] = std::min(index0[axis] + 1, m_resolution[axis] - 1);
+            fraction[axis] = coord - float(index0[axis]);
+        }
+
+        auto voxel = [&](uint32_t x, uint32_t y, uint32_t z)
+        {
+            return m_density[(size_t(z) * m_resolution[1] + y) * m_resolution[0] + x];
+        };
+
+        const float d00 = voxel(index0[0], index0[1], index0[2]) + (voxel(index1[0], index0[1], index0[2]) - voxel(index0[0], index0[1], index0[2])) * fraction[0];
+        const float d10 = voxel(index0[0], index1[1], index0[2]) + (voxel(index1[0], index1[1], index0[2]) - voxel(index0[0], index1[1], index0[2])) * fraction[0];
+        const float d01 = voxel(index0[0], index0[1], index1[2]) + (voxel(index1[0], index0[1], index1[2]) - voxel(index0[0], index0[1], index1[2])) * fraction[0];
+        const float d11 = voxel(index0[0], index1[1], index1[2]) + (voxel(index1[0], index1[1], index1[2]) - voxel(index0[0], index1[1], index1[2])) * fraction[0];
+
+        const float d0 = d00 + (d10 - d00) * fraction[1];
+        const float d1 = d01 + (d11 - d01) * fraction[1];
+        return d0 + (d1 - d0) * fraction[2];
+    }
+
+    float GridMedium::CellMajorant(const float3& position) const
+    {
+        uint32_t cell[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float coord = (position[axis] - m_boundsMin[axis]) / m_cellSize[axis];
+            cell[axis] = uint32_t(std::min(std::max(coord, 0.0f), float(m_numCells[axis] - 1)));
+        }
+        return m_majorants[CellIndex(cell)];
+    }
+
+    bool SampleGridFreeFlight(
+        const GridMedium& medium,
+        MajorantMode mode,
+        const float3& origin,
+        const float3& direction,
+        float tMax,
+        uint32_t& seed,
+        float& t,
+        MediumTrackingStats& stats
+    )
+    {
+        bool isCollision = false;
+        medium.TraverseMajorants(mode, origin, direction, 0.0f, tMax, [&](float t0, float t1, float majorant)
+        {
+            stats.numCells++;
+            const float invMajorantExtinction = 1.0f / (majorant * medium.ExtinctionCoff());
+
+            float tCurr = t0;
+            while (true)
+            {
+                tCurr -= std::log(1.0f - rnd(seed)) * invMajorantExtinction;
+                if (tCurr >= t1)
+                    return true;
+
+                stats.numDensityLookups++;
+                if (rnd(seed) * majorant < medium.Density(origin + direction * tCurr))
+                {
+                    t = tCurr;
+                    isCollision = true;
+                    return false;
+                }
+            }
+        });
+        return isCollision;
+    }
+
+    float EstimateGridTransmittance(
+        const GridMedium& medium,
+        MajorantMode mode,
+        const float3& origin,
+        const float3& direction,
+        float tMax,
+        uint32_t& seed,
+        MediumTrackingStats& stats
+    )
+    {
+        float transmittance = 1.0f;
+        medium.TraverseMajorants(mode, origin, direction, 0.0f, tMax, [&](float t0, float t1, float majorant)
+        {
+            stats.numCells++;
+            const float invMajorantExtinction = 1.0f / (majorant * medium.ExtinctionCoff());
+            const float invMajorant = 1.0f / majorant;
+
+            float tCurr = t0;
+            while (true)
+            {
+                tCurr -= std::log(1.0f - rnd(seed)) * invMajorantExtinction;
+                if (tCurr >= t1)
+                    return true;
+
+                stats.numDensityLookups++;
+                transmittance *= 1.0f - medium.Density(origin + direction * tCurr) * invMajorant;
+                if (transmittance <= 0.0f)
+                    return false;
+            }
+        });
+        return transmittance;
+    }
+
+    float IntegrateGridDensity(const GridMedium& medium, const float3& origin, const float3& direction, float tMax, uint32_t numSteps)
+    {
+        const float step = tMax / float(numSteps);
+        double sum = 0.0;
+        for (uint32_t i = 0; i < numSteps; i++)
+            sum += medium.Density(origin + direction * ((float(i) + 0.5f) * step));
+        return float(sum * step);
+    }
+
+    GridMedium CreateFogGridMedium(uint32_t resolution, float extinctionCoff, const float3& scatterCoff)
+    {
+        return CreateRoomGridMedium(resolution, extinctionCoff, scatterCoff, [](const float3& position)
+        {
+            return 0.6f + 0.4f * std::sin(1.3f * position.x) * std::sin(0.9f * position.y + 1.0f) * std::sin(1.1f * position.z + 2.0f);
+        });
+    }
+
+    GridMedium CreateSmokeGridMedium(uint32_t resolution, float extinctionCoff, const float3& scatterCoff)
+    {
+        struct Plume
+        {
+            float3 center;
+            float radius;
+        };
+
+        // above the tall block, above the short block and under the light
+        const Plume plumes[] = {
+            { float3(-2.0f, 2.8f, 1.75f), 1.2f },
+            { float3(2.0f, -0.8f, -1.75f), 1.2f },
+            { float3(0.0f, 2.5f, 0.0f), 0.8f },
+        };
+
+        return CreateRoomGridMedium(resolution, extinctionCoff, scatterCoff, [&](const float3& position)
+        {
+            float density = 0.0f;
+            for (const auto& plume : plumes)
+            {
+                const float3 offset = position - plume.center;
+                const float falloff = std::max(0.0f, 1.0f - dot(offset, offset) / (plume.radius * plume.radius));
+                density += 4.0f * falloff * falloff;
+            }
+            return density;
+        });
+    }
+
+    BeamEmissionLaunches CreateGridMediumEmissions(
+        const std::vector<SceneBox>& scene,
+        const GridMedium& medium,
+        float hgAssymFactor,
+        uint32_t numLaunches,
+        uint32_t maxBeamsPerLaunch,
+        uint32_t seed
+    )
+    {
+        // the density cancels out of the albedo
+        const float3 albedo = medium.ExtinctionCoff() > 0.0f ? medium.ScatterCoff() / medium.ExtinctionCoff() : float3(0.0f);
+        const float survival = maxComponent(albedo);
+
+        BeamEmissionLaunches launches(numLaunches);
+        for (uint32_t launch = 0; launch < numLaunches; launch++)
+        {
+            uint32_t launchSeed = rngInitSeed(launch, seed);
+            std::vector<BeamEmission>& emissions = launches[launch];
+
+            const uint32_t numBeams = 1 + std::min(uint32_t(rnd(launchSeed) * float(maxBeamsPerLaunch)), std::max(maxBeamsPerLaunch, 1u) - 1);
+            float3 position = float3(0.0f, c_lightHeight, 0.0f);
+            float3 direction = uniformSamplingSphere(launchSeed);
+            if (direction.y > 0.0f)
+                direction.y = -direction.y;
+            float3 lightColor(1.0f);
+
+            for (uint32_t i = 0; i < numBeams; i++)
+            {
+                BeamEmission emission = {};
+                emission.direction = direction;
+                emission.airSubBeams = true;
+                emission.beam.startPos = position.ToXMFLOAT3();
+                emission.beam.lightColor = lightColor.ToXMFLOAT3();
+                emission.beam.hitInstanceID = -1;
+
+                SceneHit hit;
+                const bool isSurfaceHit = TraceScene(scene, position, direction, c_rayTMin, c_missBeamLength, hit);
+
+                MediumTrackingStats stats;
+                float scatterAt;
+                if (SampleGridFreeFlight(medium, MajorantMode::Grid, position, direction, isSurfaceHit ? hit.t : c_missBeamLength, launchSeed, scatterAt, stats))
+                {
+                    position = position + direction * scatterAt;
+                    emission.beam.endPos = position.ToXMFLOAT3();
+                    emissions.push_back(emission);
+
+                    // roulette of the albedo, then the phase function
+                    if (rnd(launchSeed) >= survival)
+                        break;
+
+                    lightColor = lightColor * albedo / survival;
+                    direction = heneyGreenPhaseFuncSampling(launchSeed, direction, hgAssymFactor);
+                    continue;
+                }
+
+                if (!isSurfaceHit)
+                {
+                    emission.beam.endPos = (position + direction * c_missBeamLength).ToXMFLOAT3();
+                    emissions.push_back(emission);
+                    break;
+                }
+
+                emission.hitNormal = hit.normal;
+                emission.surfacePhoton = true;
+                emission.beam.hitInstanceID = hit.boxIndex;
+                position = position + direction * hit.t;
+                emission.beam.endPos = position.ToXMFLOAT3();
+                emissions.push_back(emission);
+
+                // diffuse bounce off the surface
+                direction = uniformSamplingSphere(launchSeed);
+                if (dot(direction, hit.normal) < 0.0f)
+                    direction = -direction;
+                position = position + hit.normal * c_rayTMin;
+            }
+        }
+
+        return launches;
+    }
+
+    bool GatherGridBeamRadiance(
+        const GridMedium& medium,
+        MajorantMode mode,
+        const BeamGatherConstants& pc,
+        const GatherRay& ray,
+        const GatherBeam& beam,
+        uint32_t& seed,
+        float3& radiance,
+        MediumTrackingStats& stats
+    )
+    {
+        float tCurr;
+        float3 beamHit;
+        if (!IntersectGatherBeam(pc, ray, beam, tCurr, beamHit))
+            return false;
+
+        const float3 worldPos = ray.origin + ray.direction * tCurr;
+        const float density = medium.Density(worldPos);
+        radiance = float3(0.0f);
+        if (density <= 0.0f)
+            return true;
+
+        const float beamDist = length(beamHit - beam.startPos);
+        float transmittance = EstimateGridTransmittance(medium, mode, ray.origin, ray.direction, tCurr, seed, stats);
+        if (transmittance > 0.0f)
+            transmittance *= EstimateGridTransmittance(medium, mode, beam.startPos, beam.direction, beamDist, seed, stats);
+
+        const float beamRadius = getGatherBeamRadius(beam.radius, pc.beamRadius);
+        const float beamRayCosVal = dot(-ray.direction, beam.direction);
+        const float beamRayAbsSinVal = std::sqrt(std::max(0.0f, 1 - beamRayCosVal * beamRayCosVal));
+        const float phaseVal = heneyGreenPhaseFunc(beamRayCosVal, pc.airHGAssymFactor);
+
+        radiance = medium.ScatterCoff() * (density * transmittance * phaseVal)
+            * beam.lightColor / pc.numBeamSources / (beamRadius * beamRayAbsSinVal + 0.1e-10f);
+
+        const float rayBeamCylinderCenterDist = length(cross(worldPos - beam.startPos, beam.direction));
+        radiance = radiance * std::sqrt(std::max(0.0f, 1.1f - rayBeamCylinderCenterDist / beamRadius));
+        return true;
+    }
+
+    std::string ValidateGridMedium()
+    {
+        std::string failures;
+
+        const float3 scatterCoff(0.25f, 0.2f, 0.15f);
+        const GridMedium smoke = CreateSmokeGridMedium(64, 0.3f, scatterCoff);
+        const GridMedium fog = CreateFogGridMedium(64, 0.3f, scatterCoff);
+        const std::vector<SceneBox> scene = CreateCornellScene();
+
+        // the majorants bound the density, at random points of the room
+        {
+            uint32_t seed = rngInitSeed(0, 1);
+            bool isBounded = true;
+            for (uint32_t i = 0; i < 100000; i++)
+            {
+                const float3 position = (float3(rnd(seed), rnd(seed), rnd(seed)) * 2.0f - 1.0f) * c_cornellRoomSize;
+                isBounded = isBounded && smoke.Density(position) <= smoke.CellMajorant(position) * (1.0f + 1e-6f)
+                    && fog.Density(position) <= fog.CellMajorant(position) * (1.0f + 1e-6f);
+            }
+            Check(isBounded, "a majorant cell is below the density in it", failures);
+        }
+
+        // the walk of the fog, where no cell is empty, covers the ray in the box without gaps
+        {
+            uint32_t seed = rngInitSeed(1, 1);
+            bool isCovering = true;
+            for (uint32_t i = 0; i < 1000; i++)
+            {
+                const float3 origin = float3(rnd(seed), rnd(seed), rnd(seed)) * 24.0f - 12.0f;
+                const float3 direction = uniformSamplingSphere(seed);
+
+                float tEnd = -1.0f;
+                float covered = 0.0f;
+                fog.TraverseMajorants(MajorantMode::Grid, origin, direction, 0.0f, 30.0f, [&](float t0, float t1, float)
+                {
+                    isCovering = isCovering && (tEnd < 0.0f || std::abs(t0 - tEnd) < 1e-4f) && t0 < t1;
+                    covered += t1 - t0;
+                    tEnd = t1;
+                    return true;
+                });
+
+                float globalCovered = 0.0f;
+                fog.TraverseMajorants(MajorantMode::Global, origin, direction, 0.0f, 30.0f, [&](float t0, float t1, float)
+                {
+                    globalCovered += t1 - t0;
+                    return true;
+                });
+                isCovering = isCovering && std::abs(covered - globalCovered) < 1e-3f;
+            }
+            Check(isCovering, "the walk of the majorant cells does not cover the ray in the box", failures);
+        }
+
+        // ratio and delta tracking against the transmittance of the density integral, through the smoke and the fog
+        {
+            const uint32_t numSamples = 20000;
+            bool isRatioMatching = true;
+            bool isDeltaMatching = true;
+            uint64_t lookups[2] = {};
+
+            for (const GridMedium* medium : { &smoke, &fog })
+            {
+                uint32_t raySeed = rngInitSeed(2, 1);
+                for (uint32_t rayIndex = 0; rayIndex < 8; rayIndex++)
+                {
+                    const GatherRay ray = MakeLightRay(scene, raySeed);
+                    const float transmittance = std::exp(-medium->ExtinctionCoff() * IntegrateGridDensity(*medium, ray.origin, ray.direction, ray.tMax, 8192));
+
+                    for (MajorantMode mode : { MajorantMode::Global, MajorantMode::Grid })
+                    {
+                        MediumTrackingStats stats;
+                        const EstimateMean ratio = MeanOf(numSamples, [&](uint32_t i)
+                        {
+                            uint32_t seed = rngInitSeed(i, rayIndex * 2 + uint32_t(mode));
+                            return EstimateGridTransmittance(*medium, mode, ray.origin, ray.direction, ray.tMax, seed, stats);
+                        });
+                        isRatioMatching = isRatioMatching && std::abs(ratio.mean - transmittance) < 4.0 * ratio.standardError + 1e-4;
+
+                        const EstimateMean escape = MeanOf(numSamples, [&](uint32_t i)
+                        {
+                            uint32_t seed = rngInitSeed(i, 100 + rayIndex * 2 + uint32_t(mode));
+                            float t;
+                            return SampleGridFreeFlight(*medium, mode, ray.origin, ray.direction, ray.tMax, seed, t, stats) ? 0.0 : 1.0;
+                        });
+                        const double escapeError = std::sqrt(transmittance * (1.0 - transmittance) / double(numSamples));
+                        isDeltaMatching = isDeltaMatching && std::abs(escape.mean - transmittance) < 4.0 * escapeError + 1e-4;
+
+                        if (medium == &smoke)
+                            lookups[uint32_t(mode)] += stats.numDensityLookups;
+                    }
+                }
+            }
+
+            Check(isRatioMatching, "ratio tracking does not average to the transmittance", failures);
+            Check(isDeltaMatching, "delta tracking does not escape with the probability of the transmittance", failures);
+            Check(lookups[uint32_t(MajorantMode::Grid)] * 2 < lookups[uint32_t(MajorantMode::Global)], "the majorant cells do not halve the density lookups in the smoke", failures);
+        }
+
+        // beams end in the fog as often as the transmittance to their surfaces says
+        {
+            const uint32_t numLaunches = 4096;
+            const BeamEmissionLaunches launches = CreateGridMediumEmissions(scene, fog, 0.3f, numLaunches, 4, 7);
+
+            double expectedCollisions = 0.0;
+            double variance = 0.0;
+            uint32_t numCollisions = 0;
+            bool isEnding = true;
+            for (const auto& emissions : launches)
+            {
+                const BeamEmission& emission = emissions.front();
+                const float3 startPos = emission.beam.startPos;
+                SceneHit hit;
+                const float tSurface = TraceScene(scene, startPos, emission.direction, c_rayTMin, c_missBeamLength, hit) ? hit.t : c_missBeamLength;
+                const double transmittance = std::exp(-fog.ExtinctionCoff() * IntegrateGridDensity(fog, startPos, emission.direction, tSurface, 1024));
+
+                expectedCollisions += 1.0 - transmittance;
+                variance += transmittance * (1.0 - transmittance);
+                numCollisions += length(float3(emission.beam.endPos) - startPos) < tSurface * 0.999f ? 1 : 0;
+
+                // a beam ending in the medium ends at a point of density, the next one starts there
+                for (size_t i = 0; i + 1 < emissions.size(); i++)
+                {
+                    if (!emissions[i].surfacePhoton)
+                        isEnding = isEnding && fog.Density(emissions[i].beam.endPos) > 0.0f
+                            && length(float3(emissions[i + 1].beam.startPos) - float3(emissions[i].beam.endPos)) < 1e-5f;
+                }
+            }
+
+            Check(std::abs(double(numCollisions) - expectedCollisions) < 4.0 * std::sqrt(variance) + 1.0, "the emission does not scatter in the fog as often as its transmittance says", failures);
+            Check(isEnding, "a beam scattered in the fog does not continue from its end", failures);
+        }
+
+        // a grid of density 1 around the whole scene is the homogeneous air of the gather
+        {
+            const BeamGatherConstants constants = MakeBeamGatherConstants(MakeSceneRayConstants(float3(0.0f, 0.0f, -14.0f), float3(0.0f), 0.8f, 1.0f, 64));
+            const uint32_t resolutions[3] = { 4, 4, 4 };
+            GridMedium air;
+            air.Build(float3(-20.0f), float3(20.0f), resolutions, std::vector<float>(64, 1.0f), constants.airExtinctCoff.x, constants.airScatterCoff);
+
+            GatherRay ray;
+            ray.origin = float3(0.0f, 0.0f, -14.0f);
+            ray.tMax = 19.0f;
+
+            GatherBeam beam;
+            beam.startPos = float3(-4.0f, 4.5f, 1.0f);
+            beam.lightColor = float3(1.0f, 0.8f, 0.6f);
+            beam.radius = 0.0f;
+
+            const float3 beamEnds[] = { float3(4.0f, -5.0f, 2.0f), float3(0.1f, -3.0f, 1.5f), float3(2.0f, 0.0f, -4.0f) };
+            bool isMatching = true;
+            uint32_t numHits = 0;
+            for (const float3& beamEnd : beamEnds)
+            {
+                beam.length = length(beamEnd - float3(beam.startPos));
+                beam.direction = normalize(beamEnd - float3(beam.startPos));
+
+                // aimed at the middle of the beam
+                ray.direction = normalize(float3(beam.startPos) + beam.direction * (beam.length * 0.5f) - ray.origin);
+
+                float3 expected;
+                if (!GatherBeamRadiance(constants, ray, beam, expected))
+                    continue;
+                numHits++;
+
+                MediumTrackingStats stats;
+                const EstimateMean estimate = MeanOf(40000, [&](uint32_t i)
+                {
+                    uint32_t seed = rngInitSeed(i, 17);
+                    float3 radiance;
+                    GatherGridBeamRadiance(air, MajorantMode::Grid, constants, ray, beam, seed, radiance, stats);
+                    return double(radiance.x);
+                });
+                isMatching = isMatching && std::abs(estimate.mean - expected.x) < 4.0 * estimate.standardError + 1e-6 * expected.x;
+            }
+
+            Check(numHits == std::size(beamEnds), "a test ray misses its beam", failures);
+            Check(isMatching, "the gather of a grid of density 1 does not average to the homogeneous gather", failures);
+        }
+
+        return failures;
+    }
+
+    std::vector<GridMediumBenchmarkResult> RunGridMediumBenchmark(const GridMediumBenchmarkSettings& settings)
+    {
+        const uint32_t numThreads = ResolveThreadCount(settings.numThreads);
+        const std::vector<SceneBox> scene = CreateCornellScene();
+        const float3 scatterCoff = float3(settings.extinctionCoff * 0.8f);
+
+        struct NamedGrid
+        {
+            const char* name;
+            GridMedium medium;
+        };
+        const NamedGrid grids[] = {
+            { "smoke", CreateSmokeGridMedium(settings.resolution, settings.extinctionCoff, scatterCoff) },
+            { "fog", CreateFogGridMedium(settings.resolution, settings.extinctionCoff, scatterCoff) },
+        };
+
+        std::vector<GatherRay> rays(settings.numSamples);
+        uint32_t raySeed = rngInitSeed(0, settings.seed);
+        for (auto& ray : rays)
+            ray = MakeLightRay(scene, raySeed);
+
+        std::vector<GridMediumBenchmarkResult> results;
+        for (const NamedGrid& grid : grids)
+        {
+            for (uint32_t isRatio = 0; isRatio < 2; isRatio++)
+            {
+                for (MajorantMode mode : { MajorantMode::Global, MajorantMode::Grid })
+                {
+                    std::vector<MediumTrackingStats> threadStats(numThreads);
+                    std::vector<double> threadSums(numThreads, 0.0);
+
+                    const auto start = std::chrono::steady_clock::now();
+                    ParallelFor(numThreads, rays.size(), [&](uint32_t threadIndex, uint64_t begin, uint64_t end)
+                    {
+                        MediumTrackingStats stats;
+                        double sum = 0.0;
+                        for (uint64_t i = begin; i < end; i++)
+                        {
+                            const GatherRay& ray = rays[i];
+                            uint32_t seed = rngInitSeed(uint32_t(i), settings.seed + 1);
+                            if (isRatio)
+                            {
+                                sum += EstimateGridTransmittance(grid.medium, mode, ray.origin, ray.direction, ray.tMax, seed, stats);
+                            }
+                            else
+                            {
+                                float t;
+                                sum += SampleGridFreeFlight(grid.medium, mode, ray.origin, ray.direction, ray.tMax, seed, t, stats) ? 1.0 : 0.0;
+                            }
+                        }
+                        threadStats[threadIndex] = stats;
+                        threadSums[threadIndex] = sum;
+                    });
+                    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                    GridMediumBenchmarkResult result;
+                    result.grid = grid.name;
+                    result.mode = mode;
+                    result.estimator = isRatio ? "transmittance" : "free flight";
+                    result.samplesPerSecond = seconds > 0.0 ? double(rays.size()) / seconds : 0.0;
+                    for (uint32_t thread = 0; thread < numThreads; thread++)
+                    {
+                        result.cells += double(threadStats[thread].numCells);
+                        result.densityLookups += double(threadStats[thread].numDensityLookups);
+                        result.mean += threadSums[thread];
+                    }
+                    result.cells /= double(rays.size());
+                    result.densityLookups /= double(rays.size());
+                    result.mean /= double(rays.size());
+                    results.push_back(result);
+                }
+            }
+        }
+
+        return results;
+    }
+
+    std::string FormatGridMediumResults(const std::vector<GridMediumBenchmarkResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-6s %-14s %-7s %7.2f M samples/s  per sample: cells %6.2f  density lookups %6.2f  %s %.4f\n",
+                result.grid.c_str(),
+                result.estimator.c_str(),
+                MajorantModeName(result.mode),
+                result.samplesPerSecond * 1e-6,
+                result.cells,
+                result.densityLookups,
+                result.estimator == "free flight" ? "collisions" : "mean",
+                result.mean
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
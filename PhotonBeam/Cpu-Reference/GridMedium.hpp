@@ -0,0 +1,277 @@
+#pragma once
+
+#include "CpuVector.hpp"
+#include "BeamGather.hpp"
+#include "BeamInstanceList.hpp"
+#include "CornellScene.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Heterogeneous medium of a density grid, for localized smoke instead of the one fog of the push constants.
+//
+// randomScatterOccured() of BeamClosestHit.hlsl samples the free path of the homogeneous air in closed form. The grid
+// medium has the extinction density(x) * extinctionCoff and the scattering density(x) * scatterCoff, the density
+// trilinear between the voxel centers of a grid over a box and 0 outside of it. Its free paths are sampled with delta
+// tracking and its transmittance estimated with ratio tracking, both against a majorant of the density:
+//   Grid     the super-grid of cells of majorantCellSize^3 voxels, every cell storing the largest density the
+//            interpolation reaches in it. A 3D DDA walks the cells along the ray, skips the cells of majorant 0 and
+//            restarts the exponential steps at every cell boundary, as the exponential is memoryless.
+//   Global   the largest density of the grid over the whole box, the reference of the benchmark
+//
+// The extinction is gray and the scattering per channel, a real collision scatters with the probability of the
+// largest albedo channel and reweights the others to it, as the roulette of randomScatterOccured() does.
+namespace CpuReference
+{
+    enum class MajorantMode
+    {
+        Global,
+        Grid,
+    };
+
+    struct MediumTrackingStats
+    {
+        // majorant cells the rays crossed with a majorant above 0
+        uint64_t numCells = 0;
+
+        // tentative collisions, every one reads the density
+        uint64_t numDensityLookups = 0;
+    };
+
+    class GridMedium
+    {
+    public:
+        // density holds resolution[0] * resolution[1] * resolution[2] voxels, x fastest
+        void Build(
+            const float3& boundsMin,
+            const float3& boundsMax,
+            const uint32_t resolution[3],
+            std::vector<float> density,
+            float extinctionCoff,
+            const float3& scatterCoff,
+            uint32_t majorantCellSize = 8
+        );
+
+        // trilinear density at position, 0 outside the box
+        float Density(const float3& position) const;
+
+        float ExtinctionCoff() const { return m_extinctionCoff; }
+        const float3& ScatterCoff() const { return m_scatterCoff; }
+        float MaxDensity() const { return m_maxDensity; }
+
+        const float3& BoundsMin() const { return m_boundsMin; }
+        const float3& BoundsMax() const { return m_boundsMax; }
+
+        // the majorant density of the cell holding position, for a position in the box
+        float CellMajorant(const float3& position) const;
+
+        // Calls visit(t0, t1, majorant) for the intervals of [tMin, tMax] of the ray in the box, front to back, as
+        // one interval of MaxDensity() or the majorant cells it crosses. visit returns false to stop the walk.
+        template <typename Visit>
+        void TraverseMajorants(MajorantMode mode, const float3& origin, const float3& direction, float tMin, float tMax, const Visit& visit) const;
+
+    private:
+        uint32_t CellIndex(const uint32_t cell[3]) const { return (cell[2] * m_numCells[1] + cell[1]) * m_numCells[0] + cell[0]; }
+
+        float3 m_boundsMin;
+        float3 m_boundsMax;
+        float3 m_voxelSize;
+        float3 m_cellSize;
+        uint32_t m_resolution[3] = {};
+        uint32_t m_numCells[3] = {};
+
+        std::vector<float> m_density;
+        std::vector<float> m_majorants;
+        float m_maxDensity = 0.0f;
+
+        float m_extinctionCoff = 0.0f;
+        float3 m_scatterCoff;
+    };
+
+    template <typename Visit>
+    void GridMedium::TraverseMajorants(MajorantMode mode, const float3& origin, const float3& direction, float tMin, float tMax, const Visit& visit) const
+    {
+        // the ray in the box
+        float tEnter = tMin;
+        float tExit = tMax;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float invDirection = 1.0f / direction[axis];
+            float t0 = (m_boundsMin[axis] - origin[axis]) * invDirection;
+            float t1 = (m_boundsMax[axis] - origin[axis]) * invDirection;
+            if (t0 > t1)
+                std::swap(t0, t1);
+
+            tEnter = std::max(tEnter, t0);
+            tExit = std::min(tExit, t1);
+        }
+        if (!(tEnter < tExit) || m_maxDensity <= 0.0f)
+            return;
+
+        if (mode == MajorantMode::Global)
+        {
+            visit(tEnter, tExit, m_maxDensity);
+            return;
+        }
+
+        // Amanatides and Woo over the majorant cells, from the cell of the entry point
+        const float3 entry = origin + direction * tEnter;
+        uint32_t cell[3];
+        int32_t step[3];
+        float tNext[3];
+        float tDelta[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float coord = (entry[axis] - m_boundsMin[axis]) / m_cellSize[axis];
+            cell[axis] = uint32_t(std::min(std::max(coord, 0.0f), float(m_numCells[axis] - 1)));
+
+            if (direction[axis] > 0.0f)
+            {
+                step[axis] = 1;
+                tNext[axis] = tEnter + (m_boundsMin[axis] + float(cell[axis] + 1) * m_cellSize[axis] - entry[axis]) / direction[axis];
+                tDelta[axis] = m_cellSize[axis] / direction[axis];
+            }
+            else if (direction[axis] < 0.0f)
+            {
+                step[axis] = -1;
+                tNext[axis] = tEnter + (m_boundsMin[axis] + float(cell[axis]) * m_cellSize[axis] - entry[axis]) / direction[axis];
+                tDelta[axis] = -m_cellSize[axis] / direction[axis];
+            }
+            else
+            {
+                step[axis] = 0;
+                tNext[axis] = tExit;
+                tDelta[axis] = 0.0f;
+            }
+        }
+
+        float t = tEnter;
+        while (t < tExit)
+        {
+            const int axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+            const float tCellExit = std::min(tNext[axis], tExit);
+
+            const float majorant = m_majorants[CellIndex(cell)];
+            if (majorant > 0.0f && t < tCellExit && !visit(t, tCellExit, majorant))
+                return;
+
+            t = tCellExit;
+            if ((step[axis] < 0 && cell[axis] == 0) || (step[axis] > 0 && cell[axis] + 1 >= m_numCells[axis]))
+                return;
+
+            cell[axis] += step[axis];
+            tNext[axis] += tDelta[axis];
+        }
+    }
+
+    // Delta tracking of the free path along the ray within [0, tMax], returns false when the ray leaves it first.
+    bool SampleGridFreeFlight(
+        const GridMedium& medium,
+        MajorantMode mode,
+        const float3& origin,
+        const float3& direction,
+        float tMax,
+        uint32_t& seed,
+        float& t,
+        MediumTrackingStats& stats
+    );
+
+    // Ratio tracking estimate of the transmittance along the ray over [0, tMax].
+    float EstimateGridTransmittance(
+        const GridMedium& medium,
+        MajorantMode mode,
+        const float3& origin,
+        const float3& direction,
+        float tMax,
+        uint32_t& seed,
+        MediumTrackingStats& stats
+    );
+
+    // integral of the density along the ray over [0, tMax], midpoint rule of numSteps steps
+    float IntegrateGridDensity(const GridMedium& medium, const float3& origin, const float3& direction, float tMax, uint32_t numSteps);
+
+    // The room of the Cornell scene filled with fog, the density between 0.2 and 1 everywhere.
+    GridMedium CreateFogGridMedium(uint32_t resolution, float extinctionCoff, const float3& scatterCoff);
+
+    // Smoke plumes of peak density 4 over the blocks of the Cornell scene, the rest of the room empty.
+    GridMedium CreateSmokeGridMedium(uint32_t resolution, float extinctionCoff, const float3& scatterCoff);
+
+    // CreateSceneEmissions() through the medium. Every beam samples its free path with delta tracking. A real
+    // collision before the surface ends the beam there, without a surface photon, and the launch goes on in a
+    // Henyey-Greenstein direction after the roulette of the albedo, which carries the weight in the light color.
+    // The launches draw from rngInitSeed(launch, seed).
+    BeamEmissionLaunches CreateGridMediumEmissions(
+        const std::vector<SceneBox>& scene,
+        const GridMedium& medium,
+        float hgAssymFactor,
+        uint32_t numLaunches,
+        uint32_t maxBeamsPerLaunch,
+        uint32_t seed
+    );
+
+    // GatherBeamHitRadiance() in the medium, the scattering of the density at the hit and the ratio tracking
+    // transmittance along the ray to the hit and along the beam to the beam point, returns false when the ray misses
+    // the beam. pc gives the phase function, the radius and the number of beam sources, not the medium.
+    bool GatherGridBeamRadiance(
+        const GridMedium& medium,
+        MajorantMode mode,
+        const BeamGatherConstants& pc,
+        const GatherRay& ray,
+        const GatherBeam& beam,
+        uint32_t& seed,
+        float3& radiance,
+        MediumTrackingStats& stats
+    );
+
+    // Checks
+    //  that the majorant cells bound the density, and that the walk covers the ray in the box once
+    //  that ratio tracking averages to the transmittance of the density integral, and delta tracking collides as often
+    //  that the grid majorants read fewer densities than the global one in the smoke
+    //  that the emission ends beams in the medium as often as the transmittance says
+    //  that the gather in a grid of density 1 averages to GatherBeamRadiance() of the same coefficients
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidateGridMedium();
+
+    struct GridMediumBenchmarkSettings
+    {
+        uint32_t resolution = 64;
+        float extinctionCoff = 0.3f;
+
+        // free flights and transmittance estimates of every grid, mode and estimator
+        uint32_t numSamples = 1u << 18;
+
+        uint32_t seed = 1;
+
+        // numThreads 0 uses std::thread::hardware_concurrency()
+        uint32_t numThreads = 0;
+    };
+
+    struct GridMediumBenchmarkResult
+    {
+        // "smoke" or "fog"
+        std::string grid;
+        MajorantMode mode = MajorantMode::Grid;
+
+        // "free flight" for delta tracking, "transmittance" for ratio tracking
+        std::string estimator;
+
+        double samplesPerSecond = 0.0;
+
+        // per sample
+        double cells = 0.0;
+        double densityLookups = 0.0;
+
+        // fraction of the free flights colliding, or the mean transmittance
+        double mean = 0.0;
+    };
+
+    // Rays from the light of the Cornell scene to its surfaces, through the smoke, then through the fog.
+    std::vector<GridMediumBenchmarkResult> RunGridMediumBenchmark(const GridMediumBenchmarkSettings& settings = {});
+
+    // one line per result
+    std::string FormatGridMediumResults(const std::vector<GridMediumBenchmarkResult>& results);
+}
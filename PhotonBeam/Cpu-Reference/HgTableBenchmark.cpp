@@ -0,0 +1,114 @@
+#include "HgTableBenchmark.hpp"
+#include "RayTracingSampling.hpp"
+#include "../Shaders/util/HenyeyGreensteinTable.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+namespace CpuReference
+{
+    namespace
+    {
+        volatile float s_benchmarkSink = 0.0f;
+
+        // best calls per second of settings.numPasses runs of func(x) over the arguments
+        // the sum of the results is written to a volatile so the calls are not optimized away
+        template <class Func>
+        double MeasureThroughput(const HgTableBenchmarkSettings& settings, const std::vector<float>& args, const Func& func)
+        {
+            double bestSeconds = 0.0;
+
+            for (uint32_t pass = 0; pass < settings.numPasses; pass++)
+            {
+                auto start = std::chrono::steady_clock::now();
+
+                float sum = 0.0f;
+                for (float x : args)
+                {
+                    sum += func(x);
+                }
+                s_benchmarkSink = sum;
+
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (pass == 0 || seconds < bestSeconds)
+                    bestSeconds = seconds;
+            }
+
+            return bestSeconds > 0.0 ? double(args.size()) / bestSeconds : 0.0;
+        }
+    }
+
+    std::vector<HgTableBenchmarkResult> RunHgTableBenchmark(const HgTableBenchmarkSettings& settings)
+    {
+        std::vector<float> table(HG_TABLE_SIZE);
+        hgTableBuild(table.data());
+
+        std::mt19937 generator(1234);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        std::vector<float> uArgs(settings.numArguments);
+        std::vector<float> cosArgs(settings.numArguments);
+        for (uint32_t i = 0; i < settings.numArguments; i++)
+        {
+            uArgs[i] = unit(generator);
+            cosArgs[i] = 2.0f * unit(generator) - 1.0f;
+        }
+
+        std::vector<HgTableBenchmarkResult> results;
+        for (float g : settings.hgAssymFactors)
+        {
+            HgTableBenchmarkResult result;
+            result.g = g;
+
+            result.tableSamplesPerSecond = MeasureThroughput(settings, uArgs, [&](float u) { return hgTableSampleCosTheta(table.data(), u, g); });
+            result.analyticSamplesPerSecond = MeasureThroughput(settings, uArgs, [&](float u) { return heneyGreenCosTheta(u, g); });
+            result.tableEvaluationsPerSecond = MeasureThroughput(settings, cosArgs, [&](float cosTheta) { return hgTablePhaseFunc(table.data(), cosTheta, g); });
+            result.analyticEvaluationsPerSecond = MeasureThroughput(settings, cosArgs, [&](float cosTheta) { return heneyGreenPhaseFunc(cosTheta, g); });
+
+            for (uint32_t i = 0; i < settings.numArguments; i++)
+            {
+                const double cosTheta = hgAnalyticCosTheta(uArgs[i], g);
+                result.tableCosThetaError = std::max(result.tableCosThetaError, std::abs(hgTableSampleCosTheta(table.data(), uArgs[i], g) - cosTheta));
+                result.analyticCosThetaError = std::max(result.analyticCosThetaError, std::abs(heneyGreenCosTheta(uArgs[i], g) - cosTheta));
+
+                const double phase = hgAnalyticPhaseFunc(cosArgs[i], g);
+                result.tablePhaseError = std::max(result.tablePhaseError, std::abs(hgTablePhaseFunc(table.data(), cosArgs[i], g) - phase) / phase);
+                result.analyticPhaseError = std::max(result.analyticPhaseError, std::abs(heneyGreenPhaseFunc(cosArgs[i], g) - phase) / phase);
+            }
+
+            results.push_back(result);
+        }
+
+        return results;
+    }
+
+    std::string FormatHgTableBenchmarkResults(const std::vector<HgTableBenchmarkResult>& results)
+    {
+        std::string text;
+        char line[320];
+
+        for (const auto& result : results)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "g %5.2f  sample table %8.2f analytic %8.2f Mcalls/s  cos err table %.2e analytic %.2e"
+                "  |  phase table %8.2f analytic %8.2f Mcalls/s  rel err table %.2e analytic %.2e\n",
+                result.g,
+                result.tableSamplesPerSecond * 1e-6,
+                result.analyticSamplesPerSecond * 1e-6,
+                result.tableCosThetaError,
+                result.analyticCosThetaError,
+                result.tableEvaluationsPerSecond * 1e-6,
+                result.analyticEvaluationsPerSecond * 1e-6,
+                result.tablePhaseError,
+                result.analyticPhaseError
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
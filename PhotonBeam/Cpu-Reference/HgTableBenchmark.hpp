@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Cost and accuracy of the Henyey-Greenstein table of Shaders/util/HenyeyGreensteinTable.h against the analytic
+// functions of RayTracingSampling.hlsli, run on their CPU ports. Both are measured against the closed forms in double
+// precision, hgAnalyticCosTheta() and hgAnalyticPhaseFunc().
+namespace CpuReference
+{
+    struct HgTableBenchmarkSettings
+    {
+        std::vector<float> hgAssymFactors = { -0.9f, -0.5f, 0.0f, 0.3f, 0.7f, 0.9f, 0.99f };
+
+        // random u and cos theta per pass, generated once before the timing
+        uint32_t numArguments = 1u << 20;
+
+        // the best of the passes is reported
+        uint32_t numPasses = 4;
+    };
+
+    struct HgTableBenchmarkResult
+    {
+        float g = 0.0f;
+
+        // calls per second on one thread
+        double tableSamplesPerSecond = 0.0;
+        double analyticSamplesPerSecond = 0.0;
+        double tableEvaluationsPerSecond = 0.0;
+        double analyticEvaluationsPerSecond = 0.0;
+
+        // largest abs error of the sampled cos theta and relative error of the phase function over the arguments
+        double tableCosThetaError = 0.0;
+        double analyticCosThetaError = 0.0;
+        double tablePhaseError = 0.0;
+        double analyticPhaseError = 0.0;
+    };
+
+    // one result per g, sampling is heneyGreenCosTheta() against hgTableSampleCosTheta(), evaluation is
+    // heneyGreenPhaseFunc() against hgTablePhaseFunc(), the table at the HG_TABLE_* resolution of the build
+    std::vector<HgTableBenchmarkResult> RunHgTableBenchmark(const HgTableBenchmarkSettings& settings = {});
+
+    // one line per g
+    std::string FormatHgTableBenchmarkResults(const std::vector<HgTableBenchmarkResult>& results);
+}
@@ -0,0 +1,646 @@
+
+#include "IncrementalBeamList.hpp"
+#include "ParallelFor.hpp"
+#include "RayTracingSampling.hpp"
+#include "../Shaders/util/BeamInstance.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // half extent of the benchmark room, centered on the origin
+        constexpr float c_roomSize = 5.0f;
+
+        // bounces of a launch of the room emitter
+        constexpr uint32_t c_maxRoomBounces = 4;
+
+        bool IsSameFloat3(const XMFLOAT3& a, const XMFLOAT3& b)
+        {
+            return a.x == b.x && a.y == b.y && a.z == b.z;
+        }
+
+        // launches in [min(a, b), max(a, b)) clamped to numLaunches
+        void MarkLaunchRange(uint32_t a, uint32_t b, std::vector<uint8_t>& marks)
+        {
+            const uint32_t end = std::min<uint32_t>(std::max(a, b), uint32_t(marks.size()));
+            for (uint32_t i = std::min(a, b); i < end; i++)
+                marks[i] = 1;
+        }
+
+        // instance ids of the instances of a launch moved from one beam range to another
+        void CopyLaunchInstances(
+            const ShaderRayTracingTopASInstanceDesc* source,
+            uint32_t numInstances,
+            uint64_t sourceBeamOffset,
+            uint64_t destinationBeamOffset,
+            ShaderRayTracingTopASInstanceDesc* destination
+        )
+        {
+            for (uint32_t i = 0; i < numInstances; i++)
+            {
+                ShaderRayTracingTopASInstanceDesc instance = source[i];
+                const uint64_t beamIndex = unpackInstanceCustomIndex(instance.instanceCustomIndexAndmask) - sourceBeamOffset + destinationBeamOffset;
+                instance.instanceCustomIndexAndmask = packInstanceCustomIndexAndMask(
+                    uint32_t(beamIndex),
+                    unpackInstanceMask(instance.instanceCustomIndexAndmask)
+                );
+                destination[i] = instance;
+            }
+        }
+
+        // A launch of BeamGen.hlsl in a closed room: the light direction blended between the two seeds,
+        // diffuse bounces off the walls, a launch ending at random after a bounce.
+        void TraceRoomLaunch(uint32_t launchIndex, const PushConstantBeam& pc, std::vector<BeamEmission>& emissions)
+        {
+            uint32_t seed = rngInitSeed(launchIndex, pc.seed);
+            uint32_t nextSeed = rngInitSeed(launchIndex, pc.seed + 1);
+
+            const float3 firstDirection = uniformSamplingSphere(seed);
+            const float3 secondDirection = uniformSamplingSphere(nextSeed);
+            const float3 sumDirection = firstDirection + secondDirection;
+            if (sumDirection.x == 0.0f && sumDirection.y == 0.0f && sumDirection.z == 0.0f)
+                return;
+
+            float3 position = pc.lightPosition;
+            float3 direction = normalize(firstDirection * (1.0f - pc.nextSeedRatio) + secondDirection * pc.nextSeedRatio);
+            float3 color = pc.sourceLight;
+
+            for (uint32_t bounce = 0; bounce < c_maxRoomBounces; bounce++)
+            {
+                float tExit = FLT_MAX;
+                int exitAxis = 0;
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    if (direction[axis] == 0.0f)
+                        continue;
+                    const float wall = direction[axis] > 0.0f ? c_roomSize : -c_roomSize;
+                    const float t = (wall - position[axis]) / direction[axis];
+                    if (t < tExit)
+                    {
+                        tExit = t;
+                        exitAxis = axis;
+                    }
+                }
+
+                float3 normal = float3(0.0f);
+                normal[exitAxis] = direction[exitAxis] > 0.0f ? -1.0f : 1.0f;
+
+                BeamEmission emission = {};
+                emission.direction = direction;
+                emission.hitNormal = normal;
+                emission.airSubBeams = launchIndex < pc.numBeamSources;
+                emission.surfacePhoton = launchIndex < pc.numPhotonSources;
+                emission.beam.startPos = position.ToXMFLOAT3();
+                position = position + direction * tExit;
+                emission.beam.endPos = position.ToXMFLOAT3();
+                emission.beam.lightColor = color.ToXMFLOAT3();
+                emission.beam.hitInstanceID = exitAxis * 2 + (direction[exitAxis] > 0.0f ? 1 : 0);
+                emissions.push_back(emission);
+
+                if (rnd(seed) < 0.25f)
+                    break;
+
+                float3 first = uniformSamplingSphere(seed);
+                float3 second = uniformSamplingSphere(nextSeed);
+                if (dot(first, normal) < 0.0f)
+                    first = -first;
+                if (dot(second, normal) < 0.0f)
+                    second = -second;
+
+                const float3 blended = first * (1.0f - pc.nextSeedRatio) + second * pc.nextSeedRatio;
+                if (dot(blended, blended) == 0.0f)
+                    break;
+
+                direction = normalize(blended);
+                color = color * 0.7f;
+            }
+        }
+
+        PushConstantBeam MakeRoomBeamConstants(uint32_t numLaunches)
+        {
+            PushConstantBeam pc = {};
+            pc.lightPosition = XMFLOAT3(0.5f, 4.0f, -0.5f);
+            pc.sourceLight = XMFLOAT3(1.0f, 0.9f, 0.8f);
+            pc.numBeamSources = numLaunches;
+            pc.numPhotonSources = numLaunches;
+            pc.beamRadius = 0.2f;
+            pc.photonRadius = 0.2f;
+            pc.seed = 1017;
+            pc.beamBlasAddress = 1;
+            pc.photonBlasAddress = 2;
+            pc.maxNumBeams = UINT32_MAX;
+            pc.maxNumSubBeams = UINT32_MAX;
+            return pc;
+        }
+
+        // the counted build of every launch traced with pc
+        void BuildRoomReference(uint32_t numLaunches, const PushConstantBeam& pc, BeamInstanceList& list)
+        {
+            BeamEmissionLaunches launches(numLaunches);
+            for (uint32_t i = 0; i < numLaunches; i++)
+                TraceRoomLaunch(i, pc, launches[i]);
+
+            BuildBeamInstanceListCounted(launches, pc, SubBeamSplitMode::Uniform, list);
+        }
+
+        bool IsSameList(const BeamInstanceList& a, const BeamInstanceList& b)
+        {
+            return a.beams.size() == b.beams.size()
+                && a.instances.size() == b.instances.size()
+                && std::memcmp(a.beams.data(), b.beams.data(), a.beams.size() * sizeof(PhotonBeam)) == 0
+                && std::memcmp(a.instances.data(), b.instances.data(), a.instances.size() * sizeof(ShaderRayTracingTopASInstanceDesc)) == 0;
+        }
+
+        // every instance slot outside the live part of the ranges is empty
+        bool AreHolesEmpty(const IncrementalBeamList& list)
+        {
+            std::vector<uint8_t> isLive(list.Instances().size(), 0);
+            for (uint32_t launch = 0; launch < list.NumLaunches(); launch++)
+            {
+                const LaunchRange& range = list.Range(launch);
+                std::fill(isLive.begin() + range.instanceOffset, isLive.begin() + range.instanceOffset + range.instanceCount, uint8_t(1));
+            }
+
+            for (size_t i = 0; i < isLive.size(); i++)
+            {
+                const bool isEmpty = list.Instances()[i].accelerationStructureReference == 0;
+                if (isEmpty == (isLive[i] != 0))
+                    return false;
+            }
+            return true;
+        }
+
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+    }
+
+    IncrementalBeamList::IncrementalBeamList(uint32_t numLaunches, SubBeamSplitMode mode, const IncrementalBeamSettings& settings) :
+        m_mode(mode),
+        m_settings(settings),
+        m_ranges(numLaunches)
+    {
+        m_settings.numRollingSlices = std::max(m_settings.numRollingSlices, 1u);
+    }
+
+    bool IncrementalBeamList::IsSameSharedInputs(const PushConstantBeam& a, const PushConstantBeam& b)
+    {
+        return IsSameFloat3(a.lightPosition, b.lightPosition)
+            && IsSameFloat3(a.sourceLight, b.sourceLight)
+            && IsSameFloat3(a.airScatterCoff, b.airScatterCoff)
+            && IsSameFloat3(a.airExtinctCoff, b.airExtinctCoff)
+            && a.airHGAssymFactor == b.airHGAssymFactor
+            && a.beamRadius == b.beamRadius
+            && a.photonRadius == b.photonRadius
+            && a.seed == b.seed
+            && a.nextSeedRatio == b.nextSeedRatio
+            && a.beamBlasAddress == b.beamBlasAddress
+            && a.photonBlasAddress == b.photonBlasAddress
+            && IsSameFloat3(a.cameraPosition, b.cameraPosition)
+            && a.pixelSpreadAngle == b.pixelSpreadAngle
+            && a.footprintPixels == b.footprintPixels
+            && a.minBeamRadius == b.minBeamRadius
+            && a.maxBeamRadius == b.maxBeamRadius;
+    }
+
+    void IncrementalBeamList::CountLaunch(const std::vector<BeamEmission>& emissions, const PushConstantBeam& pc, uint32_t& numBeams, uint32_t& numInstances) const
+    {
+        numBeams = 0;
+        numInstances = 0;
+        for (const auto& emission : emissions)
+        {
+            const uint32_t count = CountBeamInstances(emission, pc, m_mode);
+            if (count < 1)
+                break;
+
+            numBeams++;
+            numInstances += count;
+        }
+    }
+
+    uint32_t IncrementalBeamList::BeamCapacityFor(uint32_t count) const
+    {
+        return count + uint32_t(float(count) * m_settings.slackRatio) + m_settings.minBeamSlack;
+    }
+
+    uint32_t IncrementalBeamList::InstanceCapacityFor(uint32_t count) const
+    {
+        return count + uint32_t(float(count) * m_settings.slackRatio) + m_settings.minInstanceSlack;
+    }
+
+    void IncrementalBeamList::DirtyLaunches(const PushConstantBeam& pc, IncrementalUpdateMode mode, std::vector<uint32_t>& launches) const
+    {
+        launches.clear();
+        const uint32_t numLaunches = NumLaunches();
+
+        if (!m_hasInputs || mode == IncrementalUpdateMode::Full
+            || (mode == IncrementalUpdateMode::Changed && !IsSameSharedInputs(pc, m_lastInputs)))
+        {
+            for (uint32_t i = 0; i < numLaunches; i++)
+                launches.push_back(i);
+            return;
+        }
+
+        // a launch adds air sub-beams below numBeamSources and a surface photon below numPhotonSources
+        std::vector<uint8_t> marks(numLaunches, 0);
+        MarkLaunchRange(pc.numBeamSources, m_lastInputs.numBeamSources, marks);
+        MarkLaunchRange(pc.numPhotonSources, m_lastInputs.numPhotonSources, marks);
+
+        if (mode == IncrementalUpdateMode::Rolling)
+        {
+            const uint32_t slice = uint32_t(m_numFrames % m_settings.numRollingSlices);
+            for (uint32_t i = slice; i < numLaunches; i += m_settings.numRollingSlices)
+                marks[i] = 1;
+        }
+
+        for (uint32_t i = 0; i < numLaunches; i++)
+        {
+            if (marks[i])
+                launches.push_back(i);
+        }
+    }
+
+    IncrementalUpdateStats IncrementalBeamList::Update(const PushConstantBeam& pc, IncrementalUpdateMode mode, const TraceBeamLaunch& trace, uint32_t numThreads)
+    {
+        numThreads = ResolveThreadCount(numThreads);
+
+        IncrementalUpdateStats stats;
+        std::vector<uint32_t> dirty;
+        DirtyLaunches(pc, mode, dirty);
+        stats.numTracedLaunches = uint32_t(dirty.size());
+
+        // 1. trace and count the dirty launches
+        m_emissions.resize(std::max(m_emissions.size(), dirty.size()));
+        std::vector<uint32_t> beamCounts(dirty.size());
+        std::vector<uint32_t> instanceCounts(dirty.size());
+
+        ParallelFor(numThreads, dirty.size(), [&](uint32_t, uint64_t begin, uint64_t end)
+        {
+            for (uint64_t i = begin; i < end; i++)
+            {
+                m_emissions[i].clear();
+                trace(dirty[i], pc, m_emissions[i]);
+                CountLaunch(m_emissions[i], pc, beamCounts[i], instanceCounts[i]);
+            }
+        });
+
+        // 2. place, a launch outgrowing one of its ranges moves to the end of the lists
+        std::vector<uint32_t> previousInstanceCounts(dirty.size());
+        for (size_t i = 0; i < dirty.size(); i++)
+        {
+            LaunchRange& range = m_ranges[dirty[i]];
+            previousInstanceCounts[i] = range.instanceCount;
+
+            if (beamCounts[i] <= range.beamCapacity && instanceCounts[i] <= range.instanceCapacity)
+                continue;
+
+            if (range.instanceCapacity > 0)
+            {
+                std::fill_n(m_instances.begin() + range.instanceOffset, range.instanceCount, ShaderRayTracingTopASInstanceDesc{});
+                m_numHoleInstances += range.instanceCapacity;
+                stats.numMovedLaunches++;
+            }
+
+            range.beamOffset = m_beams.size();
+            range.beamCapacity = BeamCapacityFor(beamCounts[i]);
+            range.instanceOffset = m_instances.size();
+            range.instanceCapacity = InstanceCapacityFor(instanceCounts[i]);
+            previousInstanceCounts[i] = 0;
+
+            m_beams.resize(m_beams.size() + range.beamCapacity, PhotonBeam{});
+            m_instances.resize(m_instances.size() + range.instanceCapacity, ShaderRayTracingTopASInstanceDesc{});
+        }
+
+        // 3. write, and zero the instances the launch no longer has
+        ParallelFor(numThreads, dirty.size(), [&](uint32_t, uint64_t begin, uint64_t end)
+        {
+            for (uint64_t i = begin; i < end; i++)
+            {
+                LaunchRange& range = m_ranges[dirty[i]];
+                uint64_t beamIndex = range.beamOffset;
+                uint64_t instanceIndex = range.instanceOffset;
+
+                for (uint32_t j = 0; j < beamCounts[i]; j++)
+                {
+                    const BeamEmission& emission = m_emissions[i][j];
+                    m_beams[beamIndex] = EmittedBeam(emission, pc);
+                    WriteBeamInstances(emission, uint32_t(beamIndex), pc, m_mode, m_instances.data() + instanceIndex);
+
+                    beamIndex++;
+                    instanceIndex += CountBeamInstances(emission, pc, m_mode);
+                }
+
+                if (previousInstanceCounts[i] > instanceCounts[i])
+                    std::fill_n(m_instances.begin() + instanceIndex, previousInstanceCounts[i] - instanceCounts[i], ShaderRayTracingTopASInstanceDesc{});
+
+                range.beamCount = beamCounts[i];
+                range.instanceCount = instanceCounts[i];
+            }
+        });
+
+        for (size_t i = 0; i < dirty.size(); i++)
+        {
+            stats.numWrittenBeams += beamCounts[i];
+            stats.numWrittenInstances += instanceCounts[i];
+        }
+
+        m_lastInputs = pc;
+        m_hasInputs = true;
+        m_numFrames++;
+
+        if (double(m_numHoleInstances) > double(m_settings.compactHoleRatio) * double(m_instances.size()))
+        {
+            Compact();
+            stats.isCompacted = true;
+        }
+
+        return stats;
+    }
+
+    void IncrementalBeamList::Compact()
+    {
+        uint64_t numBeamSlots = 0;
+        uint64_t numInstanceSlots = 0;
+        for (const auto& range : m_ranges)
+        {
+            numBeamSlots += BeamCapacityFor(range.beamCount);
+            numInstanceSlots += InstanceCapacityFor(range.instanceCount);
+        }
+
+        std::vector<PhotonBeam> beams(numBeamSlots, PhotonBeam{});
+        std::vector<ShaderRayTracingTopASInstanceDesc> instances(numInstanceSlots, ShaderRayTracingTopASInstanceDesc{});
+
+        uint64_t beamOffset = 0;
+        uint64_t instanceOffset = 0;
+        for (auto& range : m_ranges)
+        {
+            std::copy_n(m_beams.begin() + range.beamOffset, range.beamCount, beams.begin() + beamOffset);
+            CopyLaunchInstances(
+                m_instances.data() + range.instanceOffset,
+                range.instanceCount,
+                range.beamOffset,
+                beamOffset,
+                instances.data() + instanceOffset
+            );
+
+            range.beamOffset = beamOffset;
+            range.beamCapacity = BeamCapacityFor(range.beamCount);
+            range.instanceOffset = instanceOffset;
+            range.instanceCapacity = InstanceCapacityFor(range.instanceCount);
+
+            beamOffset += range.beamCapacity;
+            instanceOffset += range.instanceCapacity;
+        }
+
+        m_beams.swap(beams);
+        m_instances.swap(instances);
+        m_numHoleInstances = 0;
+        m_numCompactions++;
+    }
+
+    void IncrementalBeamList::Flatten(BeamInstanceList& list) const
+    {
+        uint64_t numBeams = 0;
+        uint64_t numInstances = 0;
+        for (const auto& range : m_ranges)
+        {
+            numBeams += range.beamCount;
+            numInstances += range.instanceCount;
+        }
+
+        list.beams.resize(numBeams);
+        list.instances.resize(numInstances);
+        list.requestedBeams = numBeams;
+        list.requestedInstances = numInstances;
+
+        uint64_t beamOffset = 0;
+        uint64_t instanceOffset = 0;
+        for (const auto& range : m_ranges)
+        {
+            std::copy_n(m_beams.begin() + range.beamOffset, range.beamCount, list.beams.begin() + beamOffset);
+            CopyLaunchInstances(
+                m_instances.data() + range.instanceOffset,
+                range.instanceCount,
+                range.beamOffset,
+                beamOffset,
+                list.instances.data() + instanceOffset
+            );
+
+            beamOffset += range.beamCount;
+            instanceOffset += range.instanceCount;
+        }
+    }
+
+    std::string ValidateIncrementalBeamList()
+    {
+        std::string failures;
+        const uint32_t numLaunches = 2048;
+
+        IncrementalBeamSettings settings;
+        settings.numRollingSlices = 8;
+        IncrementalBeamList incremental(numLaunches, SubBeamSplitMode::Uniform, settings);
+
+        PushConstantBeam pc = MakeRoomBeamConstants(numLaunches);
+        BeamInstanceList flattened;
+        BeamInstanceList reference;
+
+        // the first update traces every launch
+        {
+            IncrementalUpdateStats stats = incremental.Update(pc, IncrementalUpdateMode::Changed, TraceRoomLaunch);
+            incremental.Flatten(flattened);
+            BuildRoomReference(numLaunches, pc, reference);
+
+            Check(stats.numTracedLaunches == numLaunches && stats.numMovedLaunches == 0, "first: every launch traced", failures);
+            Check(IsSameList(flattened, reference), "first: matches the counted build", failures);
+            Check(AreHolesEmpty(incremental), "first: empty slots zeroed", failures);
+        }
+
+        // nothing changed, nothing is traced
+        {
+            const std::vector<ShaderRayTracingTopASInstanceDesc> before = incremental.Instances();
+            IncrementalUpdateStats stats = incremental.Update(pc, IncrementalUpdateMode::Changed, TraceRoomLaunch);
+
+            Check(stats.numTracedLaunches == 0 && stats.numWrittenInstances == 0, "static: no launch traced", failures);
+            Check(before.size() == incremental.Instances().size()
+                && std::memcmp(before.data(), incremental.Instances().data(), before.size() * sizeof(before[0])) == 0,
+                "static: instances untouched", failures);
+        }
+
+        // the source counts dirty the launches between the old and the new count
+        {
+            pc.numBeamSources = 1500;
+            IncrementalUpdateStats stats = incremental.Update(pc, IncrementalUpdateMode::Changed, TraceRoomLaunch);
+            incremental.Flatten(flattened);
+            BuildRoomReference(numLaunches, pc, reference);
+            Check(stats.numTracedLaunches == numLaunches - 1500, "sources: beam source launches traced", failures);
+            Check(IsSameList(flattened, reference) && AreHolesEmpty(incremental), "sources: fewer beam sources", failures);
+
+            pc.numPhotonSources = 1000;
+            pc.numBeamSources = 1700;
+            stats = incremental.Update(pc, IncrementalUpdateMode::Changed, TraceRoomLaunch);
+            incremental.Flatten(flattened);
+            BuildRoomReference(numLaunches, pc, reference);
+            Check(stats.numTracedLaunches == numLaunches - 1000, "sources: photon and beam source launches traced", failures);
+            Check(IsSameList(flattened, reference) && AreHolesEmpty(incremental), "sources: fewer photon sources", failures);
+        }
+
+        // a moving light dirties every launch
+        {
+            pc.lightPosition = XMFLOAT3(-1.0f, 3.5f, 1.0f);
+            IncrementalUpdateStats stats = incremental.Update(pc, IncrementalUpdateMode::Changed, TraceRoomLaunch);
+            incremental.Flatten(flattened);
+            BuildRoomReference(numLaunches, pc, reference);
+            Check(stats.numTracedLaunches == numLaunches, "light: every launch traced", failures);
+            Check(IsSameList(flattened, reference) && AreHolesEmpty(incremental), "light: matches the counted build", failures);
+        }
+
+        // the rolling slices catch up with new inputs after numRollingSlices frames
+        {
+            pc.seed++;
+            pc.nextSeedRatio = 0.3f;
+            bool isSliceSize = true;
+            for (uint32_t frame = 0; frame < settings.numRollingSlices; frame++)
+            {
+                IncrementalUpdateStats stats = incremental.Update(pc, IncrementalUpdateMode::Rolling, TraceRoomLaunch);
+                isSliceSize = isSliceSize && stats.numTracedLaunches == numLaunches / settings.numRollingSlices;
+
+                if (frame == 0)
+                {
+                    incremental.Flatten(flattened);
+                    BuildRoomReference(numLaunches, pc, reference);
+                    Check(!IsSameList(flattened, reference), "rolling: one slice leaves stale launches", failures);
+                }
+            }
+            incremental.Flatten(flattened);
+            BuildRoomReference(numLaunches, pc, reference);
+            Check(isSliceSize, "rolling: one slice per frame", failures);
+            Check(IsSameList(flattened, reference) && AreHolesEmpty(incremental), "rolling: matches after every slice", failures);
+        }
+
+        // smaller radii grow the launches, they move and the lists are compacted
+        {
+            uint64_t numMoved = 0;
+            uint64_t numCompactions = incremental.NumCompactions();
+            for (float radius : { 0.15f, 0.1f, 0.07f })
+            {
+                pc.beamRadius = radius;
+                numMoved += incremental.Update(pc, IncrementalUpdateMode::Changed, TraceRoomLaunch).numMovedLaunches;
+            }
+            incremental.Flatten(flattened);
+            BuildRoomReference(numLaunches, pc, reference);
+
+            Check(numMoved > 0, "moves: launches moved", failures);
+            Check(incremental.NumCompactions() > numCompactions, "moves: lists compacted", failures);
+            Check(IsSameList(flattened, reference) && AreHolesEmpty(incremental), "moves: matches the counted build", failures);
+        }
+
+        return failures;
+    }
+
+    std::vector<IncrementalBeamBenchmarkResult> RunIncrementalBeamBenchmark(const IncrementalBeamBenchmarkSettings& settings)
+    {
+        struct Scenario
+        {
+            const char* name;
+            IncrementalUpdateMode mode;
+            bool isSeedAnimated;
+            bool isSliderDragged;
+        };
+        const Scenario scenarios[] = {
+            { "static full", IncrementalUpdateMode::Full, false, false },
+            { "static changed", IncrementalUpdateMode::Changed, false, false },
+            { "slider changed", IncrementalUpdateMode::Changed, false, true },
+            { "seed full", IncrementalUpdateMode::Full, true, false },
+            { "seed rolling", IncrementalUpdateMode::Rolling, true, false },
+        };
+
+        std::vector<IncrementalBeamBenchmarkResult> results;
+        for (const auto& scenario : scenarios)
+        {
+            IncrementalBeamSettings listSettings;
+            listSettings.numRollingSlices = settings.numRollingSlices;
+            IncrementalBeamList incremental(settings.numLaunches, SubBeamSplitMode::Uniform, listSettings);
+
+            PushConstantBeam pc = MakeRoomBeamConstants(settings.numLaunches);
+            incremental.Update(pc, IncrementalUpdateMode::Full, TraceRoomLaunch, settings.numThreads);
+
+            IncrementalBeamBenchmarkResult result;
+            result.scenario = scenario.name;
+            uint64_t numTraced = 0;
+            uint64_t numWritten = 0;
+            uint64_t numMoved = 0;
+
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t frame = 0; frame < settings.numFrames; frame++)
+            {
+                if (scenario.isSeedAnimated)
+                    pc.nextSeedRatio = float(frame + 1) / float(settings.numFrames + 1);
+
+                // a slider dragged back and forth over the upper quarter of the sources
+                if (scenario.isSliderDragged)
+                {
+                    const float phase = 0.5f + 0.5f * std::sin(float(frame) * 0.3f);
+                    pc.numBeamSources = settings.numLaunches - uint32_t(phase * float(settings.numLaunches / 4));
+                }
+
+                const IncrementalUpdateStats stats = incremental.Update(pc, scenario.mode, TraceRoomLaunch, settings.numThreads);
+                numTraced += stats.numTracedLaunches;
+                numWritten += stats.numWrittenInstances;
+                numMoved += stats.numMovedLaunches;
+            }
+            const auto end = std::chrono::steady_clock::now();
+
+            uint64_t numLive = 0;
+            for (uint32_t i = 0; i < incremental.NumLaunches(); i++)
+                numLive += incremental.Range(i).instanceCount;
+
+            const double numFrames = double(std::max(settings.numFrames, 1u));
+            result.secondsPerFrame = std::chrono::duration<double>(end - start).count() / numFrames;
+            result.tracedLaunchesPerFrame = double(numTraced) / numFrames;
+            result.writtenInstancesPerFrame = double(numWritten) / numFrames;
+            result.movedLaunchesPerFrame = double(numMoved) / numFrames;
+            result.numCompactions = incremental.NumCompactions();
+            result.slotsPerInstance = numLive > 0 ? double(incremental.Instances().size()) / double(numLive) : 0.0;
+            results.push_back(result);
+        }
+
+        return results;
+    }
+
+    std::string FormatIncrementalBeamBenchmarkResults(const std::vector<IncrementalBeamBenchmarkResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-15s %8.3f ms/frame  traced %8.1f  written instances %10.1f  moved %7.1f  compactions %3llu  slots/instance %5.2f\n",
+                result.scenario,
+                result.secondsPerFrame * 1e3,
+                result.tracedLaunchesPerFrame,
+                result.writtenInstancesPerFrame,
+                result.movedLaunchesPerFrame,
+                static_cast<unsigned long long>(result.numCompactions),
+                result.slotsPerInstance
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
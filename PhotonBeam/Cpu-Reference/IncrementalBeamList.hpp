@@ -0,0 +1,167 @@
+#pragma once
+
+#include "BeamInstanceList.hpp"
+#include "SubBeamSplitter.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Incremental update of the beam buffer and the sub-beam instance list of BeamGen.hlsl.
+//
+// Every launch owns a range of beam slots and a range of instance slots, found through a launch to range index.
+// An update traces only the dirty launches:
+//  - a change of an input every launch reads (light, seed, seed ratio, radii, footprint camera, source light, medium) dirties every launch
+//  - a change of numBeamSources or numPhotonSources dirties the launches between the old and the new count
+//  - the rolling mode traces one of numRollingSlices interleaved slices per frame,
+//    launchIndex % numRollingSlices == frame % numRollingSlices, the other launches keep the beams of their last trace
+// A traced launch is written back into its ranges when it fits, the unused tail of the instance range is zeroed
+// so the TLAS build skips it. A launch outgrowing its ranges moves to the end of the lists and its old ranges
+// become holes, the lists are compacted once the holes pass a fraction of them.
+// A beam is only referenced by the instances of its own launch, so a move rewrites the instance ids of that launch alone.
+//
+// The capacities of PushConstantBeam are not enforced, the lists grow as needed.
+namespace CpuReference
+{
+    struct IncrementalBeamSettings
+    {
+        uint32_t numRollingSlices = 8;
+
+        // a placed or moved launch reserves count * (1 + slackRatio) + minSlack slots of each list
+        float slackRatio = 0.25f;
+        uint32_t minBeamSlack = 1;
+        uint32_t minInstanceSlack = 4;
+
+        // the lists are compacted when the holes left by moved launches pass this fraction of the instance slots
+        float compactHoleRatio = 0.25f;
+    };
+
+    enum class IncrementalUpdateMode
+    {
+        // every launch, every frame, as BeamTrace() does
+        Full,
+
+        // the launches whose inputs changed
+        Changed,
+
+        // the launches whose source counts changed and one slice of the others
+        Rolling,
+    };
+
+    struct LaunchRange
+    {
+        uint64_t beamOffset = 0;
+        uint32_t beamCount = 0;
+        uint32_t beamCapacity = 0;
+
+        uint64_t instanceOffset = 0;
+        uint32_t instanceCount = 0;
+        uint32_t instanceCapacity = 0;
+    };
+
+    struct IncrementalUpdateStats
+    {
+        uint32_t numTracedLaunches = 0;
+        uint64_t numWrittenBeams = 0;
+        uint64_t numWrittenInstances = 0;
+        uint32_t numMovedLaunches = 0;
+        bool isCompacted = false;
+    };
+
+    // Writes the emissions of one launch, as BeamGen.hlsl traces launchIndex with pc.
+    using TraceBeamLaunch = std::function<void(uint32_t launchIndex, const PushConstantBeam& pc, std::vector<BeamEmission>& emissions)>;
+
+    class IncrementalBeamList
+    {
+    public:
+        IncrementalBeamList(uint32_t numLaunches, SubBeamSplitMode mode = SubBeamSplitMode::Uniform, const IncrementalBeamSettings& settings = {});
+
+        // Traces the dirty launches of the mode and writes them back. The first update traces every launch.
+        // numThreads 0 uses std::thread::hardware_concurrency()
+        IncrementalUpdateStats Update(const PushConstantBeam& pc, IncrementalUpdateMode mode, const TraceBeamLaunch& trace, uint32_t numThreads = 0);
+
+        // the launches the next Update() with pc and mode traces, in launch order
+        void DirtyLaunches(const PushConstantBeam& pc, IncrementalUpdateMode mode, std::vector<uint32_t>& launches) const;
+
+        // Dense copy in launch order with the instance ids remapped, the list BuildBeamInstanceListCounted() writes
+        // for the emissions of the last trace of every launch.
+        void Flatten(BeamInstanceList& list) const;
+
+        // the slots, with the holes and the unused tails of the ranges
+        const std::vector<PhotonBeam>& Beams() const { return m_beams; }
+        const std::vector<ShaderRayTracingTopASInstanceDesc>& Instances() const { return m_instances; }
+
+        const LaunchRange& Range(uint32_t launchIndex) const { return m_ranges[launchIndex]; }
+        uint32_t NumLaunches() const { return uint32_t(m_ranges.size()); }
+
+        uint64_t NumHoleInstances() const { return m_numHoleInstances; }
+        uint64_t NumFrames() const { return m_numFrames; }
+        uint64_t NumCompactions() const { return m_numCompactions; }
+
+    private:
+        // the inputs read by every launch are the same
+        static bool IsSameSharedInputs(const PushConstantBeam& a, const PushConstantBeam& b);
+
+        // beams until the first emission without instances, as a launch of BeamGen.hlsl stops
+        void CountLaunch(const std::vector<BeamEmission>& emissions, const PushConstantBeam& pc, uint32_t& numBeams, uint32_t& numInstances) const;
+
+        uint32_t BeamCapacityFor(uint32_t count) const;
+        uint32_t InstanceCapacityFor(uint32_t count) const;
+
+        // packs every launch at the front of the lists with fresh slack
+        void Compact();
+
+        SubBeamSplitMode m_mode;
+        IncrementalBeamSettings m_settings;
+
+        std::vector<LaunchRange> m_ranges;
+        std::vector<PhotonBeam> m_beams;
+        std::vector<ShaderRayTracingTopASInstanceDesc> m_instances;
+
+        // traced emissions of the dirty launches of an update
+        std::vector<std::vector<BeamEmission>> m_emissions;
+
+        PushConstantBeam m_lastInputs = {};
+        bool m_hasInputs = false;
+
+        uint64_t m_numHoleInstances = 0;
+        uint64_t m_numFrames = 0;
+        uint64_t m_numCompactions = 0;
+    };
+
+    // Checks the dirty launches of every mode, that the flattened list matches a full counted build after the
+    // updates, the moves and the compaction, and that the slots outside the live ranges are zeroed.
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidateIncrementalBeamList();
+
+    struct IncrementalBeamBenchmarkSettings
+    {
+        uint32_t numLaunches = 1u << 14;
+        uint32_t numFrames = 64;
+        uint32_t numRollingSlices = 8;
+        uint32_t numThreads = 0;
+    };
+
+    struct IncrementalBeamBenchmarkResult
+    {
+        const char* scenario = "";
+
+        double secondsPerFrame = 0.0;
+        double tracedLaunchesPerFrame = 0.0;
+        double writtenInstancesPerFrame = 0.0;
+        double movedLaunchesPerFrame = 0.0;
+        uint64_t numCompactions = 0;
+
+        // instance slots of the lists at the end, over the live instances
+        double slotsPerInstance = 0.0;
+    };
+
+    // Beams bouncing in a room with a CPU emitter, for a static light, a dragged source count slider
+    // and an animated seed, updated fully every frame, by change and rolling.
+    std::vector<IncrementalBeamBenchmarkResult> RunIncrementalBeamBenchmark(const IncrementalBeamBenchmarkSettings& settings = {});
+
+    // one line per result
+    std::string FormatIncrementalBeamBenchmarkResults(const std::vector<IncrementalBeamBenchmarkResult>& results);
+}
@@ -0,0 +1,400 @@
+#include "MediaTable.hpp"
+#include "RayTracingSampling.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // light position and miss length of CreateSceneEmissions()
+        constexpr float c_lightHeight = c_cornellRoomSize * 0.9f;
+        constexpr float c_missBeamLength = 20.0f;
+
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+
+        // the channel of the least absorption and its coefficients, clamped as randomScatterOccured() does
+        uint32_t SelectHeroChannel(const ParticipatingMedium& medium, float& heroExtinctCoff, float& heroScatterCoff)
+        {
+            const float3 extinctCoff = medium.extinctCoff;
+            const float3 scatterCoff = medium.scatterCoff;
+            const float3 absorption = extinctCoff - scatterCoff;
+
+            uint32_t heroIndex = 0;
+            if (absorption.z <= absorption.y && absorption.z <= absorption.x)
+                heroIndex = 2;
+            else if (absorption.y <= absorption.x && absorption.y <= absorption.z)
+                heroIndex = 1;
+
+            heroExtinctCoff = extinctCoff[heroIndex];
+            heroScatterCoff = scatterCoff[heroIndex];
+            if (heroExtinctCoff <= 0.00001f)
+            {
+                heroExtinctCoff = 0.00001f;
+                heroScatterCoff = 0.0f;
+            }
+            return heroIndex;
+        }
+
+        bool IsClose(const float3& value, const float3& expected, float tolerance)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                if (!(std::abs(value[i] - expected[i]) <= tolerance * std::abs(expected[i]) + 1e-12f))
+                    return false;
+            }
+            return true;
+        }
+    }
+
+    std::vector<ParticipatingMedium> BuildMediaTable(const PushConstantRay& pc, const std::vector<ParticipatingMedium>& sceneMedia)
+    {
+        std::vector<ParticipatingMedium> media;
+        media.reserve(1 + sceneMedia.size());
+        media.push_back(makeAirMedium(pc.airScatterCoff, pc.airExtinctCoff, pc.airHGAssymFactor));
+        media.insert(media.end(), sceneMedia.begin(), sceneMedia.end());
+        return media;
+    }
+
+    uint32_t FindMediumAt(const std::vector<SceneMediumBox>& boxes, const float3& position)
+    {
+        uint32_t mediaIndex = MEDIA_TABLE_AIR_INDEX;
+        for (const SceneMediumBox& box : boxes)
+        {
+            if (position.x >= box.boundsMin.x && position.y >= box.boundsMin.y && position.z >= box.boundsMin.z
+                && position.x <= box.boundsMax.x && position.y <= box.boundsMax.y && position.z <= box.boundsMax.z)
+                mediaIndex = box.mediaIndex;
+        }
+        return mediaIndex;
+    }
+
+    float FindNextMediumBoundary(const std::vector<SceneMediumBox>& boxes, const float3& origin, const float3& direction, float tMin, float tMax)
+    {
+        float tNext = tMax;
+        for (const SceneMediumBox& box : boxes)
+        {
+            float tEnter = -std::numeric_limits<float>::max();
+            float tExit = std::numeric_limits<float>::max();
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const float invDirection = 1.0f / direction[axis];
+                float t0 = (box.boundsMin[axis] - origin[axis]) * invDirection;
+                float t1 = (box.boundsMax[axis] - origin[axis]) * invDirection;
+                if (t0 > t1)
+                    std::swap(t0, t1);
+
+                tEnter = std::max(tEnter, t0);
+                tExit = std::min(tExit, t1);
+            }
+            if (!(tEnter <= tExit))
+                continue;
+
+            if (tEnter > tMin && tEnter < tNext)
+                tNext = tEnter;
+            if (tExit > tMin && tExit < tNext)
+                tNext = tExit;
+        }
+        return tNext;
+    }
+
+    float3 MediaOpticalDepth(
+        const std::vector<ParticipatingMedium>& media,
+        const std::vector<SceneMediumBox>& boxes,
+        const float3& origin,
+        const float3& direction,
+        float tMax
+    )
+    {
+        float3 opticalDepth(0.0f);
+        float t = 0.0f;
+        while (t < tMax)
+        {
+            const float tNext = FindNextMediumBoundary(boxes, origin, direction, t, tMax);
+            const uint32_t mediaIndex = FindMediumAt(boxes, origin + direction * ((t + tNext) * 0.5f));
+            opticalDepth = opticalDepth + float3(media[mediaIndex].extinctCoff) * (tNext - t);
+            t = tNext;
+        }
+        return opticalDepth;
+    }
+
+    BeamEmissionLaunches CreateMediaSceneEmissions(
+        const std::vector<SceneBox>& scene,
+        const std::vector<ParticipatingMedium>& media,
+        const std::vector<SceneMediumBox>& boxes,
+        uint32_t numLaunches,
+        uint32_t maxBeamsPerLaunch,
+        uint32_t seed
+    )
+    {
+        BeamEmissionLaunches launches(numLaunches);
+        for (uint32_t launch = 0; launch < numLaunches; launch++)
+        {
+            uint32_t launchSeed = rngInitSeed(launch, seed);
+            std::vector<BeamEmission>& emissions = launches[launch];
+
+            const uint32_t numBounces = 1 + std::min(uint32_t(rnd(launchSeed) * float(maxBeamsPerLaunch)), std::max(maxBeamsPerLaunch, 1u) - 1);
+            float3 position = float3(0.0f, c_lightHeight, 0.0f);
+            float3 direction = uniformSamplingSphere(launchSeed);
+            if (direction.y > 0.0f)
+                direction.y = -direction.y;
+            float3 lightColor(1.0f);
+
+            // a beam ending at a medium boundary is not a bounce, a line crosses every box at most twice
+            uint32_t bounce = 0;
+            while (bounce < numBounces)
+            {
+                BeamEmission emission = {};
+                emission.direction = direction;
+                emission.airSubBeams = true;
+                emission.beam.startPos = position.ToXMFLOAT3();
+                emission.beam.lightColor = lightColor.ToXMFLOAT3();
+                emission.beam.hitInstanceID = -1;
+
+                SceneHit hit;
+                const bool isSurfaceHit = TraceScene(scene, position, direction, c_rayTMin, c_missBeamLength, hit);
+                const float tSurface = isSurfaceHit ? hit.t : c_missBeamLength;
+                const float tBoundary = FindNextMediumBoundary(boxes, position, direction, c_rayTMin, tSurface);
+
+                emission.beam.mediaIndex = FindMediumAt(boxes, position + direction * (tBoundary * 0.5f));
+                const ParticipatingMedium& medium = media[emission.beam.mediaIndex];
+
+                float heroExtinctCoff;
+                float heroScatterCoff;
+                const uint32_t heroIndex = SelectHeroChannel(medium, heroExtinctCoff, heroScatterCoff);
+
+                const float scatterAt = -std::log(1.0f - rnd(launchSeed)) / heroExtinctCoff;
+                if (scatterAt < tBoundary)
+                {
+                    position = position + direction * scatterAt;
+                    emission.beam.endPos = position.ToXMFLOAT3();
+                    emissions.push_back(emission);
+
+                    // roulette of the albedo of the hero channel, then the phase function of the medium
+                    if (rnd(launchSeed) >= heroScatterCoff / heroExtinctCoff)
+                        break;
+
+                    float3 weight = exp((float3(heroExtinctCoff) - medium.extinctCoff) * scatterAt) * float3(medium.scatterCoff) / heroScatterCoff;
+                    weight[heroIndex] = 1.0f;
+                    lightColor = lightColor * weight;
+                    direction = heneyGreenPhaseFuncSampling(launchSeed, direction, medium.hgAssymFactor);
+                    bounce++;
+                    continue;
+                }
+
+                // transmittance over the probability of passing in the hero channel
+                const float3 passWeight = exp((float3(heroExtinctCoff) - medium.extinctCoff) * tBoundary);
+
+                if (tBoundary < tSurface)
+                {
+                    position = position + direction * tBoundary;
+                    emission.beam.endPos = position.ToXMFLOAT3();
+                    emissions.push_back(emission);
+                    lightColor = lightColor * passWeight;
+                    continue;
+                }
+
+                if (!isSurfaceHit)
+                {
+                    emission.beam.endPos = (position + direction * c_missBeamLength).ToXMFLOAT3();
+                    emissions.push_back(emission);
+                    break;
+                }
+
+                emission.hitNormal = hit.normal;
+                emission.surfacePhoton = true;
+                emission.beam.hitInstanceID = hit.boxIndex;
+                position = position + direction * hit.t;
+                emission.beam.endPos = position.ToXMFLOAT3();
+                emissions.push_back(emission);
+                lightColor = lightColor * passWeight;
+
+                // diffuse bounce off the surface
+                direction = uniformSamplingSphere(launchSeed);
+                if (dot(direction, hit.normal) < 0.0f)
+                    direction = -direction;
+                position = position + hit.normal * c_rayTMin;
+                bounce++;
+            }
+        }
+
+        return launches;
+    }
+
+    bool GatherMediaBeamRadiance(
+        const std::vector<ParticipatingMedium>& media,
+        const std::vector<SceneMediumBox>& boxes,
+        const BeamGatherConstants& pc,
+        const GatherRay& ray,
+        const GatherBeam& beam,
+        uint32_t mediaIndex,
+        float3& radiance
+    )
+    {
+        float tCurr;
+        float3 beamHit;
+        if (!IntersectGatherBeam(pc, ray, beam, tCurr, beamHit))
+            return false;
+
+        const ParticipatingMedium& medium = media[mediaIndex];
+        const float beamRadius = getGatherBeamRadius(beam.radius, pc.beamRadius);
+        const float3 worldPos = ray.origin + ray.direction * tCurr;
+        const float beamDist = length(beamHit - beam.startPos);
+
+        const float beamRayCosVal = dot(-ray.direction, beam.direction);
+        const float beamRayAbsSinVal = std::sqrt(std::max(0.0f, 1 - beamRayCosVal * beamRayCosVal));
+        const float phaseVal = heneyGreenPhaseFunc(beamRayCosVal, medium.hgAssymFactor);
+
+        // the beam runs in its medium only, the camera ray may cross several
+        const float3 opticalDepth = MediaOpticalDepth(media, boxes, ray.origin, ray.direction, tCurr) + float3(medium.extinctCoff) * beamDist;
+
+        radiance = float3(medium.scatterCoff) * exp(-opticalDepth) * phaseVal
+            * beam.lightColor / pc.numBeamSources / (beamRadius * beamRayAbsSinVal + 0.1e-10f);
+
+        const float rayBeamCylinderCenterDist = length(cross(worldPos - beam.startPos, beam.direction));
+        radiance = radiance * std::sqrt(std::max(0.0f, 1.1f - rayBeamCylinderCenterDist / beamRadius));
+        return true;
+    }
+
+    std::string ValidateMediaTable()
+    {
+        std::string failures;
+
+        // attenuationColor at attenuationDistance, the albedo as the ratio of the coefficients
+        {
+            const XMFLOAT3 attenuationColor(0.5f, 0.25f, 0.8f);
+            const float attenuationDistance = 2.0f;
+
+            const ParticipatingMedium absorbing = makeVolumeMedium(attenuationColor, attenuationDistance, XMFLOAT3(0.0f, 0.0f, 0.0f), 0.0f);
+            Check(IsClose(exp(-float3(absorbing.extinctCoff) * attenuationDistance), attenuationColor, 1e-5f), "the medium does not attenuate to attenuationColor at attenuationDistance", failures);
+            Check(IsClose(absorbing.scatterCoff, float3(0.0f), 0.0f), "a medium of albedo 0 scatters", failures);
+
+            const XMFLOAT3 albedo(0.5f, 0.9f, 1.0f);
+            const ParticipatingMedium scattering = makeVolumeMedium(attenuationColor, attenuationDistance, albedo, 0.4f);
+            const float3 expectedAlbedo(0.5f, 0.9f, MEDIA_TABLE_MAX_ALBEDO);
+            Check(IsClose(float3(scattering.scatterCoff) / float3(scattering.extinctCoff), expectedAlbedo, 1e-4f), "the scattering of the medium does not have the albedo", failures);
+            Check(IsClose(float3(scattering.extinctCoff) - float3(scattering.scatterCoff), absorbing.extinctCoff, 1e-3f), "the scattering changes the absorption of the medium", failures);
+            Check(scattering.hgAssymFactor == 0.4f, "the medium does not keep scatterAnisotropy", failures);
+
+            const ParticipatingMedium clear = makeVolumeMedium(XMFLOAT3(0.5f, 0.5f, 0.5f), std::numeric_limits<float>::max(), albedo, 0.0f);
+            Check(maxComponent(float3(clear.extinctCoff)) < 1e-30f, "the default attenuationDistance is not a clear medium", failures);
+
+            // the defaults of KHR_materials_volume and KHR_materials_transmission are thin walled and opaque
+            Check(!isVolumeMaterial(0.0f, 1.0f), "a thin walled material bounds a medium", failures);
+            Check(!isVolumeMaterial(1.0f, 0.0f), "an opaque material bounds a medium", failures);
+            Check(isVolumeMaterial(0.1f, 0.5f), "a thick transmissive material bounds no medium", failures);
+        }
+
+        // the air table is the gather of the push constants, also when a box of the same coefficients cuts the ray
+        {
+            const PushConstantRay pcRay = MakeSceneRayConstants(float3(0.0f, 0.0f, -14.0f), float3(0.0f), 0.8f, 1.0f, 64);
+            const BeamGatherConstants constants = MakeBeamGatherConstants(pcRay);
+            const std::vector<ParticipatingMedium> airMedia = BuildMediaTable(pcRay, {});
+            const std::vector<ParticipatingMedium> boxMedia = BuildMediaTable(pcRay, { makeAirMedium(pcRay.airScatterCoff, pcRay.airExtinctCoff, pcRay.airHGAssymFactor) });
+            const std::vector<SceneMediumBox> boxes = { { float3(-3.0f), float3(3.0f), 1 } };
+
+            GatherRay ray;
+            ray.origin = float3(0.0f, 0.0f, -14.0f);
+            ray.tMax = 19.0f;
+
+            GatherBeam beam;
+            beam.startPos = float3(-4.0f, 4.5f, 1.0f);
+            beam.lightColor = float3(1.0f, 0.8f, 0.6f);
+            beam.radius = 0.0f;
+
+            const float3 beamEnds[] = { float3(4.0f, -5.0f, 2.0f), float3(0.1f, -3.0f, 1.5f), float3(2.0f, 0.0f, -4.0f) };
+            bool isAirMatching = true;
+            bool isBoxMatching = true;
+            uint32_t numHits = 0;
+            for (const float3& beamEnd : beamEnds)
+            {
+                beam.length = length(beamEnd - float3(beam.startPos));
+                beam.direction = normalize(beamEnd - float3(beam.startPos));
+
+                // aimed at the middle of the beam
+                ray.direction = normalize(float3(beam.startPos) + beam.direction * (beam.length * 0.5f) - ray.origin);
+
+                float3 expected;
+                if (!GatherBeamRadiance(constants, ray, beam, expected))
+                    continue;
+                numHits++;
+
+                float3 radiance;
+                isAirMatching = isAirMatching && GatherMediaBeamRadiance(airMedia, {}, constants, ray, beam, MEDIA_TABLE_AIR_INDEX, radiance)
+                    && IsClose(radiance, expected, 1e-5f);
+
+                const uint32_t mediaIndex = FindMediumAt(boxes, float3(beam.startPos) + beam.direction * (beam.length * 0.5f));
+                isBoxMatching = isBoxMatching && GatherMediaBeamRadiance(boxMedia, boxes, constants, ray, beam, mediaIndex, radiance)
+                    && IsClose(radiance, expected, 1e-4f);
+            }
+
+            Check(numHits == std::size(beamEnds), "a test ray misses its beam", failures);
+            Check(isAirMatching, "the gather of the air table is not GatherBeamRadiance()", failures);
+            Check(isBoxMatching, "the gather through a box of the air is not GatherBeamRadiance()", failures);
+        }
+
+        // fog in the lower half of the room under the air of the light
+        {
+            const std::vector<SceneBox> scene = CreateCornellScene();
+            const PushConstantRay pcRay = MakeSceneRayConstants(float3(0.0f, 0.0f, -14.0f), float3(0.0f), 0.8f, 1.0f, 64);
+            const std::vector<ParticipatingMedium> media = BuildMediaTable(pcRay, { makeVolumeMedium(XMFLOAT3(0.3f, 0.4f, 0.5f), 8.0f, XMFLOAT3(0.8f, 0.8f, 0.8f), 0.5f) });
+            const std::vector<SceneMediumBox> boxes = { { float3(-4.9f), float3(4.9f, 0.0f, 4.9f), 1 } };
+
+            const uint32_t numLaunches = 4096;
+            const BeamEmissionLaunches launches = CreateMediaSceneEmissions(scene, media, boxes, numLaunches, 4, 7);
+
+            uint32_t numBeams[2] = {};
+            bool isRecorded = true;
+            bool isSplit = true;
+            double expectedCollisions = 0.0;
+            double variance = 0.0;
+            uint32_t numCollisions = 0;
+            for (const auto& emissions : launches)
+            {
+                for (const BeamEmission& emission : emissions)
+                {
+                    const float3 startPos = emission.beam.startPos;
+                    const float3 endPos = emission.beam.endPos;
+                    const float beamLength = length(endPos - startPos);
+                    const uint32_t mediaIndex = emission.beam.mediaIndex;
+
+                    isRecorded = isRecorded && mediaIndex == FindMediumAt(boxes, (startPos + endPos) * 0.5f);
+                    isSplit = isSplit && FindNextMediumBoundary(boxes, startPos, emission.direction, c_rayTMin, beamLength * 0.999f) == beamLength * 0.999f;
+                    numBeams[std::min(mediaIndex, 1u)]++;
+
+                    if (mediaIndex != 1)
+                        continue;
+
+                    // the free path of the hero channel in the fog up to its surface or its boundary
+                    SceneHit hit;
+                    const float tSurface = TraceScene(scene, startPos, emission.direction, c_rayTMin, c_missBeamLength, hit) ? hit.t : c_missBeamLength;
+                    const float tEnd = FindNextMediumBoundary(boxes, startPos, emission.direction, c_rayTMin, tSurface);
+
+                    float heroExtinctCoff;
+                    float heroScatterCoff;
+                    SelectHeroChannel(media[mediaIndex], heroExtinctCoff, heroScatterCoff);
+                    const double transmittance = std::exp(-double(heroExtinctCoff) * tEnd);
+
+                    expectedCollisions += 1.0 - transmittance;
+                    variance += transmittance * (1.0 - transmittance);
+                    numCollisions += beamLength < tEnd * 0.999f ? 1 : 0;
+                }
+            }
+
+            Check(isRecorded, "a beam does not record the medium it runs through", failures);
+            Check(isSplit, "a beam crosses a medium boundary", failures);
+            Check(numBeams[0] > numLaunches / 4 && numBeams[1] > numLaunches / 4, "the emission does not reach both media", failures);
+            Check(std::abs(double(numCollisions) - expectedCollisions) < 4.0 * std::sqrt(variance) + 1.0, "the emission does not scatter in the fog as often as its transmittance says", failures);
+        }
+
+        return failures;
+    }
+}
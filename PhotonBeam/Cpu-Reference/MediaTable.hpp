@@ -0,0 +1,87 @@
+#pragma once
+
+#include "CpuVector.hpp"
+#include "BeamGather.hpp"
+#include "BeamInstanceList.hpp"
+#include "CornellScene.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+#include "../Shaders/util/MediaTable.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Homogeneous media of util/MediaTable.h in the Cornell scene, clear air and dense fog side by side.
+//
+// The push constants hold one medium for the whole scene, so a fog bank raises the scattering of every beam and with
+// it the beam budget the scene needs. The media table keeps the air at index 0 and a medium per KHR_materials_volume
+// material after it. Here boxes of the scene stand in for the volume meshes, the medium of a point is the one of the
+// last box holding it, the air outside of all of them.
+//
+// The emission ends a beam where its ray crosses a box boundary and records the medium it ran through in
+// PhotonBeam::mediaIndex, the next beam goes on from there without counting as a bounce. The gather takes the
+// scattering, the extinction and the phase function of the beam from its medium, and the transmittance along the
+// camera ray through all the media it crosses. The shaders do not read the table yet, see util/MediaTable.h.
+namespace CpuReference
+{
+    struct SceneMediumBox
+    {
+        float3 boundsMin;
+        float3 boundsMax;
+
+        // index into the media table, 1 + the index of GltfScene::GetMedia()
+        uint32_t mediaIndex;
+    };
+
+    // the air of the push constants, then the scene media
+    std::vector<ParticipatingMedium> BuildMediaTable(const PushConstantRay& pc, const std::vector<ParticipatingMedium>& sceneMedia);
+
+    // media index at position
+    uint32_t FindMediumAt(const std::vector<SceneMediumBox>& boxes, const float3& position);
+
+    // nearest box boundary along the ray within (tMin, tMax), tMax when there is none
+    float FindNextMediumBoundary(const std::vector<SceneMediumBox>& boxes, const float3& origin, const float3& direction, float tMin, float tMax);
+
+    // extinctCoff integrated along the ray over [0, tMax], medium by medium
+    float3 MediaOpticalDepth(
+        const std::vector<ParticipatingMedium>& media,
+        const std::vector<SceneMediumBox>& boxes,
+        const float3& origin,
+        const float3& direction,
+        float tMax
+    );
+
+    // CreateSceneEmissions() through the media. The free path is sampled in the channel of the least absorption as
+    // randomScatterOccured() of BeamClosestHit.hlsl does, the other channels carry the ratio of the transmittances.
+    // A collision ends the beam and the launch goes on in a Henyey-Greenstein direction of the medium after the
+    // roulette of the albedo. The launches draw from rngInitSeed(launch, seed).
+    BeamEmissionLaunches CreateMediaSceneEmissions(
+        const std::vector<SceneBox>& scene,
+        const std::vector<ParticipatingMedium>& media,
+        const std::vector<SceneMediumBox>& boxes,
+        uint32_t numLaunches,
+        uint32_t maxBeamsPerLaunch,
+        uint32_t seed
+    );
+
+    // GatherBeamRadiance() of a beam in media[mediaIndex], returns false when the ray misses the beam.
+    // pc gives the radius and the number of beam sources, not the medium.
+    bool GatherMediaBeamRadiance(
+        const std::vector<ParticipatingMedium>& media,
+        const std::vector<SceneMediumBox>& boxes,
+        const BeamGatherConstants& pc,
+        const GatherRay& ray,
+        const GatherBeam& beam,
+        uint32_t mediaIndex,
+        float3& radiance
+    );
+
+    // Checks
+    //  that makeVolumeMedium() gives the attenuation color at the attenuation distance and the albedo of the scattering
+    //  that only thick transmissive materials bound a medium
+    //  that the gather of the air table, with or without a box of the air, is GatherBeamRadiance()
+    //  that the emission records the medium of every beam, splits beams at the boundaries and scatters in a fog box
+    //  as often as its transmittance says
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidateMediaTable();
+}
@@ -0,0 +1,37 @@
+
+#pragma once
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace CpuReference
+{
+    // 0 becomes std::thread::hardware_concurrency(), at least 1
+    inline uint32_t ResolveThreadCount(uint32_t numThreads)
+    {
+        if (numThreads == 0)
+            numThreads = std::thread::hardware_concurrency();
+        return numThreads == 0 ? 1 : numThreads;
+    }
+
+    // Splits [0, count) between the threads and runs func(threadIndex, begin, end) on each of them
+    template <class Func>
+    void ParallelFor(uint32_t numThreads, uint64_t count, const Func& func)
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(numThreads);
+
+        for (uint32_t threadIndex = 0; threadIndex < numThreads; threadIndex++)
+        {
+            uint64_t begin = count * threadIndex / numThreads;
+            uint64_t end = count * (threadIndex + 1) / numThreads;
+            threads.emplace_back(func, threadIndex, begin, end);
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+}
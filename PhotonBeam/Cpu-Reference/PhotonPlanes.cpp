@@ -0,0 +1,682 @@
+
+#include "PhotonPlanes.hpp"
+#include "BeamOcclusion.hpp"
+#include "ParallelFor.hpp"
+#include "ProgressiveBeams.hpp"
+#include "RayTracingSampling.hpp"
+
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // the seeds of the reference start this far from the seeds of the estimators
+        constexpr uint32_t c_referenceSeedOffset = 1u << 24;
+
+        // a ray this close to the plane of a photon plane misses it
+        constexpr float c_minPlaneDet = 1e-6f;
+
+        bool IsInsideRoom(const float3& point)
+        {
+            const float size = c_cornellRoomSize + 1e-4f;
+            return std::abs(point.x) <= size && std::abs(point.y) <= size && std::abs(point.z) <= size;
+        }
+
+        // distance from a point of the room along direction to the faces of the room
+        float RoomExitDistance(const float3& point, const float3& direction)
+        {
+            float distance = FLT_MAX;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (direction[axis] > 0.0f)
+                    distance = std::min(distance, (c_cornellRoomSize - point[axis]) / direction[axis]);
+                else if (direction[axis] < 0.0f)
+                    distance = std::min(distance, (-c_cornellRoomSize - point[axis]) / direction[axis]);
+            }
+            return std::max(distance, 0.0f);
+        }
+
+        // The largest RoomExitDistance() of the beam points in the room. The exit is the minimum of one linear function
+        // of s per axis, its maximum is at an end of the beam in the room or where two of the functions cross.
+        float FarthestRoomExit(const float3& origin, const float3& beamDirection, float beamLength, const float3& scatterDirection)
+        {
+            float sMin = 0.0f;
+            float sMax = beamLength;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (beamDirection[axis] == 0.0f)
+                    continue;
+
+                float s0 = (-c_cornellRoomSize - origin[axis]) / beamDirection[axis];
+                float s1 = (c_cornellRoomSize - origin[axis]) / beamDirection[axis];
+                if (s0 > s1)
+                    std::swap(s0, s1);
+                sMin = std::max(sMin, s0);
+                sMax = std::min(sMax, s1);
+            }
+            if (sMin > sMax)
+                return 0.0f;
+
+            float offsets[3];
+            float slopes[3];
+            int numFaces = 0;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (scatterDirection[axis] == 0.0f)
+                    continue;
+
+                const float face = scatterDirection[axis] > 0.0f ? c_cornellRoomSize : -c_cornellRoomSize;
+                offsets[numFaces] = (face - origin[axis]) / scatterDirection[axis];
+                slopes[numFaces] = -beamDirection[axis] / scatterDirection[axis];
+                numFaces++;
+            }
+
+            const auto exitAt = [&](float s)
+            {
+                float distance = FLT_MAX;
+                for (int i = 0; i < numFaces; i++)
+                    distance = std::min(distance, offsets[i] + slopes[i] * s);
+                return std::max(distance, 0.0f);
+            };
+
+            float farthest = std::max(exitAt(sMin), exitAt(sMax));
+            for (int i = 0; i < numFaces; i++)
+            {
+                for (int j = i + 1; j < numFaces; j++)
+                {
+                    if (slopes[i] == slopes[j])
+                        continue;
+
+                    const float s = (offsets[j] - offsets[i]) / (slopes[i] - slopes[j]);
+                    if (s > sMin && s < sMax)
+                        farthest = std::max(farthest, exitAt(s));
+                }
+            }
+            return farthest;
+        }
+
+        float Determinant(const float3& a, const float3& b, const float3& c)
+        {
+            return dot(a, cross(b, c));
+        }
+
+        struct PlaneView
+        {
+            std::vector<SceneBox> scene;
+            PushConstantRay pc;
+            BeamGatherConstants constants;
+            std::vector<GatherRay> pixelRays;
+        };
+
+        PlaneView CreatePlaneView(const PhotonPlaneBenchmarkSettings& settings)
+        {
+            PlaneView view;
+            view.scene = CreateCornellScene();
+            view.pc = MakeSceneRayConstants(settings.eye, settings.target, settings.fovY, float(settings.width) / float(settings.height), settings.numLaunches);
+            view.pc.beamRadius = settings.beamRadius;
+            view.constants = MakeBeamGatherConstants(view.pc);
+
+            const OcclusionCamera camera = MakeOcclusionCamera(view.pc, settings.width, settings.height);
+            view.pixelRays.resize(size_t(settings.width) * settings.height);
+            for (uint32_t y = 0; y < settings.height; y++)
+            {
+                for (uint32_t x = 0; x < settings.width; x++)
+                {
+                    GatherRay ray = MakePrimaryRay(camera, x, y);
+                    SceneHit hit;
+                    if (TraceScene(view.scene, ray.origin, ray.direction, c_rayTMin, c_rayTMaxDefault, hit))
+                        ray.tMax = hit.t;
+                    view.pixelRays[size_t(y) * settings.width + x] = ray;
+                }
+            }
+            return view;
+        }
+
+        struct FrameStats
+        {
+            uint64_t numNodeTests = 0;
+            uint64_t numPrimitiveTests = 0;
+            uint64_t numHits = 0;
+        };
+
+        // the image of the planes or the scattered beams of one frame of launches, through their BVH
+        void RenderFrame(
+            const PlaneView& view,
+            const PhotonPlaneBenchmarkSettings& settings,
+            bool isPlanes,
+            uint32_t seed,
+            std::vector<float3>& image,
+            FrameStats& stats
+        )
+        {
+            const BeamEmissionLaunches launches = CreateSceneEmissions(view.scene, settings.numLaunches, settings.maxBeamsPerLaunch, seed);
+
+            std::vector<PhotonPlane> planes;
+            std::vector<GatherBeam> beams;
+            std::vector<float3> boundsMin;
+            std::vector<float3> boundsMax;
+            if (isPlanes)
+            {
+                planes = CreateScenePhotonPlanes(launches, view.pc.airHGAssymFactor, seed);
+                boundsMin.resize(planes.size());
+                boundsMax.resize(planes.size());
+                for (size_t i = 0; i < planes.size(); i++)
+                    GetPhotonPlaneBounds(planes[i], boundsMin[i], boundsMax[i]);
+            }
+            else
+            {
+                for (const auto& beam : CreateSceneScatteredBeams(view.scene, launches, view.pc, seed))
+                {
+                    beams.push_back(LoadGatherBeam(beam));
+                    boundsMin.push_back(min(float3(beam.startPos), float3(beam.endPos)) - view.constants.beamRadius);
+                    boundsMax.push_back(max(float3(beam.startPos), float3(beam.endPos)) + view.constants.beamRadius);
+                }
+            }
+
+            BoundsBvh bvh;
+            bvh.Build(boundsMin, boundsMax);
+
+            const uint32_t numThreads = ResolveThreadCount(settings.numThreads);
+            std::vector<FrameStats> threadStats(numThreads);
+            image.assign(view.pixelRays.size(), float3(0.0f));
+            ParallelFor(numThreads, view.pixelRays.size(), [&](uint32_t threadIndex, uint64_t begin, uint64_t end)
+            {
+                FrameStats& frameStats = threadStats[threadIndex];
+                for (uint64_t pixel = begin; pixel < end; pixel++)
+                {
+                    const GatherRay& ray = view.pixelRays[pixel];
+                    float3 radiance(0.0f);
+                    bvh.Traverse(ray, [&](uint32_t primitive)
+                    {
+                        frameStats.numPrimitiveTests++;
+                        const float3 primitiveRadiance = isPlanes
+                            ? GatherPhotonPlaneRadiance(view.scene, view.constants, ray, planes[primitive])
+                            : GatherScatteredBeamRadiance(view.constants, ray, beams[primitive]);
+                        if (primitiveRadiance.x > 0.0f || primitiveRadiance.y > 0.0f || primitiveRadiance.z > 0.0f)
+                        {
+                            frameStats.numHits++;
+                            radiance += primitiveRadiance;
+                        }
+                    }, frameStats.numNodeTests);
+                    image[pixel] = radiance;
+                }
+            });
+
+            for (const auto& frameStats : threadStats)
+            {
+                stats.numNodeTests += frameStats.numNodeTests;
+                stats.numPrimitiveTests += frameStats.numPrimitiveTests;
+                stats.numHits += frameStats.numHits;
+            }
+        }
+
+        // mean of numFrames frames from seed
+        std::vector<float3> RenderAverage(const PlaneView& view, const PhotonPlaneBenchmarkSettings& settings, bool isPlanes, uint32_t seed, uint32_t numFrames)
+        {
+            std::vector<float3> average(view.pixelRays.size(), float3(0.0f));
+            std::vector<float3> image;
+            FrameStats stats;
+            for (uint32_t i = 0; i < numFrames; i++)
+            {
+                RenderFrame(view, settings, isPlanes, seed + i, image, stats);
+                for (size_t j = 0; j < image.size(); j++)
+                    average[j] += image[j] / float(numFrames);
+            }
+            return average;
+        }
+
+        double MeanChannel(const std::vector<float3>& image)
+        {
+            double sum = 0.0;
+            for (const auto& radiance : image)
+                sum += (double(radiance.x) + radiance.y + radiance.z) / 3.0;
+            return image.empty() ? 0.0 : sum / double(image.size());
+        }
+
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+    }
+
+    std::vector<PhotonPlane> CreateScenePhotonPlanes(const BeamEmissionLaunches& launches, float hgAssymFactor, uint32_t seed)
+    {
+        std::vector<PhotonPlane> planes;
+        uint32_t beamIndex = 0;
+        for (const auto& emissions : launches)
+        {
+            for (const auto& emission : emissions)
+            {
+                if (!emission.airSubBeams)
+                    continue;
+
+                uint32_t rngSeed = rngInitSeed(beamIndex++, seed);
+                const GatherBeam beam = LoadGatherBeam(emission.beam);
+                if (!(beam.length > 0.0f))
+                    continue;
+
+                PhotonPlane plane;
+                plane.origin = beam.startPos;
+                plane.beamDirection = beam.direction;
+                plane.beamLength = beam.length;
+                plane.scatterDirection = heneyGreenPhaseFuncSampling(rngSeed, beam.direction, hgAssymFactor);
+                plane.scatterLength = FarthestRoomExit(plane.origin, plane.beamDirection, plane.beamLength, plane.scatterDirection);
+                plane.lightColor = beam.lightColor;
+                if (plane.scatterLength > 0.0f)
+                    planes.push_back(plane);
+            }
+        }
+        return planes;
+    }
+
+    std::vector<PhotonBeam> CreateSceneScatteredBeams(
+        const std::vector<SceneBox>& scene,
+        const BeamEmissionLaunches& launches,
+        const PushConstantRay& pc,
+        uint32_t seed
+    )
+    {
+        std::vector<PhotonBeam> beams;
+        uint32_t beamIndex = 0;
+        for (const auto& emissions : launches)
+        {
+            for (const auto& emission : emissions)
+            {
+                if (!emission.airSubBeams)
+                    continue;
+
+                uint32_t rngSeed = rngInitSeed(beamIndex++, seed);
+                const GatherBeam beam = LoadGatherBeam(emission.beam);
+                if (!(beam.length > 0.0f))
+                    continue;
+
+                const float3 direction = heneyGreenPhaseFuncSampling(rngSeed, beam.direction, pc.airHGAssymFactor);
+                const float s = rnd(rngSeed) * beam.length;
+                const float3 start = beam.startPos + beam.direction * s;
+                if (!IsInsideRoom(start))
+                    continue;
+
+                float length = RoomExitDistance(start, direction);
+                SceneHit hit;
+                if (TraceScene(scene, start, direction, c_rayTMin, length, hit))
+                    length = hit.t;
+                if (!(length > 0.0f))
+                    continue;
+
+                // the point is picked with the pdf 1 / beam length
+                const float3 lightColor = beam.lightColor * exp(-float3(pc.airExtinctCoff) * s) * float3(pc.airScatterCoff) * beam.length;
+
+                PhotonBeam scatteredBeam = {};
+                scatteredBeam.startPos = start.ToXMFLOAT3();
+                scatteredBeam.endPos = (start + direction * length).ToXMFLOAT3();
+                scatteredBeam.lightColor = lightColor.ToXMFLOAT3();
+                scatteredBeam.hitInstanceID = -1;
+                beams.push_back(scatteredBeam);
+            }
+        }
+        return beams;
+    }
+
+    bool IntersectPhotonPlane(const PhotonPlane& plane, const GatherRay& ray, PhotonPlaneHit& hit)
+    {
+        // s d0 + u d1 - t w = o - x0, by Cramer's rule
+        const float3 negDirection = -ray.direction;
+        const float det = Determinant(plane.beamDirection, plane.scatterDirection, negDirection);
+        if (std::abs(det) < c_minPlaneDet)
+            return false;
+
+        const float3 offset = ray.origin - plane.origin;
+        const float invDet = 1.0f / det;
+        hit.s = Determinant(offset, plane.scatterDirection, negDirection) * invDet;
+        hit.u = Determinant(plane.beamDirection, offset, negDirection) * invDet;
+        hit.t = Determinant(plane.beamDirection, plane.scatterDirection, offset) * invDet;
+        hit.absDet = std::abs(det);
+
+        return hit.s >= 0.0f && hit.s <= plane.beamLength
+            && hit.u >= 0.0f && hit.u <= plane.scatterLength
+            && hit.t >= 0.0f && hit.t <= ray.tMax;
+    }
+
+    float3 GatherPhotonPlaneRadiance(const std::vector<SceneBox>& scene, const BeamGatherConstants& constants, const GatherRay& ray, const PhotonPlane& plane)
+    {
+        PhotonPlaneHit hit;
+        if (!IntersectPhotonPlane(plane, ray, hit))
+            return float3(0.0f);
+
+        const float3 scatterPoint = plane.origin + plane.beamDirection * hit.s;
+        const float3 point = scatterPoint + plane.scatterDirection * hit.u;
+        if (!IsInsideRoom(scatterPoint) || !IsInsideRoom(point))
+            return float3(0.0f);
+
+        SceneHit occluder;
+        if (TraceScene(scene, scatterPoint, plane.scatterDirection, c_rayTMin, hit.u, occluder))
+            return float3(0.0f);
+
+        const float phaseVal = heneyGreenPhaseFunc(dot(-ray.direction, plane.scatterDirection), constants.airHGAssymFactor);
+        return constants.airScatterCoff * constants.airScatterCoff * exp(-constants.airExtinctCoff * (hit.s + hit.u + hit.t)) * phaseVal
+            * plane.lightColor / (constants.numBeamSources * hit.absDet);
+    }
+
+    float3 GatherScatteredBeamRadiance(const BeamGatherConstants& constants, const GatherRay& ray, const GatherBeam& beam)
+    {
+        const float beamRadius = getGatherBeamRadius(beam.radius, constants.beamRadius);
+
+        // nearest points of the ray and the beam lines
+        const float3 normal = cross(ray.direction, beam.direction);
+        const float sinSquare = dot(normal, normal);
+        if (sinSquare < 1e-8f)
+            return float3(0.0f);
+
+        const float3 offset = beam.startPos - ray.origin;
+        const float tCurr = dot(cross(offset, beam.direction), normal) / sinSquare;
+        const float beamDist = dot(cross(offset, ray.direction), normal) / sinSquare;
+        const float beamRaySinVal = std::sqrt(sinSquare);
+        if (tCurr < 0.0f || tCurr > ray.tMax || beamDist < 0.0f || beamDist > beam.length
+            || std::abs(dot(offset, normal)) > beamRadius * beamRaySinVal)
+            return float3(0.0f);
+
+        const float phaseVal = heneyGreenPhaseFunc(dot(-ray.direction, beam.direction), constants.airHGAssymFactor);
+        return constants.airScatterCoff * exp(-constants.airExtinctCoff * (tCurr + beamDist)) * phaseVal
+            * beam.lightColor / (constants.numBeamSources * 2.0f * beamRadius * beamRaySinVal);
+    }
+
+    void GetPhotonPlaneBounds(const PhotonPlane& plane, float3& boundsMin, float3& boundsMax)
+    {
+        const float3 beamEnd = plane.beamDirection * plane.beamLength;
+        const float3 scatterEnd = plane.scatterDirection * plane.scatterLength;
+        boundsMin = plane.origin + min(float3(0.0f), beamEnd) + min(float3(0.0f), scatterEnd);
+        boundsMax = plane.origin + max(float3(0.0f), beamEnd) + max(float3(0.0f), scatterEnd);
+    }
+
+    void BoundsBvh::Build(const std::vector<float3>& boundsMin, const std::vector<float3>& boundsMax)
+    {
+        const uint32_t numPrimitives = uint32_t(boundsMin.size());
+        m_nodes.clear();
+        m_primitives.resize(numPrimitives);
+        std::iota(m_primitives.begin(), m_primitives.end(), 0u);
+        if (numPrimitives == 0)
+            return;
+
+        struct BuildTask
+        {
+            uint32_t node;
+            uint32_t begin;
+            uint32_t end;
+        };
+
+        m_nodes.reserve(size_t(numPrimitives) * 2);
+        m_nodes.push_back({});
+        std::vector<BuildTask> tasks = { { 0, 0, numPrimitives } };
+        while (!tasks.empty())
+        {
+            const BuildTask task = tasks.back();
+            tasks.pop_back();
+
+            BoundsBvhNode node;
+            node.boundsMin = float3(FLT_MAX);
+            node.boundsMax = float3(-FLT_MAX);
+            float3 centerMin(FLT_MAX);
+            float3 centerMax(-FLT_MAX);
+            for (uint32_t i = task.begin; i < task.end; i++)
+            {
+                const uint32_t primitive = m_primitives[i];
+                node.boundsMin = min(node.boundsMin, boundsMin[primitive]);
+                node.boundsMax = max(node.boundsMax, boundsMax[primitive]);
+                const float3 center = (boundsMin[primitive] + boundsMax[primitive]) * 0.5f;
+                centerMin = min(centerMin, center);
+                centerMax = max(centerMax, center);
+            }
+
+            if (task.end - task.begin <= c_maxLeafSize)
+            {
+                node.first = task.begin;
+                node.count = task.end - task.begin;
+                m_nodes[task.node] = node;
+                continue;
+            }
+
+            const float3 extent = centerMax - centerMin;
+            const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+            const uint32_t middle = task.begin + (task.end - task.begin) / 2;
+            std::nth_element(
+                m_primitives.begin() + task.begin,
+                m_primitives.begin() + middle,
+                m_primitives.begin() + task.end,
+                [&](uint32_t a, uint32_t b)
+                {
+                    return boundsMin[a][axis] + boundsMax[a][axis] < boundsMin[b][axis] + boundsMax[b][axis];
+                }
+            );
+
+            node.first = uint32_t(m_nodes.size());
+            node.count = 0;
+            m_nodes[task.node] = node;
+            m_nodes.push_back({});
+            m_nodes.push_back({});
+            tasks.push_back({ node.first, task.begin, middle });
+            tasks.push_back({ node.first + 1, middle, task.end });
+        }
+    }
+
+    std::string ValidatePhotonPlanes()
+    {
+        std::string failures;
+
+        // the coordinates of the point a ray is aimed at
+        {
+            PhotonPlane plane = {};
+            plane.origin = float3(-1.0f, 2.0f, 0.5f);
+            plane.beamDirection = normalize(float3(1.0f, -0.5f, 0.2f));
+            plane.beamLength = 4.0f;
+            plane.scatterDirection = normalize(float3(-0.3f, -1.0f, 0.6f));
+            plane.scatterLength = 3.0f;
+            plane.lightColor = float3(1.0f);
+
+            const float3 target = plane.origin + plane.beamDirection * 2.5f + plane.scatterDirection * 1.25f;
+            GatherRay ray;
+            ray.origin = float3(0.5f, 0.0f, -8.0f);
+            ray.direction = normalize(target - ray.origin);
+            ray.tMax = c_rayTMaxDefault;
+
+            PhotonPlaneHit hit;
+            const bool isHit = IntersectPhotonPlane(plane, ray, hit);
+            Check(isHit && std::abs(hit.s - 2.5f) < 1e-4f && std::abs(hit.u - 1.25f) < 1e-4f
+                && std::abs(hit.t - length(target - ray.origin)) < 1e-3f, "intersection: plane coordinates", failures);
+            Check(isHit && std::abs(hit.absDet - std::abs(Determinant(plane.beamDirection, plane.scatterDirection, ray.direction))) < 1e-6f,
+                "intersection: Jacobian", failures);
+
+            ray.tMax = hit.t * 0.5f;
+            Check(!IntersectPhotonPlane(plane, ray, hit), "intersection: hits past tMax are missed", failures);
+        }
+
+        PhotonPlaneBenchmarkSettings settings;
+        settings.width = 24;
+        settings.height = 14;
+        settings.numLaunches = 128;
+        const PlaneView view = CreatePlaneView(settings);
+        const BeamEmissionLaunches launches = CreateSceneEmissions(view.scene, settings.numLaunches, settings.maxBeamsPerLaunch, 5);
+        const std::vector<PhotonPlane> planes = CreateScenePhotonPlanes(launches, view.pc.airHGAssymFactor, 5);
+
+        // the planes stay in the room and reach its farthest exit
+        {
+            bool isInside = true;
+            bool isFarthest = true;
+            for (const auto& plane : planes)
+            {
+                float farthest = 0.0f;
+                for (uint32_t i = 0; i <= 64; i++)
+                {
+                    const float3 point = plane.origin + plane.beamDirection * (plane.beamLength * float(i) / 64.0f);
+                    if (!IsInsideRoom(point))
+                        continue;
+
+                    const float exit = RoomExitDistance(point, plane.scatterDirection);
+                    farthest = std::max(farthest, exit);
+                    isInside = isInside && exit <= plane.scatterLength + 1e-3f;
+                }
+                isFarthest = isFarthest && plane.scatterLength <= farthest + plane.beamLength / 64.0f + 1e-3f;
+            }
+            Check(!planes.empty(), "planes: one per air beam", failures);
+            Check(isInside, "planes: reach the exit of every beam point", failures);
+            Check(isFarthest, "planes: end at the farthest exit", failures);
+        }
+
+        // the BVH gathers what the loops gather
+        {
+            const std::vector<PhotonBeam> scatteredBeams = CreateSceneScatteredBeams(view.scene, launches, view.pc, 5);
+            std::vector<float3> planeMin(planes.size());
+            std::vector<float3> planeMax(planes.size());
+            for (size_t i = 0; i < planes.size(); i++)
+                GetPhotonPlaneBounds(planes[i], planeMin[i], planeMax[i]);
+
+            std::vector<GatherBeam> beams;
+            std::vector<float3> beamMin;
+            std::vector<float3> beamMax;
+            for (const auto& beam : scatteredBeams)
+            {
+                beams.push_back(LoadGatherBeam(beam));
+                beamMin.push_back(min(float3(beam.startPos), float3(beam.endPos)) - view.constants.beamRadius);
+                beamMax.push_back(max(float3(beam.startPos), float3(beam.endPos)) + view.constants.beamRadius);
+            }
+
+            BoundsBvh planeBvh;
+            planeBvh.Build(planeMin, planeMax);
+            BoundsBvh beamBvh;
+            beamBvh.Build(beamMin, beamMax);
+
+            bool isSamePlanes = true;
+            bool isSameBeams = true;
+            bool hasPlaneRadiance = false;
+            uint64_t numNodeTests = 0;
+            for (const GatherRay& ray : view.pixelRays)
+            {
+                float3 planeLoop(0.0f);
+                for (const auto& plane : planes)
+                    planeLoop += GatherPhotonPlaneRadiance(view.scene, view.constants, ray, plane);
+                float3 planeTree(0.0f);
+                planeBvh.Traverse(ray, [&](uint32_t i) { planeTree += GatherPhotonPlaneRadiance(view.scene, view.constants, ray, planes[i]); }, numNodeTests);
+
+                float3 beamLoop(0.0f);
+                for (const auto& beam : beams)
+                    beamLoop += GatherScatteredBeamRadiance(view.constants, ray, beam);
+                float3 beamTree(0.0f);
+                beamBvh.Traverse(ray, [&](uint32_t i) { beamTree += GatherScatteredBeamRadiance(view.constants, ray, beams[i]); }, numNodeTests);
+
+                isSamePlanes = isSamePlanes && maxComponent(max(planeLoop - planeTree, planeTree - planeLoop)) <= maxComponent(planeLoop) * 1e-4f;
+                isSameBeams = isSameBeams && maxComponent(max(beamLoop - beamTree, beamTree - beamLoop)) <= maxComponent(beamLoop) * 1e-4f;
+                hasPlaneRadiance = hasPlaneRadiance || maxComponent(planeLoop) > 0.0f;
+            }
+            Check(hasPlaneRadiance, "bvh: the planes are seen", failures);
+            Check(isSamePlanes, "bvh: planes of the loop", failures);
+            Check(isSameBeams, "bvh: scattered beams of the loop", failures);
+        }
+
+        // the same light, with less noise per frame for the planes
+        {
+            const uint32_t numFrames = 32;
+            const std::vector<float3> planeAverage = RenderAverage(view, settings, true, settings.seed, numFrames);
+            const std::vector<float3> beamAverage = RenderAverage(view, settings, false, settings.seed, numFrames);
+            const double planeMean = MeanChannel(planeAverage);
+            const double beamMean = MeanChannel(beamAverage);
+            Check(planeMean > 0.0 && std::abs(beamMean / planeMean - 1.0) < 0.1, "estimators: the same light", failures);
+
+            const std::vector<float3> reference = RenderAverage(view, settings, true, settings.seed + c_referenceSeedOffset, numFrames);
+            std::vector<float3> image;
+            FrameStats stats;
+            double planeError = 0.0;
+            double beamError = 0.0;
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                RenderFrame(view, settings, true, settings.seed + i, image, stats);
+                planeError += ImageRmse(image, reference);
+                RenderFrame(view, settings, false, settings.seed + i, image, stats);
+                beamError += ImageRmse(image, reference);
+            }
+            Check(planeError < beamError, "estimators: the planes have the smaller error per frame", failures);
+        }
+
+        return failures;
+    }
+
+    std::vector<PhotonPlaneBenchmarkResult> RunPhotonPlaneBenchmark(const PhotonPlaneBenchmarkSettings& settings)
+    {
+        const PlaneView view = CreatePlaneView(settings);
+        const std::vector<float3> reference = RenderAverage(view, settings, true, settings.seed + c_referenceSeedOffset, settings.numReferenceFrames);
+        const double referenceMean = MeanChannel(reference);
+        const double numRays = double(view.pixelRays.size());
+
+        std::vector<PhotonPlaneBenchmarkResult> results;
+        for (bool isPlanes : { false, true })
+        {
+            PhotonPlaneBenchmarkResult result;
+            result.estimator = isPlanes ? "planes" : "beams";
+
+            std::vector<float3> sum(view.pixelRays.size(), float3(0.0f));
+            std::vector<float3> image;
+            FrameStats stats;
+            double seconds = 0.0;
+            while (seconds < settings.secondsPerEstimator)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                RenderFrame(view, settings, isPlanes, settings.seed + result.numFrames, image, stats);
+                seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                if (result.numFrames == 0)
+                    result.firstFrameRmse = ImageRmse(image, reference);
+                for (size_t i = 0; i < sum.size(); i++)
+                    sum[i] += image[i];
+                result.numFrames++;
+            }
+
+            for (auto& radiance : sum)
+                radiance = radiance / float(result.numFrames);
+
+            const double numFrameRays = numRays * result.numFrames;
+            result.secondsPerFrame = seconds / result.numFrames;
+            result.nodeTests = double(stats.numNodeTests) / numFrameRays;
+            result.primitiveTests = double(stats.numPrimitiveTests) / numFrameRays;
+            result.hits = double(stats.numHits) / numFrameRays;
+            result.rmse = ImageRmse(sum, reference);
+            result.relativeRmse = referenceMean > 0.0 ? result.rmse / referenceMean : 0.0;
+            results.push_back(result);
+        }
+
+        return results;
+    }
+
+    std::string FormatPhotonPlaneBenchmarkResults(const std::vector<PhotonPlaneBenchmarkResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-7s %4u frames %8.2f ms/frame  per ray: nodes %7.1f  tests %7.1f  hits %6.2f  rmse first frame %.4g, all frames %.4g (%.2f%%)\n",
+                result.estimator.c_str(),
+                result.numFrames,
+                result.secondsPerFrame * 1e3,
+                result.nodeTests,
+                result.primitiveTests,
+                result.hits,
+                result.firstFrameRmse,
+                result.rmse,
+                result.relativeRmse * 100.0
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "CpuVector.hpp"
+#include "BeamGather.hpp"
+#include "CornellScene.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Photon planes (Bitterli and Jarosz 2017) for the light scattering twice in the medium of the Cornell scene.
+//
+// The beams of CreateSceneEmissions() carry the light from surface to surface and their gather is the light a camera
+// ray scatters off them once. A path scattering along a beam, then again into the camera, has one more medium vertex.
+// Its beam estimator picks a point along the beam, samples the phase function there and traces a scattered beam,
+// which the camera ray gathers with a 1D blur. A photon plane keeps the sampled direction and sweeps it along the
+// whole beam instead, the parallelogram
+//   x(s, u) = start + s d0 + u d1,   s in [0, beam length], u in [0, scatter length]
+// The camera ray o + t w meets the plane in one point, where the integral of the path over s, u and t is
+//   sigma_s^2 phase(-w . d1) exp(-sigma_t (s + u + t)) lightColor / (numBeamSources |det(d0, d1, w)|)
+// without a blur. The phase function of the first scattering cancels with the sampling of d1.
+//
+// Both estimators keep the medium of this path inside the room, the open front included: the scattered beams end
+// at the room and the planes reach the farthest exit of the room along d1. A plane hit counts when it is inside the
+// room and x(s, 0) sees it.
+namespace CpuReference
+{
+    struct PhotonPlane
+    {
+        float3 origin;
+        float3 beamDirection;
+        float beamLength;
+
+        // phase function sample at the beam, swept along it
+        float3 scatterDirection;
+        float scatterLength;
+
+        // color of the beam at origin
+        float3 lightColor;
+    };
+
+    // ray-plane intersection, s along the beam, u along the scattered direction and t along the ray
+    struct PhotonPlaneHit
+    {
+        float s;
+        float u;
+        float t;
+
+        // |det(d0, d1, w)|, the Jacobian of the plane and the ray
+        float absDet;
+    };
+
+    // one plane per air beam of the launches, seed draws the scattered directions
+    std::vector<PhotonPlane> CreateScenePhotonPlanes(const BeamEmissionLaunches& launches, float hgAssymFactor, uint32_t seed);
+
+    // One scattered beam per air beam of the launches, from a point picked uniformly along the beam to the scene or
+    // the room. It takes the direction the plane of the same seed takes, its color is divided by the pdf of the point.
+    std::vector<PhotonBeam> CreateSceneScatteredBeams(
+        const std::vector<SceneBox>& scene,
+        const BeamEmissionLaunches& launches,
+        const PushConstantRay& pc,
+        uint32_t seed
+    );
+
+    // hits within the plane and [0, ray.tMax], false for a ray in the plane
+    bool IntersectPhotonPlane(const PhotonPlane& plane, const GatherRay& ray, PhotonPlaneHit& hit);
+
+    // the radiance of the plane along the ray, 0 when the plane misses, leaves the room or is occluded
+    float3 GatherPhotonPlaneRadiance(const std::vector<SceneBox>& scene, const BeamGatherConstants& constants, const GatherRay& ray, const PhotonPlane& plane);
+
+    // BeamAnyHit without its kernel, the constant 1 / (2 r) across the beam,
+    // for the beams whose nearest point to the ray is within the beam and the ray
+    float3 GatherScatteredBeamRadiance(const BeamGatherConstants& constants, const GatherRay& ray, const GatherBeam& beam);
+
+    void GetPhotonPlaneBounds(const PhotonPlane& plane, float3& boundsMin, float3& boundsMax);
+
+    struct BoundsBvhNode
+    {
+        float3 boundsMin;
+        float3 boundsMax;
+
+        // a leaf holds count primitives from first, an inner node has count 0 and its children at first and first + 1
+        uint32_t first;
+        uint32_t count;
+    };
+
+    // the ray enters the box within [0, ray.tMax]
+    inline bool RayEntersBox(const GatherRay& ray, const float3& boundsMin, const float3& boundsMax)
+    {
+        float tMin = 0.0f;
+        float tMax = ray.tMax;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float invDirection = 1.0f / ray.direction[axis];
+            float t0 = (boundsMin[axis] - ray.origin[axis]) * invDirection;
+            float t1 = (boundsMax[axis] - ray.origin[axis]) * invDirection;
+            if (t0 > t1)
+                std::swap(t0, t1);
+
+            tMin = std::max(tMin, t0);
+            tMax = std::min(tMax, t1);
+            if (tMin > tMax)
+                return false;
+        }
+        return true;
+    }
+
+    // Binary BVH over the boxes of the planes or the scattered beams, median split of the box centers along the
+    // longest side of their bounds.
+    class BoundsBvh
+    {
+    public:
+        static constexpr uint32_t c_maxLeafSize = 4;
+
+        void Build(const std::vector<float3>& boundsMin, const std::vector<float3>& boundsMax);
+
+        // visit(primitive) for the primitives of every leaf the ray enters, numNodeTests counts the box tests
+        template <typename Visit>
+        void Traverse(const GatherRay& ray, const Visit& visit, uint64_t& numNodeTests) const
+        {
+            if (m_nodes.empty())
+                return;
+
+            uint32_t stack[64];
+            uint32_t stackSize = 0;
+            stack[stackSize++] = 0;
+            while (stackSize > 0)
+            {
+                const BoundsBvhNode& node = m_nodes[stack[--stackSize]];
+                numNodeTests++;
+                if (!RayEntersBox(ray, node.boundsMin, node.boundsMax))
+                    continue;
+
+                if (node.count > 0)
+                {
+                    for (uint32_t i = node.first; i < node.first + node.count; i++)
+                        visit(m_primitives[i]);
+                    continue;
+                }
+
+                stack[stackSize++] = node.first;
+                stack[stackSize++] = node.first + 1;
+            }
+        }
+
+        const std::vector<BoundsBvhNode>& Nodes() const { return m_nodes; }
+
+    private:
+        std::vector<BoundsBvhNode> m_nodes;
+        std::vector<uint32_t> m_primitives;
+    };
+
+    // Checks
+    //  that the intersection finds the plane coordinates of the point a ray is aimed at
+    //  that the planes stay in the room and reach the farthest exit of it
+    //  that the BVH gathers the planes and the scattered beams the loops over all of them gather
+    //  that the planes and the scattered beams carry the same light, and that a plane frame has the smaller error
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidatePhotonPlanes();
+
+    struct PhotonPlaneBenchmarkSettings
+    {
+        uint32_t width = 48;
+        uint32_t height = 27;
+
+        // outside the open front of the box, as the progressive renderer
+        float3 eye = float3(0.0f, 0.0f, -14.0f);
+        float3 target = float3(0.0f, 0.0f, 0.0f);
+        float fovY = 0.8f;
+
+        uint32_t numLaunches = 1u << 8;
+        uint32_t maxBeamsPerLaunch = 4;
+
+        // of the scattered beams
+        float beamRadius = 0.2f;
+
+        // every estimator renders frames of fresh launches until its time is spent
+        double secondsPerEstimator = 4.0;
+
+        // frames of planes on seeds none of the estimators trace
+        uint32_t numReferenceFrames = 128;
+
+        uint32_t seed = 1;
+
+        // numThreads 0 uses std::thread::hardware_concurrency()
+        uint32_t numThreads = 0;
+    };
+
+    struct PhotonPlaneBenchmarkResult
+    {
+        // "planes" or "beams"
+        std::string estimator;
+
+        uint32_t numFrames = 0;
+
+        // the launches, the planes or scattered beams, their BVH and the gather
+        double secondsPerFrame = 0.0;
+
+        // per ray and frame
+        double nodeTests = 0.0;
+        double primitiveTests = 0.0;
+        double hits = 0.0;
+
+        // against the reference, and relative to its mean channel
+        double firstFrameRmse = 0.0;
+        double rmse = 0.0;
+        double relativeRmse = 0.0;
+    };
+
+    // The scattered beams, then the planes, each for secondsPerEstimator.
+    std::vector<PhotonPlaneBenchmarkResult> RunPhotonPlaneBenchmark(const PhotonPlaneBenchmarkSettings& settings = {});
+
+    // one line per result
+    std::string FormatPhotonPlaneBenchmarkResults(const std::vector<PhotonPlaneBenchmarkResult>& results);
+}
@@ -0,0 +1,381 @@
+
+#include "ProgressiveBeams.hpp"
+#include "ParallelFor.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // the seeds of the reference start this far from the seeds of the curves
+        constexpr uint32_t c_referenceSeedOffset = 1u << 24;
+
+        // a beam with the box of its capsule
+        struct ProgressiveBeam
+        {
+            GatherBeam beam;
+            float3 boundsMin;
+            float3 boundsMax;
+        };
+
+        // the ray enters the box within [tMin, tMax]
+        bool RayEntersBounds(const GatherRay& ray, const float3& boundsMin, const float3& boundsMax, float tMin)
+        {
+            float tMax = ray.tMax;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const float invDirection = 1.0f / ray.direction[axis];
+                float t0 = (boundsMin[axis] - ray.origin[axis]) * invDirection;
+                float t1 = (boundsMax[axis] - ray.origin[axis]) * invDirection;
+                if (t0 > t1)
+                    std::swap(t0, t1);
+
+                tMin = std::max(tMin, t0);
+                tMax = std::min(tMax, t1);
+                if (tMin > tMax)
+                    return false;
+            }
+            return true;
+        }
+
+        bool IsSameImage(const std::vector<float3>& a, const std::vector<float3>& b)
+        {
+            return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(float3)) == 0;
+        }
+
+        void Check(bool condition, const char* name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+    }
+
+    ProgressiveRadii NextProgressiveRadii(const ProgressiveRadii& radii, uint32_t iteration, float alpha)
+    {
+        const float ratio = (float(iteration) + alpha) / (float(iteration) + 1.0f);
+
+        ProgressiveRadii next;
+        next.beamRadius = radii.beamRadius * ratio;
+        next.photonRadius = radii.photonRadius * std::sqrt(ratio);
+        return next;
+    }
+
+    ProgressiveBeamRenderer::ProgressiveBeamRenderer(const ProgressiveBeamSettings& settings) :
+        m_settings(settings),
+        m_scene(CreateCornellScene()),
+        m_radii(settings.initialRadii)
+    {
+        m_pc = MakeSceneRayConstants(settings.eye, settings.target, settings.fovY, float(settings.width) / float(settings.height), settings.numLaunches);
+        m_camera = MakeOcclusionCamera(m_pc, settings.width, settings.height);
+
+        const size_t numPixels = size_t(settings.width) * settings.height;
+        m_pixelRays.resize(numPixels);
+        m_pixelHits.resize(numPixels);
+        m_image.assign(numPixels, float3(0.0f));
+
+        for (uint32_t y = 0; y < settings.height; y++)
+        {
+            for (uint32_t x = 0; x < settings.width; x++)
+            {
+                const size_t pixel = size_t(y) * settings.width + x;
+                GatherRay& ray = m_pixelRays[pixel];
+                SceneHit& hit = m_pixelHits[pixel];
+
+                ray = MakePrimaryRay(m_camera, x, y);
+                hit = {};
+                hit.boxIndex = -1;
+                if (TraceScene(m_scene, ray.origin, ray.direction, c_rayTMin, c_rayTMaxDefault, hit))
+                    ray.tMax = hit.t;
+            }
+        }
+    }
+
+    void ProgressiveBeamRenderer::RenderIteration(uint32_t iteration, const ProgressiveRadii& radii, std::vector<float3>& image) const
+    {
+        const BeamEmissionLaunches launches = CreateSceneEmissions(m_scene, m_settings.numLaunches, m_settings.maxBeamsPerLaunch, m_settings.seed + iteration);
+
+        PushConstantRay pc = m_pc;
+        pc.beamRadius = radii.beamRadius;
+        pc.photonRadius = radii.photonRadius;
+        const BeamGatherConstants gatherConstants = MakeBeamGatherConstants(pc);
+
+        std::vector<ProgressiveBeam> airBeams;
+
+        // the photons of every box of the scene
+        std::vector<std::vector<PhotonBeam>> boxPhotons(m_scene.size());
+        for (const auto& emissions : launches)
+        {
+            for (const auto& emission : emissions)
+            {
+                if (emission.airSubBeams)
+                {
+                    ProgressiveBeam airBeam;
+                    airBeam.beam = LoadGatherBeam(emission.beam);
+                    airBeam.boundsMin = min(float3(emission.beam.startPos), float3(emission.beam.endPos)) - radii.beamRadius;
+                    airBeam.boundsMax = max(float3(emission.beam.startPos), float3(emission.beam.endPos)) + radii.beamRadius;
+                    airBeams.push_back(airBeam);
+                }
+
+                if (emission.surfacePhoton && emission.beam.hitInstanceID >= 0)
+                    boxPhotons[emission.beam.hitInstanceID].push_back(emission.beam);
+            }
+        }
+
+        image.assign(m_pixelRays.size(), float3(0.0f));
+        ParallelFor(ResolveThreadCount(m_settings.numThreads), m_camera.height, [&](uint32_t, uint64_t begin, uint64_t end)
+        {
+            for (uint64_t y = begin; y < end; y++)
+            {
+                for (uint32_t x = 0; x < m_camera.width; x++)
+                {
+                    const size_t pixel = size_t(y) * m_camera.width + x;
+                    const GatherRay& ray = m_pixelRays[pixel];
+                    const SceneHit& hit = m_pixelHits[pixel];
+
+                    float3 radiance = float3(0.0f);
+                    for (const auto& airBeam : airBeams)
+                    {
+                        if (!RayEntersBounds(ray, airBeam.boundsMin, airBeam.boundsMax, c_rayTMin))
+                            continue;
+
+                        float3 beamRadiance;
+                        if (GatherBeamRadiance(gatherConstants, ray, airBeam.beam, beamRadiance))
+                            radiance += beamRadiance;
+                    }
+
+                    if (hit.boxIndex >= 0 && m_settings.gatherSurfacePhotons)
+                    {
+                        for (const auto& photon : boxPhotons[hit.boxIndex])
+                            radiance += GatherSurfacePhotonBoxRadiance(pc, ray, hit, photon);
+                    }
+
+                    image[pixel] = radiance;
+                }
+            }
+        });
+    }
+
+    void ProgressiveBeamRenderer::Iterate()
+    {
+        std::vector<float3> iterationImage;
+        RenderIteration(m_numIterations, m_radii, iterationImage);
+
+        // running average, the image of every iteration weighs 1 / (n + 1)
+        const float weight = 1.0f / float(m_numIterations + 1);
+        for (size_t i = 0; i < m_image.size(); i++)
+            m_image[i] = m_image[i] + (iterationImage[i] - m_image[i]) * weight;
+
+        m_radii = NextProgressiveRadii(m_radii, m_numIterations, m_settings.alpha);
+        m_numIterations++;
+    }
+
+    double ImageRmse(const std::vector<float3>& image, const std::vector<float3>& reference)
+    {
+        const size_t size = std::min(image.size(), reference.size());
+        if (size == 0)
+            return 0.0;
+
+        double sum = 0.0;
+        for (size_t i = 0; i < size; i++)
+        {
+            const float3 difference = image[i] - reference[i];
+            sum += double(difference.x) * difference.x + double(difference.y) * difference.y + double(difference.z) * difference.z;
+        }
+        return std::sqrt(sum / double(size * 3));
+    }
+
+    std::string ValidateProgressiveBeams()
+    {
+        std::string failures;
+
+        // the radius schedule, the product of (i + alpha) / (i + 1) is Gamma(n + alpha) / (Gamma(alpha) Gamma(n + 1))
+        {
+            const ProgressiveRadii initial = { 0.4f, 0.3f };
+            bool isClosedForm = true;
+            bool isKept = true;
+            for (float alpha : { 0.3f, 0.5f, 0.7f })
+            {
+                ProgressiveRadii radii = initial;
+                ProgressiveRadii kept = initial;
+                for (uint32_t i = 0; i < 100; i++)
+                {
+                    radii = NextProgressiveRadii(radii, i, alpha);
+                    kept = NextProgressiveRadii(kept, i, 1.0f);
+                }
+
+                const double product = std::exp(std::lgamma(100.0 + alpha) - std::lgamma(double(alpha)) - std::lgamma(101.0));
+                isClosedForm = isClosedForm
+                    && std::abs(radii.beamRadius / (initial.beamRadius * product) - 1.0) < 1e-3
+                    && std::abs(radii.photonRadius / (initial.photonRadius * std::sqrt(product)) - 1.0) < 1e-3;
+                isKept = isKept && kept.beamRadius == initial.beamRadius && kept.photonRadius == initial.photonRadius;
+            }
+            Check(isClosedForm, "schedule: matches the closed form", failures);
+            Check(isKept, "schedule: alpha 1 keeps the radii", failures);
+        }
+
+        ProgressiveBeamSettings settings;
+        settings.width = 32;
+        settings.height = 18;
+        settings.numLaunches = 256;
+
+        // the average is the mean of the iterations
+        {
+            ProgressiveBeamRenderer renderer(settings);
+            ProgressiveBeamRenderer twin(settings);
+
+            std::vector<float3> sum(size_t(settings.width) * settings.height, float3(0.0f));
+            std::vector<float3> image;
+            std::vector<float3> first;
+            ProgressiveRadii radii = settings.initialRadii;
+            const uint32_t numIterations = 4;
+            for (uint32_t i = 0; i < numIterations; i++)
+            {
+                renderer.RenderIteration(i, radii, image);
+                for (size_t j = 0; j < sum.size(); j++)
+                    sum[j] += image[j];
+                if (i == 0)
+                    first = image;
+                radii = NextProgressiveRadii(radii, i, settings.alpha);
+
+                renderer.Iterate();
+                twin.Iterate();
+            }
+
+            double maxError = 0.0;
+            double maxValue = 0.0;
+            for (size_t j = 0; j < sum.size(); j++)
+            {
+                const float3 difference = sum[j] / float(numIterations) - renderer.Image()[j];
+                maxError = std::max(maxError, double(std::max({ std::abs(difference.x), std::abs(difference.y), std::abs(difference.z) })));
+                maxValue = std::max(maxValue, double(std::max({ sum[j].x, sum[j].y, sum[j].z })) / numIterations);
+            }
+
+            Check(maxValue > 0.0, "average: the beams are visible", failures);
+            Check(maxError <= maxValue * 1e-5, "average: mean of the iterations", failures);
+            Check(IsSameImage(renderer.Image(), twin.Image()), "average: deterministic", failures);
+            Check(!IsSameImage(first, renderer.Image()), "average: iterations trace different beams", failures);
+            Check(renderer.Radii().beamRadius == radii.beamRadius && renderer.Radii().photonRadius == radii.photonRadius,
+                "average: radii of the schedule", failures);
+        }
+
+        // the error against a long run shrinks
+        {
+            ProgressiveBeamSettings referenceSettings = settings;
+            referenceSettings.seed += c_referenceSeedOffset;
+            ProgressiveBeamRenderer reference(referenceSettings);
+            for (uint32_t i = 0; i < 256; i++)
+                reference.Iterate();
+
+            ProgressiveBeamRenderer renderer(settings);
+            double earlyError = 0.0;
+            for (uint32_t i = 0; i < 64; i++)
+            {
+                renderer.Iterate();
+                if (i == 3)
+                    earlyError = ImageRmse(renderer.Image(), reference.Image());
+            }
+            const double lateError = ImageRmse(renderer.Image(), reference.Image());
+
+            Check(lateError < earlyError * 0.6, "convergence: the error shrinks", failures);
+        }
+
+        return failures;
+    }
+
+    std::vector<ProgressiveConvergenceCurve> RunProgressiveBeamConvergence(const ProgressiveConvergenceSettings& settings)
+    {
+        ProgressiveBeamSettings referenceSettings = settings.render;
+        referenceSettings.alpha = settings.referenceAlpha;
+        referenceSettings.seed += c_referenceSeedOffset;
+        ProgressiveBeamRenderer reference(referenceSettings);
+        for (uint32_t i = 0; i < settings.numReferenceIterations; i++)
+            reference.Iterate();
+
+        std::vector<ProgressiveConvergenceCurve> curves;
+        for (float alpha : settings.alphas)
+        {
+            ProgressiveBeamSettings renderSettings = settings.render;
+            renderSettings.alpha = alpha;
+            ProgressiveBeamRenderer renderer(renderSettings);
+
+            ProgressiveConvergenceCurve curve;
+            curve.alpha = alpha;
+
+            double seconds = 0.0;
+            for (uint32_t i = 0; i < settings.numIterations; i++)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                renderer.Iterate();
+                const auto end = std::chrono::steady_clock::now();
+                seconds += std::chrono::duration<double>(end - start).count();
+
+                ProgressiveConvergenceSample sample;
+                sample.numIterations = renderer.NumIterations();
+                sample.seconds = seconds;
+                sample.rmse = ImageRmse(renderer.Image(), reference.Image());
+                sample.radii = renderer.Radii();
+                curve.samples.push_back(sample);
+            }
+
+            curves.push_back(curve);
+        }
+
+        return curves;
+    }
+
+    std::string FormatProgressiveConvergenceCurves(const std::vector<ProgressiveConvergenceCurve>& curves)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& curve : curves)
+        {
+            if (curve.samples.empty())
+                continue;
+
+            const ProgressiveConvergenceSample& last = curve.samples.back();
+            std::snprintf(
+                line,
+                sizeof(line),
+                "# alpha %.2f  %u iterations  %8.3f s  rmse %.6g  beam radius %.4f  photon radius %.4f\n",
+                curve.alpha,
+                last.numIterations,
+                last.seconds,
+                last.rmse,
+                last.radii.beamRadius,
+                last.radii.photonRadius
+            );
+            text += line;
+        }
+
+        text += "alpha,iterations,seconds,rmse,beamRadius,photonRadius\n";
+        for (const auto& curve : curves)
+        {
+            for (const auto& sample : curve.samples)
+            {
+                std::snprintf(
+                    line,
+                    sizeof(line),
+                    "%.2f,%u,%.6f,%.6g,%.6f,%.6f\n",
+                    curve.alpha,
+                    sample.numIterations,
+                    sample.seconds,
+                    sample.rmse,
+                    sample.radii.beamRadius,
+                    sample.radii.photonRadius
+                );
+                text += line;
+            }
+        }
+
+        return text;
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "CpuVector.hpp"
+#include "BeamOcclusion.hpp"
+#include "CornellScene.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Progressive photon beams (Jarosz et al. 2011) with a headless CPU renderer of the Cornell scene.
+//
+// Every iteration traces a fresh set of beams, gathers them with the radii of the iteration into an image and adds
+// the image to a running average. The radii shrink after every iteration i, counted from 0:
+//   beam radius      r(i + 1)   = r(i)   (i + alpha) / (i + 1)
+//   photon radius    r(i + 1)^2 = r(i)^2 (i + alpha) / (i + 1)
+// The beam blur is 1D across the beam and the photon blur 2D on the surface, so the variance of both grows by
+// (i + 1) / (i + alpha) per iteration while the bias goes to 0. alpha in (0, 1) trades the noise of the late
+// iterations against the bias of the early ones, alpha 1 keeps the radii as the sliders of the app do.
+//
+// The air beams are gathered as BeamAnyHit does. The surface photons use the constant kernel of
+// GatherSurfacePhotonBoxRadiance(), the kernel of SurfaceAnyHit has an offset of 0.1 that does not shrink with the radius.
+namespace CpuReference
+{
+    struct ProgressiveRadii
+    {
+        float beamRadius;
+        float photonRadius;
+    };
+
+    // the radii of iteration + 1
+    ProgressiveRadii NextProgressiveRadii(const ProgressiveRadii& radii, uint32_t iteration, float alpha);
+
+    struct ProgressiveBeamSettings
+    {
+        uint32_t width = 48;
+        uint32_t height = 27;
+
+        // outside the open front of the box by default
+        float3 eye = float3(0.0f, 0.0f, -14.0f);
+        float3 target = float3(0.0f, 0.0f, 0.0f);
+        float fovY = 0.8f;
+
+        uint32_t numLaunches = 1u << 9;
+        uint32_t maxBeamsPerLaunch = 4;
+
+        ProgressiveRadii initialRadii = { 0.4f, 0.4f };
+        float alpha = 0.7f;
+
+        // false renders the air beams alone
+        bool gatherSurfacePhotons = true;
+
+        // iteration i traces the beams of seed + i
+        uint32_t seed = 1;
+
+        // numThreads 0 uses std::thread::hardware_concurrency()
+        uint32_t numThreads = 0;
+    };
+
+    class ProgressiveBeamRenderer
+    {
+    public:
+        explicit ProgressiveBeamRenderer(const ProgressiveBeamSettings& settings);
+
+        // traces the beams of the next iteration, adds their image to the average and shrinks the radii
+        void Iterate();
+
+        // the image of one iteration with the given radii, alone
+        void RenderIteration(uint32_t iteration, const ProgressiveRadii& radii, std::vector<float3>& image) const;
+
+        // average of the iterations, row major from the top row
+        const std::vector<float3>& Image() const { return m_image; }
+
+        // the radii of the next iteration
+        const ProgressiveRadii& Radii() const { return m_radii; }
+
+        uint32_t NumIterations() const { return m_numIterations; }
+        uint32_t Width() const { return m_camera.width; }
+        uint32_t Height() const { return m_camera.height; }
+
+    private:
+        ProgressiveBeamSettings m_settings;
+
+        std::vector<SceneBox> m_scene;
+        PushConstantRay m_pc;
+        OcclusionCamera m_camera;
+
+        // primary rays with the tMax of their surface hit, boxIndex -1 for a miss
+        std::vector<GatherRay> m_pixelRays;
+        std::vector<SceneHit> m_pixelHits;
+
+        std::vector<float3> m_image;
+        ProgressiveRadii m_radii;
+        uint32_t m_numIterations = 0;
+    };
+
+    // root mean square of the differences of the channels
+    double ImageRmse(const std::vector<float3>& image, const std::vector<float3>& reference);
+
+    // Checks
+    //  the radius schedule against its closed form, and that alpha 1 keeps the radii
+    //  that the average of the renderer is the mean of the images of its iterations, and that it is deterministic
+    //  that the error against a long run shrinks with the iterations
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidateProgressiveBeams();
+
+    struct ProgressiveConvergenceSettings
+    {
+        // alpha is taken from alphas
+        ProgressiveBeamSettings render = {};
+
+        std::vector<float> alphas = { 0.3f, 0.5f, 0.7f, 0.9f, 1.0f };
+        uint32_t numIterations = 64;
+
+        // The reference is a long progressive run on seeds none of the curves trace.
+        float referenceAlpha = 0.7f;
+        uint32_t numReferenceIterations = 512;
+    };
+
+    struct ProgressiveConvergenceSample
+    {
+        uint32_t numIterations = 0;
+
+        // wall time of the iterations so far, without the error measurements
+        double seconds = 0.0;
+        double rmse = 0.0;
+        ProgressiveRadii radii = {};
+    };
+
+    struct ProgressiveConvergenceCurve
+    {
+        float alpha = 0.0f;
+        std::vector<ProgressiveConvergenceSample> samples;
+    };
+
+    // One curve per alpha, with a sample after every iteration.
+    std::vector<ProgressiveConvergenceCurve> RunProgressiveBeamConvergence(const ProgressiveConvergenceSettings& settings = {});
+
+    // CSV of every sample, "alpha,iterations,seconds,rmse,beamRadius,photonRadius",
+    // after one comment line per curve with its final error
+    std::string FormatProgressiveConvergenceCurves(const std::vector<ProgressiveConvergenceCurve>& curves);
+}
@@ -0,0 +1,367 @@
+
+#pragma once
+
+#include "CpuVector.hpp"
+#include "../Shaders/util/RandomNumberGenerator.h"
+#include "../Shaders/util/SobolSampler.h"
+
+// CPU port of Shaders/util/RayTracingSampling.hlsli.
+// Functions consume the random number state in the same order as the HLSL versions,
+// so the same seed gives the same samples on both sides.
+namespace CpuReference
+{
+    // same value as M_PI in the shaders
+    constexpr float c_pi = 3.141592f;
+
+    inline float2 toFloat2(const XMFLOAT2& val)
+    {
+        return float2(val.x, val.y);
+    }
+
+    inline float3 samplingHemisphere(uint32_t& seed, const float3& x, const float3& y, const float3& z)
+    {
+        float r1 = rnd(seed);
+        float r2 = rnd(seed);
+        float sq = std::sqrt(1.0f - r2);
+
+        float3 direction = float3(std::cos(2 * c_pi * r1) * sq, std::sin(2 * c_pi * r1) * sq, std::sqrt(r2));
+        direction = direction.x * x + direction.y * y + direction.z * z;
+
+        return direction;
+    }
+
+    inline float3 uniformSamplingSphereFromUV(const float2& uv)
+    {
+        float r1 = uv.x;
+        float r2 = uv.y * 2 - 1;
+        float sq = std::sqrt(1.0f - r2 * r2);
+
+        return float3(std::cos(2 * c_pi * r1) * sq, std::sin(2 * c_pi * r1) * sq, r2);
+    }
+
+    inline float3 uniformSamplingSphere(uint32_t& seed)
+    {
+        float r1 = rnd(seed);
+        float r2 = rnd(seed);
+
+        return uniformSamplingSphereFromUV(float2(r1, r2));
+    }
+
+    // Return the tangent and binormal from the incoming normal
+    inline void createCoordinateSystem(const float3& N, float3& Nt, float3& Nb)
+    {
+        if (std::abs(N.x) > std::abs(N.y))
+            Nt = float3(N.z, 0, -N.x) / std::sqrt(N.x * N.x + N.z * N.z);
+        else
+            Nt = float3(0, -N.z, N.y) / std::sqrt(N.y * N.y + N.z * N.z);
+
+        Nb = cross(N, Nt);
+    }
+
+    // Henyey-Greenstein phase function, pdf of the solid angle distribution
+    inline float heneyGreenPhaseFunc(float cosTheta, float g)
+    {
+        float g2 = g * g;
+        float denom = 1 + g2 - 2 * g * cosTheta;
+
+        return (1 - g2) / (denom * std::sqrt(denom)) / (4 * c_pi);
+    }
+
+    // cos theta of the Henyey-Greenstein sample for a uniform random value r1
+    inline float heneyGreenCosTheta(float r1, float g)
+    {
+        float g2 = g * g;
+        float g3 = g2 * g;
+
+        float s1 = 2 * r1 - 1;
+        float s2 = s1 * s1;
+
+        float denom = 1 + g * s1;
+        denom = denom * denom * 2;
+
+        float numerator = 2 * s1 + g * (s2 + 3) + g2 * (2 * s1) + g3 * (s2 - 1);
+
+        if (denom == 0.0f)
+        {
+            denom += 0.000001f;
+        }
+
+        return numerator / denom;
+    }
+
+    // scattered direction for a sampled cos theta, the azimuth is 2 pi * phiU
+    // normal is incoming ray direction start from the light source
+    inline float3 heneyGreenDirectionFromCosTheta(float cos_theta, float phiU, const float3& normal)
+    {
+        // the closed form of the sampled cos theta can be off by one ulp past +-1
+        float sin_theta = std::sqrt(std::max(0.0f, 1.0f - cos_theta * cos_theta));
+        float phi = 2.0f * c_pi * phiU;
+
+        float3 ret = float3(sin_theta * std::cos(phi), cos_theta, sin_theta * std::sin(phi));
+
+        float3 tangent, bitangent;
+        createCoordinateSystem(normal, tangent, bitangent);
+        ret = ret.x * bitangent + ret.y * normal + ret.z * tangent;
+
+        return normalize(ret);
+    }
+
+    inline float3 heneyGreenPhaseFuncSamplingFromUV(const float2& uv, const float3& normal, float g)
+    {
+        return heneyGreenDirectionFromCosTheta(heneyGreenCosTheta(uv.x, g), uv.y, normal);
+    }
+
+    inline float3 heneyGreenPhaseFuncSampling(uint32_t& seed, const float3& normal, float g)
+    {
+        float r1 = rnd(seed);
+        float r2 = rnd(seed);
+
+        return heneyGreenPhaseFuncSamplingFromUV(float2(r1, r2), normal, g);
+    }
+
+    // PDF for half vector
+    inline float microfacetPDF(float nDotH, float roughness)
+    {
+        float a2 = roughness * roughness;
+        float denom = (nDotH * nDotH * (a2 - 1.0f) + 1);
+        denom = denom * denom * c_pi;
+
+        return a2 / denom;
+    }
+
+    // GGX distribution of the glTF roughness. The samplers and the Smith terms take alpha = roughness^2,
+    // the BRDF and the weights of the samples evaluate D with the same alpha
+    inline float ggxDistribution(float nDotH, float roughness)
+    {
+        return microfacetPDF(nDotH, roughness * roughness);
+    }
+
+    // incomingLightDir is direction start from light source and goes toward the point of the interaction.
+    inline float3 microfacetReflectedLightSamplingFromUV(
+        const float2& uv,
+        const float3& incomingLightDir,
+        const float3& normal,
+        float roughness
+    )
+    {
+        float a = roughness * roughness;
+        float theta = std::atan(a * std::sqrt(uv.x / (1 - uv.x)));
+        float phi = 2 * c_pi * uv.y;
+
+        float3 halfVec = float3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+
+        float3 tangent, bitangent;
+        createCoordinateSystem(normal, tangent, bitangent);
+
+        halfVec = halfVec.x * bitangent + halfVec.y * normal + halfVec.z * tangent;
+
+        return normalize(incomingLightDir - 2 * dot(halfVec, incomingLightDir) * halfVec);
+    }
+
+    inline float3 microfacetReflectedLightSampling(
+        uint32_t& seed,
+        const float3& incomingLightDir,
+        const float3& normal,
+        float roughness
+    )
+    {
+        float r1 = rnd(seed);
+        float r2 = rnd(seed);
+
+        return microfacetReflectedLightSamplingFromUV(float2(r1, r2), incomingLightDir, normal, roughness);
+    }
+
+    // Heitz, Sampling the GGX Distribution of Visible Normals(2018)
+    // incomingLightDir is direction start from light source and goes toward the point of the interaction.
+    inline float3 microfacetVisibleNormalSamplingFromUV(
+        const float2& uv,
+        const float3& incomingLightDir,
+        const float3& normal,
+        float roughness
+    )
+    {
+        float a = roughness * roughness;
+
+        float3 tangent, bitangent;
+        createCoordinateSystem(normal, tangent, bitangent);
+
+        float3 toLight = -incomingLightDir;
+        float3 localV = float3(dot(toLight, bitangent), dot(toLight, tangent), dot(toLight, normal));
+        float3 stretchedV = normalize(float3(a * localV.x, a * localV.y, localV.z));
+
+        float lenSq = stretchedV.x * stretchedV.x + stretchedV.y * stretchedV.y;
+        float3 t1 = lenSq > 0 ? float3(-stretchedV.y, stretchedV.x, 0) / std::sqrt(lenSq) : float3(1, 0, 0);
+        float3 t2 = cross(stretchedV, t1);
+
+        float r = std::sqrt(uv.x);
+        float phi = 2 * c_pi * uv.y;
+        float p1 = r * std::cos(phi);
+        float p2 = r * std::sin(phi);
+        float s = 0.5f * (1.0f + stretchedV.z);
+        p2 = (1.0f - s) * std::sqrt(1.0f - p1 * p1) + s * p2;
+
+        float3 stretchedH = p1 * t1 + p2 * t2 + std::sqrt(std::max(0.0f, 1.0f - p1 * p1 - p2 * p2)) * stretchedV;
+        float3 localH = normalize(float3(a * stretchedH.x, a * stretchedH.y, std::max(0.0f, stretchedH.z)));
+
+        float3 halfVec = localH.x * bitangent + localH.y * tangent + localH.z * normal;
+
+        return normalize(incomingLightDir - 2 * dot(halfVec, incomingLightDir) * halfVec);
+    }
+
+    inline float3 microfacetVisibleNormalSampling(
+        uint32_t& seed,
+        const float3& incomingLightDir,
+        const float3& normal,
+        float roughness
+    )
+    {
+        float r1 = rnd(seed);
+        float r2 = rnd(seed);
+
+        return microfacetVisibleNormalSamplingFromUV(float2(r1, r2), incomingLightDir, normal, roughness);
+    }
+
+    // both incoming light and reflected light directions start from the point of the reflection
+    inline float3 gltfBrdf(
+        const float3& incomingLightDir,
+        const float3& reflectedLightDir,
+        const float3& normal,
+        const float3& baseColor,
+        float roughness,
+        float metallic
+    )
+    {
+        float a2 = std::pow(roughness, 4.0f);
+        float3 halfVec = normalize(incomingLightDir + reflectedLightDir);
+        float nDotH = dot(normal, halfVec);
+        float nDotL = dot(normal, incomingLightDir);
+        float vDotH = dot(reflectedLightDir, halfVec);
+        float hDotL = dot(incomingLightDir, halfVec);
+        float vDotN = dot(reflectedLightDir, normal);
+
+        float3 c_diff = (1.0f - metallic) * baseColor;
+        float3 f0 = float3(0.04f * (1 - metallic)) + baseColor * metallic;
+        float3 frsnel = f0 + (1 - f0) * std::pow(1 - std::abs(vDotH), 5.0f);
+        float3 f_diffuse = (1.0f - frsnel) / c_pi * c_diff;
+
+        float dVal = 0.0f;
+        if (roughness > 0.0f || nDotH < 0.9999f)
+            dVal = ggxDistribution(nDotH, roughness);
+        else
+            dVal = microfacetPDF(1.0f, 0.000001f);
+
+        float gVal = 0.0f;
+        if (hDotL > 0 && vDotH > 0)
+        {
+            float denom1 = std::sqrt(a2 + (1 - a2) * nDotL * nDotL);
+            denom1 += std::abs(nDotL);
+
+            float denom2 = std::sqrt(a2 + (1 - a2) * vDotN * vDotN);
+            denom2 += std::abs(vDotN);
+
+            gVal = 1.0f / (denom1 * denom2);
+        }
+
+        float3 f_specular = frsnel * dVal * gVal;
+        return f_specular + f_diffuse;
+    }
+
+    // weight gltfBRDF value with the pdf value of the reflected light
+    inline float3 pdfWeightedGltfBrdf(
+        const float3& incomingLightDir,
+        const float3& reflectedLightDir,
+        const float3& normal,
+        const float3& baseColor,
+        float roughness,
+        float metallic
+    )
+    {
+        float a2 = std::pow(roughness, 4.0f);
+        float3 halfVec = normalize(incomingLightDir + reflectedLightDir);
+        float nDotH = dot(normal, halfVec);
+        float nDotL = dot(normal, incomingLightDir);
+        float vDotH = dot(reflectedLightDir, halfVec);
+        float hDotL = dot(incomingLightDir, halfVec);
+        float vDotN = dot(reflectedLightDir, normal);
+
+        float3 c_diff = (1.0f - metallic) * baseColor;
+        float3 f0 = float3(0.04f * (1 - metallic)) + baseColor * metallic;
+        float3 frsnel = f0 + (1 - f0) * std::pow(1 - std::abs(vDotH), 5.0f);
+        float3 f_diffuse = float3(0.0f, 0.0f, 0.0f);
+
+        if ((roughness > 0.0f || nDotH < 0.999f) && hDotL > 0.0f)
+            f_diffuse = (1.0f - frsnel) / c_pi * c_diff / ggxDistribution(nDotH, roughness);
+
+        float gVal = 0.0f;
+        if (hDotL > 0 && vDotH > 0)
+        {
+            float denom1 = std::sqrt(a2 + (1 - a2) * nDotL * nDotL);
+            denom1 += std::abs(nDotL);
+
+            float denom2 = std::sqrt(a2 + (1 - a2) * vDotN * vDotN);
+            denom2 += std::abs(vDotN);
+
+            gVal = 1.0f / (denom1 * denom2);
+        }
+
+        float3 f_specular = frsnel * gVal * (4 * hDotL);
+        return f_specular + f_diffuse;
+    }
+
+    // Smith masking function of GGX for one direction, a2 is alpha^2
+    inline float smithG1(float nDotV, float a2)
+    {
+        nDotV = std::abs(nDotV);
+        return 2 * nDotV / (nDotV + std::sqrt(a2 + (1 - a2) * nDotV * nDotV));
+    }
+
+    // gltfBRDF value divided by the pdf of microfacetVisibleNormalSampling
+    // incomingLightDir is the direction the sample was drawn for, reflectedLightDir is the sampled direction
+    inline float3 pdfWeightedGltfBrdfVisibleNormal(
+        const float3& incomingLightDir,
+        const float3& reflectedLightDir,
+        const float3& normal,
+        const float3& baseColor,
+        float roughness,
+        float metallic
+    )
+    {
+        float a2 = std::pow(roughness, 4.0f);
+        float3 halfVec = normalize(incomingLightDir + reflectedLightDir);
+        float nDotH = dot(normal, halfVec);
+        float nDotL = dot(normal, incomingLightDir);
+        float vDotH = dot(reflectedLightDir, halfVec);
+        float hDotL = dot(incomingLightDir, halfVec);
+        float vDotN = dot(reflectedLightDir, normal);
+
+        float3 c_diff = (1.0f - metallic) * baseColor;
+        float3 f0 = float3(0.04f * (1 - metallic)) + baseColor * metallic;
+        float3 frsnel = f0 + (1 - f0) * std::pow(1 - std::abs(vDotH), 5.0f);
+
+        float g1 = smithG1(nDotL, a2);
+        if (g1 <= 0.0f || hDotL <= 0.0f)
+            return float3(0.0f);
+
+        float3 f_diffuse = float3(0.0f);
+        if (roughness > 0.0f || nDotH < 0.999f)
+        {
+            float dVal = ggxDistribution(nDotH, roughness);
+            f_diffuse = (1.0f - frsnel) / c_pi * c_diff * 4 * std::abs(nDotL) / (g1 * dVal);
+        }
+
+        float gVal = 0.0f;
+        if (vDotH > 0)
+        {
+            float denom1 = std::sqrt(a2 + (1 - a2) * nDotL * nDotL);
+            denom1 += std::abs(nDotL);
+
+            float denom2 = std::sqrt(a2 + (1 - a2) * vDotN * vDotN);
+            denom2 += std::abs(vDotN);
+
+            gVal = 1.0f / (denom1 * denom2);
+        }
+
+        float3 f_specular = frsnel * gVal * 4 * std::abs(nDotL) / g1;
+        return f_specular + f_diffuse;
+    }
+}
@@ -0,0 +1,150 @@
+#include "RngBenchmark.hpp"
+#include "../Shaders/util/RandomNumberGenerator.h"
+
+#include <chrono>
+#include <cstdio>
+
+namespace CpuReference
+{
+    namespace
+    {
+        struct LcgGenerator
+        {
+            static uint32_t InitSeed(uint32_t launchIndex, uint32_t frameSeed) { return lcgInitSeed(launchIndex, frameSeed); }
+            static uint32_t Next24(uint32_t& state) { return lcg(state); }
+        };
+
+        struct PcgGenerator
+        {
+            static uint32_t InitSeed(uint32_t launchIndex, uint32_t frameSeed) { return pcgInitSeed(launchIndex, frameSeed); }
+            static uint32_t Next24(uint32_t& state) { return pcg32(state) >> 8; }
+        };
+
+        struct PhiloxGenerator
+        {
+            static uint32_t InitSeed(uint32_t launchIndex, uint32_t frameSeed) { return philoxInitSeed(launchIndex, frameSeed); }
+            static uint32_t Next24(uint32_t& state) { return philoxStream(state) >> 8; }
+        };
+
+        volatile uint32_t s_benchmarkSink = 0;
+
+        // best seconds of settings.numPasses runs of func(), which returns a value written to a volatile so the work
+        // is not optimized away
+        template <class Func>
+        double MeasureSeconds(const RngBenchmarkSettings& settings, const Func& func)
+        {
+            double bestSeconds = 0.0;
+
+            for (uint32_t pass = 0; pass < settings.numPasses; pass++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                s_benchmarkSink = func();
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                if (pass == 0 || seconds < bestSeconds)
+                    bestSeconds = seconds;
+            }
+
+            return bestSeconds;
+        }
+
+        double PerSecond(double count, double seconds)
+        {
+            return seconds > 0.0 ? count / seconds : 0.0;
+        }
+
+        template <class Generator>
+        RngBenchmarkResult BenchmarkGenerator(const char* name, const RngBenchmarkSettings& settings)
+        {
+            RngBenchmarkResult result;
+            result.name = name;
+
+            const uint32_t numLaunches = settings.numLaunches;
+            const uint32_t drawsPerLaunch = settings.drawsPerLaunch;
+
+            double seedSeconds = MeasureSeconds(settings, [&]()
+            {
+                uint32_t sum = 0;
+                for (uint32_t launch = 0; launch < numLaunches; launch++)
+                    sum += Generator::InitSeed(launch, settings.frameSeed);
+                return sum;
+            });
+
+            // the draws alone start from the seeded states, the launches are independent as the GPU threads are
+            std::vector<uint32_t> seeds(numLaunches);
+            for (uint32_t launch = 0; launch < numLaunches; launch++)
+                seeds[launch] = Generator::InitSeed(launch, settings.frameSeed);
+
+            double drawSeconds = MeasureSeconds(settings, [&]()
+            {
+                uint32_t sum = 0;
+                for (uint32_t launch = 0; launch < numLaunches; launch++)
+                {
+                    uint32_t state = seeds[launch];
+                    for (uint32_t draw = 0; draw < drawsPerLaunch; draw++)
+                        sum += Generator::Next24(state);
+                }
+                return sum;
+            });
+
+            double launchSeconds = MeasureSeconds(settings, [&]()
+            {
+                uint32_t sum = 0;
+                for (uint32_t launch = 0; launch < numLaunches; launch++)
+                {
+                    uint32_t state = Generator::InitSeed(launch, settings.frameSeed);
+                    for (uint32_t draw = 0; draw < drawsPerLaunch; draw++)
+                        sum += Generator::Next24(state);
+                }
+                return sum;
+            });
+
+            double drawSum = 0.0;
+            for (uint32_t launch = 0; launch < numLaunches; launch++)
+            {
+                uint32_t state = seeds[launch];
+                for (uint32_t draw = 0; draw < drawsPerLaunch; draw++)
+                    drawSum += float(Generator::Next24(state)) / float(0x01000000);
+            }
+
+            const double numDraws = double(numLaunches) * drawsPerLaunch;
+            result.seedsPerSecond = PerSecond(numLaunches, seedSeconds);
+            result.drawsPerSecond = PerSecond(numDraws, drawSeconds);
+            result.launchesPerSecond = PerSecond(numLaunches, launchSeconds);
+            result.meanDraw = numDraws > 0.0 ? drawSum / numDraws : 0.0;
+            return result;
+        }
+    }
+
+    std::vector<RngBenchmarkResult> RunRngBenchmark(const RngBenchmarkSettings& settings)
+    {
+        std::vector<RngBenchmarkResult> results;
+        results.push_back(BenchmarkGenerator<LcgGenerator>("LCG", settings));
+        results.push_back(BenchmarkGenerator<PcgGenerator>("PCG", settings));
+        results.push_back(BenchmarkGenerator<PhiloxGenerator>("PHILOX", settings));
+        return results;
+    }
+
+    std::string FormatRngBenchmarkResults(const std::vector<RngBenchmarkResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-7s seed %9.2f M/s  rnd %9.2f M/s  launch %9.2f M/s  mean %.5f\n",
+                result.name.c_str(),
+                result.seedsPerSecond * 1e-6,
+                result.drawsPerSecond * 1e-6,
+                result.launchesPerSecond * 1e-6,
+                result.meanDraw
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Cost of the generators of Shaders/util/RandomNumberGenerator.h, run on their CPU ports.
+// Every launch seeds its state from (launchIndex, frameSeed) and draws from it, the way BeamGen and RayGen do, so the
+// seeding and the draws are measured apart and together.
+namespace CpuReference
+{
+    struct RngBenchmarkSettings
+    {
+        uint32_t numLaunches = 1u << 20;
+
+        // rnd() calls of a launch, the emission direction and a few bounces of free path and phase function
+        uint32_t drawsPerLaunch = 16;
+
+        // the best of the passes is reported
+        uint32_t numPasses = 8;
+
+        uint32_t frameSeed = 1;
+    };
+
+    struct RngBenchmarkResult
+    {
+        // "LCG", "PCG" or "PHILOX"
+        std::string name;
+
+        // single thread
+        double seedsPerSecond = 0.0;
+        double drawsPerSecond = 0.0;
+        double launchesPerSecond = 0.0;
+
+        // mean of the draws, 0.5 within the noise of numLaunches * drawsPerLaunch samples
+        double meanDraw = 0.0;
+    };
+
+    // LCG(tea seeding), PCG and Philox4x32, whatever PHOTONBEAM_RNG selects for rnd()
+    std::vector<RngBenchmarkResult> RunRngBenchmark(const RngBenchmarkSettings& settings = {});
+
+    // one line per generator
+    std::string FormatRngBenchmarkResults(const std::vector<RngBenchmarkResult>& results);
+}
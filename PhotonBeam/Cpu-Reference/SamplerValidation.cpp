@@ -0,0 +1,550 @@
+
+#include "SamplerValidation.hpp"
+#include "ParallelFor.hpp"
+#include "RayTracingSampling.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace CpuReference
+{
+    namespace
+    {
+        constexpr double c_piD = 3.14159265358979323846;
+
+        // Histogram over (cos theta, phi) around an axis.
+        // The cos theta bins are uniform in x = sqrt((1 - cos theta) / (1 - cosThetaMin)),
+        // which makes them narrower around the axis where the sharp lobes of small g and roughness are.
+        class SphericalHistogram
+        {
+        public:
+            SphericalHistogram(const float3& axis, float cosThetaMin, uint32_t cosThetaBins, uint32_t phiBins)
+                : m_axis(axis), m_cosThetaMin(cosThetaMin), m_cosThetaBins(cosThetaBins), m_phiBins(phiBins)
+            {
+                createCoordinateSystem(m_axis, m_tangent, m_bitangent);
+            }
+
+            uint32_t NumBins() const { return m_cosThetaBins * m_phiBins; }
+
+            // returns false when the direction is not a valid sample
+            bool BinIndex(const float3& dir, uint32_t& index) const
+            {
+                float len = length(dir);
+                if (!(std::abs(len - 1.0f) < 1e-3f))
+                    return false;
+
+                float cosTheta = dot(dir, m_axis);
+                if (cosTheta < m_cosThetaMin - 1e-5f)
+                    return false;
+
+                double phi = std::atan2(double(dot(dir, m_tangent)), double(dot(dir, m_bitangent)));
+                if (phi < 0)
+                    phi += 2 * c_piD;
+
+                double x = std::sqrt(std::max(0.0, (1.0 - double(cosTheta)) / (1.0 - m_cosThetaMin)));
+                uint32_t cosIndex = std::min(uint32_t(x * m_cosThetaBins), m_cosThetaBins - 1);
+                uint32_t phiIndex = std::min(uint32_t(phi / (2 * c_piD) * m_phiBins), m_phiBins - 1);
+
+                index = cosIndex * m_phiBins + phiIndex;
+                return true;
+            }
+
+            float3 Direction(double cosTheta, double phi) const
+            {
+                double sinTheta = std::sqrt(std::max(0.0, 1.0 - cosTheta * cosTheta));
+                return float(sinTheta * std::cos(phi)) * m_bitangent
+                    + float(sinTheta * std::sin(phi)) * m_tangent
+                    + float(cosTheta) * m_axis;
+            }
+
+            // probability of every bin, composite Simpson rule over x and phi(solid angle = (1 - cosThetaMin) 2x dx dphi)
+            template <class PdfFunc>
+            std::vector<double> BinProbabilities(const PdfFunc& pdf, uint32_t intervals) const
+            {
+                intervals = std::max(2u, intervals + (intervals & 1));
+
+                const double xWidth = 1.0 / m_cosThetaBins;
+                const double phiWidth = 2 * c_piD / m_phiBins;
+
+                std::vector<double> probabilities(NumBins());
+
+                for (uint32_t cosIndex = 0; cosIndex < m_cosThetaBins; cosIndex++)
+                {
+                    for (uint32_t phiIndex = 0; phiIndex < m_phiBins; phiIndex++)
+                    {
+                        double sum = 0.0;
+                        for (uint32_t i = 0; i <= intervals; i++)
+                        {
+                            double x = xWidth * (cosIndex + double(i) / intervals);
+                            double cosTheta = 1.0 - (1.0 - m_cosThetaMin) * x * x;
+                            double jacobian = (1.0 - m_cosThetaMin) * 2.0 * x;
+                            double weightI = ((i == 0 || i == intervals) ? 1.0 : ((i & 1) ? 4.0 : 2.0)) * jacobian;
+
+                            for (uint32_t j = 0; j <= intervals; j++)
+                            {
+                                double phi = phiWidth * (phiIndex + double(j) / intervals);
+                                double weightJ = (j == 0 || j == intervals) ? 1.0 : ((j & 1) ? 4.0 : 2.0);
+
+                                sum += weightI * weightJ * double(pdf(Direction(cosTheta, phi)));
+                            }
+                        }
+
+                        double cellArea = (xWidth / intervals) * (phiWidth / intervals);
+                        probabilities[cosIndex * m_phiBins + phiIndex] = sum * cellArea / 9.0;
+                    }
+                }
+
+                return probabilities;
+            }
+
+        private:
+            float3 m_axis;
+            float3 m_tangent;
+            float3 m_bitangent;
+            float m_cosThetaMin;
+            uint32_t m_cosThetaBins;
+            uint32_t m_phiBins;
+        };
+
+        // sample(seed) returns the direction that is tested against pdf(direction)
+        template <class SampleFunc, class PdfFunc>
+        SamplerValidationResult RunChiSquareTest(
+            const std::string& name,
+            const SamplerValidationSettings& settings,
+            uint32_t numThreads,
+            uint32_t testSeed,
+            const float3& axis,
+            float cosThetaMin,
+            const SampleFunc& sample,
+            const PdfFunc& pdf
+        )
+        {
+            SamplerValidationResult result;
+            result.name = name;
+
+            const SphericalHistogram histogram(axis, cosThetaMin, settings.cosThetaBins, settings.phiBins);
+
+            // observed counts
+            std::vector<std::vector<uint64_t>> threadCounts(numThreads, std::vector<uint64_t>(histogram.NumBins(), 0));
+            std::vector<uint64_t> threadInvalid(numThreads, 0);
+
+            ParallelFor(numThreads, settings.samplesPerTest, [&](uint32_t threadIndex, uint64_t begin, uint64_t end)
+            {
+                auto& counts = threadCounts[threadIndex];
+                for (uint64_t sampleIndex = begin; sampleIndex < end; sampleIndex++)
+                {
+                    uint32_t seed = rngInitSeed(uint32_t(sampleIndex), testSeed);
+
+                    uint32_t binIndex;
+                    if (histogram.BinIndex(sample(seed), binIndex))
+                        counts[binIndex]++;
+                    else
+                        threadInvalid[threadIndex]++;
+                }
+            });
+
+            std::vector<uint64_t> counts(histogram.NumBins(), 0);
+            for (uint32_t threadIndex = 0; threadIndex < numThreads; threadIndex++)
+            {
+                for (uint32_t binIndex = 0; binIndex < histogram.NumBins(); binIndex++)
+                {
+                    counts[binIndex] += threadCounts[threadIndex][binIndex];
+                }
+                result.invalidSamples += threadInvalid[threadIndex];
+            }
+
+            // chi-square statistic with the low expectation bins pooled together
+            const std::vector<double> probabilities = histogram.BinProbabilities(pdf, settings.integrationIntervals);
+            const double numSamples = double(settings.samplesPerTest);
+
+            double pooledExpected = 0.0;
+            double pooledObserved = 0.0;
+            uint32_t numBinsUsed = 0;
+
+            for (uint32_t binIndex = 0; binIndex < histogram.NumBins(); binIndex++)
+            {
+                double expected = probabilities[binIndex] * numSamples;
+                double observed = double(counts[binIndex]);
+
+                if (expected < settings.minExpectedCount)
+                {
+                    pooledExpected += expected;
+                    pooledObserved += observed;
+                    continue;
+                }
+
+                result.chiSquare += (observed - expected) * (observed - expected) / expected;
+                numBinsUsed++;
+            }
+
+            if (pooledExpected > 0.0)
+            {
+                result.chiSquare += (pooledObserved - pooledExpected) * (pooledObserved - pooledExpected) / pooledExpected;
+                numBinsUsed++;
+            }
+            else if (pooledObserved > 0.0)
+            {
+                // samples where the pdf is zero
+                result.invalidSamples += uint64_t(pooledObserved);
+            }
+
+            result.degreesOfFreedom = numBinsUsed > 1 ? numBinsUsed - 1 : 1;
+            result.pValue = ChiSquarePValue(result.chiSquare, result.degreesOfFreedom);
+
+            // throughput of the sampler alone
+            std::vector<double> threadSums(numThreads, 0.0);
+            auto start = std::chrono::steady_clock::now();
+
+            ParallelFor(numThreads, settings.samplesPerTest, [&](uint32_t threadIndex, uint64_t begin, uint64_t end)
+            {
+                double sum = 0.0;
+                for (uint64_t sampleIndex = begin; sampleIndex < end; sampleIndex++)
+                {
+                    uint32_t seed = rngInitSeed(uint32_t(sampleIndex), testSeed + 1);
+                    sum += sample(seed).x;
+                }
+                threadSums[threadIndex] = sum;
+            });
+
+            auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            result.samplesPerSecond = seconds > 0.0 ? numSamples / seconds : 0.0;
+
+            // keeps the timed loop from being optimized away
+            volatile double sink = 0.0;
+            for (double sum : threadSums)
+                sink = sink + sum;
+
+            return result;
+        }
+
+        std::string FormatName(const char* sampler, const char* paramName, float param)
+        {
+            char buffer[128];
+            std::snprintf(buffer, sizeof(buffer), "%s %s=%.2f", sampler, paramName, param);
+            return buffer;
+        }
+
+        std::string FormatName(const char* sampler, float roughness, float incidence)
+        {
+            char buffer[128];
+            std::snprintf(buffer, sizeof(buffer), "%s roughness=%.2f incidence=%.0f", sampler, roughness, incidence);
+            return buffer;
+        }
+
+        void Check(bool condition, const std::string& name, std::string& failures)
+        {
+            if (!condition)
+            {
+                failures += name;
+                failures += '\n';
+            }
+        }
+
+        // regularized lower incomplete gamma P(a, x) by its series, converges quickly for x < a + 1
+        double GammaSeries(double a, double x)
+        {
+            double term = 1.0 / a;
+            double sum = term;
+            for (uint32_t n = 1; n < 1000; n++)
+            {
+                term *= x / (a + n);
+                sum += term;
+                if (std::abs(term) < std::abs(sum) * 1e-15)
+                    break;
+            }
+
+            return sum * std::exp(-x + a * std::log(x) - std::lgamma(a));
+        }
+
+        // regularized upper incomplete gamma Q(a, x) by its continued fraction(modified Lentz), for x >= a + 1
+        double GammaContinuedFraction(double a, double x)
+        {
+            const double tiny = 1e-300;
+
+            double b = x + 1.0 - a;
+            double c = 1.0 / tiny;
+            double d = 1.0 / b;
+            double h = d;
+
+            for (uint32_t n = 1; n < 1000; n++)
+            {
+                double an = -double(n) * (double(n) - a);
+                b += 2.0;
+
+                d = an * d + b;
+                if (std::abs(d) < tiny)
+                    d = tiny;
+
+                c = b + an / c;
+                if (std::abs(c) < tiny)
+                    c = tiny;
+
+                d = 1.0 / d;
+                double delta = d * c;
+                h *= delta;
+
+                if (std::abs(delta - 1.0) < 1e-15)
+                    break;
+            }
+
+            return std::exp(-x + a * std::log(x) - std::lgamma(a)) * h;
+        }
+    }
+
+    double ChiSquarePValue(double chiSquare, uint32_t degreesOfFreedom)
+    {
+        if (!(chiSquare >= 0.0))
+            return 0.0;
+
+        if (chiSquare == 0.0)
+            return 1.0;
+
+        double a = 0.5 * degreesOfFreedom;
+        double x = 0.5 * chiSquare;
+
+        if (x < a + 1.0)
+            return 1.0 - GammaSeries(a, x);
+
+        return GammaContinuedFraction(a, x);
+    }
+
+    std::vector<SamplerValidationResult> RunSamplerValidation(const SamplerValidationSettings& settings)
+    {
+        const uint32_t numThreads = ResolveThreadCount(settings.numThreads);
+
+        std::vector<SamplerValidationResult> results;
+        uint32_t testSeed = 0;
+
+        // cosine weighted hemisphere around +Z
+        {
+            const float3 axis = float3(0.0f, 0.0f, 1.0f);
+            results.push_back(RunChiSquareTest(
+                "samplingHemisphere",
+                settings,
+                numThreads,
+                testSeed += 2,
+                axis,
+                0.0f,
+                [](uint32_t& seed)
+                {
+                    return samplingHemisphere(seed, float3(1.0f, 0.0f, 0.0f), float3(0.0f, 1.0f, 0.0f), float3(0.0f, 0.0f, 1.0f));
+                },
+                [axis](const float3& dir)
+                {
+                    return std::max(0.0f, dot(dir, axis)) / c_pi;
+                }
+            ));
+        }
+
+        // Henyey-Greenstein around the incoming ray direction.
+        // The histogram axis is flipped for back scattering, so the peak always falls in the fine bins around the axis.
+        const float3 incoming = normalize(float3(0.3f, -0.5f, 0.8f));
+        for (float g : settings.hgAssymFactors)
+        {
+            results.push_back(RunChiSquareTest(
+                FormatName("heneyGreenPhaseFuncSampling", "g", g),
+                settings,
+                numThreads,
+                testSeed += 2,
+                g < 0.0f ? -incoming : incoming,
+                -1.0f,
+                [incoming, g](uint32_t& seed)
+                {
+                    return heneyGreenPhaseFuncSampling(seed, incoming, g);
+                },
+                [incoming, g](const float3& dir)
+                {
+                    return heneyGreenPhaseFunc(dot(dir, incoming), g);
+                }
+            ));
+        }
+
+        // Microfacet samplers, tested on the half vector between the sampled direction and the direction toward the light.
+        // The reference is the ggxDistribution() that gltfBrdf and the pdf weights divide by, so a sampler drawing from
+        // another alpha than the weights fails here.
+        const float3 normal = float3(0.0f, 0.0f, 1.0f);
+        for (float roughness : settings.roughnessValues)
+        {
+            const float a2 = std::pow(roughness, 4.0f);
+
+            for (float incidence : settings.incidenceAngles)
+            {
+                const float angle = incidence * c_pi / 180.0f;
+                const float3 incomingLight = float3(std::sin(angle), 0.0f, -std::cos(angle));
+                const float3 toLight = -incomingLight;
+
+                results.push_back(RunChiSquareTest(
+                    FormatName("microfacetReflectedLightSampling", roughness, incidence),
+                    settings,
+                    numThreads,
+                    testSeed += 2,
+                    normal,
+                    0.0f,
+                    [=](uint32_t& seed)
+                    {
+                        // back facing microfacets reflect below the half vector, the half vector is only defined up to its sign
+                        float3 halfVec = normalize(microfacetReflectedLightSampling(seed, incomingLight, normal, roughness) + toLight);
+                        return dot(halfVec, normal) < 0.0f ? -halfVec : halfVec;
+                    },
+                    [=](const float3& halfVec)
+                    {
+                        float nDotH = dot(normal, halfVec);
+                        return nDotH > 0.0f ? ggxDistribution(nDotH, roughness) * nDotH : 0.0f;
+                    }
+                ));
+
+                results.push_back(RunChiSquareTest(
+                    FormatName("microfacetVisibleNormalSampling", roughness, incidence),
+                    settings,
+                    numThreads,
+                    testSeed += 2,
+                    normal,
+                    0.0f,
+                    [=](uint32_t& seed)
+                    {
+                        return normalize(microfacetVisibleNormalSampling(seed, incomingLight, normal, roughness) + toLight);
+                    },
+                    [=](const float3& halfVec)
+                    {
+                        float nDotH = dot(normal, halfVec);
+                        float vDotH = dot(toLight, halfVec);
+                        float nDotV = dot(normal, toLight);
+                        if (nDotH <= 0.0f || vDotH <= 0.0f)
+                            return 0.0f;
+
+                        return smithG1(nDotV, a2) * vDotH * ggxDistribution(nDotH, roughness) / nDotV;
+                    }
+                ));
+            }
+        }
+
+        // Bonferroni correction, the suite as a whole fails with the probability settings.significance when every sampler is exact
+        const double threshold = settings.significance / double(results.size());
+        for (auto& result : results)
+        {
+            result.passed = result.invalidSamples == 0 && result.pValue > threshold;
+        }
+
+        return results;
+    }
+
+    std::vector<MicrofacetRejectionResult> MeasureMicrofacetRejection(const MicrofacetRejectionSettings& settings)
+    {
+        const float3 normal = float3(0.0f, 0.0f, 1.0f);
+
+        std::vector<MicrofacetRejectionResult> results;
+        uint32_t testSeed = 0;
+
+        for (float roughness : settings.roughnessValues)
+        {
+            for (float incidence : settings.incidenceAngles)
+            {
+                const float angle = incidence * c_pi / 180.0f;
+                const float3 incomingLight = float3(std::sin(angle), 0.0f, -std::cos(angle));
+
+                uint64_t fullNdfRejected = 0;
+                uint64_t visibleNormalRejected = 0;
+                testSeed++;
+
+                for (uint32_t sampleIndex = 0; sampleIndex < settings.samplesPerCase; sampleIndex++)
+                {
+                    uint32_t fullNdfSeed = rngInitSeed(sampleIndex, testSeed);
+                    uint32_t visibleNormalSeed = fullNdfSeed;
+
+                    if (dot(microfacetReflectedLightSampling(fullNdfSeed, incomingLight, normal, roughness), normal) <= 0.0f)
+                        fullNdfRejected++;
+                    if (dot(microfacetVisibleNormalSampling(visibleNormalSeed, incomingLight, normal, roughness), normal) <= 0.0f)
+                        visibleNormalRejected++;
+                }
+
+                MicrofacetRejectionResult result;
+                result.roughness = roughness;
+                result.incidence = incidence;
+                result.fullNdfRejection = double(fullNdfRejected) / std::max(settings.samplesPerCase, 1u);
+                result.visibleNormalRejection = double(visibleNormalRejected) / std::max(settings.samplesPerCase, 1u);
+                results.push_back(result);
+            }
+        }
+
+        return results;
+    }
+
+    std::string FormatMicrofacetRejectionResults(const std::vector<MicrofacetRejectionResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "roughness %.2f incidence %2.0f  rejected full NDF %6.2f%%  VNDF %6.2f%%\n",
+                result.roughness,
+                result.incidence,
+                result.fullNdfRejection * 100.0,
+                result.visibleNormalRejection * 100.0
+            );
+            text += line;
+        }
+
+        return text;
+    }
+
+    std::string ValidateMicrofacetRejection()
+    {
+        std::string failures;
+
+        // the difference of two rejection rates of 2^18 samples has a deviation below 0.0014
+        const double noise = 0.005;
+
+        for (const auto& result : MeasureMicrofacetRejection())
+        {
+            const std::string name = FormatName("microfacetVisibleNormalSampling", result.roughness, result.incidence);
+
+            if (result.incidence == 0.0f)
+            {
+                Check(std::abs(result.visibleNormalRejection - result.fullNdfRejection) < noise,
+                    name + ": the rejection differs from the full NDF sampler at normal incidence", failures);
+            }
+            else if (result.fullNdfRejection > 0.01)
+            {
+                Check(result.visibleNormalRejection < result.fullNdfRejection - noise,
+                    name + ": rejects no fewer directions than the full NDF sampler", failures);
+            }
+            else
+            {
+                Check(result.visibleNormalRejection <= result.fullNdfRejection + noise,
+                    name + ": rejects more directions than the full NDF sampler", failures);
+            }
+        }
+
+        return failures;
+    }
+
+    std::string FormatSamplerValidationResults(const std::vector<SamplerValidationResult>& results)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& result : results)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-4s %-66s chi2 %12.1f  dof %5u  p %.4f  invalid %llu  %8.2f Msamples/s\n",
+                result.passed ? "OK" : "FAIL",
+                result.name.c_str(),
+                result.chiSquare,
+                result.degreesOfFreedom,
+                result.pValue,
+                static_cast<unsigned long long>(result.invalidSamples),
+                result.samplesPerSecond * 1e-6
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
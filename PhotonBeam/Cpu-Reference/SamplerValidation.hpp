@@ -0,0 +1,102 @@
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Chi-square goodness of fit tests and throughput measurement for the samplers of RayTracingSampling.hlsli,
+// run on their CPU ports.
+// Every sample is drawn from a fresh rngInitSeed(sampleIndex, testSeed) stream, the same way the shaders seed each launch,
+// so the tests also cover the correlation between neighbouring launch indices.
+namespace CpuReference
+{
+    struct SamplerValidationSettings
+    {
+        uint64_t samplesPerTest = 1ull << 22;
+
+        // histogram resolution over (cos theta, phi) around the axis of each sampler
+        uint32_t cosThetaBins = 64;
+        uint32_t phiBins = 128;
+
+        // Simpson intervals per bin and axis used to integrate the pdf over a bin
+        uint32_t integrationIntervals = 8;
+
+        // bins expecting fewer samples are pooled into one bin
+        double minExpectedCount = 5.0;
+
+        // significance of the whole suite, split between the tests(Bonferroni correction)
+        double significance = 0.01;
+
+        // 0 uses std::thread::hardware_concurrency()
+        uint32_t numThreads = 0;
+
+        std::vector<float> hgAssymFactors = { -0.9f, -0.5f, 0.0f, 0.3f, 0.7f, 0.9f };
+        std::vector<float> roughnessValues = { 0.2f, 0.5f, 0.8f, 1.0f };
+
+        // angle between the incoming light and the normal for the microfacet samplers, in degrees
+        std::vector<float> incidenceAngles = { 0.0f, 45.0f, 80.0f };
+    };
+
+    struct SamplerValidationResult
+    {
+        std::string name;
+
+        double chiSquare = 0.0;
+        uint32_t degreesOfFreedom = 0;
+        double pValue = 0.0;
+
+        // samples that are NaN, not unit length or outside the support of the pdf
+        uint64_t invalidSamples = 0;
+
+        bool passed = false;
+
+        // throughput of the sampler alone, seeding included, on all threads
+        double samplesPerSecond = 0.0;
+    };
+
+    // Runs the chi-square test of every sampler for every parameter in the sweep.
+    //  samplingHemisphere                     against cos theta / pi
+    //  heneyGreenPhaseFuncSampling            against heneyGreenPhaseFunc
+    //  microfacetReflectedLightSampling       half vector against ggxDistribution * cos theta
+    //  microfacetVisibleNormalSampling        half vector against G1(v) * max(0, v.h) * ggxDistribution / n.v
+    std::vector<SamplerValidationResult> RunSamplerValidation(const SamplerValidationSettings& settings = {});
+
+    // one line per result
+    std::string FormatSamplerValidationResults(const std::vector<SamplerValidationResult>& results);
+
+    struct MicrofacetRejectionSettings
+    {
+        uint32_t samplesPerCase = 1u << 18;
+
+        std::vector<float> roughnessValues = { 0.1f, 0.3f, 0.5f, 0.7f, 0.9f, 1.0f };
+
+        // angle between the incoming light and the normal, in degrees
+        std::vector<float> incidenceAngles = { 0.0f, 45.0f, 75.0f };
+    };
+
+    struct MicrofacetRejectionResult
+    {
+        float roughness = 0.0f;
+        float incidence = 0.0f;
+
+        // fraction of the reflected directions below the surface, which the shaders terminate
+        double fullNdfRejection = 0.0;
+        double visibleNormalRejection = 0.0;
+    };
+
+    // Rejected fraction of microfacetReflectedLightSampling and microfacetVisibleNormalSampling for every roughness and
+    // incidence of the sweep, both fed the same random numbers.
+    std::vector<MicrofacetRejectionResult> MeasureMicrofacetRejection(const MicrofacetRejectionSettings& settings = {});
+
+    // one line per case
+    std::string FormatMicrofacetRejectionResults(const std::vector<MicrofacetRejectionResult>& results);
+
+    // Checks that the visible normal sampler rejects fewer directions than the full NDF sampler, strictly when the
+    // full NDF sampler rejects more than 1%, and about as many at normal incidence where both sample the same lobe.
+    // Returns one line per failure, an empty string when everything passed.
+    std::string ValidateMicrofacetRejection();
+
+    // p-value of a chi-square statistic, the regularized upper incomplete gamma function Q(dof / 2, chiSquare / 2)
+    double ChiSquarePValue(double chiSquare, uint32_t degreesOfFreedom);
+}
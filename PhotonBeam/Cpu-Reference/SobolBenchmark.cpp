@@ -0,0 +1,193 @@
+#include "SobolBenchmark.hpp"
+#include "CornellScene.hpp"
+#include "RayTracingSampling.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace CpuReference
+{
+    namespace
+    {
+        // the light of CreateSceneEmissions()
+        const float3 c_lightPosition = float3(0.0f, c_cornellRoomSize * 0.9f, 0.0f);
+
+        constexpr uint32_t c_cellsPerAxis = 4;
+        constexpr uint32_t c_regionsPerBox = 6 * c_cellsPerAxis * c_cellsPerAxis;
+
+        // region of the first hit of a direction from the light, the last region when it leaves the scene
+        uint32_t FindRegion(const std::vector<SceneBox>& scene, const float3& direction)
+        {
+            SceneHit hit;
+            if (!TraceScene(scene, c_lightPosition, direction, c_rayTMin, c_rayTMaxDefault, hit))
+                return uint32_t(scene.size()) * c_regionsPerBox;
+
+            const SceneBox& box = scene[hit.boxIndex];
+            const float3 position = c_lightPosition + direction * hit.t;
+
+            uint32_t face = 0;
+            for (uint32_t axis = 0; axis < 3; axis++)
+            {
+                if (hit.normal[axis] != 0.0f)
+                    face = axis * 2 + (hit.normal[axis] > 0.0f ? 1 : 0);
+            }
+
+            const uint32_t normalAxis = face / 2;
+            uint32_t cell = 0;
+            for (uint32_t axis = 0, scale = 1; axis < 3; axis++)
+            {
+                if (axis == normalAxis)
+                    continue;
+
+                const float relative = (position[axis] - box.boundsMin[axis]) / (box.boundsMax[axis] - box.boundsMin[axis]);
+                const uint32_t index = std::min(uint32_t(std::max(relative, 0.0f) * c_cellsPerAxis), c_cellsPerAxis - 1);
+                cell += index * scale;
+                scale *= c_cellsPerAxis;
+            }
+
+            return uint32_t(hit.boxIndex) * c_regionsPerBox + face * c_cellsPerAxis * c_cellsPerAxis + cell;
+        }
+
+        // sum over the regions of the squared error of the flux fractions of numBeams directions
+        template <class SampleUV>
+        double SquaredFluxError(
+            const std::vector<SceneBox>& scene,
+            const std::vector<double>& reference,
+            uint32_t numBeams,
+            const SampleUV& sampleUV
+        )
+        {
+            std::vector<uint32_t> counts(reference.size(), 0);
+            for (uint32_t launchIndex = 0; launchIndex < numBeams; launchIndex++)
+                counts[FindRegion(scene, uniformSamplingSphereFromUV(sampleUV(launchIndex)))]++;
+
+            double sum = 0.0;
+            for (size_t region = 0; region < reference.size(); region++)
+            {
+                const double error = double(counts[region]) / numBeams - reference[region];
+                sum += error * error;
+            }
+            return sum;
+        }
+
+        // the x that gives y on the log-log polyline through the points, extrapolated from the nearest segment
+        double InterpolateLogLog(const std::vector<double>& xs, const std::vector<double>& ys, double y)
+        {
+            if (xs.size() < 2)
+                return xs.empty() ? 0.0 : xs[0];
+
+            size_t segment = 0;
+            while (segment + 2 < xs.size() && ys[segment + 1] > y)
+                segment++;
+
+            const double logY0 = std::log(ys[segment]);
+            const double logY1 = std::log(ys[segment + 1]);
+            if (logY0 == logY1)
+                return xs[segment];
+
+            const double s = (std::log(y) - logY0) / (logY1 - logY0);
+            return std::exp(std::log(xs[segment]) + s * (std::log(xs[segment + 1]) - std::log(xs[segment])));
+        }
+    }
+
+    std::vector<SobolBenchmarkRow> RunSobolBenchmark(const SobolBenchmarkSettings& settings)
+    {
+        const std::vector<SceneBox> scene = CreateCornellScene();
+        const size_t numRegions = scene.size() * c_regionsPerBox + 1;
+
+        std::vector<double> reference(numRegions, 0.0);
+        {
+            const uint32_t resolution = std::max(settings.referenceResolution, 1u);
+            const double weight = 1.0 / (double(resolution) * resolution);
+            for (uint32_t y = 0; y < resolution; y++)
+            {
+                for (uint32_t x = 0; x < resolution; x++)
+                {
+                    const float2 uv = float2((x + 0.5f) / resolution, (y + 0.5f) / resolution);
+                    reference[FindRegion(scene, uniformSamplingSphereFromUV(uv))] += weight;
+                }
+            }
+        }
+
+        std::vector<SobolBenchmarkRow> rows;
+        for (uint32_t numBeams : settings.numBeams)
+        {
+            SobolBenchmarkRow row;
+            row.numBeams = numBeams;
+
+            for (uint32_t trial = 0; trial < settings.numTrials; trial++)
+            {
+                const uint32_t seed = settings.seed + trial;
+
+                // two rnd() draws from the stream of the launch, the way uniformSamplingSphere() takes them
+                row.lcgRmse += SquaredFluxError(scene, reference, numBeams, [&](uint32_t launchIndex)
+                {
+                    uint32_t state = lcgInitSeed(launchIndex, seed);
+                    const float u = float(lcg(state)) / float(0x01000000);
+                    const float v = float(lcg(state)) / float(0x01000000);
+                    return float2(u, v);
+                });
+
+                row.pcgRmse += SquaredFluxError(scene, reference, numBeams, [&](uint32_t launchIndex)
+                {
+                    uint32_t state = pcgInitSeed(launchIndex, seed);
+                    const float u = float(pcg32(state) >> 8) / float(0x01000000);
+                    const float v = float(pcg32(state) >> 8) / float(0x01000000);
+                    return float2(u, v);
+                });
+
+                // dimension pair 0 of BeamGen
+                row.sobolRmse += SquaredFluxError(scene, reference, numBeams, [&](uint32_t launchIndex)
+                {
+                    return toFloat2(sobolSample2D(launchIndex, 0, seed));
+                });
+            }
+
+            const double normalization = 1.0 / (double(std::max(settings.numTrials, 1u)) * numRegions);
+            row.lcgRmse = std::sqrt(row.lcgRmse * normalization);
+            row.pcgRmse = std::sqrt(row.pcgRmse * normalization);
+            row.sobolRmse = std::sqrt(row.sobolRmse * normalization);
+            rows.push_back(row);
+        }
+
+        std::vector<double> beamCounts;
+        std::vector<double> sobolRmses;
+        for (const auto& row : rows)
+        {
+            beamCounts.push_back(row.numBeams);
+            sobolRmses.push_back(row.sobolRmse);
+        }
+
+        for (auto& row : rows)
+        {
+            row.sobolBeamsForLcgRmse = InterpolateLogLog(beamCounts, sobolRmses, row.lcgRmse);
+        }
+
+        return rows;
+    }
+
+    std::string FormatSobolBenchmarkResults(const std::vector<SobolBenchmarkRow>& rows)
+    {
+        std::string text;
+        char line[256];
+
+        for (const auto& row : rows)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%6u beams  rmse LCG %.3e  PCG %.3e  Sobol %.3e  Sobol beams for the LCG error %8.0f (%.2fx fewer)\n",
+                row.numBeams,
+                row.lcgRmse,
+                row.pcgRmse,
+                row.sobolRmse,
+                row.sobolBeamsForLcgRmse,
+                row.sobolBeamsForLcgRmse > 0.0 ? row.numBeams / row.sobolBeamsForLcgRmse : 0.0
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
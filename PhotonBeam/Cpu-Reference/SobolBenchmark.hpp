@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Error of the beam emission against the number of beams, for the Sobol sampler of Shaders/util/SobolSampler.h and
+// the random generators of Shaders/util/RandomNumberGenerator.h.
+//
+// The emission of BeamGen.hlsl shoots launch i from the light in uniformSamplingSphere() directions, here from the
+// light of the Cornell scene. The first hits are counted in regions, a 4x4 grid on every face of the boxes of the
+// scene and one region for the open front, and the fraction of the beams of a region estimates the flux reaching it.
+// The reference is the midpoint rule on a fine grid of the (u, v) square, which uniformSamplingSphereFromUV() maps to
+// equal solid angles.
+namespace CpuReference
+{
+    struct SobolBenchmarkSettings
+    {
+        // the beam counts of the sweep, numLaunches of BeamGen
+        std::vector<uint32_t> numBeams = { 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384 };
+
+        // frames of other seeds per beam count, the RMSE is taken over all of them
+        uint32_t numTrials = 32;
+
+        // the reference grid is referenceResolution^2 directions
+        uint32_t referenceResolution = 2048;
+
+        uint32_t seed = 1;
+    };
+
+    struct SobolBenchmarkRow
+    {
+        uint32_t numBeams = 0;
+
+        // RMSE of the flux fractions of the regions against the reference
+        double lcgRmse = 0.0;
+        double pcgRmse = 0.0;
+        double sobolRmse = 0.0;
+
+        // beams the Sobol sampler needs for lcgRmse, interpolated on the log-log curve of the sweep
+        double sobolBeamsForLcgRmse = 0.0;
+    };
+
+    std::vector<SobolBenchmarkRow> RunSobolBenchmark(const SobolBenchmarkSettings& settings = {});
+
+    // one line per beam count
+    std::string FormatSobolBenchmarkResults(const std::vector<SobolBenchmarkRow>& rows);
+}
@@ -0,0 +1,224 @@
+
+#include "SubBeamSplitter.hpp"
+#include "RayTracingSampling.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace CpuReference
+{
+    namespace
+    {
+        constexpr double c_piD = 3.14159265358979323846;
+
+        // world space AABB extents of a sub-beam box, per axis
+        //  segmentLength * |d| along the beam, plus the 2r x 2r cross section
+        struct SubBeamBoxExtents
+        {
+            float3 alongBeam;     // |d|, scaled by the segment length
+            float3 crossSection;  // 2r * (|bitangent| + |tangent|), the same for any segment length
+
+            float3 Extents(float segmentLength) const
+            {
+                return alongBeam * segmentLength + crossSection;
+            }
+        };
+
+        SubBeamBoxExtents ComputeBoxExtents(const float3& beamDirection, float beamRadius)
+        {
+            float3 tangent, bitangent;
+            createCoordinateSystem(beamDirection, tangent, bitangent);
+
+            SubBeamBoxExtents extents;
+            extents.alongBeam = float3(std::abs(beamDirection.x), std::abs(beamDirection.y), std::abs(beamDirection.z));
+            extents.crossSection = 2.0f * beamRadius * float3(
+                std::abs(bitangent.x) + std::abs(tangent.x),
+                std::abs(bitangent.y) + std::abs(tangent.y),
+                std::abs(bitangent.z) + std::abs(tangent.z)
+            );
+            return extents;
+        }
+
+        float BoxArea(const float3& e)
+        {
+            return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+
+        float BoxVolume(const float3& e)
+        {
+            return e.x * e.y * e.z;
+        }
+
+        void AccumulateStats(
+            const SubBeamBoxExtents& boxExtents,
+            float beamLength,
+            float beamRadius,
+            uint32_t numSegments,
+            const SubBeamSplitSettings& settings,
+            SubBeamSplitStats& stats
+        )
+        {
+            float3 extents = boxExtents.Extents(beamLength / float(numSegments));
+
+            stats.numSubBeams += numSegments;
+            stats.maxSubBeamsPerBeam = std::max(stats.maxSubBeamsPerBeam, numSegments);
+            stats.numBeamsOver16 += numSegments > 16 ? 1 : 0;
+
+            stats.sahCost += double(numSegments) * (BoxArea(extents) / (beamRadius * beamRadius) + settings.instanceCostArea);
+            stats.boxToBeamVolume += double(numSegments) * BoxVolume(extents);
+
+            // neighbouring boxes are shifted by the segment, which leaves the cross section extents shared on every axis
+            stats.adjacentOverlapToBeamVolume += double(numSegments - 1) * BoxVolume(boxExtents.crossSection);
+        }
+    }
+
+    uint32_t UniformSubBeamCount(float beamLength, float beamRadius)
+    {
+        uint32_t numSplit = uint32_t(beamLength / (beamRadius * 2.0f) + 1.0f);
+        if (numSplit * beamRadius * 2.0 <= beamLength)
+            numSplit += 1;
+
+        return numSplit;
+    }
+
+    uint32_t AdaptiveSubBeamCount(const float3& beamDirection, float beamLength, float beamRadius, const SubBeamSplitSettings& settings)
+    {
+        const SubBeamBoxExtents boxExtents = ComputeBoxExtents(beamDirection, beamRadius);
+        const float instanceCost = settings.instanceCostArea * beamRadius * beamRadius;
+
+        // n * area(L / n) = A * L^2 / n + B * L + C * n, the cost is minimal at n = L * sqrt(A / (C + instance cost))
+        const float3& a = boxExtents.alongBeam;
+        const float3& w = boxExtents.crossSection;
+        const float areaA = BoxArea(a);
+        const float areaC = BoxArea(w);
+
+        float bestCount = std::min(beamLength * std::sqrt(areaA / (areaC + instanceCost)), 1e9f);
+
+        uint32_t lower = std::max(1u, uint32_t(bestCount));
+        uint32_t upper = lower + 1;
+
+        auto cost = [&](uint32_t n) { return float(n) * (BoxArea(boxExtents.Extents(beamLength / float(n))) + instanceCost); };
+        uint32_t numSegments = cost(lower) <= cost(upper) ? lower : upper;
+
+        if (settings.capToUniformCount)
+            numSegments = std::min(numSegments, UniformSubBeamCount(beamLength, beamRadius));
+
+        return numSegments;
+    }
+
+    float SubBeamBoxArea(const float3& beamDirection, float segmentLength, float beamRadius)
+    {
+        return BoxArea(ComputeBoxExtents(beamDirection, beamRadius).Extents(segmentLength));
+    }
+
+    float SubBeamBoxVolume(const float3& beamDirection, float segmentLength, float beamRadius)
+    {
+        return BoxVolume(ComputeBoxExtents(beamDirection, beamRadius).Extents(segmentLength));
+    }
+
+    void SplitBeam(
+        const float3& startPos,
+        const float3& endPos,
+        float beamRadius,
+        SubBeamSplitMode mode,
+        const SubBeamSplitSettings& settings,
+        std::vector<SubBeamSegment>& segments
+    )
+    {
+        const float beamLength = length(endPos - startPos);
+        if (beamLength <= 0.0f)
+            return;
+
+        const float3 beamDirection = (endPos - startPos) / beamLength;
+
+        if (mode == SubBeamSplitMode::Uniform)
+        {
+            // the last sub-beam sticks out of the beam end, as in BeamGen.hlsl
+            const uint32_t numSegments = UniformSubBeamCount(beamLength, beamRadius);
+            for (uint32_t i = 0; i < numSegments; i++)
+            {
+                segments.push_back({ startPos + beamRadius * 2.0f * float(i) * beamDirection, beamRadius * 2.0f });
+            }
+            return;
+        }
+
+        const uint32_t numSegments = AdaptiveSubBeamCount(beamDirection, beamLength, beamRadius, settings);
+        const float segmentLength = beamLength / float(numSegments);
+        for (uint32_t i = 0; i < numSegments; i++)
+        {
+            segments.push_back({ startPos + segmentLength * float(i) * beamDirection, segmentLength });
+        }
+    }
+
+    SubBeamCostReport BuildSubBeamCostReport(const std::vector<PhotonBeam>& beams, float beamRadius, const SubBeamSplitSettings& settings)
+    {
+        SubBeamCostReport report;
+        double beamVolume = 0.0;
+
+        for (const auto& beam : beams)
+        {
+            const float3 beamVec = float3(beam.endPos) - float3(beam.startPos);
+            const float beamLength = length(beamVec);
+            if (beamLength <= 0.0f)
+                continue;
+
+            const float3 beamDirection = beamVec / beamLength;
+            const SubBeamBoxExtents boxExtents = ComputeBoxExtents(beamDirection, beamRadius);
+
+            report.numBeams++;
+            beamVolume += c_piD * beamRadius * beamRadius * beamLength;
+
+            // uniform sub-beams have the fixed length 2r, their total length is a multiple of 2r
+            const uint32_t uniformCount = UniformSubBeamCount(beamLength, beamRadius);
+            AccumulateStats(boxExtents, uniformCount * beamRadius * 2.0f, beamRadius, uniformCount, settings, report.uniform);
+
+            const uint32_t adaptiveCount = AdaptiveSubBeamCount(beamDirection, beamLength, beamRadius, settings);
+            AccumulateStats(boxExtents, beamLength, beamRadius, adaptiveCount, settings, report.adaptive);
+        }
+
+        if (beamVolume > 0.0)
+        {
+            for (SubBeamSplitStats* stats : { &report.uniform, &report.adaptive })
+            {
+                stats->boxToBeamVolume /= beamVolume;
+                stats->adjacentOverlapToBeamVolume /= beamVolume;
+            }
+        }
+
+        return report;
+    }
+
+    std::string FormatSubBeamCostReport(const SubBeamCostReport& report)
+    {
+        std::string text;
+        char line[256];
+
+        std::snprintf(line, sizeof(line), "beams %llu\n", static_cast<unsigned long long>(report.numBeams));
+        text += line;
+
+        const std::pair<const char*, const SubBeamSplitStats*> rows[] = {
+            { "uniform", &report.uniform },
+            { "adaptive", &report.adaptive },
+        };
+
+        for (const auto& [name, stats] : rows)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-9s sub-beams %10llu (%6.2f per beam, max %4u, %llu beams over 16)  SAH cost %12.4g  box/beam volume %7.3f  adjacent overlap/beam volume %7.3f\n",
+                name,
+                static_cast<unsigned long long>(stats->numSubBeams),
+                report.numBeams > 0 ? double(stats->numSubBeams) / double(report.numBeams) : 0.0,
+                stats->maxSubBeamsPerBeam,
+                static_cast<unsigned long long>(stats->numBeamsOver16),
+                stats->sahCost,
+                stats->boxToBeamVolume,
+                stats->adjacentOverlapToBeamVolume
+            );
+            text += line;
+        }
+
+        return text;
+    }
+}
@@ -0,0 +1,100 @@
+
+#pragma once
+
+#include "CpuVector.hpp"
+#include "../Shaders/RaytracingHlslCompat.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Splitting of beams into the sub-beam boxes of the beam acceleration structure.
+// A sub-beam is the beam BLAS box [-1, 1] x [-1, 1] x [0, 2] scaled by (radius, radius, length / 2)
+// along (bitangent, tangent, beam direction) of createCoordinateSystem(beam direction).
+//
+// The uniform splitter is the one of BeamGen.hlsl, a sub-beam every 2 * radius.
+// The adaptive splitter picks the number of equal length segments minimizing a SAH estimate of the traversal cost,
+//  cost(n) = n * (area of the world space AABB of one segment + instance cost)
+// The AABB area is the probability of a camera ray testing the segment, so a beam aligned with an axis,
+// whose AABB stays tight at any length, gets a single segment while a diagonal beam gets more.
+// Equal lengths are optimal for a given n since the AABB area is convex in the segment length.
+namespace CpuReference
+{
+    enum class SubBeamSplitMode
+    {
+        Uniform,
+        Adaptive,
+    };
+
+    struct SubBeamSplitSettings
+    {
+        // cost of one instance(TLAS build, instance transform, any hit call) as an AABB area in units of radius^2.
+        // 24 is the area of the 2r cube of the uniform splitter.
+        float instanceCostArea = 24.0f;
+
+        // the adaptive splitter never uses more segments than the uniform one
+        bool capToUniformCount = true;
+    };
+
+    struct SubBeamSegment
+    {
+        float3 start;
+        float length;
+    };
+
+    // number of sub-beams of BeamGen.hlsl
+    uint32_t UniformSubBeamCount(float beamLength, float beamRadius);
+
+    // number of equal length segments minimizing the SAH cost
+    uint32_t AdaptiveSubBeamCount(const float3& beamDirection, float beamLength, float beamRadius, const SubBeamSplitSettings& settings = {});
+
+    // surface area and volume of the world space AABB of one sub-beam box
+    float SubBeamBoxArea(const float3& beamDirection, float segmentLength, float beamRadius);
+    float SubBeamBoxVolume(const float3& beamDirection, float segmentLength, float beamRadius);
+
+    // appends the segments of one beam
+    void SplitBeam(
+        const float3& startPos,
+        const float3& endPos,
+        float beamRadius,
+        SubBeamSplitMode mode,
+        const SubBeamSplitSettings& settings,
+        std::vector<SubBeamSegment>& segments
+    );
+
+    struct SubBeamSplitStats
+    {
+        uint64_t numSubBeams = 0;
+        uint32_t maxSubBeamsPerBeam = 0;
+
+        // beams needing more than the 16 sub-beams per beam sample m_maxNumSubBeamInfo is sized for
+        uint64_t numBeamsOver16 = 0;
+
+        // sum over the sub-beams of the SAH cost, area of the AABB + instance cost, in units of radius^2
+        double sahCost = 0.0;
+
+        // sum of the AABB volumes over the volume of the beam cylinders, 1 is a perfect fit
+        double boxToBeamVolume = 0.0;
+
+        // volume shared by the AABBs of neighbouring sub-beams over the volume of the beam cylinders.
+        // A ray through the shared volume runs the any hit shader of both sub-beams.
+        double adjacentOverlapToBeamVolume = 0.0;
+    };
+
+    struct SubBeamCostReport
+    {
+        uint64_t numBeams = 0;
+
+        SubBeamSplitStats uniform;
+        SubBeamSplitStats adaptive;
+    };
+
+    // Compares the two splitters over the beams, beams of zero length are skipped.
+    SubBeamCostReport BuildSubBeamCostReport(
+        const std::vector<PhotonBeam>& beams,
+        float beamRadius,
+        const SubBeamSplitSettings& settings = {}
+    );
+
+    std::string FormatSubBeamCostReport(const SubBeamCostReport& report);
+}
@@ -11,6 +11,17 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCo
 
     PcRay = std::make_unique<UploadBuffer<PushConstantRay>>(device, 1, true);
     PcBeam = std::make_unique<UploadBuffer<PushConstantBeam>>(device, 1, true);
+    BeamCull = std::make_unique<UploadBuffer<BeamCullConstants>>(device, 1, true);
+
+    auto readbackHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+    auto readbackDesc = CD3DX12_RESOURCE_DESC::Buffer(c_beamReadbackSize);
+    ThrowIfFailed(device->CreateCommittedResource(
+        &readbackHeapProperties,
+        D3D12_HEAP_FLAG_NONE,
+        &readbackDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(BeamCounterReadback.GetAddressOf())));
 }
 
 FrameResource::~FrameResource()
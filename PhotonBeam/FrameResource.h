@@ -24,6 +24,12 @@ struct PassConstants
     float LightIntensity = 10.0f;
 };
 
+// Layout of FrameResource::BeamCounterReadback, the beam counters, the sub-beam cull counters
+// and the timestamps before and after the beam TLAS build.
+constexpr UINT64 c_beamReadbackCullCounterOffset = sizeof(PhotonBeamCounter);
+constexpr UINT64 c_beamReadbackTimestampOffset = c_beamReadbackCullCounterOffset + sizeof(SubBeamCullCounter);
+constexpr UINT64 c_beamReadbackSize = c_beamReadbackTimestampOffset + 2 * sizeof(UINT64);
+
 
 // Stores the resources needed for the CPU to build the command lists
 // for a frame.  
@@ -47,6 +53,14 @@ public:
 
     std::unique_ptr<UploadBuffer<PushConstantRay>> PcRay = nullptr;
     std::unique_ptr<UploadBuffer<PushConstantBeam>> PcBeam = nullptr;
+    std::unique_ptr<UploadBuffer<BeamCullConstants>> BeamCull = nullptr;
+
+    // Beam counters, cull counters and TLAS build timestamps copied after the beam tracing of the frame,
+    // read when the frame resource is reused, with the capacities the frame ran with.
+    Microsoft::WRL::ComPtr<ID3D12Resource> BeamCounterReadback = nullptr;
+    bool BeamCounterPending = false;
+    uint32_t BeamDataCapacity = 0;
+    uint32_t SubBeamInfoCapacity = 0;
 
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
@@ -11,6 +11,8 @@
 #include <microsoft-directx-graphics-samples/raytraceHelper.h>
 
 #include "Shaders/RaytracingHlslCompat.h"
+#include "Shaders/util/HenyeyGreensteinTable.h"
+#include "Shaders/util/BeamInstance.h"
 #include "AS-Builders/BlasGenerator.hpp"
 #include "Raytracing-Utils/DXCompileShader.hpp"
 
@@ -68,15 +70,33 @@ XMFLOAT3 getLightMotion(const float totalTime, const DirectX::XMFLOAT3& lightPos
 }
 
 
+// The buffers start at the maximum capacities and the planner shrinks them to the demand of the scene.
+CpuReference::BeamCapacityPlannerSettings getBeamCapacityPlannerSettings(uint32_t maxNumBeamData, uint32_t maxNumSubBeamInfo)
+{
+    CpuReference::BeamCapacityPlannerSettings settings;
+    settings.maxBeams = maxNumBeamData;
+    settings.maxSubBeams = maxNumSubBeamInfo;
+    settings.minBeams = std::min<uint64_t>(settings.minBeams, maxNumBeamData);
+    settings.minSubBeams = std::min<uint64_t>(settings.minSubBeams, maxNumSubBeamInfo);
+    return settings;
+}
+
+
 PhotonBeamApp::PhotonBeamApp(HINSTANCE hInstance): 
     D3DApp(hInstance),
     m_offScreenOutputResourceUAVDescriptorHeapIndex(UINT_MAX),
     m_beamTracingDescriptorsAllocated(0),
+    m_beamTracingBeamDataHeapIndex(UINT_MAX),
+    m_beamTracingSubBeamInfoHeapIndex(UINT_MAX),
     m_rayTracingDescriptorsAllocated(0),
+    m_rayTracingBeamDataHeapIndex(UINT_MAX),
     m_maxNumSubBeamInfo(
         ((m_maxNumBeamSamples * 16 + m_maxNumPhotonSamples) / SUB_BEAM_INFO_BUFFER_RESET_COMPUTE_SHADER_GROUP_SIZE)
         * SUB_BEAM_INFO_BUFFER_RESET_COMPUTE_SHADER_GROUP_SIZE
-    )
+    ),
+    m_beamDataCapacity(m_maxNumBeamData),
+    m_subBeamInfoCapacity(m_maxNumSubBeamInfo),
+    m_beamCapacityPlanner(m_maxNumBeamData, m_maxNumSubBeamInfo, getBeamCapacityPlannerSettings(m_maxNumBeamData, m_maxNumSubBeamInfo))
 {
     mClientWidth = 1400;
     mClientHeight = 800;
@@ -89,6 +109,7 @@ PhotonBeamApp::PhotonBeamApp(HINSTANCE hInstance):
 
     mLastMousePos = POINT{};
     m_useRayTracer = true;
+    m_beamCullMode = BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS;
     m_isBeamMotionOn = true;
     m_isRandomSeedChanging = true;
     m_airScatterCoff = XMVECTORF32{};
@@ -118,8 +139,8 @@ PhotonBeamApp::PhotonBeamApp(HINSTANCE hInstance):
 
     SetDefaults();
 
-    m_pcBeam.maxNumBeams = m_maxNumBeamData;
-    m_pcBeam.maxNumSubBeams = m_maxNumSubBeamInfo;
+    m_pcBeam.maxNumBeams = m_beamDataCapacity;
+    m_pcBeam.maxNumSubBeams = m_subBeamInfoCapacity;
 
 }
 
@@ -179,6 +200,8 @@ bool PhotonBeamApp::Initialize()
 
     ComPtr<ID3D12Resource> resetValuploadBuffer = nullptr;
     CreateBeamBuffers(resetValuploadBuffer);
+    ComPtr<ID3D12Resource> hgTableUploadBuffer = nullptr;
+    CreateHenyeyGreensteinTable(hgTableUploadBuffer);
     BuildBeamTracingShaderTables();
     BuildRayTracingShaderTables();
 
@@ -318,6 +341,9 @@ void PhotonBeamApp::Update(const GameTimer& gt)
         }
     }
 
+    // may resize the beam buffers, before their capacities are set in the push constants
+    ReadBeamCounters();
+
     UpdateObjectCBs(gt);
     UpdateMainPassCB(gt);
     UpdateRayTracingPushConstants(gt);
@@ -431,25 +457,17 @@ void PhotonBeamApp::Rasterize()
 
 void PhotonBeamApp::BeamTrace()
 {
-    // Reset Sub beam info buffer
+    // Reset the culled sub beam info buffer, the TLAS is built over its whole capacity
     {
         mCommandList->SetPipelineState(m_beamBufferResetPso.Get());
         mCommandList->SetComputeRootSignature(m_bufferResetRootSignature.Get());
-        mCommandList->SetComputeRootUnorderedAccessView(0, m_beamAsInstanceDescData->GetGPUVirtualAddress());
+        mCommandList->SetComputeRootUnorderedAccessView(0, m_culledBeamAsInstanceDescData->GetGPUVirtualAddress());
 
-        const auto num_groups = m_maxNumSubBeamInfo / 256;
+        const auto num_groups = m_subBeamInfoCapacity / SUB_BEAM_INFO_BUFFER_RESET_COMPUTE_SHADER_GROUP_SIZE;
         mCommandList->Dispatch(num_groups, 1, 1);
-
-        auto resourceBarrierRead = CD3DX12_RESOURCE_BARRIER::Transition(
-            m_beamAsInstanceDescData.Get(),
-            D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-            D3D12_RESOURCE_STATE_GENERIC_READ
-        );
-
-        //mCommandList->ResourceBarrier(1, &resourceBarrierRead);
     }
 
-    auto subBeamBarrier = CD3DX12_RESOURCE_BARRIER::UAV(m_beamAsInstanceDescData.Get());
+    auto subBeamBarrier = CD3DX12_RESOURCE_BARRIER::UAV(m_culledBeamAsInstanceDescData.Get());
     mCommandList->ResourceBarrier(1, &subBeamBarrier);
 
 
@@ -462,6 +480,8 @@ void PhotonBeamApp::BeamTrace()
 
         mCommandList->SetComputeRootSignature(globalRootSignature.Get());
         mCommandList->SetComputeRootConstantBufferView(to_underlying(EGlobalParams::SceneConstantSlot), pcBeam->GetGPUVirtualAddress());
+        mCommandList->SetComputeRootShaderResourceView(to_underlying(EGlobalParams::HenyeyGreensteinTableSlot), m_hgTable->GetGPUVirtualAddress());
+        mCommandList->SetComputeRootUnorderedAccessView(to_underlying(EGlobalParams::BeamGatherDataSlot), m_beamGatherData->GetGPUVirtualAddress());
     
         mCommandList->SetDescriptorHeaps(1, m_beamTracingDescriptorHeap.GetAddressOf());
 
@@ -504,21 +524,105 @@ void PhotonBeamApp::BeamTrace()
         mCommandList->DispatchRays(&dispatchDesc);
     }
 
-    auto resourceBarrierRender = CD3DX12_RESOURCE_BARRIER::Transition(
-        m_beamAsInstanceDescData.Get(),
-        D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE 
-    );
-    mCommandList->ResourceBarrier(1, &resourceBarrierRender);   
+    // Cull the sub beams no ray of RayTrace() can reach and compact the others into the TLAS input
+    {
+        mCommandList->CopyBufferRegion(
+            m_subBeamCullCounter.Get(),
+            0,
+            m_beamCounterReset.Get(),
+            0,
+            sizeof(SubBeamCullCounter)
+        );
+
+        CD3DX12_RESOURCE_BARRIER cullBarriers[] = {
+            CD3DX12_RESOURCE_BARRIER::UAV(m_beamAsInstanceDescData.Get()),
+            CD3DX12_RESOURCE_BARRIER::UAV(m_beamCounter.Get()),
+            CD3DX12_RESOURCE_BARRIER::Transition(
+                m_subBeamCullCounter.Get(),
+                D3D12_RESOURCE_STATE_COPY_DEST,
+                D3D12_RESOURCE_STATE_UNORDERED_ACCESS
+            ),
+        };
+        mCommandList->ResourceBarrier(_countof(cullBarriers), cullBarriers);
+
+        mCommandList->SetPipelineState(m_beamCullPso.Get());
+        mCommandList->SetComputeRootSignature(m_beamCullRootSignature.Get());
+        mCommandList->SetComputeRootConstantBufferView(0, m_currFrameResource->BeamCull->Resource()->GetGPUVirtualAddress());
+        mCommandList->SetComputeRootShaderResourceView(1, m_beamCounter->GetGPUVirtualAddress());
+        mCommandList->SetComputeRootUnorderedAccessView(2, m_beamAsInstanceDescData->GetGPUVirtualAddress());
+        mCommandList->SetComputeRootUnorderedAccessView(3, m_culledBeamAsInstanceDescData->GetGPUVirtualAddress());
+        mCommandList->SetComputeRootUnorderedAccessView(4, m_subBeamCullCounter->GetGPUVirtualAddress());
+
+        const auto num_groups = m_subBeamInfoCapacity / SUB_BEAM_INFO_BUFFER_RESET_COMPUTE_SHADER_GROUP_SIZE;
+        mCommandList->Dispatch(num_groups, 1, 1);
+    }
+
+    // Copy the beam and cull counters for the capacity planner and the UI, they are read back once the frame resource is reused
+    {
+        CD3DX12_RESOURCE_BARRIER counterBarriers[] = {
+            CD3DX12_RESOURCE_BARRIER::Transition(
+                m_beamCounter.Get(),
+                D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+                D3D12_RESOURCE_STATE_COPY_SOURCE
+            ),
+            CD3DX12_RESOURCE_BARRIER::Transition(
+                m_subBeamCullCounter.Get(),
+                D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+                D3D12_RESOURCE_STATE_COPY_SOURCE
+            ),
+        };
+        mCommandList->ResourceBarrier(_countof(counterBarriers), counterBarriers);
+
+        mCommandList->CopyBufferRegion(
+            m_currFrameResource->BeamCounterReadback.Get(),
+            0,
+            m_beamCounter.Get(),
+            0,
+            sizeof(PhotonBeamCounter)
+        );
+        mCommandList->CopyBufferRegion(
+            m_currFrameResource->BeamCounterReadback.Get(),
+            c_beamReadbackCullCounterOffset,
+            m_subBeamCullCounter.Get(),
+            0,
+            sizeof(SubBeamCullCounter)
+        );
+
+        m_currFrameResource->BeamCounterPending = true;
+        m_currFrameResource->BeamDataCapacity = m_beamDataCapacity;
+        m_currFrameResource->SubBeamInfoCapacity = m_subBeamInfoCapacity;
+    }
+
+    // BeamGen promotes the gather data from COMMON to UNORDERED_ACCESS through its root UAV, RayTrace() reads it as a
+    // root SRV. Like the culled instances, it is not transitioned back, buffers decay to COMMON at the end of
+    // ExecuteCommandLists and the next BeamGen promotes it again.
+    CD3DX12_RESOURCE_BARRIER renderBarriers[] = {
+        CD3DX12_RESOURCE_BARRIER::Transition(
+            m_culledBeamAsInstanceDescData.Get(),
+            D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE
+        ),
+        CD3DX12_RESOURCE_BARRIER::Transition(
+            m_beamGatherData.Get(),
+            D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE
+        ),
+    };
+    mCommandList->ResourceBarrier(_countof(renderBarriers), renderBarriers);
     
+    const UINT timestampIndex = 2 * m_currFrameResourceIndex;
+    mCommandList->EndQuery(m_beamTimestampQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampIndex);
+
     {
         // Create a descriptor of the requested builder work, to generate a top-level
-        // AS from the input parameters
+        // AS from the input parameters.
+        // The culled instances are packed at the front and the rest of the capacity is zeroed, D3D12 has no
+        // indirect instance count, so the build still walks the whole capacity but skips the empty instances.
         D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
         buildDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
         buildDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-        buildDesc.Inputs.InstanceDescs = m_beamAsInstanceDescData->GetGPUVirtualAddress();
-        buildDesc.Inputs.NumDescs = m_maxNumSubBeamInfo;
+        buildDesc.Inputs.InstanceDescs = m_culledBeamAsInstanceDescData->GetGPUVirtualAddress();
+        buildDesc.Inputs.NumDescs = m_subBeamInfoCapacity;
         buildDesc.DestAccelerationStructureData = m_beamTlasBuffers.pResult->GetGPUVirtualAddress();
         buildDesc.ScratchAccelerationStructureData = m_beamTlasBuffers.pScratch->GetGPUVirtualAddress();
         buildDesc.Inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
@@ -529,6 +633,16 @@ void PhotonBeamApp::BeamTrace()
     
     auto tlasBarrier = CD3DX12_RESOURCE_BARRIER::UAV(m_beamTlasBuffers.pResult.Get());
     mCommandList->ResourceBarrier(1, &tlasBarrier);
+
+    mCommandList->EndQuery(m_beamTimestampQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampIndex + 1);
+    mCommandList->ResolveQueryData(
+        m_beamTimestampQueryHeap.Get(),
+        D3D12_QUERY_TYPE_TIMESTAMP,
+        timestampIndex,
+        2,
+        m_currFrameResource->BeamCounterReadback.Get(),
+        c_beamReadbackTimestampOffset
+    );
 }
 
 void PhotonBeamApp::RayTrace()
@@ -543,6 +657,14 @@ void PhotonBeamApp::RayTrace()
         to_underlying(EGlobalParams::SceneConstantSlot), 
         pcRay->GetGPUVirtualAddress()
     );
+    mCommandList->SetComputeRootShaderResourceView(
+        to_underlying(EGlobalParams::HenyeyGreensteinTableSlot),
+        m_hgTable->GetGPUVirtualAddress()
+    );
+    mCommandList->SetComputeRootShaderResourceView(
+        to_underlying(EGlobalParams::BeamGatherDataSlot),
+        m_beamGatherData->GetGPUVirtualAddress()
+    );
 
     mCommandList->SetDescriptorHeaps(1, m_rayTracingDescriptorHeap.GetAddressOf());
 
@@ -865,8 +987,15 @@ void PhotonBeamApp::UpdateRayTracingPushConstants(const GameTimer& gt)
     m_pcBeam.sourceLight = XMFLOAT3(m_sourceLight[0], m_sourceLight[1], m_sourceLight[2]);
     m_pcBeam.numBeamSources = m_usePhotonBeam ? m_numBeamSamples : 0;
     m_pcBeam.numPhotonSources = m_usePhotonMapping ? m_numPhotonSamples : 0;
-    m_pcBeam.maxNumBeams = m_maxNumBeamData;
-    m_pcBeam.maxNumSubBeams = m_maxNumSubBeamInfo;
+    m_pcBeam.maxNumBeams = m_beamDataCapacity;
+    m_pcBeam.maxNumSubBeams = m_subBeamInfoCapacity;
+
+    // a spread angle of 0 gives every beam m_beamRadius
+    m_pcBeam.cameraPosition = m_camera.GetPosition3f();
+    m_pcBeam.pixelSpreadAngle = m_useFootprintBeamRadius ? CpuReference::PixelSpreadAngle(m_camera.GetFovY(), mClientHeight) : 0.0f;
+    m_pcBeam.footprintPixels = m_beamFootprintPixels;
+    m_pcBeam.minBeamRadius = m_beamRadius / m_footprintRadiusRange;
+    m_pcBeam.maxBeamRadius = m_beamRadius * m_footprintRadiusRange;
 
     
 
@@ -932,6 +1061,14 @@ void PhotonBeamApp::UpdateRayTracingPushConstants(const GameTimer& gt)
     auto currPcBeam = m_currFrameResource->PcBeam.get();
     currPcBeam->CopyData(0, m_pcBeam);
 
+    auto beamCull = CpuReference::MakeBeamCullConstants(
+        m_pcRay,
+        m_mirrorSurfaces,
+        static_cast<uint32_t>(m_beamCullMode),
+        m_subBeamInfoCapacity
+    );
+    m_currFrameResource->BeamCull->CopyData(0, beamCull);
+
 }
 
 void PhotonBeamApp::BuildDescriptorHeaps()
@@ -1251,6 +1388,22 @@ void PhotonBeamApp::BuildRayTracingRootSignatures()
         );
     }
 
+    // sub beam culling root signature
+    {
+        CD3DX12_ROOT_PARAMETER rootParameters[5] = {};
+        rootParameters[0].InitAsConstantBufferView(0);
+        rootParameters[1].InitAsShaderResourceView(0);
+        rootParameters[2].InitAsUnorderedAccessView(0);
+        rootParameters[3].InitAsUnorderedAccessView(1);
+        rootParameters[4].InitAsUnorderedAccessView(2);
+
+        CD3DX12_ROOT_SIGNATURE_DESC desc(_countof(rootParameters), rootParameters, 1, &GetLinearSampler());
+        SerializeAndCreateRootSignature(
+            desc,
+            m_beamCullRootSignature.GetAddressOf()
+        );
+    }
+
     // Global Root Signature
     // This is a root signature that is shared across all raytracing shaders invoked during a DispatchRays() call.
     {
@@ -1261,6 +1414,8 @@ void PhotonBeamApp::BuildRayTracingRootSignatures()
             CD3DX12_ROOT_PARAMETER rootParameters[to_underlying(EGlobalParams::Count)] = {};
             
             rootParameters[to_underlying(EGlobalParams::SceneConstantSlot)].InitAsConstantBufferView(0);
+            rootParameters[to_underlying(EGlobalParams::HenyeyGreensteinTableSlot)].InitAsShaderResourceView(0, 2);
+            rootParameters[to_underlying(EGlobalParams::BeamGatherDataSlot)].InitAsUnorderedAccessView(0, 3);
             
             CD3DX12_ROOT_SIGNATURE_DESC desc(ARRAYSIZE(rootParameters), rootParameters);
             SerializeAndCreateRootSignature(
@@ -1326,6 +1481,8 @@ void PhotonBeamApp::BuildRayTracingRootSignatures()
             CD3DX12_ROOT_PARAMETER rootParameters[to_underlying(EGlobalParams::Count)] = {};
 
             rootParameters[to_underlying(EGlobalParams::SceneConstantSlot)].InitAsConstantBufferView(0);
+            rootParameters[to_underlying(EGlobalParams::HenyeyGreensteinTableSlot)].InitAsShaderResourceView(0, 2);
+            rootParameters[to_underlying(EGlobalParams::BeamGatherDataSlot)].InitAsShaderResourceView(0, 3);
 
             CD3DX12_ROOT_SIGNATURE_DESC desc(ARRAYSIZE(rootParameters), rootParameters);
             SerializeAndCreateRootSignature(
@@ -1445,6 +1602,7 @@ void PhotonBeamApp::BuildShadersAndInputLayout()
     m_rasterizeShaders["postPS"] = DxCompileShaderLibrary(L"Shaders\\PostColor.hlsl", L"ps_6_6", L"PS");
 
     m_AsInstanceBufferResetShader = DxCompileShaderLibrary(L"Shaders\\BeamTracing\\ResetSubBeamInfoBuffer.hlsl", L"cs_6_6", L"main");
+    m_beamCullShader = DxCompileShaderLibrary(L"Shaders\\BeamTracing\\CullSubBeamInstances.hlsl", L"cs_6_6", L"main");
 
     m_beamShaders[to_underlying(EBeamTracingShaders::Miss)] = DxCompileShaderLibrary(L"Shaders\\BeamTracing\\BeamMiss.hlsl", L"lib_6_6");
     m_beamShaders[to_underlying(EBeamTracingShaders::CloseHit)] = DxCompileShaderLibrary(L"Shaders\\BeamTracing\\BeamClosestHit.hlsl", L"lib_6_6");
@@ -1499,6 +1657,25 @@ void PhotonBeamApp::LoadScene()
         );
     }
 
+    // surfaces the mirror bounce of RayGen.hlsl reflects off, they bound the beams the culling has to keep
+    m_mirrorSurfaces.clear();
+    for (const auto& node : m_gltfScene.GetNodes())
+    {
+        const auto& mesh = meshes[node.primMesh];
+        const auto& material = materials[std::max(mesh.materialIndex, 0)];
+        if (material.roughnessFactor > MIRROR_BOUNCE_MAX_ROUGHNESS)
+            continue;
+
+        m_mirrorSurfaces.push_back(
+            CpuReference::MakeMirrorSurface(
+                vertexPositions.data() + mesh.vertexOffset,
+                vertexNormals.data() + mesh.vertexOffset,
+                mesh.vertexCount,
+                node.worldMatrix
+            )
+        );
+    }
+
     auto geo = std::make_unique<MeshGeometry>();
     geo->Name = "cornellBox";
 
@@ -1786,6 +1963,19 @@ void PhotonBeamApp::BuildRayTracingPSOs()
         ThrowIfFailed(md3dDevice->CreateComputePipelineState(&bufferResetPsoDesc, IID_PPV_ARGS(m_beamBufferResetPso.GetAddressOf())));
     }
 
+    // create sub beam culling PSO
+    {
+        D3D12_COMPUTE_PIPELINE_STATE_DESC cullPsoDesc = {};
+        cullPsoDesc.pRootSignature = m_beamCullRootSignature.Get();
+        cullPsoDesc.CS = {
+            reinterpret_cast<BYTE*>(m_beamCullShader->GetBufferPointer()),
+            m_beamCullShader->GetBufferSize()
+        };
+        cullPsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+
+        ThrowIfFailed(md3dDevice->CreateComputePipelineState(&cullPsoDesc, IID_PPV_ARGS(m_beamCullPso.GetAddressOf())));
+    }
+
     CD3DX12_STATE_OBJECT_DESC rayTracingPipeline{ D3D12_STATE_OBJECT_TYPE_RAYTRACING_PIPELINE };
 
     for (size_t i = 0; i < to_underlying(ERayTracingShaders::Count); i++)
@@ -1989,6 +2179,8 @@ void PhotonBeamApp::SetDefaults()
     m_beamNearColor = defaultBeamNearColor;
     m_beamUnitDistantColor = defaultBeamUnitDistantColor;
     m_beamRadius = 0.6f;
+    m_useFootprintBeamRadius = false;
+    m_beamFootprintPixels = 24.0f;
     m_photonRadius = 1.0f;
     m_beamIntensity = 3.0f;
     m_usePhotonMapping = true;
@@ -1999,6 +2191,7 @@ void PhotonBeamApp::SetDefaults()
 
     m_numBeamSamples = 1024;
     m_numPhotonSamples = 4 * 4 * 2048;
+    m_beamCullMode = BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS;
 
 
     m_lightPosition = XMFLOAT3{ 0.0f, 0.0f, 0.0f };
@@ -2125,6 +2318,17 @@ void PhotonBeamApp::RenderUI()
             0.05f, 5.0f
         );
 
+        ImGui::Checkbox("Footprint Beam Radius", &m_useFootprintBeamRadius);
+        ImGuiH::Control::Slider(
+            std::string("Footprint Pixels"),
+            "Beam radius in pixels of the camera footprint at the nearest point of the beam,\n"
+            "clamped to 1/4 and 4 times the beam radius",
+            &m_beamFootprintPixels,
+            nullptr,
+            m_useFootprintBeamRadius ? ImGuiH::Control::Flags::Normal : ImGuiH::Control::Flags::Disabled,
+            1.0f, 128.0f
+        );
+
         ImGuiH::Control::Slider(
             std::string("Photon Radius"),  // Name of the parameter
             "Sampling radius for surface photons",
@@ -2169,6 +2373,51 @@ void PhotonBeamApp::RenderUI()
 
     } while (false);
 
+    if (ImGui::CollapsingHeader("Beam Buffers"))
+    {
+        const auto& lastFrame = m_beamCapacityPlanner.LastFrame();
+        ImGui::Text(
+            "Beams %llu / %llu stored, capacity %u",
+            lastFrame.storedBeams,
+            lastFrame.requestedBeams,
+            m_beamDataCapacity
+        );
+        ImGui::Text(
+            "Sub Beams %llu / %llu stored, capacity %u",
+            lastFrame.storedSubBeams,
+            lastFrame.requestedSubBeams,
+            m_subBeamInfoCapacity
+        );
+        ImGui::Text(
+            "Overflow frames %llu, dropped beams %llu, dropped sub beams %llu",
+            m_beamCapacityPlanner.NumOverflowFrames(),
+            m_beamCapacityPlanner.NumDroppedBeams(),
+            m_beamCapacityPlanner.NumDroppedSubBeams()
+        );
+        ImGui::Text("Buffer resizes %llu", m_beamCapacityPlanner.NumResizes());
+    }
+
+    if (ImGui::CollapsingHeader("Beam Culling"))
+    {
+        ImGui::RadioButton("Keep All", &m_beamCullMode, BEAM_CULL_MODE_KEEP_ALL);
+        ImGui::SameLine();
+        ImGui::RadioButton("Frustum", &m_beamCullMode, BEAM_CULL_MODE_FRUSTUM);
+        ImGui::SameLine();
+        ImGui::RadioButton("Frustum and Mirrors", &m_beamCullMode, BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS);
+
+        const float culledPercent = m_subBeamCullStats.numInstances > 0
+            ? 100.0f * (1.0f - float(m_subBeamCullStats.numKept) / float(m_subBeamCullStats.numInstances))
+            : 0.0f;
+        ImGui::Text(
+            "Sub Beams %u kept of %u, %.1f%% culled, %u kept by mirrors",
+            m_subBeamCullStats.numKept,
+            m_subBeamCullStats.numInstances,
+            culledPercent,
+            m_subBeamCullStats.numKeptByMirrors
+        );
+        ImGui::Text("Beam TLAS build %.3f ms", m_beamTlasBuildMs);
+    }
+
     if (ImGui::SmallButton("Set Defaults"))
         SetDefaults();
 
@@ -2297,8 +2546,8 @@ void PhotonBeamApp::CreateSurfaceTlas(ASBuilder::TlasGenerator& tlasGenerator)
 void PhotonBeamApp::CreateBeamBlases()
 {
     static const D3D12_RAYTRACING_AABB beamPhotonBoxes[] = {
-        { -1.0f, -1.0f, 0.0f, 1.0f, 1.0f, 2.0f }, // beam box 
-        { -1.0f, -0.1f, -1.0, 1.0f, 0.1f, 1.0f }, // photon box
+        BEAM_BLAS_AABB,     // beam box 
+        PHOTON_BLAS_AABB,   // photon box
     };
     static ComPtr<ID3D12Resource> boxUploadBuffer = nullptr;
     static const ComPtr<ID3D12Resource> boxBuffer = d3dUtil::CreateDefaultBuffer(
@@ -2474,28 +2723,100 @@ void PhotonBeamApp::CreateBeamBuffers(Microsoft::WRL::ComPtr<ID3D12Resource>& re
 {
     static const PhotonBeamCounter counterResetVal = { 0, 0 };
 
-    // Buffer for reading beam counter
+    //upload buffer  for resetting beam counter
+    {
+        m_beamCounterReset = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+            mCommandList.Get(), &counterResetVal, sizeof(PhotonBeamCounter), resetValuploadBuffer);
+    }
+
+    // beam data, sub beam instance and beam TLAS buffers, sized by the planned capacities
+    CreateBeamCapacityBuffers();
+
+    // Create beam counter Buffer
     {
         auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(
             sizeof(PhotonBeamCounter),
-            D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE
+            D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
+        );
+
+        auto defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+        ThrowIfFailed(
+            md3dDevice->CreateCommittedResource(
+                &defaultHeapProperties,
+                D3D12_HEAP_FLAG_ALLOW_SHADER_ATOMICS,
+                &bufferDesc,
+                D3D12_RESOURCE_STATE_UNORDERED_ACCESS | D3D12_RESOURCE_STATE_COPY_SOURCE,
+                nullptr,
+                IID_PPV_ARGS(&m_beamCounter)
+            )
+        );
+        NAME_D3D12_OBJECT(m_beamCounter);
+
+        D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
+        UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+        UAVDesc.Format = DXGI_FORMAT_UNKNOWN;
+        UAVDesc.Buffer.CounterOffsetInBytes = 0;
+        UAVDesc.Buffer.NumElements = 1;
+        UAVDesc.Buffer.StructureByteStride = sizeof(PhotonBeamCounter);
+        UAVDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
+
+        D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
+        auto allocatedIndex = AllocateBeamTracingDescriptor(&uavDescriptorHandle);
+
+        // allocated index must be the beam data index + 2
+        ThrowIfFalse(m_beamTracingBeamDataHeapIndex + 2 == allocatedIndex);
+
+        md3dDevice->CreateUnorderedAccessView(
+            m_beamCounter.Get(),
+            nullptr,
+            &UAVDesc,
+            uavDescriptorHandle
         );
+    }
 
-        auto defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+    // Create sub beam cull counter buffer, reset from the beam counter reset buffer of the same size
+    {
+        static_assert(sizeof(SubBeamCullCounter) == sizeof(PhotonBeamCounter), "the cull counter is reset from m_beamCounterReset");
 
+        auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(
+            sizeof(SubBeamCullCounter),
+            D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
+        );
+
+        auto defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+        ThrowIfFailed(
+            md3dDevice->CreateCommittedResource(
+                &defaultHeapProperties,
+                D3D12_HEAP_FLAG_ALLOW_SHADER_ATOMICS,
+                &bufferDesc,
+                D3D12_RESOURCE_STATE_COMMON,
+                nullptr,
+                IID_PPV_ARGS(&m_subBeamCullCounter)
+            )
+        );
+        NAME_D3D12_OBJECT(m_subBeamCullCounter);
     }
 
-    //upload buffer  for resetting beam counter
+    // Timestamps around the beam TLAS build, two per frame resource
     {
-        m_beamCounterReset = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-            mCommandList.Get(), &counterResetVal, sizeof(PhotonBeamCounter), resetValuploadBuffer);
+        D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+        queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+        queryHeapDesc.Count = 2 * gNumFrameResources;
+        ThrowIfFailed(md3dDevice->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(m_beamTimestampQueryHeap.GetAddressOf())));
+
+        ThrowIfFailed(mCommandQueue->GetTimestampFrequency(&m_timestampFrequency));
     }
+}
+
+void PhotonBeamApp::CreateBeamCapacityBuffers()
+{
+    // The views are written at the descriptor indices allocated by the first call,
+    // so the descriptor tables do not change when the buffers are recreated with other capacities.
 
-    uint32_t photonBeamHeapIndex{};
     // Buffer for beam data
     {
         auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(
-            sizeof(PhotonBeam) * m_maxNumBeamData, 
+            sizeof(PhotonBeam) * m_beamDataCapacity, 
             D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
         );
 
@@ -2526,12 +2847,12 @@ void PhotonBeamApp::CreateBeamBuffers(Microsoft::WRL::ComPtr<ID3D12Resource>& re
         UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
         UAVDesc.Format = DXGI_FORMAT_UNKNOWN;
         UAVDesc.Buffer.CounterOffsetInBytes = 0;
-        UAVDesc.Buffer.NumElements = m_maxNumBeamData;
+        UAVDesc.Buffer.NumElements = m_beamDataCapacity;
         UAVDesc.Buffer.StructureByteStride = sizeof(PhotonBeam);
         UAVDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
 
         D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
-        photonBeamHeapIndex = AllocateBeamTracingDescriptor(&uavDescriptorHandle);
+        m_beamTracingBeamDataHeapIndex = AllocateBeamTracingDescriptor(&uavDescriptorHandle, m_beamTracingBeamDataHeapIndex);
 
         md3dDevice->CreateUnorderedAccessView(
             m_beamData.Get(),
@@ -2542,7 +2863,7 @@ void PhotonBeamApp::CreateBeamBuffers(Microsoft::WRL::ComPtr<ID3D12Resource>& re
 
         m_beamTracingBeamDataDescriptorHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(
             m_beamTracingDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
-            photonBeamHeapIndex,
+            m_beamTracingBeamDataHeapIndex,
             mCbvSrvUavDescriptorSize
         );
 
@@ -2553,11 +2874,11 @@ void PhotonBeamApp::CreateBeamBuffers(Microsoft::WRL::ComPtr<ID3D12Resource>& re
         srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
         srvDesc.Buffer.FirstElement = 0;
         srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
-        srvDesc.Buffer.NumElements = m_maxNumBeamData;
+        srvDesc.Buffer.NumElements = m_beamDataCapacity;
         srvDesc.Buffer.StructureByteStride = sizeof(PhotonBeam);
 
         D3D12_CPU_DESCRIPTOR_HANDLE srvDescriptorHandle;
-        uint32_t rayTracingHeapIndex = AllocateRayTracingDescriptor(&srvDescriptorHandle);
+        m_rayTracingBeamDataHeapIndex = AllocateRayTracingDescriptor(&srvDescriptorHandle, m_rayTracingBeamDataHeapIndex);
 
         md3dDevice->CreateShaderResourceView(
             m_beamData.Get(),
@@ -2567,15 +2888,36 @@ void PhotonBeamApp::CreateBeamBuffers(Microsoft::WRL::ComPtr<ID3D12Resource>& re
 
         m_rayTracingBeamDataDescriptorHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(
             m_rayTracingDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
-            rayTracingHeapIndex,
+            m_rayTracingBeamDataHeapIndex,
             mCbvSrvUavDescriptorSize
         );
     }
 
+    // Buffer of the gather data of the beams, at the beam indices. It is bound as a root UAV and SRV of the global root signatures.
+    {
+        auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(
+            sizeof(PhotonBeamGatherData) * m_beamDataCapacity,
+            D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
+        );
+
+        auto defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+        ThrowIfFailed(
+            md3dDevice->CreateCommittedResource(
+                &defaultHeapProperties,
+                D3D12_HEAP_FLAG_NONE,
+                &bufferDesc,
+                D3D12_RESOURCE_STATE_COMMON,
+                nullptr,
+                IID_PPV_ARGS(&m_beamGatherData)
+            )
+        );
+        NAME_D3D12_OBJECT(m_beamGatherData);
+    }
+
     //Buffer for storing sub beam Accelerated Structure instance info
     {
         auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(
-            sizeof(ShaderRayTracingTopASInstanceDesc) * m_maxNumSubBeamInfo,
+            sizeof(ShaderRayTracingTopASInstanceDesc) * m_subBeamInfoCapacity,
             D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
         );
 
@@ -2596,14 +2938,15 @@ void PhotonBeamApp::CreateBeamBuffers(Microsoft::WRL::ComPtr<ID3D12Resource>& re
         UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
         UAVDesc.Format = DXGI_FORMAT_UNKNOWN;
         UAVDesc.Buffer.CounterOffsetInBytes = 0;
-        UAVDesc.Buffer.NumElements = m_maxNumSubBeamInfo;
+        UAVDesc.Buffer.NumElements = m_subBeamInfoCapacity;
         UAVDesc.Buffer.StructureByteStride = sizeof(ShaderRayTracingTopASInstanceDesc);
         UAVDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
 
         D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
-        auto allocatedIndex = AllocateBeamTracingDescriptor(&uavDescriptorHandle);
+        auto allocatedIndex = AllocateBeamTracingDescriptor(&uavDescriptorHandle, m_beamTracingSubBeamInfoHeapIndex);
 
-        ThrowIfFalse(allocatedIndex ==  photonBeamHeapIndex + 1);
+        ThrowIfFalse(allocatedIndex ==  m_beamTracingBeamDataHeapIndex + 1);
+        m_beamTracingSubBeamInfoHeapIndex = allocatedIndex;
 
         md3dDevice->CreateUnorderedAccessView(
             m_beamAsInstanceDescData.Get(),
@@ -2613,10 +2956,10 @@ void PhotonBeamApp::CreateBeamBuffers(Microsoft::WRL::ComPtr<ID3D12Resource>& re
         );
     }
 
-    // Create beam counter Buffer
+    // Buffer of the culled sub beam instances, the input of the beam TLAS build
     {
         auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(
-            sizeof(PhotonBeamCounter),
+            sizeof(ShaderRayTracingTopASInstanceDesc) * m_subBeamInfoCapacity,
             D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
         );
 
@@ -2624,35 +2967,14 @@ void PhotonBeamApp::CreateBeamBuffers(Microsoft::WRL::ComPtr<ID3D12Resource>& re
         ThrowIfFailed(
             md3dDevice->CreateCommittedResource(
                 &defaultHeapProperties,
-                D3D12_HEAP_FLAG_ALLOW_SHADER_ATOMICS,
+                D3D12_HEAP_FLAG_NONE,
                 &bufferDesc,
-                D3D12_RESOURCE_STATE_UNORDERED_ACCESS | D3D12_RESOURCE_STATE_COPY_SOURCE,
+                D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
                 nullptr,
-                IID_PPV_ARGS(&m_beamCounter)
+                IID_PPV_ARGS(m_culledBeamAsInstanceDescData.GetAddressOf())
             )
         );
-        NAME_D3D12_OBJECT(m_beamCounter);
-
-        D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
-        UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
-        UAVDesc.Format = DXGI_FORMAT_UNKNOWN;
-        UAVDesc.Buffer.CounterOffsetInBytes = 0;
-        UAVDesc.Buffer.NumElements = 1;
-        UAVDesc.Buffer.StructureByteStride = sizeof(PhotonBeamCounter);
-        UAVDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
-
-        D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
-        auto allocatedIndex = AllocateBeamTracingDescriptor(&uavDescriptorHandle);
-
-        // allocated index must be photonBeamHeapIndex + 2
-        ThrowIfFalse(photonBeamHeapIndex + 2 == allocatedIndex);
-
-        md3dDevice->CreateUnorderedAccessView(
-            m_beamCounter.Get(),
-            nullptr,
-            &UAVDesc,
-            uavDescriptorHandle
-        );
+        NAME_D3D12_OBJECT(m_culledBeamAsInstanceDescData);
     }
 
     // Create scratch buffer for beam TLAS
@@ -2665,7 +2987,7 @@ void PhotonBeamApp::CreateBeamBuffers(Microsoft::WRL::ComPtr<ID3D12Resource>& re
             &scratchSize,
             &resultSize,
             &instanceDescsSize,
-            m_maxNumSubBeamInfo
+            m_subBeamInfoCapacity
         );
 
         m_beamTlasBuffers.pScratch = raytrace_helper::CreateBuffer(
@@ -2685,6 +3007,81 @@ void PhotonBeamApp::CreateBeamBuffers(Microsoft::WRL::ComPtr<ID3D12Resource>& re
     }
 }
 
+void PhotonBeamApp::ResizeBeamBuffers(uint32_t beamDataCapacity, uint32_t subBeamInfoCapacity)
+{
+    // the frames in flight use the old buffers
+    FlushCommandQueue();
+
+    m_beamData.Reset();
+    m_beamGatherData.Reset();
+    m_beamAsInstanceDescData.Reset();
+    m_culledBeamAsInstanceDescData.Reset();
+    m_beamTlasBuffers.pScratch.Reset();
+    m_beamTlasBuffers.pResult.Reset();
+
+    m_beamDataCapacity = beamDataCapacity;
+    m_subBeamInfoCapacity = subBeamInfoCapacity;
+    CreateBeamCapacityBuffers();
+
+    // the ray gen record holds the address of the beam TLAS
+    BuildRayTracingShaderTables();
+}
+
+void PhotonBeamApp::ReadBeamCounters()
+{
+    // counters copied by BeamTrace() the last time this frame resource was used, the GPU is done with it
+    if (!m_currFrameResource->BeamCounterPending)
+        return;
+
+    m_currFrameResource->BeamCounterPending = false;
+
+    PhotonBeamCounter counter{};
+    UINT64 timestamps[2]{};
+    void* mappedData = nullptr;
+    const D3D12_RANGE readRange{ 0, c_beamReadbackSize };
+    const D3D12_RANGE writeRange{ 0, 0 };
+    ThrowIfFailed(m_currFrameResource->BeamCounterReadback->Map(0, &readRange, &mappedData));
+    std::memcpy(&counter, mappedData, sizeof(PhotonBeamCounter));
+    std::memcpy(&m_subBeamCullStats, static_cast<const uint8_t*>(mappedData) + c_beamReadbackCullCounterOffset, sizeof(SubBeamCullCounter));
+    std::memcpy(timestamps, static_cast<const uint8_t*>(mappedData) + c_beamReadbackTimestampOffset, sizeof(timestamps));
+    m_currFrameResource->BeamCounterReadback->Unmap(0, &writeRange);
+
+    if (m_timestampFrequency > 0 && timestamps[1] >= timestamps[0])
+        m_beamTlasBuildMs = static_cast<float>(double(timestamps[1] - timestamps[0]) * 1000.0 / double(m_timestampFrequency));
+
+    auto counters = CpuReference::MakeBeamOverflowCounters(
+        counter,
+        m_currFrameResource->BeamDataCapacity,
+        m_currFrameResource->SubBeamInfoCapacity
+    );
+
+    if (m_beamCapacityPlanner.AddFrame(counters))
+    {
+        ResizeBeamBuffers(
+            static_cast<uint32_t>(m_beamCapacityPlanner.BeamCapacity()),
+            static_cast<uint32_t>(m_beamCapacityPlanner.SubBeamCapacity())
+        );
+    }
+}
+
+
+void PhotonBeamApp::CreateHenyeyGreensteinTable(Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer)
+{
+    // Phase function table for sampling and evaluation, indexed by the assymetric factor.
+    // It does not depend on the scene, so it is filled once and bound as a root SRV of both global root signatures.
+    std::vector<float> table(HG_TABLE_SIZE);
+    hgTableBuild(table.data());
+
+    m_hgTable = d3dUtil::CreateDefaultBuffer(
+        md3dDevice.Get(),
+        mCommandList.Get(), 
+        table.data(), 
+        sizeof(float) * table.size(), 
+        uploadBuffer
+    );
+    NAME_D3D12_OBJECT(m_hgTable);
+}
+
 void PhotonBeamApp::BuildBeamTracingShaderTables()
 {
     void* beamGenShaderID;
@@ -9,6 +9,9 @@
 #include "../Common/UploadBuffer.h"
 #include "AS-Builders/TlasGenerator.hpp"
 #include "FrameResource.h"
+#include "Cpu-Reference/BeamCapacityPlanner.hpp"
+#include "Cpu-Reference/BeamFootprint.hpp"
+#include "Cpu-Reference/BeamCulling.hpp"
 #include "third-party-helper/tiny-gltf-helper/GltfScene.hpp"
 
 
@@ -35,6 +38,8 @@ namespace RootSignatueEnums
         enum class EGlobalParams : uint16_t 
         {
             SceneConstantSlot = 0,
+            HenyeyGreensteinTableSlot,
+            BeamGatherDataSlot,
             Count
         };
 
@@ -70,6 +75,8 @@ namespace RootSignatueEnums
         enum class EGlobalParams : uint16_t 
         {
             SceneConstantSlot = 0,
+            HenyeyGreensteinTableSlot,
+            BeamGatherDataSlot,
             Count
         };
 
@@ -224,6 +231,10 @@ private:
 
     void CreateOffScreenOutputResource();
     void CreateBeamBuffers(Microsoft::WRL::ComPtr<ID3D12Resource>& resetValuploadBuffer);
+    void CreateBeamCapacityBuffers();
+    void ResizeBeamBuffers(uint32_t beamDataCapacity, uint32_t subBeamInfoCapacity);
+    void ReadBeamCounters();
+    void CreateHenyeyGreensteinTable(Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer);
 
     void BuildFrameResources();
     void BuildRenderItems();
@@ -253,6 +264,7 @@ private:
     Microsoft::WRL::ComPtr<ID3D12RootSignature> m_rootSignature = nullptr;
     Microsoft::WRL::ComPtr<ID3D12RootSignature> m_postRootSignature = nullptr;
     Microsoft::WRL::ComPtr<ID3D12RootSignature> m_bufferResetRootSignature = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12RootSignature> m_beamCullRootSignature = nullptr;
     Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_srvDescriptorHeap = nullptr;
     Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_postSrvDescriptorHeap = nullptr;
     Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_guiDescriptorHeap = nullptr;
@@ -260,6 +272,8 @@ private:
 
     Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_beamTracingDescriptorHeap = nullptr;
     uint32_t m_beamTracingDescriptorsAllocated;
+    uint32_t m_beamTracingBeamDataHeapIndex;
+    uint32_t m_beamTracingSubBeamInfoHeapIndex;
     D3D12_GPU_DESCRIPTOR_HANDLE m_beamTracingBeamDataDescriptorHandle{};
     D3D12_GPU_DESCRIPTOR_HANDLE m_beamTracingVertexDescriptorHandle{};
     D3D12_GPU_DESCRIPTOR_HANDLE m_beamTracingTextureDescriptorHandle{};
@@ -267,6 +281,7 @@ private:
     
     Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_rayTracingDescriptorHeap = nullptr;
     uint32_t m_rayTracingDescriptorsAllocated;
+    uint32_t m_rayTracingBeamDataHeapIndex;
     uint32_t m_offScreenOutputResourceUAVDescriptorHeapIndex;
     D3D12_GPU_DESCRIPTOR_HANDLE m_offScreenOutputDescriptorHandle{};
     D3D12_GPU_DESCRIPTOR_HANDLE m_rayTracingNormalDescriptorHandle{};
@@ -281,12 +296,14 @@ private:
     Microsoft::WRL::ComPtr<ID3D12PipelineState> m_rasterPso;
     Microsoft::WRL::ComPtr<ID3D12PipelineState> m_postPso;
     Microsoft::WRL::ComPtr<ID3D12PipelineState> m_beamBufferResetPso;
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> m_beamCullPso;
 
 
     Microsoft::WRL::ComPtr<ID3D12StateObject> m_beamStateObject = nullptr;
     Microsoft::WRL::ComPtr<ID3D12RootSignature> m_beamRootSignatures[to_underlying(RootSignatueEnums::BeamTrace::ERootSignatures::Count)];
     Microsoft::WRL::ComPtr<IDxcBlob> m_beamShaders[to_underlying(EBeamTracingShaders::Count)];
     Microsoft::WRL::ComPtr<IDxcBlob> m_AsInstanceBufferResetShader = nullptr;
+    Microsoft::WRL::ComPtr<IDxcBlob> m_beamCullShader = nullptr;
 
     static const wchar_t* c_beamShadersExportNames[to_underlying(EBeamTracingShaders::Count)];
     static const wchar_t* c_rayHitGroupNames[to_underlying(ERayHitTypes::Count)];
@@ -314,7 +331,13 @@ private:
     Microsoft::WRL::ComPtr<ID3D12Resource> m_beamCounter = nullptr;
     Microsoft::WRL::ComPtr<ID3D12Resource> m_beamCounterReset = nullptr;
     Microsoft::WRL::ComPtr<ID3D12Resource> m_beamData = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> m_beamGatherData = nullptr;
     Microsoft::WRL::ComPtr<ID3D12Resource> m_beamAsInstanceDescData = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> m_culledBeamAsInstanceDescData = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> m_subBeamCullCounter = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12QueryHeap> m_beamTimestampQueryHeap = nullptr;
+    UINT64 m_timestampFrequency = 0;
+    Microsoft::WRL::ComPtr<ID3D12Resource> m_hgTable = nullptr;
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> m_inputLayout;
 
@@ -335,6 +358,11 @@ private:
     float m_beamRadius{ 0.5f };
     float    m_photonRadius{ 0.5f };
 
+    // per beam radius of util/BeamFootprint.h, clamped to m_beamRadius divided or multiplied by m_footprintRadiusRange
+    bool m_useFootprintBeamRadius{ false };
+    float m_beamFootprintPixels{ 24.0f };
+    const float m_footprintRadiusRange{ 4.0f };
+
     // number of beams and photons shot from the light source
     uint32_t m_numBeamSamples{ 1024 };
     uint32_t m_numPhotonSamples{ 4 * 4 * 1024 };
@@ -351,6 +379,17 @@ private:
     // number of beam samples * (expected number of scatter  + surface intersection ) * (expected length of the beam / (radius * 2)) 
     const uint32_t m_maxNumSubBeamInfo;
 
+    // capacities of the beam data and sub beam info buffers, planned from the beam counters read back every frame
+    uint32_t m_beamDataCapacity;
+    uint32_t m_subBeamInfoCapacity;
+    CpuReference::BeamCapacityPlanner m_beamCapacityPlanner;
+
+    // sub-beam culling before the beam TLAS build, with the counters and build time read back with the beam counters
+    std::vector<CpuReference::MirrorSurface> m_mirrorSurfaces;
+    int m_beamCullMode;
+    SubBeamCullCounter m_subBeamCullStats{};
+    float m_beamTlasBuildMs{ 0.0f };
+
     bool m_useRayTracer;
     DirectX::XMVECTORF32 m_beamNearColor;
     DirectX::XMVECTORF32 m_beamUnitDistantColor;
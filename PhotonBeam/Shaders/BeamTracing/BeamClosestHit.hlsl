@@ -4,6 +4,8 @@
 
 #include "..\util\Gltf.hlsli"
 #include "..\util\RayTracingSampling.hlsli"
+#include "..\util\HenyeyGreensteinTable.h"
+#include "..\util\FastMath.h"
 #include "..\RaytracingHlslCompat.h"
 
 
@@ -25,6 +27,30 @@ Texture2D g_texturesMap[] : register(t0, space1);
 
 SamplerState gsamLinearWrap  : register(s0);
 
+#if PHOTONBEAM_HG_TABLE
+StructuredBuffer<float> g_hgTable : register(t0, space2);
+#endif
+
+uint getLaunchIndex()
+{
+    uint3 dispatchDimensionSize = DispatchRaysDimensions();
+    uint3 dispatchIndex = DispatchRaysIndex();
+    return dispatchDimensionSize.y * dispatchDimensionSize.z * dispatchIndex.x
+        + dispatchDimensionSize.z * dispatchIndex.y
+        + dispatchIndex.z;
+}
+
+// sample the scattered direction of the air with the Henyey-Greenstein phase function
+float3 airScatterDirection(float2 uv, in float3 incomingDirection)
+{
+#if PHOTONBEAM_HG_TABLE
+    float cosTheta = hgTableSampleCosTheta(g_hgTable, uv.x, pc_beam.airHGAssymFactor);
+    return heneyGreenDirectionFromCosTheta(cosTheta, uv.y, incomingDirection);
+#else
+    return heneyGreenPhaseFuncSamplingFromUV(uv, incomingDirection, pc_beam.airHGAssymFactor);
+#endif
+}
+
 bool randomScatterOccured(inout BeamHitPayload prd, const in float rayLength)
 {
     float3 absortion = pc_beam.airExtinctCoff - pc_beam.airScatterCoff;
@@ -52,10 +78,11 @@ bool randomScatterOccured(inout BeamHitPayload prd, const in float rayLength)
     float curSeedRatio = 1.0f - prd.nextSeedRatio;
 
     // random walk within participating media(air) scattering
-    float airScatterAt = curSeedRatio * (-log(1.0 - rnd(prd.seed))) - prd.nextSeedRatio * log(1.0f - rnd(prd.nextSeed));
+    float airScatterAt = curSeedRatio * (-policyLog(PHOTONBEAM_SCATTER_MATH_POLICY, 1.0 - rnd(prd.seed)))
+        - prd.nextSeedRatio * policyLog(PHOTONBEAM_SCATTER_MATH_POLICY, 1.0f - rnd(prd.nextSeed));
     airScatterAt /= color_extinct_coff;
     
-    prd.weight = exp((color_extinct_coff - pc_beam.airExtinctCoff) * airScatterAt);
+    prd.weight = policyExp(PHOTONBEAM_SCATTER_MATH_POLICY, (color_extinct_coff - pc_beam.airExtinctCoff) * airScatterAt);
     // prd.weight[color_index] = 1;
 
     if (rayLength < airScatterAt) {
@@ -75,8 +102,22 @@ bool randomScatterOccured(inout BeamHitPayload prd, const in float rayLength)
     prd.weight *= pc_beam.airScatterCoff / color_extinct_coff;
     prd.weight[color_index] = 1.0;
 
-    float3 rayDirectionFirst = heneyGreenPhaseFuncSampling(prd.seed, prd.rayDirection, pc_beam.airHGAssymFactor);
-    float3 rayDirectionSecond = heneyGreenPhaseFuncSampling(prd.nextSeed, prd.rayDirection, pc_beam.airHGAssymFactor);
+#if PHOTONBEAM_SOBOL_SAMPLING
+    const uint launchIndex = getLaunchIndex();
+    float2 uvFirst = sobolSample2D(launchIndex, prd.sampleDimension, pc_beam.seed);
+    float2 uvSecond = sobolSample2D(launchIndex, prd.sampleDimension, pc_beam.seed + 1);
+    prd.sampleDimension += 1;
+#else
+    float2 uvFirst;
+    uvFirst.x = rnd(prd.seed);
+    uvFirst.y = rnd(prd.seed);
+
+    float2 uvSecond;
+    uvSecond.x = rnd(prd.nextSeed);
+    uvSecond.y = rnd(prd.nextSeed);
+#endif
+    float3 rayDirectionFirst = airScatterDirection(uvFirst, prd.rayDirection);
+    float3 rayDirectionSecond = airScatterDirection(uvSecond, prd.rayDirection);
     float3 sumDirection = rayDirectionFirst + rayDirectionSecond;
 
     if (sumDirection.x == 0 && sumDirection.y == 0 && sumDirection.z == 0)
@@ -157,18 +198,35 @@ void ClosestHit(inout BeamHitPayload prd, BuiltInTriangleIntersectionAttributes
         return;
     }
 
-    float3 rayDirectionFirst = microfacetReflectedLightSampling(
+#if PHOTONBEAM_SOBOL_SAMPLING
+    const uint launchIndex = getLaunchIndex();
+    float3 rayDirectionFirst = reflectedLightSamplingFromUV(
+        sobolSample2D(launchIndex, prd.sampleDimension, pc_beam.seed),
+        prd.rayDirection,
+        world_normal,
+        material.roughness
+    );
+    float3 rayDirectionSecond = reflectedLightSamplingFromUV(
+        sobolSample2D(launchIndex, prd.sampleDimension, pc_beam.seed + 1),
+        prd.rayDirection,
+        world_normal,
+        material.roughness
+    );
+    prd.sampleDimension += 1;
+#else
+    float3 rayDirectionFirst = reflectedLightSampling(
         prd.seed,
         prd.rayDirection,
         world_normal,
         material.roughness
     );
-    float3 rayDirectionSecond = microfacetReflectedLightSampling(
+    float3 rayDirectionSecond = reflectedLightSampling(
         prd.nextSeed,
         prd.rayDirection,
         world_normal,
         material.roughness
     );
+#endif
 
     float3 sumDirection = rayDirectionFirst + rayDirectionSecond;
     if (sumDirection.x == 0 && sumDirection.y == 0 && sumDirection.z == 0)
@@ -200,7 +258,7 @@ void ClosestHit(inout BeamHitPayload prd, BuiltInTriangleIntersectionAttributes
         albedo *= g_texturesMap[txtId].SampleLevel(gsamLinearWrap, texcoord0, 0).xyz;
     }
 
-    float3 material_f = pdfWeightedGltfBrdf(
+    float3 material_f = pdfWeightedReflectedLightBrdf(
         -prd.rayDirection, 
         rayDirection, 
         world_normal, 
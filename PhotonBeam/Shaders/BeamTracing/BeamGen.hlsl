@@ -3,6 +3,9 @@
 #define PHOTONBEAM_BEAM_GEN
 
 #include "..\util\RayTracingSampling.hlsli"
+#include "..\util\BeamInstance.h"
+#include "..\util\BeamFootprint.h"
+#include "..\util\BeamGatherData.h"
 #include "..\RaytracingHlslCompat.h"
 
 ConstantBuffer<PushConstantBeam> pc_beam : register(b0);
@@ -11,12 +14,11 @@ RaytracingAccelerationStructure g_scene : register(t0);
 RWStructuredBuffer<PhotonBeam> g_photonBeams: register(u0, space0);
 RWStructuredBuffer<ShaderRayTracingTopASInstanceDesc> g_photonBeamsTopAsInstanceDescs : register(u1, space0);
 RWStructuredBuffer<PhotonBeamCounter> g_photonBeamCounters  : register(u2, space0);
+RWStructuredBuffer<PhotonBeamGatherData> g_photonBeamGatherData : register(u0, space3);
 
 [shader("raygeneration")]
 void BeamGen()
 {
-    const uint HitTypeAir = 0;
-    const uint HitTypeSolid = 1;
     const float tMin = 0.001;
     const float tMax = 10000.0;
 
@@ -27,11 +29,16 @@ void BeamGen()
         + dispatchIndex.z;
 
     // Initialize the random number
-    uint seed = tea(launchIndex, pc_beam.seed);
-    uint nextSeed = tea(launchIndex, pc_beam.seed + 1);
+    uint seed = rngInitSeed(launchIndex, pc_beam.seed);
+    uint nextSeed = rngInitSeed(launchIndex, pc_beam.seed + 1);
     float3 rayOrigin = pc_beam.lightPosition;
+#if PHOTONBEAM_SOBOL_SAMPLING
+    float3 rayDirectionFirst = uniformSamplingSphereFromUV(sobolSample2D(launchIndex, 0, pc_beam.seed));
+    float3 rayDirectionSecond = uniformSamplingSphereFromUV(sobolSample2D(launchIndex, 0, pc_beam.seed + 1));
+#else
     float3 rayDirectionFirst = uniformSamplingSphere(seed);
     float3 rayDirectionSecond = uniformSamplingSphere(nextSeed);
+#endif
     float3 sumDirection = rayDirectionFirst + rayDirectionSecond;
 
     if (sumDirection.x == 0 && sumDirection.y == 0 && sumDirection.z == 0)
@@ -45,6 +52,7 @@ void BeamGen()
     prd.seed = seed;
     prd.nextSeed = nextSeed;
     prd.nextSeedRatio = pc_beam.nextSeedRatio;
+    prd.sampleDimension = 1;
     prd.weight = float3(0, 0, 0);
 
     uint  rayFlags = RAY_FLAG_FORCE_OPAQUE;
@@ -78,8 +86,7 @@ void BeamGen()
         newBeam.startPos = rayOrigin;
         newBeam.endPos = prd.rayOrigin;
         newBeam.mediaIndex = 0;
-        // newBeam.radius = pc_beam.beamRadius;
-        newBeam.radius = 0;
+        newBeam.radius = getFootprintBeamRadius(pc_beam, newBeam.startPos, newBeam.endPos);
         newBeam.lightColor = beamColor;
         // Only saving instance id to check if ray and photon mathces the instace for now.
         // But for a better accuracy and handle some instance with complicated shaped mesh, 
@@ -89,8 +96,8 @@ void BeamGen()
         float3 beamVec = newBeam.endPos - newBeam.startPos;
         float beamLength = length(beamVec);
 
-        uint num_split = uint(beamLength / (pc_beam.beamRadius * 2.0f) + 1.0f);
-        if (num_split * pc_beam.beamRadius * 2.0 <= beamLength)
+        uint num_split = uint(beamLength / (newBeam.radius * 2.0f) + 1.0f);
+        if (num_split * newBeam.radius * 2.0 <= beamLength)
             num_split += 1;
 
         // this value must be either 0 or 1
@@ -110,6 +117,7 @@ void BeamGen()
             return;
 
         g_photonBeams[beamIndex] = newBeam;
+        g_photonBeamGatherData[beamIndex] = makePhotonBeamGatherData(newBeam, pc_beam.airScatterCoff, pc_beam.numBeamSources);
 
         InterlockedAdd(g_photonBeamCounters[0].subBeamCount, num_split + numSurfacePhoton, subBeamIndex);
         if (num_split + subBeamIndex + numSurfacePhoton >= pc_beam.maxNumSubBeams)
@@ -120,17 +128,17 @@ void BeamGen()
 
         for (uint i = 0; i < num_split; i++)
         {
-            float3 splitStart = newBeam.startPos + pc_beam.beamRadius * 2 * float(i) * rayDirection;
+            float3 splitStart = newBeam.startPos + newBeam.radius * 2 * float(i) * rayDirection;
             ShaderRayTracingTopASInstanceDesc asInfo;
-            asInfo.instanceCustomIndexAndmask = beamIndex | (0xFF << 24);
-            asInfo.instanceShaderBindingTableRecordOffsetAndflags = HitTypeAir | (0x00000001 << 24); // use the hit group 0
+            asInfo.instanceCustomIndexAndmask = packInstanceCustomIndexAndMask(uint(beamIndex), BEAM_INSTANCE_MASK);
+            asInfo.instanceShaderBindingTableRecordOffsetAndflags = packInstanceHitGroupAndFlags(BEAM_HIT_TYPE_AIR, BEAM_INSTANCE_FLAGS); // use the hit group 0
             asInfo.accelerationStructureReference = pc_beam.beamBlasAddress;
 
             float3x4 transformMat = transpose(
                 float4x3(
-                    bitangent * pc_beam.beamRadius,
-                    tangent * pc_beam.beamRadius,
-                    rayDirection * pc_beam.beamRadius,
+                    bitangent * newBeam.radius,
+                    tangent * newBeam.radius,
+                    rayDirection * newBeam.radius,
                     splitStart
                     )
             );
@@ -144,8 +152,8 @@ void BeamGen()
         {
             float3 boxStart = newBeam.endPos;
             ShaderRayTracingTopASInstanceDesc asInfo;
-            asInfo.instanceCustomIndexAndmask = beamIndex | (0xFF << 24);
-            asInfo.instanceShaderBindingTableRecordOffsetAndflags = HitTypeSolid | (0x00000001 << 24); // use the hit group 1
+            asInfo.instanceCustomIndexAndmask = packInstanceCustomIndexAndMask(uint(beamIndex), BEAM_INSTANCE_MASK);
+            asInfo.instanceShaderBindingTableRecordOffsetAndflags = packInstanceHitGroupAndFlags(BEAM_HIT_TYPE_SOLID, BEAM_INSTANCE_FLAGS); // use the hit group 1
             asInfo.accelerationStructureReference = pc_beam.photonBlasAddress;
 
             createCoordinateSystem(prd.hitNormal, tangent, bitangent);
@@ -0,0 +1,62 @@
+
+#ifndef PHOTONBEAM_CULL_SUB_BEAM_INSTANCES
+#define PHOTONBEAM_CULL_SUB_BEAM_INSTANCES
+
+#include "..\RaytracingHlslCompat.h"
+#include "..\util\BeamCulling.h"
+
+
+ConstantBuffer<BeamCullConstants> g_cullConstants : register(b0);
+StructuredBuffer<PhotonBeamCounter> g_photonBeamCounters : register(t0, space0);
+
+// instances written by BeamGen.hlsl, cleared here once read
+RWStructuredBuffer<ShaderRayTracingTopASInstanceDesc> g_subBeamInstanceBuffer : register(u0, space0);
+
+// input of the beam TLAS build, zeroed by ResetSubBeamInfoBuffer.hlsl before BeamGen.hlsl runs
+RWStructuredBuffer<ShaderRayTracingTopASInstanceDesc> g_culledSubBeamInstanceBuffer : register(u1, space0);
+RWStructuredBuffer<SubBeamCullCounter> g_subBeamCullCounter : register(u2, space0);
+
+
+[numthreads(SUB_BEAM_INFO_BUFFER_RESET_COMPUTE_SHADER_GROUP_SIZE, 1, 1)]
+void main(int3 dispatchThreadID : SV_DispatchThreadID)
+{
+	const uint64_t numWritten = min(g_photonBeamCounters[0].subBeamCount, (uint64_t)g_cullConstants.maxNumSubBeams);
+	const uint index = dispatchThreadID.x;
+
+	uint cullResult = BEAM_CULL_RESULT_CULLED;
+	ShaderRayTracingTopASInstanceDesc instance = (ShaderRayTracingTopASInstanceDesc)0;
+
+	// an overflowing launch of BeamGen.hlsl leaves its slots empty
+	if (index < numWritten)
+	{
+		instance = g_subBeamInstanceBuffer[index];
+		g_subBeamInstanceBuffer[index] = (ShaderRayTracingTopASInstanceDesc)0;
+
+		if (instance.accelerationStructureReference != 0)
+			cullResult = cullSubBeamInstance(g_cullConstants, instance);
+	}
+
+	const bool isWritten = instance.accelerationStructureReference != 0;
+	const bool isKept = cullResult != BEAM_CULL_RESULT_CULLED;
+	const bool isKeptByMirrors = cullResult == BEAM_CULL_RESULT_MIRRORS;
+
+	// one atomic add per wave for the compaction and the counters
+	const uint numKeptInWave = WaveActiveCountBits(isKept);
+	const uint keptIndexInWave = WavePrefixCountBits(isKept);
+	const uint numWrittenInWave = WaveActiveCountBits(isWritten);
+	const uint numKeptByMirrorsInWave = WaveActiveCountBits(isKeptByMirrors);
+
+	uint keptBase = 0;
+	if (WaveIsFirstLane())
+	{
+		InterlockedAdd(g_subBeamCullCounter[0].numKept, numKeptInWave, keptBase);
+		InterlockedAdd(g_subBeamCullCounter[0].numInstances, numWrittenInWave);
+		InterlockedAdd(g_subBeamCullCounter[0].numKeptByMirrors, numKeptByMirrorsInWave);
+	}
+	keptBase = WaveReadLaneFirst(keptBase);
+
+	if (isKept)
+		g_culledSubBeamInstanceBuffer[keptBase + keptIndexInWave] = instance;
+}
+
+#endif
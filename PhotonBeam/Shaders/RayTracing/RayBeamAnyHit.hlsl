@@ -3,22 +3,33 @@
 #define PHOTONBEAM_RAY_BEAM_ANY_HIT
 
 #include "..\util\RayTracingSampling.hlsli"
+#include "..\util\HenyeyGreensteinTable.h"
+#include "..\util\FastMath.h"
+#include "..\util\BeamFootprint.h"
+#include "..\util\BeamReservoir.h"
+#include "..\util\BeamGatherData.h"
 #include "..\RaytracingHlslCompat.h"
 
 
 ConstantBuffer<PushConstantRay> pc_ray : register(b0);
 StructuredBuffer<PhotonBeam> g_photonBeams: register(t0);
+StructuredBuffer<PhotonBeamGatherData> g_photonBeamGatherData : register(t0, space3);
+
+#if PHOTONBEAM_HG_TABLE
+StructuredBuffer<float> g_hgTable : register(t0, space2);
+#endif
 
 
-bool getIntersection(float tMax, in PhotonBeam beam, out float tCurr, out float3 beamPoint)
+bool getIntersection(float tMax, in PhotonBeam beam, in PhotonBeamGatherData beamData, out float tCurr, out float3 beamPoint)
 {
     float3 rayOrigin = WorldRayOrigin();
     float3 rayDirection = WorldRayDirection();
     float3 rayEnd = rayOrigin + rayDirection * tMax;
     float rayLength = tMax - 0.0001;
 
-    float3 beamDirection = normalize(beam.endPos - beam.startPos);
-    float beamLength = length(beam.endPos - beam.startPos);
+    float3 beamDirection = beamData.direction;
+    float beamLength = beamData.length;
+    float beamRadius = getGatherBeamRadius(beam.radius, pc_ray.beamRadius);
     const float3 rayBeamCross = cross(rayDirection, beamDirection);
 
     // check if the ray hits beam cylinder when the beam cylinder has infinite radius
@@ -33,7 +44,7 @@ bool getIntersection(float tMax, in PhotonBeam beam, out float tCurr, out float3
 
     //if ray and beam are parallel or almost parallel
     // Need to choose the beam point that gives shortest ray length
-    if (length(rayBeamCross) < 0.1e-4)
+    if (dot(rayBeamCross, rayBeamCross) < 0.1e-4 * 0.1e-4)
     {
 
         float beamEndOnRayAt = min(rayLength, max(0, dot(beam.endPos - rayOrigin, rayDirection)));
@@ -42,12 +53,13 @@ bool getIntersection(float tMax, in PhotonBeam beam, out float tCurr, out float3
         float3 rayPoint = rayOrigin + rayDirection * min(beamEndOnRayAt, beamStartOnRayAt);
         beamPoint = beam.startPos + beamDirection * dot(rayPoint - beam.startPos, beamDirection);
 
-        if (length(beamPoint - rayPoint) > pc_ray.beamRadius)
+        float3 rayToBeam = beamPoint - rayPoint;
+        if (dot(rayToBeam, rayToBeam) > beamRadius * beamRadius)
         {
             return false;
         }
 
-        tCurr = length(rayPoint - rayOrigin);
+        tCurr = policyLength(PHOTONBEAM_GATHER_MATH_POLICY, rayPoint - rayOrigin);
         return true;
     }
 
@@ -83,7 +95,8 @@ bool getIntersection(float tMax, in PhotonBeam beam, out float tCurr, out float3
     }
 
     // check if ray point is within the beam radius
-    if (length(cross(rayPoint - beam.startPos, beamDirection)) > pc_ray.beamRadius)
+    float3 beamToRayPoint = cross(rayPoint - beam.startPos, beamDirection);
+    if (dot(beamToRayPoint, beamToRayPoint) > beamRadius * beamRadius)
     {
         return false;
     }
@@ -92,12 +105,12 @@ bool getIntersection(float tMax, in PhotonBeam beam, out float tCurr, out float3
     // beam point - box start position
     float boxLocalBeamPointPos = dot(beamPoint - mul(ObjectToWorld3x4(), float4(0.0, 0.0, 0.0, 1.0)), beamDirection);
 
-    if (boxLocalBeamPointPos < 0.0 || pc_ray.beamRadius * 2 <= boxLocalBeamPointPos)
+    if (boxLocalBeamPointPos < 0.0 || beamRadius * 2 <= boxLocalBeamPointPos)
     {
         return false;
     }
 
-    tCurr = length(rayPoint - rayOrigin);
+    tCurr = policyLength(PHOTONBEAM_GATHER_MATH_POLICY, rayPoint - rayOrigin);
 
     return true;
 }
@@ -107,10 +120,11 @@ bool getIntersection(float tMax, in PhotonBeam beam, out float tCurr, out float3
 void BeamAnyHit(inout RayHitPayload prd, RayHitAttributes attrs) {
 
     PhotonBeam beam = g_photonBeams[InstanceID()];
+    PhotonBeamGatherData beamData = g_photonBeamGatherData[InstanceID()];
 
     float3 beamHit;
     float tCurr;
-    if (!getIntersection(prd.tMax, beam, tCurr, beamHit))
+    if (!getIntersection(prd.tMax, beam, beamData, tCurr, beamHit))
     {
         IgnoreHit();
         return;
@@ -122,28 +136,38 @@ void BeamAnyHit(inout RayHitPayload prd, RayHitAttributes attrs) {
         return;
     }
 
+    float beamRadius = getGatherBeamRadius(beam.radius, pc_ray.beamRadius);
     float3 worldPos = WorldRayOrigin() + WorldRayDirection() * tCurr;
-    float beamDist = length(beamHit - beam.startPos);
-    float3 beamDirection = normalize(beam.endPos - beam.startPos);
+    float beamDist = policyLength(PHOTONBEAM_GATHER_MATH_POLICY, beamHit - beam.startPos);
+    float3 beamDirection = beamData.direction;
     float rayDist = tCurr;
-    float3 vewingDirection = normalize(WorldRayDirection()) * -1.0;
 
+    BeamReservoirHit hit;
+    hit.lightColor = beam.lightColor;
+    hit.beamRadius = beamRadius;
+    hit.pathLength = rayDist + beamDist;
     // the target radiance direction is -1.0 * WorldRayDirection(), opposite of the camera ray
-    float beamRayCosVal = dot(-WorldRayDirection(), beamDirection);
-    float beamRayAbsSinVal = sqrt(1 - beamRayCosVal * beamRayCosVal);
-
-    float3 radiance = pc_ray.airScatterCoff * exp(-pc_ray.airExtinctCoff * (rayDist + beamDist)) * heneyGreenPhaseFunc(beamRayCosVal, pc_ray.airHGAssymFactor)
-        * beam.lightColor / float(pc_ray.numBeamSources) / (pc_ray.beamRadius * beamRayAbsSinVal + 0.1e-10);
+    hit.beamRayCosVal = dot(-WorldRayDirection(), beamDirection);
+    hit.centerDist = policyLength(PHOTONBEAM_GATHER_MATH_POLICY, cross(worldPos - beam.startPos, beamDirection));
+
+#if PHOTONBEAM_BEAM_RESERVOIR_SIZE > 0
+    // RayGen evaluates the hits left in the slots
+    addBeamReservoirHit(prd, hit);
+#else
+
+#if PHOTONBEAM_HG_TABLE
+    float phaseVal = hgTablePhaseFunc(g_hgTable, hit.beamRayCosVal, pc_ray.airHGAssymFactor);
+#else
+    float phaseVal = heneyGreenPhaseFunc(hit.beamRayCosVal, pc_ray.airHGAssymFactor);
+#endif
 
-    float rayBeamCylinderCenterDist = length(cross(worldPos - beam.startPos, beamDirection));
     //prd.hitValue += prd.weight * radiance * exp(-pc_ray.beamRadius * rayBeamCylinderCenterDist * rayBeamCylinderCenterDist);
-
     //prd.hitValue += prd.weight * radiance * pow((1.1 - rayBeamCylinderCenterDist / pc_ray.beamRadius), 2.2);
-    prd.hitValue += prd.weight * radiance * pow((1.1 - rayBeamCylinderCenterDist / pc_ray.beamRadius), 0.5);
-
     //prd.hitValue += prd.weight * radiance * (1.1 - rayBeamCylinderCenterDist / pc_ray.beamRadius);
     //prd.hitValue += prd.weight * radiance * exp(-rayBeamCylinderCenterDist / pc_ray.beamRadius);
     //prd.hitValue += prd.weight * radiance;
+    prd.hitValue += prd.weight * getBeamGatherDataHitRadiance(beamData, pc_ray.airExtinctCoff, hit, phaseVal);
+#endif
 
     IgnoreHit();
 
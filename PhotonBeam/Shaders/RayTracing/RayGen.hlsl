@@ -3,6 +3,8 @@
 #define PHOTONBEAM_RAY_GEN
 
 #include "..\util\RayTracingSampling.hlsli"
+#include "..\util\HenyeyGreensteinTable.h"
+#include "..\util\BeamReservoir.h"
 #include "..\RaytracingHlslCompat.h"
 
 RWTexture2D<float4> RenderTarget : register(u0);
@@ -23,6 +25,38 @@ SamplerState gsamLinearWrap  : register(s0);
 
 ConstantBuffer<PushConstantRay> pc_ray : register(b0);
 
+#if PHOTONBEAM_BEAM_RESERVOIR_SIZE > 0
+
+#if PHOTONBEAM_HG_TABLE
+StructuredBuffer<float> g_hgTable : register(t0, space2);
+#endif
+
+// radiance of the beam hits BeamAnyHit left in the slots, with a payload weight of 1
+float3 resolveBeamReservoir(RayHitPayload prd)
+{
+    const uint numSlots = PHOTONBEAM_BEAM_RESERVOIR_SIZE;
+    const uint numFilled = min(prd.reservoirNumHits, numSlots);
+
+    float3 radiance = (float3)(0);
+    for (uint slot = 0; slot < numFilled; slot++)
+    {
+        BeamReservoirHit hit = prd.reservoirHits[slot];
+
+#if PHOTONBEAM_HG_TABLE
+        float phaseVal = hgTablePhaseFunc(g_hgTable, hit.beamRayCosVal, pc_ray.airHGAssymFactor);
+#else
+        float phaseVal = heneyGreenPhaseFunc(hit.beamRayCosVal, pc_ray.airHGAssymFactor);
+#endif
+
+        float weight = getBeamReservoirWeight(hit.lightColor, hit.beamRadius, hit.beamRayCosVal);
+        radiance += getBeamHitRadiance(pc_ray, hit, phaseVal)
+            * getBeamReservoirSlotScale(prd.reservoirNumHits, numSlots, prd.reservoirWeightSum, weight);
+    }
+    return radiance;
+}
+
+#endif
+
 
 [shader("raygeneration")]
 void RayGen() {
@@ -34,8 +68,8 @@ void RayGen() {
         + dispatchIndex.z;
 
     // Initialize the random number
-    uint seed = tea(launchIndex, pc_ray.seed);
-    uint nextSeed = tea(launchIndex, pc_ray.seed + 1);
+    uint seed = rngInitSeed(launchIndex, pc_ray.seed);
+    uint nextSeed = rngInitSeed(launchIndex, pc_ray.seed + 1);
 
     const float2 pixelCenter = float2(dispatchIndex.xy) + (float2)(0.5);
     float2 inUV = pixelCenter / float2(dispatchDimensionSize.xy) * 2.0 - 1.0;
@@ -61,6 +95,10 @@ void RayGen() {
     rayDesc.Origin = mul(float4(0, 0, 0, 1), pc_ray.viewInverse).xyz;
     prd.tMax = tMaxDefault;
 
+#if PHOTONBEAM_BEAM_RESERVOIR_SIZE > 0
+    prd.reservoirSeed = rngInitSeed(launchIndex, ~pc_ray.seed);
+#endif
+
     uint num_iteration = 2;
     for (int i = 0; i < num_iteration; i++)
     {
@@ -84,6 +122,9 @@ void RayGen() {
         if (query.CommittedStatus() == COMMITTED_NOTHING)
         {
             prd.isHit = 0;
+#if PHOTONBEAM_BEAM_RESERVOIR_SIZE > 0
+            resetBeamReservoir(prd);
+#endif
             TraceRay(
                 g_beamAS,
                 RAY_FLAG_FORCE_NON_OPAQUE,
@@ -94,6 +135,9 @@ void RayGen() {
                 rayDesc,
                 prd
             );
+#if PHOTONBEAM_BEAM_RESERVOIR_SIZE > 0
+            prd.hitValue += prd.weight * resolveBeamReservoir(prd);
+#endif
 
             // add clear colr if the ray has not hitted any solid surface
             prd.hitValue += prd.weight * pc_ray.clearColor.xyz * 0.8;
@@ -144,6 +188,9 @@ void RayGen() {
         prd.hitMetallic = material.metallic;
         prd.hitRoughness = material.roughness;
 
+#if PHOTONBEAM_BEAM_RESERVOIR_SIZE > 0
+        resetBeamReservoir(prd);
+#endif
         TraceRay(
             g_beamAS,
             RAY_FLAG_FORCE_NON_OPAQUE,
@@ -154,6 +201,9 @@ void RayGen() {
             rayDesc,
             prd
         );
+#if PHOTONBEAM_BEAM_RESERVOIR_SIZE > 0
+        prd.hitValue += prd.weight * resolveBeamReservoir(prd);
+#endif
         prd.weight = prd.weight * 1.0;
 
         // stop the loop at this point if this is the last iteration
@@ -161,11 +211,26 @@ void RayGen() {
             break;
 
         float3 viewingDirection = -rayDesc.Direction;
-        if (material.roughness > 0.01)
+        if (material.roughness > MIRROR_BOUNCE_MAX_ROUGHNESS)
             break;
 
-        float3 firstDirection = microfacetReflectedLightSampling(seed, rayDesc.Direction, world_normal, material.roughness);
-        float3 secondDirection = microfacetReflectedLightSampling(nextSeed, rayDesc.Direction, world_normal, material.roughness);
+#if PHOTONBEAM_SOBOL_SAMPLING
+        float3 firstDirection = reflectedLightSamplingFromUV(
+            sobolSample2D(launchIndex, i, pc_ray.seed), 
+            rayDesc.Direction, 
+            world_normal, 
+            material.roughness
+        );
+        float3 secondDirection = reflectedLightSamplingFromUV(
+            sobolSample2D(launchIndex, i, pc_ray.seed + 1), 
+            rayDesc.Direction, 
+            world_normal, 
+            material.roughness
+        );
+#else
+        float3 firstDirection = reflectedLightSampling(seed, rayDesc.Direction, world_normal, material.roughness);
+        float3 secondDirection = reflectedLightSampling(nextSeed, rayDesc.Direction, world_normal, material.roughness);
+#endif
         float3 sumDirection = firstDirection + secondDirection;
 
         if (sumDirection.x == 0 && sumDirection.y == 0 && sumDirection.z == 0)
@@ -183,9 +248,9 @@ void RayGen() {
         rayDesc.Direction = normalize(rayDesc.Direction);
 
         rayDesc.Origin = rayDesc.Origin - viewingDirection * rayDesc.TMax + rayDesc.Direction;
-        prd.weight *= exp(-pc_ray.airExtinctCoff * rayDesc.TMax) * pdfWeightedGltfBrdf(
-            rayDesc.Direction,
+        prd.weight *= exp(-pc_ray.airExtinctCoff * rayDesc.TMax) * pdfWeightedReflectedLightBrdf(
             viewingDirection,
+            rayDesc.Direction,
             world_normal, 
             albedo, 
             material.roughness, 
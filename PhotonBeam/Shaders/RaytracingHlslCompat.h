@@ -22,6 +22,11 @@ using namespace DirectX;
 #define HLSL_PAYLOAD_READ(...)  
 #define HLSL_PAYLOAD_WRITE(...)  
 
+// helpers for functions shared by HLSL and c++
+#define COMPAT_INLINE inline
+#define COMPAT_INOUT(type) type&
+#define COMPAT_OUT(type) type&
+
 #else
 #include "util\HlslCompat.h"
 
@@ -29,10 +34,29 @@ using namespace DirectX;
 #define HLSL_PAYLOAD_READ(...) : read(__VA_ARGS__)
 #define HLSL_PAYLOAD_WRITE(...) : write(__VA_ARGS__)
 
+#define COMPAT_INLINE
+#define COMPAT_INOUT(type) inout type
+#define COMPAT_OUT(type) out type
+
 #endif
 
 #define SUB_BEAM_INFO_BUFFER_RESET_COMPUTE_SHADER_GROUP_SIZE 256
 
+// RayGen.hlsl traces a reflected ray only off surfaces of at most this roughness
+#define MIRROR_BOUNCE_MAX_ROUGHNESS 0.01f
+
+// culling of the sub-beam instances before the beam TLAS build, see util/BeamCulling.h
+#define BEAM_CULL_MODE_KEEP_ALL 0
+#define BEAM_CULL_MODE_FRUSTUM 1
+#define BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS 2
+#define BEAM_CULL_MAX_MIRROR_PLANES 8
+
+// slots of the weighted reservoir gather of the beams, see util/BeamReservoir.h. 0 adds the radiance of every beam hit.
+// The payload size of the pipeline is sizeof(RayHitPayload), define it for the c++ code too.
+#ifndef PHOTONBEAM_BEAM_RESERVOIR_SIZE
+#define PHOTONBEAM_BEAM_RESERVOIR_SIZE 0
+#endif
+
 
 struct HLSL_PAYLOAD_STRUCT BeamHitPayload
 {
@@ -46,6 +70,7 @@ struct HLSL_PAYLOAD_STRUCT BeamHitPayload
 	XMFLOAT3 hitNormal HLSL_PAYLOAD_READ(caller) HLSL_PAYLOAD_WRITE(closesthit);
 	uint32_t nextSeed HLSL_PAYLOAD_READ(caller, closesthit) HLSL_PAYLOAD_WRITE(caller, closesthit);
 	float nextSeedRatio HLSL_PAYLOAD_READ(closesthit) HLSL_PAYLOAD_WRITE(caller);
+	uint32_t sampleDimension HLSL_PAYLOAD_READ(caller, closesthit) HLSL_PAYLOAD_WRITE(caller, closesthit); // next Sobol dimension pair to use
 };
 
 struct BeamHitAttributes
@@ -54,6 +79,17 @@ struct BeamHitAttributes
 };
 
 
+// a beam hit BeamAnyHit keeps in a reservoir slot, RayGen evaluates its radiance
+struct BeamReservoirHit
+{
+	XMFLOAT3 lightColor;
+	float    beamRadius;
+	float    pathLength;     // distance along the ray plus distance along the beam
+	float    beamRayCosVal;
+	float    centerDist;     // distance of the ray point to the beam axis
+};
+
+
 struct HLSL_PAYLOAD_STRUCT RayHitPayload
 {
 	XMFLOAT3 hitValue HLSL_PAYLOAD_READ(caller, anyhit) HLSL_PAYLOAD_WRITE(caller, anyhit);
@@ -65,6 +101,13 @@ struct HLSL_PAYLOAD_STRUCT RayHitPayload
 	XMFLOAT3 hitRoughness HLSL_PAYLOAD_READ(anyhit) HLSL_PAYLOAD_WRITE(caller);
 	XMFLOAT3  weight HLSL_PAYLOAD_READ(anyhit, caller) HLSL_PAYLOAD_WRITE(caller);
 	XMFLOAT3 hitMetallic HLSL_PAYLOAD_READ(anyhit) HLSL_PAYLOAD_WRITE(caller);
+
+#if PHOTONBEAM_BEAM_RESERVOIR_SIZE > 0
+	uint32_t reservoirSeed HLSL_PAYLOAD_READ(caller, anyhit) HLSL_PAYLOAD_WRITE(caller, anyhit);
+	uint32_t reservoirNumHits HLSL_PAYLOAD_READ(caller, anyhit) HLSL_PAYLOAD_WRITE(caller, anyhit);
+	float reservoirWeightSum HLSL_PAYLOAD_READ(caller, anyhit) HLSL_PAYLOAD_WRITE(caller, anyhit);
+	BeamReservoirHit reservoirHits[PHOTONBEAM_BEAM_RESERVOIR_SIZE] HLSL_PAYLOAD_READ(caller, anyhit) HLSL_PAYLOAD_WRITE(caller, anyhit);
+#endif
 };
 
 struct RayHitAttributes
@@ -129,6 +172,15 @@ struct PushConstantBeam
 	float    nextSeedRatio;
 	uint32_t padding;
 
+	// beam radius from the pixel footprint, see util/BeamFootprint.h. pixelSpreadAngle 0 gives every beam beamRadius
+	XMFLOAT3 cameraPosition;
+	float    pixelSpreadAngle;
+
+	float    footprintPixels;
+	float    minBeamRadius;
+	float    maxBeamRadius;
+	uint32_t padding2;
+
 };
 
 // Structure used for retrieving the primitive information in the closest hit
@@ -165,12 +217,64 @@ struct PhotonBeam
 	int   hitInstanceID;
 };
 
+// PhotonBeam in 32 bytes, packed and unpacked by util/PackedBeam.h
+struct PackedPhotonBeam
+{
+	XMFLOAT3  startPos;
+	uint32_t octDirection;
+
+	float length;
+	uint32_t lightColorRGB9E5;
+	uint32_t hitInstanceAndMedia;
+	float radius;
+};
+
+// per-beam terms of the gather, stored next to PhotonBeam at the same index, see util/BeamGatherData.h
+struct PhotonBeamGatherData
+{
+	XMFLOAT3 direction;
+	float length;
+
+	XMFLOAT3 startRadiance;  // lightColor * airScatterCoff / numBeamSources
+	float invLength;
+};
+
+// one entry of the media table, see util/MediaTable.h
+struct ParticipatingMedium
+{
+	XMFLOAT3 scatterCoff;
+	float hgAssymFactor;
+
+	XMFLOAT3 extinctCoff;
+	uint32_t padding;
+};
+
 struct PhotonBeamCounter
 {
 	uint64_t subBeamCount;
 	uint64_t beamCount;
 };
 
+// planes are (normal, offset), a point p is in front when dot(normal, p) + offset >= 0
+struct BeamCullConstants
+{
+	XMFLOAT4 frustumPlanes[4];
+	XMFLOAT4 mirrorPlanes[BEAM_CULL_MAX_MIRROR_PLANES];
+
+	uint32_t cullMode;
+	uint32_t numMirrorPlanes;
+	uint32_t maxNumSubBeams;
+	uint32_t padding;
+};
+
+struct SubBeamCullCounter
+{
+	uint32_t numInstances;      // instances written by BeamGen
+	uint32_t numKept;           // instances compacted into the TLAS input
+	uint32_t numKeptByMirrors;  // kept instances outside the frustum
+	uint32_t padding;
+};
+
 
 struct ShaderRayTracingTopASInstanceDesc
 {
@@ -0,0 +1,110 @@
+/*
+
+Culling of the sub-beam instances written by BeamGen.hlsl before the beam TLAS is built,
+shared by BeamTracing/CullSubBeamInstances.hlsl and the c++ code.
+
+Only two kinds of rays trace the beam TLAS in RayGen.hlsl
+	primary rays        from the camera through the pixels, inside the frustum of viewInverse and projInverse
+	mirror bounces      one reflection off a surface of roughness <= MIRROR_BOUNCE_MAX_ROUGHNESS,
+	                    starting on the surface and leaving into the hemisphere of its normal
+
+An instance is kept when its capsule reaches the four side planes of the frustum or, with BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS,
+the front half space of one of the mirror planes. A mirror plane bounds a visible mirror whose normals are all the same,
+the CPU falls back to BEAM_CULL_MODE_KEEP_ALL when a curved mirror is visible or more than BEAM_CULL_MAX_MIRROR_PLANES planar ones are.
+
+The capsule of an instance is the segment of its BLAS box along the instance z axis, with the radius of the box corners.
+The radius assumes orthogonal x and y columns of the transform, which holds for every instance of BeamGen.hlsl.
+
+*/
+
+#ifndef BEAMCULLING_H
+#define BEAMCULLING_H
+
+#include "../RaytracingHlslCompat.h"
+#include "BeamInstance.h"
+#include "FastMath.h"
+
+// result of cullSubBeamInstance()
+#define BEAM_CULL_RESULT_CULLED 0
+#define BEAM_CULL_RESULT_IN_FRUSTUM 1
+#define BEAM_CULL_RESULT_MIRRORS 2
+
+
+COMPAT_INLINE float beamCullPlaneDistance(XMFLOAT4 plane, XMFLOAT3 p)
+{
+    return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w;
+}
+
+// the whole capsule is behind the plane
+COMPAT_INLINE bool isCapsuleBehindPlane(XMFLOAT4 plane, XMFLOAT3 start, XMFLOAT3 end, float radius)
+{
+    return beamCullPlaneDistance(plane, start) < -radius && beamCullPlaneDistance(plane, end) < -radius;
+}
+
+COMPAT_INLINE void getSubBeamInstanceCapsule(
+    ShaderRayTracingTopASInstanceDesc instance,
+    COMPAT_OUT(XMFLOAT3) start,
+    COMPAT_OUT(XMFLOAT3) end,
+    COMPAT_OUT(float) radius
+)
+{
+    const float beamBox[6] = BEAM_BLAS_AABB;
+    const float photonBox[6] = PHOTON_BLAS_AABB;
+
+    const bool isPhoton = unpackInstanceHitGroup(instance.instanceShaderBindingTableRecordOffsetAndflags) == BEAM_HIT_TYPE_SOLID;
+    const float halfX = isPhoton ? photonBox[3] : beamBox[3];
+    const float halfY = isPhoton ? photonBox[4] : beamBox[4];
+    const float minZ = isPhoton ? photonBox[2] : beamBox[2];
+    const float maxZ = isPhoton ? photonBox[5] : beamBox[5];
+
+    // transform rows are (x column, y column, z column, origin) of one world axis
+    XMFLOAT4 row0 = instance.transform[0];
+    XMFLOAT4 row1 = instance.transform[1];
+    XMFLOAT4 row2 = instance.transform[2];
+
+    start.x = row0.w + row0.z * minZ;
+    start.y = row1.w + row1.z * minZ;
+    start.z = row2.w + row2.z * minZ;
+
+    end.x = row0.w + row0.z * maxZ;
+    end.y = row1.w + row1.z * maxZ;
+    end.z = row2.w + row2.z * maxZ;
+
+    const float xLengthSquare = row0.x * row0.x + row1.x * row1.x + row2.x * row2.x;
+    const float yLengthSquare = row0.y * row0.y + row1.y * row1.y + row2.y * row2.y;
+    radius = preciseSqrt(halfX * halfX * xLengthSquare + halfY * halfY * yLengthSquare);
+}
+
+COMPAT_INLINE uint32_t cullSubBeamInstance(BeamCullConstants constants, ShaderRayTracingTopASInstanceDesc instance)
+{
+    if (constants.cullMode == BEAM_CULL_MODE_KEEP_ALL)
+        return BEAM_CULL_RESULT_IN_FRUSTUM;
+
+    XMFLOAT3 start;
+    XMFLOAT3 end;
+    float radius;
+    getSubBeamInstanceCapsule(instance, start, end, radius);
+
+    bool inFrustum = true;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        if (isCapsuleBehindPlane(constants.frustumPlanes[i], start, end, radius))
+            inFrustum = false;
+    }
+
+    if (inFrustum)
+        return BEAM_CULL_RESULT_IN_FRUSTUM;
+
+    if (constants.cullMode == BEAM_CULL_MODE_FRUSTUM_AND_MIRRORS)
+    {
+        for (uint32_t i = 0; i < constants.numMirrorPlanes; i++)
+        {
+            if (!isCapsuleBehindPlane(constants.mirrorPlanes[i], start, end, radius))
+                return BEAM_CULL_RESULT_MIRRORS;
+        }
+    }
+
+    return BEAM_CULL_RESULT_CULLED;
+}
+
+#endif // BEAMCULLING_H
@@ -0,0 +1,63 @@
+/*
+
+Beam radius from the pixel footprint of the camera, shared by BeamTracing/BeamGen.hlsl, RayTracing/RayBeamAnyHit.hlsl and the c++ code.
+
+The camera rays of two neighbouring pixels spread apart by pixelSpreadAngle = 2 * tan(fovY / 2) / height per unit of distance,
+the ray differential of a pinhole camera, so a point at distance d of the camera is covered by a footprint d * pixelSpreadAngle wide.
+A beam thinner than the footprint aliases, a beam of many footprints blurs.
+
+BeamGen.hlsl stores the radius of every beam in PhotonBeam::radius,
+	footprintPixels * pixelSpreadAngle * (distance from the camera to the nearest point of the beam)
+clamped to [minBeamRadius, maxBeamRadius] of PushConstantBeam, and splits the beam into sub-beams of that radius.
+A pixelSpreadAngle of 0 gives every beam beamRadius.
+The gather uses the radius of the beam, and the radius of PushConstantRay for a beam stored with a radius of 0.
+
+*/
+
+#ifndef BEAMFOOTPRINT_H
+#define BEAMFOOTPRINT_H
+
+#include "../RaytracingHlslCompat.h"
+#include "FastMath.h"
+
+
+COMPAT_INLINE float getBeamCameraDistance(XMFLOAT3 startPos, XMFLOAT3 endPos, XMFLOAT3 cameraPosition)
+{
+    XMFLOAT3 beamVec;
+    beamVec.x = endPos.x - startPos.x;
+    beamVec.y = endPos.y - startPos.y;
+    beamVec.z = endPos.z - startPos.z;
+
+    const float lengthSquare = beamVec.x * beamVec.x + beamVec.y * beamVec.y + beamVec.z * beamVec.z;
+    const float along = (cameraPosition.x - startPos.x) * beamVec.x
+        + (cameraPosition.y - startPos.y) * beamVec.y
+        + (cameraPosition.z - startPos.z) * beamVec.z;
+
+    // the nearest point of the segment
+    float t = lengthSquare > 0.0f ? along / lengthSquare : 0.0f;
+    t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+
+    XMFLOAT3 toCamera;
+    toCamera.x = cameraPosition.x - (startPos.x + beamVec.x * t);
+    toCamera.y = cameraPosition.y - (startPos.y + beamVec.y * t);
+    toCamera.z = cameraPosition.z - (startPos.z + beamVec.z * t);
+    return preciseSqrt(toCamera.x * toCamera.x + toCamera.y * toCamera.y + toCamera.z * toCamera.z);
+}
+
+// the radius BeamGen.hlsl stores with the beam from startPos to endPos
+COMPAT_INLINE float getFootprintBeamRadius(PushConstantBeam pc, XMFLOAT3 startPos, XMFLOAT3 endPos)
+{
+    if (pc.pixelSpreadAngle <= 0.0f)
+        return pc.beamRadius;
+
+    const float radius = pc.footprintPixels * pc.pixelSpreadAngle * getBeamCameraDistance(startPos, endPos, pc.cameraPosition);
+    return radius < pc.minBeamRadius ? pc.minBeamRadius : (radius > pc.maxBeamRadius ? pc.maxBeamRadius : radius);
+}
+
+// the radius the gather uses for a beam stored with beamRadius
+COMPAT_INLINE float getGatherBeamRadius(float beamRadius, float defaultRadius)
+{
+    return beamRadius > 0.0f ? beamRadius : defaultRadius;
+}
+
+#endif // BEAMFOOTPRINT_H
@@ -0,0 +1,72 @@
+/*
+
+Per-beam terms of the beam gather, shared by the beam emission and the c++ code.
+
+BeamAnyHit recomputes the direction and the length of the beam for every ray it tests against the beam, and scales
+the light of the beam by the scattering coefficient and the number of beam sources for every hit. The emission
+computes them once per beam into PhotonBeamGatherData, at the index of the beam in the beam buffer:
+	direction        normalize(endPos - startPos)
+	length           length(endPos - startPos), and its inverse
+	startRadiance    lightColor * airScatterCoff / numBeamSources, the radiance factor of a hit where the
+	                 transmittance along the ray and the beam is 1
+
+The attenuation from the light to the start of the beam is already in lightColor, BeamClosestHit.hlsl weights the
+color of the next beam by its free path sampling, so startRadiance is the whole per-beam factor of the radiance and
+only the transmittance along the beam and the ray is left to the hit.
+
+BeamGen.hlsl writes the data to g_photonBeamGatherData, a root UAV of the global root signature of the beam tracing
+in register space 3, and BeamAnyHit of RayBeamAnyHit.hlsl reads it as a root SRV of the ray tracing in the same space.
+
+The transmittance exp(-airExtinctCoff * (ray distance + beam distance)) of a homogeneous medium only depends on the
+path length and the phase function of a frame only on the cosine, Cpu-Reference/BeamGatherData.hpp tabulates both
+per frame, so the inner loop of the CPU gather has no exponential, no power of the phase function and no
+normalization of the beam left. The shaders keep the exponential and the phase function of PHOTONBEAM_HG_TABLE.
+
+*/
+
+#ifndef BEAMGATHERDATA_H
+#define BEAMGATHERDATA_H
+
+#include "../RaytracingHlslCompat.h"
+#include "FastMath.h"
+
+
+COMPAT_INLINE PhotonBeamGatherData makePhotonBeamGatherData(PhotonBeam beam, XMFLOAT3 airScatterCoff, uint32_t numBeamSources)
+{
+    XMFLOAT3 beamVec;
+    beamVec.x = beam.endPos.x - beam.startPos.x;
+    beamVec.y = beam.endPos.y - beam.startPos.y;
+    beamVec.z = beam.endPos.z - beam.startPos.z;
+
+    const float beamLength = preciseSqrt(beamVec.x * beamVec.x + beamVec.y * beamVec.y + beamVec.z * beamVec.z);
+    const float invLength = beamLength > 0.0f ? 1.0f / beamLength : 0.0f;
+    const float sourceScale = numBeamSources > 0 ? 1.0f / float(numBeamSources) : 0.0f;
+
+    PhotonBeamGatherData data;
+    data.direction.x = beamVec.x * invLength;
+    data.direction.y = beamVec.y * invLength;
+    data.direction.z = beamVec.z * invLength;
+    data.length = beamLength;
+    data.startRadiance.x = beam.lightColor.x * airScatterCoff.x * sourceScale;
+    data.startRadiance.y = beam.lightColor.y * airScatterCoff.y * sourceScale;
+    data.startRadiance.z = beam.lightColor.z * airScatterCoff.z * sourceScale;
+    data.invLength = invLength;
+    return data;
+}
+
+#ifndef __cplusplus
+
+// getBeamHitRadiance() of util/BeamReservoir.h with the scattering and the beam sources of startRadiance
+float3 getBeamGatherDataHitRadiance(PhotonBeamGatherData data, float3 airExtinctCoff, BeamReservoirHit hit, float phaseVal)
+{
+    float beamRayAbsSinVal = policySqrt(PHOTONBEAM_GATHER_MATH_POLICY, max(0.0f, 1 - hit.beamRayCosVal * hit.beamRayCosVal));
+
+    float3 radiance = data.startRadiance * policyExp(PHOTONBEAM_GATHER_MATH_POLICY, -airExtinctCoff * hit.pathLength) * phaseVal
+        / (hit.beamRadius * beamRayAbsSinVal + 0.1e-10);
+
+    return radiance * policySqrt(PHOTONBEAM_GATHER_MATH_POLICY, 1.1 - hit.centerDist / hit.beamRadius);
+}
+
+#endif // __cplusplus
+
+#endif // BEAMGATHERDATA_H
@@ -0,0 +1,65 @@
+/*
+
+Packing of the beam acceleration structure instances shared by the HLSL shaders and c++ code.
+
+ShaderRayTracingTopASInstanceDesc has the layout of D3D12_RAYTRACING_INSTANCE_DESC, whose bit fields are
+	instanceCustomIndexAndmask                       InstanceID : 24, InstanceMask : 8
+	instanceShaderBindingTableRecordOffsetAndflags   InstanceContributionToHitGroupIndex : 24, Flags : 8
+
+InstanceID is the index of the PhotonBeam of the sub-beam, the hit group index is the beam hit type.
+
+*/
+
+#ifndef BEAMINSTANCE_H
+#define BEAMINSTANCE_H
+
+#include "../RaytracingHlslCompat.h"
+
+// hit group of the sub-beam instance
+#define BEAM_HIT_TYPE_AIR 0
+#define BEAM_HIT_TYPE_SOLID 1
+
+#define BEAM_INSTANCE_MASK 0xFF
+
+// D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_CULL_DISABLE
+#define BEAM_INSTANCE_FLAGS 0x01
+
+#define BEAM_INSTANCE_MAX_CUSTOM_INDEX 0x00FFFFFF
+
+// instance space AABBs { min x, min y, min z, max x, max y, max z } of the BLAS of the hit groups,
+// both centered on the z axis
+#define BEAM_BLAS_AABB { -1.0f, -1.0f, 0.0f, 1.0f, 1.0f, 2.0f }
+#define PHOTON_BLAS_AABB { -1.0f, -0.1f, -1.0f, 1.0f, 0.1f, 1.0f }
+
+
+COMPAT_INLINE uint32_t packInstanceCustomIndexAndMask(uint32_t customIndex, uint32_t mask)
+{
+    return (customIndex & BEAM_INSTANCE_MAX_CUSTOM_INDEX) | (mask << 24);
+}
+
+COMPAT_INLINE uint32_t packInstanceHitGroupAndFlags(uint32_t hitGroupIndex, uint32_t flags)
+{
+    return (hitGroupIndex & 0x00FFFFFF) | (flags << 24);
+}
+
+COMPAT_INLINE uint32_t unpackInstanceCustomIndex(uint32_t customIndexAndMask)
+{
+    return customIndexAndMask & BEAM_INSTANCE_MAX_CUSTOM_INDEX;
+}
+
+COMPAT_INLINE uint32_t unpackInstanceMask(uint32_t customIndexAndMask)
+{
+    return customIndexAndMask >> 24;
+}
+
+COMPAT_INLINE uint32_t unpackInstanceHitGroup(uint32_t hitGroupAndFlags)
+{
+    return hitGroupAndFlags & 0x00FFFFFF;
+}
+
+COMPAT_INLINE uint32_t unpackInstanceFlags(uint32_t hitGroupAndFlags)
+{
+    return hitGroupAndFlags >> 24;
+}
+
+#endif // BEAMINSTANCE_H
@@ -0,0 +1,134 @@
+/*
+
+Weighted reservoir gather of the beams, shared by RayTracing/RayBeamAnyHit.hlsl, RayTracing/RayGen.hlsl and the c++ code.
+
+With PHOTONBEAM_BEAM_RESERVOIR_SIZE K > 0, BeamAnyHit no longer adds the radiance of every beam the ray hits.
+It streams the hits through the K slots of RayHitPayload, and RayGen evaluates the radiance of the hits left
+in the slots after TraceRay, so a pixel looking down a bundle of beams evaluates at most K radiances.
+The any hit calls and their intersection tests still follow the number of sub-beams the ray enters.
+
+	the first K hits fill the slots, the estimate is exact while a ray hits at most K beams
+	hit K + 1 resamples the K + 1 hits into the slots, slot k takes the hit of frac(u + k / K) in the weight sum
+	every later hit i replaces slot k when frac(u_i + k / K) * W_i < w_i, W_i the weight sum of the hits 0..i
+
+Every slot then holds hit j with probability w_j / W, and the sum over the slots of
+	f(slot) * W / (K * w(slot))
+is an unbiased estimate of the sum of f over the hits. The slots share one random number per hit,
+stratified by k / K, which spreads the slots over the hits instead of sampling them independently.
+
+The weight is the brightest channel of the beam color over (beam radius * |sin| of the beam and the ray),
+the factors of the radiance that tell the beams of a bundle apart without the exponential, the phase function
+and the kernel the slots defer. A beam seen along its axis has a large weight as it has a large radiance.
+Hits of weight 0 add no radiance and are skipped.
+
+*/
+
+#ifndef BEAMRESERVOIR_H
+#define BEAMRESERVOIR_H
+
+#include "../RaytracingHlslCompat.h"
+#include "FastMath.h"
+#include "RandomNumberGenerator.h"
+
+
+COMPAT_INLINE float getBeamReservoirWeight(XMFLOAT3 lightColor, float beamRadius, float beamRayCosVal)
+{
+    float brightest = lightColor.x > lightColor.y ? lightColor.x : lightColor.y;
+    brightest = brightest > lightColor.z ? brightest : lightColor.z;
+
+    const float sinSquare = 1.0f - beamRayCosVal * beamRayCosVal;
+    const float beamRayAbsSinVal = policySqrt(PHOTONBEAM_GATHER_MATH_POLICY, sinSquare > 0.0f ? sinSquare : 0.0f);
+    return brightest / (beamRadius * beamRayAbsSinVal + 0.1e-10f);
+}
+
+// the random number of slot out of numSlots for the random number u of a hit, in [0, 1)
+COMPAT_INLINE float getBeamReservoirSlotU(float u, uint32_t slot, uint32_t numSlots)
+{
+    const float slotU = u + float(slot) / float(numSlots);
+    return slotU < 1.0f ? slotU : slotU - 1.0f;
+}
+
+// factor of the radiance of a slot of weight, after numHits hits of weight sum weightSum
+COMPAT_INLINE float getBeamReservoirSlotScale(uint32_t numHits, uint32_t numSlots, float weightSum, float weight)
+{
+    return numHits <= numSlots ? 1.0f : weightSum / (float(numSlots) * weight);
+}
+
+#ifndef __cplusplus
+
+// radiance of a beam hit for the phase function value of its beamRayCosVal, with a payload weight of 1
+float3 getBeamHitRadiance(PushConstantRay pc, BeamReservoirHit hit, float phaseVal)
+{
+    float beamRayAbsSinVal = policySqrt(PHOTONBEAM_GATHER_MATH_POLICY, max(0.0f, 1 - hit.beamRayCosVal * hit.beamRayCosVal));
+
+    float3 radiance = pc.airScatterCoff * policyExp(PHOTONBEAM_GATHER_MATH_POLICY, -pc.airExtinctCoff * hit.pathLength) * phaseVal
+        * hit.lightColor / float(pc.numBeamSources) / (hit.beamRadius * beamRayAbsSinVal + 0.1e-10);
+
+    return radiance * policySqrt(PHOTONBEAM_GATHER_MATH_POLICY, 1.1 - hit.centerDist / hit.beamRadius);
+}
+
+#if PHOTONBEAM_BEAM_RESERVOIR_SIZE > 0
+
+// empties the slots before a TraceRay, the random number state carries over
+void resetBeamReservoir(inout RayHitPayload prd)
+{
+    prd.reservoirNumHits = 0;
+    prd.reservoirWeightSum = 0.0f;
+}
+
+void addBeamReservoirHit(inout RayHitPayload prd, BeamReservoirHit hit)
+{
+    const uint numSlots = PHOTONBEAM_BEAM_RESERVOIR_SIZE;
+    const float weight = getBeamReservoirWeight(hit.lightColor, hit.beamRadius, hit.beamRayCosVal);
+    if (weight <= 0.0f)
+        return;
+
+    const uint numHits = prd.reservoirNumHits;
+    prd.reservoirNumHits = numHits + 1;
+    prd.reservoirWeightSum += weight;
+
+    if (numHits < numSlots)
+    {
+        prd.reservoirHits[numHits] = hit;
+        return;
+    }
+
+    const float u = rnd(prd.reservoirSeed);
+
+    if (numHits == numSlots)
+    {
+        BeamReservoirHit hits[PHOTONBEAM_BEAM_RESERVOIR_SIZE + 1];
+        for (uint i = 0; i < numSlots; i++)
+            hits[i] = prd.reservoirHits[i];
+        hits[numSlots] = hit;
+
+        for (uint slot = 0; slot < numSlots; slot++)
+        {
+            float target = getBeamReservoirSlotU(u, slot, numSlots) * prd.reservoirWeightSum;
+            uint picked = numSlots;
+            for (uint j = 0; j < numSlots; j++)
+            {
+                target -= getBeamReservoirWeight(hits[j].lightColor, hits[j].beamRadius, hits[j].beamRayCosVal);
+                if (target < 0.0f)
+                {
+                    picked = j;
+                    break;
+                }
+            }
+            prd.reservoirHits[slot] = hits[picked];
+        }
+        return;
+    }
+
+    for (uint slot = 0; slot < numSlots; slot++)
+    {
+        if (getBeamReservoirSlotU(u, slot, numSlots) * prd.reservoirWeightSum < weight)
+            prd.reservoirHits[slot] = hit;
+    }
+}
+
+#endif // PHOTONBEAM_BEAM_RESERVOIR_SIZE > 0
+
+#endif // __cplusplus
+
+#endif // BEAMRESERVOIR_H
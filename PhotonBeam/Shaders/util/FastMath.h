@@ -0,0 +1,218 @@
+/*
+
+Fast approximate transcendental functions shared by the HLSL shaders and c++ code.
+
+Every call site picks its math with a compile-time policy, passed as the first argument of the policy* functions.
+The policy is a literal constant, so the branch is folded away by the compiler.
+
+	PHOTONBEAM_MATH_PRECISE   intrinsics on HLSL, std functions on c++
+	PHOTONBEAM_MATH_FAST      the polynomial / bit trick kernels of this file, identical on HLSL and c++
+
+The fast kernels only use FMA pipe ops (mad, int <-> float conversion, shifts), which run at full rate,
+while exp, log, sqrt and rsqrt go through the quarter rate transcendental units on the GPU.
+On the CPU, log and rsqrt are clearly faster than the std versions, exp and sqrt are on par or slower unless the loop vectorizes,
+see RunFastMathBenchmark() in Cpu-Reference/FastMathValidation.hpp.
+
+Maximum error against the exact result, measured over every float of the domain by MeasureFastMathErrors()
+	function        domain                  max error
+	fastExp2        [-126, 127.99]          2.9 ulp
+	fastLog2        normal floats > 0       3.0 ulp
+	fastRsqrt       normal floats > 0       6.5e-4 relative (10400 ulp)
+	fastSqrt        normal floats > 0       6.5e-4 relative (9500 ulp)
+	fastExp         [-87, 88]               65 ulp(3.9e-6 relative), the rounding of x * log2(e) grows with |x|
+	fastLog         normal floats > 0       3.3 ulp
+	fastPow         error of fastExp2(y * fastLog2(x)), the error of the product grows with |y * log2(x)| like fastExp
+
+Results below 2^-126 flush to zero, like the GPU does, and fastLog2 of 0 is -127 instead of -inf.
+
+The default policy of each call site can be overridden by defining the macro before including this file.
+	PHOTONBEAM_GATHER_MATH_POLICY   beam gather in RayBeamAnyHit.hlsl
+	PHOTONBEAM_SCATTER_MATH_POLICY  free path sampling and transmittance in BeamClosestHit.hlsl
+Both default to PHOTONBEAM_MATH_PRECISE, the fast kernels change the image, a call site should only switch once a GPU
+measurement shows the gain and the image error stays within the agreed bound.
+
+*/
+
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include "../RaytracingHlslCompat.h"
+
+#define PHOTONBEAM_MATH_PRECISE 0
+#define PHOTONBEAM_MATH_FAST 1
+
+#ifndef PHOTONBEAM_GATHER_MATH_POLICY
+#define PHOTONBEAM_GATHER_MATH_POLICY PHOTONBEAM_MATH_PRECISE
+#endif
+
+#ifndef PHOTONBEAM_SCATTER_MATH_POLICY
+#define PHOTONBEAM_SCATTER_MATH_POLICY PHOTONBEAM_MATH_PRECISE
+#endif
+
+#define FAST_MATH_LOG2E 1.44269504f
+#define FAST_MATH_LN2 0.693147181f
+
+
+#ifdef __cplusplus
+#include <bit>
+#include <cmath>
+
+COMPAT_INLINE float fastMathAsFloat(uint32_t x) { return std::bit_cast<float>(x); }
+COMPAT_INLINE uint32_t fastMathAsUint(float x) { return std::bit_cast<uint32_t>(x); }
+
+COMPAT_INLINE float preciseExp(float x) { return std::exp(x); }
+COMPAT_INLINE float preciseExp2(float x) { return std::exp2(x); }
+COMPAT_INLINE float preciseLog(float x) { return std::log(x); }
+COMPAT_INLINE float preciseLog2(float x) { return std::log2(x); }
+COMPAT_INLINE float precisePow(float x, float y) { return std::pow(x, y); }
+COMPAT_INLINE float preciseSqrt(float x) { return std::sqrt(x); }
+COMPAT_INLINE float preciseRsqrt(float x) { return 1.0f / std::sqrt(x); }
+#else
+
+float fastMathAsFloat(uint x) { return asfloat(x); }
+uint fastMathAsUint(float x) { return asuint(x); }
+
+float preciseExp(float x) { return exp(x); }
+float preciseExp2(float x) { return exp2(x); }
+float preciseLog(float x) { return log(x); }
+float preciseLog2(float x) { return log2(x); }
+float precisePow(float x, float y) { return pow(x, y); }
+float preciseSqrt(float x) { return sqrt(x); }
+float preciseRsqrt(float x) { return rsqrt(x); }
+#endif
+
+
+// 2^x, split into 2^floor(x) built in the exponent bits and a degree 5 minimax polynomial of 2^f on [0, 1)
+COMPAT_INLINE float fastExp2(float x)
+{
+    x = x < -127.0f ? -127.0f : (x > 128.0f ? 128.0f : x);
+
+    // floor through a truncation of the positive x + 128, f can be slightly below 0 when x + 128 rounds up
+    int32_t xi = int32_t(x + 128.0f) - 128;
+    float f = x - float(xi);
+
+    float p = 0.00187757277f;
+    p = p * f + 0.00898934470f;
+    p = p * f + 0.0558263192f;
+    p = p * f + 0.240153614f;
+    p = p * f + 0.693153074f;
+    p = p * f + 0.999999925f;
+
+    // xi = -127 gives 0, xi = 128 gives inf
+    return p * fastMathAsFloat(uint32_t(xi + 127) << 23);
+}
+
+// log2(x) = e + log2(m), m in [sqrt(1/2), sqrt(2)), with log2(m) = s * q(s^2) and s = (m - 1) / (m + 1)
+COMPAT_INLINE float fastLog2(float x)
+{
+    uint32_t bits = fastMathAsUint(x);
+
+    // move the mantissa range from [1, 2) to [sqrt(1/2), sqrt(2))
+    uint32_t shifted = bits - 0x3f3504f3;
+    float e = float(int32_t(shifted) >> 23);
+    float m = fastMathAsFloat((shifted & 0x007fffff) + 0x3f3504f3);
+
+    float s = (m - 1.0f) / (m + 1.0f);
+    float s2 = s * s;
+
+    float q = 0.431734928f;
+    q = q * s2 + 0.576714422f;
+    q = q * s2 + 0.961798847f;
+    q = q * s2 + 2.88539008f;
+
+    return e + s * q;
+}
+
+// 1 / sqrt(x), bit trick initial guess refined by one Newton step.
+// The constants minimize the relative error after the Newton step (Moroz et al., 2018).
+COMPAT_INLINE float fastRsqrt(float x)
+{
+    float y = fastMathAsFloat(0x5f1ffff9 - (fastMathAsUint(x) >> 1));
+    return y * (0.703952253f * (2.38924456f - x * y * y));
+}
+
+// x * rsqrt(x), 0 stays 0 since the initial guess of 0 is finite
+COMPAT_INLINE float fastSqrt(float x)
+{
+    return x * fastRsqrt(x);
+}
+
+COMPAT_INLINE float fastExp(float x)
+{
+    return fastExp2(x * FAST_MATH_LOG2E);
+}
+
+COMPAT_INLINE float fastLog(float x)
+{
+    return fastLog2(x) * FAST_MATH_LN2;
+}
+
+// x >= 0
+COMPAT_INLINE float fastPow(float x, float y)
+{
+    return fastExp2(y * fastLog2(x));
+}
+
+
+COMPAT_INLINE float policyExp(uint32_t policy, float x)
+{
+    if (policy == PHOTONBEAM_MATH_FAST)
+        return fastExp(x);
+    return preciseExp(x);
+}
+
+COMPAT_INLINE float policyLog(uint32_t policy, float x)
+{
+    if (policy == PHOTONBEAM_MATH_FAST)
+        return fastLog(x);
+    return preciseLog(x);
+}
+
+COMPAT_INLINE float policyPow(uint32_t policy, float x, float y)
+{
+    if (policy == PHOTONBEAM_MATH_FAST)
+        return fastPow(x, y);
+    return precisePow(x, y);
+}
+
+COMPAT_INLINE float policySqrt(uint32_t policy, float x)
+{
+    if (policy == PHOTONBEAM_MATH_FAST)
+        return fastSqrt(x);
+    return preciseSqrt(x);
+}
+
+COMPAT_INLINE float policyRsqrt(uint32_t policy, float x)
+{
+    if (policy == PHOTONBEAM_MATH_FAST)
+        return fastRsqrt(x);
+    return preciseRsqrt(x);
+}
+
+
+#ifndef __cplusplus
+
+float3 policyExp(uint policy, float3 x)
+{
+    if (policy == PHOTONBEAM_MATH_FAST)
+        return float3(fastExp(x.x), fastExp(x.y), fastExp(x.z));
+    return exp(x);
+}
+
+float policyLength(uint policy, float3 x)
+{
+    if (policy == PHOTONBEAM_MATH_FAST)
+        return fastSqrt(dot(x, x));
+    return length(x);
+}
+
+float3 policyNormalize(uint policy, float3 x)
+{
+    if (policy == PHOTONBEAM_MATH_FAST)
+        return x * fastRsqrt(dot(x, x));
+    return normalize(x);
+}
+
+#endif
+
+#endif // FASTMATH_H
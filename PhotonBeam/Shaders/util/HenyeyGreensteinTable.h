@@ -0,0 +1,230 @@
+/*
+
+Tabulated Henyey-Greenstein phase function shared by the HLSL shaders and c++ code.
+
+The table is one float buffer with two sections, both indexed by the assymetric factor g.
+	sampling section    cos theta of the inverse CDF, (g, u) -> cos theta
+	evaluation section  phase function value, (g, cos theta) -> pdf of the solid angle distribution
+
+Only g >= 0 is stored, negative g uses the mirror symmetry of the distribution
+	cosTheta(u, -g) = -cosTheta(1 - u, g),  phase(cosTheta, -g) = phase(-cosTheta, g)
+
+The function gets sharp when g goes to 1, so the axes are warped to put more entries near the peak.
+	g row       g = 1 - (1 - HG_TABLE_G_MAX)^y
+	u column    u = x^2
+	cos column  cos theta = 1 - 2 x^4
+
+Lookups are bilinear. Maximum error over g in [-0.99, 0.99], measured by hgTableMeasureError()
+	resolution(G x U x C)   cos theta abs error   phase relative error
+	64 x 256 x 256          1.6e-3                7.9e-3
+	128 x 512 x 512         4.2e-4                2.0e-3
+
+Cpu-Reference/HgTableBenchmark compares the cost and the error of the table and the analytic functions.
+
+PHOTONBEAM_HG_TABLE defaults to 0, the shaders use the analytic functions of RayTracingSampling.hlsli. On the CPU the
+table is slower than the analytic functions and less accurate, cos theta is off by 3.3e-4 at g = 0.9 against 9.7e-6.
+Set it to 1 only once a GPU measurement shows the gain and the image error stays within the agreed bound. The app
+builds and binds the table either way.
+
+*/
+
+#ifndef HENYEYGREENSTEINTABLE_H
+#define HENYEYGREENSTEINTABLE_H
+
+#include "../RaytracingHlslCompat.h"
+
+#ifndef PHOTONBEAM_HG_TABLE
+#define PHOTONBEAM_HG_TABLE 0
+#endif
+
+#ifndef HG_TABLE_G_RESOLUTION
+#define HG_TABLE_G_RESOLUTION 64
+#endif
+
+#ifndef HG_TABLE_U_RESOLUTION
+#define HG_TABLE_U_RESOLUTION 256
+#endif
+
+#ifndef HG_TABLE_COS_RESOLUTION
+#define HG_TABLE_COS_RESOLUTION 256
+#endif
+
+// largest |g| in the table, larger values are clamped
+#ifndef HG_TABLE_G_MAX
+#define HG_TABLE_G_MAX 0.99f
+#endif
+
+#define HG_TABLE_SAMPLE_OFFSET 0
+#define HG_TABLE_EVAL_OFFSET (HG_TABLE_G_RESOLUTION * HG_TABLE_U_RESOLUTION)
+#define HG_TABLE_SIZE (HG_TABLE_EVAL_OFFSET + HG_TABLE_G_RESOLUTION * HG_TABLE_COS_RESOLUTION)
+
+
+#ifdef __cplusplus
+#include <algorithm>
+#include <cmath>
+
+#define HG_TABLE_BUFFER const float*
+
+COMPAT_INLINE float hgTableSqrt(float x) { return std::sqrt(x); }
+COMPAT_INLINE float hgTableLog2(float x) { return std::log2(x); }
+#else
+
+#define HG_TABLE_BUFFER StructuredBuffer<float>
+
+float hgTableSqrt(float x) { return sqrt(x); }
+float hgTableLog2(float x) { return log2(x); }
+#endif
+
+
+// continuous row coordinate in [0, HG_TABLE_G_RESOLUTION - 1] of |g|.
+// |g| is clamped before the log, which has no real value past 1
+COMPAT_INLINE float hgTableRowCoord(float absG)
+{
+    absG = absG > 0.0f ? (absG < HG_TABLE_G_MAX ? absG : HG_TABLE_G_MAX) : 0.0f;
+
+    float y = hgTableLog2(1.0f - absG) / hgTableLog2(1.0f - HG_TABLE_G_MAX);
+    y = y < 0.0f ? 0.0f : (y > 1.0f ? 1.0f : y);
+    return y * float(HG_TABLE_G_RESOLUTION - 1);
+}
+
+// bilinear lookup, rowCoord and colCoord are continuous coordinates within the section
+COMPAT_INLINE float hgTableBilinear(
+    HG_TABLE_BUFFER table,
+    uint32_t sectionOffset,
+    uint32_t numCols,
+    float rowCoord,
+    float colCoord
+)
+{
+    uint32_t row = uint32_t(rowCoord);
+    uint32_t col = uint32_t(colCoord);
+    row = row < HG_TABLE_G_RESOLUTION - 2 ? row : HG_TABLE_G_RESOLUTION - 2;
+    col = col < numCols - 2 ? col : numCols - 2;
+
+    float rowT = rowCoord - float(row);
+    float colT = colCoord - float(col);
+
+    uint32_t index = sectionOffset + row * numCols + col;
+    float v00 = table[index];
+    float v01 = table[index + 1];
+    float v10 = table[index + numCols];
+    float v11 = table[index + numCols + 1];
+
+    float v0 = v00 + (v01 - v00) * colT;
+    float v1 = v10 + (v11 - v10) * colT;
+    return v0 + (v1 - v0) * rowT;
+}
+
+// cos theta of the Henyey-Greenstein sample for a uniform random value u in [0, 1)
+COMPAT_INLINE float hgTableSampleCosTheta(HG_TABLE_BUFFER table, float u, float g)
+{
+    bool mirrored = g < 0.0f;
+    float absG = mirrored ? -g : g;
+    float uPos = mirrored ? 1.0f - u : u;
+    uPos = uPos < 0.0f ? 0.0f : (uPos > 1.0f ? 1.0f : uPos);
+
+    float colCoord = hgTableSqrt(uPos) * float(HG_TABLE_U_RESOLUTION - 1);
+    float cosTheta = hgTableBilinear(table, HG_TABLE_SAMPLE_OFFSET, HG_TABLE_U_RESOLUTION, hgTableRowCoord(absG), colCoord);
+
+    return mirrored ? -cosTheta : cosTheta;
+}
+
+// same value as heneyGreenPhaseFunc(cosTheta, g)
+COMPAT_INLINE float hgTablePhaseFunc(HG_TABLE_BUFFER table, float cosTheta, float g)
+{
+    bool mirrored = g < 0.0f;
+    float absG = mirrored ? -g : g;
+    float cosPos = mirrored ? -cosTheta : cosTheta;
+
+    float t = 0.5f - 0.5f * cosPos;
+    t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+
+    float colCoord = hgTableSqrt(hgTableSqrt(t)) * float(HG_TABLE_COS_RESOLUTION - 1);
+    return hgTableBilinear(table, HG_TABLE_EVAL_OFFSET, HG_TABLE_COS_RESOLUTION, hgTableRowCoord(absG), colCoord);
+}
+
+
+#ifdef __cplusplus
+
+// closed forms in double precision, used to fill the table and as the reference for the error measurement
+inline double hgAnalyticCosTheta(double u, double g)
+{
+    double s1 = 2 * u - 1;
+    double s2 = s1 * s1;
+    double g2 = g * g;
+
+    double denom = 1 + g * s1;
+    denom = denom * denom * 2;
+    if (denom == 0.0)
+        return 1.0;
+
+    return (2 * s1 + g * (s2 + 3) + g2 * (2 * s1) + g2 * g * (s2 - 1)) / denom;
+}
+
+inline double hgAnalyticPhaseFunc(double cosTheta, double g)
+{
+    double g2 = g * g;
+    double denom = 1 + g2 - 2 * g * cosTheta;
+
+    return (1 - g2) / (denom * std::sqrt(denom)) / (4 * 3.14159265358979323846);
+}
+
+// table must hold HG_TABLE_SIZE floats
+inline void hgTableBuild(float* table)
+{
+    for (uint32_t row = 0; row < HG_TABLE_G_RESOLUTION; row++)
+    {
+        double y = double(row) / double(HG_TABLE_G_RESOLUTION - 1);
+        double g = 1.0 - std::pow(1.0 - double(HG_TABLE_G_MAX), y);
+
+        for (uint32_t col = 0; col < HG_TABLE_U_RESOLUTION; col++)
+        {
+            double x = double(col) / double(HG_TABLE_U_RESOLUTION - 1);
+            table[HG_TABLE_SAMPLE_OFFSET + row * HG_TABLE_U_RESOLUTION + col] = float(hgAnalyticCosTheta(x * x, g));
+        }
+
+        for (uint32_t col = 0; col < HG_TABLE_COS_RESOLUTION; col++)
+        {
+            double x = double(col) / double(HG_TABLE_COS_RESOLUTION - 1);
+            double x2 = x * x;
+            table[HG_TABLE_EVAL_OFFSET + row * HG_TABLE_COS_RESOLUTION + col] = float(hgAnalyticPhaseFunc(1.0 - 2.0 * x2 * x2, g));
+        }
+    }
+}
+
+struct HgTableError
+{
+    float maxCosThetaAbsError;
+    float maxPhaseRelativeError;
+};
+
+// Compares the table against the closed forms on a samplesPerAxis x samplesPerAxis grid over g in [-HG_TABLE_G_MAX, HG_TABLE_G_MAX].
+inline HgTableError hgTableMeasureError(const float* table, uint32_t samplesPerAxis)
+{
+    HgTableError error = { 0.0f, 0.0f };
+
+    for (uint32_t gIndex = 0; gIndex < samplesPerAxis; gIndex++)
+    {
+        double g = (2.0 * gIndex / (samplesPerAxis - 1) - 1.0) * HG_TABLE_G_MAX;
+
+        for (uint32_t i = 0; i < samplesPerAxis; i++)
+        {
+            double v = double(i) / (samplesPerAxis - 1);
+
+            double cosError = std::abs(hgTableSampleCosTheta(table, float(v), float(g)) - hgAnalyticCosTheta(v, g));
+
+            double cosTheta = 2.0 * v - 1.0;
+            double phase = hgAnalyticPhaseFunc(cosTheta, g);
+            double phaseError = std::abs(hgTablePhaseFunc(table, float(cosTheta), float(g)) - phase) / phase;
+
+            error.maxCosThetaAbsError = std::max(error.maxCosThetaAbsError, float(cosError));
+            error.maxPhaseRelativeError = std::max(error.maxPhaseRelativeError, float(phaseError));
+        }
+    }
+
+    return error;
+}
+
+#endif
+
+#endif // HENYEYGREENSTEINTABLE_H
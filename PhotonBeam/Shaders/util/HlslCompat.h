@@ -4,7 +4,7 @@
 #ifndef HLSLCOMPAT_H
 #define HLSLCOMPAT_H
 
-typedef uint3 XMUINT2;
+typedef uint2 XMUINT2;
 typedef uint3 XMUINT3;
 typedef uint4 XMUINT4;
 
@@ -0,0 +1,78 @@
+/*
+
+Media table of the participating media, shared by the glTF import and the c++ code.
+
+	index 0        the air of the push constants, airScatterCoff, airExtinctCoff and airHGAssymFactor
+	index 1 + i    medium i of GltfScene::GetMedia(), a KHR_materials_volume material
+
+PhotonBeam::mediaIndex is the medium the beam runs through. A beam stays in one medium, the emission ends it where the
+traced ray crosses into another one. PackedBeam.h keeps 8 bits of the index.
+
+Only the CPU reference, Cpu-Reference/MediaTable.hpp, emits and gathers through the table. The shaders do not bind it:
+BeamClosestHit.hlsl has no transmission, so a GPU beam never enters a volume mesh, BeamGen.hlsl writes mediaIndex 0 and
+the gather takes the air from the push constants.
+
+A material bounds a medium only when it has a thickness and some transmission, a thin walled or an opaque surface
+encloses no volume the light can enter.
+
+A KHR_materials_volume material absorbs with
+	sigma_a = -log(attenuationColor) / attenuationDistance
+and scatters with the albedo and the anisotropy of KHR_materials_volume_scatter, its multiscatterColor taken as the
+single scattering albedo
+	sigma_t = sigma_a / (1 - albedo),  sigma_s = sigma_t - sigma_a
+A material without it only absorbs, the default attenuationDistance of infinity is a clear medium.
+
+*/
+
+#ifndef MEDIATABLE_H
+#define MEDIATABLE_H
+
+#include "../RaytracingHlslCompat.h"
+#include "FastMath.h"
+#include "PackedBeam.h"
+
+#define MEDIA_TABLE_AIR_INDEX 0
+#define MEDIA_TABLE_MAX_SIZE (PACKED_BEAM_MAX_MEDIA_INDEX + 1)
+
+// albedos closer to 1 are clamped, the extinction of a pure scatterer is not given by its absorption
+#define MEDIA_TABLE_MAX_ALBEDO 0.999f
+
+
+COMPAT_INLINE bool isVolumeMaterial(float thicknessFactor, float transmissionFactor)
+{
+    return thicknessFactor > 0.0f && transmissionFactor > 0.0f;
+}
+
+COMPAT_INLINE ParticipatingMedium makeAirMedium(XMFLOAT3 airScatterCoff, XMFLOAT3 airExtinctCoff, float airHGAssymFactor)
+{
+    ParticipatingMedium medium;
+    medium.scatterCoff = airScatterCoff;
+    medium.hgAssymFactor = airHGAssymFactor;
+    medium.extinctCoff = airExtinctCoff;
+    medium.padding = 0;
+    return medium;
+}
+
+COMPAT_INLINE float getVolumeExtinctCoff(float attenuation, float attenuationDistance, float albedo, COMPAT_OUT(float) scatterCoff)
+{
+    const float clampedAttenuation = attenuation < 1.0f ? (attenuation > 1e-30f ? attenuation : 1e-30f) : 1.0f;
+    const float absorptionCoff = -preciseLog(clampedAttenuation) / attenuationDistance;
+    const float clampedAlbedo = albedo < MEDIA_TABLE_MAX_ALBEDO ? (albedo > 0.0f ? albedo : 0.0f) : MEDIA_TABLE_MAX_ALBEDO;
+
+    const float extinctCoff = absorptionCoff / (1.0f - clampedAlbedo);
+    scatterCoff = extinctCoff - absorptionCoff;
+    return extinctCoff;
+}
+
+COMPAT_INLINE ParticipatingMedium makeVolumeMedium(XMFLOAT3 attenuationColor, float attenuationDistance, XMFLOAT3 scatterAlbedo, float hgAssymFactor)
+{
+    ParticipatingMedium medium;
+    medium.extinctCoff.x = getVolumeExtinctCoff(attenuationColor.x, attenuationDistance, scatterAlbedo.x, medium.scatterCoff.x);
+    medium.extinctCoff.y = getVolumeExtinctCoff(attenuationColor.y, attenuationDistance, scatterAlbedo.y, medium.scatterCoff.y);
+    medium.extinctCoff.z = getVolumeExtinctCoff(attenuationColor.z, attenuationDistance, scatterAlbedo.z, medium.scatterCoff.z);
+    medium.hgAssymFactor = hgAssymFactor;
+    medium.padding = 0;
+    return medium;
+}
+
+#endif // MEDIATABLE_H
@@ -0,0 +1,196 @@
+/*
+
+Packing of PhotonBeam into the 32 byte PackedPhotonBeam, shared by the HLSL shaders and c++ code.
+
+	startPos               3 x float
+	octDirection           octahedral unit direction, 2 x snorm16
+	length                 float, endPos = startPos + direction * length
+	lightColorRGB9E5       RGB9E5 shared exponent color, the layout of DXGI_FORMAT_R9G9B9E5_SHAREDEXP
+	hitInstanceAndMedia    hitInstanceID : 24, mediaIndex : 8
+	radius                 float, the radius of util/BeamFootprint.h
+
+Error of a round trip, measured by RunBeamLayoutBenchmark() in Cpu-Reference/BeamLayoutBenchmark.hpp
+	direction      below 7e-5 rad (16 bit octahedral)
+	endPos         direction error * length, plus the float rounding of startPos + direction * length
+	lightColor     channel error at most 2^-9 of the largest channel, channels over 65408 are clamped
+	hitInstanceID  exact in [-2^23, 2^23), -1 stays -1
+	mediaIndex     exact in [0, 255]
+	radius         exact
+
+*/
+
+#ifndef PACKEDBEAM_H
+#define PACKEDBEAM_H
+
+#include "../RaytracingHlslCompat.h"
+#include "FastMath.h"
+
+#define PACKED_BEAM_RGB9E5_MAX_VALUE 65408.0f
+#define PACKED_BEAM_MAX_MEDIA_INDEX 0xFF
+
+
+COMPAT_INLINE float packedBeamAbs(float x)
+{
+    return x >= 0.0f ? x : -x;
+}
+
+COMPAT_INLINE float packedBeamSignNotZero(float x)
+{
+    return x >= 0.0f ? 1.0f : -1.0f;
+}
+
+// rounds half away from zero, [-1, 1] to [-32767, 32767]
+COMPAT_INLINE uint32_t packSnorm16(float x)
+{
+    x = x < -1.0f ? -1.0f : (x > 1.0f ? 1.0f : x);
+    return uint32_t(int32_t(x * 32767.0f + (x >= 0.0f ? 0.5f : -0.5f))) & 0xFFFF;
+}
+
+COMPAT_INLINE float unpackSnorm16(uint32_t x)
+{
+    float value = float(int32_t(x << 16) >> 16) / 32767.0f;
+    return value < -1.0f ? -1.0f : value;
+}
+
+// unit direction to the octahedron folded on the z >= 0 half, x in the low 16 bits
+COMPAT_INLINE uint32_t packOctahedralDirection(XMFLOAT3 direction)
+{
+    float l1 = packedBeamAbs(direction.x) + packedBeamAbs(direction.y) + packedBeamAbs(direction.z);
+    float invL1 = l1 > 0.0f ? 1.0f / l1 : 0.0f;
+
+    float u = direction.x * invL1;
+    float v = direction.y * invL1;
+
+    if (direction.z < 0.0f)
+    {
+        float foldedU = (1.0f - packedBeamAbs(v)) * packedBeamSignNotZero(u);
+        float foldedV = (1.0f - packedBeamAbs(u)) * packedBeamSignNotZero(v);
+        u = foldedU;
+        v = foldedV;
+    }
+
+    return packSnorm16(u) | (packSnorm16(v) << 16);
+}
+
+COMPAT_INLINE XMFLOAT3 unpackOctahedralDirection(uint32_t octDirection)
+{
+    float u = unpackSnorm16(octDirection);
+    float v = unpackSnorm16(octDirection >> 16);
+
+    XMFLOAT3 direction;
+    direction.z = 1.0f - packedBeamAbs(u) - packedBeamAbs(v);
+
+    if (direction.z < 0.0f)
+    {
+        direction.x = (1.0f - packedBeamAbs(v)) * packedBeamSignNotZero(u);
+        direction.y = (1.0f - packedBeamAbs(u)) * packedBeamSignNotZero(v);
+    }
+    else
+    {
+        direction.x = u;
+        direction.y = v;
+    }
+
+    float invLength = preciseRsqrt(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+    direction.x *= invLength;
+    direction.y *= invLength;
+    direction.z *= invLength;
+    return direction;
+}
+
+// Shared exponent color, 9 bit mantissas and a 5 bit exponent biased by 15.
+// Negative and NaN channels are stored as 0, the largest channel rounds to nearest.
+COMPAT_INLINE uint32_t packRGB9E5(XMFLOAT3 color)
+{
+    float r = color.x > 0.0f ? (color.x < PACKED_BEAM_RGB9E5_MAX_VALUE ? color.x : PACKED_BEAM_RGB9E5_MAX_VALUE) : 0.0f;
+    float g = color.y > 0.0f ? (color.y < PACKED_BEAM_RGB9E5_MAX_VALUE ? color.y : PACKED_BEAM_RGB9E5_MAX_VALUE) : 0.0f;
+    float b = color.z > 0.0f ? (color.z < PACKED_BEAM_RGB9E5_MAX_VALUE ? color.z : PACKED_BEAM_RGB9E5_MAX_VALUE) : 0.0f;
+
+    float maxChannel = r > g ? r : g;
+    maxChannel = maxChannel > b ? maxChannel : b;
+
+    // floor(log2(maxChannel)) from the float exponent, at least -16
+    int32_t exponent = int32_t((fastMathAsUint(maxChannel) >> 23) & 0xFF) - 127;
+    exponent = exponent > -16 ? exponent : -16;
+
+    int32_t sharedExponent = exponent + 1 + 15;
+
+    // 2^-(sharedExponent - 15 - 9)
+    float scale = fastMathAsFloat(uint32_t(127 - (sharedExponent - 24)) << 23);
+
+    // rounding the largest channel up to 512 needs the next exponent
+    if (uint32_t(maxChannel * scale + 0.5f) == 512)
+    {
+        sharedExponent += 1;
+        scale *= 0.5f;
+    }
+
+    uint32_t rm = uint32_t(r * scale + 0.5f);
+    uint32_t gm = uint32_t(g * scale + 0.5f);
+    uint32_t bm = uint32_t(b * scale + 0.5f);
+
+    return rm | (gm << 9) | (bm << 18) | (uint32_t(sharedExponent) << 27);
+}
+
+COMPAT_INLINE XMFLOAT3 unpackRGB9E5(uint32_t rgb9e5)
+{
+    // 2^(sharedExponent - 15 - 9)
+    float scale = fastMathAsFloat(uint32_t(int32_t(rgb9e5 >> 27) - 24 + 127) << 23);
+
+    XMFLOAT3 color;
+    color.x = float(rgb9e5 & 0x1FF) * scale;
+    color.y = float((rgb9e5 >> 9) & 0x1FF) * scale;
+    color.z = float((rgb9e5 >> 18) & 0x1FF) * scale;
+    return color;
+}
+
+COMPAT_INLINE uint32_t packBeamHitInstanceAndMedia(int32_t hitInstanceID, uint32_t mediaIndex)
+{
+    return (uint32_t(hitInstanceID) & 0x00FFFFFF) | ((mediaIndex & PACKED_BEAM_MAX_MEDIA_INDEX) << 24);
+}
+
+// sign extended, so an id of -1 stays -1
+COMPAT_INLINE int32_t unpackBeamHitInstanceID(uint32_t hitInstanceAndMedia)
+{
+    return int32_t(hitInstanceAndMedia << 8) >> 8;
+}
+
+COMPAT_INLINE uint32_t unpackBeamMediaIndex(uint32_t hitInstanceAndMedia)
+{
+    return hitInstanceAndMedia >> 24;
+}
+
+COMPAT_INLINE PackedPhotonBeam packPhotonBeam(PhotonBeam beam)
+{
+    XMFLOAT3 beamVec;
+    beamVec.x = beam.endPos.x - beam.startPos.x;
+    beamVec.y = beam.endPos.y - beam.startPos.y;
+    beamVec.z = beam.endPos.z - beam.startPos.z;
+
+    PackedPhotonBeam packed;
+    packed.startPos = beam.startPos;
+    packed.octDirection = packOctahedralDirection(beamVec);
+    packed.length = preciseSqrt(beamVec.x * beamVec.x + beamVec.y * beamVec.y + beamVec.z * beamVec.z);
+    packed.lightColorRGB9E5 = packRGB9E5(beam.lightColor);
+    packed.hitInstanceAndMedia = packBeamHitInstanceAndMedia(beam.hitInstanceID, beam.mediaIndex);
+    packed.radius = beam.radius;
+    return packed;
+}
+
+COMPAT_INLINE PhotonBeam unpackPhotonBeam(PackedPhotonBeam packed)
+{
+    XMFLOAT3 direction = unpackOctahedralDirection(packed.octDirection);
+
+    PhotonBeam beam;
+    beam.startPos = packed.startPos;
+    beam.endPos.x = packed.startPos.x + direction.x * packed.length;
+    beam.endPos.y = packed.startPos.y + direction.y * packed.length;
+    beam.endPos.z = packed.startPos.z + direction.z * packed.length;
+    beam.mediaIndex = unpackBeamMediaIndex(packed.hitInstanceAndMedia);
+    beam.radius = packed.radius;
+    beam.lightColor = unpackRGB9E5(packed.lightColorRGB9E5);
+    beam.hitInstanceID = unpackBeamHitInstanceID(packed.hitInstanceAndMedia);
+    return beam;
+}
+
+#endif // PACKEDBEAM_H
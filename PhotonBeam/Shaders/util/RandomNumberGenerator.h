@@ -0,0 +1,239 @@
+/*
+
+Random number generators shared by the HLSL shaders and c++ code.
+Include this file after RaytracingHlslCompat.h, or include it alone(it includes the compat header).
+
+The generator used by rnd() is selected at compile time with PHOTONBEAM_RNG.
+Define it before including this file to override the default.
+
+	PHOTONBEAM_RNG_LCG     tea seeding + 24 bit Numerical Recipes LCG (the original generator)
+	PHOTONBEAM_RNG_PCG     PCG hash seeding + PCG-RXS-M-XS 32 bit stream
+	PHOTONBEAM_RNG_PHILOX  Philox4x32 seeding + Philox4x32 counter stream
+
+Every generator keeps its state in a single 32 bit uint, so payloads and the sampling functions do not change.
+
+Approximate integer op count per call, Cpu-Reference/RngBenchmark measures the cost of the CPU ports
+	                     seeding     per rnd()
+	LCG                  ~230(tea)   2
+	PCG                  ~12         7
+	PHILOX(10 rounds)    ~70         ~70
+
+*/
+
+#ifndef RANDOMNUMBERGENERATOR_H
+#define RANDOMNUMBERGENERATOR_H
+
+#include "../RaytracingHlslCompat.h"
+
+#define PHOTONBEAM_RNG_LCG 0
+#define PHOTONBEAM_RNG_PCG 1
+#define PHOTONBEAM_RNG_PHILOX 2
+
+#ifndef PHOTONBEAM_RNG
+#define PHOTONBEAM_RNG PHOTONBEAM_RNG_PCG
+#endif
+
+// Philox4x32-10 is the recommended variant, 7 rounds is the smallest number of rounds passing BigCrush.
+#ifndef PHOTONBEAM_PHILOX_ROUNDS
+#define PHOTONBEAM_PHILOX_ROUNDS 10
+#endif
+
+
+COMPAT_INLINE uint32_t tea(uint32_t val0, uint32_t val1)
+{
+    uint32_t v0 = val0;
+    uint32_t v1 = val1;
+    uint32_t s0 = 0;
+
+    for (uint32_t n = 0; n < 16; n++)
+    {
+        s0 += 0x9e3779b9;
+        v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
+        v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
+    }
+
+    return v0;
+}
+
+// Generate a random unsigned int in [0, 2^24) given the previous RNG state
+// using the Numerical Recipes linear congruential generator
+COMPAT_INLINE uint32_t lcg(COMPAT_INOUT(uint32_t) prev)
+{
+    const uint32_t LCG_A = 1664525u;
+    const uint32_t LCG_C = 1013904223u;
+    prev = (LCG_A * prev + LCG_C);
+    return prev & 0x00FFFFFF;
+}
+
+
+// output permutation of PCG-RXS-M-XS 32/32
+COMPAT_INLINE uint32_t pcgPermute(uint32_t state)
+{
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// one LCG step followed by the output permutation.
+// Jarzynski and Olano, Hash Functions for GPU Rendering(2020)
+COMPAT_INLINE uint32_t pcgHash(uint32_t val)
+{
+    return pcgPermute(val * 747796405u + 2891336453u);
+}
+
+// Generate a random unsigned int in [0, 2^32) and advance the PCG state
+COMPAT_INLINE uint32_t pcg32(COMPAT_INOUT(uint32_t) state)
+{
+    state = state * 747796405u + 2891336453u;
+    return pcgPermute(state);
+}
+
+
+// Salmon et al., Parallel Random Numbers: As Easy as 1, 2, 3(2011)
+COMPAT_INLINE XMUINT4 philox4x32(XMUINT4 counter, XMUINT2 key)
+{
+    const uint32_t PHILOX_M0 = 0xD2511F53u;
+    const uint32_t PHILOX_M1 = 0xCD9E8D57u;
+    const uint32_t PHILOX_W0 = 0x9E3779B9u;
+    const uint32_t PHILOX_W1 = 0xBB67AE85u;
+
+    for (uint32_t n = 0; n < PHOTONBEAM_PHILOX_ROUNDS; n++)
+    {
+        uint64_t product0 = uint64_t(PHILOX_M0) * counter.x;
+        uint64_t product1 = uint64_t(PHILOX_M1) * counter.z;
+
+        XMUINT4 next;
+        next.x = uint32_t(product1 >> 32) ^ counter.y ^ key.x;
+        next.y = uint32_t(product1);
+        next.z = uint32_t(product0 >> 32) ^ counter.w ^ key.y;
+        next.w = uint32_t(product0);
+        counter = next;
+
+        key.x += PHILOX_W0;
+        key.y += PHILOX_W1;
+    }
+
+    return counter;
+}
+
+// Generate a random unsigned int in [0, 2^32) and advance the counter stored in the state.
+// The key is fixed, the per launch stream comes from the seeded counter value.
+COMPAT_INLINE uint32_t philoxStream(COMPAT_INOUT(uint32_t) state)
+{
+    XMUINT4 counter;
+    counter.x = state;
+    counter.y = 0x5851F42Du;
+    counter.z = 0;
+    counter.w = 0;
+
+    XMUINT2 key;
+    key.x = 0xA511E9B3u;
+    key.y = 0x63D83595u;
+
+    state += 1;
+    return philox4x32(counter, key).x;
+}
+
+
+// Initial states of the generators for a launch index and a frame seed, rngInitSeed() picks one of them
+COMPAT_INLINE uint32_t lcgInitSeed(uint32_t launchIndex, uint32_t frameSeed)
+{
+    return tea(launchIndex, frameSeed);
+}
+
+COMPAT_INLINE uint32_t pcgInitSeed(uint32_t launchIndex, uint32_t frameSeed)
+{
+    return pcgHash(launchIndex + pcgHash(frameSeed));
+}
+
+COMPAT_INLINE uint32_t philoxInitSeed(uint32_t launchIndex, uint32_t frameSeed)
+{
+    XMUINT4 counter;
+    counter.x = launchIndex;
+    counter.y = frameSeed;
+    counter.z = 0;
+    counter.w = 0;
+
+    XMUINT2 key;
+    key.x = 0x2F6B6DB1u;
+    key.y = 0x8E5FC4D7u;
+
+    return philox4x32(counter, key).x;
+}
+
+// Initial state of the random number stream for a launch index and a frame seed.
+// Different frame seeds must give independent streams for the same launch index,
+// because the shaders interpolate between the streams of seed and seed + 1.
+COMPAT_INLINE uint32_t rngInitSeed(uint32_t launchIndex, uint32_t frameSeed)
+{
+#if PHOTONBEAM_RNG == PHOTONBEAM_RNG_LCG
+    return lcgInitSeed(launchIndex, frameSeed);
+#elif PHOTONBEAM_RNG == PHOTONBEAM_RNG_PCG
+    return pcgInitSeed(launchIndex, frameSeed);
+#else
+    return philoxInitSeed(launchIndex, frameSeed);
+#endif
+}
+
+// Generate a random unsigned int in [0, 2^24) given the previous RNG state
+COMPAT_INLINE uint32_t rngNext24(COMPAT_INOUT(uint32_t) state)
+{
+#if PHOTONBEAM_RNG == PHOTONBEAM_RNG_LCG
+    return lcg(state);
+#elif PHOTONBEAM_RNG == PHOTONBEAM_RNG_PCG
+    return pcg32(state) >> 8;
+#else
+    return philoxStream(state) >> 8;
+#endif
+}
+
+// Generate a random float in [0, 1) given the previous RNG state
+COMPAT_INLINE float rnd(COMPAT_INOUT(uint32_t) prev)
+{
+    return (float(rngNext24(prev)) / float(0x01000000));
+}
+
+
+#ifdef __cplusplus
+
+#include <stddef.h>
+
+// Hook for statistical test suites(PractRand, TestU01, ...).
+// Writes the 24 bits consumed by rnd() as 3 bytes per call.
+// The streams of streamCount consecutive launch indices are interleaved,
+// which is the order the GPU threads consume them, so correlation between neighbouring launches shows up in the test.
+inline void rngFillTestBytes(
+    uint32_t frameSeed,
+    uint32_t firstLaunchIndex,
+    uint32_t streamCount,
+    uint8_t* out,
+    size_t numBytes
+)
+{
+    const uint32_t maxStreams = 64;
+    uint32_t states[maxStreams];
+
+    if (streamCount < 1)
+        streamCount = 1;
+    if (streamCount > maxStreams)
+        streamCount = maxStreams;
+
+    for (uint32_t i = 0; i < streamCount; i++)
+        states[i] = rngInitSeed(firstLaunchIndex + i, frameSeed);
+
+    size_t written = 0;
+    uint32_t streamIndex = 0;
+    while (written < numBytes)
+    {
+        uint32_t value = rngNext24(states[streamIndex]);
+        streamIndex = (streamIndex + 1) % streamCount;
+
+        for (uint32_t byteIndex = 0; byteIndex < 3 && written < numBytes; byteIndex++)
+        {
+            out[written++] = uint8_t(value >> (byteIndex * 8));
+        }
+    }
+}
+
+#endif
+
+#endif // RANDOMNUMBERGENERATOR_H
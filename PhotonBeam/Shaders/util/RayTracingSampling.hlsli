@@ -3,37 +3,16 @@
 #ifndef RAYTRACINGSAMPLING_H
 #define RAYTRACINGSAMPLING_H
 
-uint tea(uint val0, uint val1)
-{
-    uint v0 = val0;
-    uint v1 = val1;
-    uint s0 = 0;
-
-    for (uint n = 0; n < 16; n++)
-    {
-        s0 += 0x9e3779b9;
-        v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
-        v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
-    }
-
-    return v0;
-}
+// tea, lcg, rnd and the other generators live in the shared header.
+// Define PHOTONBEAM_RNG before including this file to select the generator used by rnd().
+#include "RandomNumberGenerator.h"
+#include "SobolSampler.h"
 
-// Generate a random unsigned int in [0, 2^24) given the previous RNG state
-// using the Numerical Recipes linear congruential generator
-uint lcg(inout uint prev)
-{
-    const static uint LCG_A = 1664525u;
-    const static uint LCG_C = 1013904223u;
-    prev = (LCG_A * prev + LCG_C);
-    return prev & 0x00FFFFFF;
-}
-
-// Generate a random float in [0, 1) given the previous RNG state
-float rnd(inout uint prev)
-{
-    return (float(lcg(prev)) / float(0x01000000));
-}
+// 1: GGX reflections sample the distribution of visible normals(Heitz 2018)
+// 0: GGX reflections sample the full normal distribution, more samples are reflected below the surface
+#ifndef PHOTONBEAM_GGX_VNDF
+#define PHOTONBEAM_GGX_VNDF 1
+#endif
 
 
 //-------------------------------------------------------------------------------------------------
@@ -57,11 +36,12 @@ float3 samplingHemisphere(inout uint seed, in float3 x, in float3 y, in float3 z
     return direction;
 }
 
-float3 uniformSamplingSphere(inout uint seed)
+// uv is a point in [0, 1)^2, either from rnd() or from a low discrepancy sampler
+float3 uniformSamplingSphereFromUV(float2 uv)
 {
 
-    float r1 = rnd(seed);
-    float r2 = rnd(seed) * 2 - 1;
+    float r1 = uv.x;
+    float r2 = uv.y * 2 - 1;
     float sq = sqrt(1.0 - r2 * r2);
 
     float3 direction = float3(cos(2 * M_PI * r1) * sq, sin(2 * M_PI * r1) * sq, r2);
@@ -69,6 +49,14 @@ float3 uniformSamplingSphere(inout uint seed)
     return direction;
 }
 
+float3 uniformSamplingSphere(inout uint seed)
+{
+    float r1 = rnd(seed);
+    float r2 = rnd(seed);
+
+    return uniformSamplingSphereFromUV(float2(r1, r2));
+}
+
 // Return the tangent and binormal from the incoming normal
 void createCoordinateSystem(in float3 N, out float3 Nt, out float3 Nb)
 {
@@ -98,11 +86,29 @@ float heneyGreenPhaseFunc(float cosTheta, float g)
     return (1 - g2) / (denom * sqrt(denom)) / (4 * M_PI);
 }
 
+// scattered direction for a sampled cos theta, the azimuth is 2 pi * phiU
 // normal is incoming ray direction start from the light source 
-float3 heneyGreenPhaseFuncSampling(inout uint seed, in float3 normal, float g)
+float3 heneyGreenDirectionFromCosTheta(float cos_theta, float phiU, in float3 normal)
 {
-    float r1 = rnd(seed);
-    float r2 = rnd(seed);
+    // the closed form of the sampled cos theta can be off by one ulp past +-1
+    float sin_theta = sqrt(max(0.0, 1.0 - cos_theta * cos_theta));
+    float phi = 2.0f * M_PI * phiU;
+
+    float3 ret = float3(sin_theta * cos(phi), cos_theta, sin_theta * sin(phi));
+
+    float3 tangent, bitangent;
+    createCoordinateSystem(normal, tangent, bitangent);
+    ret = ret.x * bitangent + ret.y * normal + ret.z * tangent;
+
+    // normalize at last step in order to avoid some floating point error;
+    return normalize(ret);
+}
+
+// normal is incoming ray direction start from the light source 
+float3 heneyGreenPhaseFuncSamplingFromUV(float2 uv, in float3 normal, float g)
+{
+    float r1 = uv.x;
+    float r2 = uv.y;
 
     float g2 = g * g;
     float g3 = g2 * g;
@@ -124,17 +130,16 @@ float3 heneyGreenPhaseFuncSampling(inout uint seed, in float3 normal, float g)
     // cos theta == 1 -> front scattering, result direction is exactly same as the incoming light direction(direction start from the light source)
     // cos theta == -1 -> back ward scattering, result direction is opposite of the incoming light direction(direction start from the light source)
     float cos_theta = numerator / denom;
-    float sin_theta = sqrt(1.0 - cos_theta * cos_theta);
-    float phi = 2.0f * M_PI * r2;
 
-    float3 ret = float3(sin_theta * cos(phi), cos_theta, sin_theta * sin(phi));
+    return heneyGreenDirectionFromCosTheta(cos_theta, r2, normal);
+}
 
-    float3 tangent, bitangent;
-    createCoordinateSystem(normal, tangent, bitangent);
-    ret = ret.x * bitangent + ret.y * normal + ret.z * tangent;
+float3 heneyGreenPhaseFuncSampling(inout uint seed, in float3 normal, float g)
+{
+    float r1 = rnd(seed);
+    float r2 = rnd(seed);
 
-    // normalize at last step in order to avoid some floating point error;
-    return normalize(ret);
+    return heneyGreenPhaseFuncSamplingFromUV(float2(r1, r2), normal, g);
 }
 
 // PDF for half vector
@@ -150,18 +155,25 @@ float microfacetPDF(float nDotH, float roughness)
     return a2 / denom;
 }
 
+// GGX distribution of the glTF roughness. The samplers and the Smith terms take alpha = roughness^2,
+// the BRDF and the weights of the samples evaluate D with the same alpha
+float ggxDistribution(float nDotH, float roughness)
+{
+    return microfacetPDF(nDotH, roughness * roughness);
+}
+
 // https://schuttejoe.github.io/post/ggximportancesamplingpart1/
 // https://agraphicsguy.wordpress.com/2015/11/01/sampling-microfacet-brdf/
 // incomiing LightDir is direction start from light source and goes toward the point of the interaction.
-float3 microfacetReflectedLightSampling(
-    inout uint seed, 
+float3 microfacetReflectedLightSamplingFromUV(
+    float2 uv, 
     in float3 incomingLightDir, 
     in float3 normal, 
     float roughness
 )
 {
-    float r1 = rnd(seed);
-    float r2 = rnd(seed);
+    float r1 = uv.x;
+    float r2 = uv.y;
 
     float a = roughness * roughness;
     float theta = atan(a * sqrt(r1 / (1 - r1)));
@@ -178,6 +190,104 @@ float3 microfacetReflectedLightSampling(
     return normalize(incomingLightDir - 2 * dot(halfVec, incomingLightDir) * halfVec);
 }
 
+float3 microfacetReflectedLightSampling(
+    inout uint seed, 
+    in float3 incomingLightDir, 
+    in float3 normal, 
+    float roughness
+)
+{
+    float r1 = rnd(seed);
+    float r2 = rnd(seed);
+
+    return microfacetReflectedLightSamplingFromUV(float2(r1, r2), incomingLightDir, normal, roughness);
+}
+
+// Eric Heitz, Sampling the GGX Distribution of Visible Normals(2018)
+// Only half vectors visible from the incoming light direction are sampled, 
+// so far fewer reflected directions go below the surface than with microfacetReflectedLightSampling.
+// incomiing LightDir is direction start from light source and goes toward the point of the interaction.
+float3 microfacetVisibleNormalSamplingFromUV(
+    float2 uv, 
+    in float3 incomingLightDir, 
+    in float3 normal, 
+    float roughness
+)
+{
+    float a = roughness * roughness;
+
+    float3 tangent, bitangent;
+    createCoordinateSystem(normal, tangent, bitangent);
+
+    // direction toward the light in the local frame, z is the normal
+    float3 toLight = -incomingLightDir;
+    float3 localV = float3(dot(toLight, bitangent), dot(toLight, tangent), dot(toLight, normal));
+
+    // stretch to the hemisphere configuration
+    float3 stretchedV = normalize(float3(a * localV.x, a * localV.y, localV.z));
+
+    float lenSq = stretchedV.x * stretchedV.x + stretchedV.y * stretchedV.y;
+    float3 t1 = lenSq > 0 ? float3(-stretchedV.y, stretchedV.x, 0) / sqrt(lenSq) : float3(1, 0, 0);
+    float3 t2 = cross(stretchedV, t1);
+
+    // point on the projected disk, squeezed to the visible half
+    float r = sqrt(uv.x);
+    float phi = 2 * M_PI * uv.y;
+    float p1 = r * cos(phi);
+    float p2 = r * sin(phi);
+    float s = 0.5 * (1.0 + stretchedV.z);
+    p2 = (1.0 - s) * sqrt(1.0 - p1 * p1) + s * p2;
+
+    float3 stretchedH = p1 * t1 + p2 * t2 + sqrt(max(0.0, 1.0 - p1 * p1 - p2 * p2)) * stretchedV;
+    float3 localH = normalize(float3(a * stretchedH.x, a * stretchedH.y, max(0.0, stretchedH.z)));
+
+    float3 halfVec = localH.x * bitangent + localH.y * tangent + localH.z * normal;
+
+    // normalize at last step in order to avoid some floating point error;
+    return normalize(incomingLightDir - 2 * dot(halfVec, incomingLightDir) * halfVec);
+}
+
+float3 microfacetVisibleNormalSampling(
+    inout uint seed, 
+    in float3 incomingLightDir, 
+    in float3 normal, 
+    float roughness
+)
+{
+    float r1 = rnd(seed);
+    float r2 = rnd(seed);
+
+    return microfacetVisibleNormalSamplingFromUV(float2(r1, r2), incomingLightDir, normal, roughness);
+}
+
+// reflected light sampling selected by PHOTONBEAM_GGX_VNDF
+float3 reflectedLightSamplingFromUV(
+    float2 uv, 
+    in float3 incomingLightDir, 
+    in float3 normal, 
+    float roughness
+)
+{
+#if PHOTONBEAM_GGX_VNDF
+    return microfacetVisibleNormalSamplingFromUV(uv, incomingLightDir, normal, roughness);
+#else
+    return microfacetReflectedLightSamplingFromUV(uv, incomingLightDir, normal, roughness);
+#endif
+}
+
+float3 reflectedLightSampling(
+    inout uint seed, 
+    in float3 incomingLightDir, 
+    in float3 normal, 
+    float roughness
+)
+{
+    float r1 = rnd(seed);
+    float r2 = rnd(seed);
+
+    return reflectedLightSamplingFromUV(float2(r1, r2), incomingLightDir, normal, roughness);
+}
+
 // both incoming light and reflected light directions start from the point of the reflection
 float3 gltfBrdf(
     in float3 incomingLightDir, 
@@ -205,7 +315,7 @@ float3 gltfBrdf(
     // roughness = 0.0 and nDotH = 1.0 -> microfacetPDF = inf
     if (roughness > 0.0 || nDotH < 0.9999)
     {
-        dVal = microfacetPDF(nDotH, roughness);
+        dVal = ggxDistribution(nDotH, roughness);
     }
     // I am actually not sure what to do in this case
     // For now just get microfacetPDF(1.0, 0.000001)
@@ -257,7 +367,7 @@ float3 pdfWeightedGltfBrdf(
     // roughness = 0.0, nDotH = 1.0 -> microfacetPDF = inf -> f_diffuse = 0
     if ((roughness > 0.0 || nDotH < 0.999) && hDotL > 0.0)
     {
-        f_diffuse = (1.0 - frsnel) / M_PI * c_diff / microfacetPDF(nDotH, roughness);
+        f_diffuse = (1.0 - frsnel) / M_PI * c_diff / ggxDistribution(nDotH, roughness);
     }
 
     float gVal = 0.0;
@@ -276,4 +386,86 @@ float3 pdfWeightedGltfBrdf(
     return f_specular + f_diffuse;
 }
 
+// Smith masking function of GGX for one direction, a2 is alpha^2
+float smithG1(float nDotV, float a2)
+{
+    nDotV = abs(nDotV);
+    return 2 * nDotV / (nDotV + sqrt(a2 + (1 - a2) * nDotV * nDotV));
+}
+
+// gltfBRDF value divided by the pdf of microfacetVisibleNormalSampling
+// incomingLightDir is the direction the sample was drawn for, reflectedLightDir is the sampled direction
+// both directions start from the point of the reflection
+float3 pdfWeightedGltfBrdfVisibleNormal(
+    in float3 incomingLightDir, 
+    in float3 reflectedLightDir, 
+    in float3 normal, 
+    in float3 baseColor, 
+    float roughness, 
+    float metallic
+)
+{
+    float a2 = pow(roughness, 4.0);
+    float3  halfVec = normalize(incomingLightDir + reflectedLightDir);
+    float nDotH = dot(normal, halfVec);
+    float nDotL = dot(normal, incomingLightDir);
+    float vDotH = dot(reflectedLightDir, halfVec);
+    float hDotL = dot(incomingLightDir, halfVec);
+    float vDotN = dot(reflectedLightDir, normal);
+
+    float3 c_diff = (1.0 - metallic) * baseColor;
+    float3 f0 = 0.04 * (1 - metallic) + baseColor * metallic;
+    float3 frsnel = f0 + (1 - f0) * pow(1 - abs(vDotH), 5);
+
+    // pdf of the reflected direction is G1(l) * D(h) / (4 * nDotL)
+    float g1 = smithG1(nDotL, a2);
+    if (g1 <= 0.0 || hDotL <= 0.0)
+    {
+        return float3(0.0, 0.0, 0.0);
+    }
+
+    float3 f_diffuse = float3(0.0, 0.0, 0.0);
+
+    // roughness = 0.0, nDotH = 1.0 -> D = inf -> f_diffuse = 0
+    if (roughness > 0.0 || nDotH < 0.999)
+    {
+        float dVal = ggxDistribution(nDotH, roughness);
+        f_diffuse = (1.0 - frsnel) / M_PI * c_diff * 4 * abs(nDotL) / (g1 * dVal);
+    }
+
+    float gVal = 0.0;
+    if (vDotH > 0)
+    {
+        float denom1 = sqrt(a2 + (1 - a2) * nDotL * nDotL);
+        denom1 += abs(nDotL);
+
+        float denom2 = sqrt(a2 + (1 - a2) * vDotN * vDotN);
+        denom2 += abs(vDotN);
+
+        gVal = 1.0 / (denom1 * denom2);
+    }
+
+    // D cancels out for the specular part
+    float3 f_specular = frsnel * gVal * 4 * abs(nDotL) / g1;
+    return f_specular + f_diffuse;
+}
+
+// pdf weighted BRDF matching reflectedLightSampling
+// incomingLightDir is the direction the sample was drawn for, reflectedLightDir is the sampled direction
+float3 pdfWeightedReflectedLightBrdf(
+    in float3 incomingLightDir, 
+    in float3 reflectedLightDir, 
+    in float3 normal, 
+    in float3 baseColor, 
+    float roughness, 
+    float metallic
+)
+{
+#if PHOTONBEAM_GGX_VNDF
+    return pdfWeightedGltfBrdfVisibleNormal(incomingLightDir, reflectedLightDir, normal, baseColor, roughness, metallic);
+#else
+    return pdfWeightedGltfBrdf(incomingLightDir, reflectedLightDir, normal, baseColor, roughness, metallic);
+#endif
+}
+
 #endif // RAYTRACINGSAMPLING_H
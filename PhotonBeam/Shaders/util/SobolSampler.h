@@ -0,0 +1,98 @@
+/*
+
+Owen-scrambled Sobol sampler shared by the HLSL shaders and c++ code.
+Brent Burley, Practical Hash-based Owen Scrambling(2020)
+
+A sample is addressed by (index, dimension pair, seed).
+The index is the launch index, so all launches of a dispatch together form one low discrepancy point set,
+instead of independent random points that clump and leave gaps.
+Each dimension pair uses the first two Sobol dimensions with its own index shuffle and scrambling,
+so dimension pairs are decorrelated from each other without needing higher dimensional direction numbers.
+
+Set PHOTONBEAM_SOBOL_SAMPLING to 1 to use this sampler for the emission, Henyey-Greenstein and GGX directions.
+
+*/
+
+#ifndef SOBOLSAMPLER_H
+#define SOBOLSAMPLER_H
+
+#include "RandomNumberGenerator.h"
+
+#ifndef PHOTONBEAM_SOBOL_SAMPLING
+#define PHOTONBEAM_SOBOL_SAMPLING 0
+#endif
+
+
+COMPAT_INLINE uint32_t reverseBits32(uint32_t x)
+{
+#ifdef __cplusplus
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+#else
+    return reversebits(x);
+#endif
+}
+
+COMPAT_INLINE uint32_t hashCombine(uint32_t seed, uint32_t value)
+{
+    return pcgHash(seed + pcgHash(value));
+}
+
+// hash based approximation of an Owen scramble of bit reversed values
+COMPAT_INLINE uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+COMPAT_INLINE uint32_t nestedUniformScramble(uint32_t x, uint32_t seed)
+{
+    x = reverseBits32(x);
+    x = laineKarrasPermutation(x, seed);
+    x = reverseBits32(x);
+    return x;
+}
+
+// second Sobol dimension. primitive polynomial x + 1, every direction number m_k = 1
+COMPAT_INLINE uint32_t sobolSecondDimension(uint32_t index)
+{
+    uint32_t result = 0;
+    uint32_t direction = 0x80000000u;
+    for (uint32_t bit = 0; bit < 32 && index != 0; bit++)
+    {
+        if ((index & 1u) != 0)
+            result ^= direction;
+
+        index >>= 1;
+        direction ^= direction >> 1;
+    }
+
+    return result;
+}
+
+// 2D point in [0, 1)^2 of the scrambled Sobol sequence
+COMPAT_INLINE XMFLOAT2 sobolSample2D(uint32_t index, uint32_t dimensionPair, uint32_t seed)
+{
+    const uint32_t pairSeed = hashCombine(seed, dimensionPair);
+    const uint32_t shuffledIndex = nestedUniformScramble(index, pairSeed);
+
+    uint32_t x = reverseBits32(shuffledIndex);
+    uint32_t y = sobolSecondDimension(shuffledIndex);
+
+    x = nestedUniformScramble(x, hashCombine(pairSeed, 0));
+    y = nestedUniformScramble(y, hashCombine(pairSeed, 1));
+
+    XMFLOAT2 sample;
+    sample.x = float(x >> 8) / float(0x01000000);
+    sample.y = float(y >> 8) / float(0x01000000);
+    return sample;
+}
+
+#endif // SOBOLSAMPLER_H
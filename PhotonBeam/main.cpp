@@ -1,5 +1,8 @@
 
 #include "PhotonBeamApp.hpp"
+#include "Cpu-Reference/CpuReferenceSuites.hpp"
+
+#include <cstring>
 
 // bellow is required if imgui header files are included in the project
 #pragma comment(lib, "dxgi.lib")
@@ -8,8 +11,18 @@
 // However running on Debug mode works without bellow link
 #pragma comment(lib, "dxguid.lib")
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
+    // --cpu-reference-tests [filter] and --cpu-reference-benchmarks [filter] run the CPU references instead of the app
+    if (argc > 1 && (std::strcmp(argv[1], "--cpu-reference-tests") == 0 || std::strcmp(argv[1], "--cpu-reference-benchmarks") == 0))
+    {
+        bool tests = std::strcmp(argv[1], "--cpu-reference-tests") == 0;
+        std::string filter = argc > 2 ? argv[2] : "";
+
+        auto suites = tests ? CpuReference::CpuReferenceTestSuites() : CpuReference::CpuReferenceBenchmarkSuites();
+        return static_cast<int>(CpuReference::RunCpuReferenceSuites(suites, filter, tests, stdout));
+    }
+
     // Enable run-time memory check for debug builds.
 #if defined(DEBUG) | defined(_DEBUG)
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
@@ -5,6 +5,7 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include "GltfScene.hpp"
+#include "../../Shaders/util/MediaTable.h"
 #include <iostream>
 #include <sstream>
 #include <windows.h>
@@ -23,6 +24,11 @@ const std::vector<GltfMaterial>& GltfScene::GetMaterials()
     return m_materials;
 }
 
+const std::vector<ParticipatingMedium>& GltfScene::GetMedia()
+{
+    return m_media;
+}
+
 const std::vector<GltfNode>& GltfScene::GetNodes()
 {
     return m_nodes;
@@ -108,6 +114,7 @@ void GltfScene::checkRequiredExtensions()
         KHR_MATERIALS_ANISOTROPY_EXTENSION_NAME,
         KHR_MATERIALS_IOR_EXTENSION_NAME,
         KHR_MATERIALS_VOLUME_EXTENSION_NAME,
+        KHR_MATERIALS_VOLUME_SCATTER_EXTENSION_NAME,
         KHR_MATERIALS_TRANSMISSION_EXTENSION_NAME,
         KHR_TEXTURE_BASISU_NAME,
     };
@@ -261,7 +268,29 @@ void GltfScene::importMaterials()
             getTexId(ext, "thicknessTexture", gmat.volume.thicknessTexture);
             getFloat(ext, "attenuationDistance", gmat.volume.attenuationDistance);
             getVec3(ext, "attenuationColor", gmat.volume.attenuationColor);
-        };
+
+            // KHR_materials_volume_scatter
+            if (tmat.extensions.find(KHR_MATERIALS_VOLUME_SCATTER_EXTENSION_NAME) != tmat.extensions.end())
+            {
+                const auto& scatterExt = tmat.extensions.find(KHR_MATERIALS_VOLUME_SCATTER_EXTENSION_NAME)->second;
+                getVec3(scatterExt, "multiscatterColor", gmat.volumeScatter.multiscatterColor);
+                getFloat(scatterExt, "scatterAnisotropy", gmat.volumeScatter.scatterAnisotropy);
+            }
+
+            // a thin walled or an opaque material bounds no volume the light can enter, it keeps mediumIndex -1.
+            // The media table keeps the air at index 0 and PackedBeam.h 8 bits of the index.
+            if (isVolumeMaterial(gmat.volume.thicknessFactor, gmat.transmission.factor))
+            {
+                if (m_media.size() + 1 < MEDIA_TABLE_MAX_SIZE)
+                {
+                    gmat.mediumIndex = int(m_media.size());
+                    m_media.push_back(makeVolumeMedium(gmat.volume.attenuationColor, gmat.volume.attenuationDistance,
+                        gmat.volumeScatter.multiscatterColor, gmat.volumeScatter.scatterAnisotropy));
+                }
+                else
+                    OutputDebugStringA("\n---------------------------------------\n Too many volume materials for the media table \n");
+            }
+        }
 
         // KHR_materials_displacement
         if (tmat.extensions.find(KHR_MATERIALS_DISPLACEMENT_NAME) != tmat.extensions.end())
@@ -838,6 +867,7 @@ void GltfScene::createColors(GltfPrimMesh& resultMesh)
 void GltfScene::destroy()
 {
     m_materials.clear();
+    m_media.clear();
     m_nodes.clear();
     m_primMeshes.clear();
     //m_cameras.clear();
@@ -11,6 +11,7 @@
 #include <tiny-gltf/tiny_gltf.h>
 #include <DirectXMath.h>
 #include "../Common/MathHelper.h"
+#include "../../Shaders/RaytracingHlslCompat.h"
 
 #define KHR_LIGHTS_PUNCTUAL_EXTENSION_NAME "KHR_lights_punctual"
 
@@ -100,6 +101,15 @@ struct KHR_materials_volume
     DirectX::XMFLOAT3 attenuationColor{ 1.f, 1.f, 1.f };
 };
 
+// https://github.com/KhronosGroup/glTF/pull/1726
+// multiscatterColor is taken as the single scattering albedo of the medium, see Shaders/util/MediaTable.h
+#define KHR_MATERIALS_VOLUME_SCATTER_EXTENSION_NAME "KHR_materials_volume_scatter"
+struct KHR_materials_volume_scatter
+{
+    DirectX::XMFLOAT3 multiscatterColor{ 0, 0, 0 };
+    float         scatterAnisotropy{ 0 };
+};
+
 
 // https://github.com/KhronosGroup/glTF/blob/main/extensions/2.0/Khronos/KHR_texture_basisu/README.md
 #define KHR_TEXTURE_BASISU_NAME "KHR_texture_basisu"
@@ -150,8 +160,12 @@ struct GltfMaterial
     KHR_materials_anisotropy            anisotropy;
     KHR_materials_ior                   ior;
     KHR_materials_volume                volume;
+    KHR_materials_volume_scatter        volumeScatter;
     KHR_materials_displacement          displacement;
 
+    // index into GetMedia() of a KHR_materials_volume material of some thickness and transmission, -1 for none
+    int mediumIndex{ -1 };
+
     // Tiny Reference
     const tinygltf::Material* tmaterial{ nullptr };
 };
@@ -215,6 +229,9 @@ public:
     void destroy();
 
     const std::vector<GltfMaterial>& GetMaterials();
+    // media of the volume materials, entry 1 + i of the media table is medium i. Only the CPU reference reads them,
+    // see Shaders/util/MediaTable.h
+    const std::vector<ParticipatingMedium>& GetMedia();
     const std::vector<GltfNode>& GetNodes();
     const std::vector<GltfPrimMesh>& GetPrimMeshes(); 
 
@@ -231,6 +248,7 @@ public:
 private:
     // Scene data
     std::vector<GltfMaterial> m_materials;   // Material for shading
+    std::vector<ParticipatingMedium> m_media; // Participating media of the volume materials
     std::vector<GltfNode>     m_nodes;       // Drawable nodes, flat hierarchy
     std::vector<GltfPrimMesh> m_primMeshes;  // Primitive promoted to meshes
 